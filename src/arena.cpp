@@ -0,0 +1,94 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "arena.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(MAP_HUGETLB) && !defined(MAP_HUGE_SHIFT)
+#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace badgerdb {
+
+static const std::size_t HUGE_PAGE_2MB = (std::size_t)2 << 20;
+static const std::size_t HUGE_PAGE_1GB = (std::size_t)1 << 30;
+
+static std::size_t roundUp(const std::size_t value, const std::size_t unit) {
+    return (value + unit - 1) / unit * unit;
+}
+
+/**
+ * Maps size bytes of anonymous memory with extra flags, returning NULL on failure.
+ */
+static void* mapAnonymous(const std::size_t size, const int flags) {
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return memory == MAP_FAILED ? NULL : memory;
+}
+
+MemoryArena::MemoryArena(const std::size_t size, const HugePageMode hugePages)
+    : base_(NULL), size_(0), pageSize_((std::size_t)sysconf(_SC_PAGESIZE)), hugePages_(HUGE_PAGES_NONE) {
+#ifdef MAP_HUGETLB
+    if (hugePages == HUGE_PAGES_2MB || hugePages == HUGE_PAGES_1GB) {
+        const std::size_t hugeSize = hugePages == HUGE_PAGES_2MB ? HUGE_PAGE_2MB : HUGE_PAGE_1GB;
+        const int sizeFlag = (hugePages == HUGE_PAGES_2MB ? 21 : 30) << MAP_HUGE_SHIFT;
+        size_ = roundUp(size, hugeSize);
+        base_ = mapAnonymous(size_, MAP_HUGETLB | sizeFlag);
+        if (base_ != NULL) {
+            pageSize_ = hugeSize;
+            hugePages_ = hugePages;
+            return;
+        }
+    }
+#endif
+
+    size_ = roundUp(size > 0 ? size : 1, pageSize_);
+    base_ = mapAnonymous(size_, 0);
+    if (base_ == NULL) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+    if (hugePages != HUGE_PAGES_NONE && madvise(base_, size_, MADV_HUGEPAGE) == 0)
+        hugePages_ = HUGE_PAGES_TRANSPARENT;
+#endif
+}
+
+MemoryArena::~MemoryArena() {
+    munmap(base_, size_);
+}
+
+void MemoryArena::preferNode(const std::size_t offset, const std::size_t length, const int node) {
+#if defined(__linux__) && defined(__NR_mbind)
+    const std::size_t begin = roundUp(offset, pageSize_);
+    const std::size_t end = (offset + length) / pageSize_ * pageSize_;
+    if (begin >= end || node < 0 || node >= (int)(8 * sizeof(unsigned long))) return;
+    unsigned long nodeMask = 1UL << node;
+    syscall(__NR_mbind, static_cast<char*>(base_) + begin, end - begin, MPOL_PREFERRED, &nodeMask,
+            8 * sizeof(nodeMask), 0);
+#endif
+}
+
+int MemoryArena::numaNodes() {
+    // the file lists the online nodes as ranges such as "0-3" or "0,2-3"; the last number is the highest node
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string ranges;
+    if (!std::getline(online, ranges)) return 1;
+    const std::size_t last = ranges.find_last_of(",-");
+    const int highest = std::atoi(ranges.c_str() + (last == std::string::npos ? 0 : last + 1));
+    return highest >= 0 ? highest + 1 : 1;
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,126 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace badgerdb {
+
+/**
+ * Size of a cache line, which buffer frame descriptors are aligned to
+ */
+const std::size_t CACHE_LINE_SIZE = 64;
+
+/**
+ * @brief Kind of pages a memory arena is backed by.
+ */
+enum HugePageMode {
+    /**
+     * Regular pages only
+     */
+    HUGE_PAGES_NONE,
+
+    /**
+     * Regular pages, with the kernel asked to back the arena with transparent huge pages where it can
+     */
+    HUGE_PAGES_TRANSPARENT,
+
+    /**
+     * 2 MB pages reserved through hugetlbfs, falling back to transparent huge pages if none are available
+     */
+    HUGE_PAGES_2MB,
+
+    /**
+     * 1 GB pages reserved through hugetlbfs, falling back to transparent huge pages if none are available
+     */
+    HUGE_PAGES_1GB
+};
+
+/**
+ * @brief How BufMgr lays out the memory of its buffer pool.
+ */
+struct ArenaOptions {
+    /**
+     * Pages backing the frames
+     */
+    HugePageMode hugePages;
+
+    /**
+     * If true and the machine has several NUMA nodes, the frames of each partition are placed on one node,
+     * assigning the partitions to the nodes in turn
+     */
+    bool numaPartitions;
+
+    ArenaOptions() : hugePages(HUGE_PAGES_TRANSPARENT), numaPartitions(true) {}
+};
+
+/**
+ * @brief A block of memory mapped directly from the kernel.
+ *
+ * The block starts on a page boundary, so anything placed at a multiple of DIRECT_IO_ALIGNMENT in it may be
+ * used for direct I/O. Its memory is zero and not yet backed by physical pages until it is first touched,
+ * which lets NUMA placement be chosen before then.
+ */
+class MemoryArena {
+   public:
+    /**
+     * Constructor of MemoryArena class, maps the memory.
+     *
+     * @param size       Number of bytes; rounded up to whole pages of the kind used
+     * @param hugePages  Kind of pages requested
+     * @throws std::bad_alloc if the memory cannot be mapped at all
+     */
+    MemoryArena(const std::size_t size, const HugePageMode hugePages);
+
+    /**
+     * Destructor of MemoryArena class, unmaps the memory
+     */
+    ~MemoryArena();
+
+    /**
+     * Returns the start of the arena.
+     */
+    void* base() const { return base_; }
+
+    /**
+     * Returns the kind of pages the arena actually got, which may be less than requested.
+     */
+    HugePageMode hugePages() const { return hugePages_; }
+
+    /**
+     * Returns the size of the pages backing the arena, as far as it is known.
+     */
+    std::size_t pageSize() const { return pageSize_; }
+
+    /**
+     * Asks the kernel to place the pages of a range on a NUMA node when they are first touched. The range is
+     * shrunk to whole pages of the arena. Placement is a preference; it is silently skipped where the kernel
+     * does not support it.
+     *
+     * @param offset  Start of the range in the arena
+     * @param length  Length of the range
+     * @param node    NUMA node
+     */
+    void preferNode(const std::size_t offset, const std::size_t length, const int node);
+
+    /**
+     * Returns the number of NUMA nodes of the machine, one if it cannot be told.
+     */
+    static int numaNodes();
+
+   private:
+    void* base_;
+    std::size_t size_;
+    std::size_t pageSize_;
+    HugePageMode hugePages_;
+
+    MemoryArena(const MemoryArena&);
+    MemoryArena& operator=(const MemoryArena&);
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,306 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Micro and macro benchmarks of the index and the buffer pool, run by Google Benchmark. Each benchmark is
+ * parameterized over the relation size, the buffer pool size and, where keys are drawn, their distribution, and
+ * reports its operations per second as items_per_second and the p50, p99 and p99.9 latency of one operation.
+ *
+ * Build with "make bench" (OPT=-O2 for optimized numbers, after "make clean") and run src/bench/badgerdb_bench,
+ * with --benchmark_filter to pick benchmarks. The files it makes are written to the working directory.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "bench/workload.h"
+#include "btree.h"
+#include "bufHashTbl.h"
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+
+using namespace badgerdb;
+
+// the shared index is allocated with plain new, which honours no more than the fundamental alignment
+static_assert(alignof(BTreeIndex) <= alignof(std::max_align_t), "BTreeIndex is over-aligned for new");
+
+namespace {
+
+const std::string BENCH_RELATION = "benchRel";
+const std::string BENCH_PAGES = "benchPages";
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Nanoseconds since start.
+ */
+std::uint64_t elapsed(const Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+/**
+ * Reports the operations per second of a run and the latencies of its operations.
+ */
+void report(benchmark::State &state, LatencySamples &latencies) {
+    state.SetItemsProcessed(latencies.count());
+    state.counters["p50_ns"] = latencies.percentile(0.5);
+    state.counters["p99_ns"] = latencies.percentile(0.99);
+    state.counters["p999_ns"] = latencies.percentile(0.999);
+}
+
+/**
+ * @brief Index over the i attribute of a random relation, kept across the benchmarks that only read it while
+ * they ask for the same relation and pool size.
+ */
+struct SharedIndex {
+    int size;
+    int frames;
+    BufMgr *bufMgr;
+    BTreeIndex *index;
+    std::string indexName;
+} shared = {0, 0, NULL, NULL, ""};
+
+void releaseShared() {
+    delete shared.index;
+    delete shared.bufMgr;
+    if (shared.index != NULL) {
+        removeFile(shared.indexName);
+        removeFile(BENCH_RELATION);
+    }
+    shared.index = NULL;
+    shared.bufMgr = NULL;
+}
+
+BTreeIndex &sharedIndex(const int size, const int frames) {
+    if (shared.index != NULL && shared.size == size && shared.frames == frames) return *shared.index;
+    releaseShared();
+    std::vector<int> keys;
+    std::vector<RecordId> rids;
+    createRelation(BENCH_RELATION, size, RELATION_RANDOM, 1, keys, rids);
+    shared.size = size;
+    shared.frames = frames;
+    shared.bufMgr = new BufMgr(frames);
+    shared.index = new BTreeIndex(BENCH_RELATION, shared.indexName, shared.bufMgr, offsetof(BenchRecord, i), INTEGER);
+    return *shared.index;
+}
+
+// -----------------------------------------------------------------------------
+// Index benchmarks
+// -----------------------------------------------------------------------------
+
+/**
+ * Point lookups of existing keys. Arguments: relation size, pool frames, KeyDistribution.
+ */
+void pointLookup(benchmark::State &state) {
+    BTreeIndex &index = sharedIndex(state.range(0), state.range(1));
+    KeyChooser chooser(state.range(0), (KeyDistribution)state.range(2), 7);
+    LatencySamples latencies;
+    for (auto _ : state) {
+        const int key = (int)chooser.next();
+        const Clock::time_point start = Clock::now();
+        benchmark::DoNotOptimize(index.lookup(&key));
+        latencies.add(elapsed(start));
+    }
+    report(state, latencies);
+}
+
+/**
+ * Range scans of a fixed number of keys, starting at a drawn key. Arguments: relation size, pool frames, keys per
+ * scan, KeyDistribution. items_per_second counts scans; entries_per_second counts the entries they return.
+ */
+void rangeScan(benchmark::State &state) {
+    BTreeIndex &index = sharedIndex(state.range(0), state.range(1));
+    const int width = state.range(2);
+    KeyChooser chooser(state.range(0), (KeyDistribution)state.range(3), 11);
+    LatencySamples latencies;
+    RecordId batch[64];
+    std::int64_t entries = 0;
+    for (auto _ : state) {
+        const int low = (int)chooser.next();
+        const int high = low + width;
+        const Clock::time_point start = Clock::now();
+        IndexScanCursor cursor = index.openScan(&low, GTE, &high, LT);
+        std::size_t count;
+        while ((count = cursor.nextBatch(batch, 64)) > 0) entries += count;
+        latencies.add(elapsed(start));
+    }
+    report(state, latencies);
+    state.counters["entries_per_second"] = benchmark::Counter((double)entries, benchmark::Counter::kIsRate);
+}
+
+/**
+ * Inserts of every record of a relation, in file order, into an empty index. Arguments: relation size, pool
+ * frames, RelationOrder.
+ */
+void insert(benchmark::State &state) {
+    std::vector<int> keys;
+    std::vector<RecordId> rids;
+    createRelation(BENCH_RELATION, state.range(0), (RelationOrder)state.range(2), 3, keys, rids);
+    BufMgr bufMgr(state.range(1));
+    const IndexEntries none;
+    LatencySamples latencies;
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::string indexName;
+        {
+            BTreeIndex index(BENCH_RELATION, indexName, &bufMgr, offsetof(BenchRecord, i), INTEGER,
+                             BULKLOAD_FILL_FACTOR, 1, 0, &none);
+            state.ResumeTiming();
+            for (std::size_t i = 0; i < keys.size(); i++) {
+                const Clock::time_point start = Clock::now();
+                index.insertEntry(&keys[i], rids[i]);
+                latencies.add(elapsed(start));
+            }
+            state.PauseTiming();
+        }
+        removeFile(indexName);
+        state.ResumeTiming();
+    }
+    report(state, latencies);
+    removeFile(BENCH_RELATION);
+}
+
+/**
+ * Bulk loads of an index from a scan of its relation. Arguments: relation size, pool frames, RelationOrder.
+ * items_per_second counts entries loaded; the latencies are those of whole loads.
+ */
+void bulkLoad(benchmark::State &state) {
+    std::vector<int> keys;
+    std::vector<RecordId> rids;
+    createRelation(BENCH_RELATION, state.range(0), (RelationOrder)state.range(2), 5, keys, rids);
+    BufMgr bufMgr(state.range(1));
+    LatencySamples latencies;
+    for (auto _ : state) {
+        std::string indexName;
+        const Clock::time_point start = Clock::now();
+        {
+            BTreeIndex index(BENCH_RELATION, indexName, &bufMgr, offsetof(BenchRecord, i), INTEGER);
+        }
+        latencies.add(elapsed(start));
+        state.PauseTiming();
+        removeFile(indexName);
+        state.ResumeTiming();
+    }
+    report(state, latencies);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    removeFile(BENCH_RELATION);
+}
+
+// -----------------------------------------------------------------------------
+// Buffer pool benchmarks
+// -----------------------------------------------------------------------------
+
+/**
+ * Reads and unpins of pages drawn from a file of pages times the pool size, which is read into the pool first.
+ * Arguments: pool frames, pages of the file per 100 frames, KeyDistribution. A file smaller than the pool measures
+ * the hit path, a larger one mostly misses.
+ */
+void bufferRead(benchmark::State &state) {
+    const int frames = state.range(0);
+    const int pages = std::max(1, (int)(frames * state.range(1) / 100));
+    removeFile(BENCH_PAGES);
+    BufMgr bufMgr(frames);
+    {
+        LatencySamples latencies;
+        PageFile file(BENCH_PAGES, true);
+        std::vector<PageId> pageNos(pages);
+        for (int i = 0; i < pages; i++) {
+            Page *page;
+            bufMgr.allocPage(&file, pageNos[i], page);
+            bufMgr.unPinPage(&file, pageNos[i], true);
+        }
+        bufMgr.flushFile(&file);
+        for (int i = 0; i < pages; i++) {
+            Page *page;
+            bufMgr.readPage(&file, pageNos[i], page);
+            bufMgr.unPinPage(&file, pageNos[i], false);
+        }
+        KeyChooser chooser(pages, (KeyDistribution)state.range(2), 13);
+        bufMgr.clearBufStats();
+        for (auto _ : state) {
+            const PageId pageNo = pageNos[chooser.next()];
+            const Clock::time_point start = Clock::now();
+            Page *page;
+            bufMgr.readPage(&file, pageNo, page);
+            bufMgr.unPinPage(&file, pageNo, false);
+            latencies.add(elapsed(start));
+        }
+        report(state, latencies);
+        const BufStats &stats = bufMgr.getBufStats();
+        state.counters["disk_reads_per_op"] = (double)stats.diskreads / state.iterations();
+        bufMgr.flushFile(&file);
+    }
+    removeFile(BENCH_PAGES);
+}
+
+/**
+ * Insert, lookup and remove of frames in a BufHashTbl holding a fixed number of pages. Arguments: pages held.
+ * One operation is the three calls for one page.
+ */
+void hashTable(benchmark::State &state) {
+    const int held = state.range(0);
+    removeFile(BENCH_PAGES);
+    {
+        PageFile file(BENCH_PAGES, true);
+        // sized as the buffer manager sizes its table for as many frames
+        BufHashTbl table(((int)(held * 1.2) * 2) / 2 + 1);
+        for (int i = 0; i < held; i++) table.insert(&file, i, i);
+        KeyChooser chooser(held, KEYS_UNIFORM, 17);
+        LatencySamples latencies;
+        PageId next = held;
+        for (auto _ : state) {
+            const PageId victim = (PageId)chooser.next();
+            const Clock::time_point start = Clock::now();
+            FrameId frame;
+            table.lookup(&file, victim, frame);
+            table.remove(&file, victim);
+            table.insert(&file, next, frame);
+            benchmark::DoNotOptimize(frame);
+            latencies.add(elapsed(start));
+            // the page inserted takes the place of the one removed, so the keys drawn stay held
+            table.remove(&file, next);
+            table.insert(&file, victim, frame);
+        }
+        report(state, latencies);
+    }
+    removeFile(BENCH_PAGES);
+}
+
+}  // namespace
+
+BENCHMARK(pointLookup)
+    ->ArgNames({"records", "frames", "zipfian"})
+    ->ArgsProduct({{10000, 100000, 1000000}, {100, 1000, 10000}, {KEYS_UNIFORM, KEYS_ZIPFIAN}});
+BENCHMARK(rangeScan)
+    ->ArgNames({"records", "frames", "width", "zipfian"})
+    ->ArgsProduct({{100000, 1000000}, {100, 10000}, {10, 1000}, {KEYS_UNIFORM, KEYS_ZIPFIAN}});
+BENCHMARK(insert)
+    ->ArgNames({"records", "frames", "order"})
+    ->ArgsProduct({{10000, 100000}, {100, 10000}, {RELATION_FORWARD, RELATION_BACKWARD, RELATION_RANDOM}})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(bulkLoad)
+    ->ArgNames({"records", "frames", "order"})
+    ->ArgsProduct({{100000, 1000000}, {100, 10000}, {RELATION_FORWARD, RELATION_RANDOM}})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(bufferRead)
+    ->ArgNames({"frames", "pagesPct", "zipfian"})
+    ->ArgsProduct({{100, 1000, 10000}, {50, 400}, {KEYS_UNIFORM, KEYS_ZIPFIAN}});
+BENCHMARK(hashTable)->ArgName("pages")->Arg(100)->Arg(10000)->Arg(1000000);
+
+int main(int argc, char **argv) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    releaseShared();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,156 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "bench/workload.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+#include "file.h"
+#include "page.h"
+
+namespace badgerdb {
+
+void removeFile(const std::string& name) {
+    try {
+        File::remove(name);
+    } catch (const FileNotFoundException& e) {
+    }
+}
+
+void createRelation(const std::string& name, const int size, const RelationOrder order, const std::uint64_t seed,
+                    std::vector<int>& keys, std::vector<RecordId>& rids) {
+    keys.resize(size);
+    for (int i = 0; i < size; i++) keys[i] = order == RELATION_BACKWARD ? size - 1 - i : i;
+    if (order == RELATION_RANDOM) {
+        std::mt19937_64 random(seed);
+        std::shuffle(keys.begin(), keys.end(), random);
+    }
+
+    removeFile(name);
+    PageFile file(name, true);
+    BenchRecord record;
+    // initialize all of record.s, so no uninitialized byte reaches the file
+    memset(record.s, ' ', sizeof(record.s));
+    PageId pageNo;
+    Page page = file.allocatePage(pageNo);
+    rids.clear();
+    rids.reserve(size);
+    for (int i = 0; i < size; i++) {
+        sprintf(record.s, "%05d string record", keys[i]);
+        record.i = keys[i];
+        record.d = keys[i];
+        const std::string data(reinterpret_cast<char*>(&record), sizeof(record));
+        while (true) {
+            try {
+                rids.push_back(page.insertRecord(data));
+                break;
+            } catch (const InsufficientSpaceException& e) {
+                file.writePage(pageNo, page);
+                page = file.allocatePage(pageNo);
+            }
+        }
+    }
+    file.writePage(pageNo, page);
+}
+
+KeyChooser::KeyChooser(const std::uint64_t n, const KeyDistribution distribution, const std::uint64_t seed)
+    : n(n), distribution(distribution), random(seed), unit(0.0, 1.0), alpha(0), zetan(0), eta(0), halfPowTheta(0) {
+    if (distribution != KEYS_ZIPFIAN) return;
+    for (std::uint64_t i = 1; i <= n; i++) zetan += 1.0 / std::pow((double)i, ZIPFIAN_THETA);
+    const double zeta2 = 1.0 + 1.0 / std::pow(2.0, ZIPFIAN_THETA);
+    alpha = 1.0 / (1.0 - ZIPFIAN_THETA);
+    eta = (1.0 - std::pow(2.0 / n, 1.0 - ZIPFIAN_THETA)) / (1.0 - zeta2 / zetan);
+    halfPowTheta = 1.0 + std::pow(0.5, ZIPFIAN_THETA);
+}
+
+std::uint64_t KeyChooser::nextRank() {
+    const double u = unit(random);
+    const double uz = u * zetan;
+    if (uz < 1.0) return 0;
+    if (uz < halfPowTheta) return 1;
+    const std::uint64_t rank = (std::uint64_t)(n * std::pow(eta * u - eta + 1.0, alpha));
+    return std::min(rank, n - 1);
+}
+
+std::uint64_t KeyChooser::next() {
+    if (distribution == KEYS_UNIFORM) return std::uniform_int_distribution<std::uint64_t>(0, n - 1)(random);
+    // FNV-1a of the rank scatters the hot keys, as YCSB's scrambled Zipfian does
+    std::uint64_t hash = 14695981039346656037ULL;
+    std::uint64_t rank = nextRank();
+    for (int i = 0; i < 8; i++) {
+        hash ^= rank & 0xff;
+        hash *= 1099511628211ULL;
+        rank >>= 8;
+    }
+    return hash % n;
+}
+
+std::uint64_t LatencySamples::percentile(const double fraction) {
+    if (samples.empty()) return 0;
+    if (!sorted) {
+        std::sort(samples.begin(), samples.end());
+        sorted = true;
+    }
+    const std::size_t rank = (std::size_t)std::ceil(fraction * samples.size());
+    return samples[rank == 0 ? 0 : rank - 1];
+}
+
+LatencyHistogram::LatencyHistogram()
+    : counts((1 << SUB_BUCKET_BITS) + (64 - SUB_BUCKET_BITS) * (1 << (SUB_BUCKET_BITS - 1)), 0), total(0), sum(0),
+      smallest(~0ULL), largest(0) {}
+
+int LatencyHistogram::bucketOf(const std::uint64_t nanos) {
+    if (nanos < (1ULL << SUB_BUCKET_BITS)) return (int)nanos;
+    // the top SUB_BUCKET_BITS bits of the latency, whose highest is always set, pick the bucket of its power of two
+    const int shift = 63 - __builtin_clzll(nanos) - (SUB_BUCKET_BITS - 1);
+    const int half = 1 << (SUB_BUCKET_BITS - 1);
+    return (1 << SUB_BUCKET_BITS) + (shift - 1) * half + (int)(nanos >> shift) - half;
+}
+
+std::uint64_t LatencyHistogram::highestIn(const int bucket) {
+    if (bucket < (1 << SUB_BUCKET_BITS)) return bucket;
+    const int half = 1 << (SUB_BUCKET_BITS - 1);
+    const int shift = (bucket - (1 << SUB_BUCKET_BITS)) / half + 1;
+    const std::uint64_t top = (bucket - (1 << SUB_BUCKET_BITS)) % half + half;
+    return ((top + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(const std::uint64_t nanos) {
+    counts[bucketOf(nanos)]++;
+    total++;
+    sum += nanos;
+    smallest = std::min(smallest, nanos);
+    largest = std::max(largest, nanos);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (std::size_t i = 0; i < counts.size(); i++) counts[i] += other.counts[i];
+    total += other.total;
+    sum += other.sum;
+    smallest = std::min(smallest, other.smallest);
+    largest = std::max(largest, other.largest);
+}
+
+std::uint64_t LatencyHistogram::percentile(const double fraction) const {
+    if (total == 0) return 0;
+    const std::uint64_t rank = std::max<std::uint64_t>(1, (std::uint64_t)std::ceil(fraction * total));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts.size(); i++) {
+        seen += counts[i];
+        // the largest latency counted is known exactly, and no bucket reaches past it
+        if (seen >= rank) return std::min(highestIn((int)i), largest);
+    }
+    return largest;
+}
+
+}  // namespace badgerdb
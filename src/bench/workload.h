@@ -0,0 +1,239 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Order the records of a generated relation are written in, as by the test driver's createRelationForward,
+ * createRelationBackward and createRelationRandom.
+ */
+enum RelationOrder {
+    /**
+     * Keys 0 to size - 1 in increasing order
+     */
+    RELATION_FORWARD,
+
+    /**
+     * Keys size - 1 down to 0
+     */
+    RELATION_BACKWARD,
+
+    /**
+     * Keys 0 to size - 1 shuffled
+     */
+    RELATION_RANDOM
+};
+
+/**
+ * @brief Distribution the keys of a workload are drawn from.
+ */
+enum KeyDistribution {
+    /**
+     * Every key equally likely
+     */
+    KEYS_UNIFORM,
+
+    /**
+     * Zipfian with the skew of YCSB; the hottest keys are scattered over the key space rather than next to each
+     * other
+     */
+    KEYS_ZIPFIAN
+};
+
+/**
+ * @brief Tuple of a generated relation, laid out as the test driver's tuples are.
+ */
+struct BenchRecord {
+    int i;
+    double d;
+    char s[64];
+};
+
+/**
+ * Writes a relation of size records with keys 0 to size - 1, replacing any file of that name. The tuple with key
+ * k holds k in i and d, and k in the string s starts with.
+ *
+ * @param name      Relation file to write
+ * @param size      Number of records
+ * @param order     Order the records are written in
+ * @param seed      Seed of the shuffle of a random order
+ * @param keys      Returns the key of each record, in file order
+ * @param rids      Returns the record id of each record, in file order
+ */
+void createRelation(const std::string& name, const int size, const RelationOrder order, const std::uint64_t seed,
+                    std::vector<int>& keys, std::vector<RecordId>& rids);
+
+/**
+ * Removes a file if it exists.
+ *
+ * @param name  File to remove
+ */
+void removeFile(const std::string& name);
+
+/**
+ * @brief Draws keys from 0 to n - 1 under a KeyDistribution.
+ *
+ * The Zipfian keys follow the generator of Gray et al., "Quickly Generating Billion-Record Synthetic Databases",
+ * which YCSB uses: drawing a key is constant time once the zeta constant of n keys is computed, which takes time
+ * linear in n when the chooser is made. Each thread draws from a chooser of its own.
+ */
+class KeyChooser {
+   public:
+    /**
+     * Skew of the Zipfian distribution, that of YCSB.
+     */
+    static constexpr double ZIPFIAN_THETA = 0.99;
+
+    /**
+     * @param n             Number of keys
+     * @param distribution  Distribution to draw keys from
+     * @param seed          Seed of the chooser's random numbers
+     */
+    KeyChooser(const std::uint64_t n, const KeyDistribution distribution, const std::uint64_t seed);
+
+    /**
+     * @return  Next key, in [0, n)
+     */
+    std::uint64_t next();
+
+    /**
+     * @return  Number of keys drawn from
+     */
+    std::uint64_t keys() const { return n; }
+
+   private:
+    /**
+     * Rank of the next key in the Zipfian distribution, 0 the most frequent.
+     */
+    std::uint64_t nextRank();
+
+    std::uint64_t n;
+    KeyDistribution distribution;
+    std::mt19937_64 random;
+    std::uniform_real_distribution<double> unit;
+    double alpha;
+    double zetan;
+    double eta;
+    double halfPowTheta;
+};
+
+/**
+ * @brief Latencies of the operations of a run, in nanoseconds, kept whole so percentiles are exact.
+ */
+class LatencySamples {
+   public:
+    LatencySamples() : sorted(false) {}
+
+    /**
+     * Adds the latency of one operation.
+     */
+    void add(const std::uint64_t nanos) {
+        samples.push_back(nanos);
+        sorted = false;
+    }
+
+    /**
+     * Adds every latency of another run.
+     */
+    void merge(const LatencySamples& other) {
+        samples.insert(samples.end(), other.samples.begin(), other.samples.end());
+        sorted = false;
+    }
+
+    /**
+     * @param fraction  Fraction [0, 1] of the operations at most as slow as the latency returned
+     * @return          That latency, in nanoseconds; 0 without samples
+     */
+    std::uint64_t percentile(const double fraction);
+
+    /**
+     * @return  Number of latencies added
+     */
+    std::size_t count() const { return samples.size(); }
+
+    void clear() { samples.clear(); }
+
+   private:
+    std::vector<std::uint64_t> samples;
+    bool sorted;
+};
+
+/**
+ * @brief Log-linear histogram of latencies in nanoseconds, in the manner of HdrHistogram.
+ *
+ * Latencies below 2^SUB_BUCKET_BITS are counted exactly; above, each power of two is split into 2^(SUB_BUCKET_BITS
+ * - 1) equal buckets, so a latency is known to within 1 part in 128 whatever its size. Recording is a few shifts
+ * and an increment into a fixed array, cheap enough to time every operation; each thread keeps its own histogram
+ * and the histograms are merged when the run is over.
+ */
+class LatencyHistogram {
+   public:
+    /**
+     * Bits of precision of each bucket.
+     */
+    static const int SUB_BUCKET_BITS = 8;
+
+    LatencyHistogram();
+
+    /**
+     * Counts one latency.
+     */
+    void record(const std::uint64_t nanos);
+
+    /**
+     * Adds the counts of another histogram.
+     */
+    void merge(const LatencyHistogram& other);
+
+    /**
+     * @param fraction  Fraction [0, 1] of the latencies at most as large as the value returned
+     * @return          Largest latency of the bucket that fraction ends in, 0 if the histogram is empty
+     */
+    std::uint64_t percentile(const double fraction) const;
+
+    /**
+     * @return  Number of latencies counted
+     */
+    std::uint64_t count() const { return total; }
+
+    /**
+     * @return  Mean latency, exact as the sum is kept aside from the buckets
+     */
+    double mean() const { return total == 0 ? 0 : (double)sum / total; }
+
+    std::uint64_t min() const { return total == 0 ? 0 : smallest; }
+
+    std::uint64_t max() const { return largest; }
+
+   private:
+    /**
+     * Bucket a latency is counted in.
+     */
+    static int bucketOf(const std::uint64_t nanos);
+
+    /**
+     * Largest latency counted in a bucket.
+     */
+    static std::uint64_t highestIn(const int bucket);
+
+    std::vector<std::uint64_t> counts;
+    std::uint64_t total;
+    std::uint64_t sum;
+    std::uint64_t smallest;
+    std::uint64_t largest;
+};
+
+}  // namespace badgerdb
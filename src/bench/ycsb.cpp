@@ -0,0 +1,376 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * YCSB-style workload driver. Threads run a mix of point reads, inserts and short range scans against one index
+ * on one shared buffer pool, drawing keys uniformly or Zipfian. Each run loads a fresh index, runs the mix for a
+ * warm-up period uncounted, then for the measured period, timing every operation into per-thread histograms.
+ *
+ * Usage: badgerdb_ycsb [--name=value ...], with the options and defaults of Options below, e.g.
+ *   ./badgerdb_ycsb --threads=1,2,4,8 --read=90 --insert=5 --scan=5 --distribution=zipfian --format=csv
+ * runs the mix once for each thread count, so a scalability regression shows as a row that stops improving.
+ */
+
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench/workload.h"
+#include "btree.h"
+#include "buffer.h"
+#include "exceptions/no_such_key_found_exception.h"
+
+using namespace badgerdb;
+
+namespace {
+
+const std::string YCSB_RELATION = "ycsbRel";
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief Kinds of operation of the mix.
+ */
+enum Operation { OP_READ, OP_INSERT, OP_SCAN, OP_COUNT };
+
+const char *const OPERATION_NAMES[OP_COUNT] = {"read", "insert", "scan"};
+
+/**
+ * @brief Options of the driver, each given as --name=value.
+ */
+struct Options {
+    /** Thread counts to run the mix with, one run each (threads) */
+    std::vector<int> threads;
+    /** Records loaded before each run (records) */
+    int records;
+    /** Buffer pool frames (frames) */
+    int frames;
+    /** Buffer pool partitions (partitions) */
+    int partitions;
+    /** Seconds of warm-up, not counted (warmup) */
+    double warmup;
+    /** Seconds measured (seconds) */
+    double seconds;
+    /** Relative weights of the operations (read, insert, scan) */
+    int weights[OP_COUNT];
+    /** Most entries a scan returns; each scan returns 1 to this many, uniformly (scan-length) */
+    int scanLength;
+    /** Distribution of the keys read and scanned from (distribution: uniform or zipfian) */
+    KeyDistribution distribution;
+    /** Output format (format: text, csv or json) */
+    std::string format;
+    /** File written instead of standard output, if not empty (output) */
+    std::string output;
+
+    Options()
+        : records(100000), frames(1000), partitions(8), warmup(1), seconds(5), scanLength(100),
+          distribution(KEYS_ZIPFIAN), format("text") {
+        threads.push_back(4);
+        weights[OP_READ] = 95;
+        weights[OP_INSERT] = 5;
+        weights[OP_SCAN] = 0;
+    }
+};
+
+/**
+ * @brief What one thread did while the run was measured.
+ */
+struct ThreadResult {
+    LatencyHistogram latencies[OP_COUNT];
+    /** Scans that found no entry, and reads that found no record id */
+    std::uint64_t empty;
+
+    ThreadResult() : empty(0) {}
+};
+
+/**
+ * @brief What one run did, for one thread count.
+ */
+struct RunResult {
+    int threads;
+    double seconds;
+    ThreadResult total;
+};
+
+/**
+ * Parses a comma-separated list of positive integers.
+ */
+bool parseList(const std::string &value, std::vector<int> &out) {
+    out.clear();
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        const int n = atoi(item.c_str());
+        if (n <= 0) return false;
+        out.push_back(n);
+    }
+    return !out.empty();
+}
+
+/**
+ * Reads the options from the command line.
+ *
+ * @return  False, having printed why, if an option is unknown or its value is not valid
+ */
+bool parseOptions(const int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const std::size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+            std::cerr << "expected --name=value, got " << arg << std::endl;
+            return false;
+        }
+        const std::string name = arg.substr(2, eq - 2);
+        const std::string value = arg.substr(eq + 1);
+        bool valid = true;
+        if (name == "threads") {
+            valid = parseList(value, options.threads);
+        } else if (name == "records") {
+            options.records = atoi(value.c_str());
+            valid = options.records > 0;
+        } else if (name == "frames") {
+            options.frames = atoi(value.c_str());
+            valid = options.frames > 0;
+        } else if (name == "partitions") {
+            options.partitions = atoi(value.c_str());
+            valid = options.partitions > 0;
+        } else if (name == "warmup") {
+            options.warmup = atof(value.c_str());
+            valid = options.warmup >= 0;
+        } else if (name == "seconds") {
+            options.seconds = atof(value.c_str());
+            valid = options.seconds > 0;
+        } else if (name == "read" || name == "insert" || name == "scan") {
+            const Operation op = name == "read" ? OP_READ : name == "insert" ? OP_INSERT : OP_SCAN;
+            options.weights[op] = atoi(value.c_str());
+            valid = options.weights[op] >= 0;
+        } else if (name == "scan-length") {
+            options.scanLength = atoi(value.c_str());
+            valid = options.scanLength > 0;
+        } else if (name == "distribution") {
+            options.distribution = value == "uniform" ? KEYS_UNIFORM : KEYS_ZIPFIAN;
+            valid = value == "uniform" || value == "zipfian";
+        } else if (name == "format") {
+            options.format = value;
+            valid = value == "text" || value == "csv" || value == "json";
+        } else if (name == "output") {
+            options.output = value;
+        } else {
+            std::cerr << "unknown option " << name << std::endl;
+            return false;
+        }
+        if (!valid) {
+            std::cerr << "bad value for " << name << ": " << value << std::endl;
+            return false;
+        }
+    }
+    if (options.weights[OP_READ] + options.weights[OP_INSERT] + options.weights[OP_SCAN] == 0) {
+        std::cerr << "every operation has weight 0" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief State the threads of a run share.
+ */
+struct SharedRun {
+    const Options *options;
+    BTreeIndex *index;
+    /** 0 while warming up, 1 while measured, 2 once the threads are to stop */
+    std::atomic<int> phase;
+    /** Next key an insert adds, past every key loaded */
+    std::atomic<int> nextKey;
+};
+
+/**
+ * Runs the mix on one thread until the run stops, counting what it does while the run is measured.
+ */
+void worker(SharedRun &run, const int id, ThreadResult &result) {
+    const Options &options = *run.options;
+    KeyChooser chooser(options.records, options.distribution, 1000 + id);
+    std::mt19937_64 random(id);
+    const int totalWeight = options.weights[OP_READ] + options.weights[OP_INSERT] + options.weights[OP_SCAN];
+    const int highKey = INT_MAX;
+    RecordId batch[64];
+    int phase;
+    while ((phase = run.phase.load(std::memory_order_relaxed)) < 2) {
+        const int pick = (int)(random() % totalWeight);
+        const Operation op = pick < options.weights[OP_READ]                                 ? OP_READ
+                             : pick < options.weights[OP_READ] + options.weights[OP_INSERT] ? OP_INSERT
+                                                                                              : OP_SCAN;
+        bool empty = false;
+        const Clock::time_point start = Clock::now();
+        if (op == OP_READ) {
+            const int key = (int)chooser.next();
+            empty = run.index->lookup(&key).empty();
+        } else if (op == OP_INSERT) {
+            // the entries inserted have no record behind them; the index does not look
+            const int key = run.nextKey.fetch_add(1, std::memory_order_relaxed);
+            RecordId rid;
+            rid.page_number = key / 64 + 1;
+            rid.slot_number = key % 64 + 1;
+            run.index->insertEntry(&key, rid);
+        } else {
+            const int low = (int)chooser.next();
+            const std::size_t length = 1 + random() % options.scanLength;
+            try {
+                IndexScanCursor cursor =
+                    run.index->openScan(&low, GTE, &highKey, LTE, false, ScanOptions(SCAN_ASCENDING, length));
+                while (cursor.nextBatch(batch, 64) > 0) {
+                }
+            } catch (const NoSuchKeyFoundException &e) {
+                empty = true;
+            }
+        }
+        if (phase != 1) continue;
+        const Clock::duration latency = Clock::now() - start;
+        result.latencies[op].record(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+        if (empty) result.empty++;
+    }
+}
+
+/**
+ * Loads a fresh index and runs the mix on it with a number of threads.
+ */
+RunResult runMix(const Options &options, const int threads) {
+    std::vector<int> keys;
+    std::vector<RecordId> rids;
+    createRelation(YCSB_RELATION, options.records, RELATION_RANDOM, 1, keys, rids);
+    RunResult result;
+    result.threads = threads;
+    {
+        BufMgr bufMgr(options.frames, options.partitions);
+        std::string indexName;
+        {
+            BTreeIndex index(YCSB_RELATION, indexName, &bufMgr, offsetof(BenchRecord, i), INTEGER);
+            SharedRun run;
+            run.options = &options;
+            run.index = &index;
+            run.phase = 0;
+            run.nextKey = options.records;
+            std::vector<ThreadResult> results(threads);
+            std::vector<std::thread> workers;
+            for (int i = 0; i < threads; i++)
+                workers.push_back(std::thread(worker, std::ref(run), i, std::ref(results[i])));
+            std::this_thread::sleep_for(std::chrono::duration<double>(options.warmup));
+            run.phase = 1;
+            const Clock::time_point start = Clock::now();
+            std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+            run.phase = 2;
+            result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            for (int i = 0; i < threads; i++) {
+                workers[i].join();
+                for (int op = 0; op < OP_COUNT; op++) result.total.latencies[op].merge(results[i].latencies[op]);
+                result.total.empty += results[i].empty;
+            }
+        }
+        removeFile(indexName);
+    }
+    removeFile(YCSB_RELATION);
+    return result;
+}
+
+/**
+ * Operations of a run per second, of one kind or OP_COUNT for all.
+ */
+double throughput(const RunResult &result, const int op) {
+    std::uint64_t count = 0;
+    for (int i = 0; i < OP_COUNT; i++)
+        if (op == OP_COUNT || op == i) count += result.total.latencies[i].count();
+    return count / result.seconds;
+}
+
+void writeText(std::ostream &out, const Options &options, const std::vector<RunResult> &results) {
+    for (std::size_t r = 0; r < results.size(); r++) {
+        const RunResult &result = results[r];
+        out << "threads " << result.threads << ": " << (std::uint64_t)throughput(result, OP_COUNT) << " ops/s over "
+            << result.seconds << " s, " << result.total.empty << " empty" << std::endl;
+        for (int op = 0; op < OP_COUNT; op++) {
+            const LatencyHistogram &h = result.total.latencies[op];
+            if (h.count() == 0) continue;
+            out << "  " << OPERATION_NAMES[op] << ": " << h.count() << " ops, " << (std::uint64_t)throughput(result, op)
+                << " ops/s, ns mean " << (std::uint64_t)h.mean() << " p50 " << h.percentile(0.5) << " p90 "
+                << h.percentile(0.9) << " p99 " << h.percentile(0.99) << " p99.9 " << h.percentile(0.999) << " max "
+                << h.max() << std::endl;
+        }
+    }
+}
+
+void writeCsv(std::ostream &out, const Options &options, const std::vector<RunResult> &results) {
+    out << "threads,operation,count,ops_per_sec,mean_ns,min_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns" << std::endl;
+    for (std::size_t r = 0; r < results.size(); r++) {
+        const RunResult &result = results[r];
+        for (int op = 0; op < OP_COUNT; op++) {
+            const LatencyHistogram &h = result.total.latencies[op];
+            if (h.count() == 0) continue;
+            out << result.threads << "," << OPERATION_NAMES[op] << "," << h.count() << ","
+                << (std::uint64_t)throughput(result, op) << "," << (std::uint64_t)h.mean() << "," << h.min() << ","
+                << h.percentile(0.5) << "," << h.percentile(0.9) << "," << h.percentile(0.99) << ","
+                << h.percentile(0.999) << "," << h.max() << std::endl;
+        }
+    }
+}
+
+void writeJson(std::ostream &out, const Options &options, const std::vector<RunResult> &results) {
+    out << "{\"records\": " << options.records << ", \"frames\": " << options.frames
+        << ", \"partitions\": " << options.partitions << ", \"distribution\": \""
+        << (options.distribution == KEYS_ZIPFIAN ? "zipfian" : "uniform") << "\", \"weights\": {";
+    for (int op = 0; op < OP_COUNT; op++)
+        out << (op > 0 ? ", " : "") << "\"" << OPERATION_NAMES[op] << "\": " << options.weights[op];
+    out << "}, \"runs\": [";
+    for (std::size_t r = 0; r < results.size(); r++) {
+        const RunResult &result = results[r];
+        out << (r > 0 ? ", " : "") << "{\"threads\": " << result.threads << ", \"seconds\": " << result.seconds
+            << ", \"ops_per_sec\": " << throughput(result, OP_COUNT) << ", \"empty\": " << result.total.empty
+            << ", \"operations\": {";
+        bool first = true;
+        for (int op = 0; op < OP_COUNT; op++) {
+            const LatencyHistogram &h = result.total.latencies[op];
+            if (h.count() == 0) continue;
+            out << (first ? "" : ", ") << "\"" << OPERATION_NAMES[op] << "\": {\"count\": " << h.count()
+                << ", \"ops_per_sec\": " << throughput(result, op) << ", \"mean_ns\": " << h.mean()
+                << ", \"min_ns\": " << h.min() << ", \"p50_ns\": " << h.percentile(0.5)
+                << ", \"p90_ns\": " << h.percentile(0.9) << ", \"p99_ns\": " << h.percentile(0.99)
+                << ", \"p999_ns\": " << h.percentile(0.999) << ", \"max_ns\": " << h.max() << "}";
+            first = false;
+        }
+        out << "}}";
+    }
+    out << "]}" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) return 1;
+    std::vector<RunResult> results;
+    for (std::size_t i = 0; i < options.threads.size(); i++) results.push_back(runMix(options, options.threads[i]));
+
+    std::ofstream file;
+    if (!options.output.empty()) file.open(options.output.c_str());
+    std::ostream &out = options.output.empty() ? std::cout : file;
+    if (options.format == "csv") {
+        writeCsv(out, options, results);
+    } else if (options.format == "json") {
+        writeJson(out, options, results);
+    } else {
+        writeText(out, options, results);
+    }
+    return 0;
+}
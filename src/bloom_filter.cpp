@@ -0,0 +1,107 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "bloom_filter.h"
+
+#include <fstream>
+
+namespace badgerdb {
+
+/**
+ * Words of a filter's block, one cache line, within which all the bits of a key lie.
+ */
+static const std::size_t BLOOM_BLOCK_WORDS = 8;
+
+/**
+ * Marks a filter file.
+ */
+static const std::uint32_t BLOOM_FILE_MAGIC = 0x424c4f4d;
+
+BloomFilter::BloomFilter() : probes(0) {}
+
+BloomFilter::BloomFilter(const std::size_t keys, const int bitsPerKey) {
+    // k = bits per key * ln 2 minimizes the false positives
+    probes = (std::uint32_t)(bitsPerKey * 69 / 100);
+    if (probes < 1) probes = 1;
+    if (probes > 16) probes = 16;
+    std::size_t blocks = (keys * bitsPerKey + BLOOM_BLOCK_WORDS * 64 - 1) / (BLOOM_BLOCK_WORDS * 64);
+    if (blocks == 0) blocks = 1;
+    words.assign(blocks * BLOOM_BLOCK_WORDS, 0);
+}
+
+std::uint64_t BloomFilter::hash(const void* data, const std::size_t length) {
+    // FNV-1a, then a 64-bit finalizer so that every bit depends on every byte
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    std::uint64_t h = 14695981039346656037ull;
+    for (std::size_t i = 0; i < length; i++) {
+        h ^= bytes[i];
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+void BloomFilter::add(const std::uint64_t keyHash) {
+    if (words.empty()) return;
+    std::uint64_t* block = &words[(keyHash % (words.size() / BLOOM_BLOCK_WORDS)) * BLOOM_BLOCK_WORDS];
+    // the upper half picks the bits within the block, stepping by the lower half
+    std::uint32_t bit = (std::uint32_t)(keyHash >> 32);
+    const std::uint32_t step = (std::uint32_t)keyHash | 1;
+    for (std::uint32_t i = 0; i < probes; i++, bit += step) {
+        const std::uint32_t b = bit % (BLOOM_BLOCK_WORDS * 64);
+        // inserts into one index add their keys from several threads, and a plain or would lose bits
+        __atomic_fetch_or(&block[b / 64], 1ull << (b % 64), __ATOMIC_RELAXED);
+    }
+}
+
+bool BloomFilter::mayContain(const std::uint64_t keyHash) const {
+    if (words.empty()) return true;
+    const std::uint64_t* block = &words[(keyHash % (words.size() / BLOOM_BLOCK_WORDS)) * BLOOM_BLOCK_WORDS];
+    std::uint32_t bit = (std::uint32_t)(keyHash >> 32);
+    const std::uint32_t step = (std::uint32_t)keyHash | 1;
+    for (std::uint32_t i = 0; i < probes; i++, bit += step) {
+        const std::uint32_t b = bit % (BLOOM_BLOCK_WORDS * 64);
+        if ((__atomic_load_n(&block[b / 64], __ATOMIC_RELAXED) & (1ull << (b % 64))) == 0) return false;
+    }
+    return true;
+}
+
+bool BloomFilter::save(const std::string& name) const {
+    std::ofstream out(name.c_str(), std::ios::binary | std::ios::trunc);
+    const std::uint32_t magic = BLOOM_FILE_MAGIC;
+    const std::uint64_t count = words.size();
+    out.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+    out.write(reinterpret_cast<const char*>(&probes), sizeof(probes));
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char*>(words.data()), count * sizeof(std::uint64_t));
+    return (bool)out;
+}
+
+bool BloomFilter::load(const std::string& name) {
+    words.clear();
+    probes = 0;
+    std::ifstream in(name.c_str(), std::ios::binary);
+    std::uint32_t magic = 0;
+    std::uint32_t stored = 0;
+    std::uint64_t count = 0;
+    in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    in.read(reinterpret_cast<char*>(&stored), sizeof(stored));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!in || magic != BLOOM_FILE_MAGIC || count == 0 || count % BLOOM_BLOCK_WORDS != 0) return false;
+    std::vector<std::uint64_t> read(count);
+    in.read(reinterpret_cast<char*>(read.data()), count * sizeof(std::uint64_t));
+    if (!in) return false;
+    words.swap(read);
+    probes = stored;
+    return true;
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,96 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace badgerdb {
+
+/**
+ * @brief Bits per key a BloomFilter is sized with by default, which makes about 1% of absent keys pass.
+ */
+const int BLOOM_BITS_PER_KEY = 10;
+
+/**
+ * @brief Bloom filter over the 64-bit hashes of a set of keys.
+ *
+ * mayContain is never false for a key that was added, and is false for most keys that were not, so a caller can
+ * skip looking for those. Each key sets a few bits picked by double hashing from its one hash, all within one
+ * cache line of the filter, so a probe touches a single line. add and mayContain may be called from several
+ * threads at once.
+ */
+class BloomFilter {
+   public:
+    /**
+     * Constructor of BloomFilter class, creates a filter that passes every key, as for a set whose keys are not
+     * known.
+     */
+    BloomFilter();
+
+    /**
+     * Constructor of BloomFilter class, creates an empty filter sized for a number of keys.
+     *
+     * @param keys          Number of keys expected
+     * @param bitsPerKey    Bits of filter per key
+     */
+    BloomFilter(const std::size_t keys, const int bitsPerKey = BLOOM_BITS_PER_KEY);
+
+    /**
+     * Returns the hash of a key's bytes, for add and mayContain.
+     *
+     * @param data      Key
+     * @param length    Bytes of the key
+     */
+    static std::uint64_t hash(const void* data, const std::size_t length);
+
+    /**
+     * Adds a key.
+     *
+     * @param keyHash   Hash of the key
+     */
+    void add(const std::uint64_t keyHash);
+
+    /**
+     * Returns false if the key was certainly not added.
+     *
+     * @param keyHash   Hash of the key
+     */
+    bool mayContain(const std::uint64_t keyHash) const;
+
+    /**
+     * Writes the filter to a file, replacing it.
+     *
+     * @param name  Name of the file
+     * @return      False if the file could not be written
+     */
+    bool save(const std::string& name) const;
+
+    /**
+     * Reads a filter written by save. If the file is missing or damaged the filter passes every key.
+     *
+     * @param name  Name of the file
+     * @return      False if no filter could be read
+     */
+    bool load(const std::string& name);
+
+   private:
+    /**
+     * Bits of the filter; empty for a filter that passes every key
+     */
+    std::vector<std::uint64_t> words;
+
+    /**
+     * Bits set per key
+     */
+    std::uint32_t probes;
+};
+
+}  // namespace badgerdb
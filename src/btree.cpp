@@ -7,789 +7,4267 @@
 
 #include "btree.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <limits>
+#include <thread>
+
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
 #include "exceptions/end_of_file_exception.h"
 #include "exceptions/file_not_found_exception.h"
+#include "exceptions/file_open_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+#include "exceptions/invalid_record_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/page_pinned_exception.h"
+#include "exceptions/read_only_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
+#include "external_sort.h"
 #include "filescan.h"
+#include "key_search.h"
+#include "trace.h"
+
+namespace badgerdb {
+
+template <class K>
+std::string formatArray(const K *arr, int size);
+
+/**
+ * Branch-free binary search over a sorted key array. Each step halves the remaining range with a
+ * conditional move instead of a branch until at most KEY_SEARCH_WINDOW keys are left, and those are
+ * counted in one pass by the vector kernel selected for this CPU.
+ *
+ * @param arr   Sorted keys
+ * @param size  Number of keys in arr
+ * @param key   Key to search for
+ * @return      Index of the first key not less than key, or size if there is none
+ */
+static inline int lowerBound(const int *arr, int size, int key) {
+    const int *base = arr;
+    while (size > KEY_SEARCH_WINDOW) {
+        int half = size / 2;
+        base = (base[half] < key) ? base + half : base;
+        size -= half;
+    }
+    return (base - arr) + countKeysLess(base, size, key);
+}
+
+/**
+ * Branch-free binary search over a sorted key array, finishing with the vector kernel like lowerBound.
+ *
+ * @param arr   Sorted keys
+ * @param size  Number of keys in arr
+ * @param key   Key to search for
+ * @return      Index of the first key greater than key, or size if there is none
+ */
+static inline int upperBound(const int *arr, int size, int key) {
+    const int *base = arr;
+    while (size > KEY_SEARCH_WINDOW) {
+        int half = size / 2;
+        base = (base[half] <= key) ? base + half : base;
+        size -= half;
+    }
+    return (base - arr) + countKeysLessEqual(base, size, key);
+}
+
+/**
+ * Branch-free binary search over a sorted array of DOUBLE or STRING keys, which the vector kernel does not
+ * cover. Each step halves the range with a conditional move until one key is left.
+ *
+ * @param arr   Sorted keys
+ * @param size  Number of keys in arr
+ * @param key   Key to search for
+ * @return      Index of the first key not less than key, or size if there is none
+ */
+template <class K>
+static inline int lowerBound(const K *arr, int size, const K &key) {
+    if (size == 0) return 0;
+    const K *base = arr;
+    while (size > 1) {
+        int half = size / 2;
+        base = (base[half] < key) ? base + half : base;
+        size -= half;
+    }
+    return (base - arr) + (*base < key);
+}
+
+/**
+ * Branch-free binary search over a sorted array of DOUBLE or STRING keys, like the generic lowerBound.
+ *
+ * @param arr   Sorted keys
+ * @param size  Number of keys in arr
+ * @param key   Key to search for
+ * @return      Index of the first key greater than key, or size if there is none
+ */
+template <class K>
+static inline int upperBound(const K *arr, int size, const K &key) {
+    if (size == 0) return 0;
+    const K *base = arr;
+    while (size > 1) {
+        int half = size / 2;
+        base = (base[half] <= key) ? base + half : base;
+        size -= half;
+    }
+    return (base - arr) + (*base <= key);
+}
+
+/**
+ * Reads a key of the attribute type out of a scan parameter or a record, which need not be aligned.
+ *
+ * @param ptr   Attribute value
+ * @param key   Returns the key
+ */
+static inline void readKey(const void *ptr, int &key) {
+    memcpy(&key, ptr, sizeof(int));
+}
+
+static inline void readKey(const void *ptr, double &key) {
+    memcpy(&key, ptr, sizeof(double));
+}
+
+static inline void readKey(const void *ptr, StringKey &key) {
+    key = StringKey((const char *)ptr);
+}
+
+/**
+ * @brief Lowest and highest possible keys of type K, the fences of the root.
+ */
+template <class K>
+struct KeyBounds {
+    static K lowest() {
+        return std::numeric_limits<K>::lowest();
+    }
+    static K highest() {
+        return std::numeric_limits<K>::max();
+    }
+};
+
+template <>
+struct KeyBounds<StringKey> {
+    static StringKey lowest() {
+        return StringKey();
+    }
+    static StringKey highest() {
+        StringKey key;
+        memset(key.chars, 0xff, STRINGSIZE);
+        return key;
+    }
+};
+
+/**
+ * Hash of a key for the key filter. A zero DOUBLE hashes alike whatever its sign, as both compare equal.
+ */
+template <class K>
+static inline std::uint64_t keyHash(const K &key) {
+    return BloomFilter::hash(&key, sizeof(K));
+}
+
+template <>
+inline std::uint64_t keyHash<double>(const double &key) {
+    const double value = key == 0 ? 0.0 : key;
+    return BloomFilter::hash(&value, sizeof(double));
+}
+
+/**
+ * Writes a key as the bytes the hot key cache holds it under: most significant byte first, with the sign flipped
+ * for numbers, so that nearby keys share their leading bytes and so the cache's nodes. Equal keys give the same
+ * bytes, -0.0 those of 0.0.
+ *
+ * @param key   Key
+ * @param out   Receives hotKeyLength<K>() bytes
+ */
+static inline void hotKeyBytes(const int &key, unsigned char *out) {
+    const std::uint32_t bits = (std::uint32_t)key ^ 0x80000000u;
+    for (int i = 0; i < 4; i++) out[i] = (unsigned char)(bits >> (24 - 8 * i));
+}
+
+static inline void hotKeyBytes(const double &key, unsigned char *out) {
+    const double value = key == 0 ? 0.0 : key;
+    std::uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits = (bits >> 63) != 0 ? ~bits : bits ^ ((std::uint64_t)1 << 63);
+    for (int i = 0; i < 8; i++) out[i] = (unsigned char)(bits >> (56 - 8 * i));
+}
+
+static inline void hotKeyBytes(const StringKey &key, unsigned char *out) {
+    memcpy(out, key.chars, STRINGSIZE);
+}
+
+template <class K>
+static inline std::size_t hotKeyLength() {
+    return sizeof(K);
+}
+
+template <>
+inline std::size_t hotKeyLength<StringKey>() {
+    return STRINGSIZE;
+}
+
+/**
+ * Picks the separator to push up when a leaf splits between the keys left and right, left <= right. Fixed-size
+ * keys use right itself.
+ */
+template <class K>
+static inline K shortestSeparator(const K &left, const K &right) {
+    return right;
+}
+
+/**
+ * Suffix truncation: the shortest prefix of right that is still greater than left, padded with NULs. Every key
+ * of the left leaf stays below it and every key of the right leaf at or above it, and the short separator
+ * leaves the nodes it bounds a longer shared prefix.
+ */
+static inline StringKey shortestSeparator(const StringKey &left, const StringKey &right) {
+    StringKey separator;
+    int i = 0;
+    while (i < STRINGSIZE && left.chars[i] == right.chars[i]) {
+        separator.chars[i] = right.chars[i];
+        i++;
+    }
+    if (i < STRINGSIZE) separator.chars[i] = right.chars[i];
+    return separator;
+}
+
+/*
+ * Node access. The tree code reads and writes nodes only through the functions below, so the same algorithms
+ * run over the fixed-size key arrays of DOUBLE nodes and INTEGER non-leaf nodes, over the frame-of-reference
+ * INTEGER leaves and over the prefix-compressed STRING nodes. Fences are only kept by STRING nodes and INTEGER
+ * leaves; for the others they are accepted and dropped.
+ */
+
+template <class K>
+static inline int leafCapacity(const LeafNode<K> *leaf) {
+    return NodeCapacity<K>::LEAF;
+}
+
+/**
+ * Number of slots of a leaf built to hold keys between the given fences, and includedWidth bytes of included
+ * attributes per entry.
+ */
+template <class K>
+static inline int leafCapacityFor(const K &lowFence, const K &highFence, const int includedWidth) {
+    return NodeCapacity<K>::LEAF;
+}
+
+template <class K>
+static inline K leafKey(const LeafNode<K> *leaf, const int i) {
+    return leaf->keyArray[i];
+}
+
+template <class K>
+static inline RecordId *leafRids(LeafNode<K> *leaf) {
+    return leaf->ridArray;
+}
+
+template <class K>
+static inline const RecordId *leafRids(const LeafNode<K> *leaf) {
+    return leaf->ridArray;
+}
+
+/**
+ * Bytes of included attributes each entry of a leaf keeps, and where they start. Only the leaves of covering
+ * indexes, which are INTEGER ones, keep any.
+ */
+template <class K>
+static inline int leafIncludedWidth(const LeafNode<K> *leaf) {
+    return 0;
+}
+
+template <class K>
+static inline const char *leafIncluded(const LeafNode<K> *leaf) {
+    return NULL;
+}
+
+template <class K>
+static inline K leafLowFence(const LeafNode<K> *leaf) {
+    return KeyBounds<K>::lowest();
+}
+
+template <class K>
+static inline K leafHighFence(const LeafNode<K> *leaf) {
+    return KeyBounds<K>::highest();
+}
+
+template <class K>
+static inline int leafLowerBound(const LeafNode<K> *leaf, const int n, const K &key) {
+    return lowerBound(leaf->keyArray, n, key);
+}
+
+template <class K>
+static inline int leafUpperBound(const LeafNode<K> *leaf, const int n, const K &key) {
+    return upperBound(leaf->keyArray, n, key);
+}
+
+/**
+ * Empties a leaf that will hold keys between the given fences, and includedWidth bytes of included attributes per
+ * entry. The sibling links are left to the caller.
+ */
+template <class K>
+static inline void leafInit(LeafNode<K> *leaf, const K &lowFence, const K &highFence, const int includedWidth) {
+    leaf->spaceAvail = NodeCapacity<K>::LEAF;
+}
+
+/**
+ * Inserts an entry at slot of a leaf holding n entries and room for one more. included holds the entry's
+ * included attributes if the leaf keeps any, and is NULL otherwise.
+ */
+template <class K>
+static inline void leafInsert(LeafNode<K> *leaf, const int n, const int slot, const K &key, const RecordId rid,
+                              const char *included) {
+    memmove(&leaf->keyArray[slot + 1], &leaf->keyArray[slot], (n - slot) * sizeof(K));
+    memmove(&leaf->ridArray[slot + 1], &leaf->ridArray[slot], (n - slot) * sizeof(RecordId));
+    leaf->keyArray[slot] = key;
+    leaf->ridArray[slot] = rid;
+    leaf->spaceAvail--;
+}
+
+/**
+ * Removes the entry at slot of a leaf holding n entries.
+ */
+template <class K>
+static inline void leafRemove(LeafNode<K> *leaf, const int n, const int slot) {
+    memmove(&leaf->keyArray[slot], &leaf->keyArray[slot + 1], (n - slot - 1) * sizeof(K));
+    memmove(&leaf->ridArray[slot], &leaf->ridArray[slot + 1], (n - slot - 1) * sizeof(RecordId));
+    leaf->spaceAvail++;
+}
+
+template <class K>
+static inline int nodeCapacity(const NonLeafNode<K> *node) {
+    return NodeCapacity<K>::NONLEAF;
+}
+
+/**
+ * Number of key slots of a non-leaf node built to hold keys between the given fences.
+ */
+template <class K>
+static inline int nodeCapacityFor(const K &lowFence, const K &highFence) {
+    return NodeCapacity<K>::NONLEAF;
+}
+
+template <class K>
+static inline K nodeKey(const NonLeafNode<K> *node, const int i) {
+    return node->keyArray[i];
+}
+
+template <class K>
+static inline PageId *nodeChildren(NonLeafNode<K> *node) {
+    return node->pageNoArray;
+}
+
+template <class K>
+static inline const PageId *nodeChildren(const NonLeafNode<K> *node) {
+    return node->pageNoArray;
+}
+
+template <class K>
+static inline K nodeLowFence(const NonLeafNode<K> *node) {
+    return KeyBounds<K>::lowest();
+}
+
+template <class K>
+static inline K nodeHighFence(const NonLeafNode<K> *node) {
+    return KeyBounds<K>::highest();
+}
+
+template <class K>
+static inline int nodeLowerBound(const NonLeafNode<K> *node, const int n, const K &key) {
+    return lowerBound(node->keyArray, n, key);
+}
+
+template <class K>
+static inline int nodeUpperBound(const NonLeafNode<K> *node, const int n, const K &key) {
+    return upperBound(node->keyArray, n, key);
+}
+
+/**
+ * Sets up a non-leaf node with a single child that will hold keys between the given fences.
+ */
+template <class K>
+static inline void nodeInit(NonLeafNode<K> *node, const int level, const PageId firstChild, const K &lowFence,
+                            const K &highFence) {
+    node->level = level;
+    node->spaceAvail = NodeCapacity<K>::NONLEAF;
+    node->pageNoArray[0] = firstChild;
+}
+
+/**
+ * Inserts a separator at slot of a non-leaf node holding n keys and room for one more, with the child to its
+ * right at slot + 1.
+ */
+template <class K>
+static inline void nodeInsert(NonLeafNode<K> *node, const int n, const int slot, const K &key, const PageId child) {
+    memmove(&node->keyArray[slot + 1], &node->keyArray[slot], (n - slot) * sizeof(K));
+    memmove(&node->pageNoArray[slot + 2], &node->pageNoArray[slot + 1], (n - slot) * sizeof(PageId));
+    node->keyArray[slot] = key;
+    node->pageNoArray[slot + 1] = child;
+    node->spaceAvail--;
+}
+
+/**
+ * Removes the separator at slot of a non-leaf node holding n keys, with the child to its right at slot + 1.
+ */
+template <class K>
+static inline void nodeRemove(NonLeafNode<K> *node, const int n, const int slot) {
+    memmove(&node->keyArray[slot], &node->keyArray[slot + 1], (n - slot - 1) * sizeof(K));
+    memmove(&node->pageNoArray[slot + 1], &node->pageNoArray[slot + 2], (n - slot - 1) * sizeof(PageId));
+    node->spaceAvail++;
+}
+
+/**
+ * Number of leading bytes two STRING keys share.
+ */
+static inline int sharedPrefixLength(const StringKey &a, const StringKey &b) {
+    int i = 0;
+    while (i < STRINGSIZE && a.chars[i] == b.chars[i]) i++;
+    return i;
+}
+
+/**
+ * Rebuilds a full key from the shared prefix in a fence and a stored suffix.
+ */
+static inline StringKey expandKey(const StringKey &fence, const int prefixLength, const char *suffix) {
+    StringKey key;
+    memcpy(key.chars, fence.chars, prefixLength);
+    memcpy(key.chars + prefixLength, suffix, STRINGSIZE - prefixLength);
+    return key;
+}
+
+/**
+ * Branch-free binary search over the n sorted suffixes of a STRING node. A key that does not share the node's
+ * prefix sorts before or after all of them, so only the suffix bytes are ever compared.
+ *
+ * @param fence         Either fence of the node
+ * @param prefixLength  Length of the node's shared prefix
+ * @param suffixes      The node's key suffixes
+ * @param n             Number of keys in the node
+ * @param key           Key to search for
+ * @param upper         False for the first key not less than key, true for the first key greater than key
+ * @return              Index of that key, or n if there is none
+ */
+static inline int suffixBound(const StringKey &fence, const int prefixLength, const char *suffixes, const int n,
+                              const StringKey &key, const bool upper) {
+    int cmp = memcmp(key.chars, fence.chars, prefixLength);
+    if (cmp != 0 || n == 0) return cmp < 0 ? 0 : n;
+
+    const int width = STRINGSIZE - prefixLength;
+    const char *probe = key.chars + prefixLength;
+    int base = 0;
+    int size = n;
+    while (size > 1) {
+        int half = size / 2;
+        cmp = memcmp(suffixes + (base + half) * width, probe, width);
+        base = (upper ? cmp <= 0 : cmp < 0) ? base + half : base;
+        size -= half;
+    }
+    cmp = memcmp(suffixes + base * width, probe, width);
+    return base + (upper ? cmp <= 0 : cmp < 0);
+}
+
+/**
+ * Number of slots of a STRING leaf whose keys share prefixLength bytes.
+ */
+static inline int stringLeafCapacity(const int prefixLength) {
+    return STRINGLEAFAREA / (sizeof(RecordId) + STRINGSIZE - prefixLength);
+}
+
+/**
+ * Number of key slots of a STRING non-leaf node whose keys share prefixLength bytes.
+ */
+static inline int stringNodeCapacity(const int prefixLength) {
+    return (STRINGNONLEAFAREA - sizeof(PageId)) / (sizeof(PageId) + STRINGSIZE - prefixLength);
+}
+
+static inline int leafCapacity(const LeafNodeString *leaf) {
+    return stringLeafCapacity(leaf->prefixLength);
+}
+
+static inline int leafCapacityFor(const StringKey &lowFence, const StringKey &highFence, const int includedWidth) {
+    return stringLeafCapacity(sharedPrefixLength(lowFence, highFence));
+}
+
+// the suffixes start right after the fences and the record ids end at the end of the page
+static inline RecordId *leafRids(LeafNodeString *leaf) {
+    return (RecordId *)(leaf->entries + STRINGLEAFAREA) - leafCapacity(leaf);
+}
+
+static inline const RecordId *leafRids(const LeafNodeString *leaf) {
+    return (const RecordId *)(leaf->entries + STRINGLEAFAREA) - leafCapacity(leaf);
+}
+
+static inline char *leafSuffixes(LeafNodeString *leaf) {
+    return leaf->entries;
+}
+
+static inline const char *leafSuffixes(const LeafNodeString *leaf) {
+    return leaf->entries;
+}
+
+static inline StringKey leafKey(const LeafNodeString *leaf, const int i) {
+    return expandKey(leaf->lowFence, leaf->prefixLength, leafSuffixes(leaf) + i * (STRINGSIZE - leaf->prefixLength));
+}
+
+static inline StringKey leafLowFence(const LeafNodeString *leaf) {
+    return leaf->lowFence;
+}
+
+static inline StringKey leafHighFence(const LeafNodeString *leaf) {
+    return leaf->highFence;
+}
+
+static inline int leafLowerBound(const LeafNodeString *leaf, const int n, const StringKey &key) {
+    return suffixBound(leaf->lowFence, leaf->prefixLength, leafSuffixes(leaf), n, key, false);
+}
+
+static inline int leafUpperBound(const LeafNodeString *leaf, const int n, const StringKey &key) {
+    return suffixBound(leaf->lowFence, leaf->prefixLength, leafSuffixes(leaf), n, key, true);
+}
+
+static inline void leafInit(LeafNodeString *leaf, const StringKey &lowFence, const StringKey &highFence,
+                            const int includedWidth) {
+    leaf->lowFence = lowFence;
+    leaf->highFence = highFence;
+    leaf->prefixLength = sharedPrefixLength(lowFence, highFence);
+    leaf->spaceAvail = leafCapacity(leaf);
+}
+
+static inline void leafInsert(LeafNodeString *leaf, const int n, const int slot, const StringKey &key,
+                              const RecordId rid, const char *included) {
+    const int width = STRINGSIZE - leaf->prefixLength;
+    RecordId *rids = leafRids(leaf);
+    char *suffixes = leafSuffixes(leaf);
+    memmove(&rids[slot + 1], &rids[slot], (n - slot) * sizeof(RecordId));
+    memmove(suffixes + (slot + 1) * width, suffixes + slot * width, (n - slot) * width);
+    rids[slot] = rid;
+    memcpy(suffixes + slot * width, key.chars + leaf->prefixLength, width);
+    leaf->spaceAvail--;
+}
+
+static inline void leafRemove(LeafNodeString *leaf, const int n, const int slot) {
+    const int width = STRINGSIZE - leaf->prefixLength;
+    RecordId *rids = leafRids(leaf);
+    char *suffixes = leafSuffixes(leaf);
+    memmove(&rids[slot], &rids[slot + 1], (n - slot - 1) * sizeof(RecordId));
+    memmove(suffixes + slot * width, suffixes + (slot + 1) * width, (n - slot - 1) * width);
+    leaf->spaceAvail++;
+}
+
+static inline int nodeCapacity(const NonLeafNodeString *node) {
+    return stringNodeCapacity(node->prefixLength);
+}
+
+static inline int nodeCapacityFor(const StringKey &lowFence, const StringKey &highFence) {
+    return stringNodeCapacity(sharedPrefixLength(lowFence, highFence));
+}
+
+// as in leaves, the suffixes start right after the fences and the child page numbers end at the end of the page
+static inline PageId *nodeChildren(NonLeafNodeString *node) {
+    return (PageId *)(node->entries + STRINGNONLEAFAREA) - (nodeCapacity(node) + 1);
+}
+
+static inline const PageId *nodeChildren(const NonLeafNodeString *node) {
+    return (const PageId *)(node->entries + STRINGNONLEAFAREA) - (nodeCapacity(node) + 1);
+}
+
+static inline char *nodeSuffixes(NonLeafNodeString *node) {
+    return node->entries;
+}
+
+static inline const char *nodeSuffixes(const NonLeafNodeString *node) {
+    return node->entries;
+}
+
+static inline StringKey nodeKey(const NonLeafNodeString *node, const int i) {
+    return expandKey(node->lowFence, node->prefixLength, nodeSuffixes(node) + i * (STRINGSIZE - node->prefixLength));
+}
+
+static inline StringKey nodeLowFence(const NonLeafNodeString *node) {
+    return node->lowFence;
+}
+
+static inline StringKey nodeHighFence(const NonLeafNodeString *node) {
+    return node->highFence;
+}
+
+static inline int nodeLowerBound(const NonLeafNodeString *node, const int n, const StringKey &key) {
+    return suffixBound(node->lowFence, node->prefixLength, nodeSuffixes(node), n, key, false);
+}
+
+static inline int nodeUpperBound(const NonLeafNodeString *node, const int n, const StringKey &key) {
+    return suffixBound(node->lowFence, node->prefixLength, nodeSuffixes(node), n, key, true);
+}
+
+static inline void nodeInit(NonLeafNodeString *node, const int level, const PageId firstChild,
+                            const StringKey &lowFence, const StringKey &highFence) {
+    node->level = level;
+    node->lowFence = lowFence;
+    node->highFence = highFence;
+    node->prefixLength = sharedPrefixLength(lowFence, highFence);
+    node->spaceAvail = nodeCapacity(node);
+    nodeChildren(node)[0] = firstChild;
+}
+
+static inline void nodeInsert(NonLeafNodeString *node, const int n, const int slot, const StringKey &key,
+                              const PageId child) {
+    const int width = STRINGSIZE - node->prefixLength;
+    PageId *children = nodeChildren(node);
+    char *suffixes = nodeSuffixes(node);
+    memmove(suffixes + (slot + 1) * width, suffixes + slot * width, (n - slot) * width);
+    memmove(&children[slot + 2], &children[slot + 1], (n - slot) * sizeof(PageId));
+    memcpy(suffixes + slot * width, key.chars + node->prefixLength, width);
+    children[slot + 1] = child;
+    node->spaceAvail--;
+}
+
+static inline void nodeRemove(NonLeafNodeString *node, const int n, const int slot) {
+    const int width = STRINGSIZE - node->prefixLength;
+    PageId *children = nodeChildren(node);
+    char *suffixes = nodeSuffixes(node);
+    memmove(suffixes + slot * width, suffixes + (slot + 1) * width, (n - slot - 1) * width);
+    memmove(&children[slot + 1], &children[slot + 2], (n - slot - 1) * sizeof(PageId));
+    node->spaceAvail++;
+}
+
+/**
+ * Bytes of the key deltas of an INTEGER leaf whose keys lie between the given fences: the fewest of 1, 2 or 4
+ * that hold the distance between them, or none if the fences are equal. A leaf without deltas is the posting
+ * list of a single key, holding nothing but its record ids.
+ */
+static inline int intKeyWidth(const int lowFence, const int highFence) {
+    const std::uint32_t range = (std::uint32_t)highFence - (std::uint32_t)lowFence;
+    return range == 0 ? 0 : (range <= 0xff ? 1 : (range <= 0xffff ? 2 : 4));
+}
+
+/**
+ * Width of the key deltas of an INTEGER leaf. A leaf read optimistically may show a torn width, so it is kept to
+ * one the leaf can have; validation rejects whatever was read with it.
+ */
+static inline int intKeyWidth(const LeafNodeInt *leaf) {
+    return leaf->keyWidth == 0 ? 0 : (leaf->keyWidth == 1 ? 1 : (leaf->keyWidth == 2 ? 2 : 4));
+}
+
+/**
+ * Number of slots of an INTEGER leaf whose key deltas take width bytes and whose entries keep includedWidth bytes
+ * of included attributes.
+ */
+static inline int intLeafCapacity(const int width, const int includedWidth) {
+    return INTLEAFAREA / (sizeof(RecordId) + width + includedWidth);
+}
+
+/**
+ * Bytes of included attributes of each entry of an INTEGER leaf, kept within bounds like intKeyWidth.
+ */
+static inline int intIncludedWidth(const LeafNodeInt *leaf) {
+    const int width = leaf->includedWidth;
+    return width < 0 ? 0 : (width > MAX_INCLUDED_BYTES ? MAX_INCLUDED_BYTES : width);
+}
+
+static inline std::uint32_t intLeafDelta(const LeafNodeInt *leaf, const int width, const int i) {
+    const char *at = leaf->entries + i * width;
+    if (width == 0) return 0;
+    if (width == 1) return (unsigned char)*at;
+    if (width == 2) {
+        std::uint16_t delta;
+        memcpy(&delta, at, sizeof(delta));
+        return delta;
+    }
+    std::uint32_t delta;
+    memcpy(&delta, at, sizeof(delta));
+    return delta;
+}
+
+static inline int leafCapacity(const LeafNodeInt *leaf) {
+    return intLeafCapacity(intKeyWidth(leaf), intIncludedWidth(leaf));
+}
+
+static inline int leafCapacityFor(const int &lowFence, const int &highFence, const int includedWidth) {
+    return intLeafCapacity(intKeyWidth(lowFence, highFence), includedWidth);
+}
+
+// as in STRING leaves, the deltas start the entries and the record ids end at the end of the page
+static inline RecordId *leafRids(LeafNodeInt *leaf) {
+    return (RecordId *)(leaf->entries + INTLEAFAREA) - leafCapacity(leaf);
+}
+
+static inline const RecordId *leafRids(const LeafNodeInt *leaf) {
+    return (const RecordId *)(leaf->entries + INTLEAFAREA) - leafCapacity(leaf);
+}
+
+static inline int leafIncludedWidth(const LeafNodeInt *leaf) {
+    return intIncludedWidth(leaf);
+}
+
+// the included attributes lie between the deltas and the record ids
+static inline char *leafIncluded(LeafNodeInt *leaf) {
+    return (char *)leafRids(leaf) - leafCapacity(leaf) * intIncludedWidth(leaf);
+}
+
+static inline const char *leafIncluded(const LeafNodeInt *leaf) {
+    return (const char *)leafRids(leaf) - leafCapacity(leaf) * intIncludedWidth(leaf);
+}
+
+static inline int leafKey(const LeafNodeInt *leaf, const int i) {
+    return (int)((std::uint32_t)leaf->lowFence + intLeafDelta(leaf, intKeyWidth(leaf), i));
+}
+
+/**
+ * Copies count keys of a leaf from slot begin on into out.
+ */
+template <class K>
+static inline void leafKeys(const LeafNode<K> *leaf, const int begin, const int count, K *out) {
+    for (int i = 0; i < count; i++) out[i] = leafKey(leaf, begin + i);
+}
+
+static inline void leafKeys(const LeafNodeInt *leaf, const int begin, const int count, int *out) {
+    const int width = intKeyWidth(leaf);
+    unpackKeys(leaf->entries + begin * width, width, count, leaf->lowFence, out);
+}
+
+static inline int leafLowFence(const LeafNodeInt *leaf) {
+    return leaf->lowFence;
+}
+
+static inline int leafHighFence(const LeafNodeInt *leaf) {
+    return leaf->highFence;
+}
+
+/**
+ * Branch-free binary search over the n key deltas of an INTEGER leaf. A key outside the fences sorts before or
+ * after all of them; inside, the deltas are compared to the key's own delta until at most KEY_SEARCH_WINDOW are
+ * left, which are unpacked and counted by the vector kernels.
+ *
+ * @param upper     False for the first key not less than key, true for the first key greater than key
+ * @return          Index of that key, or n if there is none
+ */
+static inline int intLeafBound(const LeafNodeInt *leaf, const int n, const int key, const bool upper) {
+    if (key < leaf->lowFence || (key == leaf->lowFence && !upper)) return 0;
+    if (key > leaf->highFence) return n;
+    const int width = intKeyWidth(leaf);
+    // every entry of a posting list equals key
+    if (width == 0) return n;
+    const std::uint32_t probe = (std::uint32_t)key - (std::uint32_t)leaf->lowFence;
+    int base = 0;
+    int size = n;
+    while (size > KEY_SEARCH_WINDOW) {
+        int half = size / 2;
+        const std::uint32_t delta = intLeafDelta(leaf, width, base + half);
+        base = (upper ? delta <= probe : delta < probe) ? base + half : base;
+        size -= half;
+    }
+    int window[KEY_SEARCH_WINDOW];
+    unpackKeys(leaf->entries + base * width, width, size, leaf->lowFence, window);
+    return base + (upper ? countKeysLessEqual(window, size, key) : countKeysLess(window, size, key));
+}
+
+static inline int leafLowerBound(const LeafNodeInt *leaf, const int n, const int &key) {
+    return intLeafBound(leaf, n, key, false);
+}
+
+static inline int leafUpperBound(const LeafNodeInt *leaf, const int n, const int &key) {
+    return intLeafBound(leaf, n, key, true);
+}
+
+static inline void leafInit(LeafNodeInt *leaf, const int &lowFence, const int &highFence, const int includedWidth) {
+    leaf->lowFence = lowFence;
+    leaf->highFence = highFence;
+    leaf->keyWidth = intKeyWidth(lowFence, highFence);
+    leaf->includedWidth = includedWidth;
+    leaf->spaceAvail = leafCapacity(leaf);
+}
+
+static inline void leafInsert(LeafNodeInt *leaf, const int n, const int slot, const int &key, const RecordId rid,
+                              const char *included) {
+    const int width = intKeyWidth(leaf);
+    const int includedWidth = intIncludedWidth(leaf);
+    RecordId *rids = leafRids(leaf);
+    char *deltas = leaf->entries;
+    memmove(&rids[slot + 1], &rids[slot], (n - slot) * sizeof(RecordId));
+    memmove(deltas + (slot + 1) * width, deltas + slot * width, (n - slot) * width);
+    rids[slot] = rid;
+    if (includedWidth > 0) {
+        char *attrs = leafIncluded(leaf);
+        memmove(attrs + (slot + 1) * includedWidth, attrs + slot * includedWidth, (n - slot) * includedWidth);
+        memcpy(attrs + slot * includedWidth, included, includedWidth);
+    }
+    const std::uint32_t delta = (std::uint32_t)key - (std::uint32_t)leaf->lowFence;
+    if (width == 0) {
+        // the key is the fences' own
+    } else if (width == 1) {
+        deltas[slot] = (char)delta;
+    } else if (width == 2) {
+        const std::uint16_t narrow = (std::uint16_t)delta;
+        memcpy(deltas + slot * 2, &narrow, sizeof(narrow));
+    } else {
+        memcpy(deltas + slot * 4, &delta, sizeof(delta));
+    }
+    leaf->spaceAvail--;
+}
+
+static inline void leafRemove(LeafNodeInt *leaf, const int n, const int slot) {
+    const int width = intKeyWidth(leaf);
+    RecordId *rids = leafRids(leaf);
+    char *deltas = leaf->entries;
+    memmove(&rids[slot], &rids[slot + 1], (n - slot - 1) * sizeof(RecordId));
+    memmove(deltas + slot * width, deltas + (slot + 1) * width, (n - slot - 1) * width);
+    const int includedWidth = intIncludedWidth(leaf);
+    char *attrs = leafIncluded(leaf);
+    memmove(attrs + slot * includedWidth, attrs + (slot + 1) * includedWidth, (n - slot - 1) * includedWidth);
+    leaf->spaceAvail++;
+}
+
+/**
+ * Appends the included attributes of count entries of a leaf, from slot begin on, to out.
+ */
+template <class K>
+static inline void appendIncluded(const LeafNode<K> *leaf, const int begin, const int count, std::vector<char> &out) {
+    const int width = leafIncludedWidth(leaf);
+    if (width == 0) return;
+    const char *from = leafIncluded(leaf) + begin * width;
+    out.insert(out.end(), from, from + count * width);
+}
+
+/**
+ * Included attributes of entry i of scratch entries whose attributes are laid out back to back in included, or
+ * NULL if they have none.
+ */
+static inline const char *includedAt(const std::vector<char> &included, const int width, const std::size_t i) {
+    return included.empty() ? NULL : &included[i * width];
+}
+
+/**
+ * Number of entries of a leaf. A leaf read optimistically may show a torn count, so it is kept within the slots
+ * of the leaf; validation rejects whatever was read with it.
+ */
+template <class K>
+static inline int leafEntries(const LeafNode<K> *leaf) {
+    const int capacity = leafCapacity(leaf);
+    const int count = capacity - leaf->spaceAvail;
+    return count < 0 ? 0 : (count > capacity ? capacity : count);
+}
+
+/**
+ * Number of keys of a non-leaf node, kept within its slots as in leafEntries.
+ */
+template <class K>
+static inline int nodeKeys(const NonLeafNode<K> *node) {
+    const int capacity = nodeCapacity(node);
+    const int count = capacity - node->spaceAvail;
+    return count < 0 ? 0 : (count > capacity ? capacity : count);
+}
+
+/**
+ * Whether optimistic reads copy a node before reading it. Nodes of fixed-size keys are read in place, bounded by
+ * leafEntries and nodeKeys. Where the entries of a STRING node lie depends on its prefix length, so a torn read
+ * of it could lead outside the page; it is copied and the copy validated first.
+ */
+template <class K>
+struct OptimisticCopy {
+    static const bool COPY = false;
+};
+
+template <>
+struct OptimisticCopy<StringKey> {
+    static const bool COPY = true;
+};
+
+/**
+ * True if a node holding count of its capacity slots has fallen below the merge threshold.
+ */
+static inline bool underfull(const int count, const int capacity, const double threshold) {
+    return count < threshold * capacity;
+}
+
+/**
+ * Name of the write-ahead log of an index file, which lives next to it.
+ */
+static std::string logName(const std::string &indexName) {
+    return indexName + ".wal";
+}
+
+/**
+ * BTreeIndex Constructor.
+ * Check to see if the corresponding index file exists. If so, open the file.
+ * If not, create it and insert entries for every tuple in the base relation using FileScan class.
+ *
+ * @param relationName        Name of file.
+ * @param outIndexName        Return the name of index file.
+ * @param bufMgrIn			  Buffer Manager Instance
+ * @param attrByteOffset	  Offset of attribute, over which index is to be built, in the record
+ * @param attrType			  Datatype of attribute over which index is built
+ * @param fillFactor		  Fraction (0, 1] of each node filled when a new index is bulk loaded
+ * @param buildThreads		  Number of threads scanning the relation when a new index is bulk loaded
+ * @param sortBudget		  Buffer frames a new index's entries are sorted in, or 0 to sort them in memory
+ * @param entries			  Entries a new index is loaded from instead of the relation, or NULL
+ * @param keyFilterBits		  Bits per key of the key filter built once the index is ready, or 0 for none
+ * @param includedColumns	  Attributes kept next to each key of a covering index, or none
+ * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
+ */
+
+BTreeIndex::BTreeIndex(const std::string &relationName,
+                       std::string &outIndexName,
+                       BufMgr *bufMgrIn,
+                       const int attrByteOffset,
+                       const Datatype attrType,
+                       const double fillFactor,
+                       const unsigned buildThreads,
+                       const std::uint32_t sortBudget,
+                       const IndexEntries *entries,
+                       const int keyFilterBits,
+                       const std::vector<IncludedColumn> &includedColumns) {
+    // initialize variables
+    this->attributeType = attrType;
+    this->attrByteOffset = attrByteOffset;
+    this->includedColumns = includedColumns;
+    includedWidth = 0;
+    for (size_t i = 0; i < includedColumns.size(); i++) {
+        if (includedColumns[i].length <= 0 || includedColumns[i].byteOffset < 0)
+            throw BadIndexInfoException("Included column is empty.");
+        includedWidth += includedColumns[i].length;
+    }
+    if (!includedColumns.empty() && attrType != INTEGER)
+        throw BadIndexInfoException("Only INTEGER indexes can include columns.");
+    if (includedColumns.size() > (size_t)MAX_INCLUDED_COLUMNS || includedWidth > MAX_INCLUDED_BYTES)
+        throw BadIndexInfoException("Too many included columns.");
+    scanExecuting = false;
+    bufMgr = bufMgrIn;
+    mapping = NULL;
+    mergeThreshold = MERGE_THRESHOLD;
+    rightmostLeaf = Page::INVALID_NUMBER;
+    reorgFromInt = KeyBounds<int>::lowest();
+    reorgFromDouble = KeyBounds<double>::lowest();
+    reorgFromString = KeyBounds<StringKey>::lowest();
+    pinnedTopStale = false;
+    treeHeight = 1;
+    entryBase = 0;
+    entryBaseExact = false;
+    swizzleMask = 1;
+    while (swizzleMask < bufMgr->frames() * SWIZZLE_SLOTS_PER_FRAME) swizzleMask <<= 1;
+    swizzled.reset(new std::atomic<Page *>[swizzleMask]);
+    for (PageId i = 0; i < swizzleMask; i++) swizzled[i] = NULL;
+    swizzleMask--;
+    swizzling = true;
+    switch (attrType) {
+        case INTEGER:
+            leafOccupancy = INTARRAYLEAFSIZE;
+            nodeOccupancy = INTARRAYNONLEAFSIZE;
+            break;
+        case DOUBLE:
+            leafOccupancy = DOUBLEARRAYLEAFSIZE;
+            nodeOccupancy = DOUBLEARRAYNONLEAFSIZE;
+            break;
+        case STRING:
+            leafOccupancy = STRINGARRAYLEAFSIZE;
+            nodeOccupancy = STRINGARRAYNONLEAFSIZE;
+            break;
+    }
+    // Want to begin by inserting into the root
+    insertInRoot = true;
+    Page *metaPage;
+    bool summarized = true;
+    // Page *rootPage;
+
+    // Creating the index file name, taken from the project specification
+    std::ostringstream indexStr;
+    indexStr << relationName << '.' << attrByteOffset;
+    outIndexName = indexStr.str();
+
+    // Since meta contains information about the first page, we have to get the header page
+    // but also have to see if the file exists.
+    try {
+        BlobFile *existing = new BlobFile(outIndexName, false);
+        file = existing;
+        // whatever a crash left in the log is redone before anything is read
+        const std::size_t replayed = LogManager::replay(logName(outIndexName), *existing);
+        headerPageNum = file->getFirstPageNo();
+
+        // After we get the first page, we use meta's info to compare with the given info to see if it matches.
+        bufMgr->readPage(file, headerPageNum, metaPage);
+        IndexMetaInfo *meta = (IndexMetaInfo *)metaPage;
+        try {
+            if (relationName != meta->relationName) throw BadIndexInfoException("Index doesn't exist.");
+            if (attributeType != meta->attrType) throw BadIndexInfoException("Index doesn't exist.");
+            if (attrByteOffset != meta->attrByteOffset) throw BadIndexInfoException("Index  doesn't exist.");
+            if (meta->nodeFormat != NODE_FORMAT_VERSION)
+                throw BadIndexInfoException("Index was written in another node format.");
+            bool sameColumns = meta->includedCount == (int)includedColumns.size();
+            for (int i = 0; sameColumns && i < meta->includedCount; i++) {
+                sameColumns = meta->includedColumns[i].byteOffset == includedColumns[i].byteOffset &&
+                              meta->includedColumns[i].length == includedColumns[i].length;
+            }
+            if (!sameColumns) throw BadIndexInfoException("Index includes other columns.");
+        } catch (const BadIndexInfoException &e) {
+            // the file is left closed, so that it can be opened as it is or removed
+            bufMgr->unPinPage(file, headerPageNum, false);
+            bufMgr->flushFile(file);
+            delete file;
+            throw;
+        }
+        rootPageNum = meta->rootPageNo;
+        insertInRoot = meta->rootIsLeaf;
+        summarized = meta->metaFormat == META_FORMAT_VERSION;
+        if (summarized) {
+            treeHeight = meta->height;
+            entryBase = meta->entryCount;
+            // changes redone from the log were made after the count was saved
+            entryBaseExact = meta->closedCleanly && meta->entryCountExact && replayed == 0;
+            measuredLeaves.nodes = meta->leafNodes;
+            measuredLeaves.entries = meta->leafEntries;
+            measuredLeaves.slots = meta->leafSlots;
+            if (meta->closedCleanly) {
+                // written through at once, so the file never holds changes the count misses while it says clean
+                meta->closedCleanly = false;
+                file->writePage(headerPageNum, *metaPage);
+            }
+        }
+
+        // unpin headerPage; the frame holds just what the file does
+        bufMgr->unPinPage(file, headerPageNum, false);
+
+    } catch (FileNotFoundException) {  // This means file doesn't exist so create a file.
+        // file = new BlobFile(outIndexName, true);
+
+        BlobFile *newFile = new BlobFile(outIndexName, true);
+        file = (File *)newFile;
+        // a log left by an index file of the same name that was removed must not be replayed onto this one
+        std::remove(logName(outIndexName).c_str());
+        PageId metaPageId;
+        Page *metaPage;
+        bufMgr->allocPage(file, metaPageId, metaPage);
+
+        IndexMetaInfo *metaInfo = (IndexMetaInfo *)metaPage;
+        strcpy(metaInfo->relationName, relationName.c_str());
+        metaInfo->attrByteOffset = attrByteOffset;
+        metaInfo->attrType = attrType;
+        metaInfo->nodeFormat = NODE_FORMAT_VERSION;
+        metaInfo->includedCount = (int)includedColumns.size();
+        for (size_t i = 0; i < includedColumns.size(); i++) metaInfo->includedColumns[i] = includedColumns[i];
+        headerPageNum = metaPageId;
+
+        // Build the whole tree bottom-up from the sorted contents of the relation.
+        switch (attributeType) {
+            case INTEGER:
+                if (entries != NULL)
+                    loadEntries<int>(*entries, fillFactor);
+                else
+                    bulkLoad<int>(relationName, fillFactor, buildThreads, sortBudget);
+                break;
+            case DOUBLE:
+                if (entries != NULL)
+                    loadEntries<double>(*entries, fillFactor);
+                else
+                    bulkLoad<double>(relationName, fillFactor, buildThreads, sortBudget);
+                break;
+            case STRING:
+                if (entries != NULL)
+                    loadEntries<StringKey>(*entries, fillFactor);
+                else
+                    bulkLoad<StringKey>(relationName, fillFactor, buildThreads, sortBudget);
+                break;
+        }
+
+        metaInfo->rootPageNo = rootPageNum;
+        metaInfo->rootIsLeaf = insertInRoot;
+        entryBase = measuredLeaves.entries;
+        entryBaseExact = true;
+        metaInfo->metaFormat = META_FORMAT_VERSION;
+        metaInfo->height = treeHeight;
+        metaInfo->closedCleanly = false;
+        metaInfo->entryCountExact = true;
+        metaInfo->entryCount = entryBase;
+        metaInfo->leafNodes = measuredLeaves.nodes;
+        metaInfo->leafEntries = measuredLeaves.entries;
+        metaInfo->leafSlots = measuredLeaves.slots;
+        bufMgr->unPinPage(file, metaPageId, true);
+    }
+    // an index written before the meta page kept its summary is walked once, and keeps one from then on
+    if (!summarized) {
+        const IndexShape shape = analyze();
+        treeHeight = shape.height();
+    }
+    refreshPinnedTop();
+    // the leaves just loaded or opened are read once more, most of them still in the buffer pool
+    if (keyFilterBits > 0) setKeyFilter(keyFilterBits);
+}
+
+/**
+ * BTreeIndex Destructor.
+ * End any initialized scan, flush index file, after unpinning any pinned pages, from the buffer manager
+ * and delete file instance thereby closing the index file.
+ * Destructor should not throw any exceptions. All exceptions should be caught in here itself.
+ * */
+BTreeIndex::~BTreeIndex() {
+    // The destructor should end any scan, clear state variables, unpin pinned pages, and flush index file,
+    // and deletes the file object.
+    if (scanExecuting) {  // If the scan is executing, then end it.
+        try {
+            endScan();
+        } catch (ScanNotInitializedException) {
+            std::cout << "No scan has been initialized.";
+        }
+    }
+    // clears state variables and delete file instance.
+    scanExecuting = false;
+    try {
+        flushWriteBuffer();
+    } catch (...) {
+        std::cout << "The write buffer could not be flushed.";
+    }
+    delete mapping;
+    releasePinnedTop();
+    // no reader is left, so nodes still waiting for one are freed now
+    std::vector<PageId> reclaimed;
+    epochs.drain(reclaimed);
+    for (size_t i = 0; i < reclaimed.size(); i++) {
+        freeNode(reclaimed[i]);
+    }
+    saveSummary();
+    bufMgr->flushFile(file);
+    if (log) log->truncate();
+    delete file;
+}
+
+/**
+ * Insert a new entry using the pair <value,rid>.
+ * Most inserts fit in their leaf, so the first descent only latches the leaf exclusively. If the leaf is full the
+ * insert descends again latching exclusively every node its split can reach. The split may cause splitting of the
+ * leaf's parent, which may in turn split, up to the root, in which case a new root is created and the metapage is
+ * updated. All latches are held until the insert is complete.
+ * @param key			Key to insert, pointer to integer/double/char string
+ * @param rid			Record ID of a record whose entry is getting inserted into the index.
+ * @param included		Included attributes of the record, if the index is covering
+ **/
+void BTreeIndex::insertEntry(const void *key, const RecordId rid, const void *included) {
+    if (mapping != NULL) throw ReadOnlyException(file->filename());
+    if (includedWidth > 0 && included == NULL) throw BadIndexInfoException("Index includes columns.");
+    LogScope scope(this);
+    switch (attributeType) {
+        case INTEGER: {
+            int keyInt;
+            readKey(key, keyInt);
+            // the key is in the filter before it is in the tree, so no lookup that can find it is turned away
+            if (keyFilter) keyFilter->add(keyHash(keyInt));
+            if (writeBuffer)
+                bufferKey(keyInt, rid);
+            else
+                insertKey(keyInt, rid, includedWidth > 0 ? static_cast<const char *>(included) : NULL);
+            if (hotKeys) hotKeyChanged(keyInt, rid, true);
+            break;
+        }
+        case DOUBLE: {
+            double keyDouble;
+            readKey(key, keyDouble);
+            if (keyFilter) keyFilter->add(keyHash(keyDouble));
+            if (writeBuffer)
+                bufferKey(keyDouble, rid);
+            else
+                insertKey(keyDouble, rid, NULL);
+            if (hotKeys) hotKeyChanged(keyDouble, rid, true);
+            break;
+        }
+        case STRING: {
+            StringKey keyString;
+            readKey(key, keyString);
+            if (keyFilter) keyFilter->add(keyHash(keyString));
+            if (writeBuffer)
+                bufferKey(keyString, rid);
+            else
+                insertKey(keyString, rid, NULL);
+            if (hotKeys) hotKeyChanged(keyString, rid, true);
+            break;
+        }
+    }
+    scope.commit();
+}
+
+/**
+ * Inserts the pair <key,rid> into the tree of keys of type K, as described for insertEntry.
+ *
+ * @param key       Key to insert
+ * @param rid       Record ID of a record whose entry is getting inserted into the index.
+ * @param included  Included attributes of the entry, or NULL
+ */
+template <class K>
+void BTreeIndex::insertKey(const K &key, const RecordId rid, const char *included) {
+    BADGERDB_TRACE_DEBUG("Insert entry: " << key);
+    BADGERDB_SPAN("BTreeIndex::insert", 1);
+    counters.add(INDEX_INSERTS);
+    entryChanges.add(INDEX_INSERTS);
+    if (appendToRightmost(key, rid, included)) return;
+
+    NodePath path;
+    PageId leafId;
+    Page *leafPage;
+    searchNode(key, false, DESCEND_INSERT, path, leafId, leafPage);
+    if (((LeafNode<K> *)leafPage)->spaceAvail == 0) {
+        releasePage(leafId, leafPage, true);
+        searchNode(key, false, DESCEND_SPLIT, path, leafId, leafPage);
+    }
+    const int heldDepth = path.depth;
+    if (((LeafNode<K> *)leafPage)->rightSibPageNo == Page::INVALID_NUMBER) rightmostLeaf = leafId;
+
+    PageKeyPair<K> newChild;
+    if (insertIntoLeafNode(leafId, rid, key, included, newChild)) propagateSplit(path, leafId, newChild);
+
+    releasePage(leafId, leafPage, true);
+    for (int i = 0; i < heldDepth; i++) {
+        releasePage(path.entries[i].pageNo, path.entries[i].page, true);
+    }
+    commitLog();
+    if (pinnedTopStale) refreshPinnedTop();
+}
+
+/**
+ * Appends to the cached rightmost leaf, as described in the header. The leaf is read inside an epoch, like a
+ * cursor holds the next leaf it scans, so it is not reused while it is latched here even if it was merged away in
+ * the meantime; the cache is checked again once the latch is held.
+ *
+ * @param key       Key to insert
+ * @param rid       Record ID of a record whose entry is getting inserted into the index.
+ * @param included  Included attributes of the entry, or NULL
+ * @return          True if the entry was appended
+ */
+template <class K>
+bool BTreeIndex::appendToRightmost(const K &key, const RecordId rid, const char *included) {
+    EpochGuard guard(epochs);
+    const PageId leafId = rightmostLeaf;
+    bool appended = false;
+    if (leafId != Page::INVALID_NUMBER) {
+        Page *leafPage = fetchPage(leafId, true);
+        LeafNode<K> *leaf = (LeafNode<K> *)leafPage;
+        const int numEntries = leafCapacity(leaf) - leaf->spaceAvail;
+        // an empty leaf has no key to tell where its range starts
+        appended = rightmostLeaf == leafId && leaf->rightSibPageNo == Page::INVALID_NUMBER && leaf->spaceAvail > 0 &&
+                   numEntries > 0 && !(key < leafKey(leaf, numEntries - 1));
+        if (appended) leafInsert(leaf, numEntries, numEntries, key, rid, included);
+        releasePage(leafId, leafPage, true, appended);
+    }
+    return appended;
+}
+
+/**
+ * Pushes the separator of a split leaf up the recorded path until a node absorbs it, creating a new root if
+ * the root itself split.
+ *
+ * @param path      Non-leaf nodes latched by a DESCEND_SPLIT descent
+ * @param leafId    Page ID of the leaf that split
+ * @param newChild  Separator and Page ID of the new right leaf
+ */
+template <class K>
+void BTreeIndex::propagateSplit(NodePath &path, const PageId leafId, PageKeyPair<K> &newChild) {
+    bool aboveLeaf = true;
+    bool absorbed = false;
+    PageId splitId = leafId;
+    while (path.depth > 0 && !absorbed) {
+        const NodePathEntry &parent = path.pop();
+        absorbed = !insertIntoNonLeafNode(parent.pageNo, parent.slot, newChild);
+        splitId = parent.pageNo;
+        aboveLeaf = false;
+    }
+
+    // the root itself split
+    if (!absorbed) {
+        BADGERDB_TRACE_INFO("Creating a new root ");
+        BADGERDB_TRACE_INFO("Pushing up key: " << newChild.key);
+        createNewRoot<K>(newChild.key, splitId, newChild.pageNo, aboveLeaf);
+    }
+}
+
+/**
+ * Inserts several entries at once, as described in the header.
+ * @param keys			Keys to insert, laid out back to back
+ * @param rids			Record ID of each key
+ * @param count			Number of entries
+ * @param included		Included attributes of each entry, if the index is covering
+ **/
+void BTreeIndex::insertBatch(const void *keys, const RecordId *rids, const size_t count, const void *included) {
+    if (mapping != NULL) throw ReadOnlyException(file->filename());
+    if (includedWidth > 0 && included == NULL) throw BadIndexInfoException("Index includes columns.");
+    LogScope scope(this);
+    const char *key = static_cast<const char *>(keys);
+    // only INTEGER indexes include columns
+    std::vector<char> attrs;
+    if (includedWidth > 0) {
+        const char *from = static_cast<const char *>(included);
+        attrs.assign(from, from + count * includedWidth);
+    }
+    switch (attributeType) {
+        case INTEGER: {
+            std::vector<RIDKeyPair<int> > entries(count);
+            for (size_t i = 0; i < count; i++) {
+                readKey(key + i * sizeof(int), entries[i].key);
+                entries[i].rid = rids[i];
+                if (keyFilter) keyFilter->add(keyHash(entries[i].key));
+            }
+            insertKeys(entries, attrs);
+            for (size_t i = 0; hotKeys && i < count; i++) hotKeyChanged(entries[i].key, entries[i].rid, true);
+            break;
+        }
+        case DOUBLE: {
+            std::vector<RIDKeyPair<double> > entries(count);
+            for (size_t i = 0; i < count; i++) {
+                readKey(key + i * sizeof(double), entries[i].key);
+                entries[i].rid = rids[i];
+                if (keyFilter) keyFilter->add(keyHash(entries[i].key));
+            }
+            insertKeys(entries, attrs);
+            for (size_t i = 0; hotKeys && i < count; i++) hotKeyChanged(entries[i].key, entries[i].rid, true);
+            break;
+        }
+        case STRING: {
+            std::vector<RIDKeyPair<StringKey> > entries(count);
+            for (size_t i = 0; i < count; i++) {
+                readKey(key + i * STRINGSIZE, entries[i].key);
+                entries[i].rid = rids[i];
+                if (keyFilter) keyFilter->add(keyHash(entries[i].key));
+            }
+            insertKeys(entries, attrs);
+            for (size_t i = 0; hotKeys && i < count; i++) hotKeyChanged(entries[i].key, entries[i].rid, true);
+            break;
+        }
+    }
+    scope.commit();
+}
+
+/**
+ * Sorts pairs, and the included attributes laid out back to back beside them if there are any, into key order.
+ */
+template <class K>
+static void sortEntries(std::vector<RIDKeyPair<K> > &entries, std::vector<char> &included, const int width) {
+    if (included.empty()) {
+        std::sort(entries.begin(), entries.end());
+        return;
+    }
+    std::vector<std::size_t> order(entries.size());
+    for (std::size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(),
+              [&entries](const std::size_t a, const std::size_t b) { return entries[a] < entries[b]; });
+    std::vector<RIDKeyPair<K> > sortedEntries(entries.size());
+    std::vector<char> sortedIncluded(included.size());
+    for (std::size_t i = 0; i < order.size(); i++) {
+        sortedEntries[i] = entries[order[i]];
+        memcpy(&sortedIncluded[i * width], &included[order[i] * width], width);
+    }
+    entries.swap(sortedEntries);
+    included.swap(sortedIncluded);
+}
+
+/**
+ * Merges sorted entries with those of a leaf into scratch arrays, in one pass. Each entry goes after the equal
+ * keys already in the leaf. included holds the included attributes of the entries, back to back, or is NULL if
+ * the leaf keeps none.
+ */
+template <class K>
+static void mergeWithLeaf(const LeafNode<K> *leaf, const RIDKeyPair<K> *entries, const char *included,
+                          const size_t count, std::vector<K> &keys, std::vector<RecordId> &rids,
+                          std::vector<char> &attrs) {
+    const int n = leafCapacity(leaf) - leaf->spaceAvail;
+    const int width = leafIncludedWidth(leaf);
+    keys.reserve(n + count);
+    rids.reserve(n + count);
+    attrs.reserve((n + count) * width);
+    const RecordId *leafRidArray = leafRids(leaf);
+    int old = 0;
+    for (size_t i = 0; i < count; i++) {
+        int first = old;
+        for (; old < n && !(entries[i].key < leafKey(leaf, old)); old++) {
+            keys.push_back(leafKey(leaf, old));
+            rids.push_back(leafRidArray[old]);
+        }
+        appendIncluded(leaf, first, old - first, attrs);
+        keys.push_back(entries[i].key);
+        rids.push_back(entries[i].rid);
+        if (width > 0) attrs.insert(attrs.end(), included + i * width, included + (i + 1) * width);
+    }
+    appendIncluded(leaf, old, n - old, attrs);
+    for (; old < n; old++) {
+        keys.push_back(leafKey(leaf, old));
+        rids.push_back(leafRidArray[old]);
+    }
+}
+
+/**
+ * Inserts sorted pairs into the tree of keys of type K, one descent per leaf they fall in. Each descent first
+ * latches only the leaf, as insertKey does, and descends again in DESCEND_SPLIT_LEAF mode if the leaf cannot take
+ * every entry that belongs in it.
+ *
+ * @param entries   Pairs to insert; sorted in place
+ * @param included  Included attributes of each pair, or empty; sorted in place along with entries
+ */
+template <class K>
+void BTreeIndex::insertKeys(std::vector<RIDKeyPair<K> > &entries, std::vector<char> &included) {
+    BADGERDB_SPAN("BTreeIndex::insertBatch", entries.size());
+    sortEntries(entries, included, includedWidth);
+    counters.add(INDEX_INSERTS, entries.size());
+    entryChanges.add(INDEX_INSERTS, entries.size());
+    size_t next = 0;
+    while (next < entries.size()) {
+        NodePath path;
+        PageId leafId;
+        Page *leafPage;
+        K bound;
+        // entries below the leaf's bound belong in it; past them the next descent picks up
+        auto groupEnd = [&]() -> size_t {
+            size_t end = next + 1;
+            while (end < entries.size() && entries[end].key < bound) end++;
+            return end;
+        };
+        searchNode(entries[next].key, false, DESCEND_INSERT, path, leafId, leafPage, &bound);
+        size_t end = groupEnd();
+        if ((size_t)((LeafNode<K> *)leafPage)->spaceAvail < end - next) {
+            releasePage(leafId, leafPage, true);
+            searchNode(entries[next].key, false, DESCEND_SPLIT_LEAF, path, leafId, leafPage, &bound);
+            end = groupEnd();
+        }
+        const int heldDepth = path.depth;
+
+        LeafNode<K> *leaf = (LeafNode<K> *)leafPage;
+        std::vector<K> keys;
+        std::vector<RecordId> rids;
+        std::vector<char> attrs;
+        const char *groupIncluded = includedAt(included, includedWidth, next);
+        if ((size_t)leaf->spaceAvail >= end - next) {
+            mergeWithLeaf(leaf, &entries[next], groupIncluded, end - next, keys, rids, attrs);
+            // the fences, and so the capacity, stay as they were; so does the right sibling
+            const PageId rightSibling = leaf->rightSibPageNo;
+            leafInit(leaf, leafLowFence(leaf), leafHighFence(leaf), includedWidth);
+            for (size_t i = 0; i < keys.size(); i++)
+                leafInsert(leaf, i, i, keys[i], rids[i], includedAt(attrs, includedWidth, i));
+            leaf->rightSibPageNo = rightSibling;
+        } else {
+            // one split leaves two leaves at least as large as this one, so it can take up to a leaf's worth
+            // of entries beyond the capacity; the rest wait for the next descent
+            const int capacity = leafCapacity(leaf);
+            const int numEntries = capacity - leaf->spaceAvail;
+            end = std::min(end, next + (capacity + leaf->spaceAvail));
+            mergeWithLeaf(leaf, &entries[next], groupIncluded, end - next, keys, rids, attrs);
+
+            // entries appended past the end of the rightmost leaf fill it before spilling into the new leaf
+            const bool append = leaf->rightSibPageNo == Page::INVALID_NUMBER &&
+                                (numEntries == 0 || !(entries[next].key < leafKey(leaf, numEntries - 1)));
+            PageKeyPair<K> newChild;
+            splitLeafEntries(leaf, leafId, keys, rids, attrs, append ? capacity : (int)keys.size() / 2, newChild);
+            propagateSplit(path, leafId, newChild);
+        }
+
+        releasePage(leafId, leafPage, true, true);
+        for (int i = 0; i < heldDepth; i++) {
+            releasePage(path.entries[i].pageNo, path.entries[i].page, true);
+        }
+        // the next descent may latch the pages this one changed
+        commitLog();
+        next = end;
+    }
+    if (pinnedTopStale) refreshPinnedTop();
+}
+
+/**
+ * This method is called when inserting a separator into a non leaf node. It checks to see if there is space
+ * available and if not it calls splitNonLeafNode
+ *
+ * @param pid			pageId of the page the value is to be inserted into
+ * @param slot			Slot of the child that split; the separator belongs in the key slot of the same index
+ * @param newChild		Separator and right child to insert; on a split, returns the pair to insert into the parent
+ * @return				True if the node split
+ **/
+template <class K>
+bool BTreeIndex::insertIntoNonLeafNode(const PageId pid, const int slot, PageKeyPair<K> &newChild) {
+    BADGERDB_TRACE_DEBUG("insert into non leaf: " << newChild.key);
+
+    // declare and read the current page
+    Page *curPage;
+    bufMgr->readPage(file, pid, curPage);
+
+    // creating and initializing a node
+    NonLeafNode<K> *curNode = (NonLeafNode<K> *)curPage;
+
+    BADGERDB_TRACE_DEBUG("Space left: " << curNode->spaceAvail);
+
+    // no space availble in node, split it and push the middle key up
+    if (curNode->spaceAvail == 0) {
+        splitNonLeafNode(curNode, pid, slot, newChild);
+        return true;
+    }
+
+    // count how many spaces are full within node, then shift the key and child tails right by one
+    int size = nodeCapacity(curNode) - curNode->spaceAvail;
+    nodeInsert(curNode, size, slot, newChild.key, newChild.pageNo);
+    bufMgr->unPinPage(file, pid, true);
+    return false;
+}
+
+/**
+ * Inserts new entry into a leaf node if the node has space left, if not, splitLeafNode will be called.
+ *
+ * @param pid           Page ID of leaf node
+ * @param rid			Record ID of a record whose entry is getting inserted into the index.
+ * @param key			Key to insert
+ * @param included		Included attributes of the entry, or NULL
+ * @param newChild		On a split, returns the smallest key and Page ID of the new right leaf
+ * @return				True if the leaf split
+ */
+template <class K>
+bool BTreeIndex::insertIntoLeafNode(const PageId pid, const RecordId rid, const K &key, const char *included,
+                                    PageKeyPair<K> &newChild) {
+    BADGERDB_TRACE_DEBUG("insert into LEAF: " << key);
+
+    // declare and read the current page
+    Page *curPage;
+    bufMgr->readPage(file, pid, curPage);
+
+    // initialize the leaf node what we're insert into
+    LeafNode<K> *curNode = (LeafNode<K> *)curPage;
+
+    BADGERDB_TRACE_DEBUG("Space left: " << curNode->spaceAvail);
+
+    // No room now, need to split and push up
+    if (curNode->spaceAvail == 0) {
+        splitLeafNode(curNode, pid, rid, key, included, newChild);
+        return true;
+    }
+
+    int numNode = leafCapacity(curNode) - curNode->spaceAvail;  // How many entries are in this node
+
+    // Find the slot after any equal keys, then shift the key and rid tails right by one
+    int slot = leafUpperBound(curNode, numNode, key);
+    leafInsert(curNode, numNode, slot, key, rid, included);
+    bufMgr->unPinPage(file, pid, true);
+
+    BADGERDB_TRACE_DEBUG("Insert " << key << "success");
+    return false;
+}
+
+/**
+ * This method is called when the top of the tree is reached and we have to create a new root node.
+ *
+ * @param key			Separator key of the new root
+ * @param leftChild		The PageId of the leftchild of the new root
+ * @param rightChild	The PageId of the rightchild of the new root
+ * @param aboveLeaf		Bool value that tells if the new root to create will be above LeafNodes
+ **/
+template <class K>
+void BTreeIndex::createNewRoot(const K &key, const PageId leftChild, const PageId rightChild, bool aboveLeaf) {
+    // declare rootID
+    PageId rootId;
+    // declare rootPage
+    Page *rootPage;
+    // allocate a new page for root node
+    bufMgr->allocPage(file, rootId, rootPage);
+    logPage(rootId, rootPage, true);
+    // initialize new root node
+    NonLeafNode<K> *rootNode = (NonLeafNode<K> *)rootPage;
+    // the root may hold any key; start it with the left child, then add the key and the right child
+    nodeInit(rootNode, aboveLeaf ? 1 : 0, leftChild, KeyBounds<K>::lowest(), KeyBounds<K>::highest());
+    nodeInsert(rootNode, 0, 0, key, rightChild);
+
+    // latched, so the background writer never writes the meta page halfway through an operation
+    Page *metaPage = fetchPage(headerPageNum, true);
+    IndexMetaInfo *meta = (IndexMetaInfo *)metaPage;
+    meta->rootPageNo = rootId;
+    meta->rootIsLeaf = false;
+
+    // the caller still holds the old root latched, so descents waiting on it will see the new root
+    {
+        std::lock_guard<std::mutex> guard(rootLock);
+        rootPageNum = rootId;
+        insertInRoot = false;
+        meta->height = ++treeHeight;
+    }
+    releasePage(headerPageNum, metaPage, true, true);
+    pinnedTopStale = true;
+
+    // unpin page
+    this->bufMgr->unPinPage(this->file, rootId, true);
+}
+
+/**
+ * Delete the entry <key,rid>.
+ * The first descent latches only the leftmost leaf that may hold key, exclusively, and the entry is removed from it
+ * or from a leaf to its right. If that leaves the leaf underfull the delete descends again latching exclusively
+ * every node a merge can reach, and merges bottom-up along that path. Pages merged away are retired once all
+ * latches are released, and freed once no reader can reach them any more.
+ * @param key			Key of the entry, pointer to integer/double/char string
+ * @param rid			Record ID of the entry
+ * @return				True if the entry was found and removed
+ **/
+bool BTreeIndex::deleteEntry(const void *key, const RecordId rid) {
+    if (mapping != NULL) throw ReadOnlyException(file->filename());
+    LogScope scope(this);
+    bool deleted = false;
+    switch (attributeType) {
+        case INTEGER: {
+            int keyInt;
+            readKey(key, keyInt);
+            deleted = (writeBuffer && buffered<int>()->remove(keyInt, rid)) || deleteKey(keyInt, rid);
+            if (deleted && hotKeys) hotKeyChanged(keyInt, rid, false);
+            break;
+        }
+        case DOUBLE: {
+            double keyDouble;
+            readKey(key, keyDouble);
+            deleted = (writeBuffer && buffered<double>()->remove(keyDouble, rid)) || deleteKey(keyDouble, rid);
+            if (deleted && hotKeys) hotKeyChanged(keyDouble, rid, false);
+            break;
+        }
+        case STRING: {
+            StringKey keyString;
+            readKey(key, keyString);
+            deleted = (writeBuffer && buffered<StringKey>()->remove(keyString, rid)) || deleteKey(keyString, rid);
+            if (deleted && hotKeys) hotKeyChanged(keyString, rid, false);
+            break;
+        }
+    }
+    scope.commit();
+    return deleted;
+}
+
+/**
+ * Finds every entry equal to any of several probe keys, as described in the header.
+ * @param keys			Probe keys, laid out back to back
+ * @param count			Number of probe keys
+ * @param callback		Receives each match with the position of its probe
+ **/
+void BTreeIndex::lookupBatch(const void *keys, const size_t count, const LookupCallback &callback) {
+    flushWriteBuffer();
+    const char *key = static_cast<const char *>(keys);
+    switch (attributeType) {
+        case INTEGER: {
+            std::vector<int> probes(count);
+            for (size_t i = 0; i < count; i++) readKey(key + i * sizeof(int), probes[i]);
+            lookupKeys(probes, callback);
+            break;
+        }
+        case DOUBLE: {
+            std::vector<double> probes(count);
+            for (size_t i = 0; i < count; i++) readKey(key + i * sizeof(double), probes[i]);
+            lookupKeys(probes, callback);
+            break;
+        }
+        case STRING: {
+            std::vector<StringKey> probes(count);
+            for (size_t i = 0; i < count; i++) readKey(key + i * STRINGSIZE, probes[i]);
+            lookupKeys(probes, callback);
+            break;
+        }
+    }
+}
+
+/**
+ * Answers the probes in key order over one shared descent. The path holds the non-leaf nodes above the current
+ * leaf, each latched shared with the separator bounding its keys from above; the descents are leftmost, which send
+ * a key equal to a separator to its left, so a node covers every key up to and including its bound. A probe past
+ * the bound of the current leaf releases it and the nodes above it whose bounds it is past as well, and descends
+ * again from the deepest node left. Latches are only ever taken downwards, or rightwards along the leaves, so the
+ * batch cannot deadlock with a writer; while the batch holds the root no node can split or merge however.
+ *
+ * @param keys      Probe keys, in the order of the batch
+ * @param callback  Receives every match
+ */
+template <class K>
+void BTreeIndex::lookupKeys(const std::vector<K> &keys, const LookupCallback &callback) {
+    // probes the key filter rules out have no match and are left out of the descent
+    std::vector<size_t> order;
+    order.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (!keyFilter || keyFilter->mayContain(keyHash(keys[i]))) order.push_back(i);
+    }
+    counters.add(INDEX_PROBES, keys.size());
+    counters.add(INDEX_FILTERED, keys.size() - order.size());
+    std::stable_sort(order.begin(), order.end(), [&keys](const size_t a, const size_t b) { return keys[a] < keys[b]; });
+
+    NodePath path;
+    K bounds[MAX_INDEX_HEIGHT];
+    PageId leafId = Page::INVALID_NUMBER;
+    Page *leafPage = NULL;
+    K leafBound;
+    // probes before this position already had their leaves prefetched
+    size_t prefetched = 0;
+    auto releaseHeld = [&]() {
+        if (leafPage != NULL) releasePage(leafId, leafPage, false);
+        leafPage = NULL;
+        while (path.depth > 0) {
+            const NodePathEntry &held = path.pop();
+            releasePage(held.pageNo, held.page, false);
+        }
+    };
+
+    try {
+        for (size_t i = 0; i < order.size(); i++) {
+            const K &key = keys[order[i]];
+            if (leafPage != NULL && leafBound < key) {
+                releasePage(leafId, leafPage, false);
+                leafPage = NULL;
+            }
+            if (leafPage == NULL) {
+                while (path.depth > 0 && bounds[path.depth - 1] < key) {
+                    const NodePathEntry &held = path.pop();
+                    releasePage(held.pageNo, held.page, false);
+                }
+                if (path.depth == 0) {
+                    PageId rootId;
+                    Page *rootPage;
+                    bool rootIsLeaf;
+                    latchRoot(DESCEND_READ, rootId, rootPage, rootIsLeaf);
+                    if (rootIsLeaf) {
+                        leafId = rootId;
+                        leafPage = rootPage;
+                        leafBound = KeyBounds<K>::highest();
+                    } else {
+                        bounds[0] = KeyBounds<K>::highest();
+                        path.push(rootId, 0, rootPage);
+                    }
+                }
+                while (leafPage == NULL) {
+                    const NodePathEntry &top = path.entries[path.depth - 1];
+                    const NonLeafNode<K> *node = (const NonLeafNode<K> *)top.page;
+                    const int numKeys = nodeCapacity(node) - node->spaceAvail;
+                    const int slot = nodeLowerBound(node, numKeys, key);
+                    const K bound = slot < numKeys ? nodeKey(node, slot) : bounds[path.depth - 1];
+                    const PageId childId = nodeChildren(node)[slot];
+                    if (node->level != 1) {
+                        bounds[path.depth] = bound;
+                        path.push(childId, 0, fetchPage(childId, false));
+                        continue;
+                    }
+
+                    // start reading the leaves of the next probes below this node before waiting on this one
+                    if (mapping == NULL) {
+                        PageId last = childId;
+                        size_t ahead = std::max(prefetched, i + 1);
+                        for (; ahead < order.size() && ahead <= i + LOOKUP_PREFETCH_PROBES; ahead++) {
+                            const K &aheadKey = keys[order[ahead]];
+                            if (bounds[path.depth - 1] < aheadKey) break;
+                            const PageId aheadId = nodeChildren(node)[nodeLowerBound(node, numKeys, aheadKey)];
+                            if (aheadId != last) bufMgr->prefetch(file, aheadId);
+                            last = aheadId;
+                        }
+                        prefetched = ahead;
+                    }
+                    leafId = childId;
+                    leafPage = fetchPage(childId, false);
+                    leafBound = bound;
+                }
+            }
+
+            bool movedRight = false;
+            while (true) {
+                const LeafNode<K> *leaf = (const LeafNode<K> *)leafPage;
+                const int numEntries = leafCapacity(leaf) - leaf->spaceAvail;
+                int slot = leafLowerBound(leaf, numEntries, key);
+                for (; slot < numEntries && leafKey(leaf, slot) == key; slot++) {
+                    callback(order[i], leafRids(leaf)[slot]);
+                }
+                // no greater key was seen, so equal keys may continue in the right sibling
+                if (slot < numEntries || leaf->rightSibPageNo == Page::INVALID_NUMBER) break;
+                const PageId sibId = leaf->rightSibPageNo;
+                Page *sibPage = fetchPage(sibId, false);
+                releasePage(leafId, leafPage, false);
+                leafId = sibId;
+                leafPage = sibPage;
+                movedRight = true;
+            }
+            // a leaf reached by moving right has no known bound
+            if (movedRight) {
+                releasePage(leafId, leafPage, false);
+                leafPage = NULL;
+            }
+        }
+    } catch (...) {
+        releaseHeld();
+        throw;
+    }
+    releaseHeld();
+}
+
+std::vector<RecordId> BTreeIndex::lookup(const void *key) {
+    std::vector<RecordId> matches;
+    switch (attributeType) {
+        case INTEGER: {
+            int keyInt;
+            readKey(key, keyInt);
+            findMerged(keyInt, &matches);
+            break;
+        }
+        case DOUBLE: {
+            double keyDouble;
+            readKey(key, keyDouble);
+            findMerged(keyDouble, &matches);
+            break;
+        }
+        case STRING: {
+            StringKey keyString;
+            readKey(key, keyString);
+            findMerged(keyString, &matches);
+            break;
+        }
+    }
+    return matches;
+}
+
+bool BTreeIndex::contains(const void *key) {
+    switch (attributeType) {
+        case INTEGER: {
+            int keyInt;
+            readKey(key, keyInt);
+            return findMerged(keyInt, NULL);
+        }
+        case DOUBLE: {
+            double keyDouble;
+            readKey(key, keyDouble);
+            return findMerged(keyDouble, NULL);
+        }
+        case STRING: {
+            StringKey keyString;
+            readKey(key, keyString);
+            return findMerged(keyString, NULL);
+        }
+    }
+    return false;
+}
+
+/**
+ * Descends once to the leftmost leaf that may hold key and collects its matches, moving right with coupled
+ * latches while the matches may continue in the next leaf.
+ *
+ * @param key   Key to look up
+ * @param out   Receives the record IDs of the matches; if NULL the search stops at the first one
+ * @return      True if any entry holds key
+ */
+template <class K>
+bool BTreeIndex::findKey(const K &key, std::vector<RecordId> *out) {
+    if (mapping == NULL && swizzling) {
+        EpochGuard guard(epochs);
+        bool found;
+        for (int attempt = 0; attempt < OPTIMISTIC_ATTEMPTS; attempt++) {
+            if (findKeyOptimistic(key, out, found)) return found;
+            counters.add(INDEX_RETRIES);
+        }
+    }
+
+    NodePath path;
+    PageId leafId;
+    Page *leafPage;
+    searchNode(key, true, DESCEND_READ, path, leafId, leafPage);
+    bool found = false;
+    int leaves = 1;
+    while (true) {
+        const LeafNode<K> *leaf = (const LeafNode<K> *)leafPage;
+        const int numEntries = leafCapacity(leaf) - leaf->spaceAvail;
+        const int first = leafLowerBound(leaf, numEntries, key);
+        int slot = first;
+        while (slot < numEntries && leafKey(leaf, slot) == key) slot++;
+        if (slot > first) {
+            found = true;
+            if (out == NULL) break;
+            out->insert(out->end(), leafRids(leaf) + first, leafRids(leaf) + slot);
+        }
+        // no greater key was seen, so equal keys may continue in the right sibling
+        if (slot < numEntries || leaf->rightSibPageNo == Page::INVALID_NUMBER) break;
+        const PageId sibId = leaf->rightSibPageNo;
+        Page *sibPage = fetchPage(sibId, false);
+        releasePage(leafId, leafPage, false);
+        leafId = sibId;
+        leafPage = sibPage;
+        leaves++;
+    }
+    releasePage(leafId, leafPage, false);
+    counters.add(INDEX_LOOKUP_LEAVES, leaves);
+    return found;
+}
+
+template <class K>
+bool BTreeIndex::findKeyOptimistic(const K &key, std::vector<RecordId> *out, bool &found) {
+    alignas(CACHE_LINE_SIZE) char scratch[Page::SIZE];
+    OptimisticPage leafPage;
+    if (!descendOptimistic(key, true, (Page *)scratch, leafPage)) return false;
+    std::vector<RecordId> matches;
+    found = false;
+    int leaves = 1;
+    while (true) {
+        const LeafNode<K> *leaf = (const LeafNode<K> *)leafPage.node;
+        const int numEntries = leafEntries(leaf);
+        const int first = leafLowerBound(leaf, numEntries, key);
+        int slot = first;
+        while (slot < numEntries && leafKey(leaf, slot) == key) slot++;
+        if (slot > first) {
+            found = true;
+            if (out == NULL) {
+                if (!validate(leafPage)) return false;
+                counters.add(INDEX_LOOKUP_LEAVES, leaves);
+                return true;
+            }
+            matches.insert(matches.end(), leafRids(leaf) + first, leafRids(leaf) + slot);
+        }
+        const PageId sibId = leaf->rightSibPageNo;
+        if (slot < numEntries || sibId == Page::INVALID_NUMBER) break;
+        // as for a child, the sibling's version is read before the leaf pointing at it is validated
+        OptimisticPage sibPage;
+        if (!readOptimistic<K>(sibId, (Page *)scratch, sibPage) || !validate(leafPage)) return false;
+        leafPage = sibPage;
+        leaves++;
+    }
+    if (!validate(leafPage)) return false;
+    if (out != NULL) out->insert(out->end(), matches.begin(), matches.end());
+    counters.add(INDEX_LOOKUP_LEAVES, leaves);
+    return true;
+}
+
+void BTreeIndex::mapReadOnly(const bool verifyChecksums) {
+    if (mapping != NULL) return;
+    // the mapping sees the file, so every page has to be written back first
+    flushWriteBuffer();
+    writeBuffer.reset();
+    releasePinnedTop();
+    bufMgr->flushFile(file);
+    mapping = new MappedFile(file->filename(), verifyChecksums);
+}
+
+template <class K>
+bool BTreeIndex::findMerged(const K &key, std::vector<RecordId> *out) {
+    BADGERDB_SPAN("BTreeIndex::lookup", 0);
+    counters.add(INDEX_LOOKUPS);
+    if (hotKeys) return findHot(key, out);
+    return findStored(key, out);
+}
+
+template <class K>
+bool BTreeIndex::findHot(const K &key, std::vector<RecordId> *out) {
+    unsigned char bytes[HOT_KEY_MAX_BYTES];
+    hotKeyBytes(key, bytes);
+    std::vector<RecordId> matches;
+    if (hotKeys->find(bytes, matches)) {
+        counters.add(INDEX_HOT_HITS);
+    } else {
+        // read before the tree, so that an entry changed while the tree is read keeps what it found out
+        const std::uint64_t stamp = hotKeys->version();
+        findStored(key, &matches);
+        hotKeys->offer(bytes, matches, stamp);
+    }
+    if (out != NULL) out->insert(out->end(), matches.begin(), matches.end());
+    return !matches.empty();
+}
+
+template <class K>
+void BTreeIndex::hotKeyChanged(const K &key, const RecordId rid, const bool inserted) {
+    unsigned char bytes[HOT_KEY_MAX_BYTES];
+    hotKeyBytes(key, bytes);
+    if (inserted)
+        hotKeys->added(bytes, rid);
+    else
+        hotKeys->removed(bytes, rid);
+}
+
+template <class K>
+bool BTreeIndex::findStored(const K &key, std::vector<RecordId> *out) {
+    if (keyFilter && !keyFilter->mayContain(keyHash(key))) {
+        counters.add(INDEX_FILTERED);
+        return false;
+    }
+    if (!writeBuffer) return findKey(key, out);
+    // the buffer is looked at first: an entry flushed in between is in the tree by the time the tree is
+    if (out == NULL) return buffered<K>()->find(key, NULL) || findKey(key, NULL);
+    std::vector<RecordId> pending;
+    buffered<K>()->find(key, &pending);
+    const size_t inTree = out->size();
+    findKey(key, out);
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (std::find(out->begin() + inTree, out->end(), pending[i]) == out->end()) out->push_back(pending[i]);
+    }
+    return out->size() > inTree;
+}
+
+template <class K>
+void BTreeIndex::bufferKey(const K &key, const RecordId rid) {
+    if (buffered<K>()->add(key, rid)) flushBuffered<K>();
+}
+
+template <class K>
+void BTreeIndex::flushBuffered() {
+    std::vector<std::pair<K, RecordId> > taken;
+    if (!buffered<K>()->take(taken)) return;
+    std::vector<RIDKeyPair<K> > entries(taken.size());
+    for (size_t i = 0; i < taken.size(); i++) entries[i].set(taken[i].second, taken[i].first);
+    try {
+        LogScope scope(this);
+        std::vector<char> none;
+        insertKeys(entries, none);
+        scope.commit();
+    } catch (...) {
+        buffered<K>()->done();
+        throw;
+    }
+    buffered<K>()->done();
+}
+
+void BTreeIndex::flushWriteBuffer() {
+    if (!writeBuffer) return;
+    switch (attributeType) {
+        case INTEGER:
+            flushBuffered<int>();
+            break;
+        case DOUBLE:
+            flushBuffered<double>();
+            break;
+        case STRING:
+            flushBuffered<StringKey>();
+            break;
+    }
+}
+
+void BTreeIndex::setWriteBuffer(const std::size_t capacity) {
+    if (mapping != NULL) throw ReadOnlyException(file->filename());
+    if (capacity > 0 && includedWidth > 0) throw BadIndexInfoException("Index includes columns.");
+    flushWriteBuffer();
+    writeBuffer.reset();
+    if (capacity == 0) return;
+    switch (attributeType) {
+        case INTEGER:
+            writeBuffer.reset(new WriteBuffer<int>(capacity));
+            break;
+        case DOUBLE:
+            writeBuffer.reset(new WriteBuffer<double>(capacity));
+            break;
+        case STRING:
+            writeBuffer.reset(new WriteBuffer<StringKey>(capacity));
+            break;
+    }
+}
+
+void BTreeIndex::setKeyFilter(const int bitsPerKey) {
+    keyFilter.reset();
+    if (bitsPerKey <= 0) return;
+    switch (attributeType) {
+        case INTEGER:
+            buildKeyFilter<int>(bitsPerKey);
+            break;
+        case DOUBLE:
+            buildKeyFilter<double>(bitsPerKey);
+            break;
+        case STRING:
+            buildKeyFilter<StringKey>(bitsPerKey);
+            break;
+    }
+}
+
+void BTreeIndex::setHotKeyCache(const std::size_t budget) {
+    hotKeys.reset();
+    if (budget == 0) return;
+    switch (attributeType) {
+        case INTEGER:
+            hotKeys.reset(new HotKeyCache(hotKeyLength<int>(), budget));
+            break;
+        case DOUBLE:
+            hotKeys.reset(new HotKeyCache(hotKeyLength<double>(), budget));
+            break;
+        case STRING:
+            hotKeys.reset(new HotKeyCache(hotKeyLength<StringKey>(), budget));
+            break;
+    }
+}
+
+template <class K>
+void BTreeIndex::buildKeyFilter(const int bitsPerKey) {
+    // entries still in the write buffer are in the tree after this, so the walk sees every key
+    flushWriteBuffer();
+    std::vector<std::uint64_t> hashes;
+    NodePath path;
+    PageId leafId;
+    Page *leafPage;
+    searchNode(KeyBounds<K>::lowest(), true, DESCEND_READ, path, leafId, leafPage);
+    while (true) {
+        const LeafNode<K> *leaf = (const LeafNode<K> *)leafPage;
+        const int numEntries = leafCapacity(leaf) - leaf->spaceAvail;
+        for (int slot = 0; slot < numEntries; slot++) hashes.push_back(keyHash(leafKey(leaf, slot)));
+        if (leaf->rightSibPageNo == Page::INVALID_NUMBER) break;
+        const PageId sibId = leaf->rightSibPageNo;
+        Page *sibPage = fetchPage(sibId, false);
+        releasePage(leafId, leafPage, false);
+        leafId = sibId;
+        leafPage = sibPage;
+    }
+    releasePage(leafId, leafPage, false);
+
+    keyFilter.reset(new BloomFilter(hashes.size(), bitsPerKey));
+    for (size_t i = 0; i < hashes.size(); i++) keyFilter->add(hashes[i]);
+}
+
+IndexStats BTreeIndex::stats() const {
+    IndexStats out;
+    counters.addTo(out);
+    return out;
+}
+
+IndexShape BTreeIndex::analyze() {
+    IndexShape shape;
+    {
+        EpochGuard guard(epochs);
+        switch (attributeType) {
+            case INTEGER:
+                analyzeLevels<int>(shape);
+                break;
+            case DOUBLE:
+                analyzeLevels<double>(shape);
+                break;
+            case STRING:
+                analyzeLevels<StringKey>(shape);
+                break;
+        }
+    }
+    shape.retiredNodes = epochs.pending();
+    {
+        std::lock_guard<std::mutex> guard(summaryLock);
+        measuredLeaves = shape.leaves();
+        entryBase = shape.leaves().entries - netInserts();
+        entryBaseExact = true;
+    }
+    return shape;
+}
+
+std::uint64_t BTreeIndex::netInserts() const {
+    IndexStats changes;
+    entryChanges.addTo(changes);
+    return changes.inserts - changes.deletes;
+}
+
+IndexSummary BTreeIndex::summary() {
+    IndexSummary out;
+    {
+        std::lock_guard<std::mutex> guard(rootLock);
+        out.height = treeHeight;
+    }
+    std::lock_guard<std::mutex> guard(summaryLock);
+    out.entries = entryBase + netInserts();
+    out.entriesExact = entryBaseExact;
+    out.leafNodes = measuredLeaves.nodes;
+    out.leafEntries = measuredLeaves.entries;
+    out.leafSlots = measuredLeaves.slots;
+    return out;
+}
+
+void BTreeIndex::saveSummary() {
+    const IndexSummary saved = summary();
+    Page *metaPage;
+    bufMgr->readPage(file, headerPageNum, metaPage);
+    // latched, as the background writer may be writing the page back
+    bufMgr->latchPage(metaPage, true);
+    IndexMetaInfo *meta = (IndexMetaInfo *)metaPage;
+    meta->metaFormat = META_FORMAT_VERSION;
+    meta->height = saved.height;
+    meta->closedCleanly = true;
+    meta->entryCountExact = saved.entriesExact;
+    meta->entryCount = saved.entries;
+    meta->leafNodes = saved.leafNodes;
+    meta->leafEntries = saved.leafEntries;
+    meta->leafSlots = saved.leafSlots;
+    bufMgr->unlatchPage(metaPage, true);
+    bufMgr->unPinPage(file, headerPageNum, true);
+}
+
+template <class K>
+void BTreeIndex::analyzeLevels(IndexShape &shape) {
+    PageId rootId;
+    bool leafLevel;
+    getRoot(rootId, leafLevel);
+    std::vector<PageId> level(1, rootId);
+    while (!level.empty()) {
+        LevelShape counted;
+        std::vector<PageId> below;
+        bool aboveLeaves = false;
+        for (size_t i = 0; i < level.size(); i++) {
+            Page *page = fetchPage(level[i], false);
+            if (leafLevel) {
+                const LeafNode<K> *leaf = (const LeafNode<K> *)page;
+                counted.add(leafCapacity(leaf) - leaf->spaceAvail, leafCapacity(leaf));
+            } else {
+                const NonLeafNode<K> *node = (const NonLeafNode<K> *)page;
+                const int numKeys = nodeCapacity(node) - node->spaceAvail;
+                counted.add(numKeys, nodeCapacity(node));
+                const PageId *children = nodeChildren(node);
+                below.insert(below.end(), children, children + numKeys + 1);
+                aboveLeaves = node->level == 1;
+            }
+            releasePage(level[i], page, false);
+        }
+        shape.levels.push_back(counted);
+        level.swap(below);
+        leafLevel = aboveLeaves;
+    }
+}
+
+bool BTreeIndex::filterRejects(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp) {
+    if (!keyFilter || lowOp != GTE || highOp != LTE) return false;
+    switch (attributeType) {
+        case INTEGER: {
+            int low, high;
+            readKey(lowVal, low);
+            readKey(highVal, high);
+            return low == high && !keyFilter->mayContain(keyHash(low));
+        }
+        case DOUBLE: {
+            double low, high;
+            readKey(lowVal, low);
+            readKey(highVal, high);
+            return low == high && !keyFilter->mayContain(keyHash(low));
+        }
+        case STRING: {
+            StringKey low, high;
+            readKey(lowVal, low);
+            readKey(highVal, high);
+            return low == high && !keyFilter->mayContain(keyHash(low));
+        }
+    }
+    return false;
+}
+
+void BTreeIndex::setMergeThreshold(const double threshold) {
+    mergeThreshold = threshold;
+}
+
+void BTreeIndex::setPointerSwizzling(const bool enabled) {
+    swizzling = enabled;
+}
+
+template <class K>
+bool BTreeIndex::deleteKey(const K &key, const RecordId rid) {
+    BADGERDB_TRACE_DEBUG("Delete entry: " << key);
+
+    NodePath path;
+    PageId leafId;
+    Page *leafPage;
+    searchNode(key, true, DESCEND_INSERT, path, leafId, leafPage);
+    const PageId firstLeafId = leafId;
+    const bool found = removeFromLeaf(key, rid, leafId, leafPage);
+    if (found) {
+        counters.add(INDEX_DELETES);
+        entryChanges.add(INDEX_DELETES);
+    }
+
+    // only the leaf the tree routes key to is merged; a leaf reached by moving right is left as it is
+    LeafNode<K> *leaf = (LeafNode<K> *)leafPage;
+    const bool rebalance = found && leafId == firstLeafId &&
+                           underfull(leafCapacity(leaf) - leaf->spaceAvail, leafCapacity(leaf), mergeThreshold);
+    releasePage(leafId, leafPage, true, found);
+    commitLog();
+    if (!rebalance) return found;
+
+    searchNode(key, true, DESCEND_MERGE, path, leafId, leafPage);
+    const int heldDepth = path.depth;
+    std::vector<PageId> retired;
+    if (heldDepth > 0) {
+        mergeUp<K>(path, leafId, leafPage, retired);
+    }
+
+    releasePage(leafId, leafPage, true, true);
+    for (int i = 0; i < heldDepth; i++) {
+        releasePage(path.entries[i].pageNo, path.entries[i].page, true, true);
+    }
+    commitLog();
+    // a retired node may be pinned in pinnedTop, and is only freed once a set without it replaces that one
+    if (pinnedTopStale) refreshPinnedTop();
+    counters.add(INDEX_MERGES, retired.size());
+    for (size_t i = 0; i < retired.size(); i++) {
+        retireNode(retired[i]);
+    }
+    return true;
+}
+
+template <class K>
+bool BTreeIndex::removeFromLeaf(const K &key, const RecordId rid, PageId &leafId, Page *&leafPage) {
+    while (true) {
+        LeafNode<K> *leaf = (LeafNode<K> *)leafPage;
+        const int numEntries = leafCapacity(leaf) - leaf->spaceAvail;
+        int slot = leafLowerBound(leaf, numEntries, key);
+        for (; slot < numEntries && leafKey(leaf, slot) == key; slot++) {
+            if (leafRids(leaf)[slot] == rid) {
+                leafRemove(leaf, numEntries, slot);
+                return true;
+            }
+        }
+        // a key greater than key ends the search; otherwise duplicates may continue in the right sibling
+        if (slot < numEntries || leaf->rightSibPageNo == Page::INVALID_NUMBER) return false;
+
+        PageId sibId = leaf->rightSibPageNo;
+        Page *sibPage;
+        bufMgr->readPage(file, sibId, sibPage);
+        bufMgr->latchPage(sibPage, true);
+        logPage(sibId, sibPage);
+        releasePage(leafId, leafPage, true);
+        leafId = sibId;
+        leafPage = sibPage;
+    }
+}
+
+template <class K>
+void BTreeIndex::mergeUp(NodePath &path, const PageId leafId, Page *leafPage, std::vector<PageId> &retired) {
+    NodePathEntry parent = path.pop();
+    NonLeafNode<K> *parentNode = (NonLeafNode<K> *)parent.page;
+    int parentKeys = nodeCapacity(parentNode) - parentNode->spaceAvail;
+    if (parentKeys == 0) return;
+
+    // pair the leaf with its right sibling, or its left one if it is the last child; latches are always taken
+    // left to right, so a left sibling is latched before the leaf is latched again
+    const int leftSlot = parent.slot < parentKeys ? parent.slot : parent.slot - 1;
+    const PageId leftId = nodeChildren(parentNode)[leftSlot];
+    const PageId rightId = nodeChildren(parentNode)[leftSlot + 1];
+    Page *leftPage;
+    Page *rightPage;
+    if (leftSlot == parent.slot) {
+        leftPage = leafPage;
+        bufMgr->readPage(file, rightId, rightPage);
+        bufMgr->latchPage(rightPage, true);
+        logPage(rightId, rightPage);
+    } else {
+        rightPage = leafPage;
+        bufMgr->unlatchPage(leafPage, true);
+        bufMgr->readPage(file, leftId, leftPage);
+        bufMgr->latchPage(leftPage, true);
+        logPage(leftId, leftPage);
+        // the leaf is unchanged, but another operation may have changed it while it was unlatched
+        bufMgr->latchPage(leafPage, true);
+        logPage(leafId, leafPage);
+    }
+
+    LeafNode<K> *left = (LeafNode<K> *)leftPage;
+    LeafNode<K> *right = (LeafNode<K> *)rightPage;
+    const int leftCount = leafCapacity(left) - left->spaceAvail;
+    const int rightCount = leafCapacity(right) - right->spaceAvail;
+    const K lowFence = leafLowFence(left);
+    const K highFence = leafHighFence(right);
+    const bool merged = leftCount + rightCount <= leafCapacityFor(lowFence, highFence, includedWidth);
+    if (merged) {
+        // rebuild the left leaf over both key ranges; the right one keeps its entries and sibling link for
+        // cursors that already hold its page number
+        std::vector<K> keys(leftCount + rightCount);
+        std::vector<RecordId> rids(leftCount + rightCount);
+        for (int i = 0; i < leftCount; i++) {
+            keys[i] = leafKey(left, i);
+        }
+        for (int i = 0; i < rightCount; i++) {
+            keys[leftCount + i] = leafKey(right, i);
+        }
+        std::copy(leafRids(left), leafRids(left) + leftCount, rids.begin());
+        std::copy(leafRids(right), leafRids(right) + rightCount, rids.begin() + leftCount);
+        std::vector<char> attrs;
+        appendIncluded(left, 0, leftCount, attrs);
+        appendIncluded(right, 0, rightCount, attrs);
+
+        leafInit(left, lowFence, highFence, includedWidth);
+        for (int i = 0; i < leftCount + rightCount; i++) {
+            leafInsert(left, i, i, keys[i], rids[i], includedAt(attrs, includedWidth, i));
+        }
+        left->rightSibPageNo = right->rightSibPageNo;
+        if (right->rightSibPageNo != Page::INVALID_NUMBER) {
+            // the leaf after the pair is latched last, keeping the latches left to right
+            Page *nextPage = fetchPage(right->rightSibPageNo, true);
+            logPage(right->rightSibPageNo, nextPage);
+            ((LeafNode<K> *)nextPage)->leftSibPageNo = leftId;
+            releasePage(right->rightSibPageNo, nextPage, true, true);
+        }
+        nodeRemove(parentNode, parentKeys, leftSlot);
+        retired.push_back(rightId);
+        PageId cached = rightId;
+        rightmostLeaf.compare_exchange_strong(cached, Page::INVALID_NUMBER);
+    }
+    if (leftSlot == parent.slot) {
+        releasePage(rightId, rightPage, true);
+    } else {
+        releasePage(leftId, leftPage, true, merged);
+    }
+    if (!merged) return;
+
+    // each merge takes a separator out of the node above; merge that node in turn while it is underfull
+    while (true) {
+        NonLeafNode<K> *node = (NonLeafNode<K> *)parent.page;
+        const int numKeys = nodeCapacity(node) - node->spaceAvail;
+
+        PageId rootId;
+        bool rootIsLeaf;
+        getRoot(rootId, rootIsLeaf);
+        if (parent.pageNo == rootId) {
+            if (numKeys > 0) return;
+
+            // the root is left with a single child, which becomes the root
+            BADGERDB_TRACE_INFO("Collapsing the root");
+            const PageId childId = nodeChildren(node)[0];
+            Page *metaPage = fetchPage(headerPageNum, true);
+            IndexMetaInfo *meta = (IndexMetaInfo *)metaPage;
+            meta->rootPageNo = childId;
+            meta->rootIsLeaf = node->level == 1;
+            {
+                std::lock_guard<std::mutex> guard(rootLock);
+                rootPageNum = childId;
+                insertInRoot = node->level == 1;
+                meta->height = --treeHeight;
+            }
+            releasePage(headerPageNum, metaPage, true, true);
+            retired.push_back(parent.pageNo);
+            pinnedTopStale = true;
+            return;
+        }
+        if (!underfull(numKeys, nodeCapacity(node), mergeThreshold) || path.depth == 0) return;
+
+        const NodePathEntry grandparent = path.pop();
+        NonLeafNode<K> *grandNode = (NonLeafNode<K> *)grandparent.page;
+        const int grandKeys = nodeCapacity(grandNode) - grandNode->spaceAvail;
+        if (grandKeys == 0) return;
+
+        const int nodeLeftSlot = grandparent.slot < grandKeys ? grandparent.slot : grandparent.slot - 1;
+        const PageId nodeLeftId = nodeChildren(grandNode)[nodeLeftSlot];
+        const PageId nodeRightId = nodeChildren(grandNode)[nodeLeftSlot + 1];
+        Page *nodeLeftPage;
+        Page *nodeRightPage;
+        // the grandparent is held, so no other operation reaches the node while it is unlatched here
+        if (nodeLeftSlot == grandparent.slot) {
+            nodeLeftPage = parent.page;
+            bufMgr->readPage(file, nodeRightId, nodeRightPage);
+            bufMgr->latchPage(nodeRightPage, true);
+            logPage(nodeRightId, nodeRightPage);
+        } else {
+            nodeRightPage = parent.page;
+            bufMgr->unlatchPage(parent.page, true);
+            bufMgr->readPage(file, nodeLeftId, nodeLeftPage);
+            bufMgr->latchPage(nodeLeftPage, true);
+            logPage(nodeLeftId, nodeLeftPage);
+            bufMgr->latchPage(parent.page, true);
+        }
+
+        // the separator between the two comes down between their keys
+        NonLeafNode<K> *nodeLeft = (NonLeafNode<K> *)nodeLeftPage;
+        NonLeafNode<K> *nodeRight = (NonLeafNode<K> *)nodeRightPage;
+        const int nodeLeftKeys = nodeCapacity(nodeLeft) - nodeLeft->spaceAvail;
+        const int nodeRightKeys = nodeCapacity(nodeRight) - nodeRight->spaceAvail;
+        const K mergedLowFence = nodeLowFence(nodeLeft);
+        const K mergedHighFence = nodeHighFence(nodeRight);
+        const bool nodesMerged = nodeLeftKeys + 1 + nodeRightKeys <= nodeCapacityFor(mergedLowFence, mergedHighFence);
+        if (nodesMerged) {
+            const int total = nodeLeftKeys + 1 + nodeRightKeys;
+            std::vector<K> keys(total);
+            std::vector<PageId> children(total + 1);
+            for (int i = 0; i < nodeLeftKeys; i++) {
+                keys[i] = nodeKey(nodeLeft, i);
+            }
+            keys[nodeLeftKeys] = nodeKey(grandNode, nodeLeftSlot);
+            for (int i = 0; i < nodeRightKeys; i++) {
+                keys[nodeLeftKeys + 1 + i] = nodeKey(nodeRight, i);
+            }
+            std::copy(nodeChildren(nodeLeft), nodeChildren(nodeLeft) + nodeLeftKeys + 1, children.begin());
+            std::copy(nodeChildren(nodeRight), nodeChildren(nodeRight) + nodeRightKeys + 1,
+                      children.begin() + nodeLeftKeys + 1);
+
+            nodeInit(nodeLeft, nodeLeft->level, children[0], mergedLowFence, mergedHighFence);
+            for (int i = 0; i < total; i++) {
+                nodeInsert(nodeLeft, i, i, keys[i], children[i + 1]);
+            }
+            nodeRemove(grandNode, grandKeys, nodeLeftSlot);
+            retired.push_back(nodeRightId);
+            pinnedTopStale = true;
+        }
+        // the node from the path is released with the rest of the path
+        if (nodeLeftSlot == grandparent.slot) {
+            releasePage(nodeRightId, nodeRightPage, true);
+        } else {
+            releasePage(nodeLeftId, nodeLeftPage, true, nodesMerged);
+        }
+        if (!nodesMerged) return;
+        parent = grandparent;
+    }
+}
+
+void BTreeIndex::freeNode(const PageId pid) {
+    // descents latch their way down without entering epochs, so one that read the old root just before it
+    // collapsed may still hold a pin on it for a moment
+    while (true) {
+        try {
+            bufMgr->disposePage(file, pid);
+            return;
+        } catch (const PagePinnedException &e) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void BTreeIndex::retireNode(const PageId pid) {
+    epochs.retire(pid);
+    reclaimNodes();
+}
+
+void BTreeIndex::reclaimNodes() {
+    std::vector<PageId> reclaimed;
+    epochs.collect(reclaimed);
+    for (size_t i = 0; i < reclaimed.size(); i++) {
+        freeNode(reclaimed[i]);
+    }
+}
+
+PinnedNodes::~PinnedNodes() {
+    for (size_t i = 0; i < nodes.size(); i++) {
+        bufMgr->unPinPage(file, nodes[i].first, false);
+    }
+}
 
-//#define DEBUG
+void BTreeIndex::refreshPinnedTop() {
+    if (mapping != NULL) return;
+    std::lock_guard<std::mutex> guard(pinnedTopLock);
+    // a node created or removed while the set is built marks it stale again
+    pinnedTopStale = false;
+    std::shared_ptr<PinnedNodes> fresh(new PinnedNodes(bufMgr, file));
+    switch (attributeType) {
+        case INTEGER:
+            collectPinnedTop<int>(*fresh);
+            break;
+        case DOUBLE:
+            collectPinnedTop<double>(*fresh);
+            break;
+        case STRING:
+            collectPinnedTop<StringKey>(*fresh);
+            break;
+    }
+    std::atomic_store(&pinnedTop, std::shared_ptr<const PinnedNodes>(fresh));
+}
 
-namespace badgerdb {
+/**
+ * Reads the top levels one at a time, each node under a shared latch of its own. The tree may change in between;
+ * the set then only misses nodes, which descents read through the buffer manager, or holds nodes already removed,
+ * which whoever removed them replaces it without before freeing them.
+ *
+ * @param nodes     Set to fill
+ */
+template <class K>
+void BTreeIndex::collectPinnedTop(PinnedNodes &nodes) {
+    PageId rootId;
+    bool rootIsLeaf;
+    getRoot(rootId, rootIsLeaf);
+    if (rootIsLeaf) return;
+
+    const size_t budget = (size_t)(bufMgr->frames() * PINNED_TOP_FRACTION);
+    std::vector<std::pair<PageId, Page *> > pinned;
+    std::vector<PageId> level(1, rootId);
+    for (int depth = 0; depth < PINNED_TOP_LEVELS && !level.empty() && pinned.size() + level.size() <= budget;
+         depth++) {
+        std::vector<PageId> below;
+        for (size_t i = 0; i < level.size(); i++) {
+            Page *page;
+            bufMgr->readPage(file, level[i], page);
+            // descents latch pinned nodes in their frames directly; optimistic reads find them through swizzled
+            if (swizzling) swizzled[level[i] & swizzleMask].store(page, std::memory_order_relaxed);
+            bufMgr->latchPage(page, false);
+            const NonLeafNode<K> *node = (const NonLeafNode<K> *)page;
+            if (node->level != 1) {
+                const PageId *children = nodeChildren(node);
+                below.insert(below.end(), children, children + nodeCapacity(node) - node->spaceAvail + 1);
+            }
+            bufMgr->unlatchPage(page, false);
+            pinned.push_back(std::make_pair(level[i], page));
+        }
+        level.swap(below);
+    }
+    std::sort(pinned.begin(), pinned.end());
+    for (size_t i = 0; i < pinned.size(); i++) {
+        nodes.add(pinned[i].first, pinned[i].second);
+    }
+}
+
+void BTreeIndex::releasePinnedTop() {
+    std::lock_guard<std::mutex> guard(pinnedTopLock);
+    std::atomic_store(&pinnedTop, std::shared_ptr<const PinnedNodes>());
+}
+
+bool BTreeIndex::latchPinnedRoot(const PinnedNodes &top, PageId &rootId, Page *&rootPage) {
+    bool rootIsLeaf;
+    getRoot(rootId, rootIsLeaf);
+    rootPage = rootIsLeaf ? NULL : top.find(rootId);
+    if (rootPage == NULL) return false;
 
-void printArray(const int *arr, int size);
+    // as in latchRoot, a root split happens under the old root's exclusive latch
+    bufMgr->latchPage(rootPage, false);
+    PageId latchedId;
+    bool latchedIsLeaf;
+    getRoot(latchedId, latchedIsLeaf);
+    if (latchedId == rootId) return true;
+    bufMgr->unlatchPage(rootPage, false);
+    return false;
+}
+
+void BTreeIndex::getRoot(PageId &rootId, bool &rootIsLeaf) {
+    std::lock_guard<std::mutex> guard(rootLock);
+    rootId = rootPageNum;
+    rootIsLeaf = insertInRoot;
+}
+
+void BTreeIndex::latchRoot(const DescentMode mode, PageId &rootId, Page *&rootPage, bool &rootIsLeaf) {
+    while (true) {
+        getRoot(rootId, rootIsLeaf);
+        bool exclusive = mode == DESCEND_SPLIT || mode == DESCEND_SPLIT_LEAF || mode == DESCEND_MERGE ||
+                         (mode == DESCEND_INSERT && rootIsLeaf);
+        rootPage = fetchPage(rootId, exclusive);
+
+        // a root split happens under the old root's exclusive latch, so once latched the root is current
+        PageId latchedId;
+        bool latchedIsLeaf;
+        getRoot(latchedId, latchedIsLeaf);
+        if (latchedId == rootId) return;
+        releasePage(rootId, rootPage, exclusive);
+    }
+}
+
+Page *BTreeIndex::fetchPage(const PageId pid, const bool exclusive) {
+    // a mapped page is never written, so PROT_READ protects it if a caller tries to
+    if (mapping != NULL) return const_cast<Page *>(mapping->page(pid));
+    Page *page = NULL;
+    std::atomic<Page *> *slot = swizzling ? &swizzled[pid & swizzleMask] : NULL;
+    if (slot != NULL) page = slot->load(std::memory_order_relaxed);
+    if (page == NULL || !bufMgr->pinFrame(file, pid, page)) {
+        bufMgr->readPage(file, pid, page);
+        if (slot != NULL) slot->store(page, std::memory_order_relaxed);
+    }
+    bufMgr->latchPage(page, exclusive);
+    if (exclusive) logPage(pid, page);
+    return page;
+}
+
+void BTreeIndex::releasePage(const PageId pid, Page *page, const bool exclusive, const bool dirty) {
+    if (mapping != NULL) return;
+    const bool held = exclusive && holdLogged(pid, page);
+    if (!held) bufMgr->unlatchPage(page, exclusive);
+    bufMgr->unPinFrame(file, pid, page, dirty || held);
+}
 
 /**
- * BTreeIndex Constructor.
- * Check to see if the corresponding index file exists. If so, open the file.
- * If not, create it and insert entries for every tuple in the base relation using FileScan class.
- *
- * @param relationName        Name of file.
- * @param outIndexName        Return the name of index file.
- * @param bufMgrIn			  Buffer Manager Instance
- * @param attrByteOffset	  Offset of attribute, over which index is to be built, in the record
- * @param attrType			  Datatype of attribute over which index is built
- * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
+ * Operation running on this thread, whose pages go to the write-ahead log of its index.
  */
+static thread_local OperationLog operationLog;
 
-BTreeIndex::BTreeIndex(const std::string &relationName,
-                       std::string &outIndexName,
-                       BufMgr *bufMgrIn,
-                       const int attrByteOffset,
-                       const Datatype attrType) {
-    // initialize variables
-    this->attributeType = attrType;
-    this->attrByteOffset = attrByteOffset;
-    scanExecuting = false;
-    bufMgr = bufMgrIn;
-    leafOccupancy = INTARRAYLEAFSIZE;
-    nodeOccupancy = INTARRAYNONLEAFSIZE;
-    lowValDouble = -1;
-    highValDouble = -1;
-    // Want to begin by inserting into the root
-    insertInRoot = true;
-    Page *metaPage;
-    // Page *rootPage;
+LogScope::LogScope(BTreeIndex *index) : index(index), outermost(operationLog.index == NULL && index->log) {
+    if (outermost) operationLog.index = index;
+}
+
+void LogScope::commit() {
+    if (outermost) index->commitLog();
+}
+
+LogScope::~LogScope() {
+    if (!outermost) return;
+    // an operation that threw before commit still releases its pages; the buffer manager flushes their group
+    // before any of them is written back
+    index->appendLog();
+    operationLog.index = NULL;
+}
 
-    // check correct datatype
-    if (attrType != INTEGER) {
-        std::cout << "Incorrect data type.";
+void BTreeIndex::logPage(const PageId pid, Page *page, const bool created) {
+    if (operationLog.index != this) return;
+    std::vector<LoggedPage> &pages = operationLog.pages;
+    for (size_t i = 0; i < pages.size(); i++) {
+        if (pages[i].frame != page) continue;
+        // latched again after an unlatch: whatever the page holds now was changed by someone else
+        if (pages[i].before) *pages[i].before = *page;
         return;
     }
-    // Creating the index file name, taken from the project specification
-    std::ostringstream indexStr;
-    indexStr << relationName << '.' << attrByteOffset;
-    outIndexName = indexStr.str();
+    LoggedPage logged;
+    logged.pageNo = pid;
+    logged.frame = page;
+    logged.held = created;
+    if (created) {
+        bufMgr->latchPage(page, true);
+    } else {
+        logged.before.reset(new Page(*page));
+    }
+    bufMgr->pinFrame(file, pid, page);
+    pages.push_back(std::move(logged));
+}
 
-    // Since meta contains information about the first page, we have to get the header page
-    // but also have to see if the file exists.
-    try {
-        file = new BlobFile(outIndexName, false);
-        headerPageNum = file->getFirstPageNo();
+bool BTreeIndex::holdLogged(const PageId pid, Page *page) {
+    if (operationLog.index != this) return false;
+    std::vector<LoggedPage> &pages = operationLog.pages;
+    for (size_t i = 0; i < pages.size(); i++) {
+        if (pages[i].frame != page) continue;
+        if (!pages[i].before || memcmp(pages[i].before.get(), page, Page::SIZE) != 0) {
+            pages[i].held = true;
+            return true;
+        }
+        bufMgr->unPinFrame(file, pid, page, false);
+        pages.erase(pages.begin() + i);
+        return false;
+    }
+    return false;
+}
 
-        // After we get the first page, we use meta's info to compare with the given info to see if it matches.
-        bufMgr->readPage(file, headerPageNum, metaPage);
-        IndexMetaInfo *meta = (IndexMetaInfo *)metaPage;
-        if (relationName != meta->relationName) throw BadIndexInfoException("Index doesn't exist.");
-        if (attributeType != meta->attrType) throw BadIndexInfoException("Index doesn't exist.");
-        if (attrByteOffset != meta->attrByteOffset) throw BadIndexInfoException("Index  doesn't exist.");
+void BTreeIndex::commitLog() {
+    const Lsn lsn = appendLog();
+    if (lsn != 0) log->flush(lsn);
+}
 
-        // unpin headerPage because we are finished with it but didn't modify it.
-        bufMgr->unPinPage(file, headerPageNum, false);
+Lsn BTreeIndex::appendLog() {
+    if (operationLog.index != this || operationLog.pages.empty()) return 0;
+    std::vector<LoggedPage> &pages = operationLog.pages;
+    LogGroup group;
+    std::vector<bool> changed(pages.size());
+    for (size_t i = 0; i < pages.size(); i++) {
+        const size_t records = group.size();
+        if (pages[i].before)
+            group.addChanges(pages[i].pageNo, *pages[i].before, *pages[i].frame);
+        else
+            group.addPage(pages[i].pageNo, *pages[i].frame);
+        changed[i] = group.size() > records;
+    }
+    Lsn lsn = 0;
+    if (!group.empty()) {
+        // the group goes into the log before any of its pages is unlatched, so changes to a page are logged
+        // in the order they were made, and before any of them is unpinned, so none is written back ahead of it
+        const Lsn first = log->end();
+        for (size_t i = 0; i < pages.size(); i++) {
+            if (changed[i]) bufMgr->logChange(pages[i].frame, first);
+        }
+        lsn = log->append(group);
+        for (size_t i = 0; i < pages.size(); i++) {
+            if (changed[i]) bufMgr->setPageLsn(pages[i].frame, log.get(), lsn);
+        }
+    }
+    for (size_t i = 0; i < pages.size(); i++) {
+        if (pages[i].held) bufMgr->unlatchPage(pages[i].frame, true);
+        bufMgr->unPinFrame(file, pages[i].pageNo, pages[i].frame, changed[i]);
+    }
+    pages.clear();
+    return lsn;
+}
 
-    } catch (FileNotFoundException) {  // This means file doesn't exist so create a file.
-        // file = new BlobFile(outIndexName, true);
+void BTreeIndex::setWriteAheadLog(const bool enabled) {
+    if (mapping != NULL || enabled == (bool)log) return;
+    // the log only redoes what is done from now on, over a file that holds everything done before
+    releasePinnedTop();
+    bufMgr->flushFile(file);
+    if (log) log->truncate();
+    log.reset(enabled ? new LogManager(logName(file->filename())) : NULL);
+    refreshPinnedTop();
+}
 
-        BlobFile *newFile = new BlobFile(outIndexName, true);
-        file = (File *)newFile;
-        PageId metaPageId;
-        Page *metaPage;
-        bufMgr->allocPage(file, metaPageId, metaPage);
+std::size_t BTreeIndex::checkpoint() {
+    if (!log) return 0;
+    // every group from begin on is replayed; a page changed before it but not yet written back holds the redo
+    // point back to its oldest change
+    const Lsn begin = log->end();
+    std::vector<DirtyPage> dirty;
+    bufMgr->dirtyPageTable(file, dirty);
+    Lsn redo = begin;
+    for (size_t i = 0; i < dirty.size(); i++) redo = std::min(redo, dirty[i].recLsn);
+    // the header records pages allocated since the last checkpoint, which replay from redo may not see
+    file->sync();
+    log->checkpoint(redo);
+    bufMgr->trickle(file, begin);
+    return dirty.size();
+}
 
-        IndexMetaInfo *metaInfo = (IndexMetaInfo *)metaPage;
-        strcpy(metaInfo->relationName, relationName.c_str());
-        metaInfo->attrByteOffset = attrByteOffset;
-        metaInfo->attrType = attrType;
-        headerPageNum = metaPageId;
+template <class K>
+bool BTreeIndex::readOptimistic(const PageId pid, Page *scratch, OptimisticPage &page) {
+    page.frame = swizzled[pid & swizzleMask].load(std::memory_order_relaxed);
+    if (page.frame == NULL || !bufMgr->readVersion(file, pid, page.frame, page.version)) return false;
+    page.node = page.frame;
+    if (!OptimisticCopy<K>::COPY) return true;
+    memcpy(scratch, page.frame, Page::SIZE);
+    page.node = scratch;
+    return validate(page);
+}
+
+/**
+ * Walks from the root to the leaf the key belongs in like searchNode in DESCEND_READ mode, but reads every node
+ * optimistically. A node is validated only after the version of the child followed out of it has been read,
+ * so the child was the right one at a moment when its version was the one read.
+ *
+ * @param key       Key to search for
+ * @param leftmost  True to follow the leftmost child that may hold key
+ * @param scratch   Page nodes are copied into when they need to be
+ * @param leaf      Returns the leaf, still to be validated
+ * @return          False if the descent has to be repeated
+ */
+template <class K>
+bool BTreeIndex::descendOptimistic(const K &key, const bool leftmost, Page *scratch, OptimisticPage &leaf) {
+    PageId rootId;
+    bool isLeaf;
+    getRoot(rootId, isLeaf);
+    OptimisticPage current;
+    if (!readOptimistic<K>(rootId, scratch, current)) return false;
 
-        // create a meta page for the new index and fill out it's information.
-        // bufMgr->allocPage(file, headerPageNum, metaPage);
-        // bufMgr->allocPage(file, rootPageNum, rootPage);
-        // IndexMetaInfo *meta = (IndexMetaInfo *)metaPage;
-        // strncpy(meta->relationName, relationName.c_str(), 20);
-        // meta->attrType = attrType;
-        // meta->rootPageNo = rootPageNum;
+    // as in latchRoot, the root stops being the root only under its exclusive latch, which changes its version
+    PageId checkId;
+    bool checkIsLeaf;
+    getRoot(checkId, checkIsLeaf);
+    if (checkId != rootId || checkIsLeaf != isLeaf) return false;
+    int visited = 1;
+    while (!isLeaf) {
+        const NonLeafNode<K> *node = (const NonLeafNode<K> *)current.node;
+        const int numKeys = nodeKeys(node);
+        const int slot = leftmost ? nodeLowerBound(node, numKeys, key) : nodeUpperBound(node, numKeys, key);
+        const PageId childId = nodeChildren(node)[slot];
+        isLeaf = node->level == 1;
 
-        // Create the root.
-        // NonLeafNodeInt *root = (NonLeafNodeInt *)rootPage;
+        OptimisticPage child;
+        if (!readOptimistic<K>(childId, scratch, child) || !validate(current)) return false;
+        current = child;
+        visited++;
+    }
+    leaf = current;
+    counters.add(INDEX_DESCENTS);
+    counters.add(INDEX_DESCENT_NODES, visited);
+    return true;
+}
 
-        PageId rootPageId;
-        Page *rootPage;
+/**
+ * Walks from the root to the leaf the key belongs in, one level per iteration, coupling latches: the child is
+ * latched before the parent is released. In DESCEND_SPLIT mode a non-leaf node stays latched on the path until a
+ * node below it is found to have room, and in DESCEND_MERGE mode until a node below it can lose a key without
+ * becoming underfull; the slot followed out of each is recorded for splits and merges to use.
+ *
+ * @param key       Key to search for
+ * @param leftmost  True to follow the leftmost child that may hold key
+ * @param mode      How the nodes on the way down are latched
+ * @param path      Returns the non-leaf nodes still latched, root first
+ * @param leafId    Returns the Page ID of the leaf the key belongs in
+ * @param leafPage  Returns the leaf, pinned and latched
+ * @param bound     If not NULL, returns the separator bounding the leaf's keys from above
+ */
+template <class K>
+void BTreeIndex::searchNode(const K &key, const bool leftmost, const DescentMode mode, NodePath &path,
+                            PageId &leafId, Page *&leafPage, K *bound, K *parentBound) {
+    BADGERDB_TRACE_DEBUG("Searching for : " << key);
 
-        std::cout << "Rootpage Id initialize: " << rootPageId << std::endl;
+    PageId currentId;
+    Page *curPage;
+    bool isLeaf = false;
+    if (bound != NULL) *bound = KeyBounds<K>::highest();
+    if (parentBound != NULL) *parentBound = KeyBounds<K>::highest();
 
-        bufMgr->allocPage(file, rootPageId, rootPage);
-        rootPageNum = rootPageId;
-        ((LeafNodeInt *)rootPage)->rightSibPageNo = Page::INVALID_NUMBER;
-        ((LeafNodeInt *)rootPage)->spaceAvail = INTARRAYLEAFSIZE;
-        ((LeafNodeInt *)rootPage)->parentId = -1;
+    // non-leaf nodes are latched shared in these modes and released on the way down, so any of them that is
+    // pinned in pinnedTop is latched in its frame and never pinned or unpinned by the descent itself
+    std::shared_ptr<const PinnedNodes> top;
+    if (mapping == NULL && (mode == DESCEND_READ || mode == DESCEND_INSERT)) top = std::atomic_load(&pinnedTop);
+    bool curPinned = top && latchPinnedRoot(*top, currentId, curPage);
+    if (!curPinned) {
+        top.reset();
+        latchRoot(mode, currentId, curPage, isLeaf);
+    }
+    int visited = 1;
+    while (!isLeaf) {
+        NonLeafNode<K> *curNode = (NonLeafNode<K> *)curPage;
+        int numKeys = nodeCapacity(curNode) - curNode->spaceAvail;  // How many keys are in this node
 
-        bufMgr->unPinPage(file, rootPageId, true);
-        metaInfo->rootPageNo = rootPageId;
-        bufMgr->unPinPage(file, metaPageId, true);
-        FileScan FS(relationName, bufMgr);
+        BADGERDB_TRACE_DEBUG("Current level:  " << curNode->level);
 
-        std::cout << "Rootpage Id after: " << rootPageId << std::endl;
-        std::cout << "Rootpage NO after: " << rootPageNum << std::endl;
+        // Right biased: a key equal to a separator belongs to the child on its right. Scans start left of it,
+        // since duplicates of a separator may also end the leaf to its left.
+        int slot = leftmost ? nodeLowerBound(curNode, numKeys, key) : nodeUpperBound(curNode, numKeys, key);
+        PageId childId = nodeChildren(curNode)[slot];
+        isLeaf = curNode->level == 1;
+        // each level's separator lies within the one above it, so the deepest one found is the tightest
+        if (parentBound != NULL && isLeaf) *parentBound = *bound;
+        if (bound != NULL && slot < numKeys) *bound = nodeKey(curNode, slot);
 
-        // get every tuple from the relation and load into the new file.
-        RecordId rid;
-        while (true) {  // get all rids that meet the predicate and break if the end of the file of relationName is reached.
-            try {
-                // get
-                FS.scanNext(rid);
-                insertEntry(FS.getRecord().c_str() + attrByteOffset, rid);
-            } catch (EndOfFileException e) {
-                break;
+        const bool splitting = mode == DESCEND_SPLIT || mode == DESCEND_SPLIT_LEAF;
+        bool childExclusive = splitting || mode == DESCEND_MERGE || (mode == DESCEND_INSERT && isLeaf);
+        Page *childPage = top && !isLeaf ? top->find(childId) : NULL;
+        const bool childPinned = childPage != NULL;
+        if (childPinned) {
+            bufMgr->latchPage(childPage, childExclusive);
+        } else {
+            childPage = fetchPage(childId, childExclusive);
+        }
+
+        if (splitting || mode == DESCEND_MERGE) {
+            path.push(currentId, slot, curPage);
+            // a child with room absorbs any split below it, and a child that can spare a key absorbs any merge
+            // below it, so nothing above it can change
+            bool childSafe;
+            if (mode == DESCEND_SPLIT_LEAF && isLeaf) {
+                childSafe = false;
+            } else if (splitting) {
+                childSafe = (isLeaf ? ((LeafNode<K> *)childPage)->spaceAvail
+                                    : ((NonLeafNode<K> *)childPage)->spaceAvail) > 0;
+            } else if (isLeaf) {
+                LeafNode<K> *child = (LeafNode<K> *)childPage;
+                childSafe = !underfull(leafCapacity(child) - child->spaceAvail, leafCapacity(child), mergeThreshold);
+            } else {
+                NonLeafNode<K> *child = (NonLeafNode<K> *)childPage;
+                childSafe =
+                    !underfull(nodeCapacity(child) - child->spaceAvail - 1, nodeCapacity(child), mergeThreshold);
             }
+            if (childSafe) {
+                while (path.depth > 0) {
+                    const NodePathEntry &held = path.pop();
+                    releasePage(held.pageNo, held.page, true);
+                }
+            }
+        } else if (curPinned) {
+            bufMgr->unlatchPage(curPage, false);
+        } else {
+            releasePage(currentId, curPage, false);
         }
-        // finished with the meta page and root page and we did modify it.
-        // bufMgr->unPinPage(file, headerPageNum, true);
-        // bufMgr->unPinPage(file, rootPageNum, true);
+        currentId = childId;
+        curPage = childPage;
+        curPinned = childPinned;
+        visited++;
     }
+    leafId = currentId;
+    leafPage = curPage;
+    counters.add(INDEX_DESCENTS);
+    counters.add(INDEX_DESCENT_NODES, visited);
 }
 
 /**
- * BTreeIndex Destructor.
- * End any initialized scan, flush index file, after unpinning any pinned pages, from the buffer manager
- * and delete file instance thereby closing the index file.
- * Destructor should not throw any exceptions. All exceptions should be caught in here itself.
- * */
-BTreeIndex::~BTreeIndex() {
-    // The destructor should end any scan, clear state variables, unpin pinned pages, and flush index file,
-    // and deletes the file object.
-    if (scanExecuting) {  // If the scan is executing, then end it.
-        try {
-            endScan();
-        } catch (ScanNotInitializedException) {
-            std::cout << "No scan has been initialized.";
+ * Formats a key array ten entries per line for trace output.
+ *
+ * @param arr   Keys to format
+ * @param size  Number of keys in arr
+ * @return      The formatted keys
+ */
+template <class K>
+std::string formatArray(const K *arr, int size) {
+    std::ostringstream out;
+    for (int i = 0; i < size; i++) {
+        if (i % 10 == 0) {
+            out << std::endl;
         }
+        out << i << ": " << arr[i] << ",  ";
     }
-    // clears state variables and delete file instance.
-    scanExecuting = false;
-    bufMgr->flushFile(file);
-    delete file;
+    out << std::endl
+        << "#######################################################";
+    return out.str();
 }
 
 /**
- * Insert a new entry using the pair <value,rid>.
- * Start from root to recursively find out the leaf to insert the entry in. The insertion may cause splitting of leaf node.
- * This splitting will require addition of new leaf page number entry into the parent non-leaf, which may in-turn get split.
- * This may continue all the way upto the root causing the root to get split. If root gets split, metapage needs to be changed accordingly.
- * Make sure to unpin pages as soon as you can.
- * @param key			Key to insert, pointer to integer/double/char string
- * @param rid			Record ID of a record whose entry is getting inserted into the index.
- **/
-void BTreeIndex::insertEntry(const void *key, const RecordId rid) {
-    if (insertInRoot) {
-        //! debug
-        std::cout << "---------------------------" << std::endl;
-        std::cout << "Insert entry: " << *((int *)key) << " into rootnode" << std::endl;
-
-        // case 1 - there hasn't been a split yet, ie, all nodes inserted into root node (leaf node)
-        // call insert directly
-        insertIntoLeafNode(rootPageNum, rid, key);
-    } else {
-        //! debug
-        std::cout << "Regular insert: " << *((int *)key) << std::endl;
+ * This method is called when a non leaf node is at max capacity already so it needs to be split.
+ * The new separator is merged in first, then the node is cut around its middle key, which moves up to the parent
+ * and is kept in neither half.
+ *
+ * @param node      The full node, pinned
+ * @param pid       Page ID of the full node
+ * @param slot      Slot at which the separator in newChild belongs
+ * @param newChild  Separator and right child to insert; returns the pushed up key and the new node
+ */
+template <class K>
+void BTreeIndex::splitNonLeafNode(NonLeafNode<K> *node, const PageId pid, const int slot, PageKeyPair<K> &newChild) {
+    const int capacity = nodeCapacity(node);
+    BADGERDB_TRACE_INFO("Splitting non leaf node");
+    BADGERDB_SPAN("BTreeIndex::splitNode", pid);
+    pinnedTopStale = true;
+    counters.add(INDEX_NODE_SPLITS);
+
+    // merge the new separator into scratch copies holding one key and one child too many
+    std::vector<K> keys(capacity + 1);
+    std::vector<PageId> children(capacity + 2);
+    const PageId *nodeChildArray = nodeChildren(node);
+    for (int i = 0; i < capacity; i++) {
+        keys[i < slot ? i : i + 1] = nodeKey(node, i);
+    }
+    keys[slot] = newChild.key;
+    std::copy(nodeChildArray, nodeChildArray + slot + 1, children.begin());
+    std::copy(nodeChildArray + slot + 1, nodeChildArray + capacity + 1, children.begin() + slot + 2);
+    children[slot + 1] = newChild.pageNo;
+
+    BADGERDB_TRACE_DEBUG("Current node BEFORE split");
+    BADGERDB_TRACE_DEBUG(formatArray(&keys[0], capacity + 1));
 
-        // case 2 - traverse tree till you find a leaf node to insert into
-        PageId resultPage;
-        searchNode(resultPage, key, rootPageNum);
+    // Create the new page(sibling)
+    Page *newPage;
+    PageId newPageId;
+    bufMgr->allocPage(file, newPageId, newPage);
+    logPage(newPageId, newPage, true);
+    NonLeafNode<K> *newNode = (NonLeafNode<K> *)newPage;
 
-        // then call insert on the result
-        insertIntoLeafNode(resultPage, rid, key);
+    // left keeps keys [0, mid) and their mid + 1 children, keys[mid] moves up, right gets the rest. Each half
+    // is bounded by keys[mid] on one side, so neither has fewer slots than the node had.
+    const int mid = (capacity + 1) / 2;
+    const K lowFence = nodeLowFence(node);
+    const K highFence = nodeHighFence(node);
+    nodeInit(node, node->level, children[0], lowFence, keys[mid]);
+    for (int i = 0; i < mid; i++) {
+        nodeInsert(node, i, i, keys[i], children[i + 1]);
     }
+    nodeInit(newNode, node->level, children[mid + 1], keys[mid], highFence);
+    for (int i = mid + 1; i <= capacity; i++) {
+        nodeInsert(newNode, i - mid - 1, i - mid - 1, keys[i], children[i + 1]);
+    }
+
+    BADGERDB_TRACE_DEBUG("curNode start: " << nodeKey(node, 0));
+    BADGERDB_TRACE_DEBUG("newNode start: " << nodeKey(newNode, 0));
+
+    bufMgr->unPinPage(file, pid, true);
+    bufMgr->unPinPage(file, newPageId, true);
+
+    newChild.set(newPageId, keys[mid]);
 }
 
 /**
- * This method is called when inserting a value into a non leaf node. It checks to see if there is space available
- * and if not it calls splitNode
+ * This method is called when a leaf node is at max capacity already so it needs to be split.
+ * The upper half of the entries move to a new leaf linked in to the right, and the new entry goes into whichever
+ * half it belongs in. The smallest key of the new leaf is the separator to push up.
  *
- * @param pid			pageId of the page the value is to be inserted into
- * @param key			Key to insert, pointer to integer/double/char string
- **/
-void BTreeIndex::insertIntoNonLeafNode(const PageId pid, const void *key) {
-    //! debug
-    // std::cout << "Print self" << std::endl;
-    // bufMgr->printSelf();
-    std::cout << "" << std::endl;
-    std::cout << "insert into non leaf: " << *((int *)key) << std::endl;
+ * @param node      The full leaf, pinned
+ * @param pid       Page ID of the full leaf
+ * @param rid       RecordId of the entry to insert
+ * @param key       Key of the entry to insert
+ * @param included  Included attributes of the entry to insert, or NULL
+ * @param newChild  Returns the smallest key and Page ID of the new leaf
+ */
+template <class K>
+void BTreeIndex::splitLeafNode(LeafNode<K> *node, const PageId pid, const RecordId rid, const K &key,
+                               const char *included, PageKeyPair<K> &newChild) {
+    const int capacity = leafCapacity(node);
+    BADGERDB_TRACE_INFO("Splitting LEAF node");
 
-    // declare and read the current page
-    Page *curPage;
-    bufMgr->readPage(file, pid, curPage);
+    // merge the new entry, after any equal keys, into scratch copies holding one entry too many
+    const int slot = leafUpperBound(node, capacity, key);
+    std::vector<K> keys(capacity + 1);
+    std::vector<RecordId> rids(capacity + 1);
+    const RecordId *nodeRids = leafRids(node);
+    for (int i = 0; i < capacity; i++) {
+        keys[i < slot ? i : i + 1] = leafKey(node, i);
+    }
+    keys[slot] = key;
+    std::copy(nodeRids, nodeRids + slot, rids.begin());
+    std::copy(nodeRids + slot, nodeRids + capacity, rids.begin() + slot + 1);
+    rids[slot] = rid;
+    std::vector<char> attrs;
+    appendIncluded(node, 0, slot, attrs);
+    if (included != NULL) attrs.insert(attrs.end(), included, included + includedWidth);
+    appendIncluded(node, slot, capacity - slot, attrs);
 
-    // creating and initializing a node
-    NonLeafNodeInt *curNode = (NonLeafNodeInt *)curPage;
-
-    std::cout << "Space left: " << curNode->spaceAvail << std::endl;
-
-    // check if there is any space available within this non leaf node
-    if (curNode->spaceAvail > 0) {
-        // count how many spaces are full within node
-        int size = INTARRAYNONLEAFSIZE - curNode->spaceAvail;
-
-        // add key value to the node
-        curNode->keyArray[size] = *((int *)key);
-        // decrement the availSpace
-        curNode->spaceAvail--;
-        // for loop to traverse through the keyArray
-        // so it is in sorted order
-        for (int i = 0; i < size; i++) {
-            if (curNode->keyArray[size - i] < curNode->keyArray[size - i - 1]) {  // swap key values
-                int temp = curNode->keyArray[size - i - 1];
-                curNode->keyArray[size - i - 1] = curNode->keyArray[size - i];
-                curNode->keyArray[size - i] = temp;
+    BADGERDB_TRACE_DEBUG("Current node BEFORE split");
+    BADGERDB_TRACE_DEBUG(formatArray(&keys[0], capacity + 1));
+
+    // an append leaves the leaf full and starts the new rightmost leaf with the new entry
+    const bool append = slot == capacity && node->rightSibPageNo == Page::INVALID_NUMBER;
+    splitLeafEntries(node, pid, keys, rids, attrs, append ? capacity : (capacity + 1) / 2, newChild);
+    bufMgr->unPinPage(file, pid, true);
+}
+
+/**
+ * Refills a leaf with more entries than it holds: the node keeps the first leftCount and the rest move to a new
+ * leaf linked in to the right. The separator between the two bounds both, so neither has fewer slots than the node
+ * had, and each takes up to the node's capacity.
+ *
+ * @param node       The leaf, pinned
+ * @param keys       Keys of every entry, sorted
+ * @param rids       Record IDs of every entry
+ * @param included   Included attributes of every entry, or empty
+ * @param leftCount  Number of entries the node keeps
+ * @param newChild   Returns the separator and Page ID of the new leaf
+ */
+template <class K>
+void BTreeIndex::splitLeafEntries(LeafNode<K> *node, const PageId pid, const std::vector<K> &keys,
+                                  const std::vector<RecordId> &rids, const std::vector<char> &included,
+                                  const int leftCount, PageKeyPair<K> &newChild) {
+    BADGERDB_SPAN("BTreeIndex::splitLeaf", pid);
+    const int count = keys.size();
+    counters.add(INDEX_LEAF_SPLITS);
+
+    // create new node to split into
+    Page *newLeafPage;
+    PageId newLeafPageId;
+    bufMgr->allocPage(file, newLeafPageId, newLeafPage);
+    logPage(newLeafPageId, newLeafPage, true);
+    LeafNode<K> *splitNode = (LeafNode<K> *)newLeafPage;
+
+    const K separator = shortestSeparator(keys[leftCount - 1], keys[leftCount]);
+    const K lowFence = leafLowFence(node);
+    const K highFence = leafHighFence(node);
+    const PageId rightSibling = node->rightSibPageNo;
+    leafInit(node, lowFence, separator, includedWidth);
+    for (int i = 0; i < leftCount; i++) {
+        leafInsert(node, i, i, keys[i], rids[i], includedAt(included, includedWidth, i));
+    }
+    leafInit(splitNode, separator, highFence, includedWidth);
+    for (int i = leftCount; i < count; i++) {
+        leafInsert(splitNode, i - leftCount, i - leftCount, keys[i], rids[i], includedAt(included, includedWidth, i));
+    }
+
+    BADGERDB_TRACE_DEBUG("CurNode space available: " << node->spaceAvail);
+    BADGERDB_TRACE_DEBUG("splitNode space available: " << splitNode->spaceAvail);
+
+    // link the new leaf in to the right of the node; the leaf after it is latched after the node, left to right
+    splitNode->rightSibPageNo = rightSibling;
+    splitNode->leftSibPageNo = pid;
+    node->rightSibPageNo = newLeafPageId;
+    if (rightSibling == Page::INVALID_NUMBER) {
+        rightmostLeaf = newLeafPageId;
+    } else {
+        Page *rightPage = fetchPage(rightSibling, true);
+        logPage(rightSibling, rightPage);
+        ((LeafNode<K> *)rightPage)->leftSibPageNo = newLeafPageId;
+        releasePage(rightSibling, rightPage, true, true);
+    }
+
+    newChild.set(newLeafPageId, separator);
+    bufMgr->unPinPage(file, newLeafPageId, true);
+}
+
+/**
+ * Reads the (key, rid) pair of a record handed over by a ParallelScan.
+ *
+ * @throws  InvalidRecordException  If the record is too short to hold the key
+ */
+template <class K>
+static inline void scannedEntry(const ScanRecord &scanned, const int attrByteOffset, RIDKeyPair<K> &entry) {
+    if (attrByteOffset + sizeof(K) > scanned.record.length)
+        throw InvalidRecordException(scanned.rid, scanned.rid.page_number);
+    K key;
+    readKey(scanned.record.data + attrByteOffset, key);
+    entry.set(scanned.rid, key);
+}
+
+/**
+ * @brief Sorted (key, rid) pairs held in memory, as read by buildLeafLevel.
+ */
+template <class K>
+class SortedEntries {
+   public:
+    SortedEntries(const std::vector<RIDKeyPair<K> > &entries, const std::vector<char> &attrs, const int width)
+        : entries(entries), attrs(attrs), width(width) {}
+
+    std::size_t size() const { return entries.size(); }
+
+    const RIDKeyPair<K> &operator[](const std::size_t i) const { return entries[i]; }
+
+    /**
+     * Included attributes of entry i, or NULL if the entries have none.
+     */
+    const char *included(const std::size_t i) const { return includedAt(attrs, width, i); }
+
+    /**
+     * Entries before index i will not be read again.
+     */
+    void release(const std::size_t i) {}
+
+   private:
+    const std::vector<RIDKeyPair<K> > &entries;
+    const std::vector<char> &attrs;
+    const int width;
+};
+
+/**
+ * @brief Sorted (key, rid) pairs streamed out of an ExternalSorter, as read by buildLeafLevel. Only the window
+ * of entries between the last release and the furthest one read is held in memory.
+ */
+template <class K>
+class MergedEntries {
+   public:
+    explicit MergedEntries(ExternalSorter<RIDKeyPair<K> > &sorter) : sorter(sorter), first(0) {}
+
+    std::size_t size() const { return sorter.size(); }
+
+    const RIDKeyPair<K> &operator[](const std::size_t i) {
+        RIDKeyPair<K> entry;
+        while (i >= first + window.size() && sorter.next(entry)) window.push_back(entry);
+        return window[i - first];
+    }
+
+    // covering indexes are never sorted externally
+    const char *included(const std::size_t i) const { return NULL; }
+
+    void release(const std::size_t i) {
+        for (; first < i && !window.empty(); first++) window.pop_front();
+    }
+
+   private:
+    ExternalSorter<RIDKeyPair<K> > &sorter;
+    std::size_t first;
+    std::deque<RIDKeyPair<K> > window;
+};
+
+/**
+ * Builds the tree bottom-up from every tuple in the base relation. The (key, rid) pairs are collected
+ * with FileScan, or with a ParallelScan if buildThreads is above one, and sorted, in memory or with an
+ * ExternalSorter if sortBudget is set, then packed into full leaves left to right, and each non-leaf level
+ * is packed from the separator keys of the level below it until a single root remains. Every node page is
+ * allocated in order and filled completely before it is unpinned, so each page is written out once. The entries
+ * of a covering index are collected by one FileScan together with their included attributes and sorted in memory.
+ *
+ * @param relationName  Name of the base relation to scan.
+ * @param fillFactor    Fraction (0, 1] of the key slots of each node to fill.
+ * @param buildThreads  Number of threads scanning the relation.
+ * @param sortBudget    Buffer frames the pairs are sorted in, or 0 to sort them in memory.
+ */
+template <class K>
+void BTreeIndex::bulkLoad(const std::string &relationName, const double fillFactor, const unsigned buildThreads,
+                          const std::uint32_t sortBudget) {
+    std::vector<PageKeyPair<K> > children;
+    const int offset = attrByteOffset;
+    if (sortBudget > 0 && includedWidth == 0) {
+        // each scan worker writes sorted runs of its own, and their merge feeds the leaves directly
+        ExternalSorter<RIDKeyPair<K> > sorter(bufMgr, file->filename() + ".sort", sortBudget, buildThreads);
+        {
+            ParallelScan scan(relationName, bufMgr, sorter.writers());
+            scan.run([&sorter, offset](unsigned worker, const std::vector<ScanRecord> &records) {
+                RIDKeyPair<K> entry;
+                for (size_t i = 0; i < records.size(); i++) {
+                    scannedEntry(records[i], offset, entry);
+                    sorter.add(worker, entry);
+                }
+            });
+        }
+        sorter.finish();
+        MergedEntries<K> merged(sorter);
+        buildLeafLevel<K>(merged, fillFactor, children);
+    } else {
+        std::vector<RIDKeyPair<K> > entries;
+        std::vector<char> included;
+        if (buildThreads > 1 && includedWidth == 0) {
+            // each worker collects the pairs of its pages on its own; the sort below puts them in order anyway
+            ParallelScan scan(relationName, bufMgr, buildThreads);
+            std::vector<std::vector<RIDKeyPair<K> > > collected(scan.threads());
+            scan.run([&collected, offset](unsigned worker, const std::vector<ScanRecord> &records) {
+                RIDKeyPair<K> entry;
+                for (size_t i = 0; i < records.size(); i++) {
+                    scannedEntry(records[i], offset, entry);
+                    collected[worker].push_back(entry);
+                }
+            });
+            size_t total = 0;
+            for (size_t w = 0; w < collected.size(); w++) total += collected[w].size();
+            entries.reserve(total);
+            for (size_t w = 0; w < collected.size(); w++) {
+                entries.insert(entries.end(), collected[w].begin(), collected[w].end());
+                std::vector<RIDKeyPair<K> >().swap(collected[w]);
+            }
+        } else {
+            FileScan FS(relationName, bufMgr);
+            RecordId rid;
+            RIDKeyPair<K> entry;
+            K key;
+            while (true) {  // collect every (key, rid) pair in the relation
+                try {
+                    FS.scanNext(rid);
+                    // the key is read from the pinned page itself; a key type is as large as its attribute
+                    readKey(FS.attribute(attrByteOffset, sizeof(K)), key);
+                    entry.set(rid, key);
+                    entries.push_back(entry);
+                    for (size_t i = 0; i < includedColumns.size(); i++) {
+                        const IncludedColumn &column = includedColumns[i];
+                        const char *attr = FS.attribute(column.byteOffset, column.length);
+                        included.insert(included.end(), attr, attr + column.length);
+                    }
+                } catch (EndOfFileException e) {
+                    break;
+                }
             }
         }
-        // unpin page, call split non leaf node
-        bufMgr->unPinPage(file, pid, true);
+        sortEntries(entries, included, includedWidth);
+        SortedEntries<K> sorted(entries, included, includedWidth);
+        buildLeafLevel<K>(sorted, fillFactor, children);
+    }
+    buildUpperLevels(children, fillFactor);
+}
+
+/**
+ * Builds the tree from entries given by the caller: they are sorted in memory and packed like the relation's
+ * entries in bulkLoad.
+ *
+ * @param entries       Entries to load
+ * @param fillFactor    Fraction (0, 1] of the key slots of each node to fill.
+ */
+template <class K>
+void BTreeIndex::loadEntries(const IndexEntries &entries, const double fillFactor) {
+    if (includedWidth > 0 && entries.included == NULL) throw BadIndexInfoException("Index includes columns.");
+    const char *key = static_cast<const char *>(entries.keys);
+    std::vector<RIDKeyPair<K> > sortedEntries(entries.count);
+    for (size_t i = 0; i < entries.count; i++) {
+        readKey(key + i * sizeof(K), sortedEntries[i].key);
+        sortedEntries[i].rid = entries.rids[i];
+    }
+    std::vector<char> included;
+    if (includedWidth > 0) {
+        const char *from = static_cast<const char *>(entries.included);
+        included.assign(from, from + entries.count * includedWidth);
+    }
+    sortEntries(sortedEntries, included, includedWidth);
+    SortedEntries<K> sorted(sortedEntries, included, includedWidth);
+    std::vector<PageKeyPair<K> > children;
+    buildLeafLevel<K>(sorted, fillFactor, children);
+    buildUpperLevels(children, fillFactor);
+}
+
+/**
+ * Packs non-leaf levels on top of a leaf level, as described in the header.
+ *
+ * @param children      Page number and smallest key of each leaf, in key order.
+ * @param fillFactor    Fraction (0, 1] of the key slots of each node to fill.
+ */
+template <class K>
+void BTreeIndex::buildUpperLevels(std::vector<PageKeyPair<K> > &children, const double fillFactor) {
+    // Keep adding levels on top until there is only one node left, which becomes the root.
+    bool aboveLeaf = true;
+    treeHeight = 1;
+    while (children.size() > 1) {
+        buildNonLeafLevel(children, fillFactor, aboveLeaf);
+        aboveLeaf = false;
+        treeHeight++;
     }
-    // no space availble in node
-    // call splitNonLeafNode
-    // also need to check if it is a root Node from within split non leaf node
-    else {
-        // No room now, need to split and push up
-        // bufMgr->unPinPage(file, pid, true);
-        // check if we need to create a root node
-        // call split non leaf node if full
-        // initialize leftChild
-        // initialize rightChild
-        bufMgr->unPinPage(file, pid, false);
-        splitNonLeafNode(pid, key);
+    rootPageNum = children[0].pageNo;
+    // The root is still a leaf if no non-leaf level had to be built.
+    insertInRoot = aboveLeaf;
+}
+
+/**
+ * Splits the remaining items of a level among the nodes still to be built: the items left are spread evenly
+ * over as many nodes as it takes when each holds at most most items, so the last node is not left nearly empty.
+ *
+ * @param remaining     Number of items not yet placed in a node
+ * @param most          Largest number of items the next node should take
+ * @param atLeast       Fewest items any node may be left with, 1 or 2
+ * @return              Number of items for the next node
+ */
+static int nextNodeCount(const std::size_t remaining, const int most, const int atLeast) {
+    std::size_t nodesLeft = (remaining + most - 1) / most;
+    if (nodesLeft > 1 && remaining / nodesLeft < (std::size_t)atLeast) nodesLeft = remaining / atLeast;
+    return (int)((remaining + nodesLeft - 1) / nodesLeft);
+}
+
+/**
+ * Finds the largest count in [1, remaining] with count <= fits(count), for a fits that never grows with count:
+ * the number of items a node can take once its last item, and so its high fence, is known.
+ */
+template <class Fits>
+static int largestFittingCount(const int remaining, const Fits &fits) {
+    int low = 1;
+    int high = remaining;
+    while (low < high) {
+        int mid = low + (high - low + 1) / 2;
+        if (mid <= fits(mid)) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
     }
+    return low;
+}
+
+/**
+ * Packs sorted entries into a chain of leaves linked both ways by their siblings. The entries are spread evenly
+ * over the minimum number of leaves so that the last leaf is not left nearly empty. The separator between two
+ * leaves is the shortest key between the last entry of one and the first entry of the next, and is the fence
+ * of both; a prefix-compressed leaf is sized from its fences and takes as many entries as fit.
+ *
+ * @param entries       Sorted (key, rid) pairs: a SortedEntries or MergedEntries, read front to back.
+ * @param fillFactor    Fraction (0, 1] of the key slots of each leaf to fill.
+ * @param children      Returns the page number and smallest key of every leaf built, in key order.
+ */
+template <class K, class Entries>
+void BTreeIndex::buildLeafLevel(Entries &entries, const double fillFactor, std::vector<PageKeyPair<K> > &children) {
+    const std::size_t numEntries = entries.size();
+    // no leaf holds more entries than it has record ids, so a leaf never looks further ahead than this
+    const int mostPerLeaf = Page::SIZE / sizeof(RecordId);
+
+    children.clear();
+    measuredLeaves = LevelShape();
+    PageId prevPageId = Page::INVALID_NUMBER;
+    LeafNode<K> *prevNode = NULL;
+    K lowFence = KeyBounds<K>::lowest();
+    std::size_t next = 0;
+    do {
+        const std::size_t remaining = numEntries - next;
+        // the high fence, and so the leaf's capacity, depends on where the leaf ends
+        auto highFenceAfter = [&](const int count) -> K {
+            return (std::size_t)count >= remaining
+                       ? KeyBounds<K>::highest()
+                       : shortestSeparator(entries[next + count - 1].key, entries[next + count].key);
+        };
+        auto fits = [&](const int count) {
+            int capacity = leafCapacityFor(lowFence, highFenceAfter(count), includedWidth);
+            return std::max(1, std::min(capacity, (int)(capacity * fillFactor)));
+        };
+        const int most = largestFittingCount((int)std::min<std::size_t>(remaining, mostPerLeaf), fits);
+        const int count = remaining == 0 ? 0 : nextNodeCount(remaining, most, 1);
+        const K highFence = highFenceAfter(count);
+
+        PageId pageId;
+        Page *page;
+        bufMgr->allocPage(file, pageId, page);
+        LeafNode<K> *node = (LeafNode<K> *)page;
+        leafInit(node, lowFence, highFence, includedWidth);
+        for (int i = 0; i < count; i++) {
+            leafInsert(node, i, i, entries[next + i].key, entries[next + i].rid, entries.included(next + i));
+        }
+        node->rightSibPageNo = Page::INVALID_NUMBER;
+        node->leftSibPageNo = prevPageId;
+        measuredLeaves.add(count, leafCapacity(node));
+
+        // each leaf is filed under its low fence; the first one's is never used as a separator
+        PageKeyPair<K> child;
+        child.set(pageId, lowFence);
+        children.push_back(child);
+        next += count;
+        entries.release(next);
+        lowFence = highFence;
+
+        // The previous leaf is complete once it knows its right sibling.
+        if (prevNode != NULL) {
+            prevNode->rightSibPageNo = pageId;
+            bufMgr->unPinPage(file, prevPageId, true);
+        }
+        prevPageId = pageId;
+        prevNode = node;
+    } while (next < numEntries);
+    bufMgr->unPinPage(file, prevPageId, true);
 }
 
 /**
- * Inserts new entry into a leaf node if the node has space left, if not, splitLeafNode will be called.
+ * Packs one non-leaf level above the given children. The key of every child but the first becomes a separator
+ * in its parent, and the keys of a node's first child and of the next node's first child are its fences. On
+ * return children holds the nodes of the new level.
  *
- * @param pid           Page ID of leaf node
- * @param rid			Record ID of a record whose entry is getting inserted into the index.
- * @param key			Key to insert, pointer to integer/double/char string
+ * @param children      Page number and smallest key of each child, in key order.
+ * @param fillFactor    Fraction (0, 1] of the key slots of each node to fill.
+ * @param aboveLeaf     True if the children are leaf nodes.
  */
-void BTreeIndex::insertIntoLeafNode(const PageId pid, const RecordId rid, const void *key) {
-    //! debug
-    // std::cout << "Print self" << std::endl;
-    // bufMgr->printSelf();
-    std::cout << "" << std::endl;
-    std::cout << "insert into LEAF: " << *((int *)key) << std::endl;
+template <class K>
+void BTreeIndex::buildNonLeafLevel(std::vector<PageKeyPair<K> > &children, const double fillFactor, bool aboveLeaf) {
+    const int numChildren = children.size();
 
-    // declare and read the current page
-    Page *curPage;
-    bufMgr->readPage(file, pid, curPage);
+    std::vector<PageKeyPair<K> > parents;
+    int next = 0;
+    while (next < numChildren) {
+        const int remaining = numChildren - next;
+        auto highFenceAfter = [&](const int count) -> K {
+            return count >= remaining ? KeyBounds<K>::highest() : children[next + count].key;
+        };
+        auto fits = [&](const int count) {
+            int capacity = nodeCapacityFor(children[next].key, highFenceAfter(count));
+            return std::max(2, std::min(capacity, (int)(capacity * fillFactor)) + 1);
+        };
+        // Every node needs at least two children for its separator key to mean anything.
+        const int count = nextNodeCount(remaining, largestFittingCount(remaining, fits), 2);
+        const K highFence = highFenceAfter(count);
 
-    // initialize the leaf node what we're insert into
-    LeafNodeInt *curNode = (LeafNodeInt *)curPage;
+        PageId pageId;
+        Page *page;
+        bufMgr->allocPage(file, pageId, page);
+        NonLeafNode<K> *node = (NonLeafNode<K> *)page;
+        nodeInit(node, aboveLeaf ? 1 : 0, children[next].pageNo, children[next].key, highFence);
+        for (int i = 1; i < count; i++) {
+            nodeInsert(node, i - 1, i - 1, children[next + i].key, children[next + i].pageNo);
+        }
+
+        PageKeyPair<K> parent;
+        parent.set(pageId, children[next].key);
+        parents.push_back(parent);
+        next += count;
+
+        bufMgr->unPinPage(file, pageId, true);
+    }
+    children.swap(parents);
+}
+
+ReorgResult BTreeIndex::reorganize(const std::size_t maxRuns, const double fillFactor) {
+    if (mapping != NULL) throw ReadOnlyException(file->filename());
+    std::lock_guard<std::mutex> guard(reorgLock);
+    ReorgResult result;
+    switch (attributeType) {
+        case INTEGER:
+            reorganizeLeaves<int>(reorgFromInt, maxRuns, fillFactor, result);
+            break;
+        case DOUBLE:
+            reorganizeLeaves<double>(reorgFromDouble, maxRuns, fillFactor, result);
+            break;
+        case STRING:
+            reorganizeLeaves<StringKey>(reorgFromString, maxRuns, fillFactor, result);
+            break;
+    }
+    return result;
+}
 
-    //! debug
-    std::cout << "Space left: " << curNode->spaceAvail << std::endl;
+template <class K>
+void BTreeIndex::reorganizeLeaves(K &from, const std::size_t maxRuns, const double fillFactor, ReorgResult &result) {
+    while (maxRuns == 0 || result.runs < maxRuns) {
+        if (!reorganizeRun(from, fillFactor, result)) {
+            from = KeyBounds<K>::lowest();
+            result.complete = true;
+            return;
+        }
+    }
+}
+
+template <class K>
+bool BTreeIndex::reorganizeRun(K &from, const double fillFactor, ReorgResult &result) {
+    BADGERDB_SPAN("BTreeIndex::reorganizeRun", 0);
+    LogScope scope(this);
+    // no leaf holds more entries than it has record ids, so a leaf never looks further ahead than this
+    const int mostPerLeaf = Page::SIZE / sizeof(RecordId);
+    while (true) {
+        // descend as a leaf split would, which leaves the parent of the leaf latched exclusively on path
+        NodePath path;
+        PageId leafId;
+        Page *leafPage;
+        K bound;
+        K parentBound;
+        searchNode(from, false, DESCEND_SPLIT_LEAF, path, leafId, leafPage, &bound, &parentBound);
+        releasePage(leafId, leafPage, true);
+        if (path.depth == 0) {
+            scope.commit();
+            return false;
+        }
+        const NodePathEntry parent = path.pop();
+        while (path.depth > 0) {
+            const NodePathEntry &held = path.pop();
+            releasePage(held.pageNo, held.page, true);
+        }
+        NonLeafNode<K> *node = (NonLeafNode<K> *)parent.page;
+        const int numChildren = nodeKeys(node) + 1;
+        const PageId *children = nodeChildren(node);
+        const int first = parent.slot;
+        const int last = std::min(numChildren, first + REORG_RUN_LEAVES);
+        const int runLength = last - first;
+        const std::vector<PageId> oldIds(children + first, children + last);
+
+        // The leaves are latched left to right as a merge latches them, starting with the one left of the
+        // run, which may belong to another parent; a split or merge there can change it until it is latched.
+        Page *firstPage = fetchPage(oldIds[0], false);
+        const PageId leftId = ((LeafNode<K> *)firstPage)->leftSibPageNo;
+        releasePage(oldIds[0], firstPage, false);
+        Page *leftPage = leftId == Page::INVALID_NUMBER ? NULL : fetchPage(leftId, true);
+        std::vector<Page *> oldPages(runLength);
+        for (int i = 0; i < runLength; i++) oldPages[i] = fetchPage(oldIds[i], true);
+        if (((LeafNode<K> *)oldPages[0])->leftSibPageNo != leftId) {
+            for (int i = 0; i < runLength; i++) releasePage(oldIds[i], oldPages[i], true);
+            if (leftPage != NULL) releasePage(leftId, leftPage, true);
+            releasePage(parent.pageNo, parent.page, true);
+            continue;
+        }
+        const PageId rightId = ((LeafNode<K> *)oldPages.back())->rightSibPageNo;
 
-    // check if there is space within the current leafNode
-    if (curNode->spaceAvail > 0) {
-        // If there's room in this node
-        int numNode = INTARRAYLEAFSIZE - curNode->spaceAvail;  // How many pages are in this node
+        std::vector<K> keys;
+        std::vector<RecordId> rids;
+        std::vector<char> attrs;
+        bool sequential = true;
+        for (int i = 0; i < runLength; i++) {
+            const LeafNode<K> *leaf = (const LeafNode<K> *)oldPages[i];
+            const int count = leafCapacity(leaf) - leaf->spaceAvail;
+            for (int j = 0; j < count; j++) keys.push_back(leafKey(leaf, j));
+            rids.insert(rids.end(), leafRids(leaf), leafRids(leaf) + count);
+            appendIncluded(leaf, 0, count, attrs);
+            sequential = sequential && oldIds[i] == oldIds[0] + i;
+        }
 
-        // First add the new entry to the end of the array
-        curNode->ridArray[numNode] = rid;
-        curNode->keyArray[numNode] = *((int *)key);
+        // pack the entries as buildLeafLevel does, between the fences of the run; a run of all the parent's
+        // leaves is packed into two at least, so that the parent keeps a separator
+        const std::size_t numEntries = keys.size();
+        const K runLow = leafLowFence((const LeafNode<K> *)oldPages[0]);
+        const K runHigh = leafHighFence((const LeafNode<K> *)oldPages.back());
+        const bool keepTwo = runLength == numChildren && numEntries >= 2;
+        std::vector<int> counts;
+        std::vector<K> fences;
+        int limit = mostPerLeaf;
+        while (true) {
+            counts.clear();
+            fences.assign(1, runLow);
+            std::size_t next = 0;
+            do {
+                const std::size_t remaining = numEntries - next;
+                auto highFenceAfter = [&](const int count) -> K {
+                    if ((std::size_t)count >= remaining) return runHigh;
+                    return shortestSeparator(keys[next + count - 1], keys[next + count]);
+                };
+                auto fits = [&](const int count) {
+                    int capacity = leafCapacityFor(fences.back(), highFenceAfter(count), includedWidth);
+                    return std::max(1, std::min(capacity, (int)(capacity * fillFactor)));
+                };
+                const int most = largestFittingCount((int)std::min<std::size_t>(remaining, limit), fits);
+                const int count = remaining == 0 ? 0 : nextNodeCount(remaining, most, 1);
+                fences.push_back(highFenceAfter(count));
+                counts.push_back(count);
+                next += count;
+            } while (next < numEntries);
+            if (counts.size() > 1 || !keepTwo || limit == (int)((numEntries + 1) / 2)) break;
+            limit = (int)((numEntries + 1) / 2);
+        }
+        const bool compact = counts.size() < (std::size_t)runLength;
+        const bool changed = compact || !sequential;
+        result.runs++;
+        result.leavesRead += runLength;
 
-        // Then bubble sort the entries into the right place
-        for (int i = numNode; i > 0; i++) {
-            if (curNode->keyArray[i] < curNode->keyArray[i - 1]) {
-                // Swaps the lower value and the inserted value by saving a temporay variable
-                int tempKey = curNode->keyArray[i - 1];
-                RecordId tempId = curNode->ridArray[i - 1];
+        if (changed) {
+            // the new leaves go to the end of the file, so their page numbers follow one another in key order
+            const int numLeaves = compact ? (int)counts.size() : runLength;
+            std::vector<PageId> newIds(numLeaves);
+            std::vector<Page *> newPages(numLeaves);
+            for (int i = 0; i < numLeaves; i++) {
+                bufMgr->allocPage(file, newIds[i], newPages[i], true);
+                logPage(newIds[i], newPages[i], true);
+            }
+            std::size_t next = 0;
+            for (int i = 0; i < numLeaves; i++) {
+                LeafNode<K> *leaf = (LeafNode<K> *)newPages[i];
+                if (compact) {
+                    leafInit(leaf, fences[i], fences[i + 1], includedWidth);
+                    for (int j = 0; j < counts[i]; j++) {
+                        const char *included = includedAt(attrs, includedWidth, next + j);
+                        leafInsert(leaf, j, j, keys[next + j], rids[next + j], included);
+                    }
+                    next += counts[i];
+                } else {
+                    *newPages[i] = *oldPages[i];
+                }
+                leaf->leftSibPageNo = i == 0 ? leftId : newIds[i - 1];
+                leaf->rightSibPageNo = i + 1 < numLeaves ? newIds[i + 1] : rightId;
+            }
 
-                curNode->keyArray[i - 1] = curNode->keyArray[i];
-                curNode->ridArray[i - 1] = curNode->ridArray[i];
+            // link the new leaves in between the neighbours of the old ones, the right one latched last
+            if (leftPage != NULL) ((LeafNode<K> *)leftPage)->rightSibPageNo = newIds[0];
+            if (rightId == Page::INVALID_NUMBER) {
+                PageId cached = oldIds.back();
+                rightmostLeaf.compare_exchange_strong(cached, Page::INVALID_NUMBER);
+            } else {
+                Page *rightPage = fetchPage(rightId, true);
+                ((LeafNode<K> *)rightPage)->leftSibPageNo = newIds.back();
+                releasePage(rightId, rightPage, true, true);
+            }
 
-                curNode->keyArray[i] = tempKey;
-                curNode->ridArray[i] = tempId;
+            // the parent files the new leaves under the separators between them in place of the run's
+            if (compact) {
+                std::vector<K> separators;
+                for (int i = 0; i < first; i++) separators.push_back(nodeKey(node, i));
+                separators.insert(separators.end(), fences.begin() + 1, fences.end() - 1);
+                for (int i = last - 1; i < numChildren - 1; i++) separators.push_back(nodeKey(node, i));
+                std::vector<PageId> childIds(children, children + first);
+                childIds.insert(childIds.end(), newIds.begin(), newIds.end());
+                childIds.insert(childIds.end(), children + last, children + numChildren);
+                const K lowFence = nodeLowFence(node);
+                const K highFence = nodeHighFence(node);
+                nodeInit(node, node->level, childIds[0], lowFence, highFence);
+                for (int i = 0; i < (int)separators.size(); i++) nodeInsert(node, i, i, separators[i], childIds[i + 1]);
             } else {
-                // If it reaches here, that means the new key is in the right spot
-                break;
+                std::copy(newIds.begin(), newIds.end(), nodeChildren(node) + first);
             }
+            for (int i = 0; i < numLeaves; i++) bufMgr->unPinPage(file, newIds[i], true);
+            result.leavesWritten += numLeaves;
         }
-        // use up one aviliable space
-        curNode->spaceAvail--;
-        bufMgr->unPinPage(file, pid, true);
 
-        //! debug
-        std::cout << "Insert " << *((int *)key) << "success" << std::endl;
-        // printArray(curNode->keyArray, INTARRAYLEAFSIZE);
+        // the old leaves keep their entries and links for cursors that already hold their page numbers
+        for (int i = 0; i < runLength; i++) releasePage(oldIds[i], oldPages[i], true);
+        if (leftPage != NULL) releasePage(leftId, leftPage, true, changed);
+        releasePage(parent.pageNo, parent.page, true, changed);
+        commitLog();
+        if (changed) {
+            for (int i = 0; i < runLength; i++) retireNode(oldIds[i]);
+        }
 
-    } else {
-        // No room now, need to split and push up
-        bufMgr->unPinPage(file, pid, false);
-        splitLeafNode(key, rid, pid);
+        // the next run starts at the leaf after this one, which may be under the next parent
+        if (last < numChildren) {
+            from = runHigh;
+            return true;
+        }
+        from = parentBound;
+        return parentBound != KeyBounds<K>::highest();
     }
 }
 
 /**
- * This method is called when the top of the tree is reached and we have to create a new root node.
+ * Checks the operators and range of a scan before anything about the scan is set up.
  *
- * @param key			Key to insert, pointer to integer/double/char string
- * @param leftChild		The PageId of the leftchild of the new root
- * @param rightChild	The PageId of the rightchild of the new root
- * @param aboveLeaf		Bool value that tells if the new root to create will be above LeafNodes
+ * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+ * @throws  BadScanrangeException If lowVal > highval
  **/
-void BTreeIndex::createNewRoot(const void *key, const PageId leftChild, const PageId rightChild, bool aboveLeaf) {
-    // declare rootID
-    PageId rootId;
-    // declare rootPage
-    Page *rootPage;
-    // allocate a new page for root node
-    bufMgr->allocPage(file, rootId, rootPage);
-    // initialize new root node
-    NonLeafNodeInt *rootNode = (NonLeafNodeInt *)rootPage;
-    // update new non leaf node
-    if (aboveLeaf) {
-        rootNode->level = 1;
-    } else {
-        rootNode->level = 0;
+void BTreeIndex::checkScanRange(const void *lowValParm, const Operator lowOpParm,
+                                const void *highValParm, const Operator highOpParm) {
+    if ((lowOpParm != GT && lowOpParm != GTE) ||
+        (highOpParm != LT && highOpParm != LTE)) {
+        throw BadOpcodesException();
     }
-    rootNode->keyArray[0] = *((int *)key);
-    // add left child
-    rootNode->pageNoArray[0] = leftChild;
-    // add right child
-    rootNode->pageNoArray[1] = rightChild;
-    rootNode->spaceAvail = INTARRAYNONLEAFSIZE - 1;
 
-    Page *metaPage;
-    bufMgr->readPage(file, headerPageNum, metaPage);
-    IndexMetaInfo *meta = (IndexMetaInfo *)metaPage;
-    meta->rootPageNo = rootId;
-    rootPageNum = rootId;
+    // Make sure the parameter makes sense
+    bool inverted = false;
+    switch (attributeType) {
+        case INTEGER: {
+            int low, high;
+            readKey(lowValParm, low);
+            readKey(highValParm, high);
+            inverted = low > high;
+            break;
+        }
+        case DOUBLE: {
+            double low, high;
+            readKey(lowValParm, low);
+            readKey(highValParm, high);
+            inverted = low > high;
+            break;
+        }
+        case STRING: {
+            StringKey low, high;
+            readKey(lowValParm, low);
+            readKey(highValParm, high);
+            inverted = low > high;
+            break;
+        }
+    }
+    if (inverted) throw BadScanrangeException();
+}
+
+/**
+ * Begin a filtered scan of the index.  For instance, if the method is called
+ * using ("a",GT,"d",LTE) then we should seek all entries with a value
+ * greater than "a" and less than or equal to "d".
+ * If another scan is already executing, that needs to be ended here.
+ * The scan runs on a cursor owned by the index, positioned by openScan.
+ *
+ * @param lowVal	Low value of range, pointer to integer / double / char string
+ * @param lowOp		Low operator (GT/GTE)
+ * @param highVal	High value of range, pointer to integer / double / char string
+ * @param highOp	High operator (LT/LTE)
+ * @param options	Order, limit and distinct mode of the scan
+ * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+ * @throws  BadScanrangeException If lowVal > highval
+ * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+ **/
+void BTreeIndex::startScan(const void *lowValParm, const Operator lowOpParm,
+                           const void *highValParm, const Operator highOpParm, const ScanOptions &options) {
+    checkScanRange(lowValParm, lowOpParm, highValParm, highOpParm);
+    BADGERDB_TRACE_DEBUG("Inside start scan");
 
-    insertInRoot = false;
+    // only one scan at a time
+    if (scanExecuting) endScan();
 
-    // unpin page
-    this->bufMgr->unPinPage(this->file, rootId, true);
+    scanCursor = openScan(lowValParm, lowOpParm, highValParm, highOpParm, false, options);
+    scanExecuting = true;
 }
 
 /**
- * Recursive function to traverse the B+ Tree and find the node with the coorsponding key value
+ * Opens a cursor on the first entry inside the range. The descent latches its way down to the leftmost leaf that
+ * can hold the low value, and the cursor copies out that leaf's matching entries; a descending cursor starts at
+ * the leaf that can hold the high value instead. A limit or a distinct scan only changes how far and how the
+ * cursor moves on from there.
  *
- * @param key   the void pointer of the key to be searched
- * @param currentId
- */
-void BTreeIndex::searchNode(PageId &pid, const void *key, PageId currentId) {
-    // Reads the content of currentId into curPage
-    Page *curPage;
-    bufMgr->readPage(file, currentId, curPage);
+ * @param lowVal	Low value of range, pointer to integer / double / char string
+ * @param lowOp		Low operator (GT/GTE)
+ * @param highVal	High value of range, pointer to integer / double / char string
+ * @param highOp	High operator (LT/LTE)
+ * @param withKeys	True to copy out the keys of the entries too
+ * @param options	Order, limit and distinct mode of the scan
+ * @return			Open cursor over the range
+ * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+ * @throws  BadScanrangeException If lowVal > highval
+ * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+ **/
+IndexScanCursor BTreeIndex::openScan(const void *lowValParm, const Operator lowOpParm,
+                                     const void *highValParm, const Operator highOpParm, const bool withKeys,
+                                     const ScanOptions &options) {
+    BADGERDB_SPAN("BTreeIndex::openScan", 0);
+    checkScanRange(lowValParm, lowOpParm, highValParm, highOpParm);
+    counters.add(INDEX_SCANS);
+    if (filterRejects(lowValParm, lowOpParm, highValParm, highOpParm)) {
+        counters.add(INDEX_FILTERED);
+        throw NoSuchKeyFoundException();
+    }
+    // a scan reads the leaves in order anyway, so the delta is merged by inserting it rather than entry by entry
+    flushWriteBuffer();
 
-    int keyInt = *((int *)key);  // Key of data, but in int form
-    NonLeafNodeInt *curNode = (NonLeafNodeInt *)curPage;
-    int numPage = INTARRAYNONLEAFSIZE - curNode->spaceAvail;  // How many pages are in this node
-    int numChild = numPage + 1;                               // How many children nodes this node points to
+    // the epoch is entered before the descent, so no leaf it can reach is reused while it is open
+    IndexScanCursor cursor;
+    cursor.index = this;
+    cursor.epoch = epochs.enter();
+    // resolve the operators once; each leaf is then cut with two binary searches
+    cursor.withKeys = withKeys;
+    cursor.lowInclusive = lowOpParm == GTE;
+    cursor.highInclusive = highOpParm == LTE;
+    cursor.descending = options.order == SCAN_DESCENDING;
+    cursor.distinct = options.distinct;
+    if (options.limit > 0) cursor.remaining = options.limit;
 
-    //! debug
-    std::cout << "Searching for : " << keyInt << std::endl;
+    NodePath path;
+    PageId leafId;
+    Page *leafPage = NULL;
+    switch (attributeType) {
+        case INTEGER:
+            readKey(lowValParm, cursor.lowValInt);
+            readKey(highValParm, cursor.highValInt);
+            if (cursor.descending) break;
+            if (!openOptimistic(cursor, cursor.lowValInt))
+                searchNode(cursor.lowValInt, true, DESCEND_READ, path, leafId, leafPage);
+            break;
+        case DOUBLE:
+            readKey(lowValParm, cursor.lowValDouble);
+            readKey(highValParm, cursor.highValDouble);
+            if (cursor.descending) break;
+            if (!openOptimistic(cursor, cursor.lowValDouble))
+                searchNode(cursor.lowValDouble, true, DESCEND_READ, path, leafId, leafPage);
+            break;
+        case STRING:
+            readKey(lowValParm, cursor.lowValString);
+            readKey(highValParm, cursor.highValString);
+            if (cursor.descending) break;
+            if (!openOptimistic(cursor, cursor.lowValString))
+                searchNode(cursor.lowValString, true, DESCEND_READ, path, leafId, leafPage);
+            break;
+    }
+    if (cursor.descending) {
+        descendTo(cursor);
+    } else if (leafPage != NULL) {
+        cursor.bufferPage(leafPage);
+        releasePage(leafId, leafPage, false);
+    }
 
-    // ! debug
-    std::cout << "Current level:  " << curNode->level << std::endl;
+    // move on if this leaf has no matching entry
+    if (!cursor.fill()) {
+        throw NoSuchKeyFoundException();
+    }
+    return cursor;
+}
 
-    std::cout << "Current size:  " << numChild << std::endl;
+template <class K>
+bool BTreeIndex::openOptimistic(IndexScanCursor &cursor, const K &lowVal) {
+    if (mapping != NULL || !swizzling) return false;
+    alignas(CACHE_LINE_SIZE) char scratch[Page::SIZE];
+    for (int attempt = 0; attempt < OPTIMISTIC_ATTEMPTS; attempt++) {
+        OptimisticPage leaf;
+        if (descendOptimistic(lowVal, true, (Page *)scratch, leaf)) {
+            cursor.bufferEntries(leaf.node);
+            if (validate(leaf)) {
+                cursor.prefetchNext();
+                return true;
+            }
+        }
+        counters.add(INDEX_RETRIES);
+    }
+    return false;
+}
 
-    //  search throught the key list of the current node until we reach the leaf node
-    for (int i = 0; i < numPage; i++) {
-        //! debug
-        std::cout << "comparing against : " << curNode->keyArray[i] << std::endl;
+bool BTreeIndex::bufferOptimistic(IndexScanCursor &cursor, const PageId leafId) {
+    alignas(CACHE_LINE_SIZE) char scratch[Page::SIZE];
+    OptimisticPage leaf;
+    bool readable = false;
+    switch (attributeType) {
+        case INTEGER:
+            readable = readOptimistic<int>(leafId, (Page *)scratch, leaf);
+            break;
+        case DOUBLE:
+            readable = readOptimistic<double>(leafId, (Page *)scratch, leaf);
+            break;
+        case STRING:
+            readable = readOptimistic<StringKey>(leafId, (Page *)scratch, leaf);
+            break;
+    }
+    if (!readable) return false;
+    if (!cursor.bufferEntries(leaf.node) || !validate(leaf)) return false;
+    cursor.prefetchNext();
+    return true;
+}
 
-        PageId targetId;
-        bool found = false;
+void BTreeIndex::descendTo(IndexScanCursor &cursor) {
+    NodePath path;
+    PageId leafId;
+    Page *leafPage;
+    // entries past an exclusive bound start in the last leaf that may hold it, those at an inclusive one may
+    // start in the first
+    const bool leftmost = cursor.descending ? !cursor.highInclusive : cursor.lowInclusive;
+    switch (attributeType) {
+        case INTEGER:
+            searchNode(cursor.descending ? cursor.highValInt : cursor.lowValInt, leftmost, DESCEND_READ, path, leafId,
+                       leafPage);
+            break;
+        case DOUBLE:
+            searchNode(cursor.descending ? cursor.highValDouble : cursor.lowValDouble, leftmost, DESCEND_READ, path,
+                       leafId, leafPage);
+            break;
+        case STRING:
+            searchNode(cursor.descending ? cursor.highValString : cursor.lowValString, leftmost, DESCEND_READ, path,
+                       leafId, leafPage);
+            break;
+    }
+    // any leaf a descent reaches is taken as it is, and may hold entries the scan already returned
+    cursor.rightPageNum = Page::INVALID_NUMBER;
+    cursor.skipRids = cursor.boundaryRids;
+    cursor.bufferEntries(leafPage);
+    // its neighbour in the direction of the scan cannot hold the bound, so there is nothing to jump over
+    cursor.jumpNext = false;
+    cursor.prefetchNext();
+    cursor.acceptLeaf(leafId);
+    releasePage(leafId, leafPage, false);
+}
 
-        // Start comparing against the smallest key in this node
-        // If it is true, then the pid at the current location is the target page
-        // Since we are right biased, it's only until the key is less than current node,
-        // otherwise, we'd use <=
-        if (keyInt < curNode->keyArray[i]) {
-            targetId = curNode->pageNoArray[i];
-            found = true;
+IndexScanCursor::IndexScanCursor()
+    : index(NULL), lowValInt(-1), highValInt(-1), lowValDouble(-1), highValDouble(-1), lowInclusive(true),
+      highInclusive(true),
+      nextPageNum(Page::INVALID_NUMBER), nextEntry(0), withKeys(false), descending(false), distinct(false),
+      jumpNext(false), remaining(std::numeric_limits<std::size_t>::max()), rightPageNum(Page::INVALID_NUMBER) {
+}
 
-            // ! debug
-            std::cout << "Insert into before: " << curNode->keyArray[i] << std::endl;
+IndexScanCursor::IndexScanCursor(const IndexScanCursor &other)
+    : index(other.index), lowValInt(other.lowValInt), highValInt(other.highValInt),
+      lowValDouble(other.lowValDouble), highValDouble(other.highValDouble), lowValString(other.lowValString),
+      highValString(other.highValString), lowInclusive(other.lowInclusive), highInclusive(other.highInclusive),
+      nextPageNum(other.nextPageNum), rids(other.rids), nextEntry(other.nextEntry), withKeys(other.withKeys),
+      keys(other.keys), included(other.included), descending(other.descending), distinct(other.distinct),
+      jumpNext(other.jumpNext), remaining(other.remaining), rightPageNum(other.rightPageNum),
+      boundaryRids(other.boundaryRids), skipRids(other.skipRids) {
+    if (index != NULL) epoch = index->epochs.join(other.epoch);
+}
 
-        } else if (keyInt > curNode->keyArray[numPage - 1]) {
-            // This is the edge case if the key is larger than all keys in this node, then we jump straight to the
-            // right most pointer
-            targetId = curNode->pageNoArray[numChild - 1];
-            found = true;
+IndexScanCursor &IndexScanCursor::operator=(const IndexScanCursor &other) {
+    if (this == &other) return *this;
+    close();
+    index = other.index;
+    lowValInt = other.lowValInt;
+    highValInt = other.highValInt;
+    lowValDouble = other.lowValDouble;
+    highValDouble = other.highValDouble;
+    lowValString = other.lowValString;
+    highValString = other.highValString;
+    lowInclusive = other.lowInclusive;
+    highInclusive = other.highInclusive;
+    rids = other.rids;
+    nextPageNum = other.nextPageNum;
+    nextEntry = other.nextEntry;
+    withKeys = other.withKeys;
+    keys = other.keys;
+    included = other.included;
+    descending = other.descending;
+    distinct = other.distinct;
+    jumpNext = other.jumpNext;
+    remaining = other.remaining;
+    rightPageNum = other.rightPageNum;
+    boundaryRids = other.boundaryRids;
+    skipRids = other.skipRids;
+    if (index != NULL) epoch = index->epochs.join(other.epoch);
+    return *this;
+}
 
-            // ! debug
-            std::cout << "Going to the right most pointer, bigger than: " << curNode->keyArray[numPage - 1] << std::endl;
-        }
+IndexScanCursor::~IndexScanCursor() {
+    close();
+}
 
-        if (found) {
-            // Found a spot, set the parent of node at the destination as the current node
-            Page *targetPage;
-            bufMgr->readPage(file, targetId, targetPage);
-            LeafNodeInt *targetNode = (LeafNodeInt *)targetPage;
+/**
+ * Orders record ids by page number, then slot number.
+ */
+static inline bool ridBefore(const RecordId &a, const RecordId &b) {
+    return a.page_number != b.page_number ? a.page_number < b.page_number : a.slot_number < b.slot_number;
+}
 
-            // Sets the parrent of the leaf node to current node
-            targetNode->parentId = currentId;
+/**
+ * Tells whether the neighbour of a leaf, to the right or to the left, may hold key too. The fences of a leaf bound
+ * its neighbours; a leaf without fences is only assumed to continue into them when key is all it holds.
+ *
+ * @param leaf      Leaf, latched shared
+ * @param n         Number of entries of the leaf
+ * @param key       Key at the end of the leaf towards that neighbour
+ * @param right     True for the right neighbour
+ */
+template <class K>
+static inline bool leafMayShare(const LeafNode<K> *leaf, const int n, const K &key, const bool right) {
+    return n > 0 && leafKey(leaf, 0) == key && leafKey(leaf, n - 1) == key;
+}
 
-            // ! debug
-            std::cout << "FOUND" << std::endl;
-            std::cout << "First key in found" << targetNode->keyArray[0] << std::endl;
+static inline bool leafMayShare(const LeafNodeInt *leaf, const int n, const int &key, const bool right) {
+    return (right ? leafHighFence(leaf) : leafLowFence(leaf)) == key;
+}
 
-            // Whether we reached the end or not
-            if (curNode->level == 1) {
-                bufMgr->unPinPage(file, currentId, false);
-                // this means we are right above the target leaf node
-                // Save the result
-                pid = targetId;
-                // ! debug
-                std::cout << "ending search" << std::endl;
-                break;
-            } else {
-                // means we found a spot, but they're not a leaf node, so we must go even furthur
-                bufMgr->unPinPage(file, currentId, false);
+static inline bool leafMayShare(const LeafNodeString *leaf, const int n, const StringKey &key, const bool right) {
+    return (right ? leafHighFence(leaf) : leafLowFence(leaf)) == key;
+}
 
-                // ! debug
-                std::cout << "Searching further : " << curNode->level << std::endl;
-                // searchNode(pid, key, targetId);
+/**
+ * Copies the record ids of the matching entries of a leaf into rids as one run. Keys are sorted, so the run is
+ * bounded by two binary searches; a high bound that falls inside the leaf ends the scan, otherwise the scan
+ * continues at the right sibling read under the same latch, which covers every entry a later split moves out of
+ * this leaf. A descending scan ends at a low bound inside the leaf and otherwise continues at the left sibling,
+ * which a split or merge may replace before it is read; that leaf is checked against this one then. A distinct
+ * scan keeps the first entry of each key, and jumps over the leaves the last key may fill with a descent. Once as
+ * many entries as the limit allows are copied, the scan ends.
+ *
+ * @param leaf      Leaf to copy from, latched shared
+ * @param lowVal    Low bound of the scan
+ * @param highVal   High bound of the scan
+ * @return          False if a descending scan has to descend again, as the leaf does not link back to rightPageNum
+ */
+template <class K>
+bool IndexScanCursor::bufferLeaf(const LeafNode<K> *leaf, const K &lowVal, const K &highVal) {
+    if (descending && rightPageNum != Page::INVALID_NUMBER && leaf->rightSibPageNo != rightPageNum) return false;
+    int numEntries = leafEntries(leaf);
+    // duplicates of a GT low bound may continue into the leaves to the right, so every leaf is bounded below
+    int begin = lowInclusive ? leafLowerBound(leaf, numEntries, lowVal) : leafUpperBound(leaf, numEntries, lowVal);
+    int end = highInclusive ? leafUpperBound(leaf, numEntries, highVal) : leafLowerBound(leaf, numEntries, highVal);
+    if (descending) {
+        nextPageNum = begin > 0 ? Page::INVALID_NUMBER : leaf->leftSibPageNo;
+    } else {
+        nextPageNum = end < numEntries ? Page::INVALID_NUMBER : leaf->rightSibPageNo;
+    }
+    nextEntry = 0;
+    if (begin < end) {
+        rids.assign(leafRids(leaf) + begin, leafRids(leaf) + end);
+    } else {
+        rids.clear();
+    }
+    included.clear();
+    appendIncluded(leaf, begin, (int)rids.size(), included);
+    jumpNext = false;
+    if (withKeys || descending || distinct) {
+        // the buffer comes from operator new, which aligns it for any key type
+        keys.resize(rids.size() * sizeof(K));
+        if (!rids.empty()) leafKeys(leaf, begin, (int)rids.size(), (K *)&keys[0]);
+        if (descending) reverseEntries(highVal);
+        if (distinct) {
+            firstOfEachKey<K>();
+            // the key this leaf ends on, towards the scan, once it is returned; the next leaf may hold nothing else
+            const bool inclusive = descending ? highInclusive : lowInclusive;
+            const bool atEnd = descending ? begin == 0 : end == numEntries;
+            if (atEnd && nextPageNum != Page::INVALID_NUMBER && (!rids.empty() || !inclusive)) {
+                const K last = rids.empty() ? (descending ? highVal : lowVal) : ((const K *)&keys[0])[rids.size() - 1];
+                jumpNext = leafMayShare(leaf, numEntries, last, !descending);
             }
         }
     }
+    if (rids.size() >= remaining) {
+        rids.resize(remaining);
+        if (!keys.empty()) keys.resize(remaining * sizeof(K));
+        if (!included.empty()) included.resize(remaining * (size_t)leafIncludedWidth(leaf));
+        nextPageNum = Page::INVALID_NUMBER;
+        jumpNext = false;
+    }
+    return true;
 }
 
-void printArray(const int *arr, int size) {
-    for (int i = 0; i < size; i++) {
-        if (i % 10 == 0) {
-            std::cout << "" << std::endl;
-        }
-        std::cout << i << ": " << arr[i] << ",  ";
+template <class K>
+void IndexScanCursor::firstOfEachKey() {
+    const int count = (int)rids.size();
+    if (count == 0) return;
+    K *copied = (K *)&keys[0];
+    const int width = (int)included.size() / count;
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (kept > 0 && copied[i] == copied[kept - 1]) continue;
+        copied[kept] = copied[i];
+        rids[kept] = rids[i];
+        std::copy(included.begin() + i * width, included.begin() + (i + 1) * width, included.begin() + kept * width);
+        kept++;
     }
-    std::cout << "#######################################################" << std::endl;
+    rids.resize(kept);
+    keys.resize(kept * sizeof(K));
+    included.resize(kept * width);
 }
 
-/**
- * This method is called when a node is at max capacity already so it needs to be split.
- * It is a recursive method that pushes values up the tree as it is split
- * if the given node is full then splitNonLeafNode is called again from within.
- *
- * @param pid   Page ID of the result
- * @param key   the void pointer of the key to be searched
- */
-void BTreeIndex::splitNonLeafNode(const PageId pid, const void *key) {
-    // ! debug
-    std::cout << "Splitting non leaf node" << std::endl;
-
-    Page *curPage;
-    bufMgr->readPage(file, pid, curPage);
-    // initialize the non leaf node to split
-    NonLeafNodeInt *curNode = (NonLeafNodeInt *)curPage;
+template <class K>
+void IndexScanCursor::reverseEntries(const K &highVal) {
+    const int count = (int)rids.size();
+    pendingSkip = skipRids;
+    if (count == 0) return;
+    const K *copied = (const K *)&keys[0];
+    const int width = (int)included.size() / count;
+    std::vector<RecordId> reversedRids;
+    std::vector<char> reversedKeys;
+    std::vector<char> reversedIncluded;
+    reversedRids.reserve(count);
+    reversedKeys.reserve(keys.size());
+    reversedIncluded.reserve(included.size());
+    for (int i = count - 1; i >= 0; i--) {
+        // entries of the smallest key returned so far that a descent found again; an index may hold one entry
+        // more than once, so each record id in the list stands for a single entry
+        if (!pendingSkip.empty() && copied[i] == highVal) {
+            std::vector<RecordId>::iterator skip =
+                std::lower_bound(pendingSkip.begin(), pendingSkip.end(), rids[i], ridBefore);
+            if (skip != pendingSkip.end() && *skip == rids[i]) {
+                pendingSkip.erase(skip);
+                continue;
+            }
+        }
+        reversedRids.push_back(rids[i]);
+        reversedKeys.insert(reversedKeys.end(), keys.begin() + i * sizeof(K), keys.begin() + (i + 1) * sizeof(K));
+        reversedIncluded.insert(reversedIncluded.end(), included.begin() + i * width,
+                                included.begin() + (i + 1) * width);
+    }
+    rids.swap(reversedRids);
+    keys.swap(reversedKeys);
+    included.swap(reversedIncluded);
+}
 
-    // ! debug
-    std::cout << "Current node BEFORE split" << std::endl;
-    printArray(curNode->keyArray, INTARRAYNONLEAFSIZE);
+template <class K>
+void IndexScanCursor::narrowBound(K &lowVal, K &highVal) {
+    if (rids.empty()) return;
+    const K *copied = (const K *)&keys[0];
+    const K least = copied[rids.size() - 1];
+    if (!descending) {
+        lowVal = least;
+        lowInclusive = false;
+        return;
+    }
+    if (distinct) {
+        highVal = least;
+        highInclusive = false;
+        boundaryRids.clear();
+        skipRids.clear();
+        return;
+    }
+    if (!highInclusive || least != highVal) {
+        highVal = least;
+        highInclusive = true;
+        boundaryRids.clear();
+        skipRids.clear();
+    }
+    for (int i = (int)rids.size() - 1; i >= 0 && copied[i] == least; i--) boundaryRids.push_back(rids[i]);
+    std::sort(boundaryRids.begin(), boundaryRids.end(), ridBefore);
+}
 
-    // Create the new page(sibling)
-    // allocate page
+void IndexScanCursor::acceptLeaf(const PageId leafId) {
+    rightPageNum = leafId;
+    if (descending) skipRids.swap(pendingSkip);
+}
 
-    Page *newPage;
-    PageId newPageId;
+bool IndexScanCursor::bufferPage(const Page *leafPage) {
+    if (!bufferEntries(leafPage)) return false;
+    prefetchNext();
+    return true;
+}
 
-    std::cout << "BROKEN HERE BEFORE ALLOC" << std::endl;
-    bufMgr->allocPage(file, newPageId, newPage);
-    std::cout << "BROKEN HERE AFTER ALLOC" << std::endl;
-
-    // create node
-    // assign variables to sibling
-    NonLeafNodeInt *newNode = (NonLeafNodeInt *)newPage;
-    newNode->level = curNode->level;
-    newNode->parentId = curNode->parentId;
-
-    // udpdate the new nodes values
-    // the new node will get all the larger values
-    // if max value is odd then we will split 2,3
-    // int odd = false;
-    for (int i = 0; i < INTARRAYNONLEAFSIZE / 2; i++) {
-        // sets the split node to the second half values of the current node
-        newNode->keyArray[i] = curNode->keyArray[INTARRAYNONLEAFSIZE / 2 + i];
-        curNode->keyArray[INTARRAYNONLEAFSIZE / 2 + i] = -1;
-
-        // update the children of the new node
-        newNode->pageNoArray[i] = curNode->pageNoArray[INTARRAYNONLEAFSIZE / 2 + i];
-        curNode->pageNoArray[INTARRAYNONLEAFSIZE / 2 + i] = -1;
-    }
-
-    // update spaceAvail
-    curNode->spaceAvail = INTARRAYNONLEAFSIZE / 2;
-    newNode->spaceAvail = INTARRAYNONLEAFSIZE / 2;
-
-    // if INTARRAYNONLEAFSIZE is odd
-    // assign the largest value to the newNode
-    if (INTARRAYNONLEAFSIZE % 2 != 0) {
-        newNode->keyArray[INTARRAYNONLEAFSIZE / 2] = curNode->keyArray[INTARRAYNONLEAFSIZE - 1];
-        curNode->keyArray[INTARRAYNONLEAFSIZE - 1] = -1;
-        newNode->spaceAvail--;
-        newNode->pageNoArray[INTARRAYNONLEAFSIZE / 2] = curNode->pageNoArray[INTARRAYNONLEAFSIZE];
-    } else {
-        newNode->pageNoArray[INTARRAYNONLEAFSIZE / 2 + 1] = curNode->pageNoArray[INTARRAYNONLEAFSIZE];
-    }
-
-    //! Debug
-    std::cout << "curNode start: " << curNode->keyArray[0] << std::endl;
-    // std::cout << "curNode ends: " << curNode->keyArray[INTARRAYNONLEAFSIZE - 1] << std::endl;
-    printArray(curNode->keyArray, INTARRAYNONLEAFSIZE);
-
-    //! Debug
-    std::cout << "newNode start: " << newNode->keyArray[0] << std::endl;
-    // std::cout << "newNode ends: " << newNode->keyArray[INTARRAYNONLEAFSIZE - 1] << std::endl;
-    printArray(newNode->keyArray, INTARRAYNONLEAFSIZE);
-
-    // addedNewNode keeps track of where the new node was added
-    // this will be used to find which key to push up
-    bool addedNewNode = false;
-    // check where to insert value
-    // compare to the last value in the curNode and if it is less than or equal then insert into current Node
-    if (curNode->keyArray[INTARRAYLEAFSIZE / 2 - 1] >= *((int *)key)) {
-        // call insert for the curNode
-        //! Debug
-        std::cout << "INSERT CURRENT NODE " << pid << std::endl;
-
-        insertIntoNonLeafNode(pid, key);
-    }
-    // else call insert on the newNode created
-    else {
-        //! Debug
-        std::cout << "INSERT NEW NODE " << newPageId << std::endl;
-
-        insertIntoNonLeafNode(newPageId, key);
-        addedNewNode = true;
-    }
-    // insert value
-    // unpin current page
-    bufMgr->unPinPage(file, pid, false);
-    // unpin new page created
-    bufMgr->unPinPage(file, newPageId, false);
-    // value to push up
-    // right biased
-    // always going to be the middle value which is the 3rd array value of left node
-    int pushedKey = false;
-    // value to push up
-    // right biased
-    if (addedNewNode) {
-        pushedKey = curNode->keyArray[INTARRAYLEAFSIZE / 2];
-    } else {
-        pushedKey = newNode->keyArray[0];
-    }
-
-    // check if parentId is null, if so call create new root
-    if (curNode->parentId == -1) {
-        bool aboveLeaf = false;
-        if (curNode->level == 1) {
-            aboveLeaf = true;
-        }
-        // current node pid
-        PageId leftChild = pid;
-        // new node created pageID
-        PageId rightChild = newPageId;
-        // call create new root node
-        createNewRoot(&pushedKey, leftChild, rightChild, false);
-        // update the parentId of the two nodes created
-    }
-    // parent already exists
-
-    else {
-        // update parent node to have a new child
-        // declare parent page
-        Page *parentPage;
-        // read parent
-        bufMgr->readPage(this->file, curNode->parentId, parentPage);
-        // create parent node
-        NonLeafNodeInt *parentNode = (NonLeafNodeInt *)parentPage;
-        // unpin parent
-        bufMgr->unPinPage(this->file, curNode->parentId, parentPage);
-        // check if parent has space available
-        if (parentNode->spaceAvail > 0) {
-            // unpin page
-            bufMgr->unPinPage(this->file, curNode->parentId, parentPage);
-            // insert value into parent
-            insertIntoNonLeafNode(curNode->parentId, &pushedKey);
-        }
-        // if no spaceAvail, call splitNonLeafNode
-        // else {
-        //     splitNonLeafNode(curNode->parentId, (void *)pushedKey);
-        // }
-    }
-}
-
-/**
- * This method is called when a node is at max capacity already so it needs to be split.
- * This method also called insert, splitNonLeafNode based on which case it is
- *
- * @param pid   Page ID of the result
- * @param rid   RecordId of the result
- * @param key   the void pointer of the key to be searched
- */
-void BTreeIndex::splitLeafNode(const void *key, const RecordId rid, const PageId pid) {
-    // ! debug
-    std::cout << "Splitting LEAF node" << std::endl;
-
-    // right biased
-    // creates page of leaf node
-    Page *leafPage;
-    // reads the page to split
-    bufMgr->readPage(file, pid, leafPage);
-    // create node
-    LeafNodeInt *curNode = (LeafNodeInt *)leafPage;
+bool IndexScanCursor::bufferEntries(const Page *leafPage) {
+    index->counters.add(INDEX_SCAN_LEAVES);
+    switch (index->attributeType) {
+        case INTEGER:
+            return bufferLeaf((const LeafNodeInt *)leafPage, lowValInt, highValInt);
+        case DOUBLE:
+            return bufferLeaf((const LeafNodeDouble *)leafPage, lowValDouble, highValDouble);
+        case STRING:
+            return bufferLeaf((const LeafNodeString *)leafPage, lowValString, highValString);
+    }
+    return true;
+}
 
-    // ! debug
-    std::cout << "Current node BEFORE split" << std::endl;
-    printArray(curNode->keyArray, INTARRAYLEAFSIZE);
+void IndexScanCursor::prefetchNext() {
+    // read the next leaf of the chain while the caller works through this one
+    if (nextPageNum != Page::INVALID_NUMBER && !jumpNext && index->mapping == NULL)
+        index->bufMgr->prefetch(index->file, nextPageNum);
+}
 
-    // create new node to split into
-    Page *newLeafPage;
-    PageId newLeafPageId;
-    // creates new page for split
-    bufMgr->allocPage(file, newLeafPageId, newLeafPage);
-    // create a new node
-    LeafNodeInt *splitNode = (LeafNodeInt *)newLeafPage;
-    // split leafNode into size of node / 2, (size of node / 2)+1
-    for (int i = 0; i < INTARRAYLEAFSIZE / 2; i++) {
-        // sets the split node to the second half values of the current node
-        splitNode->keyArray[i] = curNode->keyArray[INTARRAYLEAFSIZE / 2 + i];
-        splitNode->ridArray[i] = curNode->ridArray[INTARRAYLEAFSIZE / 2 + i];
-
-        curNode->keyArray[INTARRAYLEAFSIZE / 2 + i] = -1;
-        // curNode->ridArray[INTARRAYLEAFSIZE / 2 + i] = (RecordId)-1;
-    }
-
-    splitNode->spaceAvail = INTARRAYLEAFSIZE - (INTARRAYLEAFSIZE / 2);
-    curNode->spaceAvail = INTARRAYLEAFSIZE - (INTARRAYLEAFSIZE / 2);
-
-    // if the size of node
-    // assign the largest value in node to the split Node
-    // this will split the values to d, d+1
-    if (INTARRAYLEAFSIZE % 2 != 0) {
-        splitNode->keyArray[INTARRAYLEAFSIZE / 2] = curNode->keyArray[INTARRAYLEAFSIZE - 1];
-        curNode->keyArray[INTARRAYLEAFSIZE - 1] = -1;
-
-        splitNode->ridArray[INTARRAYLEAFSIZE / 2] = curNode->ridArray[INTARRAYLEAFSIZE - 1];
-        splitNode->spaceAvail--;
-    }
-
-    //! Debug
-    std::cout << "AFTER SPLIT SPACE AVAILABLE" << std::endl;
-    std::cout << "CurNode space available: " << curNode->spaceAvail << std::endl;
-    std::cout << "splitNode space available: " << splitNode->spaceAvail << std::endl;
-
-    //! Debug
-    std::cout << "curNode start: " << curNode->keyArray[0] << std::endl;
-    // std::cout << "curNode ends: " << curNode->keyArray[INTARRAYNONLEAFSIZE - 1] << std::endl;
-    printArray(curNode->keyArray, INTARRAYLEAFSIZE);
-
-    //! Debug
-    std::cout << "splitNode start: " << splitNode->keyArray[0] << std::endl;
-    // std::cout << "newNode ends: " << newNode->keyArray[INTARRAYNONLEAFSIZE - 1] << std::endl;
-    printArray(splitNode->keyArray, INTARRAYLEAFSIZE);
-
-    // update split node attributes
-    splitNode->rightSibPageNo = curNode->rightSibPageNo;
-    splitNode->parentId = curNode->parentId;
-    // update all the attributes
-    curNode->rightSibPageNo = newLeafPageId;
-
-    if (curNode->keyArray[INTARRAYLEAFSIZE / 2 - 1] >= *((int *)key)) {
-        // call insert for the curNode
-        //! Debug
-        std::cout << "INSERT CURRENT LEAF " << pid << std::endl;
-        insertIntoLeafNode(pid, rid, key);
-    }
-    // else call insert for the splitNode
-    else {
-        //! Debug
-        std::cout << "INSERT NEW LEAF " << newLeafPageId << std::endl;
-        insertIntoLeafNode(newLeafPageId, rid, key);
-    }
-
-    int pushedKey;
-    // value to push up
-    // right biased
-    pushedKey = splitNode->keyArray[0];
-
-    // check if parentId is null, if so call create new root
-    // if (curNode->parentId == -1) {
-    if (insertInRoot) {
-        // current node pid
-        PageId leftChild = pid;
-        // new node created pageID
-        PageId rightChild = newLeafPageId;
-        // call create new root node
-
-        //! Debug
-        std::cout << "Creating a new root " << std::endl;
-        std::cout << "Pushing up key: " << pushedKey << std::endl;
-
-        createNewRoot(&pushedKey, leftChild, rightChild, true);
-        // update the parentId of the two nodes created
-    }
-    // parent already exists
-    else {
-        // update parent node to have a new child
-        // declare parent page
-        Page *parentPage;
-        // read parent
-        bufMgr->readPage(file, curNode->parentId, parentPage);
-        // create parent node
-        NonLeafNodeInt *parentNode = (NonLeafNodeInt *)parentPage;
-        // unpin parent
-        bufMgr->unPinPage(file, curNode->parentId, parentPage);
-        // check if parent has space available
-        if (parentNode->spaceAvail > 0) {
-            // add newNode as child of parent node
-            insertIntoNonLeafNode(curNode->parentId, &pushedKey);
-        }
-        // if no spaceAvail, call splitNonLeafNode
-        else {
-            splitNonLeafNode(curNode->parentId, &pushedKey);
+/**
+ * Refills rids from the next leaves once every copied entry has been returned. A descending scan first lowers its
+ * high bound to the entries just returned, so that a leaf that is not linked back to its predecessor any more can
+ * be replaced by a descent to that bound; a distinct scan moves its bound past the key returned last, and
+ * descends to it rather than read the next leaf when the duplicates of that key may fill it.
+ *
+ * @return  True if there is an entry to return at nextEntry
+ */
+bool IndexScanCursor::fill() {
+    while (nextEntry == (int)rids.size() && nextPageNum != Page::INVALID_NUMBER) {
+        BADGERDB_SPAN("IndexScanCursor::fill", nextPageNum);
+        PageId leafId = nextPageNum;
+        if (descending || distinct) {
+            switch (index->attributeType) {
+                case INTEGER:
+                    narrowBound(lowValInt, highValInt);
+                    break;
+                case DOUBLE:
+                    narrowBound(lowValDouble, highValDouble);
+                    break;
+                case STRING:
+                    narrowBound(lowValString, highValString);
+                    break;
+            }
+        }
+        if (jumpNext) {
+            index->descendTo(*this);
+            continue;
+        }
+        if (index->mapping == NULL && index->swizzling && index->bufferOptimistic(*this, leafId)) {
+            acceptLeaf(leafId);
+            continue;
+        }
+        Page *leafPage = index->fetchPage(leafId, false);
+        const bool linked = bufferPage(leafPage);
+        index->releasePage(leafId, leafPage, false);
+        if (linked) {
+            acceptLeaf(leafId);
+        } else {
+            index->descendTo(*this);
         }
     }
+    return nextEntry < (int)rids.size();
 }
 
 /**
- * Begin a filtered scan of the index.  For instance, if the method is called
- * using ("a",GT,"d",LTE) then we should seek all entries with a value
- * greater than "a" and less than or equal to "d".
- * If another scan is already executing, that needs to be ended here.
- * Set up all the variables for scan. Start from root to find out the leaf page that contains the first RecordID
- * that satisfies the scan parameters. Keep that page pinned in the buffer pool.
- *
- * @param lowVal	Low value of range, pointer to integer / double / char string
- * @param lowOp		Low operator (GT/GTE)
- * @param highVal	High value of range, pointer to integer / double / char string
- * @param highOp	High operator (LT/LTE)
- * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
- * @throws  BadScanrangeException If lowVal > highval
- * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+ * Fetch the record id of the next index entry that matches the scan.
+ * Return the next record from the entries copied out of the current leaf. Once those are used up, entries are
+ * copied from the right sibling of that leaf, if any exists, and so on. No page stays pinned between calls.
+ * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+ * @throws ScanNotInitializedException If the cursor is not open.
+ * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
  **/
-void BTreeIndex::startScan(const void *lowValParm, const Operator lowOpParm,
-                           const void *highValParm, const Operator highOpParm) {
-    if ((lowOpParm != GT && lowOpParm != GTE) ||
-        (highOpParm != LT && highOpParm != LTE)) {
-        throw BadOpcodesException();
+void IndexScanCursor::next(RecordId &outRid) {
+    if (!isOpen()) throw ScanNotInitializedException();
+
+    if (!fill()) {
+        throw IndexScanCompletedException();
     }
-    // ! debug
-    std::cout << "Inside start scan" << std::endl;
+    outRid = rids[nextEntry];
+    consumed(1);
+    index->counters.add(INDEX_SCAN_RIDS);
+}
 
-    lowOp = lowOpParm;
-    highOp = highOpParm;
+void IndexScanCursor::nextKeyed(void *outKey, RecordId &outRid) {
+    if (!isOpen() || !withKeys) throw ScanNotInitializedException();
 
-    // Have to cast to int pointer first and then reference to get int value
-    lowValInt = *(int *)lowValParm;
-    highValInt = *(int *)highOpParm;
+    if (!fill()) {
+        throw IndexScanCompletedException();
+    }
+    const size_t keySize = keys.size() / rids.size();
+    memcpy(outKey, &keys[nextEntry * keySize], keySize);
+    outRid = rids[nextEntry];
+    consumed(1);
+    index->counters.add(INDEX_SCAN_RIDS);
+}
 
-    // Make sure the parameter makes sense
-    if (lowValInt > highValInt) throw BadScanrangeException();
+void IndexScanCursor::nextIncluded(void *outKey, RecordId &outRid, void *outIncluded) {
+    if (!isOpen() || index->includedWidth == 0 || (outKey != NULL && !withKeys)) throw ScanNotInitializedException();
 
-    // only one scan at a time
-    if (scanExecuting) endScan();
+    if (!fill()) {
+        throw IndexScanCompletedException();
+    }
+    const int width = index->includedWidth;
+    if (outKey != NULL) memcpy(outKey, &keys[nextEntry * sizeof(int)], sizeof(int));
+    memcpy(outIncluded, &included[nextEntry * width], width);
+    outRid = rids[nextEntry];
+    consumed(1);
+    index->counters.add(INDEX_SCAN_RIDS);
+}
 
-    /** ########### begin scan ########### */
-    scanExecuting = true;
+/**
+ * Copies up to max record ids of the next matching entries into out, refilling from the next leaf as often as
+ * needed to fill the batch.
+ * @param out		Array of at least max record ids
+ * @param max		Largest number of record ids to return
+ * @return			Number of record ids copied; 0 once the scan is complete
+ * @throws ScanNotInitializedException If the cursor is not open.
+ **/
+size_t IndexScanCursor::nextBatch(RecordId *out, const size_t max) {
+    if (!isOpen()) throw ScanNotInitializedException();
+
+    size_t count = 0;
+    while (count < max && fill()) {
+        size_t run = std::min(max - count, rids.size() - nextEntry);
+        std::copy(rids.begin() + nextEntry, rids.begin() + nextEntry + run, out + count);
+        consumed(run);
+        count += run;
+    }
+    index->counters.add(INDEX_SCAN_RIDS, count);
+    return count;
+}
+
+void IndexScanCursor::close() {
+    // leaves merged away while the cursor was open may be reusable once it leaves its epoch
+    if (index != NULL) {
+        index->epochs.exit(epoch);
+        index->reclaimNodes();
+    }
+    index = NULL;
+    rids.clear();
+    keys.clear();
+    included.clear();
+    boundaryRids.clear();
+    skipRids.clear();
+    nextEntry = 0;
+    jumpNext = false;
+    nextPageNum = Page::INVALID_NUMBER;
+    rightPageNum = Page::INVALID_NUMBER;
 }
 
 /**
  * Fetch the record id of the next index entry that matches the scan.
- * Return the next record from current page being scanned. If current page has been scanned to its entirety, move on to the right sibling of current page, if any exists, to start scanning that page. Make sure to unpin any pages that are no longer required.
+ * Return the next record from the scan cursor owned by the index.
  * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
  * @throws ScanNotInitializedException If no scan has been initialized.
  * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
@@ -797,71 +4275,27 @@ void BTreeIndex::startScan(const void *lowValParm, const Operator lowOpParm,
 void BTreeIndex::scanNext(RecordId &outRid) {
     // Can't scan next if there's no scan going on
     if (!scanExecuting) throw ScanNotInitializedException();
-    // Finishing scan
-    if (nextEntry == -1) throw IndexScanCompletedException();
 
-    // ! debug
-    std::cout << "Scanning next" << std::endl;
+    BADGERDB_TRACE_DEBUG("Scanning next");
 
-    LeafNodeInt *currentNode = (LeafNodeInt *)currentPageData;
-    // If the current page is fully read, then move on to the right riblings page if possible.
-    if (currentNode->ridArray[nextEntry].page_number == 0 || nextEntry == leafOccupancy) {
-        if (currentNode->rightSibPageNo == 0) {
-            throw IndexScanCompletedException();
-        } else {
-            bufMgr->unPinPage(file, currentPageNum, false);  // move on to right sibling's page.
-            currentPageNum = currentNode->rightSibPageNo;
-            bufMgr->readPage(file, currentPageNum, currentPageData);
-            nextEntry = 0;  // reset the entry to start at the first entry for the sibling's page.
-            currentNode = (LeafNodeInt *)currentPageData;
-        }
-        // else, if the page is not fully read then you check if the retrieved key meets the conditions.
-    } else {
-        if (currentNode->ridArray[nextEntry].page_number != 0 && nextEntry != leafOccupancy) {
-            int currentKey = currentNode->keyArray[nextEntry];
-            int key = currentNode->keyArray[nextEntry];
-            if (keyCorrect(lowOp, highOp, lowValInt, highValInt, key)) {
-                outRid = currentNode->ridArray[nextEntry];
-                nextEntry = nextEntry + 1;
-            }
-        } else {
-            // the rid is not satisfied.
-        }
-    }
+    scanCursor.next(outRid);
 }
 
 /**
- * @brief Checks if the key satisfies the conditions based on the operators and values.
- *
- * @param lowOp Low operator (GT/GTE)
- * @param highOp High operator (LT/LTE)
- * @param lowVal Low value of range, pointer to integer / double / char string
- * @param highVal High value of range, pointer to integer / double / char string
- * @param key The key to check.
- * @return true If the key meets the conditions
- * @return false if the key doesn't meet the conditions.
- */
-bool BTreeIndex::keyCorrect(Operator lowOp, Operator highOp, int lowVal, int highVal, int key) {
-    if (lowOp == GTE) {
-        if (highOp == LTE) {
-            return key <= highVal && key >= lowVal;
-        } else if (highOp == LT) {
-            return key < highVal && key >= lowVal;
-        }
-    } else {
-        if (lowOp == GT) {
-            if (highOp == LTE) {
-                return key <= highVal && key > lowVal;
-            } else {
-                if (highOp == LT) {
-                    return key < highVal && key > lowVal;
-                }
-            }
-        }
-    }
+ * Fetch the record ids of the next index entries that match the scan, many per call.
+ * @param out		Array of at least max record ids
+ * @param max		Largest number of record ids to return
+ * @return			Number of record ids copied; 0 once the scan is complete
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ **/
+size_t BTreeIndex::scanNextBatch(RecordId *out, const size_t max) {
+    if (!scanExecuting) throw ScanNotInitializedException();
+
+    return scanCursor.nextBatch(out, max);
 }
+
 /**
- * Terminate the current scan. Unpin any pinned pages. Reset scan specific variables.
+ * Terminate the current scan. Reset scan specific variables.
  * @throws ScanNotInitializedException If no scan has been initialized.
  **/
 void BTreeIndex::endScan() {
@@ -870,15 +4304,83 @@ void BTreeIndex::endScan() {
     }
     // reset scan specific variables.
     scanExecuting = false;
-    nextEntry = -1;
-    scanExecuting = false;
-    bufMgr->unPinPage(file, currentPageNum, false);
-    currentPageNum = (PageId)-1;
-    currentPageData = NULL;
-    lowOp = (Operator)NULL;
-    highOp = (Operator)NULL;
-    lowValInt = -1;
-    highValInt = -1;
+    scanCursor.close();
+}
+
+/**
+ * Appends the record ids of every entry of an index to rids, in key order.
+ */
+template <class K>
+static void indexOrder(BTreeIndex &index, std::vector<RecordId> &rids) {
+    const K low = KeyBounds<K>::lowest();
+    const K high = KeyBounds<K>::highest();
+    try {
+        index.startScan(&low, GTE, &high, LTE);
+    } catch (const NoSuchKeyFoundException &e) {
+        return;  // the index is empty
+    }
+    RecordId batch[256];
+    size_t count;
+    while ((count = index.scanNextBatch(batch, 256)) > 0) rids.insert(rids.end(), batch, batch + count);
+    index.endScan();
+}
+
+std::size_t BTreeIndex::cluster(const std::string &relationName, BufMgr *bufMgr, const int attrByteOffset,
+                                const Datatype attrType) {
+    std::ostringstream indexStr;
+    indexStr << relationName << '.' << attrByteOffset;
+    const std::string indexName = indexStr.str();
+    if (File::isOpen(relationName)) throw FileOpenException(relationName);
+    if (File::isOpen(indexName)) throw FileOpenException(indexName);
+
+    std::vector<RecordId> rids;
+    {
+        std::string outIndexName;
+        BTreeIndex index(relationName, outIndexName, bufMgr, attrByteOffset, attrType);
+        switch (attrType) {
+            case INTEGER:
+                indexOrder<int>(index, rids);
+                break;
+            case DOUBLE:
+                indexOrder<double>(index, rids);
+                break;
+            case STRING:
+                indexOrder<StringKey>(index, rids);
+                break;
+        }
+    }
+
+    // the records are read in key order, the next one's page prefetched, and written out a page at a time
+    const std::string clusteredName = relationName + ".cluster";
+    if (File::exists(clusteredName)) File::remove(clusteredName);
+    {
+        PageFile heap(relationName, false);
+        PageFile clustered(clusteredName, true);
+        PageId outPageNo;
+        Page outPage = clustered.allocatePage(outPageNo);
+        for (size_t i = 0; i < rids.size(); i++) {
+            if (i + 1 < rids.size() && rids[i + 1].page_number != rids[i].page_number)
+                bufMgr->prefetch(&heap, rids[i + 1].page_number);
+            Page *page;
+            bufMgr->readPage(&heap, rids[i].page_number, page);
+            const std::string record = page->getRecord(rids[i]);
+            bufMgr->unPinPage(&heap, rids[i].page_number, false);
+            try {
+                outPage.insertRecord(record);
+            } catch (const InsufficientSpaceException &e) {
+                clustered.writePage(outPageNo, outPage);
+                outPage = clustered.allocatePage(outPageNo);
+                outPage.insertRecord(record);
+            }
+        }
+        clustered.writePage(outPageNo, outPage);
+        bufMgr->flushFile(&heap);
+    }
+    File::remove(relationName);
+    File::rename(clusteredName, relationName);
+    File::remove(indexName);
+    std::remove(logName(indexName).c_str());
+    return rids.size();
 }
 
 }  // namespace badgerdb
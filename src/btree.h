@@ -7,48 +7,187 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <vector>
 
+#include "bloom_filter.h"
 #include "buffer.h"
+#include "epoch.h"
 #include "file.h"
+#include "hot_key_cache.h"
+#include "index_stats.h"
+#include "mapped_file.h"
 #include "page.h"
 #include "string.h"
 #include "types.h"
+#include "wal.h"
+#include "write_buffer.h"
 
 namespace badgerdb {
 
 /**
- * @brief Datatype enumeration type.
+ * @brief Version of the node layout below, recorded in the meta page. An index file written with another layout
+ * is not opened.
  */
-enum Datatype {
-    INTEGER = 0,
-    DOUBLE = 1,
-    STRING = 2
+const int NODE_FORMAT_VERSION = 5;
+
+/**
+ * @brief Version of the fields IndexMetaInfo keeps past includedColumns. A meta page of another version is read
+ * for the fields before them only, and the tree's height and size are found again.
+ */
+const int META_FORMAT_VERSION = 1;
+
+/**
+ * @brief Bytes of a B+Tree leaf for INTEGER key left for record ids, key deltas and included attributes.
+ */
+//                                         spaceAvil       sibling ptrs       keyWidth           fences       included
+const int INTLEAFAREA = Page::SIZE - sizeof(int) - 2 * sizeof(PageId) - sizeof(int) - 2 * sizeof(int) - sizeof(int);
+
+/**
+ * @brief Most attributes a covering index includes next to its keys.
+ */
+const int MAX_INCLUDED_COLUMNS = 4;
+
+/**
+ * @brief Most bytes of included attributes a covering index keeps per entry.
+ */
+const int MAX_INCLUDED_BYTES = 32;
+
+/**
+ * @brief Number of key slots in B+Tree leaf for INTEGER key whose fences are too far apart to narrow its keys.
+ */
+//                                             key               rid
+const int INTARRAYLEAFSIZE = INTLEAFAREA / (sizeof(int) + sizeof(RecordId));
+
+/**
+ * @brief Number of key slots in B+Tree leaf for DOUBLE key.
+ */
+//                                                  spaceAvil       sibling ptrs                key               rid
+const int DOUBLEARRAYLEAFSIZE = (Page::SIZE - sizeof(int) - 2 * sizeof(PageId)) / (sizeof(double) + sizeof(RecordId));
+
+/**
+ * @brief Bytes of a B+Tree leaf for STRING key left for record ids and key suffixes.
+ */
+//                                              spaceAvil       sibling ptrs     prefixLength       fences
+const int STRINGLEAFAREA = Page::SIZE - sizeof(int) - 2 * sizeof(PageId) - sizeof(int) - 2 * STRINGSIZE;
+
+/**
+ * @brief Number of key slots in B+Tree leaf for STRING key whose keys share no prefix.
+ */
+//                                                     key                 rid
+const int STRINGARRAYLEAFSIZE = STRINGLEAFAREA / (STRINGSIZE * sizeof(char) + sizeof(RecordId));
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
+ */
+//                                                  level      spaceAvil     extra pageNo            key            pageNo
+const int INTARRAYNONLEAFSIZE = (Page::SIZE - sizeof(int) - sizeof(int) - sizeof(PageId)) / (sizeof(int) + sizeof(PageId));
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for DOUBLE key.
+ */
+//                                                     level      spaceAvil     extra pageNo             key              pageNo
+const int DOUBLEARRAYNONLEAFSIZE = (Page::SIZE - sizeof(int) - sizeof(int) - sizeof(PageId)) / (sizeof(double) + sizeof(PageId));
+
+/**
+ * @brief Bytes of a B+Tree non-leaf for STRING key left for page numbers and key suffixes.
+ */
+//                                                 level      spaceAvil     prefixLength       fences
+const int STRINGNONLEAFAREA = Page::SIZE - sizeof(int) - sizeof(int) - sizeof(int) - 2 * STRINGSIZE;
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for STRING key whose keys share no prefix.
+ */
+//                                                           extra pageNo                key                  pageNo
+const int STRINGARRAYNONLEAFSIZE = (STRINGNONLEAFAREA - sizeof(PageId)) / (STRINGSIZE * sizeof(char) + sizeof(PageId));
+
+/**
+ * @brief Fixed-length STRING key: the first STRINGSIZE characters of the attribute, padded with NULs.
+ * Keys compare bytewise.
+ */
+struct StringKey {
+    char chars[STRINGSIZE];
+
+    StringKey() {
+        memset(chars, 0, STRINGSIZE);
+    }
+
+    /**
+     * Builds the key of a NUL-terminated or STRINGSIZE-long character string.
+     */
+    explicit StringKey(const char* str) {
+        strncpy(chars, str, STRINGSIZE);
+    }
+
+    bool operator<(const StringKey& other) const {
+        return memcmp(chars, other.chars, STRINGSIZE) < 0;
+    }
+    bool operator<=(const StringKey& other) const {
+        return memcmp(chars, other.chars, STRINGSIZE) <= 0;
+    }
+    bool operator>(const StringKey& other) const {
+        return memcmp(chars, other.chars, STRINGSIZE) > 0;
+    }
+    bool operator>=(const StringKey& other) const {
+        return memcmp(chars, other.chars, STRINGSIZE) >= 0;
+    }
+    bool operator==(const StringKey& other) const {
+        return memcmp(chars, other.chars, STRINGSIZE) == 0;
+    }
+    bool operator!=(const StringKey& other) const {
+        return memcmp(chars, other.chars, STRINGSIZE) != 0;
+    }
 };
 
 /**
- * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() method.
+ * @brief Writes a STRING key for trace output.
+ */
+inline std::ostream& operator<<(std::ostream& out, const StringKey& key) {
+    return out << std::string(key.chars, strnlen(key.chars, STRINGSIZE));
+}
+
+/**
+ * @brief Compile-time slot counts of the nodes for fixed-size key type K, one specialization per key type.
+ * STRING nodes are prefix compressed and size their slots per node.
  */
-enum Operator {
-    LT,  /* Less Than */
-    LTE, /* Less Than or Equal to */
-    GTE, /* Greater Than or Equal to */
-    GT   /* Greater Than */
+template <class K>
+struct NodeCapacity;
+
+template <>
+struct NodeCapacity<int> {
+    static const int LEAF = INTARRAYLEAFSIZE;
+    static const int NONLEAF = INTARRAYNONLEAFSIZE;
+};
+
+template <>
+struct NodeCapacity<double> {
+    static const int LEAF = DOUBLEARRAYLEAFSIZE;
+    static const int NONLEAF = DOUBLEARRAYNONLEAFSIZE;
 };
 
 /**
- * @brief Number of key slots in B+Tree leaf for INTEGER key.
+ * @brief Default fraction of each node's key slots filled by the bulk loader.
  */
-//                                              sibling ptr   spaceAvil        parentId         used              key             rid
-const int INTARRAYLEAFSIZE = (Page::SIZE - sizeof(PageId) - sizeof(int) - sizeof(PageId) - sizeof(int)) / (sizeof(int) + sizeof(RecordId));
+const double BULKLOAD_FILL_FACTOR = 1.0;
 
 /**
- * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
+ * @brief Default fraction of each leaf's key slots filled by BTreeIndex::reorganize, leaving inserts some room.
+ */
+const double REORG_FILL_FACTOR = 0.9;
+
+/**
+ * @brief Most leaves BTreeIndex::reorganize takes in one step, each pinned together with the one written in its
+ * place.
  */
-//                                                  level      extra pageNo    spaceAvil      parentId             used            key            pageNo
-const int INTARRAYNONLEAFSIZE = (Page::SIZE - sizeof(int) - sizeof(PageId) - sizeof(int) - sizeof(PageId) - sizeof(int)) / (sizeof(int) + sizeof(PageId));
+const int REORG_RUN_LEAVES = 16;
 
 /**
  * @brief Structure to store a key-rid pair. It is used to pass the pair to functions that
@@ -80,316 +219,1833 @@ class PageKeyPair {
     }
 };
 
-/**
- * @brief Overloaded operator to compare the key values of two rid-key pairs
- * and if they are the same compares to see if the first pair has
- * a smaller rid.pageNo value.
- */
-template <class T>
-bool operator<(const RIDKeyPair<T>& r1, const RIDKeyPair<T>& r2) {
-    if (r1.key != r2.key)
-        return r1.key < r2.key;
-    else
-        return r1.rid.page_number < r2.rid.page_number;
-}
+/**
+ * @brief Overloaded operator to compare the key values of two rid-key pairs
+ * and if they are the same compares to see if the first pair has
+ * a smaller rid.pageNo value.
+ */
+template <class T>
+bool operator<(const RIDKeyPair<T>& r1, const RIDKeyPair<T>& r2) {
+    if (r1.key != r2.key)
+        return r1.key < r2.key;
+    else if (r1.rid.page_number != r2.rid.page_number)
+        return r1.rid.page_number < r2.rid.page_number;
+    else
+        return r1.rid.slot_number < r2.rid.slot_number;
+}
+
+/**
+ * @brief Upper bound on the number of non-leaf levels above the leaves. With hundreds of keys per node
+ * no real index comes close.
+ */
+const int MAX_INDEX_HEIGHT = 32;
+
+/**
+ * @brief One step of a root-to-leaf descent: a non-leaf node and the slot of the child followed out of it.
+ */
+struct NodePathEntry {
+    PageId pageNo;
+    int slot;
+    Page* page;
+};
+
+/**
+ * @brief Stack of the non-leaf nodes a descent left pinned and latched, root first. Splits pop it to find
+ * each parent.
+ */
+struct NodePath {
+    NodePathEntry entries[MAX_INDEX_HEIGHT];
+    int depth;
+
+    NodePath() : depth(0) {}
+
+    void push(PageId pageNo, int slot, Page* page) {
+        entries[depth].pageNo = pageNo;
+        entries[depth].slot = slot;
+        entries[depth].page = page;
+        depth++;
+    }
+
+    const NodePathEntry& pop() {
+        return entries[--depth];
+    }
+};
+
+/**
+ * @brief A page being read optimistically, without a pin or a latch.
+ */
+struct OptimisticPage {
+    /**
+     * Frame holding the page
+     */
+    const Page* frame;
+
+    /**
+     * Version of the frame when the read started
+     */
+    std::uint32_t version;
+
+    /**
+     * Node to read: the frame itself, or a copy of it already validated
+     */
+    const Page* node;
+};
+
+/**
+ * @brief Number of optimistic attempts a lookup or scan makes before it latches its way down instead.
+ */
+const int OPTIMISTIC_ATTEMPTS = 3;
+
+/**
+ * @brief How a root-to-leaf descent latches the nodes it passes. Every descent couples latches, taking the
+ * child's latch before releasing the parent's.
+ */
+enum DescentMode {
+    /**
+     * Shared latches all the way down; the leaf is returned latched shared.
+     */
+    DESCEND_READ,
+    /**
+     * Shared latches on non-leaf nodes; the leaf is returned latched exclusive. Enough for an insert that
+     * fits in its leaf.
+     */
+    DESCEND_INSERT,
+    /**
+     * Exclusive latches all the way down. Nodes above the lowest node with room are released on the way,
+     * so the path keeps exactly the nodes a split of the leaf can reach.
+     */
+    DESCEND_SPLIT,
+    /**
+     * As DESCEND_SPLIT, but the leaf counts as having no room whatever its free slots, so its parent always
+     * stays on the path. For inserts that may bring a leaf more entries than it has slots left.
+     */
+    DESCEND_SPLIT_LEAF,
+    /**
+     * Exclusive latches all the way down. Nodes above the lowest node that can lose a key without becoming
+     * underfull are released on the way, so the path keeps exactly the nodes a merge of the leaf can reach.
+     */
+    DESCEND_MERGE
+};
+
+/**
+ * @brief Default fraction of a node's slots below which deleteEntry merges it into a sibling.
+ */
+const double MERGE_THRESHOLD = 0.25;
+
+/**
+ * @brief Number of probes ahead of the current one whose leaves lookupBatch prefetches.
+ */
+const int LOOKUP_PREFETCH_PROBES = 8;
+
+/**
+ * @brief Receives the matches of lookupBatch: the position of the probe key in the batch and the record ID of an
+ * entry holding that key.
+ */
+typedef std::function<void(size_t probe, const RecordId& rid)> LookupCallback;
+
+/**
+ * @brief An attribute a covering index copies into its leaves next to each key, so that an index scan can return
+ * it without reading the record.
+ */
+struct IncludedColumn {
+    /**
+     * Offset of the attribute inside the record.
+     */
+    int byteOffset;
+
+    /**
+     * Bytes of the attribute.
+     */
+    int length;
+};
+
+/**
+ * @brief The meta page, which holds metadata for Index file, is always first page of the btree index file and is cast
+ * to the following structure to store or retrieve information from it.
+ * Contains the relation name for which the index is created, the byte offset
+ * of the key value on which the index is made, the type of the key and the page no
+ * of the root page. Root page starts as page 2 but since a split can occur
+ * at the root the root page may get moved up and get a new page no.
+ */
+struct IndexMetaInfo {
+    /**
+     * Name of base relation.
+     */
+    char relationName[20];
+
+    /**
+     * Offset of attribute, over which index is built, inside the record stored in pages.
+     */
+    int attrByteOffset;
+
+    /**
+     * Type of the attribute over which index is built.
+     */
+    Datatype attrType;
+
+    /**
+     * Page number of root page of the B+ Tree inside the file index file.
+     */
+    PageId rootPageNo;
+
+    /**
+     * True while the root is a leaf, so that a reopened index knows how to read it.
+     */
+    bool rootIsLeaf;
+
+    /**
+     * NODE_FORMAT_VERSION of the layout the nodes were written in.
+     */
+    int nodeFormat;
+
+    /**
+     * Number of attributes included next to each key; 0 unless the index is covering.
+     */
+    int includedCount;
+
+    /**
+     * Attributes included next to each key, in the order they are laid out in the leaves.
+     */
+    IncludedColumn includedColumns[MAX_INCLUDED_COLUMNS];
+
+    /**
+     * META_FORMAT_VERSION of the fields below; 0 in an index written before they were kept.
+     */
+    int metaFormat;
+
+    /**
+     * Levels of the tree, leaves included, changed along with the root.
+     */
+    int height;
+
+    /**
+     * True once the index was closed cleanly with entryCount up to date. Cleared on disk as soon as the index is
+     * opened, so an index that is not closed cleanly again is known to have lost count.
+     */
+    bool closedCleanly;
+
+    /**
+     * True if entryCount was exact when it was saved.
+     */
+    bool entryCountExact;
+
+    /**
+     * Entries in the tree, saved when the index is closed.
+     */
+    std::uint64_t entryCount;
+
+    /**
+     * Leaves, their entries and their slots as last measured by a bulk load or BTreeIndex::analyze.
+     */
+    std::uint64_t leafNodes;
+    std::uint64_t leafEntries;
+    std::uint64_t leafSlots;
+};
+
+/*
+Each node is a page, so once we read the page in we just cast the pointer to the page to this struct and use it to access the parts
+These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of
+node they are. The level member of each non leaf structure seen below is set to 1 if the nodes
+at this level are just above the leaf nodes. Otherwise set to 0.
+Every node starts with a small header, so that the fields a visit reads share the first cache line with the first
+keys; the keys follow it back to back, and the record ids or child page numbers, which a search reads only once it
+has found its slot, are kept in a region of their own after them.
+*/
+
+/**
+ * @brief Structure for all non-leaf nodes, for keys of type K.
+ */
+template <class K>
+struct NonLeafNode {
+    /**
+     * Level of the node in the tree.
+     */
+    int level;
+
+    /**
+     * Stores available space in Node. Decrements as new array are added
+     */
+    int spaceAvail;
+
+    /**
+     * Stores keys.
+     */
+    K keyArray[NodeCapacity<K>::NONLEAF];
+
+    /**
+     * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
+     */
+    PageId pageNoArray[NodeCapacity<K>::NONLEAF + 1];
+};
+
+/**
+ * @brief Structure for all leaf nodes, for keys of type K.
+ */
+template <class K>
+struct LeafNode {
+    /**
+     * Stores available space in Node
+     */
+    int spaceAvail;
+
+    /**
+     * Page number of the leaf on the right side.
+     * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+     */
+    PageId rightSibPageNo;
+
+    /**
+     * Page number of the leaf on the left side, which descending scans move to.
+     */
+    PageId leftSibPageNo;
+
+    /**
+     * Stores keys.
+     */
+    K keyArray[NodeCapacity<K>::LEAF];
+
+    /**
+     * Stores RecordIds.
+     */
+    RecordId ridArray[NodeCapacity<K>::LEAF];
+};
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of STRING type.
+ *
+ * Every key a node can ever hold lies between its fence keys: the separators on either side of it in its
+ * parent, or the lowest and highest possible keys for the root. The first prefixLength bytes the fences
+ * share are therefore shared by all its keys; they are kept once, in the fences, and each key stores only
+ * its remaining STRINGSIZE - prefixLength bytes. Fences only narrow when a node splits, so a node's prefix,
+ * and with it its slot count, is fixed from the time it is built until it splits.
+ *
+ * entries holds the key suffixes from its start and the child page numbers, one more than there are slots, at its
+ * end, which is the end of the page.
+ */
+template <>
+struct NonLeafNode<StringKey> {
+    /**
+     * Level of the node in the tree.
+     */
+    int level;
+
+    /**
+     * Stores available space in Node. Decrements as new array are added
+     */
+    int spaceAvail;
+
+    /**
+     * Number of leading bytes shared by the fences, and so by every key, and left out of the key suffixes.
+     */
+    int prefixLength;
+
+    /**
+     * Separator in the parent to the left of this node; no key in the node is less.
+     */
+    StringKey lowFence;
+
+    /**
+     * Separator in the parent to the right of this node; no key in the node is greater.
+     */
+    StringKey highFence;
+
+    /**
+     * Key suffixes, sized by prefixLength, and child page numbers.
+     */
+    char entries[STRINGNONLEAFAREA];
+};
+
+/**
+ * @brief Structure for all leaf nodes when the key is of STRING type, prefix compressed like
+ * NonLeafNode<StringKey>. entries holds the key suffixes from its start and the record ids at its end.
+ */
+template <>
+struct LeafNode<StringKey> {
+    /**
+     * Stores available space in Node. Decrements as new array are added
+     */
+    int spaceAvail;
+
+    /**
+     * Page number of the leaf on the right side.
+     * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+     */
+    PageId rightSibPageNo;
+
+    /**
+     * Page number of the leaf on the left side, which descending scans move to.
+     */
+    PageId leftSibPageNo;
+
+    /**
+     * Number of leading bytes shared by the fences, and so by every key, and left out of the key suffixes.
+     */
+    int prefixLength;
+
+    /**
+     * Separator in the parent to the left of this leaf; no key in the leaf is less.
+     */
+    StringKey lowFence;
+
+    /**
+     * Separator in the parent to the right of this leaf; no key in the leaf is greater.
+     */
+    StringKey highFence;
+
+    /**
+     * Key suffixes, sized by prefixLength, and record ids.
+     */
+    char entries[STRINGLEAFAREA];
+};
+
+/**
+ * @brief Structure for all leaf nodes when the key is of INTEGER type, frame-of-reference compressed.
+ *
+ * As in LeafNode<StringKey>, every key of the leaf lies between its fences. Each key is stored as its unsigned
+ * distance from the low fence in keyWidth bytes, the fewest of 1, 2 or 4 that hold the distance between the
+ * fences, so the leaves of dense or clustered keys hold up to a third more entries than 4-byte keys allow. The
+ * width, and with it the slot count, is fixed from the time the leaf is built until it splits.
+ *
+ * A leaf whose fences are equal holds entries of that one key only and stores no deltas at all: it is a posting
+ * list of record ids, half again as many as 4-byte keys leave room for. The leaves between the separators of a
+ * heavily duplicated key are such lists; bulk loads build them directly, and inserts do as the leaves holding
+ * the key split between its duplicates. A bulk load sorts the duplicates of a key by record id, and inserts add
+ * each after those already there; either way an equality scan copies the record ids out of each list in one
+ * run.
+ *
+ * The leaves of a covering index also keep the included attributes of each entry, includedWidth bytes of them,
+ * in a region between the key deltas and the record ids; the leaves of other indexes leave it empty.
+ *
+ * entries holds the key deltas from its start, the included attributes after them and the record ids at its end,
+ * which is the end of the page.
+ */
+template <>
+struct LeafNode<int> {
+    /**
+     * Stores available space in Node. Decrements as new array are added
+     */
+    int spaceAvail;
+
+    /**
+     * Page number of the leaf on the right side.
+     * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+     */
+    PageId rightSibPageNo;
+
+    /**
+     * Page number of the leaf on the left side, which descending scans move to.
+     */
+    PageId leftSibPageNo;
+
+    /**
+     * Bytes of each key delta: 0, 1, 2 or 4.
+     */
+    int keyWidth;
+
+    /**
+     * Separator in the parent to the left of this leaf; no key in the leaf is less.
+     */
+    int lowFence;
+
+    /**
+     * Separator in the parent to the right of this leaf; no key in the leaf is greater.
+     */
+    int highFence;
+
+    /**
+     * Bytes of included attributes of each entry, 0 unless the index is covering.
+     */
+    int includedWidth;
+
+    /**
+     * Key deltas, sized by keyWidth, included attributes and record ids.
+     */
+    char entries[INTLEAFAREA];
+};
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+ */
+typedef NonLeafNode<int> NonLeafNodeInt;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of DOUBLE type.
+ */
+typedef NonLeafNode<double> NonLeafNodeDouble;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of STRING type.
+ */
+typedef NonLeafNode<StringKey> NonLeafNodeString;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of INTEGER type.
+ */
+typedef LeafNode<int> LeafNodeInt;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of DOUBLE type.
+ */
+typedef LeafNode<double> LeafNodeDouble;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of STRING type.
+ */
+typedef LeafNode<StringKey> LeafNodeString;
+
+static_assert(sizeof(NonLeafNodeInt) <= Page::SIZE && sizeof(LeafNodeInt) == Page::SIZE,
+              "INTEGER nodes must fit in a page, and INTEGER leaves end at its end, where their record ids lie");
+static_assert(sizeof(NonLeafNodeDouble) <= Page::SIZE && sizeof(LeafNodeDouble) <= Page::SIZE,
+              "DOUBLE nodes must fit in a page");
+static_assert(sizeof(NonLeafNodeString) == Page::SIZE && sizeof(LeafNodeString) == Page::SIZE,
+              "STRING nodes must end at the end of the page, where their record ids and page numbers are aligned");
+
+/**
+ * @brief Number of levels, counted from the root, whose non-leaf nodes a BTreeIndex keeps pinned.
+ */
+const int PINNED_TOP_LEVELS = 2;
+
+/**
+ * @brief Fraction of the buffer pool the pinned top levels may take; a level that would take more is left unpinned.
+ */
+const double PINNED_TOP_FRACTION = 0.125;
+
+/**
+ * @brief Slots per buffer frame in the table of frames an index last found its pages in.
+ */
+const int SWIZZLE_SLOTS_PER_FRAME = 2;
+
+/**
+ * @brief A set of non-leaf nodes from the top of a tree, each kept pinned for as long as the set exists, so that
+ * descents latch them in their frames without looking them up or pinning them.
+ *
+ * A set only ever goes stale. A node created after it was taken is missing from it and read through the buffer
+ * manager, and a node removed from the tree since is still pinned, so still safe to latch, until the set is
+ * destroyed.
+ */
+class PinnedNodes {
+   public:
+    /**
+     * Constructor of PinnedNodes class, for nodes of file pinned in bufMgr.
+     */
+    PinnedNodes(BufMgr* bufMgr, File* file) : bufMgr(bufMgr), file(file) {}
+
+    /**
+     * Destructor of PinnedNodes class, unpins every node
+     */
+    ~PinnedNodes();
+
+    /**
+     * Adds a node, taking over a pin on it. Nodes must be added in increasing page number order.
+     */
+    void add(const PageId pageNo, Page* page) { nodes.push_back(std::make_pair(pageNo, page)); }
+
+    /**
+     * Returns the frame of a node in the set, or NULL if it is not in it.
+     */
+    Page* find(const PageId pageNo) const {
+        std::vector<std::pair<PageId, Page*> >::const_iterator it =
+            std::lower_bound(nodes.begin(), nodes.end(), std::make_pair(pageNo, (Page*)NULL));
+        return it != nodes.end() && it->first == pageNo ? it->second : NULL;
+    }
+
+    /**
+     * Returns the number of nodes in the set.
+     */
+    size_t size() const { return nodes.size(); }
+
+   private:
+    BufMgr* bufMgr;
+    File* file;
+    std::vector<std::pair<PageId, Page*> > nodes;
+
+    PinnedNodes(const PinnedNodes&);
+    PinnedNodes& operator=(const PinnedNodes&);
+};
+
+class BTreeIndex;
+
+/**
+ * @brief Entries a new index is bulk loaded from instead of its relation's records, laid out as for
+ * BTreeIndex::insertBatch.
+ */
+struct IndexEntries {
+    IndexEntries() : keys(NULL), rids(NULL), count(0), included(NULL) {}
+
+    /**
+     * Keys, laid out back to back: count integers, doubles or STRINGSIZE-byte strings, in any order
+     */
+    const void* keys;
+
+    /**
+     * Record ID of each key
+     */
+    const RecordId* rids;
+
+    /**
+     * Number of entries
+     */
+    std::size_t count;
+
+    /**
+     * Included attributes of each entry, laid out as for BTreeIndex::insertBatch; required by a covering index
+     */
+    const void* included;
+};
+
+/**
+ * @brief A page an index operation latched exclusively or created, kept pinned by the operation until its
+ * changes are logged.
+ */
+struct LoggedPage {
+    /**
+     * Page ID of the page
+     */
+    PageId pageNo;
+
+    /**
+     * Frame the page is pinned in
+     */
+    Page* frame;
+
+    /**
+     * The page as it was when latched, or NULL for a page the operation created, which is logged whole
+     */
+    std::unique_ptr<Page> before;
+
+    /**
+     * True once the operation is done with the page but holds its exclusive latch until the group is logged
+     */
+    bool held;
+};
+
+/**
+ * @brief The pages one index operation on this thread has changed so far, logged as one group.
+ */
+struct OperationLog {
+    /**
+     * Index the operation runs on, or NULL between operations
+     */
+    const BTreeIndex* index;
+
+    /**
+     * Pages latched exclusively or created since the last group was logged
+     */
+    std::vector<LoggedPage> pages;
+
+    OperationLog() : index(NULL) {}
+};
+
+/**
+ * @brief Makes the index operations of its lifetime log their changes, if the index has a write-ahead log.
+ * Scopes nest; only the outermost one logs what is left. An operation calls commit once it is done, so that an
+ * error writing the log reaches its caller; a scope that ends without it, because the operation threw, still
+ * logs and releases what the operation holds but does not wait for it to be durable, and never throws.
+ */
+class LogScope {
+   public:
+    explicit LogScope(BTreeIndex* index);
+    ~LogScope();
+
+    /**
+     * Logs what the operation holds, releases it and waits until it is durable, if this is the outermost scope.
+     *
+     * @throws LogWriteException if the log cannot be written
+     */
+    void commit();
+
+   private:
+    BTreeIndex* index;
+    bool outermost;
+
+    LogScope(const LogScope&);
+    LogScope& operator=(const LogScope&);
+};
+
+/**
+ * @brief Order in which a scan returns the entries of its range.
+ */
+enum ScanOrder {
+    /**
+     * Ascending keys, moving right along the leaves.
+     */
+    SCAN_ASCENDING,
+    /**
+     * Descending keys, moving left along the leaves; the entries of one key come in the reverse of their
+     * ascending order.
+     */
+    SCAN_DESCENDING
+};
+
+/**
+ * @brief How a range scan reads its range, beyond the bounds. Converts from a ScanOrder for the default options in
+ * that order.
+ */
+struct ScanOptions {
+    /**
+     * Order the entries are returned in.
+     */
+    ScanOrder order;
+
+    /**
+     * Most entries the scan returns, or 0 for no limit. The scan stops reading, and prefetching, leaves once it has
+     * copied that many.
+     */
+    std::size_t limit;
+
+    /**
+     * True to return only the first entry of each key, in scan order. Once a leaf ends inside the duplicates of a
+     * key, the scan descends again past them rather than reading the leaves they fill.
+     */
+    bool distinct;
+
+    ScanOptions(const ScanOrder order = SCAN_ASCENDING, const std::size_t limit = 0, const bool distinct = false)
+        : order(order), limit(limit), distinct(distinct) {}
+};
+
+/**
+ * @brief What one call of BTreeIndex::reorganize did.
+ */
+struct ReorgResult {
+    /**
+     * Runs of leaves looked at, each of at most REORG_RUN_LEAVES leaves of one parent
+     */
+    std::size_t runs;
+
+    /**
+     * Leaves in those runs
+     */
+    std::size_t leavesRead;
+
+    /**
+     * Leaves written in place of some of them, packed into fewer or moved to consecutive page numbers
+     */
+    std::size_t leavesWritten;
+
+    /**
+     * True if the call reached the last leaf, so the next call starts again from the first
+     */
+    bool complete;
+
+    ReorgResult() : runs(0), leavesRead(0), leavesWritten(0), complete(false) {}
+};
+
+/**
+ * @brief An independent range scan over a BTreeIndex, returned by BTreeIndex::openScan.
+ *
+ * A cursor copies the matching entries of one leaf at a time under a shared latch, together with that leaf's
+ * right sibling, and pins nothing between calls. Any number of cursors can be open on one index, each used by
+ * one thread at a time, alongside concurrent inserts.
+ *
+ * A descending cursor starts at the rightmost leaf that may hold the high value and moves to left siblings
+ * instead. A left link is only followed while it still leads to the leaf the cursor came from, as a split or
+ * merge to the left in between would skip or repeat entries; otherwise the cursor descends again to the
+ * rightmost leaf that may hold the smallest key it returned, skipping the entries of that key it already did.
+ */
+class IndexScanCursor {
+    friend class BTreeIndex;
+
+   private:
+    /**
+     * Index being scanned, NULL if the cursor is closed.
+     */
+    BTreeIndex* index;
+
+    /**
+     * Low INTEGER value for scan.
+     */
+    int lowValInt;
+
+    /**
+     * High INTEGER value for scan.
+     */
+    int highValInt;
+
+    /**
+     * Low DOUBLE value for scan.
+     */
+    double lowValDouble;
+
+    /**
+     * High DOUBLE value for scan.
+     */
+    double highValDouble;
+
+    /**
+     * Low STRING value for scan.
+     */
+    StringKey lowValString;
+
+    /**
+     * High STRING value for scan.
+     */
+    StringKey highValString;
+
+    /**
+     * True if the low operator is GTE, false for GT.
+     */
+    bool lowInclusive;
+
+    /**
+     * True if the high operator is LTE, false for LT.
+     */
+    bool highInclusive;
+
+    /**
+     * Page number of the next leaf to copy entries from, or Page::INVALID_NUMBER once the scan reached its
+     * high bound or the last leaf.
+     */
+    PageId nextPageNum;
+
+    /**
+     * Epoch of the index the cursor is inside while open, which keeps nextPageNum from being reused.
+     */
+    EpochTicket epoch;
+
+    /**
+     * Record ids of the matching entries copied from the last leaf scanned.
+     */
+    std::vector<RecordId> rids;
+
+    /**
+     * Index of next entry to be returned from rids.
+     */
+    int nextEntry;
+
+    /**
+     * True if the keys of the entries are copied as well, for nextKeyed.
+     */
+    bool withKeys;
+
+    /**
+     * Keys of the entries in rids, back to back, if withKeys is set.
+     */
+    std::vector<char> keys;
+
+    /**
+     * Included attributes of the entries in rids, back to back, if the index is covering.
+     */
+    std::vector<char> included;
+
+    /**
+     * True if the scan runs in descending key order.
+     */
+    bool descending;
+
+    /**
+     * True if the scan returns one entry per key.
+     */
+    bool distinct;
+
+    /**
+     * True if a distinct scan is to descend again past the key it returned last rather than read the next leaf.
+     */
+    bool jumpNext;
+
+    /**
+     * Number of entries the scan may still return, or std::numeric_limits<std::size_t>::max() without a limit.
+     */
+    std::size_t remaining;
+
+    /**
+     * Leaf a descending scan copied its entries from last, which the next leaf must still link back to, or
+     * Page::INVALID_NUMBER after a descent. Once a descending scan has copied entries, the high value is the
+     * smallest key among them, inclusive.
+     */
+    PageId rightPageNum;
+
+    /**
+     * Record ids a descending scan returned with a key equal to the high value, sorted by page and slot.
+     */
+    std::vector<RecordId> boundaryRids;
+
+    /**
+     * Those of boundaryRids a descending scan has not yet found again since it last descended, which the leaves
+     * it reads leave out, one entry for each; pendingSkip is what is left of them after the leaf copied last.
+     */
+    std::vector<RecordId> skipRids;
+    std::vector<RecordId> pendingSkip;
+
+    /**
+     * Copies the record ids of the entries of a latched leaf that fall inside the scan range into rids, and
+     * records the leaf's right sibling as the next leaf to scan, or none if the high bound was reached. A
+     * descending scan copies them in reverse, leaving out those in skipRids, and records the left sibling.
+     *
+     * @param leaf      Leaf to copy from, latched shared
+     * @param lowVal    Low bound of the scan, of the index's key type
+     * @param highVal   High bound of the scan, of the index's key type
+     * @return          False, with nothing copied, if a descending scan finds the leaf no longer links back to
+     *                  rightPageNum
+     */
+    template <class K>
+    bool bufferLeaf(const LeafNode<K>* leaf, const K& lowVal, const K& highVal);
+
+    /**
+     * Reverses the entries copied by bufferLeaf for a descending scan, leaving out those in skipRids.
+     *
+     * @param highVal   High bound of the scan
+     */
+    template <class K>
+    void reverseEntries(const K& highVal);
+
+    /**
+     * Makes the leaf copied last the one the next leaf of a descending scan must link back to.
+     *
+     * @param leafId    Page ID of the leaf
+     */
+    void acceptLeaf(const PageId leafId);
+
+    /**
+     * Keeps the first entry of each key among those copied by bufferLeaf, for a distinct scan.
+     */
+    template <class K>
+    void firstOfEachKey();
+
+    /**
+     * Moves the bound a scan is heading towards past the entries copied last, which have all been returned. A
+     * descending scan lowers its high bound to their smallest key, adding those of them holding it to boundaryRids;
+     * a distinct scan makes the bound exclusive, so no later leaf returns that key again.
+     *
+     * @param lowVal    Low bound of the scan, raised in place by an ascending distinct scan
+     * @param highVal   High bound of the scan, lowered in place by a descending scan
+     */
+    template <class K>
+    void narrowBound(K& lowVal, K& highVal);
+
+    /**
+     * Returns an entry from the copied ones, counting it against the limit.
+     */
+    void consumed(const std::size_t count) {
+        nextEntry += (int)count;
+        if (remaining != std::numeric_limits<std::size_t>::max()) remaining -= count;
+    }
+
+    /**
+     * Casts a latched leaf page to the leaf of the index's key type and buffers it with bufferLeaf, then prefetches
+     * the leaf the scan continues at.
+     *
+     * @param leafPage  Leaf to copy from, latched shared
+     * @return          As for bufferLeaf
+     */
+    bool bufferPage(const Page* leafPage);
+
+    /**
+     * Casts a leaf page to the leaf of the index's key type and buffers it with bufferLeaf.
+     *
+     * @param leafPage  Leaf to copy from, latched shared or read optimistically
+     * @return          As for bufferLeaf
+     */
+    bool bufferEntries(const Page* leafPage);
+
+    /**
+     * Prefetches the leaf the scan continues at, if any.
+     */
+    void prefetchNext();
+
+    /**
+     * Copies entries from the next leaves, to the right or for a descending scan to the left, until some match or
+     * the scan reaches its end.
+     *
+     * @return  True if rids holds entries past nextEntry
+     */
+    bool fill();
+
+   public:
+    /**
+     * Constructs a closed cursor.
+     */
+    IndexScanCursor();
+
+    /**
+     * Copies a cursor; an open copy scans on independently from the same position.
+     */
+    IndexScanCursor(const IndexScanCursor& other);
+
+    IndexScanCursor& operator=(const IndexScanCursor& other);
+
+    /**
+     * Closes the cursor.
+     */
+    ~IndexScanCursor();
+
+    /**
+     * Returns true if the cursor was opened by BTreeIndex::openScan and has not been closed.
+     */
+    bool isOpen() const {
+        return index != NULL;
+    }
+
+    /**
+     * Fetch the record id of the next index entry that matches the scan.
+     *
+     * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+     * @throws ScanNotInitializedException If the cursor is not open.
+     * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+     */
+    void next(RecordId& outRid);
+
+    /**
+     * Fetch the next index entry that matches the scan together with its key, for a cursor opened with
+     * withKeys set.
+     *
+     * @param outKey	Receives the key: an integer, a double or STRINGSIZE characters, not NUL-terminated if full
+     * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+     * @throws ScanNotInitializedException If the cursor is not open, or was opened without keys.
+     * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+     */
+    void nextKeyed(void* outKey, RecordId& outRid);
+
+    /**
+     * Fetch the next index entry that matches the scan together with its included attributes, for a cursor over a
+     * covering index. The record itself need not be read.
+     *
+     * @param outKey        Receives the key as for nextKeyed, if the cursor was opened with withKeys set; NULL to
+     *                      leave it out
+     * @param outRid        RecordId of next record found that satisfies the scan criteria returned in this
+     * @param outIncluded   Receives the included attributes, back to back in the order of the index's columns
+     * @throws ScanNotInitializedException If the cursor is not open, is not over a covering index, or was opened
+     *                                     without keys and outKey is set.
+     * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+     */
+    void nextIncluded(void* outKey, RecordId& outRid, void* outIncluded);
+
+    /**
+     * Fetch the record ids of the next index entries that match the scan, copying whole runs of each leaf at
+     * a time. The end of the scan is reported by the return value rather than an exception.
+     *
+     * @param out		Array of at least max record ids
+     * @param max		Largest number of record ids to return
+     * @return			Number of record ids copied; less than max only at the end of the scan, 0 once it is complete
+     * @throws ScanNotInitializedException If the cursor is not open.
+     */
+    size_t nextBatch(RecordId* out, const size_t max);
+
+    /**
+     * Closes the cursor, releasing its copied entries.
+     */
+    void close();
+};
+
+/**
+ * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
+ * relation. startScan supports only one scan at a time; openScan opens any number of independent cursors.
+ *
+ * The attribute may be an INTEGER, a DOUBLE or a STRING, of which the first STRINGSIZE characters are the key.
+ * The node code is written once over the key type K; the public methods pick the instantiation from
+ * attributeType.
+ *
+ * Inserts may run from several threads at once, and concurrently with the scan. Node pages are latched
+ * through the buffer manager with latch coupling: inserts descend optimistically with shared latches and
+ * only latch the whole split path exclusively when their leaf is full. The scan copies the matching
+ * entries of one leaf at a time under a shared latch and follows the right sibling recorded with them, so
+ * entries moved right by a concurrent split are still seen exactly once. Lookups and scans first try to read
+ * their nodes optimistically, without pins or latches, validating each against the version of its frame, and
+ * latch their way down only if that keeps running into changes. The scan itself must only be driven by one
+ * thread at a time; see IndexScanCursor.
+ */
+class BTreeIndex {
+    friend class IndexScanCursor;
+    friend class LogScope;
+
+   private:
+    /**
+     * File object for the index file.
+     */
+    File* file;
+
+    /**
+     * Buffer Manager Instance.
+     */
+    BufMgr* bufMgr;
+
+    /**
+     * Read-only mapping of the index file once mapReadOnly has been called, NULL before. While it is set,
+     * node pages are read from it instead of through bufMgr.
+     */
+    MappedFile* mapping;
+
+    /**
+     * Page number of meta page.
+     */
+    PageId headerPageNum;
+
+    /**
+     * page number of root page of B+ tree inside index file.
+     */
+    PageId rootPageNum;
+
+    /**
+     * Datatype of attribute over which index is built.
+     */
+    Datatype attributeType;
+
+    /**
+     * Offset of attribute, over which index is built, inside records.
+     */
+    int attrByteOffset;
+
+    /**
+     * Attributes a covering index includes next to each key; empty for other indexes.
+     */
+    std::vector<IncludedColumn> includedColumns;
+
+    /**
+     * Bytes of included attributes of each entry, the lengths of includedColumns added up.
+     */
+    int includedWidth;
+
+    /**
+     * Number of keys in leaf node, depending upon the type of key.
+     */
+    int leafOccupancy;
+
+    /**
+     * Number of keys in non-leaf node, depending upon the type of key.
+     */
+    int nodeOccupancy;
+
+    // MEMBERS SPECIFIC TO SCANNING
+
+    /**
+     * True if an index scan has been started.
+     */
+    bool scanExecuting;
+
+    /**
+     * Cursor behind startScan and scanNext.
+     */
+    IndexScanCursor scanCursor;
+
+    /* ########### Custom Fields ########### */
+
+    /**
+     * Variable keep track of if the new insert should be in the root or not
+     */
+    bool insertInRoot;
+
+    /**
+     * Guards rootPageNum, insertInRoot and treeHeight, which change together when the root splits.
+     */
+    std::mutex rootLock;
+
+    /**
+     * Levels of the tree, leaves included
+     */
+    int treeHeight;
+
+    /**
+     * Entries counted when the index was built, opened or last analyzed, less the net inserts entryChanges had
+     * counted by then, so that adding the net inserts counted since gives the entries now; unsigned arithmetic
+     * wraps the same way both times. Guarded by summaryLock.
+     */
+    std::uint64_t entryBase;
+
+    /**
+     * False if entryBase started from an estimate. Guarded by summaryLock.
+     */
+    bool entryBaseExact;
+
+    /**
+     * Entries inserted and deleted since the index was opened. Unlike counters, never cleared.
+     */
+    IndexCounters entryChanges;
+
+    /**
+     * Leaves as last measured by a bulk load or analyze. Guarded by summaryLock.
+     */
+    LevelShape measuredLeaves;
+
+    std::mutex summaryLock;
+
+    /**
+     * Fraction of a node's slots below which a delete merges the node into a sibling.
+     */
+    double mergeThreshold;
+
+    /**
+     * Frames pages were last found in, indexed by page number modulo the table size. fetchPage pins a page
+     * through its frame when the frame still holds it, skipping the buffer manager's hash table; a slot
+     * overwritten by another page or pointing at a frame that was evicted just misses.
+     */
+    std::unique_ptr<std::atomic<Page*>[]> swizzled;
+
+    /**
+     * Size of swizzled minus one; the size is a power of two.
+     */
+    PageId swizzleMask;
+
+    /**
+     * True while fetchPage uses and fills swizzled.
+     */
+    std::atomic<bool> swizzling;
+
+    /**
+     * Epochs of the readers that hold page numbers without a latch or pin: open cursors, which hold the next
+     * leaf they scan, optimistic lookups and appends to the cached rightmost leaf. Nodes merged away are
+     * retired here and only freed, which lets their frames and page numbers be reused, once none of those
+     * readers can still reach them.
+     */
+    EpochManager epochs;
+
+    /**
+     * Page ID of the leaf at the right end of the tree as last seen by an insert, or Page::INVALID_NUMBER. It
+     * is only set while that leaf is latched, and cleared while it is latched to be merged away.
+     */
+    std::atomic<PageId> rightmostLeaf;
+
+    /**
+     * Non-leaf nodes of the top PINNED_TOP_LEVELS levels, held pinned; NULL while mapped. Read and replaced with
+     * the atomic shared_ptr functions, so a descent keeps the set it started with for as long as it needs it.
+     */
+    std::shared_ptr<const PinnedNodes> pinnedTop;
+
+    /**
+     * Set when a non-leaf node is created or removed, so that pinnedTop no longer matches the top of the tree.
+     */
+    std::atomic<bool> pinnedTopStale;
+
+    /**
+     * Serializes rebuilds of pinnedTop.
+     */
+    std::mutex pinnedTopLock;
+
+    /**
+     * Write-ahead log the changes to the index file go to, or NULL while there is none.
+     */
+    std::unique_ptr<LogManager> log;
+
+    /**
+     * Write buffer inserts gather in before they reach the tree, holding keys of the index's type, or NULL while
+     * there is none; see setWriteBuffer.
+     */
+    std::unique_ptr<WriteBufferBase> writeBuffer;
+
+    /**
+     * Filter over the keys of the index, consulted before a lookup descends, or NULL while there is none; see
+     * setKeyFilter.
+     */
+    std::unique_ptr<BloomFilter> keyFilter;
+
+    /**
+     * Cache of the record ids of hot keys, consulted before a lookup descends, or NULL while there is none; see
+     * setHotKeyCache.
+     */
+    std::unique_ptr<HotKeyCache> hotKeys;
+
+    /**
+     * Counts of the operations run on the index since it was opened or stats were last cleared.
+     */
+    IndexCounters counters;
+
+    /**
+     * Key reorganize continues from, of the index's type: the smallest key of the next run of leaves it looks at.
+     */
+    int reorgFromInt;
+    double reorgFromDouble;
+    StringKey reorgFromString;
+
+    /**
+     * Serializes calls of reorganize, which share the key they continue from.
+     */
+    std::mutex reorgLock;
+
+    /**
+     * Returns the write buffer, for keys of type K.
+     */
+    template <class K>
+    WriteBuffer<K>* buffered() const {
+        return static_cast<WriteBuffer<K>*>(writeBuffer.get());
+    }
+
+    /* ########### Custom functions ########### */
+
+    /**
+     * Reads rootPageNum and insertInRoot as one consistent pair.
+     *
+     * @param rootId        Returns the Page ID of the root
+     * @param rootIsLeaf    Returns true if the root is a leaf
+     */
+    void getRoot(PageId& rootId, bool& rootIsLeaf);
+
+    /**
+     * Pins and latches the root for a descent in the given mode, retrying if the root splits while the
+     * latch is awaited.
+     *
+     * @param mode          Mode of the descent
+     * @param rootId        Returns the Page ID of the root
+     * @param rootPage      Returns the root, pinned and latched
+     * @param rootIsLeaf    Returns true if the root is a leaf
+     */
+    void latchRoot(const DescentMode mode, PageId& rootId, Page*& rootPage, bool& rootIsLeaf);
+
+    /**
+     * Pins and latches a node page for a descent. Once the index is mapped the page is taken straight from the
+     * mapping instead; nothing changes it then, so it is neither pinned nor latched.
+     *
+     * @param pid       Page ID of the page
+     * @param exclusive Mode to latch the page in
+     * @return          The page
+     */
+    Page* fetchPage(const PageId pid, const bool exclusive);
 
-/**
- * @brief The meta page, which holds metadata for Index file, is always first page of the btree index file and is cast
- * to the following structure to store or retrieve information from it.
- * Contains the relation name for which the index is created, the byte offset
- * of the key value on which the index is made, the type of the key and the page no
- * of the root page. Root page starts as page 2 but since a split can occur
- * at the root the root page may get moved up and get a new page no.
- */
-struct IndexMetaInfo {
     /**
-     * Name of base relation.
+     * Unlatches and unpins a page latched by a descent.
+     *
+     * @param pid       Page ID of the page
+     * @param page      The page
+     * @param exclusive Mode the page was latched in
+     * @param dirty     True if the page was modified while latched
      */
-    char relationName[20];
+    void releasePage(const PageId pid, Page* page, const bool exclusive, const bool dirty = false);
 
     /**
-     * Offset of attribute, over which index is built, inside the record stored in pages.
+     * Adds a page to the group of the operation running on this thread, if the index is logged: the
+     * operation takes a pin of its own on the page and copies it as it is now, so that the group logs what
+     * changes from here on. Called once the page is latched exclusively or, for a page just allocated, in
+     * place of latching it, which this does then and holds until the group is logged.
+     *
+     * @param pid       Page ID of the page
+     * @param page      The page, pinned
+     * @param created   True if the operation allocated the page
      */
-    int attrByteOffset;
+    void logPage(const PageId pid, Page* page, const bool created = false);
 
     /**
-     * Type of the attribute over which index is built.
+     * Called by releasePage for a page latched exclusively. A page the group changed keeps its latch until
+     * the group is logged, so that no other operation changes it on top of changes not logged yet; an
+     * unchanged one leaves the group.
+     *
+     * @param pid       Page ID of the page
+     * @param page      The page
+     * @return          True if the latch is to be held
      */
-    Datatype attrType;
+    bool holdLogged(const PageId pid, Page* page);
 
     /**
-     * Page number of root page of the B+ Tree inside the file index file.
+     * Logs the group of the operation running on this thread, then releases the latches and pins the group
+     * holds and waits until the group is durable. Called wherever the operation has released every page it
+     * latched, before it latches another page it may have changed.
+     *
+     * @throws LogWriteException if the log cannot be written
      */
-    PageId rootPageNo;
-};
+    void commitLog();
 
-/*
-Each node is a page, so once we read the page in we just cast the pointer to the page to this struct and use it to access the parts
-These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of
-node they are. The level member of each non leaf structure seen below is set to 1 if the nodes
-at this level are just above the leaf nodes. Otherwise set to 0.
-*/
+    /**
+     * Logs the group of the operation running on this thread and releases the latches and pins the group
+     * holds, without waiting for it to be durable.
+     *
+     * @return  End of the group in the log, or 0 if there was nothing to log
+     */
+    Lsn appendLog();
 
-/**
- * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
- */
-struct NonLeafNodeInt {
     /**
-     * Level of the node in the tree.
+     * Iterative, latch-coupled descent from the root to the leaf the key belongs in. In DESCEND_SPLIT mode
+     * the non-leaf nodes a split can still reach are left pinned and latched on path together with the slot
+     * of the child followed out of each; in the other modes the path stays empty.
+     *
+     * @param key       Key to search for
+     * @param leftmost  True to follow the leftmost child that may hold key, as scans do; false to follow the
+     *                  child key is inserted into
+     * @param mode      How the nodes on the way down are latched
+     * @param path      Returns the non-leaf nodes still latched, root side first
+     * @param leafId    Returns the Page ID of the leaf
+     * @param leafPage  Returns the leaf, pinned and latched as mode describes
+     * @param bound     If not NULL, returns the separator bounding the leaf's keys from above, or
+     *                  KeyBounds<K>::highest() if none does; keys below it belong in the leaf too
+     * @param parentBound  If not NULL, returns the separator bounding the keys of the leaf's parent from above in
+     *                  the same way, or KeyBounds<K>::highest() while the root is a leaf; bound must not be NULL
      */
-    int level;
+    template <class K>
+    void searchNode(const K& key, const bool leftmost, const DescentMode mode, NodePath& path, PageId& leafId,
+                    Page*& leafPage, K* bound = NULL, K* parentBound = NULL);
 
     /**
-     * Parent node's id
+     * Starts an optimistic read of a node in the frame recorded for it in swizzled. STRING nodes are copied
+     * into scratch and the copy validated, since where their entries lie depends on the node itself; other
+     * nodes are read in place.
+     *
+     * @param pid       Page ID of the node
+     * @param scratch   Page to copy the node into if it needs copying
+     * @param page      Returns the frame, its version and the node to read
+     * @return          False if the frame of the node is not known or it cannot be read now
      */
-    PageId parentId;
+    template <class K>
+    bool readOptimistic(const PageId pid, Page* scratch, OptimisticPage& page);
 
     /**
-     * Stores keys.
+     * Returns true if a page read with readOptimistic did not change since.
      */
-    int keyArray[INTARRAYNONLEAFSIZE];
+    bool validate(const OptimisticPage& page) const { return bufMgr->validateVersion(page.frame, page.version); }
 
     /**
-     * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
+     * Descends from the root to the leaf the key belongs in without pinning or latching anything, validating
+     * each node once the version of the next has been read. The caller validates the leaf once it read it.
+     *
+     * @param key       Key to search for
+     * @param leftmost  True to follow the leftmost child that may hold key, as in searchNode
+     * @param scratch   Page to copy nodes into, see readOptimistic
+     * @param leaf      Returns the leaf
+     * @return          False if the descent ran into a change or a node whose frame is not known
      */
-    PageId pageNoArray[INTARRAYNONLEAFSIZE + 1];
+    template <class K>
+    bool descendOptimistic(const K& key, const bool leftmost, Page* scratch, OptimisticPage& leaf);
 
     /**
-     * Stores available space in Node. Decrements as new array are added
+     * Like findKey, but reads the nodes optimistically.
+     *
+     * @param key   Key to look up
+     * @param out   Receives the record IDs of the matches if the search succeeds; NULL as for findKey
+     * @param found Returns true if any entry holds key
+     * @return      False if the search has to be repeated
      */
-    int spaceAvail;
+    template <class K>
+    bool findKeyOptimistic(const K& key, std::vector<RecordId>* out, bool& found);
 
-    int used;
-};
+    /**
+     * Opens a cursor on its first leaf by an optimistic descent to the low value.
+     *
+     * @param cursor    Cursor with its bounds set
+     * @param lowVal    Low value of the scan
+     * @return          False if the descent has to be repeated
+     */
+    template <class K>
+    bool openOptimistic(IndexScanCursor& cursor, const K& lowVal);
 
-/**
- * @brief Structure for all leaf nodes when the key is of INTEGER type.
- */
-struct LeafNodeInt {
     /**
-     * Stores keys.
+     * Copies the matching entries of a leaf into a cursor, reading the leaf optimistically.
+     *
+     * @param cursor    Cursor to fill
+     * @param leafId    Page ID of the leaf
+     * @return          False if the leaf has to be read again
      */
-    int keyArray[INTARRAYLEAFSIZE];
+    bool bufferOptimistic(IndexScanCursor& cursor, const PageId leafId);
 
     /**
-     * Stores RecordIds.
+     * Copies the entries of the leaf a cursor's range continues at into it, latching its way down to the bound it
+     * is heading away from: the leftmost leaf that may hold an inclusive low value or the rightmost that may hold an
+     * exclusive one, or for a descending cursor the rightmost leaf that may hold an inclusive high value or the
+     * leftmost that may hold an exclusive one.
+     *
+     * @param cursor    Cursor with its bounds set
      */
-    RecordId ridArray[INTARRAYLEAFSIZE];
+    void descendTo(IndexScanCursor& cursor);
 
     /**
-     * Page number of the leaf on the right side.
-     * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+     * Checks the operators and range of a scan.
+     *
+     * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+     * @throws  BadScanrangeException If lowVal > highval
      */
-    PageId rightSibPageNo;
+    void checkScanRange(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
 
     /**
-     * Stores available space in Node
+     * Returns true if the key filter shows that a scan cannot match: the scan is for one key, which the filter
+     * rules out.
      */
-    int spaceAvail;
+    bool filterRejects(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
 
     /**
-     * Stores page numbers of parent page number
-     * This is -1 if no parent page exists
+     * Walks the tree of keys of type K level by level, as described for analyze.
      */
-    PageId parentId;
+    template <class K>
+    void analyzeLevels(IndexShape& shape);
 
-    int used;
-};
+    /**
+     * Returns the entries inserted less the entries deleted since the index was opened.
+     */
+    std::uint64_t netInserts() const;
 
-/**
- * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
- * relation. This index supports only one scan at a time.
- */
-class BTreeIndex {
-   private:
     /**
-     * File object for the index file.
+     * Writes the height, entries and measured leaves into the meta page and marks the index closed cleanly.
+     * Called by the destructor once nothing else uses the index.
      */
-    File* file;
+    void saveSummary();
 
     /**
-     * Buffer Manager Instance.
+     * Reorganizes runs of leaves from the leaf key from belongs in on, as described for reorganize, and moves
+     * from past the last of them.
      */
-    BufMgr* bufMgr;
+    template <class K>
+    void reorganizeLeaves(K& from, const std::size_t maxRuns, const double fillFactor, ReorgResult& result);
 
     /**
-     * Page number of meta page.
+     * Reorganizes the run of leaves that starts at the leaf key from belongs in and takes up to REORG_RUN_LEAVES
+     * of its parent's children, and sets from to the smallest key of the leaf after the run.
+     *
+     * @return  False if the run ended at the last leaf, or the root is a leaf
      */
-    PageId headerPageNum;
+    template <class K>
+    bool reorganizeRun(K& from, const double fillFactor, ReorgResult& result);
 
     /**
-     * page number of root page of B+ tree inside index file.
+     * Builds the key filter from every key of the tree of keys of type K, walking the leaf level once.
+     *
+     * @param bitsPerKey    Bits of filter per key
      */
-    PageId rootPageNum;
+    template <class K>
+    void buildKeyFilter(const int bitsPerKey);
 
     /**
-     * Datatype of attribute over which index is built.
+     * Inserts the pair <key,rid> into the tree of keys of type K. See insertEntry.
+     *
+     * @param key       Key to insert
+     * @param rid       Record ID of a record whose entry is getting inserted into the index.
+     * @param included  Included attributes of the entry, or NULL if the index is not covering
      */
-    Datatype attributeType;
+    template <class K>
+    void insertKey(const K& key, const RecordId rid, const char* included);
 
     /**
-     * Offset of attribute, over which index is built, inside records.
+     * Inserts pairs into the tree of keys of type K, as described for insertBatch.
+     *
+     * @param entries   Pairs to insert; sorted in place
+     * @param included  Included attributes of each pair, back to back, or empty if the index is not covering;
+     *                  sorted in place along with entries
      */
-    int attrByteOffset;
+    template <class K>
+    void insertKeys(std::vector<RIDKeyPair<K> >& entries, std::vector<char>& included);
 
     /**
-     * Number of keys in leaf node, depending upon the type of key.
+     * Looks up probe keys of type K in key order, as described for lookupBatch.
+     *
+     * @param keys      Probe keys, in the order of the batch
+     * @param callback  Receives every match
      */
-    int leafOccupancy;
+    template <class K>
+    void lookupKeys(const std::vector<K>& keys, const LookupCallback& callback);
 
     /**
-     * Number of keys in non-leaf node, depending upon the type of key.
+     * Finds the entries equal to key in the tree of keys of type K, as described for lookup.
+     *
+     * @param key   Key to look up
+     * @param out   Receives the record IDs of the matches; if NULL the search stops at the first one
+     * @return      True if any entry holds key
      */
-    int nodeOccupancy;
+    template <class K>
+    bool findKey(const K& key, std::vector<RecordId>* out);
 
-    // MEMBERS SPECIFIC TO SCANNING
+    /**
+     * Looks a key up for lookup and contains: through the hot key cache if there is one, and otherwise as
+     * findStored.
+     */
+    template <class K>
+    bool findMerged(const K& key, std::vector<RecordId>* out);
 
     /**
-     * True if an index scan has been started.
+     * Like findKey, but turns away keys the key filter rules out and merges in the matches held by the write
+     * buffer, after those in the tree.
      */
-    bool scanExecuting;
+    template <class K>
+    bool findStored(const K& key, std::vector<RecordId>* out);
 
     /**
-     * Index of next entry to be scanned in current leaf being scanned.
+     * Answers a lookup from the hot key cache, or from the tree when the key is not cached, offering the tree's
+     * answer to the cache.
      */
-    int nextEntry;
+    template <class K>
+    bool findHot(const K& key, std::vector<RecordId>* out);
 
     /**
-     * Page number of current page being scanned.
+     * Tells the hot key cache that the entry <key,rid> was inserted or deleted.
      */
-    PageId currentPageNum;
+    template <class K>
+    void hotKeyChanged(const K& key, const RecordId rid, const bool inserted);
 
     /**
-     * Current Page being scanned.
+     * Adds an entry to the write buffer, and flushes the buffer if that fills it.
      */
-    Page* currentPageData;
+    template <class K>
+    void bufferKey(const K& key, const RecordId rid);
 
     /**
-     * Low INTEGER value for scan.
+     * Inserts the entries gathered in the write buffer into the tree as one batch.
      */
-    int lowValInt;
+    template <class K>
+    void flushBuffered();
 
     /**
-     * Low DOUBLE value for scan.
+     * Pushes the separator of a split leaf up the path recorded by a DESCEND_SPLIT descent, splitting the non-leaf
+     * nodes that have no room for it, and creates a new root if the root split. Releases nothing.
+     *
+     * @param path      Non-leaf nodes latched by the descent; popped as splits move up
+     * @param leafId    Page ID of the leaf that split
+     * @param newChild  Separator and Page ID of the new right leaf
      */
-    double lowValDouble;
+    template <class K>
+    void propagateSplit(NodePath& path, const PageId leafId, PageKeyPair<K>& newChild);
 
     /**
-     * Low STRING value for scan.
+     * Deletes the pair <key,rid> from the tree of keys of type K. See deleteEntry.
+     *
+     * @param key   Key of the entry
+     * @param rid   Record ID of the entry
+     * @return      True if the entry was found and removed
      */
-    std::string lowValString;
+    template <class K>
+    bool deleteKey(const K& key, const RecordId rid);
 
     /**
-     * High INTEGER value for scan.
+     * Removes the pair <key,rid> from the leaf the descent reached, or from the leaves to its right that
+     * hold further duplicates of key, moving right with coupled exclusive latches.
+     *
+     * @param key       Key of the entry
+     * @param rid       Record ID of the entry
+     * @param leafId    Page ID of the leftmost leaf that may hold key, latched exclusive; returns the leaf the
+     *                  search ended in, still latched
+     * @param leafPage  The leaf; returns the leaf the search ended in
+     * @return          True if the entry was found and removed
      */
-    int highValInt;
+    template <class K>
+    bool removeFromLeaf(const K& key, const RecordId rid, PageId& leafId, Page*& leafPage);
 
     /**
-     * High DOUBLE value for scan.
+     * Merges an underfull leaf with a sibling under the same parent if the two fit in one leaf, and then
+     * merges each ancestor on the path that became underfull, collapsing the root once it has a single
+     * child. Nodes merged away are left intact for readers still on their way to them and appended to
+     * retired.
+     *
+     * @param path      Non-leaf nodes latched by a DESCEND_MERGE descent; popped as merges move up
+     * @param leafId    Page ID of the leaf, latched exclusive
+     * @param leafPage  The leaf
+     * @param retired   Returns the pages to retire once every latch is released
      */
-    double highValDouble;
+    template <class K>
+    void mergeUp(NodePath& path, const PageId leafId, Page* leafPage, std::vector<PageId>& retired);
 
     /**
-     * High STRING value for scan.
+     * Returns a node page no longer reachable from the root to the index file's free list.
+     *
+     * @param pid   Page ID of the page
      */
-    std::string highValString;
+    void freeNode(const PageId pid);
 
     /**
-     * Low Operator. Can only be GT(>) or GTE(>=).
+     * Retires a node merged away in epochs and frees whatever retired node no reader can reach any more.
+     *
+     * @param pid   Page ID of the node
      */
-    Operator lowOp;
+    void retireNode(const PageId pid);
 
     /**
-     * High Operator. Can only be LT(<) or LTE(<=).
+     * Frees the retired nodes no reader can reach any more.
      */
-    Operator highOp;
+    void reclaimNodes();
 
-    /* ########### Custom Fields ########### */
+    /**
+     * Rebuilds pinnedTop from the current top of the tree, pinning the new set before the old one is let go.
+     * Must be called with no page of the index latched.
+     */
+    void refreshPinnedTop();
 
     /**
-     * Variable keep track of if the new insert should be in the root or not
+     * Pins and adds the non-leaf nodes of the top levels of the tree of keys of type K, level by level while the
+     * budget allows.
+     *
+     * @param nodes     Set to fill
      */
-    bool insertInRoot;
+    template <class K>
+    void collectPinnedTop(PinnedNodes& nodes);
 
-    /* ########### Custom functions ########### */
+    /**
+     * Drops pinnedTop, unpinning its nodes once no descent holds the set any longer.
+     */
+    void releasePinnedTop();
+
+    /**
+     * Latches the root shared straight in its frame if it is a pinned non-leaf node.
+     *
+     * @param top       Pinned set of the descent
+     * @param rootId    Returns the Page ID of the root
+     * @param rootPage  Returns the root, latched shared
+     * @return          False if the root is not in the set; nothing is latched then
+     */
+    bool latchPinnedRoot(const PinnedNodes& top, PageId& rootId, Page*& rootPage);
 
     /**
-     * Recursive function to traverse the B+ Tree and find the node with the coorsponding key value
+     * Inserts a separator key and the child to its right into a non-leaf node at the given slot, splitting the
+     * node if it is full.
      *
-     * @param pid   Page ID of the result
-     * @param key   the void pointer of the key to be searched
+     * @param pid       Page ID of the non-leaf node
+     * @param slot      Slot of the child that was split; the separator goes into the key slot of the same index
+     * @param newChild  Separator key and right child to insert. If the node splits, returns the separator
+     *                  and new node to insert into the parent.
+     * @return          True if the node split and newChild must be inserted into its parent
      */
-    void searchNode(PageId& pid, const void* key, PageId currentId);
+    template <class K>
+    bool insertIntoNonLeafNode(const PageId pid, const int slot, PageKeyPair<K>& newChild);
 
-    void insertIntoNonLeafNode(const PageId pid, const void* key);
+    /**
+     * Appends the pair <key,rid> to the cached rightmost leaf without descending, if the leaf is still the
+     * rightmost one, has room and key is at least its largest key.
+     *
+     * @param key       Key to insert
+     * @param rid       Record ID of a record whose entry is getting inserted into the index.
+     * @param included  Included attributes of the entry, or NULL
+     * @return          True if the entry was appended; otherwise nothing was changed
+     */
+    template <class K>
+    bool appendToRightmost(const K& key, const RecordId rid, const char* included);
 
     /**
      * Inserts new entry into a leaf node if the node has space left, if not, splitLeafNode will be called
      *
      * @param pid           Page ID of leaf node
      * @param rid			Record ID of a record whose entry is getting inserted into the index.
-     * @param key			Key to insert, pointer to integer/double/char string
+     * @param key			Key to insert
+     * @param included      Included attributes of the entry, or NULL
+     * @param newChild      If the leaf splits, returns the smallest key and Page ID of the new right leaf
+     * @return              True if the leaf split and newChild must be inserted into its parent
      */
-    void insertIntoLeafNode(const PageId pid, const RecordId rid, const void* key);
+    template <class K>
+    bool insertIntoLeafNode(const PageId pid, const RecordId rid, const K& key, const char* included,
+                            PageKeyPair<K>& newChild);
 
     /**
      * This method is called when the top of the tree is reached and we have to create a new root node.
      *
-     * @param key			Key to insert, pointer to integer/double/char string
+     * @param key			Separator key of the new root
      * @param leftChild		The PageId of the leftchild of the new root
      * @param rightChild	The PageId of the rightchild of the new root
      * @param aboveLeaf		Bool value that tells if the new root to create will be above LeafNodes
      **/
-    void createNewRoot(const void* key, const PageId leftChild, const PageId rightChild, bool aboveLeaf);
+    template <class K>
+    void createNewRoot(const K& key, const PageId leftChild, const PageId rightChild, bool aboveLeaf);
+
+    /**
+     * Splits a full leaf in half and inserts the new entry into the half it belongs in. The new leaf is
+     * linked in to the right of the old one. If the leaf is the rightmost one and the entry goes at its end, the
+     * leaf is kept full and the new leaf starts with the new entry alone, so appends fill every leaf. Both pages
+     * are unpinned before returning.
+     *
+     * @param node      The full leaf, pinned
+     * @param pid       Page ID of the full leaf
+     * @param rid       Record ID of the entry to insert
+     * @param key       Key of the entry to insert
+     * @param included  Included attributes of the entry to insert, or NULL
+     * @param newChild  Returns the smallest key and Page ID of the new right leaf
+     */
+    template <class K>
+    void splitLeafNode(LeafNode<K>* node, const PageId pid, const RecordId rid, const K& key, const char* included,
+                       PageKeyPair<K>& newChild);
+
+    /**
+     * Refills a leaf with more entries than it can hold, keeping the first leftCount and moving the rest to a
+     * new leaf linked in to its right. The new leaf is unpinned before returning; the old one is left as it was.
+     * The leaf that was to the right of the old one is latched exclusively for a moment to link it back.
+     *
+     * @param node       The leaf, pinned and latched exclusively
+     * @param pid        Page ID of the leaf
+     * @param keys       Keys of every entry, sorted; at most twice the capacity of the leaf
+     * @param rids       Record IDs of every entry
+     * @param included   Included attributes of every entry, back to back, or empty if the index is not covering
+     * @param leftCount  Number of entries the leaf keeps; neither leaf may be left empty or take more than the
+     *                   capacity of the leaf
+     * @param newChild   Returns the separator and Page ID of the new right leaf
+     */
+    template <class K>
+    void splitLeafEntries(LeafNode<K>* node, const PageId pid, const std::vector<K>& keys,
+                          const std::vector<RecordId>& rids, const std::vector<char>& included, const int leftCount,
+                          PageKeyPair<K>& newChild);
+
+    /**
+     * Splits a full non-leaf node around its middle key after inserting newChild at slot. The middle key is
+     * removed from both halves and pushed up. Both pages are unpinned before returning.
+     *
+     * @param node      The full non-leaf node, pinned
+     * @param pid       Page ID of the full node
+     * @param slot      Slot at which newChild's separator is inserted
+     * @param newChild  Separator and right child to insert; returns the pushed up key and Page ID of the new node
+     */
+    template <class K>
+    void splitNonLeafNode(NonLeafNode<K>* node, const PageId pid, const int slot, PageKeyPair<K>& newChild);
+
+    /**
+     * Builds the tree bottom-up from every tuple in the base relation. The (key, rid) pairs are collected
+     * with FileScan, or with a ParallelScan if buildThreads is above one, and sorted, in memory or with an
+     * ExternalSorter if sortBudget is set, then packed into full leaves left to right, and each non-leaf level
+     * is packed from the separator keys of the level below it until a single root remains. Every node page is
+     * allocated in order and filled completely before it is unpinned, so each page is written out once.
+     *
+     * @param relationName  Name of the base relation to scan.
+     * @param fillFactor    Fraction (0, 1] of the key slots of each node to fill.
+     * @param buildThreads  Number of threads scanning the relation.
+     * @param sortBudget    Buffer frames the pairs are sorted in, or 0 to sort them in memory.
+     */
+    template <class K>
+    void bulkLoad(const std::string& relationName, const double fillFactor, const unsigned buildThreads,
+                  const std::uint32_t sortBudget);
+
+    /**
+     * Builds the tree bottom-up from given entries, like bulkLoad does from the relation's.
+     *
+     * @param entries       Entries to load
+     * @param fillFactor    Fraction (0, 1] of the key slots of each node to fill.
+     */
+    template <class K>
+    void loadEntries(const IndexEntries& entries, const double fillFactor);
 
     /**
-     * This method is called when a node is at max capacity already so it needs to be split.
-     * This method also called insert, splitNonLeafNode based on which case it is
+     * Packs non-leaf levels above a leaf level until a single root is left, and makes it the root.
      *
-     * @param pid   Page ID of the result
-     * @param rid   RecordId of the result
-     * @param key   the void pointer of the key to be searched
+     * @param children      Page number and smallest key of each leaf, in key order.
+     * @param fillFactor    Fraction (0, 1] of the key slots of each node to fill.
      */
-    void splitLeafNode(const void* key, const RecordId rid, PageId pid);
+    template <class K>
+    void buildUpperLevels(std::vector<PageKeyPair<K> >& children, const double fillFactor);
 
     /**
-     * This method is called when a node is at max capacity already so it needs to be split.
-     * It is a recursive method that pushes values up the tree as it is split
-     * if the given node is full then splitNonLeafNode is called again from within.
+     * Packs sorted entries into a chain of leaves linked both ways by their siblings.
      *
-     * @param pid   Page ID of the result
-     * @param key   the void pointer of the key to be searched
+     * @param entries       Sorted (key, rid) pairs: a SortedEntries or MergedEntries, read front to back.
+     * @param fillFactor    Fraction (0, 1] of the key slots of each leaf to fill.
+     * @param children      Returns the page number and smallest key of every leaf built, in key order.
      */
-    void splitNonLeafNode(const PageId Page, const void* key);
+    template <class K, class Entries>
+    void buildLeafLevel(Entries& entries, const double fillFactor, std::vector<PageKeyPair<K> >& children);
 
     /**
-     * @brief Checks if the key satisfies the conditions based on the operators and values.
+     * Packs one non-leaf level above the given children. On return children holds the nodes of the new level.
      *
-     * @param lowOp Low operator (GT/GTE)
-     * @param highOp High operator (LT/LTE)
-     * @param lowVal Low value of range, pointer to integer / double / char string
-     * @param highVal High value of range, pointer to integer / double / char string
-     * @param key The key to check.
-     * @return true If the key meets the conditions
-     * @return false if the key doesn't meet the conditions.
+     * @param children      Page number and smallest key of each child, in key order.
+     * @param fillFactor    Fraction (0, 1] of the key slots of each node to fill.
+     * @param aboveLeaf     True if the children are leaf nodes.
      */
-    bool keyCorrect(Operator lowOp, Operator highOp, int lowVal, int highVal, int key);
+    template <class K>
+    void buildNonLeafLevel(std::vector<PageKeyPair<K> >& children, const double fillFactor, bool aboveLeaf);
 
    public:
     /**
      * BTreeIndex Constructor.
      * Check to see if the corresponding index file exists. If so, open the file.
-     * If not, create it and insert entries for every tuple in the base relation using FileScan class.
+     * If not, create it and bulk load entries for every tuple in the base relation using FileScan class.
      *
      * @param relationName        Name of file.
      * @param outIndexName        Return the name of index file.
      * @param bufMgrIn						Buffer Manager Instance
      * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
      * @param attrType						Datatype of attribute over which index is built
+     * @param fillFactor					Fraction (0, 1] of each node filled when a new index is bulk loaded
+     * @param buildThreads				Number of threads scanning the relation when a new index is bulk loaded
+     * @param sortBudget					Buffer frames a new index's entries are sorted in, through temporary files
+     *                                  next to the index; 0 sorts them in memory
+     * @param entries						Entries a new index is loaded from instead of the relation, which need
+     *                                  not exist then; NULL to scan the relation. Ignored if the index exists.
+     * @param keyFilterBits				Bits per key of a key filter built once the index is loaded or opened, as by
+     *                                  setKeyFilter; 0 for none
+     * @param includedColumns			Attributes of each record kept next to its key, which makes the index covering;
+     *                                  empty for none. Only INTEGER indexes can be covering. A new covering index
+     *                                  is loaded from the relation by one thread and sorted in memory, whatever
+     *                                  buildThreads and sortBudget ask for.
      * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
+     * @throws  BadIndexInfoException     If includedColumns is given for a key type other than INTEGER, takes more
+     *                                    than MAX_INCLUDED_COLUMNS columns or MAX_INCLUDED_BYTES bytes, or differs
+     *                                    from the columns an existing index includes.
      */
     BTreeIndex(const std::string& relationName, std::string& outIndexName,
-               BufMgr* bufMgrIn, const int attrByteOffset, const Datatype attrType);
+               BufMgr* bufMgrIn, const int attrByteOffset, const Datatype attrType,
+               const double fillFactor = BULKLOAD_FILL_FACTOR, const unsigned buildThreads = 1,
+               const std::uint32_t sortBudget = 0, const IndexEntries* entries = NULL, const int keyFilterBits = 0,
+               const std::vector<IncludedColumn>& includedColumns = std::vector<IncludedColumn>());
 
     /**
      * BTreeIndex Destructor.
@@ -405,10 +2061,251 @@ class BTreeIndex {
      * This splitting will require addition of new leaf page number entry into the parent non-leaf, which may in-turn get split.
      * This may continue all the way upto the root causing the root to get split. If root gets split, metapage needs to be changed accordingly.
      * Make sure to unpin pages as soon as you can.
+     * A key at least as large as every key in the rightmost leaf is appended to that leaf directly, without a
+     * descent, while the leaf has room.
      * @param key			Key to insert, pointer to integer/double/char string
      * @param rid			Record ID of a record whose entry is getting inserted into the index.
+     * @param included		Included attributes of the record, back to back in the order of the index's columns;
+     *                      ignored unless the index is covering
+     * @throws  BadIndexInfoException If the index is covering and included is NULL
+     **/
+    void insertEntry(const void* key, const RecordId rid, const void* included = NULL);
+
+    /**
+     * Inserts several entries at once. The entries are sorted, and each descent serves every entry that belongs
+     * in the leaf reached: they are merged into it in one pass, with one pin and one dirty unpin of the leaf,
+     * instead of one descent each. A leaf without room for all of them is split once, taking as many of them as
+     * the two halves can hold; the rest go to a further descent. Equal keys end up after the entries already
+     * in the index, in record ID order among the batch.
+     * @param keys			Keys to insert, laid out back to back: count integers, doubles or STRINGSIZE-byte strings
+     * @param rids			Record ID of each key
+     * @param count			Number of entries
+     * @param included		Included attributes of each entry, laid out back to back as for insertEntry; ignored
+     *                      unless the index is covering
+     * @throws  BadIndexInfoException If the index is covering and included is NULL
+     **/
+    void insertBatch(const void* keys, const RecordId* rids, const size_t count, const void* included = NULL);
+
+    /**
+     * Delete the entry <key,rid>.
+     * Start from the root to find the leftmost leaf that may hold the key and remove the entry from it, or from
+     * the leaves to its right if duplicates of the key continue there. Rebalancing is lazy: only when the leaf
+     * falls below the merge threshold is it merged into a sibling, and only if the two fit in one leaf, which may
+     * in turn leave the parent underfull and so on up to the root. Pages merged away go back to the index file's
+     * free list, which later node allocations reuse. Entries are never moved between leaves that stay in the
+     * tree, so open scans still see every remaining entry exactly once.
+     * @param key			Key of the entry, pointer to integer/double/char string
+     * @param rid			Record ID of the entry
+     * @return				True if the entry was found and removed, false if the index holds no such entry
+     **/
+    bool deleteEntry(const void* key, const RecordId rid);
+
+    /**
+     * Finds every entry equal to any of several probe keys, as an index nested-loop join probes the index.
+     * The probes are sorted and answered left to right: the non-leaf nodes above the current leaf stay latched
+     * shared, and each probe moves up only as far as the first node whose range holds it and down from there, so
+     * probes falling in the same subtree share its nodes and probes falling in the same leaf share one visit of
+     * it. The leaves of the next few probes are prefetched while the current one is read. Equal probes are each
+     * answered in full.
+     * The callback runs with pages of the index latched, so it must not use the index.
+     * @param keys			Probe keys, laid out back to back: count integers, doubles or STRINGSIZE-byte strings
+     * @param count			Number of probe keys
+     * @param callback		Receives each match, in key order, with the position of its probe in keys
+     **/
+    void lookupBatch(const void* keys, const size_t count, const LookupCallback& callback);
+
+    /**
+     * Returns the record ID of every entry equal to key, in index order.
+     * One descent latches its way down to the leftmost leaf that may hold key, binary searches it and copies out
+     * the matches, following the right siblings while they continue; every page is released before returning. No
+     * scan is started, so a scan open on the index is not disturbed, and a key that is absent gives an empty
+     * result rather than an exception.
+     * @param key			Key to look up, pointer to integer/double/char string
+     * @return				Record IDs of the matching entries
+     **/
+    std::vector<RecordId> lookup(const void* key);
+
+    /**
+     * Returns true if any entry equals key. Like lookup, but stops at the first match.
+     * @param key			Key to look up, pointer to integer/double/char string
+     **/
+    bool contains(const void* key);
+
+    /**
+     * Sets the fraction of a node's slots below which deleteEntry merges the node into a sibling.
+     * A fraction of 0 disables merging. Takes effect for deletes started after the call.
+     * @param threshold		Fraction [0, 1) of the slots
+     **/
+    void setMergeThreshold(const double threshold);
+
+    /**
+     * Turns pointer swizzling on or off. While it is on, which it is by default, descents remember the
+     * buffer frame each node was found in and pin it there directly the next time the node is visited.
+     * Lookups and scans read nodes optimistically only through the frames remembered, so turning it off
+     * makes them latch their way down every time.
+     * @param enabled		True to use remembered frames
      **/
-    void insertEntry(const void* key, const RecordId rid);
+    void setPointerSwizzling(const bool enabled);
+
+    /**
+     * Turns the write-ahead log of the index file on or off; it is off by default. While it is on, each
+     * insert, batch insert and delete appends the bytes it changed in the leaves, the nodes above them and the
+     * meta page to the log, next to the index file, as one group, and returns once the group is durable;
+     * concurrent operations share syncs. Pages are written back whenever the buffer manager evicts or cleans
+     * them, after the log is flushed up to their changes, and only the index's destructor flushes the file and
+     * empties the log. Opening an index whose log was left behind redoes every whole group in it first,
+     * recovering everything done since the log was turned on or last emptied.
+     * The index file is flushed either way, so the log starts from a file holding everything done before.
+     * Must not be called while another thread uses the index.
+     * @param enabled		True to log changes
+     * @throws  PagePinnedException If a page of the index is still pinned, for example by an open cursor
+     **/
+    void setWriteAheadLog(const bool enabled);
+
+    /**
+     * Takes a fuzzy checkpoint of the write-ahead log without stopping other operations: records as the log's
+     * redo point the oldest change still in a buffer frame only, and asks the buffer manager's background
+     * writer to trickle out every page changed before now. Each later checkpoint moves the redo point on past
+     * whatever was written meanwhile, so reopening after a crash only replays the log from the last one, and
+     * the log space before it is given back. Unlike flushFile it neither waits for pinned pages nor fails on
+     * them. Does nothing while the log is off. Trickling needs the background writer running.
+     * @return	Number of pages holding the redo point back, which is 0 once everything logged is on disk
+     **/
+    std::size_t checkpoint();
+
+    /**
+     * Puts a write buffer in front of the tree, or takes it away; there is none by default. While there is one,
+     * insertEntry only adds its entry to a sorted in-memory delta, and every capacity entries the delta is
+     * inserted into the tree as one batch, like insertBatch, so random inserts bound for the same leaf share one
+     * read and write of it. lookup, contains and deleteEntry see the entries in the delta; scans and
+     * lookupBatch flush it first. Entries still in the delta are not in the write-ahead log. Taking the
+     * buffer away, or destroying the index, flushes it. Must not be called while another thread uses the index.
+     * @param capacity		Entries gathered per flush; 0 for no buffer
+     * @throws  BadIndexInfoException If the index is covering, whose entries the delta has no room for
+     **/
+    void setWriteBuffer(const std::size_t capacity);
+
+    /**
+     * Inserts every entry gathered in the write buffer into the tree. Does nothing without a buffer.
+     **/
+    void flushWriteBuffer();
+
+    /**
+     * Builds an in-memory Bloom filter over the keys of the index, or drops it; there is none by default. While
+     * there is one, lookup, contains, lookupBatch and scans for a single key return at once, without reading a
+     * page, for most keys the index does not hold. Inserts add their keys to the filter; deletes leave them, so
+     * a filter that saw many deletes or far more inserts than it was sized for rejects fewer keys until it is
+     * built again. Must not be called while another thread uses the index.
+     * @param bitsPerKey	Bits of filter per key held now; 0 for no filter
+     **/
+    void setKeyFilter(const int bitsPerKey = BLOOM_BITS_PER_KEY);
+
+    /**
+     * Puts an in-memory cache of the record ids of hot keys in front of the tree, or takes it away; there is none
+     * by default. While there is one, lookup and contains answer keys it holds without reading a page, and a
+     * lookup of a key it does not hold offers what it found in the tree to it; keys get in and stay by how often
+     * they are looked up, within a budget of bytes, as described for HotKeyCache. Inserts and deletes, through
+     * insertEntry, insertBatch or deleteEntry, update the keys it holds once their change is made. Matches of a
+     * cached key come back in the order they were cached rather than in index order. lookupBatch and scans still
+     * read the tree. Must not be called while another thread uses the index.
+     * @param budget		Most bytes the cached keys and their record ids take; 0 for no cache
+     **/
+    void setHotKeyCache(const std::size_t budget);
+
+    /**
+     * Returns the hot key cache, or NULL while there is none.
+     **/
+    const HotKeyCache* hotKeyCache() const { return hotKeys.get(); }
+
+    /**
+     * Switches the index to read-only use of a memory mapping of its file. The index file is flushed from the
+     * buffer manager and mapped, and from then on scans read node pages in the mapping directly: nothing is
+     * copied into frames, looked up, pinned or latched. Inserts and deletes throw ReadOnlyException. Must not
+     * be called while another thread uses the index; calling it again does nothing.
+     * @param verifyChecksums	True to check the mapped pages against the index file's checksums, if it keeps any;
+     * false for a trusted replica, whose pages are mapped without being read
+     * @throws  PagePinnedException If a page of the index is still pinned, for example by an open cursor
+     * @throws  PageChecksumException If a page does not match its checksum
+     * @throws  FileOpenException If the index file is compressed
+     **/
+    void mapReadOnly(const bool verifyChecksums = true);
+
+    /**
+     * Returns true once mapReadOnly has been called.
+     **/
+    bool isMapped() const { return mapping != NULL; }
+
+    /**
+     * Returns the counts of the operations run on the index since it was opened or clearStats was last called:
+     * entries inserted and deleted, nodes split and merged, lookups and the leaves they read, descents and the
+     * nodes they read, and scans with the leaves they read and the record ids they returned. Counting is a
+     * relaxed atomic add into a shard of the calling thread's, so it is always on.
+     **/
+    IndexStats stats() const;
+
+    /**
+     * Sets every count stats returns back to 0.
+     **/
+    void clearStats() { counters.clear(); }
+
+    /**
+     * Walks every node of the tree, one level after the other, each node under a shared latch of its own, and
+     * returns how many nodes each level has and how full they are. A leaf level far below the fill factor it was
+     * loaded with, or a tree higher than its entries need, is one a rebuild would make smaller and faster to
+     * search. Other threads may use the index meanwhile; the shape is then that of no one moment, but every node
+     * found is counted once, as the walk holds an epoch that keeps nodes merged away from being reused.
+     * @return	Occupancy of each level, root first
+     **/
+    IndexShape analyze();
+
+    /**
+     * Returns the height of the tree, its entries and the fill of its leaves as last measured, which the meta
+     * page keeps so that an index is opened by reading that page alone. The count of entries is saved when the
+     * index is closed; an index that was not closed cleanly since, or whose log was replayed, only has an
+     * estimate of it until analyze counts the entries again, which is exact if nothing changes the index
+     * meanwhile.
+     * @return	Summary of the index
+     **/
+    IndexSummary summary();
+
+    /**
+     * Reorganizes the leaves of the tree a few at a time while other threads keep using it. Each step takes a
+     * run of up to REORG_RUN_LEAVES adjacent leaves of one parent: if repacking their entries at fillFactor, as
+     * bulkLoad does, takes fewer leaves, they are replaced by the repacked ones; otherwise, unless their page
+     * numbers are already consecutive, they are copied as they are. Either way the new leaves are added at the
+     * end of the file, one after another, so that a scan over them reads the file sequentially. A step latches
+     * the parent and the run exclusively, as a delete merging leaves would, and the leaves replaced are retired
+     * and freed once no reader can still reach them.
+     *
+     * Each call continues from where the last one stopped.
+     * @param maxRuns      Most runs to handle, or 0 to go on to the last leaf
+     * @param fillFactor   Fraction (0, 1] of the key slots of each repacked leaf to fill
+     * @return	How many nodes and leaves were handled, and whether the last leaf was reached
+     * @throws  ReadOnlyException  If the index has been mapped read-only
+     **/
+    ReorgResult reorganize(const std::size_t maxRuns = 0, const double fillFactor = REORG_FILL_FACTOR);
+
+    /**
+     * Returns the attributes the index includes next to each key, empty unless it is covering.
+     **/
+    const std::vector<IncludedColumn>& included() const { return includedColumns; }
+
+    /**
+     * Rewrites a relation with its records in the key order of an index on one of its attributes, so that range
+     * scans of that index then read the relation's pages nearly in sequence. The index is opened, or built if it
+     * does not exist, and its entries are read in key order; the records are copied in that order into a new file,
+     * which replaces the relation. As every record id changes, the index file is removed, to be rebuilt when it is
+     * next opened, and the caller must drop any other index of the relation.
+     *
+     * @param relationName    Name of the relation
+     * @param bufMgr          Buffer manager the relation and the index are read through
+     * @param attrByteOffset  Offset of the attribute the records are ordered on
+     * @param attrType        Datatype of the attribute
+     * @return                Number of records copied
+     * @throws  FileOpenException  If the relation or the index file is open
+     **/
+    static std::size_t cluster(const std::string& relationName, BufMgr* bufMgr, const int attrByteOffset,
+                               const Datatype attrType);
 
     /**
      * Begin a filtered scan of the index.  For instance, if the method is called
@@ -416,20 +2313,40 @@ class BTreeIndex {
      * greater than "a" and less than or equal to "d".
      * If another scan is already executing, that needs to be ended here.
      * Set up all the variables for scan. Start from root to find out the leaf page that contains the first RecordID
-     * that satisfies the scan parameters. Keep that page pinned in the buffer pool.
+     * that satisfies the scan parameters. The scan runs on an IndexScanCursor owned by the index.
+     * @param lowVal	Low value of range, pointer to integer / double / char string
+     * @param lowOp		Low operator (GT/GTE)
+     * @param highVal	High value of range, pointer to integer / double / char string
+     * @param highOp	High operator (LT/LTE)
+     * @param options	Order, limit and distinct mode of the scan
+     * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+     * @throws  BadScanrangeException If lowVal > highval
+     * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+     **/
+    void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp,
+                   const ScanOptions& options = ScanOptions());
+
+    /**
+     * Opens an independent scan over the index, positioned on the first entry inside the range. Unlike
+     * startScan this does not end any other scan; each returned cursor scans on its own.
      * @param lowVal	Low value of range, pointer to integer / double / char string
      * @param lowOp		Low operator (GT/GTE)
      * @param highVal	High value of range, pointer to integer / double / char string
      * @param highOp	High operator (LT/LTE)
+     * @param withKeys	True to copy out the keys of the entries too, for IndexScanCursor::nextKeyed
+     * @param options	Order, limit and distinct mode of the scan; a descending cursor is positioned on the last
+     *					entry
+     * @return			Open cursor over the range
      * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
      * @throws  BadScanrangeException If lowVal > highval
      * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
      **/
-    void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+    IndexScanCursor openScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp,
+                             const bool withKeys = false, const ScanOptions& options = ScanOptions());
 
     /**
      * Fetch the record id of the next index entry that matches the scan.
-     * Return the next record from current page being scanned. If current page has been scanned to its entirety, move on to the right sibling of current page, if any exists, to start scanning that page. Make sure to unpin any pages that are no longer required.
+     * Return the next record from the scan cursor owned by the index.
      * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
      * @throws ScanNotInitializedException If no scan has been initialized.
      * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
@@ -437,7 +2354,17 @@ class BTreeIndex {
     void scanNext(RecordId& outRid);  // returned record id
 
     /**
-     * Terminate the current scan. Unpin any pinned pages. Reset scan specific variables.
+     * Fetch the record ids of the next index entries that match the scan, many per call. The end of the scan
+     * is reported by the return value rather than an exception.
+     * @param out		Array of at least max record ids
+     * @param max		Largest number of record ids to return
+     * @return			Number of record ids copied; less than max only at the end of the scan, 0 once it is complete
+     * @throws ScanNotInitializedException If no scan has been initialized.
+     **/
+    size_t scanNextBatch(RecordId* out, const size_t max);
+
+    /**
+     * Terminate the current scan. Reset scan specific variables.
      * @throws ScanNotInitializedException If no scan has been initialized.
      **/
     void endScan();
@@ -7,6 +7,8 @@
 
 #include "bufHashTbl.h"
 
+#include <stdint.h>
+
 #include <iostream>
 #include <memory>
 
@@ -17,89 +19,92 @@
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo) {
-    int tmp, value;
-    tmp = (long)file;  // cast of pointer to the file object to an integer
-    value = (tmp + pageNo) % HTSIZE;
-    return value;
+int BufHashTbl::hash(const File* file, const PageId pageNo) const {
+    // combine the pointer and page number, then scramble with the 64-bit finalizer from MurmurHash3
+    uint64_t value = (uint64_t)(uintptr_t)file ^ ((uint64_t)pageNo << 32 | pageNo);
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return (int)(value & (uint64_t)(HTSIZE - 1));
 }
 
 BufHashTbl::BufHashTbl(int htSize)
-    : HTSIZE(htSize) {
-    // allocate an array of pointers to hashBuckets
-    ht = new hashBucket*[htSize];
+    : HTSIZE(1), count(0) {
+    // keep the load factor at or below one half
+    while (HTSIZE < 2 * htSize)
+        HTSIZE <<= 1;
+
+    ht = new hashBucket[HTSIZE];
     for (int i = 0; i < HTSIZE; i++)
-        ht[i] = NULL;
+        ht[i].file = NULL;
 }
 
 BufHashTbl::~BufHashTbl() {
-    for (int i = 0; i < HTSIZE; i++) {
-        hashBucket* tmpBuf = ht[i];
-        while (ht[i]) {
-            tmpBuf = ht[i];
-            ht[i] = ht[i]->next;
-            delete tmpBuf;
-        }
-    }
     delete[] ht;
 }
 
+int BufHashTbl::find(const File* file, const PageId pageNo) const {
+    for (int index = hash(file, pageNo); ht[index].file != NULL; index = (index + 1) & (HTSIZE - 1)) {
+        if (ht[index].file == file && ht[index].pageNo == pageNo)
+            return index;
+    }
+    return -1;
+}
+
 void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo) {
     int index = hash(file, pageNo);
-
-    hashBucket* tmpBuc = ht[index];
-    while (tmpBuc) {
-        if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-            throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-        tmpBuc = tmpBuc->next;
+    while (ht[index].file != NULL) {
+        if (ht[index].file == file && ht[index].pageNo == pageNo)
+            throw HashAlreadyPresentException(ht[index].file->filename(), ht[index].pageNo, ht[index].frameNo);
+        index = (index + 1) & (HTSIZE - 1);
     }
 
-    tmpBuc = new hashBucket;
-    if (!tmpBuc)
+    // one slot always stays empty so that probes terminate
+    if (count == HTSIZE - 1)
         throw HashTableException();
 
-    tmpBuc->file = (File*)file;
-    tmpBuc->pageNo = pageNo;
-    tmpBuc->frameNo = frameNo;
-    tmpBuc->next = ht[index];
-    ht[index] = tmpBuc;
+    ht[index].file = (File*)file;
+    ht[index].pageNo = pageNo;
+    ht[index].frameNo = frameNo;
+    count++;
 }
 
 void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId& frameNo) {
-    int index = hash(file, pageNo);
-    hashBucket* tmpBuc = ht[index];
-    while (tmpBuc) {
-        if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
-            frameNo = tmpBuc->frameNo;  // return frameNo by reference
-            return;
-        }
-        tmpBuc = tmpBuc->next;
-    }
+    if (!tryLookup(file, pageNo, frameNo))
+        throw HashNotFoundException(file->filename(), pageNo);
+}
 
-    throw HashNotFoundException(file->filename(), pageNo);
+bool BufHashTbl::tryLookup(const File* file, const PageId pageNo, FrameId& frameNo) const {
+    int index = find(file, pageNo);
+    if (index < 0)
+        return false;
+
+    frameNo = ht[index].frameNo;  // return frameNo by reference
+    return true;
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
-    int index = hash(file, pageNo);
-    hashBucket* tmpBuc = ht[index];
-    hashBucket* prevBuc = NULL;
-
-    while (tmpBuc) {
-        if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
-            if (prevBuc)
-                prevBuc->next = tmpBuc->next;
-            else
-                ht[index] = tmpBuc->next;
-
-            delete tmpBuc;
-            return;
-        } else {
-            prevBuc = tmpBuc;
-            tmpBuc = tmpBuc->next;
+    int hole = find(file, pageNo);
+    if (hole < 0)
+        throw HashNotFoundException(file->filename(), pageNo);
+
+    // Backward shift deletion: pull later entries of the probe run into the hole whenever the hole lies
+    // between their home slot and where they sit, so lookups never need tombstones.
+    int index = hole;
+    while (true) {
+        index = (index + 1) & (HTSIZE - 1);
+        if (ht[index].file == NULL)
+            break;
+        int home = hash(ht[index].file, ht[index].pageNo);
+        if (((index - home) & (HTSIZE - 1)) >= ((index - hole) & (HTSIZE - 1))) {
+            ht[hole] = ht[index];
+            hole = index;
         }
     }
-
-    throw HashNotFoundException(file->filename(), pageNo);
+    ht[hole].file = NULL;
+    count--;
 }
 
 }  // namespace badgerdb
@@ -12,7 +12,7 @@
 namespace badgerdb {
 
 /**
- * @brief Declarations for buffer pool hash table
+ * @brief One slot of the buffer pool hash table. A slot whose file is NULL is empty.
  */
 struct hashBucket {
     /**
@@ -29,41 +29,56 @@ struct hashBucket {
      * frame number of page in the buffer pool
      */
     FrameId frameNo;
-
-    /**
-     * Next node in the hash table
-     */
-    hashBucket* next;
 };
 
 /**
  * @brief Hash table class to keep track of pages in the buffer pool
  *
+ * The table is a single flat array of slots probed linearly, so no operation allocates memory. The slot
+ * count is a power of two at least twice the requested size, which keeps probe sequences short as long as
+ * the table holds no more entries than it was sized for (one per buffer frame).
+ *
  * @warning This class is not threadsafe.
  */
 class BufHashTbl {
    private:
     /**
-     *	Size of Hash Table
+     *	Number of slots in the table, a power of two
      */
     int HTSIZE;
+    /**
+     * Number of occupied slots
+     */
+    int count;
     /**
      * Actual Hash table object
      */
-    hashBucket** ht;
+    hashBucket* ht;
 
     /**
-     * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
+     * returns hash value between 0 and HTSIZE-1 computed using file and pageNo. The file pointer and page
+     * number are mixed into a full 64-bit value first, so pages of different files do not cluster.
      *
      * @param file   	File object
      * @param pageNo  Page number in the file
      * @return  			Hash value.
      */
-    int hash(const File* file, const PageId pageNo);
+    int hash(const File* file, const PageId pageNo) const;
+
+    /**
+     * Returns the slot holding (file, pageNo), or -1 if it is not in the table.
+     *
+     * @param file   	File object
+     * @param pageNo  Page number in the file
+     * @return  			Slot index or -1
+     */
+    int find(const File* file, const PageId pageNo) const;
 
    public:
     /**
      * Constructor of BufHashTbl class
+     *
+     * @param htSize  Largest number of entries the table is expected to hold
      */
     BufHashTbl(const int htSize);  // constructor
 
@@ -79,7 +94,7 @@ class BufHashTbl {
      * @param pageNo 	Page number in the file
      * @param frameNo Frame number assigned to that page of the file
      * @throws  HashAlreadyPresentException	if the corresponding page already exists in the hash table
-     * @throws  HashTableException (optional) if could not create a new bucket as running of memory
+     * @throws  HashTableException if every slot of the table is in use
      */
     void insert(const File* file, const PageId pageNo, const FrameId frameNo);
 
@@ -94,6 +109,17 @@ class BufHashTbl {
      */
     void lookup(const File* file, const PageId pageNo, FrameId& frameNo);
 
+    /**
+     * Check if (file, pageNo) is currently in the buffer pool without throwing on a miss. This is the
+     * lookup the buffer manager uses on its hot paths, where a miss is expected rather than an error.
+     *
+     * @param file  	File object
+     * @param pageNo	Page number in the file
+     * @param frameNo Frame number reference, set only if the page is found
+     * @return  			True if the page entry was found
+     */
+    bool tryLookup(const File* file, const PageId pageNo, FrameId& frameNo) const;
+
     /**
      * Delete entry (file,pageNo) from hash table.
      *
@@ -7,142 +7,597 @@
 
 #include "buffer.h"
 
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <memory>
+#include <new>
+#include <thread>
 
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/hash_not_found_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
+#include "trace.h"
 
 namespace badgerdb {
 
+/**
+ * Largest number of frames a partition's scan ring may hold; partitions smaller than four times this use a
+ * quarter of their frames
+ */
+const std::uint32_t SCAN_RING_SIZE = 16;
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Nanoseconds since start.
+ */
+static inline std::uint64_t nanosSince(const Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+/**
+ * Locks a partition lock into guard, timing the wait only if the lock is taken, so an uncontended pin reads no
+ * clock.
+ *
+ * @return  Nanoseconds waited, 0 if the lock was free
+ */
+static inline std::uint64_t lockTimed(std::mutex& lock, std::unique_lock<std::mutex>& guard) {
+    guard = std::unique_lock<std::mutex>(lock, std::try_to_lock);
+    if (guard.owns_lock()) return 0;
+    const Clock::time_point start = Clock::now();
+    guard.lock();
+    return std::max<std::uint64_t>(1, nanosSince(start));
+}
+
 //----------------------------------------
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs)
-    : numBufs(bufs) {
-    bufDescTable = new BufDesc[bufs];
+BufMgr::BufMgr(std::uint32_t bufs, std::uint32_t partitionCount, const ReplacementPolicyKind policy,
+               const ArenaOptions& memory)
+    : numBufs(bufs), numPartitions(partitionCount), ioEngine(NULL), writerStop(false), writerInterval(0),
+      writerBatch(0) {
+    // the frames come first, so each of them starts on a page boundary and can take part in direct I/O
+    static_assert(Page::SIZE % DIRECT_IO_ALIGNMENT == 0 && Page::SIZE % alignof(BufDesc) == 0,
+                  "Frames must stay aligned in the arena.");
+    arena = new MemoryArena((std::size_t)bufs * (Page::SIZE + sizeof(BufDesc)), memory.hugePages);
+    bufPool = static_cast<Page*>(arena->base());
+    bufDescTable = reinterpret_cast<BufDesc*>(static_cast<char*>(arena->base()) + (std::size_t)bufs * Page::SIZE);
+
+    // split the frames as evenly as possible, earlier partitions taking the remainder
+    partitions = new BufPartition[numPartitions];
+    FrameId first = 0;
+    for (std::uint32_t p = 0; p < numPartitions; p++) {
+        BufPartition& part = partitions[p];
+        part.firstFrame = first;
+        part.numFrames = bufs / numPartitions + (p < bufs % numPartitions ? 1 : 0);
+        part.policy = ReplacementPolicy::create(policy, first, part.numFrames);
+        // frames are handed out from the back, lowest first
+        for (FrameId i = first + part.numFrames; i > first; i--)
+            part.freeFrames.push_back(i - 1);
+        part.scanRingSize = std::min(SCAN_RING_SIZE, part.numFrames / 4);
+        first += part.numFrames;
+
+        int htsize = ((((int)(part.numFrames * 1.2)) * 2) / 2) + 1;
+        part.hashTable = new BufHashTbl(htsize);  // allocate the buffer hash table
+    }
 
+    // the arena is not backed by memory until it is touched, so place the partitions before constructing
+    const int nodes = MemoryArena::numaNodes();
+    if (memory.numaPartitions && nodes > 1) {
+        for (std::uint32_t p = 0; p < numPartitions; p++)
+            arena->preferNode((std::size_t)partitions[p].firstFrame * Page::SIZE,
+                              (std::size_t)partitions[p].numFrames * Page::SIZE, p % nodes);
+    }
     for (FrameId i = 0; i < bufs; i++) {
+        new (&bufPool[i]) Page();
+        new (&bufDescTable[i]) BufDesc();
         bufDescTable[i].frameNo = i;
         bufDescTable[i].valid = false;
     }
-
-    bufPool = new Page[bufs];
-
-    int htsize = ((((int)(bufs * 1.2)) * 2) / 2) + 1;
-    hashTable = new BufHashTbl(htsize);  // allocate the buffer hash table
-
-    clockHand = bufs - 1;
 }
 
 BufMgr::~BufMgr() {
+    // let the background writer and asynchronous I/O finish before the frames go away
+    stopBackgroundWriter();
+    delete ioEngine;
+
     // Flush out all unwritten pages
-    for (std::uint32_t i = 0; i < numBufs; i++) {
-        BufDesc* tmpbuf = &(bufDescTable[i]);
-        if (tmpbuf->valid == true && tmpbuf->dirty == true) {
-            tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-        }
+    std::vector<FrameId> dirty;
+    for (std::uint32_t p = 0; p < numPartitions; p++) {
+        FileFrameMap& files = partitions[p].files;
+        for (FileFrameMap::iterator iter = files.begin(); iter != files.end(); ++iter)
+            dirty.insert(dirty.end(), iter->second.dirty.begin(), iter->second.dirty.end());
     }
+    writeFrames(dirty);
 
-    delete hashTable;
-    delete[] bufDescTable;
-    delete[] bufPool;
+    for (std::uint32_t p = 0; p < numPartitions; p++) {
+        delete partitions[p].hashTable;
+        delete partitions[p].policy;
+    }
+    delete[] partitions;
+    for (FrameId i = 0; i < numBufs; i++) {
+        bufDescTable[i].~BufDesc();
+        bufPool[i].~Page();
+    }
+    delete arena;
 }
 
-void BufMgr::allocBuf(FrameId& frame) {
-    // perform first part of clock algorithm to search for
-    // open buffer frame
-    // Assumes non-concurrent access to buffer manager
-    std::uint32_t numScanned = 0;
-    bool found = 0;
+BufMgr::BufPartition& BufMgr::partitionOf(const File* file, const PageId pageNo) {
+    if (numPartitions == 1) return partitions[0];
 
-    while (numScanned < 2 * numBufs)  // Need to scn twice
-    {
-        // advance the clock
-        advanceClock();
-        numScanned++;
+    // consecutive pages of a file land in different partitions
+    std::uint64_t value = (std::uint64_t)(uintptr_t)file + pageNo * 0x9e3779b97f4a7c15ULL;
+    value ^= value >> 29;
+    return partitions[value % numPartitions];
+}
 
-        // if invalid, use frame
-        if (!bufDescTable[clockHand].valid) {
-            break;
+void BufMgr::allocBuf(BufPartition& part, FrameId& frame, const AccessHint hint) {
+    BADGERDB_SPAN("BufMgr::allocBuf", hint);
+    // The caller holds the partition lock, so only this partition's frames are considered
+    bool recycled = false;
+    if (hint == ACCESS_SCAN && part.scanRingSize > 0 && part.scanRing.size() >= part.scanRingSize) {
+        // a full ring reuses its oldest unpinned frame
+        for (size_t i = 0; i < part.scanRing.size() && !recycled; i++) {
+            FrameId candidate = part.scanRing.front();
+            part.scanRing.pop_front();
+            part.scanRing.push_back(candidate);
+            if (bufDescTable[candidate].pinCnt == 0) {
+                frame = candidate;
+                recycled = true;
+            }
         }
+    }
 
-        // is valid, check referenced bit
-        if (!bufDescTable[clockHand].refbit) {
-            // check to see if someone has it pinned
-            if (bufDescTable[clockHand].pinCnt == 0) {
-                // hasn't been referenced and is not pinned, use it
-                // remove previous entry from hash table
-                hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-                found = true;
-                break;
-            }
+    if (!recycled) {
+        if (!part.freeFrames.empty()) {
+            frame = part.freeFrames.back();
+            part.freeFrames.pop_back();
         } else {
-            // has been referenced, clear the bit
-            bufStats.accesses++;
-            bufDescTable[clockHand].refbit = false;
+            const bool found = part.policy->victim([this](FrameId f) { return bufDescTable[f].pinCnt == 0; }, frame);
+            part.sweepLength.record(part.policy->lastSweepLength());
+            // check for full buffer pool
+            if (!found) throw BufferExceededException();
         }
     }
 
-    // check for full buffer pool
-    if (!found && numScanned >= 2 * numBufs) {
-        throw BufferExceededException();
+    // remove previous entry from hash table and flush any existing changes to disk if necessary
+    BufDesc& desc = bufDescTable[frame];
+    if (desc.valid) {
+        FileMetrics& metrics = metricsOf(part, desc.file);
+        FileMetrics::bump(metrics.evictions);
+        unmapFrame(part, frame);
+        if (desc.dirty) {
+            part.stats.diskwrites++;
+            FileMetrics::bump(metrics.dirtyWritebacks);
+            const Clock::time_point start = Clock::now();
+            forceLog(desc);
+            desc.file->writePage(desc.pageNo, bufPool[frame]);
+            metrics.wrote(nanosSince(start));
+        }
     }
 
-    // flush any existing changes to disk if necessary
-    if (bufDescTable[clockHand].dirty) {
-        bufStats.diskwrites++;
-        // status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-        bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
+    // Reset all the BufDesc entry for the frame before returning the frame
+    desc.Clear();
+    if (recycled) {
+        desc.inScanRing = true;
+    } else if (hint == ACCESS_SCAN && part.scanRingSize > 0) {
+        // the ring only grows past its size while all of its frames are pinned
+        part.scanRing.push_back(frame);
+        desc.inScanRing = true;
     }
+}  // end allocBuf
 
-    // Reset all the BufDesc entry for the frame before returning the frame
-    bufDescTable[clockHand].Clear();
+void BufMgr::admitFrame(BufPartition& part, const FrameId frame, const bool referenced) {
+    BufDesc& desc = bufDescTable[frame];
+    if (!desc.inScanRing) part.policy->admit(frame, desc.file, desc.pageNo, referenced);
+}
 
-    // return new frame number
-    frame = clockHand;
-}  // end allocBuf
+void BufMgr::touchFrame(BufPartition& part, const FrameId frame, const AccessHint hint) {
+    BufDesc& desc = bufDescTable[frame];
+    if (!desc.inScanRing) {
+        part.policy->touch(frame);
+    } else if (hint == ACCESS_NORMAL) {
+        part.scanRing.erase(std::find(part.scanRing.begin(), part.scanRing.end(), frame));
+        desc.inScanRing = false;
+        part.policy->admit(frame, desc.file, desc.pageNo, true);
+    }
+}
+
+void BufMgr::releaseFrame(BufPartition& part, const FrameId frame) {
+    BufDesc& desc = bufDescTable[frame];
+    if (desc.inScanRing)
+        part.scanRing.erase(std::find(part.scanRing.begin(), part.scanRing.end(), frame));
+    else
+        part.policy->remove(frame);
+    desc.Clear();
+    part.freeFrames.push_back(frame);
+}
+
+FileMetrics& BufMgr::metricsOf(BufPartition& part, const File* file) {
+    if (part.lastMetricsFile == file) return *part.lastMetrics;
+    std::unique_ptr<FileMetrics>& entry = part.metrics[file];
+    if (!entry) entry.reset(new FileMetrics(file->filename()));
+    part.lastMetricsFile = file;
+    part.lastMetrics = entry.get();
+    return *entry;
+}
+
+void BufMgr::retireMetrics(const File* file) {
+    for (std::uint32_t p = 0; p < numPartitions; p++) {
+        BufPartition& part = partitions[p];
+        std::unordered_map<const File*, std::unique_ptr<FileMetrics> >::iterator entry = part.metrics.find(file);
+        if (entry == part.metrics.end()) continue;
+        FileMetricsSnapshot& retired = retiredMetrics[entry->second->filename];
+        retired.filename = entry->second->filename;
+        entry->second->addTo(retired);
+        part.metrics.erase(entry);
+        if (part.lastMetricsFile == file) {
+            part.lastMetricsFile = NULL;
+            part.lastMetrics = NULL;
+        }
+    }
+}
+
+BufMgr::FileFrames& BufMgr::framesOf(BufPartition& part, const File* file) {
+    FileFrameMap::iterator entry = part.files.find(file);
+    if (entry == part.files.end()) entry = part.files.insert(std::make_pair(file, FileFrames(&part.slab))).first;
+    return entry->second;
+}
+
+void BufMgr::mapFrame(BufPartition& part, const FrameId frame) {
+    BufDesc& desc = bufDescTable[frame];
+    part.hashTable->insert(desc.file, desc.pageNo, frame);
+    framesOf(part, desc.file).resident.insert(frame);
+}
+
+void BufMgr::unmapFrame(BufPartition& part, const FrameId frame) {
+    BufDesc& desc = bufDescTable[frame];
+    part.hashTable->remove(desc.file, desc.pageNo);
+    FileFrameMap::iterator entry = part.files.find(desc.file);
+    entry->second.resident.erase(frame);
+    entry->second.dirty.erase(frame);
+    if (entry->second.resident.empty()) part.files.erase(entry);
+}
+
+void BufMgr::setDirty(BufPartition& part, const FrameId frame, const bool dirty) {
+    BufDesc& desc = bufDescTable[frame];
+    desc.dirty = dirty;
+    FileFrames& frames = framesOf(part, desc.file);
+    if (dirty)
+        frames.dirty.insert(frame);
+    else
+        frames.dirty.erase(frame);
+}
+
+void BufMgr::writeFrames(std::vector<FrameId>& frames) {
+    // in page order the writes of a file are sequential
+    std::sort(frames.begin(), frames.end(), [this](FrameId a, FrameId b) {
+        const BufDesc& x = bufDescTable[a];
+        const BufDesc& y = bufDescTable[b];
+        return x.file != y.file ? std::less<const File*>()(x.file, y.file) : x.pageNo < y.pageNo;
+    });
+    for (size_t i = 0; i < frames.size(); i++) {
+        BufDesc& desc = bufDescTable[frames[i]];
+        BufPartition& part = partitionOf(desc.file, desc.pageNo);
+        part.stats.diskwrites++;
+        const Clock::time_point start = Clock::now();
+        forceLog(desc);
+        desc.file->writePage(desc.pageNo, bufPool[frames[i]]);
+        metricsOf(part, desc.file).wrote(nanosSince(start));
+        desc.recLsn = 0;
+        setDirty(part, frames[i], false);
+    }
+}
+
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, const AccessHint hint) {
+    BADGERDB_SPAN("BufMgr::readPage", pageNo);
+    BufPartition& part = partitionOf(file, pageNo);
+    std::unique_lock<std::mutex> guard;
+    const std::uint64_t waited = lockTimed(part.lock, guard);
+    part.stats.accesses++;
+    FileMetrics& metrics = metricsOf(part, file);
 
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page) {
     // check to see if it is already in the buffer pool
-    // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
     FrameId frameNo = 0;
-    try {
-        hashTable->lookup(file, pageNo, frameNo);
-
-        // set the referenced bit
-        bufDescTable[frameNo].refbit = true;
+    if (part.hashTable->tryLookup(file, pageNo, frameNo)) {
+        FileMetrics::bump(metrics.hits);
+        touchFrame(part, frameNo, hint);
         bufDescTable[frameNo].pinCnt++;
         page = &bufPool[frameNo];
-    } catch (const HashNotFoundException& e)  // not in the buffer pool, must allocate a new page
+
+        if (bufDescTable[frameNo].reading || bufDescTable[frameNo].readFailed) {
+            guard.unlock();
+            const Clock::time_point start = Clock::now();
+            waitForRead(part, file, pageNo, frameNo, metrics);
+            metrics.waited(waited + nanosSince(start));
+        } else if (waited > 0) {
+            metrics.waited(waited);
+        }
+    } else  // not in the buffer pool, must allocate a new page
     {
+        FileMetrics::bump(metrics.misses);
+        if (waited > 0) metrics.waited(waited);
         // alloc a new frame
-        allocBuf(frameNo);
+        allocBuf(part, frameNo, hint);
 
         // read the page into the new frame
-        bufStats.diskreads++;
-        // status = file->readPage(pageNo, &bufPool[frameNo]);
-        bufPool[frameNo] = file->readPage(pageNo);
+        part.stats.diskreads++;
+        const Clock::time_point start = Clock::now();
+        try {
+            file->readPageInto(pageNo, bufPool[frameNo]);
+        } catch (...) {
+            releaseFrame(part, frameNo);
+            throw;
+        }
+        metrics.readNanos.record(nanosSince(start));
 
         // set up the entry properly
         bufDescTable[frameNo].Set(file, pageNo);
+        admitFrame(part, frameNo, true);
         page = &bufPool[frameNo];
 
         // insert in the hash table
-        hashTable->insert(file, pageNo, frameNo);
+        mapFrame(part, frameNo);
+    }
+}
+
+void BufMgr::waitForRead(BufPartition& part, File* file, const PageId pageNo, const FrameId frameNo,
+                         FileMetrics& metrics) {
+    BufDesc& desc = bufDescTable[frameNo];
+    while (desc.reading.load(std::memory_order_acquire))
+        std::this_thread::yield();
+
+    if (desc.readFailed) {
+        std::lock_guard<std::mutex> guard(part.lock);
+        if (desc.readFailed) {
+            // read it synchronously, so that the reader gets the exception
+            const Clock::time_point start = Clock::now();
+            try {
+                part.stats.diskreads++;
+                file->readPageInto(pageNo, bufPool[frameNo]);
+            } catch (...) {
+                desc.pinCnt--;
+                throw;
+            }
+            metrics.readNanos.record(nanosSince(start));
+            desc.readFailed = false;
+        }
+    }
+}
+
+IOEngine& BufMgr::engine() {
+    std::lock_guard<std::mutex> guard(engineLock);
+    if (ioEngine == NULL) ioEngine = new IOEngine();
+    return *ioEngine;
+}
+
+void BufMgr::readPageAsync(File* file, const PageId pageNo) {
+    startRead(file, pageNo, true, ACCESS_NORMAL);
+}
+
+void BufMgr::prefetch(File* file, const PageId pageNo, const AccessHint hint) {
+    try {
+        startRead(file, pageNo, false, hint);
+    } catch (const BufferExceededException&) {
+        // a hint is dropped rather than fail the caller
+    }
+}
+
+void BufMgr::prefetchRange(File* file, const PageId firstPageNo, const std::uint32_t count, const AccessHint hint) {
+    for (std::uint32_t i = 0; i < count; i++)
+        prefetch(file, firstPageNo + i, hint);
+}
+
+void BufMgr::startRead(File* file, const PageId pageNo, const bool referenced, const AccessHint hint) {
+    BufPartition& part = partitionOf(file, pageNo);
+    FrameId frameNo = 0;
+    FileMetrics* metrics;
+    {
+        std::lock_guard<std::mutex> guard(part.lock);
+        if (part.hashTable->tryLookup(file, pageNo, frameNo)) return;
+
+        allocBuf(part, frameNo, hint);
+        part.stats.diskreads++;
+        metrics = &metricsOf(part, file);
+        FileMetrics::bump(metrics->prefetches);
+
+        // the pin taken by Set belongs to the read and is dropped when it completes
+        bufDescTable[frameNo].Set(file, pageNo);
+        admitFrame(part, frameNo, referenced);
+        bufDescTable[frameNo].reading = true;
+        mapFrame(part, frameNo);
+    }
+
+    // submitted without the partition lock, since a full engine waits for completions
+    BufDesc* desc = &bufDescTable[frameNo];
+    const Clock::time_point start = Clock::now();
+    engine().submitRead(file, pageNo, &bufPool[frameNo], [desc, metrics, start](bool ok) {
+        metrics->readNanos.record(nanosSince(start));
+        desc->readFailed = !ok;
+        desc->reading.store(false, std::memory_order_release);
+        desc->pinCnt--;
+    });
+}
+
+void BufMgr::writePageAsync(File* file, const PageId pageNo) {
+    BufPartition& part = partitionOf(file, pageNo);
+    FrameId frameNo = 0;
+    FileMetrics* metrics;
+    {
+        std::lock_guard<std::mutex> guard(part.lock);
+        if (!part.hashTable->tryLookup(file, pageNo, frameNo)) return;
+
+        BufDesc& desc = bufDescTable[frameNo];
+        // a second write in flight could complete first and be overwritten with older contents
+        if (!desc.dirty || desc.writing || desc.reading) return;
+
+        part.stats.diskwrites++;
+        metrics = &metricsOf(part, file);
+        forceLog(desc);
+        setDirty(part, frameNo, false);
+        desc.writing = true;
+        desc.pinCnt++;
+    }
+
+    BufDesc* desc = &bufDescTable[frameNo];
+    const Clock::time_point start = Clock::now();
+    engine().submitWrite(file, pageNo, &bufPool[frameNo], [this, desc, &part, frameNo, metrics, start](bool ok) {
+        metrics->wrote(nanosSince(start));
+        if (!ok) {
+            std::lock_guard<std::mutex> guard(part.lock);
+            setDirty(part, frameNo, true);
+        }
+        desc->writing = false;
+        desc->pinCnt--;
+    });
+}
+
+void BufMgr::waitForIO() {
+    IOEngine* started;
+    {
+        std::lock_guard<std::mutex> guard(engineLock);
+        started = ioEngine;
+    }
+    if (started != NULL) started->drain();
+}
+
+void BufMgr::startBackgroundWriter(const std::uint32_t intervalMs, const std::uint32_t batchSize) {
+    std::lock_guard<std::mutex> guard(writerLock);
+    if (writerThread.joinable()) return;
+    writerStop = false;
+    writerInterval = intervalMs;
+    writerBatch = batchSize;
+    writerThread = std::thread(&BufMgr::writerLoop, this);
+}
+
+void BufMgr::stopBackgroundWriter() {
+    {
+        std::lock_guard<std::mutex> guard(writerLock);
+        if (!writerThread.joinable()) return;
+        writerStop = true;
+    }
+    writerWake.notify_all();
+    writerThread.join();
+}
+
+void BufMgr::writerLoop() {
+    std::unique_lock<std::mutex> guard(writerLock);
+    while (!writerStop) {
+        writerWake.wait_for(guard, std::chrono::milliseconds(writerInterval));
+        if (writerStop) break;
+        cleanFrames(writerBatch);
+        trickleFrames(writerBatch);
+    }
+}
+
+void BufMgr::cleanFrames(const std::uint32_t batch) {
+    std::vector<FrameId> frames;
+    ReplacementPolicy::EvictableTest cleanable = [this](FrameId f) {
+        const BufDesc& desc = bufDescTable[f];
+        return desc.dirty && desc.pinCnt == 0 && !desc.writing && !desc.reading;
+    };
+    for (std::uint32_t p = 0; p < numPartitions; p++) {
+        BufPartition& part = partitions[p];
+        std::lock_guard<std::mutex> guard(part.lock);
+        const size_t first = frames.size();
+        part.policy->upcomingVictims(cleanable, batch, frames);
+        for (size_t i = first; i < frames.size(); i++) {
+            part.stats.diskwrites++;
+            setDirty(part, frames[i], false);
+            bufDescTable[frames[i]].pinCnt++;
+        }
+    }
+
+    writePicked(frames);
+}
+
+void BufMgr::trickleFrames(const std::uint32_t batch) {
+    for (size_t t = 0; t < trickleTargets.size();) {
+        const File* file = trickleTargets[t].first;
+        const Lsn below = trickleTargets[t].second;
+        std::vector<FrameId> frames;
+        bool remaining = false;
+        for (std::uint32_t p = 0; p < numPartitions; p++) {
+            BufPartition& part = partitions[p];
+            std::lock_guard<std::mutex> guard(part.lock);
+            FileFrameMap::iterator entry = part.files.find(file);
+            if (entry == part.files.end()) continue;
+            std::uint32_t picked = 0;
+            for (FrameSet::iterator iter = entry->second.resident.begin();
+                 iter != entry->second.resident.end(); ++iter) {
+                BufDesc& desc = bufDescTable[*iter];
+                const Lsn recLsn = desc.recLsn.load();
+                if (recLsn == 0 || recLsn >= below) continue;
+                // a frame with I/O in flight is looked at again in the next batch
+                if (picked == batch || desc.writing || desc.reading) {
+                    remaining = true;
+                    continue;
+                }
+                part.stats.diskwrites++;
+                if (desc.dirty) setDirty(part, *iter, false);
+                desc.pinCnt++;
+                frames.push_back(*iter);
+                picked++;
+            }
+        }
+        writePicked(frames);
+        if (remaining || !frames.empty()) {
+            t++;
+        } else {
+            trickleTargets.erase(trickleTargets.begin() + t);
+        }
+    }
+}
+
+void BufMgr::writePicked(std::vector<FrameId>& frames) {
+    // the writes run without any partition lock; a page changed meanwhile is marked dirty again when unpinned
+    std::sort(frames.begin(), frames.end(), [this](FrameId a, FrameId b) {
+        const BufDesc& x = bufDescTable[a];
+        const BufDesc& y = bufDescTable[b];
+        return x.file != y.file ? std::less<const File*>()(x.file, y.file) : x.pageNo < y.pageNo;
+    });
+    for (size_t i = 0; i < frames.size(); i++) {
+        BufDesc& desc = bufDescTable[frames[i]];
+        bool written = true;
+        // the page may have been pinned again since it was picked, so it is written under a shared latch: a
+        // change in progress, not yet in the log, never reaches the disk
+        desc.latch.lockShared();
+        const Clock::time_point start = Clock::now();
+        try {
+            forceLog(desc);
+            desc.file->writePage(desc.pageNo, bufPool[frames[i]]);
+            desc.recLsn = 0;
+        } catch (...) {
+            written = false;
+        }
+        const std::uint64_t nanos = nanosSince(start);
+        desc.latch.unlockShared();
+
+        BufPartition& part = partitionOf(desc.file, desc.pageNo);
+        std::lock_guard<std::mutex> guard(part.lock);
+        if (written) metricsOf(part, desc.file).wrote(nanos);
+        if (!written) setDirty(part, frames[i], true);
+        desc.pinCnt--;
     }
 }
 
 void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) {
+    BADGERDB_SPAN("BufMgr::unPinPage", pageNo);
+    BufPartition& part = partitionOf(file, pageNo);
+    std::lock_guard<std::mutex> guard(part.lock);
+
     // lookup in hashtable
     FrameId frameNo = 0;
-    hashTable->lookup(file, pageNo, frameNo);
+    if (!part.hashTable->tryLookup(file, pageNo, frameNo))
+        throw HashNotFoundException(file->filename(), pageNo);
 
-    if (dirty == true) bufDescTable[frameNo].dirty = dirty;
+    if (dirty == true) setDirty(part, frameNo, true);
 
     // make sure the page is actually pinned
     if (bufDescTable[frameNo].pinCnt == 0) {
@@ -151,59 +606,315 @@ void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) {
         bufDescTable[frameNo].pinCnt--;
 }
 
-void BufMgr::allocPage(File* file, PageId& pageNo, Page*& page) {
-    FrameId frameNo;
+bool BufMgr::ownsFrame(const BufPartition& part, const Page* frame) const {
+    // a frame is only ever given to pages of its own partition, and its descriptor is read under that lock
+    if (frame < bufPool || frame >= bufPool + numBufs) return false;
+    const FrameId frameNo = frame - bufPool;
+    return frameNo >= part.firstFrame && frameNo < part.firstFrame + part.numFrames;
+}
+
+bool BufMgr::pinFrame(File* file, const PageId pageNo, Page* frame) {
+    BufPartition& part = partitionOf(file, pageNo);
+    if (!ownsFrame(part, frame)) return false;
+
+    const FrameId frameNo = frame - bufPool;
+    BufDesc& desc = bufDescTable[frameNo];
+    std::unique_lock<std::mutex> guard;
+    const std::uint64_t waited = lockTimed(part.lock, guard);
+    if (!desc.valid || desc.file != file || desc.pageNo != pageNo || desc.reading || desc.readFailed)
+        return false;
+
+    part.stats.accesses++;
+    FileMetrics& metrics = metricsOf(part, file);
+    FileMetrics::bump(metrics.hits);
+    if (waited > 0) metrics.waited(waited);
+    touchFrame(part, frameNo, ACCESS_NORMAL);
+    desc.pinCnt++;
+    return true;
+}
+
+void BufMgr::unPinFrame(File* file, const PageId pageNo, Page* frame, const bool dirty) {
+    BADGERDB_SPAN("BufMgr::unPinFrame", pageNo);
+    BufPartition& part = partitionOf(file, pageNo);
+    if (!ownsFrame(part, frame)) return unPinPage(file, pageNo, dirty);
+
+    const FrameId frameNo = frame - bufPool;
+    BufDesc& desc = bufDescTable[frameNo];
+    {
+        std::lock_guard<std::mutex> guard(part.lock);
+        if (desc.valid && desc.file == file && desc.pageNo == pageNo) {
+            if (desc.pinCnt == 0) throw PageNotPinnedException(file->filename(), pageNo, frameNo);
+            if (dirty) setDirty(part, frameNo, true);
+            desc.pinCnt--;
+            return;
+        }
+    }
+    unPinPage(file, pageNo, dirty);
+}
 
-    // alloc a new frame
-    allocBuf(frameNo);
+bool BufMgr::readVersion(const File* file, const PageId pageNo, const Page* frame, std::uint32_t& version) const {
+    if (frame < bufPool || frame >= bufPool + numBufs) return false;
+    const BufDesc& desc = bufDescTable[frame - bufPool];
+    const std::uint32_t current = desc.version.load(std::memory_order_acquire);
+    if (current & 1) return false;
+    // the descriptor only changes along with the version, so validateVersion also vouches for this check
+    if (!desc.valid || desc.file != file || desc.pageNo != pageNo || desc.reading.load(std::memory_order_acquire) ||
+        desc.readFailed)
+        return false;
+    version = current;
+    return true;
+}
+
+void BufMgr::allocPage(File* file, PageId& pageNo, Page*& page, const bool append) {
+    FrameId frameNo;
+    std::unique_lock<std::mutex> guard;
+    BufPartition* owner;
+    if (numPartitions == 1) {
+        // the partition is known before the page number, so the new page is built right in its frame
+        owner = &partitions[0];
+        guard = std::unique_lock<std::mutex>(owner->lock);
+        owner->stats.accesses++;
+        allocBuf(*owner, frameNo, ACCESS_NORMAL);
+        try {
+            if (append) {
+                file->appendPageInto(pageNo, bufPool[frameNo]);
+            } else {
+                file->allocatePageInto(pageNo, bufPool[frameNo]);
+            }
+        } catch (...) {
+            releaseFrame(*owner, frameNo);
+            throw;
+        }
+    } else {
+        // the page number decides the partition, so the page is allocated first and copied into a frame
+        Page newPage;
+        if (append) {
+            file->appendPageInto(pageNo, newPage);
+        } else {
+            file->allocatePageInto(pageNo, newPage);
+        }
+        owner = &partitionOf(file, pageNo);
+        guard = std::unique_lock<std::mutex>(owner->lock);
+        owner->stats.accesses++;
+        allocBuf(*owner, frameNo, ACCESS_NORMAL);
+        bufPool[frameNo] = newPage;
+    }
+    BufPartition& part = *owner;
+
+    // a prefetch may have read the page while it was free; that copy is dropped once its read is done
+    FrameId stale;
+    while (part.hashTable->tryLookup(file, pageNo, stale)) {
+        if (bufDescTable[stale].pinCnt == 0) {
+            unmapFrame(part, stale);
+            releaseFrame(part, stale);
+            break;
+        }
+        guard.unlock();
+        std::this_thread::yield();
+        guard.lock();
+    }
 
-    // allocate a new page in the file
-    // std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-    bufPool[frameNo] = file->allocatePage(pageNo);
     page = &bufPool[frameNo];
 
     // set up the entry properly
     bufDescTable[frameNo].Set(file, pageNo);
+    admitFrame(part, frameNo, true);
 
     // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+    mapFrame(part, frameNo);
+}
+
+void BufMgr::dirtyPageTable(const File* file, std::vector<DirtyPage>& pages) {
+    for (std::uint32_t p = 0; p < numPartitions; p++) {
+        BufPartition& part = partitions[p];
+        std::lock_guard<std::mutex> guard(part.lock);
+        FileFrameMap::iterator entry = part.files.find(file);
+        if (entry == part.files.end()) continue;
+        for (FrameSet::iterator iter = entry->second.resident.begin();
+             iter != entry->second.resident.end(); ++iter) {
+            const BufDesc& desc = bufDescTable[*iter];
+            DirtyPage page;
+            page.pageNo = desc.pageNo;
+            page.recLsn = desc.recLsn.load();
+            if (page.recLsn != 0) pages.push_back(page);
+        }
+    }
+}
+
+void BufMgr::trickle(const File* file, const Lsn below) {
+    std::lock_guard<std::mutex> guard(writerLock);
+    for (size_t t = 0; t < trickleTargets.size(); t++) {
+        if (trickleTargets[t].first != file) continue;
+        trickleTargets[t].second = below;
+        return;
+    }
+    trickleTargets.push_back(std::make_pair(file, below));
 }
 
 void BufMgr::flushFile(const File* file) {
-    for (std::uint32_t i = 0; i < numBufs; i++) {
-        BufDesc* tmpbuf = &(bufDescTable[i]);
-        if (tmpbuf->file && tmpbuf->valid == true && tmpbuf->file == file) {
+    // frames with I/O in flight, or being cleaned by the background writer, are pinned
+    waitForIO();
+    std::lock_guard<std::mutex> writer(writerLock);
+    std::lock_guard<std::mutex> retiring(metricsLock);
+    // every page of the file is on disk afterwards, and the File may go away
+    for (size_t t = 0; t < trickleTargets.size(); t++) {
+        if (trickleTargets[t].first != file) continue;
+        trickleTargets.erase(trickleTargets.begin() + t);
+        break;
+    }
+
+    // every partition stays locked, so the file's pages are written in one sorted pass and none is read back
+    // in between; no other operation holds more than one partition lock
+    std::vector<std::unique_lock<std::mutex> > guards;
+    std::vector<FrameId> resident;
+    std::vector<FrameId> dirty;
+    for (std::uint32_t p = 0; p < numPartitions; p++) {
+        BufPartition& part = partitions[p];
+        guards.push_back(std::unique_lock<std::mutex>(part.lock));
+
+        FileFrameMap::iterator entry = part.files.find(file);
+        if (entry == part.files.end()) continue;
+        for (FrameSet::iterator iter = entry->second.resident.begin();
+             iter != entry->second.resident.end(); ++iter) {
+            BufDesc* tmpbuf = &(bufDescTable[*iter]);
+            if (tmpbuf->valid == false)
+                throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, part.policy->referenced(*iter));
             if (tmpbuf->pinCnt > 0)
                 throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+            resident.push_back(*iter);
+        }
+        dirty.insert(dirty.end(), entry->second.dirty.begin(), entry->second.dirty.end());
+    }
 
-            if (tmpbuf->dirty == true) {
-                // if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-                tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-                tmpbuf->dirty = false;
-            }
-
-            hashTable->remove(file, tmpbuf->pageNo);
-            tmpbuf->Clear();
-        } else if (tmpbuf->valid == false && tmpbuf->file == file)
-            throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+    writeFrames(dirty);
+    for (size_t i = 0; i < resident.size(); i++) {
+        BufDesc& desc = bufDescTable[resident[i]];
+        BufPartition& part = partitionOf(desc.file, desc.pageNo);
+        unmapFrame(part, resident[i]);
+        releaseFrame(part, resident[i]);
     }
+    retireMetrics(file);
+    guards.clear();
+
+    file->sync();
 }
 
 void BufMgr::disposePage(File* file, const PageId pageNo) {
     // Deallocate from file altogether
-    // See if it is in the buffer pool
-    FrameId frameNo = 0;
-    hashTable->lookup(file, pageNo, frameNo);
-
-    // clear the page
-    bufDescTable[frameNo].Clear();
-
-    hashTable->remove(file, pageNo);
+    {
+        BufPartition& part = partitionOf(file, pageNo);
+        std::lock_guard<std::mutex> guard(part.lock);
+
+        // See if it is in the buffer pool
+        FrameId frameNo = 0;
+        if (part.hashTable->tryLookup(file, pageNo, frameNo)) {
+            if (bufDescTable[frameNo].pinCnt > 0) {
+                throw PagePinnedException(file->filename(), pageNo, frameNo);
+            }
+            // clear the page
+            unmapFrame(part, frameNo);
+            releaseFrame(part, frameNo);
+        }
+    }
 
     // deallocate it in the file
     file->deletePage(pageNo);
 }
 
+void BufMgr::reserveFrames(const std::uint32_t count, std::vector<Page*>& frames) {
+    std::vector<Page*> taken;
+    for (std::uint32_t i = 0; i < count; i++) {
+        // a partition out of unpinned frames passes the request on to the next one
+        bool found = false;
+        for (std::uint32_t tries = 0; tries < numPartitions && !found; tries++) {
+            BufPartition& part = partitions[(i + tries) % numPartitions];
+            std::lock_guard<std::mutex> guard(part.lock);
+            FrameId frameNo;
+            try {
+                allocBuf(part, frameNo, ACCESS_NORMAL);
+            } catch (const BufferExceededException&) {
+                continue;
+            }
+            taken.push_back(&bufPool[frameNo]);
+            found = true;
+        }
+        if (!found) {
+            releaseFrames(taken);
+            throw BufferExceededException();
+        }
+    }
+    frames.insert(frames.end(), taken.begin(), taken.end());
+}
+
+void BufMgr::releaseFrames(std::vector<Page*>& frames) {
+    for (size_t i = 0; i < frames.size(); i++) {
+        const FrameId frameNo = frames[i] - bufPool;
+        std::uint32_t p = 0;
+        while (frameNo >= partitions[p].firstFrame + partitions[p].numFrames) p++;
+        std::lock_guard<std::mutex> guard(partitions[p].lock);
+        bufDescTable[frameNo].Clear();
+        partitions[p].freeFrames.push_back(frameNo);
+    }
+    frames.clear();
+}
+
+BufStats& BufMgr::getBufStats() {
+    bufStats.clear();
+    for (std::uint32_t p = 0; p < numPartitions; p++) {
+        std::lock_guard<std::mutex> guard(partitions[p].lock);
+        bufStats.accesses += partitions[p].stats.accesses;
+        bufStats.diskreads += partitions[p].stats.diskreads;
+        bufStats.diskwrites += partitions[p].stats.diskwrites;
+    }
+    return bufStats;
+}
+
+void BufMgr::clearBufStats() {
+    for (std::uint32_t p = 0; p < numPartitions; p++) {
+        std::lock_guard<std::mutex> guard(partitions[p].lock);
+        partitions[p].stats.clear();
+    }
+    bufStats.clear();
+}
+
+void BufMgr::metrics(BufMetricsSnapshot& out) {
+    out = BufMetricsSnapshot();
+    std::lock_guard<std::mutex> retiring(metricsLock);
+    std::map<std::string, FileMetricsSnapshot> files(retiredMetrics);
+    for (std::uint32_t p = 0; p < numPartitions; p++) {
+        BufPartition& part = partitions[p];
+        std::lock_guard<std::mutex> guard(part.lock);
+        for (std::unordered_map<const File*, std::unique_ptr<FileMetrics> >::const_iterator iter = part.metrics.begin();
+             iter != part.metrics.end(); ++iter) {
+            FileMetricsSnapshot& file = files[iter->second->filename];
+            file.filename = iter->second->filename;
+            iter->second->addTo(file);
+        }
+        part.sweepLength.addTo(out.sweepLength);
+    }
+    for (std::map<std::string, FileMetricsSnapshot>::const_iterator iter = files.begin(); iter != files.end(); ++iter) {
+        const FileMetricsSnapshot& file = iter->second;
+        // metrics cleared in place stay behind at zero until their file is flushed
+        if (file.hits + file.misses + file.prefetches + file.evictions + file.writes == 0) continue;
+        out.files.push_back(file);
+        out.total.add(file);
+    }
+}
+
+void BufMgr::clearMetrics() {
+    std::lock_guard<std::mutex> retiring(metricsLock);
+    retiredMetrics.clear();
+    for (std::uint32_t p = 0; p < numPartitions; p++) {
+        BufPartition& part = partitions[p];
+        std::lock_guard<std::mutex> guard(part.lock);
+        // I/O in flight may still count into the metrics, so they are zeroed rather than dropped
+        for (std::unordered_map<const File*, std::unique_ptr<FileMetrics> >::iterator iter = part.metrics.begin();
+             iter != part.metrics.end(); ++iter)
+            iter->second->clear();
+        part.sweepLength.clear();
+    }
+}
+
 void BufMgr::printSelf(void) {
     BufDesc* tmpbuf;
     int validFrames = 0;
@@ -7,10 +7,28 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
-
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "arena.h"
 #include "bufHashTbl.h"
+#include "buffer_metrics.h"
 #include "file.h"
+#include "io_engine.h"
+#include "latch.h"
+#include "replacement.h"
+#include "slab.h"
+#include "wal.h"
 
 namespace badgerdb {
 
@@ -21,8 +39,11 @@ class BufMgr;
 
 /**
  * @brief Class for maintaining information about buffer pool frames
+ *
+ * Each descriptor fills one cache line of its own, so threads working on neighbouring frames do not contend
+ * for the same line.
  */
-class BufDesc {
+class alignas(CACHE_LINE_SIZE) BufDesc {
     friend class BufMgr;
 
    private:
@@ -44,7 +65,7 @@ class BufDesc {
     /**
      * Number of times this page has been pinned
      */
-    int pinCnt;
+    std::atomic<int> pinCnt;
 
     /**
      * True if page is dirty;  false otherwise
@@ -57,20 +78,67 @@ class BufDesc {
     bool valid;
 
     /**
-     * Has this buffer frame been reference recently
+     * Latch guarding the contents of the page in this frame, see BufMgr::latchPage
+     */
+    RWLatch latch;
+
+    /**
+     * True while an asynchronous read fills the frame; readers of the page wait for it
+     */
+    std::atomic<bool> reading;
+
+    /**
+     * True while an asynchronous write of the frame is in flight
      */
-    bool refbit;
+    std::atomic<bool> writing;
+
+    /**
+     * True if the last asynchronous read of the frame failed, so the next reader has to read it again
+     */
+    std::atomic<bool> readFailed;
+
+    /**
+     * True if the frame belongs to its partition's scan ring instead of the replacement policy
+     */
+    bool inScanRing;
+
+    /**
+     * Version of the frame's contents for optimistic reads, see BufMgr::readVersion. It is odd while the frame
+     * holds no page or its page is latched exclusively, and moves on whenever either ends.
+     */
+    std::atomic<std::uint32_t> version;
+
+    /**
+     * Log holding the changes made to the page, or NULL, and the LSN up to which the log has to be on disk
+     * before the page is written back, see BufMgr::setPageLsn
+     */
+    LogManager* log;
+    std::atomic<Lsn> lsn;
+
+    /**
+     * LSN from which the log holds every change to the page not yet on disk, or 0 if the disk has them all; see
+     * BufMgr::logChange
+     */
+    std::atomic<Lsn> recLsn;
 
     /**
      * Initialize buffer frame for a new user
      */
     void Clear() {
+        version.fetch_or(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
         pinCnt = 0;
         file = NULL;
         pageNo = Page::INVALID_NUMBER;
         dirty = false;
-        refbit = false;
         valid = false;
+        inScanRing = false;
+        reading = false;
+        writing = false;
+        readFailed = false;
+        log = NULL;
+        lsn = 0;
+        recLsn = 0;
     };
 
     /**
@@ -86,7 +154,7 @@ class BufDesc {
         pinCnt = 1;
         dirty = false;
         valid = true;
-        refbit = true;
+        if (version.load(std::memory_order_relaxed) & 1) version.fetch_add(1, std::memory_order_release);
     }
 
     void Print() {
@@ -99,35 +167,35 @@ class BufDesc {
         std::cout << "valid:" << valid << " ";
         std::cout << "pinCnt:" << pinCnt << " ";
         std::cout << "dirty:" << dirty << " ";
-        std::cout << "refbit:" << refbit << "\n";
+        std::cout << "scanRing:" << inScanRing << "\n";
     }
 
     /**
      * Constructor of BufDesc class
      */
-    BufDesc() {
+    BufDesc() : version(1) {
         Clear();
     }
 };
 
 /**
- * @brief Class to maintain statistics of buffer usage
+ * @brief Class to maintain statistics of buffer usage. BufMgr::metrics breaks these down further, per file.
  */
 struct BufStats {
     /**
      * Total number of accesses to buffer pool
      */
-    int accesses;
+    std::uint64_t accesses;
 
     /**
      * Number of pages read from disk (including allocs)
      */
-    int diskreads;
+    std::uint64_t diskreads;
 
     /**
      * Number of pages written back to disk
      */
-    int diskwrites;
+    std::uint64_t diskwrites;
 
     /**
      * Clear all values
@@ -144,15 +212,141 @@ struct BufStats {
     }
 };
 
+/**
+ * @brief A page of a file whose frame holds changes not yet on disk, with the LSN its oldest such change was
+ * logged from; see BufMgr::dirtyPageTable.
+ */
+struct DirtyPage {
+    PageId pageNo;
+    Lsn recLsn;
+};
+
 /**
  * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file
+ *
+ * All public methods may be called from several threads at once. Each call locks only the partition the
+ * page hashes to. Pages can also be read and written back asynchronously through an IOEngine, which is
+ * started the first time it is needed; a frame holds a pin for as long as its I/O is in flight. An optional
+ * background writer cleans the frames the replacement policy is about to evict.
  */
 class BufMgr {
    private:
     /**
-     * Current position of clockhand in our buffer pool
+     * @brief Set of frames whose nodes come from a partition's slab.
      */
-    FrameId clockHand;
+    typedef std::unordered_set<FrameId, std::hash<FrameId>, std::equal_to<FrameId>, SlabAllocator<FrameId> > FrameSet;
+
+    /**
+     * @brief The frames of one partition that hold pages of one file.
+     */
+    struct FileFrames {
+        /**
+         * Frames holding a page of the file
+         */
+        FrameSet resident;
+
+        /**
+         * The resident frames that are dirty
+         */
+        FrameSet dirty;
+
+        explicit FileFrames(Slab* slab)
+            : resident(0, std::hash<FrameId>(), std::equal_to<FrameId>(), SlabAllocator<FrameId>(slab)),
+              dirty(0, std::hash<FrameId>(), std::equal_to<FrameId>(), SlabAllocator<FrameId>(slab)) {}
+    };
+
+    typedef std::unordered_map<const File*, FileFrames, std::hash<const File*>, std::equal_to<const File*>,
+                               SlabAllocator<std::pair<const File* const, FileFrames> > >
+        FileFrameMap;
+
+    /**
+     * @brief A contiguous slice of the frames with its own hash table, replacement policy and lock. Every page
+     * maps to exactly one partition, so threads working on pages of different partitions never contend.
+     */
+    struct BufPartition {
+        /**
+         * Guards the hash table, policy, free frames, scan ring, statistics and the descriptors of this
+         * partition's frames
+         */
+        std::mutex lock;
+
+        /**
+         * Hash table mapping (File, page) to frame for the pages of this partition
+         */
+        BufHashTbl* hashTable;
+
+        /**
+         * First frame of the partition
+         */
+        FrameId firstFrame;
+
+        /**
+         * Number of frames in the partition
+         */
+        std::uint32_t numFrames;
+
+        /**
+         * Chooses the victims among the frames holding pages
+         */
+        ReplacementPolicy* policy;
+
+        /**
+         * Frames holding no page
+         */
+        std::vector<FrameId> freeFrames;
+
+        /**
+         * Frames holding pages read with ACCESS_SCAN, oldest first. Once scanRingSize frames are in the ring,
+         * scans reuse its unpinned frames instead of taking frames from the policy.
+         */
+        std::deque<FrameId> scanRing;
+
+        /**
+         * Largest number of frames in the scan ring
+         */
+        std::uint32_t scanRingSize;
+
+        /**
+         * Nodes of the frame sets of files, which are inserted and erased with every page read and evicted
+         */
+        Slab slab;
+
+        /**
+         * Frames of each file with pages in this partition, so that flushing a file visits only its own frames
+         */
+        FileFrameMap files;
+
+        /**
+         * Buffer pool usage statistics of this partition
+         */
+        BufStats stats;
+
+        /**
+         * Metrics of each file with pages in this partition, from the first page counted until flushFile retires
+         * them. The metrics stay where they are, so I/O completions may count into them without the lock.
+         */
+        std::unordered_map<const File*, std::unique_ptr<FileMetrics> > metrics;
+
+        /**
+         * File whose metrics were looked up last, which saves the lookup for runs of pages of one file
+         */
+        const File* lastMetricsFile;
+
+        /**
+         * Metrics of lastMetricsFile
+         */
+        FileMetrics* lastMetrics;
+
+        /**
+         * Frames the replacement policy stepped over for each victim
+         */
+        MetricHistogram sweepLength;
+
+        BufPartition()
+            : files(0, std::hash<const File*>(), std::equal_to<const File*>(),
+                    SlabAllocator<std::pair<const File* const, FileFrames> >(&slab)),
+              lastMetricsFile(NULL), lastMetrics(NULL) {}
+    };
 
     /**
      * Number of frames in the buffer pool
@@ -160,9 +354,14 @@ class BufMgr {
     std::uint32_t numBufs;
 
     /**
-     * Hash table mapping (File, page) to frame
+     * Number of partitions the frames are divided into
      */
-    BufHashTbl* hashTable;
+    std::uint32_t numPartitions;
+
+    /**
+     * Array of numPartitions partitions
+     */
+    BufPartition* partitions;
 
     /**
      * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
@@ -170,24 +369,200 @@ class BufMgr {
     BufDesc* bufDescTable;
 
     /**
-     * Maintains Buffer pool usage statistics
+     * Memory holding bufPool followed by bufDescTable
+     */
+    MemoryArena* arena;
+
+    /**
+     * Sum of the partition statistics, filled in by getBufStats
      */
     BufStats bufStats;
 
     /**
-     * Advance clock to next frame in the buffer pool
+     * Engine for asynchronous reads and writebacks, NULL until first used
      */
-    void advanceClock() {
-        clockHand = (clockHand + 1) % numBufs;
-    }
+    IOEngine* ioEngine;
+
+    /**
+     * Guards the creation of ioEngine
+     */
+    std::mutex engineLock;
+
+    /**
+     * Returns the I/O engine, starting it if this is its first use.
+     */
+    IOEngine& engine();
+
+    /**
+     * Background writer thread, if started
+     */
+    std::thread writerThread;
+
+    /**
+     * Held by the background writer while it cleans a batch, and by flushFile so that no frame of the file is
+     * pinned by the writer; also guards writerStop
+     */
+    std::mutex writerLock;
+
+    /**
+     * Wakes the background writer early when it is asked to stop
+     */
+    std::condition_variable writerWake;
+
+    /**
+     * True once the background writer has been asked to stop
+     */
+    bool writerStop;
+
+    /**
+     * Milliseconds the background writer sleeps between batches
+     */
+    std::uint32_t writerInterval;
+
+    /**
+     * Largest number of frames the background writer cleans per partition and batch
+     */
+    std::uint32_t writerBatch;
+
+    /**
+     * Files whose pages the background writer trickles out, with the LSN below which their logged changes have
+     * to reach the disk; see trickle. Guarded by writerLock.
+     */
+    std::vector<std::pair<const File*, Lsn> > trickleTargets;
+
+    /**
+     * Counters of the files flushFile retired, by name, until the metrics are cleared
+     */
+    std::map<std::string, FileMetricsSnapshot> retiredMetrics;
+
+    /**
+     * Guards retiredMetrics. Taken before any partition lock.
+     */
+    std::mutex metricsLock;
+
+    /**
+     * Returns the metrics of a file in a partition, creating them on its first page. The partition lock must be
+     * held; the metrics returned may be updated after it is released.
+     */
+    FileMetrics& metricsOf(BufPartition& part, const File* file);
+
+    /**
+     * Moves the metrics of a file out of every partition into retiredMetrics, as the File may go away once
+     * flushed. metricsLock and every partition lock must be held.
+     */
+    void retireMetrics(const File* file);
+
+    /**
+     * Body of the background writer thread.
+     */
+    void writerLoop();
+
+    /**
+     * Writes back the dirty, unpinned frames each partition's policy would evict next, at most batch per
+     * partition, in file and page number order. The frames are pinned while they are written, so they cannot be
+     * evicted halfway. writerLock must be held.
+     */
+    void cleanFrames(const std::uint32_t batch);
+
+    /**
+     * Writes back, at most batch per partition, the frames of the files in trickleTargets holding changes logged
+     * before the file's LSN, pinned or not, and drops the targets that have none left. writerLock must be held.
+     */
+    void trickleFrames(const std::uint32_t batch);
 
     /**
-     * Allocate a free frame.
+     * Writes out frames picked and pinned by cleanFrames or trickleFrames, in file and page number order, each
+     * under a shared latch, then unpins them. A frame whose write fails is marked dirty again.
+     */
+    void writePicked(std::vector<FrameId>& frames);
+
+    /**
+     * Waits for an asynchronous read of a frame pinned by the caller to finish, and reads the page again
+     * if that read failed.
+     */
+    void waitForRead(BufPartition& part, File* file, const PageId pageNo, const FrameId frameNo,
+                     FileMetrics& metrics);
+
+    /**
+     * Starts an asynchronous read of a page that is not in the buffer pool.
+     *
+     * @param file        File object
+     * @param pageNo      Page number in the file to be read
+     * @param referenced  False lets the policy evict the frame first if the page is never used
+     * @param hint        How the page will be read
+     * @throws BufferExceededException If no frame is free
+     */
+    void startRead(File* file, const PageId pageNo, const bool referenced, const AccessHint hint);
+
+    /**
+     * Returns the partition responsible for (file, pageNo).
+     */
+    BufPartition& partitionOf(const File* file, const PageId pageNo);
+
+    /**
+     * Returns true if frame points at one of the frames of part.
+     */
+    bool ownsFrame(const BufPartition& part, const Page* frame) const;
+
+    /**
+     * Allocate a free frame from a partition: an empty frame if there is one, otherwise the victim of the
+     * replacement policy, written back first if dirty. Scans reuse the frames of the scan ring once it is
+     * full. The partition lock must be held.
      *
+     * @param part    	Partition to allocate from
      * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+     * @param hint      How the page that will be put in the frame is accessed
      * @throws BufferExceededException If no such buffer is found which can be allocated
      */
-    void allocBuf(FrameId& frame);
+    void allocBuf(BufPartition& part, FrameId& frame, const AccessHint hint);
+
+    /**
+     * Hands a frame that has just been Set to the replacement policy, unless it is in the scan ring.
+     */
+    void admitFrame(BufPartition& part, const FrameId frame, const bool referenced);
+
+    /**
+     * Records a hit on a frame. A normal access takes a frame out of the scan ring and gives it to the policy.
+     */
+    void touchFrame(BufPartition& part, const FrameId frame, const AccessHint hint);
+
+    /**
+     * Empties a frame whose page has been dropped from the hash table and returns it to the free frames.
+     */
+    void releaseFrame(BufPartition& part, const FrameId frame);
+
+    /**
+     * Returns the frames of a file in a partition, entering the file if it has none there yet.
+     */
+    FileFrames& framesOf(BufPartition& part, const File* file);
+
+    /**
+     * Enters a frame that has just been Set in the hash table and the frames of its file.
+     */
+    void mapFrame(BufPartition& part, const FrameId frame);
+
+    /**
+     * Removes a valid frame from the hash table and the frames of its file.
+     */
+    void unmapFrame(BufPartition& part, const FrameId frame);
+
+    /**
+     * Sets the dirty flag of a mapped frame and keeps the dirty frames of its file up to date.
+     */
+    void setDirty(BufPartition& part, const FrameId frame, const bool dirty);
+
+    /**
+     * Flushes the write-ahead log of a frame's page up to the page's LSN, before the page is written back.
+     */
+    static void forceLog(const BufDesc& desc) {
+        if (desc.log != NULL) desc.log->flush(desc.lsn);
+    }
+
+    /**
+     * Writes out the given dirty frames in file and page number order and marks them clean. The partition
+     * locks of all of the frames must be held.
+     */
+    void writeFrames(std::vector<FrameId>& frames);
 
    public:
     /**
@@ -197,8 +572,19 @@ class BufMgr {
 
     /**
      * Constructor of BufMgr class
+     *
+     * With one partition the buffer manager behaves as a single clock over all frames. With more, the frames
+     * are split evenly between partitions, each page is assigned to one by hashing, and threads may call into
+     * the buffer manager concurrently; a partition that runs out of unpinned frames throws
+     * BufferExceededException even if other partitions have room.
+     *
+     * @param bufs        Number of frames in the buffer pool
+     * @param partitions  Number of partitions, at least one and at most bufs
+     * @param policy      Replacement policy of every partition
+     * @param memory      Layout of the memory holding the frames
      */
-    BufMgr(std::uint32_t bufs);
+    BufMgr(std::uint32_t bufs, std::uint32_t partitions = 1, const ReplacementPolicyKind policy = POLICY_CLOCK,
+           const ArenaOptions& memory = ArenaOptions());
 
     /**
      * Destructor of BufMgr class
@@ -213,8 +599,9 @@ class BufMgr {
      * @param file   	File object
      * @param PageNo  Page number in the file to be read
      * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+     * @param hint    ACCESS_SCAN for pages a sequential scan reads once, so they do not displace the rest of the pool
      */
-    void readPage(File* file, const PageId PageNo, Page*& page);
+    void readPage(File* file, const PageId PageNo, Page*& page, const AccessHint hint = ACCESS_NORMAL);
 
     /**
      * Unpin a page from memory since it is no longer required for it to remain in memory.
@@ -223,9 +610,36 @@ class BufMgr {
      * @param PageNo  Page number
      * @param dirty		True if the page to be unpinned needs to be marked dirty
      * @throws  PageNotPinnedException If the page is not already pinned
+     * @throws  HashNotFoundException If the page is not in the buffer pool
      */
     void unPinPage(File* file, const PageId PageNo, const bool dirty);
 
+    /**
+     * Pins a page through the frame it was last found in, without looking it up in the hash table. Callers
+     * remember the frames of pages they return to often and check here that a frame still holds the page;
+     * there is nothing to undo when the page is evicted, the frame just stops matching it.
+     *
+     * @param file   	File object
+     * @param PageNo  Page number
+     * @param frame   Frame the page was returned in by an earlier readPage or allocPage
+     * @return  True if the frame still holds the page, which is now pinned and touched as readPage would;
+     *          false if it does not or the page is still being read, and nothing was pinned
+     */
+    bool pinFrame(File* file, const PageId PageNo, Page* frame);
+
+    /**
+     * Unpins a page through the frame it is pinned in, without looking it up in the hash table. Falls back to
+     * unPinPage if the frame does not hold the page.
+     *
+     * @param file   	File object
+     * @param PageNo  Page number
+     * @param frame   Frame the page is pinned in
+     * @param dirty		True if the page to be unpinned needs to be marked dirty
+     * @throws  PageNotPinnedException If the page is not already pinned
+     * @throws  HashNotFoundException If the page is not in the buffer pool
+     */
+    void unPinFrame(File* file, const PageId PageNo, Page* frame, const bool dirty);
+
     /**
      * Allocates a new, empty page in the file and returns the Page object.
      * The newly allocated page is also assigned a frame in the buffer pool.
@@ -233,11 +647,15 @@ class BufMgr {
      * @param file   	File object
      * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
      * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+     * @param append  True to allocate the page with File::appendPageInto, at the end of the file, rather than
+     *                reusing a free page
+     * @throws BufferExceededException If no frame is free; the page stays allocated in the file
      */
-    void allocPage(File* file, PageId& PageNo, Page*& page);
+    void allocPage(File* file, PageId& PageNo, Page*& page, const bool append = false);
 
     /**
-     * Writes out all dirty pages of the file to disk.
+     * Waits for asynchronous I/O, writes out all dirty pages of the file, and then its cached header, and syncs
+     * the file so that they all reach it.
      * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
      * Otherwise Error returned.
      *
@@ -247,33 +665,245 @@ class BufMgr {
      */
     void flushFile(const File* file);
 
+    /**
+     * Starts reading a page into the buffer pool without waiting for it. The frame is not left pinned; a later
+     * readPage of the page pins it and waits for the read if it is still in flight. Does nothing if the page
+     * is already in the buffer pool.
+     *
+     * @param file   	File object
+     * @param PageNo  Page number in the file to be read
+     * @throws BufferExceededException If no frame is free
+     */
+    void readPageAsync(File* file, const PageId PageNo);
+
+    /**
+     * Hints that a page will be read soon. Like readPageAsync, but the frame enters the clock unreferenced, so
+     * a prefetched page that is never read is the first to be evicted, and no frame is taken if none is free.
+     *
+     * @param file   	File object
+     * @param PageNo  Page number in the file to be read
+     * @param hint    How the page will be read
+     */
+    void prefetch(File* file, const PageId PageNo, const AccessHint hint = ACCESS_NORMAL);
+
+    /**
+     * Prefetches count consecutive pages starting at firstPageNo.
+     *
+     * @param file   	    File object
+     * @param firstPageNo  First page number to prefetch
+     * @param count        Number of pages
+     * @param hint         How the pages will be read
+     */
+    void prefetchRange(File* file, const PageId firstPageNo, const std::uint32_t count,
+                       const AccessHint hint = ACCESS_NORMAL);
+
+    /**
+     * Starts writing a dirty page of the buffer pool back to its file without waiting for it. Does nothing if
+     * the page is not in the buffer pool, not dirty, or already being written. The page stays in the pool
+     * and is marked dirty again if the write fails.
+     *
+     * @param file   	File object
+     * @param PageNo  Page number
+     */
+    void writePageAsync(File* file, const PageId PageNo);
+
+    /**
+     * Waits until every asynchronous read and write started so far has completed.
+     */
+    void waitForIO();
+
+    /**
+     * Starts a thread that keeps writing back the dirty frames that are about to be evicted, so that misses
+     * find clean victims and do not wait for a write. Does nothing if it is already running.
+     *
+     * @param intervalMs  Milliseconds between batches
+     * @param batchSize   Largest number of frames cleaned per partition and batch
+     */
+    void startBackgroundWriter(const std::uint32_t intervalMs = 10, const std::uint32_t batchSize = 32);
+
+    /**
+     * Stops the background writer, waiting for its current batch. The destructor calls it.
+     */
+    void stopBackgroundWriter();
+
     /**
      * Delete page from file and also from buffer pool if present.
      * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
      *
      * @param file   	File object
      * @param PageNo  Page number
+     * @throws  PagePinnedException If the page is pinned in the buffer pool
      */
     void disposePage(File* file, const PageId PageNo);
 
+    /**
+     * Takes frames out of the buffer pool to serve as working memory, such as the buffers of an external sort,
+     * so that such memory comes out of the pool's budget instead of adding to it. The frames are taken from
+     * the partitions in turn, evicting pages, written back first if dirty, where no frame is empty. They hold
+     * no page and are not handed out again until released.
+     *
+     * @param count   Number of frames
+     * @param frames  The frames are appended here
+     * @throws BufferExceededException If fewer than count frames can be freed; none are taken then
+     */
+    void reserveFrames(const std::uint32_t count, std::vector<Page*>& frames);
+
+    /**
+     * Returns frames taken with reserveFrames to the buffer pool and clears frames.
+     *
+     * @param frames  Frames to return
+     */
+    void releaseFrames(std::vector<Page*>& frames);
+
+    /**
+     * Latches the contents of a pinned page. Pins only keep a page in the pool; threads that read a page
+     * another thread may modify take a shared latch, and writers an exclusive one.
+     *
+     * @param page  	Page returned by readPage or allocPage and still pinned
+     * @param exclusive True for an exclusive latch, false for a shared one
+     */
+    void latchPage(const Page* page, const bool exclusive) {
+        BufDesc& desc = bufDescTable[page - bufPool];
+        if (exclusive) {
+            desc.latch.lockExclusive();
+            // an optimistic reader that started before the change sees the odd version once it validates
+            desc.version.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        } else {
+            desc.latch.lockShared();
+        }
+    }
+
+    /**
+     * Releases a latch taken with latchPage.
+     *
+     * @param page  	Latched page
+     * @param exclusive Mode the latch was taken in
+     */
+    void unlatchPage(const Page* page, const bool exclusive) {
+        BufDesc& desc = bufDescTable[page - bufPool];
+        if (exclusive) {
+            desc.version.fetch_add(1, std::memory_order_release);
+            desc.latch.unlockExclusive();
+        } else {
+            desc.latch.unlockShared();
+        }
+    }
+
+    /**
+     * Records that changes made to a pinned page were appended to a write-ahead log. The log is flushed up
+     * to lsn before the page is next written back, so the page never reaches the disk ahead of its changes.
+     * Set while the page is still latched exclusively by the change, and only ever moved forward.
+     *
+     * @param page  	Page returned by readPage or allocPage and still pinned
+     * @param log   	Log the changes were appended to
+     * @param lsn   	LSN returned by LogManager::append
+     */
+    void setPageLsn(const Page* page, LogManager* log, const Lsn lsn) {
+        BufDesc& desc = bufDescTable[page - bufPool];
+        desc.log = log;
+        if (lsn > desc.lsn) desc.lsn = lsn;
+    }
+
+    /**
+     * Records that a pinned page, latched exclusively, holds a change logged at or after first, unless it holds
+     * an older one the disk has not seen yet. Called before the change's group is appended, so a checkpoint that
+     * reads the end of the log after the group finds the page in dirtyPageTable.
+     *
+     * @param page  	Page returned by readPage or allocPage and still pinned
+     * @param first 	LogManager::end before the group is appended
+     */
+    void logChange(const Page* page, const Lsn first) {
+        Lsn clean = 0;
+        bufDescTable[page - bufPool].recLsn.compare_exchange_strong(clean, first);
+    }
+
+    /**
+     * Collects the pages of a file whose frames hold logged changes not yet on disk, for a fuzzy checkpoint: the
+     * log has to be replayed from the oldest of their LSNs. Each partition is locked only while it is looked at,
+     * and nothing waits for a pin or latch.
+     *
+     * @param file   	File object
+     * @param pages  	Receives the pages
+     */
+    void dirtyPageTable(const File* file, std::vector<DirtyPage>& pages);
+
+    /**
+     * Asks the background writer to write back the pages of a file holding changes logged before an LSN, pinned
+     * pages included, a batch at a time. Pages are written under a shared latch, so nothing is stopped for
+     * them. Only the last LSN asked for per file counts.
+     *
+     * @param file   	File object
+     * @param below  	Changes logged before it are written back
+     */
+    void trickle(const File* file, const Lsn below);
+
+    /**
+     * Starts an optimistic read of a page in the frame it was last found in. The page is neither pinned nor
+     * latched: the caller reads it as it is, bounding whatever it reads by the page, and then calls
+     * validateVersion, which fails if the frame was latched exclusively or given to another page in between.
+     * Frames read this way are not touched, so the replacement policy does not see the reads.
+     *
+     * @param file   	File object
+     * @param PageNo  Page number
+     * @param frame   Frame the page was returned in by an earlier readPage or allocPage
+     * @param version Returns the version to validate against
+     * @return  True if the frame holds the page and may be read; false if it does not, is latched
+     *          exclusively or is still being read
+     */
+    bool readVersion(const File* file, const PageId PageNo, const Page* frame, std::uint32_t& version) const;
+
+    /**
+     * Ends an optimistic read started with readVersion.
+     *
+     * @param frame   Frame read
+     * @param version Version readVersion returned
+     * @return  True if the frame did not change since readVersion, so everything read from it in between is
+     *          consistent
+     */
+    bool validateVersion(const Page* frame, const std::uint32_t version) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return bufDescTable[frame - bufPool].version.load(std::memory_order_relaxed) == version;
+    }
+
     /**
      * Print member variable values.
      */
     void printSelf();
 
     /**
-     * Get buffer pool usage statistics
+     * Get buffer pool usage statistics, summed over all partitions
      */
-    BufStats& getBufStats() {
-        return bufStats;
-    }
+    BufStats& getBufStats();
 
     /**
      * Clear buffer pool usage statistics
      */
-    void clearBufStats() {
-        bufStats.clear();
-    }
+    void clearBufStats();
+
+    /**
+     * Takes a snapshot of the metrics of the pool, per file and in total, while the pool keeps running: each
+     * partition is locked only long enough to read its counters, which are updated with relaxed atomics, so a
+     * snapshot taken under load may be off by the operations in flight.
+     *
+     * @param out   Returns the snapshot
+     */
+    void metrics(BufMetricsSnapshot& out);
+
+    /**
+     * Sets every metric to zero and forgets the files retired so far.
+     */
+    void clearMetrics();
+
+    /**
+     * Returns the kind of pages the frames actually got, which may be less than requested.
+     */
+    HugePageMode hugePages() const { return arena->hugePages(); }
+
+    /**
+     * Returns the number of frames in the buffer pool.
+     */
+    std::uint32_t frames() const { return numBufs; }
 };
 
 }  // namespace badgerdb
@@ -0,0 +1,195 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "buffer_metrics.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace badgerdb {
+
+void HistogramSnapshot::clear() {
+    for (int i = 0; i < BUCKETS; i++) counts[i] = 0;
+    count = sum = 0;
+}
+
+void HistogramSnapshot::add(const HistogramSnapshot& other) {
+    for (int i = 0; i < BUCKETS; i++) counts[i] += other.counts[i];
+    count += other.count;
+    sum += other.sum;
+}
+
+std::uint64_t HistogramSnapshot::percentile(const double fraction) const {
+    if (count == 0) return 0;
+    const std::uint64_t rank = std::max<std::uint64_t>(1, (std::uint64_t)std::ceil(fraction * count));
+    std::uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) return i == 0 ? 0 : i == 64 ? ~0ULL : (1ULL << i) - 1;
+    }
+    return ~0ULL;
+}
+
+void MetricHistogram::addTo(HistogramSnapshot& out) const {
+    for (int i = 0; i < HistogramSnapshot::BUCKETS; i++) {
+        const std::uint64_t n = buckets[i].load(std::memory_order_relaxed);
+        out.counts[i] += n;
+        out.count += n;
+    }
+    out.sum += sum.load(std::memory_order_relaxed);
+}
+
+void MetricHistogram::clear() {
+    for (int i = 0; i < HistogramSnapshot::BUCKETS; i++) buckets[i].store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+}
+
+void FileMetricsSnapshot::clear() {
+    hits = misses = prefetches = evictions = dirtyWritebacks = writes = pinWaits = 0;
+    readNanos.clear();
+    writeNanos.clear();
+    pinWaitNanos.clear();
+}
+
+void FileMetricsSnapshot::add(const FileMetricsSnapshot& other) {
+    hits += other.hits;
+    misses += other.misses;
+    prefetches += other.prefetches;
+    evictions += other.evictions;
+    dirtyWritebacks += other.dirtyWritebacks;
+    writes += other.writes;
+    pinWaits += other.pinWaits;
+    readNanos.add(other.readNanos);
+    writeNanos.add(other.writeNanos);
+    pinWaitNanos.add(other.pinWaitNanos);
+}
+
+void FileMetrics::addTo(FileMetricsSnapshot& out) const {
+    out.hits += hits.load(std::memory_order_relaxed);
+    out.misses += misses.load(std::memory_order_relaxed);
+    out.prefetches += prefetches.load(std::memory_order_relaxed);
+    out.evictions += evictions.load(std::memory_order_relaxed);
+    out.dirtyWritebacks += dirtyWritebacks.load(std::memory_order_relaxed);
+    out.writes += writes.load(std::memory_order_relaxed);
+    out.pinWaits += pinWaits.load(std::memory_order_relaxed);
+    readNanos.addTo(out.readNanos);
+    writeNanos.addTo(out.writeNanos);
+    pinWaitNanos.addTo(out.pinWaitNanos);
+}
+
+void FileMetrics::clear() {
+    hits = misses = prefetches = evictions = dirtyWritebacks = writes = pinWaits = 0;
+    readNanos.clear();
+    writeNanos.clear();
+    pinWaitNanos.clear();
+}
+
+/**
+ * Writes a string as a JSON string; file names need no more escaping than quotes and backslashes.
+ */
+static void writeQuoted(std::ostream& out, const std::string& text) {
+    out << '"';
+    for (std::size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '"' || text[i] == '\\') out << '\\';
+        out << text[i];
+    }
+    out << '"';
+}
+
+static void writeHistogramJson(std::ostream& out, const HistogramSnapshot& h) {
+    out << "{\"count\": " << h.count << ", \"mean\": " << h.mean() << ", \"p50\": " << h.percentile(0.5)
+        << ", \"p99\": " << h.percentile(0.99) << ", \"p999\": " << h.percentile(0.999) << "}";
+}
+
+static void writeFileJson(std::ostream& out, const FileMetricsSnapshot& m) {
+    out << "{\"hits\": " << m.hits << ", \"misses\": " << m.misses << ", \"hit_ratio\": " << m.hitRatio()
+        << ", \"prefetches\": " << m.prefetches << ", \"evictions\": " << m.evictions
+        << ", \"dirty_writebacks\": " << m.dirtyWritebacks << ", \"writes\": " << m.writes
+        << ", \"pin_waits\": " << m.pinWaits << ", \"read_ns\": ";
+    writeHistogramJson(out, m.readNanos);
+    out << ", \"write_ns\": ";
+    writeHistogramJson(out, m.writeNanos);
+    out << ", \"pin_wait_ns\": ";
+    writeHistogramJson(out, m.pinWaitNanos);
+    out << "}";
+}
+
+void BufMetricsSnapshot::writeJson(std::ostream& out) const {
+    out << "{\"total\": ";
+    writeFileJson(out, total);
+    out << ", \"sweep_length\": ";
+    writeHistogramJson(out, sweepLength);
+    out << ", \"files\": {";
+    for (std::size_t i = 0; i < files.size(); i++) {
+        if (i > 0) out << ", ";
+        writeQuoted(out, files[i].filename);
+        out << ": ";
+        writeFileJson(out, files[i]);
+    }
+    out << "}}" << std::endl;
+}
+
+/**
+ * Writes one histogram family of latencies in nanoseconds as Prometheus histograms in seconds, one per file.
+ */
+static void writePrometheusHistogram(std::ostream& out, const std::string& name,
+                                     const std::vector<FileMetricsSnapshot>& files,
+                                     HistogramSnapshot FileMetricsSnapshot::*member) {
+    out << "# TYPE " << name << " histogram\n";
+    for (std::size_t f = 0; f < files.size(); f++) {
+        const HistogramSnapshot& h = files[f].*member;
+        std::uint64_t cumulative = 0;
+        for (int i = 0; i < HistogramSnapshot::BUCKETS - 1; i++) {
+            cumulative += h.counts[i];
+            // empty buckets past the last value add nothing the +Inf bucket does not say
+            if (cumulative == h.count && h.counts[i] == 0) continue;
+            out << name << "_bucket{file=";
+            writeQuoted(out, files[f].filename);
+            out << ",le=\"" << (i == 0 ? 0.0 : ((1ULL << i) - 1) / 1e9) << "\"} " << cumulative << "\n";
+        }
+        out << name << "_bucket{file=";
+        writeQuoted(out, files[f].filename);
+        out << ",le=\"+Inf\"} " << h.count << "\n";
+        out << name << "_sum{file=";
+        writeQuoted(out, files[f].filename);
+        out << "} " << h.sum / 1e9 << "\n";
+        out << name << "_count{file=";
+        writeQuoted(out, files[f].filename);
+        out << "} " << h.count << "\n";
+    }
+}
+
+void BufMetricsSnapshot::writePrometheus(std::ostream& out) const {
+    struct Counter {
+        const char* name;
+        std::uint64_t FileMetricsSnapshot::*member;
+    };
+    const Counter counters[] = {{"badgerdb_buffer_hits_total", &FileMetricsSnapshot::hits},
+                                {"badgerdb_buffer_misses_total", &FileMetricsSnapshot::misses},
+                                {"badgerdb_buffer_prefetches_total", &FileMetricsSnapshot::prefetches},
+                                {"badgerdb_buffer_evictions_total", &FileMetricsSnapshot::evictions},
+                                {"badgerdb_buffer_dirty_writebacks_total", &FileMetricsSnapshot::dirtyWritebacks},
+                                {"badgerdb_buffer_writes_total", &FileMetricsSnapshot::writes},
+                                {"badgerdb_buffer_pin_waits_total", &FileMetricsSnapshot::pinWaits}};
+    for (std::size_t c = 0; c < sizeof(counters) / sizeof(counters[0]); c++) {
+        out << "# TYPE " << counters[c].name << " counter\n";
+        for (std::size_t f = 0; f < files.size(); f++) {
+            out << counters[c].name << "{file=";
+            writeQuoted(out, files[f].filename);
+            out << "} " << files[f].*counters[c].member << "\n";
+        }
+    }
+    writePrometheusHistogram(out, "badgerdb_buffer_read_seconds", files, &FileMetricsSnapshot::readNanos);
+    writePrometheusHistogram(out, "badgerdb_buffer_write_seconds", files, &FileMetricsSnapshot::writeNanos);
+    writePrometheusHistogram(out, "badgerdb_buffer_pin_wait_seconds", files, &FileMetricsSnapshot::pinWaitNanos);
+    out << "# TYPE badgerdb_buffer_sweep_length summary\n";
+    out << "badgerdb_buffer_sweep_length_sum " << sweepLength.sum << "\n";
+    out << "badgerdb_buffer_sweep_length_count " << sweepLength.count << "\n";
+    out.flush();
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,256 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace badgerdb {
+
+/**
+ * @brief Plain copy of a MetricHistogram, taken by BufMgr::metrics.
+ *
+ * Bucket 0 counts the values 0, bucket i > 0 the values in [2^(i-1), 2^i).
+ */
+struct HistogramSnapshot {
+    /**
+     * Number of buckets, enough for any 64-bit value
+     */
+    static const int BUCKETS = 65;
+
+    /**
+     * Values counted in each bucket
+     */
+    std::uint64_t counts[BUCKETS];
+
+    /**
+     * Number of values counted
+     */
+    std::uint64_t count;
+
+    /**
+     * Sum of the values counted, so the mean is exact
+     */
+    std::uint64_t sum;
+
+    HistogramSnapshot() { clear(); }
+
+    void clear();
+
+    /**
+     * Adds the counts of another snapshot.
+     */
+    void add(const HistogramSnapshot& other);
+
+    /**
+     * @return  Mean of the values counted, 0 if there are none
+     */
+    double mean() const { return count == 0 ? 0 : (double)sum / count; }
+
+    /**
+     * @param fraction  Fraction [0, 1] of the values at most as large as the value returned
+     * @return          Upper bound of the bucket that fraction ends in, so at most twice the true percentile;
+     *                  0 if nothing was counted
+     */
+    std::uint64_t percentile(const double fraction) const;
+};
+
+/**
+ * @brief Histogram with one bucket per power of two, updated with relaxed atomics.
+ *
+ * Recording is two relaxed increments, so it can be done from any thread, with or without a partition lock, and
+ * read by a snapshot while it is.
+ */
+class MetricHistogram {
+   public:
+    MetricHistogram() { clear(); }
+
+    /**
+     * Counts one value.
+     */
+    void record(const std::uint64_t value) {
+        const int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    /**
+     * Adds the counts to a snapshot. Values recorded meanwhile may or may not be in it.
+     */
+    void addTo(HistogramSnapshot& out) const;
+
+    void clear();
+
+   private:
+    std::atomic<std::uint64_t> buckets[HistogramSnapshot::BUCKETS];
+    std::atomic<std::uint64_t> sum;
+};
+
+/**
+ * @brief Plain copy of the counters of one file, or of the whole pool, taken by BufMgr::metrics.
+ */
+struct FileMetricsSnapshot {
+    /**
+     * Name of the file; empty for the totals of the pool
+     */
+    std::string filename;
+
+    /**
+     * Pins of a page found in the pool, by readPage or pinFrame
+     */
+    std::uint64_t hits;
+
+    /**
+     * Pins of a page readPage had to read from disk
+     */
+    std::uint64_t misses;
+
+    /**
+     * Pages read ahead by readPageAsync and prefetch
+     */
+    std::uint64_t prefetches;
+
+    /**
+     * Pages of the file evicted from the pool to make room for another
+     */
+    std::uint64_t evictions;
+
+    /**
+     * Evictions that had to write the page back first
+     */
+    std::uint64_t dirtyWritebacks;
+
+    /**
+     * Pages written back for any reason: eviction, flushFile, writePageAsync or the background writer
+     */
+    std::uint64_t writes;
+
+    /**
+     * Pins that waited, for the partition lock or for a read already in flight
+     */
+    std::uint64_t pinWaits;
+
+    /**
+     * Latency of each page read, in nanoseconds, from the request to the page being in its frame
+     */
+    HistogramSnapshot readNanos;
+
+    /**
+     * Latency of each page write, in nanoseconds
+     */
+    HistogramSnapshot writeNanos;
+
+    /**
+     * Time each waiting pin waited, in nanoseconds
+     */
+    HistogramSnapshot pinWaitNanos;
+
+    FileMetricsSnapshot() { clear(); }
+
+    void clear();
+
+    /**
+     * Adds the counters of another snapshot, keeping this one's name.
+     */
+    void add(const FileMetricsSnapshot& other);
+
+    /**
+     * @return  Fraction of the pins that were hits, 0 without pins
+     */
+    double hitRatio() const { return hits + misses == 0 ? 0 : (double)hits / (hits + misses); }
+};
+
+/**
+ * @brief Counters of the buffer pool's work on the pages of one file, updated with relaxed atomics.
+ *
+ * The pool keeps one per file and partition; BufMgr::metrics adds them up.
+ */
+struct FileMetrics {
+    /**
+     * Name of the file, taken when its first page was counted
+     */
+    std::string filename;
+
+    std::atomic<std::uint64_t> hits;
+    std::atomic<std::uint64_t> misses;
+    std::atomic<std::uint64_t> prefetches;
+    std::atomic<std::uint64_t> evictions;
+    std::atomic<std::uint64_t> dirtyWritebacks;
+    std::atomic<std::uint64_t> writes;
+    std::atomic<std::uint64_t> pinWaits;
+    MetricHistogram readNanos;
+    MetricHistogram writeNanos;
+    MetricHistogram pinWaitNanos;
+
+    explicit FileMetrics(const std::string& filename) : filename(filename) { clear(); }
+
+    /**
+     * Adds one to a counter.
+     */
+    static void bump(std::atomic<std::uint64_t>& counter) { counter.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * Counts a page write and its latency.
+     */
+    void wrote(const std::uint64_t nanos) {
+        bump(writes);
+        writeNanos.record(nanos);
+    }
+
+    /**
+     * Counts a pin that waited.
+     */
+    void waited(const std::uint64_t nanos) {
+        bump(pinWaits);
+        pinWaitNanos.record(nanos);
+    }
+
+    /**
+     * Adds the counters to a snapshot.
+     */
+    void addTo(FileMetricsSnapshot& out) const;
+
+    void clear();
+};
+
+/**
+ * @brief Snapshot of the metrics of a buffer pool, from BufMgr::metrics.
+ */
+struct BufMetricsSnapshot {
+    /**
+     * Counters of every file added up
+     */
+    FileMetricsSnapshot total;
+
+    /**
+     * Counters of each file the pool has worked on since the metrics were last cleared, by name, in name order.
+     * Files of the same name, opened one after the other, share their counters.
+     */
+    std::vector<FileMetricsSnapshot> files;
+
+    /**
+     * Number of frames the replacement policy stepped over to find each victim
+     */
+    HistogramSnapshot sweepLength;
+
+    /**
+     * Writes the snapshot as one JSON object.
+     */
+    void writeJson(std::ostream& out) const;
+
+    /**
+     * Writes the snapshot in the Prometheus text exposition format, one badgerdb_buffer_* metric family per
+     * counter with a file label, and the latencies as histograms in seconds.
+     */
+    void writePrometheus(std::ostream& out) const;
+};
+
+}  // namespace badgerdb
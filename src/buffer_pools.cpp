@@ -0,0 +1,87 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "buffer_pools.h"
+
+#include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/no_such_pool_exception.h"
+#include "exceptions/pool_exists_exception.h"
+
+namespace badgerdb {
+
+BufPoolRegistry::~BufPoolRegistry() {
+    for (std::map<std::string, Pool>::iterator iter = pools.begin(); iter != pools.end(); ++iter)
+        iter->second.bufMgr->releaseFrames(iter->second.reserved);
+}
+
+BufMgr* BufPoolRegistry::createPool(const std::string& name, const std::uint32_t frames,
+                                    const std::uint32_t capacity, const std::uint32_t partitions,
+                                    const ReplacementPolicyKind policy, const ArenaOptions& memory) {
+    const std::uint32_t most = capacity == 0 ? frames : capacity;
+    if (frames == 0 || frames > most) throw BufferExceededException();
+    std::lock_guard<std::mutex> guard(lock);
+    if (pools.count(name) > 0) throw PoolExistsException(name);
+
+    std::unique_ptr<BufMgr> bufMgr(new BufMgr(most, partitions, policy, memory));
+    // the frames past the starting size are held back until the pool grows into them
+    std::vector<Page*> reserved;
+    if (most > frames) bufMgr->reserveFrames(most - frames, reserved);
+    Pool& pool = pools[name];
+    pool.bufMgr.swap(bufMgr);
+    pool.reserved.swap(reserved);
+    if (defaultPool.empty()) defaultPool = name;
+    return pool.bufMgr.get();
+}
+
+const BufPoolRegistry::Pool& BufPoolRegistry::find(const std::string& name) const {
+    std::map<std::string, Pool>::const_iterator iter = pools.find(name);
+    if (iter == pools.end()) throw NoSuchPoolException(name);
+    return iter->second;
+}
+
+BufMgr* BufPoolRegistry::pool(const std::string& name) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return find(name).bufMgr.get();
+}
+
+void BufPoolRegistry::assign(const std::string& filename, const std::string& name) {
+    std::lock_guard<std::mutex> guard(lock);
+    find(name);
+    assignments[filename] = name;
+}
+
+BufMgr* BufPoolRegistry::poolFor(const std::string& filename) const {
+    std::lock_guard<std::mutex> guard(lock);
+    std::unordered_map<std::string, std::string>::const_iterator iter = assignments.find(filename);
+    return find(iter == assignments.end() ? defaultPool : iter->second).bufMgr.get();
+}
+
+void BufPoolRegistry::resize(const std::string& name, const std::uint32_t frames) {
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<std::string, Pool>::iterator iter = pools.find(name);
+    if (iter == pools.end()) throw NoSuchPoolException(name);
+    Pool& pool = iter->second;
+    const std::uint32_t capacity = pool.bufMgr->frames();
+    if (frames == 0 || frames > capacity) throw BufferExceededException();
+    const std::uint32_t current = capacity - pool.reserved.size();
+    if (frames < current) {
+        // takes none if it cannot take them all
+        pool.bufMgr->reserveFrames(current - frames, pool.reserved);
+    } else if (frames > current) {
+        std::vector<Page*> returned(pool.reserved.end() - (frames - current), pool.reserved.end());
+        pool.reserved.resize(pool.reserved.size() - returned.size());
+        pool.bufMgr->releaseFrames(returned);
+    }
+}
+
+std::uint32_t BufPoolRegistry::size(const std::string& name) const {
+    std::lock_guard<std::mutex> guard(lock);
+    const Pool& pool = find(name);
+    return pool.bufMgr->frames() - pool.reserved.size();
+}
+
+}  // namespace badgerdb
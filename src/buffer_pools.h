@@ -0,0 +1,153 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "buffer.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Named buffer pools, each a BufMgr with its own frames and replacement policy, and the pool each file
+ * is assigned to, so that hot indexes and cold scans sharing a process do not evict each other's pages.
+ *
+ * A pool is created with the most frames it may ever have. Its arena is only backed by memory once frames are
+ * used, and resize shrinks or grows the pool online within that capacity by taking frames out of circulation
+ * with BufMgr::reserveFrames and handing them back with releaseFrames. Files are assigned by name, so that a
+ * file may be given a pool before it is opened, as BTreeIndex opens its own; files assigned to no pool use the
+ * first pool created. Callers pass the BufMgr poolFor returns wherever one is taken. All methods may be called
+ * from several threads at once.
+ */
+class BufPoolRegistry {
+   public:
+    BufPoolRegistry() {}
+
+    /**
+     * Destructor, which releases the frames taken out by resize and destroys every pool. No pool may be in use.
+     */
+    ~BufPoolRegistry();
+
+    /**
+     * Creates a pool.
+     *
+     * @param name        Name of the pool
+     * @param frames      Number of frames the pool starts with
+     * @param capacity    Most frames resize may grow the pool to, or 0 for frames
+     * @param partitions  Number of partitions of the pool, see BufMgr::BufMgr
+     * @param policy      Replacement policy of the pool
+     * @param memory      Layout of the memory holding the pool's frames
+     * @return  The pool
+     * @throws  PoolExistsException  If a pool of that name exists
+     * @throws  BufferExceededException  If frames is more than capacity
+     */
+    BufMgr* createPool(const std::string& name, const std::uint32_t frames, const std::uint32_t capacity = 0,
+                       const std::uint32_t partitions = 1, const ReplacementPolicyKind policy = POLICY_CLOCK,
+                       const ArenaOptions& memory = ArenaOptions());
+
+    /**
+     * Returns a pool.
+     *
+     * @param name  Name of the pool
+     * @throws  NoSuchPoolException  If there is no such pool
+     */
+    BufMgr* pool(const std::string& name) const;
+
+    /**
+     * Assigns a file to a pool, in place of the pool it was assigned to before. Pages the file already has in
+     * its old pool stay there until it is flushed, so files are best assigned before they are used.
+     *
+     * @param filename  Name of the file
+     * @param name      Name of the pool
+     * @throws  NoSuchPoolException  If there is no such pool
+     */
+    void assign(const std::string& filename, const std::string& name);
+
+    /**
+     * Returns the pool a file is assigned to, or the first pool created if it is assigned to none.
+     *
+     * @param filename  Name of the file
+     * @throws  NoSuchPoolException  If no pool has been created
+     */
+    BufMgr* poolFor(const std::string& filename) const;
+
+    /**
+     * Returns the pool a file is assigned to, see poolFor(const std::string&).
+     */
+    BufMgr* poolFor(const File* file) const { return poolFor(file->filename()); }
+
+    /**
+     * Resizes a pool while it is in use. Shrinking evicts unpinned pages, written back first if dirty, to free
+     * the frames it takes out.
+     *
+     * @param name    Name of the pool
+     * @param frames  Number of frames the pool is to have, at least 1 and at most its capacity
+     * @throws  NoSuchPoolException  If there is no such pool
+     * @throws  BufferExceededException  If frames is out of range or too many frames are pinned to shrink the
+     *          pool; it keeps its size then
+     */
+    void resize(const std::string& name, const std::uint32_t frames);
+
+    /**
+     * Returns the number of frames a pool has now.
+     *
+     * @param name  Name of the pool
+     * @throws  NoSuchPoolException  If there is no such pool
+     */
+    std::uint32_t size(const std::string& name) const;
+
+   private:
+    /**
+     * @brief One pool with the frames resize took out of it.
+     */
+    struct Pool {
+        std::unique_ptr<BufMgr> bufMgr;
+
+        /**
+         * Frames held back from the pool so that it has no more than the size it was given
+         */
+        std::vector<Page*> reserved;
+    };
+
+    /**
+     * Guards everything below
+     */
+    mutable std::mutex lock;
+
+    /**
+     * Every pool, by name
+     */
+    std::map<std::string, Pool> pools;
+
+    /**
+     * Name of the first pool created
+     */
+    std::string defaultPool;
+
+    /**
+     * Pool each assigned file is assigned to, by file name
+     */
+    std::unordered_map<std::string, std::string> assignments;
+
+    /**
+     * Returns a pool. The lock must be held.
+     *
+     * @throws  NoSuchPoolException  If there is no such pool
+     */
+    const Pool& find(const std::string& name) const;
+
+    BufPoolRegistry(const BufPoolRegistry&);
+    BufPoolRegistry& operator=(const BufPoolRegistry&);
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,147 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "checksum.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#include "exceptions/file_open_exception.h"
+#include "exceptions/file_write_exception.h"
+#include "exceptions/page_checksum_exception.h"
+
+namespace badgerdb {
+
+const char* const PageChecksums::SUFFIX = ".crc";
+
+/**
+ * CRC32C of every byte value, for the reflected polynomial 0x82f63b78.
+ */
+struct Crc32cTable {
+    std::uint32_t entries[256];
+
+    Crc32cTable() {
+        for (std::uint32_t i = 0; i < 256; i++) {
+            std::uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0x82f63b78u & (0u - (crc & 1)));
+            entries[i] = crc;
+        }
+    }
+};
+
+static std::uint32_t crc32cTable(std::uint32_t crc, const unsigned char* data, std::size_t length) {
+    static const Crc32cTable table;
+    for (std::size_t i = 0; i < length; i++) crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__x86_64__)
+/**
+ * CRC32C by the crc32 instruction, 8 bytes at a time; compiled for SSE4.2 whatever the build targets, and only
+ * called once the processor is known to have it.
+ */
+__attribute__((target("sse4.2"))) static std::uint32_t crc32cHardware(std::uint32_t crc, const unsigned char* data,
+                                                                       std::size_t length) {
+    std::uint64_t wide = crc;
+    for (; length >= 8; data += 8, length -= 8) {
+        std::uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = (std::uint32_t)wide;
+    for (; length > 0; data++, length--) crc = _mm_crc32_u8(crc, *data);
+    return crc;
+}
+
+static bool hasHardwareCrc32c() {
+    // static initializers may run before the runtime has looked at the processor
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+}
+
+static const bool HARDWARE_CRC32C = hasHardwareCrc32c();
+#endif
+
+std::uint32_t crc32c(const void* data, const std::size_t length, const std::uint32_t crc) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+#if defined(__x86_64__)
+    if (HARDWARE_CRC32C) return ~crc32cHardware(~crc, bytes, length);
+#endif
+    return ~crc32cTable(~crc, bytes, length);
+}
+
+PageChecksums::PageChecksums(const std::string& filename, const bool truncate, const bool writable) {
+    const std::string name = filenameOf(filename);
+    const int flags = writable ? O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0) : O_RDONLY;
+    name_ = name;
+    fd_ = ::open(name.c_str(), flags, 0644);
+    if (fd_ < 0) throw FileOpenException(name);
+
+    // a torn last slot reads as no checksum
+    struct stat info;
+    if (fstat(fd_, &info) == 0) crcs_.resize(info.st_size / sizeof(std::uint32_t));
+    char* data = reinterpret_cast<char*>(crcs_.data());
+    const std::size_t length = crcs_.size() * sizeof(std::uint32_t);
+    std::size_t done = 0;
+    while (done < length) {
+        const ssize_t n = ::pread(fd_, data + done, length - done, done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+    crcs_.resize(done / sizeof(std::uint32_t));
+}
+
+PageChecksums::~PageChecksums() {
+    ::close(fd_);
+}
+
+std::uint32_t PageChecksums::get(const PageId pageNo) const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return pageNo < crcs_.size() ? crcs_[pageNo] : 0;
+}
+
+void PageChecksums::set(const PageId pageNo, const std::uint32_t crc) {
+    write(pageNo, crc == 0 ? 0xffffffffu : crc);
+}
+
+void PageChecksums::forget(const PageId pageNo) {
+    write(pageNo, 0);
+}
+
+void PageChecksums::write(const PageId pageNo, const std::uint32_t recorded) {
+    std::lock_guard<std::mutex> guard(lock_);
+    // the slot goes to the checksum file along with the page, and only then into memory
+    ssize_t n;
+    do {
+        n = ::pwrite(fd_, &recorded, sizeof(recorded), (off_t)pageNo * sizeof(recorded));
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) throw FileWriteException(name_, errno);
+    if (n != (ssize_t)sizeof(recorded)) throw FileWriteException(name_, EIO);
+    if (pageNo >= crcs_.size()) crcs_.resize(pageNo + 1, 0);
+    crcs_[pageNo] = recorded;
+}
+
+void PageChecksums::sync() const {
+    if (::fdatasync(fd_) != 0) throw FileWriteException(name_, errno);
+}
+
+void PageChecksums::verify(const PageId pageNo, const std::uint32_t crc, const std::string& filename) const {
+    const std::uint32_t recorded = get(pageNo);
+    if (recorded == 0) return;
+    if (recorded != (crc == 0 ? 0xffffffffu : crc)) throw PageChecksumException(pageNo, filename, recorded, crc);
+}
+
+}  // namespace badgerdb
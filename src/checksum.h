@@ -0,0 +1,124 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * Computes the CRC32C (Castagnoli) checksum of length bytes, with the SSE4.2 crc32 instruction where the processor
+ * has it and a table otherwise.
+ *
+ * @param data    Bytes to checksum
+ * @param length  Number of bytes
+ * @param crc     Checksum of the bytes before these, to continue it; 0 to start a new one
+ * @return        Checksum of all the bytes so far
+ */
+std::uint32_t crc32c(const void* data, const std::size_t length, const std::uint32_t crc = 0);
+
+/**
+ * @brief Checksums of the pages of one file, kept in a file of their own next to it, 4 bytes per page by page
+ * number.
+ *
+ * A page without a checksum, because it was never written while checksums were kept or its slot lies past the
+ * end of the checksum file, reads as 0 and is not checked. A checksum that happens to be 0 is recorded as
+ * 0xffffffff, which get returns, so it still matches.
+ *
+ * The checksums are read into memory when the file is opened, so that checking a page costs no I/O. Recording
+ * one still writes its slot through to the checksum file right away, so that a crash leaves no page written
+ * before it with a stale checksum.
+ */
+class PageChecksums {
+   public:
+    /**
+     * Suffix of the checksum file's name after the name of the file it covers.
+     */
+    static const char* const SUFFIX;
+
+    /**
+     * Returns the name of the checksum file of a file.
+     */
+    static std::string filenameOf(const std::string& filename) { return filename + SUFFIX; }
+
+    /**
+     * Opens the checksum file of a file, creating it if need be.
+     *
+     * @param filename  Name of the file whose pages are checksummed
+     * @param truncate  True to drop every checksum it holds, for a file being created
+     * @param writable  False to open an existing checksum file only to check pages against it
+     * @throws  FileOpenException  If the checksum file cannot be opened
+     */
+    PageChecksums(const std::string& filename, const bool truncate, const bool writable = true);
+
+    ~PageChecksums();
+
+    /**
+     * Returns the checksum recorded for a page, 0 if none is.
+     */
+    std::uint32_t get(const PageId pageNo) const;
+
+    /**
+     * Records the checksum of a page.
+     *
+     * @throws  FileWriteException  If the checksum file cannot be written
+     */
+    void set(const PageId pageNo, const std::uint32_t crc);
+
+    /**
+     * Drops the checksum of a page, whose contents are changed in ways its checksum does not follow.
+     *
+     * @throws  FileWriteException  If the checksum file cannot be written
+     */
+    void forget(const PageId pageNo);
+
+    /**
+     * Syncs the checksums recorded so far to disk.
+     *
+     * @throws  FileWriteException  If the checksum file cannot be synced
+     */
+    void sync() const;
+
+    /**
+     * Compares a page's checksum with the one recorded for it.
+     *
+     * @throws  PageChecksumException  If a checksum is recorded and it differs
+     */
+    void verify(const PageId pageNo, const std::uint32_t crc, const std::string& filename) const;
+
+   private:
+    int fd_;
+
+    /**
+     * Name of the checksum file
+     */
+    std::string name_;
+
+    /**
+     * Guards crcs_
+     */
+    mutable std::mutex lock_;
+
+    /**
+     * Checksum of every page up to the last one recorded, by page number, as in the checksum file
+     */
+    std::vector<std::uint32_t> crcs_;
+
+    void write(const PageId pageNo, const std::uint32_t recorded);
+
+    PageChecksums(const PageChecksums&);
+    PageChecksums& operator=(const PageChecksums&);
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,294 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "compressed_pages.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "exceptions/file_open_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "page.h"
+
+namespace badgerdb {
+
+const char* const CompressedPages::SUFFIX = ".pmap";
+
+/**
+ * Bits of the compressor's hash table of recent 4-byte sequences.
+ */
+static const int LZ4_HASH_BITS = 12;
+
+/**
+ * The format ends every block with at least this many literals, and starts no match closer than MATCH_LIMIT
+ * bytes to its end.
+ */
+static const std::size_t LAST_LITERALS = 5;
+static const std::size_t MATCH_LIMIT = 12;
+
+static std::uint32_t read32(const unsigned char* p) {
+    std::uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static unsigned hash4(const std::uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+/**
+ * Writes a length past the 15 a token holds as a run of bytes of 255 and the rest.
+ */
+static unsigned char* writeLength(unsigned char* out, std::size_t length) {
+    for (; length >= 255; length -= 255) *out++ = 255;
+    *out++ = (unsigned char)length;
+    return out;
+}
+
+/**
+ * Writes one sequence: literals, then a match of matchLength bytes offset bytes back, or none if matchLength is
+ * 0, as the last sequence has.
+ *
+ * @return  False if the sequence does not fit before end
+ */
+static bool writeSequence(unsigned char*& out, const unsigned char* end, const unsigned char* literals,
+                          const std::size_t literalLength, const std::size_t offset, const std::size_t matchLength) {
+    const std::size_t matchCode = matchLength == 0 ? 0 : matchLength - 4;
+    const std::size_t worst = 1 + literalLength / 255 + 1 + literalLength + 2 + matchCode / 255 + 1;
+    if (worst > (std::size_t)(end - out)) return false;
+    unsigned char* token = out++;
+    *token = (unsigned char)(std::min<std::size_t>(literalLength, 15) << 4);
+    if (literalLength >= 15) out = writeLength(out, literalLength - 15);
+    memcpy(out, literals, literalLength);
+    out += literalLength;
+    if (matchLength == 0) return true;
+    *out++ = (unsigned char)(offset & 0xff);
+    *out++ = (unsigned char)(offset >> 8);
+    *token |= (unsigned char)std::min<std::size_t>(matchCode, 15);
+    if (matchCode >= 15) out = writeLength(out, matchCode - 15);
+    return true;
+}
+
+std::size_t lz4Compress(const char* in, const std::size_t length, char* out, const std::size_t capacity) {
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(in);
+    unsigned char* dst = reinterpret_cast<unsigned char*>(out);
+    const unsigned char* const dstEnd = dst + capacity;
+    // positions fit in 16 bits since blocks are at most 64 KB; a stale or empty slot is caught by comparing
+    std::uint16_t table[1 << LZ4_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    std::size_t anchor = 0;
+    std::size_t pos = 1;
+    while (pos + MATCH_LIMIT <= length) {
+        const std::uint32_t sequence = read32(src + pos);
+        const unsigned h = hash4(sequence);
+        std::size_t match = table[h];
+        table[h] = (std::uint16_t)pos;
+        if (match >= pos || read32(src + match) != sequence) {
+            pos++;
+            continue;
+        }
+        // grow the match back over the literals before it, then forward up to the last literals
+        while (pos > anchor && match > 0 && src[pos - 1] == src[match - 1]) {
+            pos--;
+            match--;
+        }
+        std::size_t matchEnd = pos + 4;
+        while (matchEnd < length - LAST_LITERALS && src[matchEnd] == src[match + (matchEnd - pos)]) matchEnd++;
+        if (!writeSequence(dst, dstEnd, src + anchor, pos - anchor, pos - match, matchEnd - pos)) return 0;
+        if (matchEnd + MATCH_LIMIT <= length) table[hash4(read32(src + matchEnd - 2))] = (std::uint16_t)(matchEnd - 2);
+        pos = anchor = matchEnd;
+    }
+    if (!writeSequence(dst, dstEnd, src + anchor, length - anchor, 0, 0)) return 0;
+    return dst - reinterpret_cast<unsigned char*>(out);
+}
+
+/**
+ * Reads a length past the 15 a token holds.
+ *
+ * @return  False if the block ends first
+ */
+static bool readLength(const unsigned char*& in, const unsigned char* end, std::size_t& length) {
+    unsigned char byte;
+    do {
+        if (in == end) return false;
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool lz4Decompress(const char* in, const std::size_t length, char* out, const std::size_t size) {
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(in);
+    const unsigned char* const srcEnd = src + length;
+    std::size_t op = 0;
+    while (src < srcEnd) {
+        const unsigned char token = *src++;
+        std::size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(src, srcEnd, literalLength)) return false;
+        if (literalLength > (std::size_t)(srcEnd - src) || literalLength > size - op) return false;
+        memcpy(out + op, src, literalLength);
+        src += literalLength;
+        op += literalLength;
+        if (src == srcEnd) return op == size;
+
+        if (srcEnd - src < 2) return false;
+        const std::size_t offset = src[0] | ((std::size_t)src[1] << 8);
+        src += 2;
+        std::size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(src, srcEnd, matchLength)) return false;
+        matchLength += 4;
+        if (offset == 0 || offset > op || matchLength > size - op) return false;
+        if (offset >= matchLength) {
+            memcpy(out + op, out + op - offset, matchLength);
+        } else {
+            // the match overlaps the bytes it produces, repeating the last offset bytes
+            for (std::size_t i = 0; i < matchLength; i++) out[op + i] = out[op + i - offset];
+        }
+        op += matchLength;
+    }
+    return false;
+}
+
+static bool preadFully(const int fd, char* data, const std::size_t length, const off_t offset) {
+    std::size_t done = 0;
+    while (done < length) {
+        const ssize_t n = ::pread(fd, data + done, length - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+static void pwriteFully(const int fd, const char* data, const std::size_t length, const off_t offset) {
+    std::size_t done = 0;
+    while (done < length) {
+        const ssize_t n = ::pwrite(fd, data + done, length - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+}
+
+CompressedPages::CompressedPages(const int fd, const std::string& filename, const bool truncate)
+    : fd_(fd), filename_(filename), end_(Page::SIZE) {
+    const std::string name = filenameOf(filename);
+    mapFd_ = ::open(name.c_str(), O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+    if (mapFd_ < 0) throw FileOpenException(name);
+    struct stat info;
+    if (fstat(mapFd_, &info) == 0 && info.st_size > 0) {
+        extents_.resize(info.st_size / sizeof(PageExtent));
+        if (!preadFully(mapFd_, reinterpret_cast<char*>(extents_.data()), extents_.size() * sizeof(PageExtent), 0))
+            extents_.clear();
+    }
+
+    // the space between the extents in use is free
+    std::vector<std::pair<std::uint64_t, std::uint32_t> > used;
+    for (std::size_t i = 0; i < extents_.size(); i++) {
+        if (extents_[i].length > 0) used.push_back(std::make_pair(extents_[i].offset, extents_[i].capacity));
+    }
+    std::sort(used.begin(), used.end());
+    for (std::size_t i = 0; i < used.size(); i++) {
+        if (used[i].first > end_) free_.insert(std::make_pair((std::uint32_t)(used[i].first - end_), end_));
+        end_ = std::max(end_, used[i].first + used[i].second);
+    }
+}
+
+CompressedPages::~CompressedPages() {
+    ::close(mapFd_);
+}
+
+std::uint32_t CompressedPages::compress(const char* page, char* out) {
+    // a page that would not save a whole extent unit is not worth decompressing on every read
+    const std::size_t length = lz4Compress(page, Page::SIZE, out, Page::SIZE - COMPRESSED_EXTENT_UNIT);
+    if (length > 0) return (std::uint32_t)length;
+    memcpy(out, page, Page::SIZE);
+    return Page::SIZE;
+}
+
+void CompressedPages::read(const PageId pageNo, char* page) const {
+    char stored[Page::SIZE];
+    PageExtent extent = {0, 0, 0};
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (pageNo < extents_.size()) extent = extents_[pageNo];
+        if (extent.length > 0 &&
+            !preadFully(fd_, extent.length == Page::SIZE ? page : stored, extent.length, extent.offset))
+            throw InvalidPageException(pageNo, filename_);
+    }
+    if (extent.length == 0) {
+        memset(page, 0, Page::SIZE);
+    } else if (extent.length < Page::SIZE && !lz4Decompress(stored, extent.length, page, Page::SIZE)) {
+        throw InvalidPageException(pageNo, filename_);
+    }
+}
+
+void CompressedPages::readLocked(const PageId pageNo, char* page) const {
+    const PageExtent extent = pageNo < extents_.size() ? extents_[pageNo] : PageExtent();
+    if (pageNo >= extents_.size() || extent.length == 0) {
+        memset(page, 0, Page::SIZE);
+        return;
+    }
+    char stored[Page::SIZE];
+    if (!preadFully(fd_, extent.length == Page::SIZE ? page : stored, extent.length, extent.offset) ||
+        (extent.length < Page::SIZE && !lz4Decompress(stored, extent.length, page, Page::SIZE)))
+        throw InvalidPageException(pageNo, filename_);
+}
+
+void CompressedPages::write(const PageId pageNo, const char* page) {
+    char stored[Page::SIZE];
+    const std::uint32_t length = compress(page, stored);
+    std::lock_guard<std::mutex> guard(lock_);
+    writeLocked(pageNo, stored, length);
+}
+
+void CompressedPages::update(const PageId pageNo, const std::size_t offset, const char* data,
+                             const std::size_t length) {
+    char page[Page::SIZE];
+    char stored[Page::SIZE];
+    std::lock_guard<std::mutex> guard(lock_);
+    readLocked(pageNo, page);
+    memcpy(page + offset, data, length);
+    writeLocked(pageNo, stored, compress(page, stored));
+}
+
+void CompressedPages::writeLocked(const PageId pageNo, const char* stored, const std::uint32_t length) {
+    if (pageNo >= extents_.size()) extents_.resize(pageNo + 1, PageExtent());
+    PageExtent& extent = extents_[pageNo];
+    const std::uint32_t capacity = (length + COMPRESSED_EXTENT_UNIT - 1) / COMPRESSED_EXTENT_UNIT * COMPRESSED_EXTENT_UNIT;
+    if (extent.length == 0 || extent.capacity < length) {
+        // an outgrown extent goes back to the free ones, and the page moves to the smallest that holds it
+        if (extent.length > 0) free_.insert(std::make_pair(extent.capacity, extent.offset));
+        std::multimap<std::uint32_t, std::uint64_t>::iterator fit = free_.lower_bound(capacity);
+        if (fit != free_.end()) {
+            extent.offset = fit->second;
+            if (fit->first > capacity) free_.insert(std::make_pair(fit->first - capacity, fit->second + capacity));
+            free_.erase(fit);
+        } else {
+            extent.offset = end_;
+            end_ += capacity;
+        }
+        extent.capacity = capacity;
+    }
+    extent.length = length;
+    // the page goes in before the map points at it
+    pwriteFully(fd_, stored, length, extent.offset);
+    pwriteFully(mapFd_, reinterpret_cast<const char*>(&extent), sizeof(PageExtent),
+                (off_t)pageNo * sizeof(PageExtent));
+}
+
+void CompressedPages::sync() const {
+    ::fdatasync(mapFd_);
+}
+
+}  // namespace badgerdb
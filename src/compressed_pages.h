@@ -0,0 +1,175 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * Compresses bytes into the LZ4 block format.
+ *
+ * @param in        Bytes to compress, at most 64 KB of them
+ * @param length    Number of bytes
+ * @param out       Buffer for the compressed bytes
+ * @param capacity  Size of out
+ * @return          Number of compressed bytes, or 0 if they would not fit in capacity
+ */
+std::size_t lz4Compress(const char* in, const std::size_t length, char* out, const std::size_t capacity);
+
+/**
+ * Decompresses an LZ4 block.
+ *
+ * @param in      Compressed bytes
+ * @param length  Number of compressed bytes
+ * @param out     Buffer for the decompressed bytes
+ * @param size    Number of bytes the block decompresses to
+ * @return        True if the block is well formed and decompresses to exactly size bytes
+ */
+bool lz4Decompress(const char* in, const std::size_t length, char* out, const std::size_t size);
+
+/**
+ * @brief Extent of one page of a CompressedPages file, as its page map holds it.
+ */
+struct PageExtent {
+    /**
+     * Position of the extent in the file
+     */
+    std::uint64_t offset;
+
+    /**
+     * Bytes of the page stored in the extent: the LZ4 block, or Page::SIZE for a page stored as it is because it
+     * did not compress; 0 for a page never written
+     */
+    std::uint32_t length;
+
+    /**
+     * Bytes the extent takes in the file, a multiple of COMPRESSED_EXTENT_UNIT, so that a page that compresses a
+     * little worse when it is written again still fits
+     */
+    std::uint32_t capacity;
+};
+
+/**
+ * @brief Unit extents of a CompressedPages file are sized in.
+ */
+const std::uint32_t COMPRESSED_EXTENT_UNIT = 512;
+
+/**
+ * @brief Pages of one file stored LZ4-compressed in extents of varying size, with a page map saying where each
+ * page is kept in a file of its own next to it, one PageExtent per page by page number.
+ *
+ * Page 0, the file header, stays uncompressed in the first page slot of the file; the extents follow it. A page
+ * written again goes back into its extent if it still fits and into the smallest free one that holds it
+ * otherwise, or at the end of the file. Free extents are found again when the file is opened from the gaps
+ * between those the page map holds.
+ */
+class CompressedPages {
+   public:
+    /**
+     * Suffix of the page map's name after the name of the file it covers.
+     */
+    static const char* const SUFFIX;
+
+    /**
+     * Returns the name of the page map of a file.
+     */
+    static std::string filenameOf(const std::string& filename) { return filename + SUFFIX; }
+
+    /**
+     * Opens the page map of a file, creating it if need be, and reads it.
+     *
+     * @param fd        Descriptor of the file the extents are in
+     * @param filename  Name of that file
+     * @param truncate  True to drop every page the map holds, for a file being created
+     * @throws  FileOpenException  If the page map cannot be opened
+     */
+    CompressedPages(const int fd, const std::string& filename, const bool truncate);
+
+    ~CompressedPages();
+
+    /**
+     * Reads a page. A page never written reads as zeros.
+     *
+     * @param pageNo  Number of the page, 1 or more
+     * @param page    Buffer of Page::SIZE bytes
+     * @throws  InvalidPageException  If the page's extent does not decompress to a page
+     */
+    void read(const PageId pageNo, char* page) const;
+
+    /**
+     * Writes a page.
+     *
+     * @param pageNo  Number of the page, 1 or more
+     * @param page    Page::SIZE bytes of the page
+     */
+    void write(const PageId pageNo, const char* page);
+
+    /**
+     * Replaces part of a page, reading and writing the rest of it again.
+     *
+     * @param pageNo  Number of the page
+     * @param offset  Position of the bytes in the page
+     * @param data    Bytes to write
+     * @param length  Number of bytes, at most Page::SIZE - offset
+     */
+    void update(const PageId pageNo, const std::size_t offset, const char* data, const std::size_t length);
+
+    /**
+     * Syncs the page map to disk.
+     */
+    void sync() const;
+
+   private:
+    int fd_;
+    int mapFd_;
+    std::string filename_;
+
+    /**
+     * Guards the page map, free extents and end; held while a page's extent is read or written, so that the
+     * extent is not handed to another page meanwhile.
+     */
+    mutable std::mutex lock_;
+
+    /**
+     * Extent of every page, by page number
+     */
+    std::vector<PageExtent> extents_;
+
+    /**
+     * Extents no page holds, by capacity
+     */
+    std::multimap<std::uint32_t, std::uint64_t> free_;
+
+    /**
+     * Position just past the last extent
+     */
+    std::uint64_t end_;
+
+    /**
+     * Compresses a page into out, which holds Page::SIZE bytes, or copies it there if it does not compress.
+     *
+     * @return  Number of bytes of out to store
+     */
+    static std::uint32_t compress(const char* page, char* out);
+
+    void readLocked(const PageId pageNo, char* page) const;
+    void writeLocked(const PageId pageNo, const char* stored, const std::uint32_t length);
+
+    CompressedPages(const CompressedPages&);
+    CompressedPages& operator=(const CompressedPages&);
+};
+
+}  // namespace badgerdb
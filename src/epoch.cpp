@@ -0,0 +1,115 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "epoch.h"
+
+#include <stdlib.h>
+
+#include <functional>
+#include <new>
+#include <thread>
+
+namespace badgerdb {
+
+EpochManager::EpochManager() : current(1) {
+    void* storage = NULL;
+    if (posix_memalign(&storage, CACHE_LINE_SIZE, EPOCH_SLOTS * sizeof(Slot)) != 0) throw std::bad_alloc();
+    slots = static_cast<Slot*>(storage);
+    for (int i = 0; i < EPOCH_SLOTS; i++) {
+        new (&slots[i]) Slot();
+        slots[i].epoch = 0;
+    }
+}
+
+EpochManager::~EpochManager() {
+    for (int i = 0; i < EPOCH_SLOTS; i++) slots[i].~Slot();
+    free(slots);
+}
+
+EpochTicket EpochManager::enter() {
+    return announce(current.load());
+}
+
+EpochTicket EpochManager::join(const EpochTicket& other) {
+    // the other ticket keeps its epoch's pages from being collected while this one is announced
+    return announce(other.epoch);
+}
+
+EpochTicket EpochManager::announce(const std::uint64_t epoch) {
+    // each thread starts looking at a slot of its own, so threads rarely touch each other's slots
+    static thread_local int preferred = (int)(std::hash<std::thread::id>()(std::this_thread::get_id()) % EPOCH_SLOTS);
+    EpochTicket ticket;
+    ticket.epoch = epoch;
+    for (int i = 0; i < EPOCH_SLOTS && ticket.slot < 0; i++) {
+        const int slot = (preferred + i) % EPOCH_SLOTS;
+        std::uint64_t expected = 0;
+        if (slots[slot].epoch.load(std::memory_order_relaxed) == 0 &&
+            slots[slot].epoch.compare_exchange_strong(expected, epoch))
+            ticket.slot = slot;
+    }
+    if (ticket.slot < 0) {
+        std::lock_guard<std::mutex> guard(lock);
+        overflow.insert(epoch);
+    }
+    // pairs with the fence in collect: either collect sees this reader, or this reader sees every page the
+    // retiring thread took out of the structure before retiring it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return ticket;
+}
+
+void EpochManager::exit(EpochTicket& ticket) {
+    if (ticket.epoch == 0) return;
+    if (ticket.slot >= 0) {
+        slots[ticket.slot].epoch.store(0, std::memory_order_release);
+    } else {
+        std::lock_guard<std::mutex> guard(lock);
+        overflow.erase(overflow.find(ticket.epoch));
+    }
+    ticket = EpochTicket();
+}
+
+void EpochManager::retire(const PageId pageNo) {
+    std::lock_guard<std::mutex> guard(lock);
+    retired.push_back(std::make_pair(current.fetch_add(1), pageNo));
+}
+
+std::uint64_t EpochManager::oldestReader() {
+    std::uint64_t oldest = current.load();
+    for (int i = 0; i < EPOCH_SLOTS; i++) {
+        const std::uint64_t epoch = slots[i].epoch.load(std::memory_order_acquire);
+        if (epoch != 0 && epoch < oldest) oldest = epoch;
+    }
+    if (!overflow.empty() && *overflow.begin() < oldest) oldest = *overflow.begin();
+    return oldest;
+}
+
+void EpochManager::collect(std::vector<PageId>& reclaimed) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (retired.empty()) return;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // a page retired in an epoch older than every reader's was gone before any of them entered
+    const std::uint64_t oldest = oldestReader();
+    size_t count = 0;
+    while (count < retired.size() && retired[count].first < oldest) {
+        reclaimed.push_back(retired[count].second);
+        count++;
+    }
+    retired.erase(retired.begin(), retired.begin() + count);
+}
+
+void EpochManager::drain(std::vector<PageId>& reclaimed) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (size_t i = 0; i < retired.size(); i++) reclaimed.push_back(retired[i].second);
+    retired.clear();
+}
+
+std::size_t EpochManager::pending() {
+    std::lock_guard<std::mutex> guard(lock);
+    return retired.size();
+}
+
+}  // namespace badgerdb
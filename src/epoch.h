@@ -0,0 +1,175 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "arena.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Number of reader slots of an EpochManager. Readers past them are tracked under a mutex instead.
+ */
+const int EPOCH_SLOTS = 64;
+
+/**
+ * @brief Proof that a reader is inside an epoch, returned by EpochManager::enter.
+ */
+struct EpochTicket {
+    /**
+     * Slot the epoch is announced in, or -1 if it is kept in the overflow set
+     */
+    int slot;
+
+    /**
+     * Epoch entered; 0 if the ticket is not inside any
+     */
+    std::uint64_t epoch;
+
+    EpochTicket() : slot(-1), epoch(0) {}
+};
+
+/**
+ * @brief Epoch-based reclamation of pages that readers may still reach without holding a pin or latch.
+ *
+ * A reader enters the current epoch before it reads any page number it will use unlatched, and exits once it
+ * holds none. A page taken out of a structure is retired under the epoch current then, which moves the epoch
+ * on; it may be reused once every reader that entered at or before that epoch has exited, since any later
+ * reader found the structure without it. Entering and exiting store to a slot of the reader's own, so readers
+ * do not count references or share a cache line with each other.
+ */
+class EpochManager {
+   public:
+    /**
+     * Constructor of EpochManager class, starts at epoch 1 with no reader inside.
+     */
+    EpochManager();
+
+    ~EpochManager();
+
+    /**
+     * Enters the current epoch.
+     *
+     * @return  Ticket to exit with
+     */
+    EpochTicket enter();
+
+    /**
+     * Enters the epoch of a ticket still inside it, for a reader that takes over page numbers read by another.
+     *
+     * @param other   Ticket inside an epoch
+     * @return        Ticket to exit with
+     */
+    EpochTicket join(const EpochTicket& other);
+
+    /**
+     * Exits the epoch of a ticket and resets it. Does nothing if the ticket is not inside an epoch.
+     *
+     * @param ticket  Ticket returned by enter or join
+     */
+    void exit(EpochTicket& ticket);
+
+    /**
+     * Retires a page, which is handed back by collect once no reader can still reach it.
+     *
+     * @param pageNo  Page number no longer reachable by readers entering from now on
+     */
+    void retire(const PageId pageNo);
+
+    /**
+     * Moves the retired pages no reader can reach any more to reclaimed.
+     *
+     * @param reclaimed  Receives the pages
+     */
+    void collect(std::vector<PageId>& reclaimed);
+
+    /**
+     * Moves every retired page to reclaimed, whatever the readers. For use once no reader is left.
+     *
+     * @param reclaimed  Receives the pages
+     */
+    void drain(std::vector<PageId>& reclaimed);
+
+    /**
+     * Returns the number of retired pages not collected yet.
+     */
+    std::size_t pending();
+
+   private:
+    /**
+     * @brief A reader's announced epoch, 0 while the slot is free, alone in its cache line.
+     */
+    struct alignas(CACHE_LINE_SIZE) Slot {
+        std::atomic<std::uint64_t> epoch;
+    };
+
+    /**
+     * Current epoch; retiring a page moves it on
+     */
+    std::atomic<std::uint64_t> current;
+
+    /**
+     * EPOCH_SLOTS reader slots, allocated apart on a cache line boundary: the manager is a member of objects
+     * allocated with plain new, which would not honour the alignment of slots held inline
+     */
+    Slot* slots;
+
+    /**
+     * Guards overflow and retired
+     */
+    std::mutex lock;
+
+    /**
+     * Epochs of the readers that found no free slot
+     */
+    std::multiset<std::uint64_t> overflow;
+
+    /**
+     * Retired pages with the epoch each was retired in, oldest first
+     */
+    std::vector<std::pair<std::uint64_t, PageId> > retired;
+
+    /**
+     * Announces epoch in a free slot, or in overflow if there is none.
+     */
+    EpochTicket announce(const std::uint64_t epoch);
+
+    /**
+     * Returns the oldest epoch a reader is inside, or the current epoch if none is. Called with lock held.
+     */
+    std::uint64_t oldestReader();
+
+    EpochManager(const EpochManager&);
+    EpochManager& operator=(const EpochManager&);
+};
+
+/**
+ * @brief Holds an epoch of an EpochManager for as long as it exists.
+ */
+class EpochGuard {
+   public:
+    explicit EpochGuard(EpochManager& manager) : manager(manager), ticket(manager.enter()) {}
+
+    ~EpochGuard() { manager.exit(ticket); }
+
+   private:
+    EpochManager& manager;
+    EpochTicket ticket;
+
+    EpochGuard(const EpochGuard&);
+    EpochGuard& operator=(const EpochGuard&);
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,25 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "file_format_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+FileFormatException::FileFormatException(const std::string& name,
+                                         const std::uint32_t expected,
+                                         const std::uint32_t actual)
+    : BadgerDbException(""), filename_(name), format_(actual) {
+  std::stringstream ss;
+  ss << "File '" << filename_ << "' has page format " << format_
+     << ", expected " << expected;
+  message_.assign(ss.str());
+}
+
+}
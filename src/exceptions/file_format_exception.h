@@ -0,0 +1,61 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a file opened holds its pages in a
+ *        layout other than the one this build reads and writes.
+ */
+class FileFormatException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a file format exception for the given file.
+   *
+   * @param name      Name of the file.
+   * @param expected  Page format this build reads and writes.
+   * @param actual    Page format recorded in the file's header.
+   */
+  FileFormatException(const std::string& name, const std::uint32_t expected,
+                      const std::uint32_t actual);
+
+  /**
+   * Destroys the exception.  Does nothing special; just included to make the
+   * compiler happy.
+   */
+  virtual ~FileFormatException() throw() {}
+
+  /**
+   * Returns the name of the file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+  /**
+   * Returns the page format recorded in the file's header.
+   */
+  virtual std::uint32_t format() const { return format_; }
+
+ protected:
+  /**
+   * Name of the file which caused this exception.
+   */
+  const std::string filename_;
+
+  /**
+   * Page format recorded in the file's header.
+   */
+  const std::uint32_t format_;
+};
+
+}
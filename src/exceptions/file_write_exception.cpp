@@ -0,0 +1,24 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "file_write_exception.h"
+
+#include <string.h>
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+FileWriteException::FileWriteException(const std::string& name, const int error)
+    : BadgerDbException(""), filename_(name), error_(error) {
+  std::stringstream ss;
+  ss << "Failed to write file '" << filename_ << "': " << strerror(error_);
+  message_.assign(ss.str());
+}
+
+}
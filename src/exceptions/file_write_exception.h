@@ -0,0 +1,58 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a file cannot be written or synced
+ *        to disk.
+ */
+class FileWriteException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a file write exception for the given file.
+   *
+   * @param name   Name of the file.
+   * @param error  errno of the failed write or sync.
+   */
+  FileWriteException(const std::string& name, const int error);
+
+  /**
+   * Destroys the exception.  Does nothing special; just included to make the
+   * compiler happy.
+   */
+  virtual ~FileWriteException() throw() {}
+
+  /**
+   * Returns the name of the file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+  /**
+   * Returns the errno of the failed write or sync.
+   */
+  virtual int error() const { return error_; }
+
+ protected:
+  /**
+   * Name of the file which caused this exception.
+   */
+  const std::string filename_;
+
+  /**
+   * errno of the failed write or sync.
+   */
+  const int error_;
+};
+
+}
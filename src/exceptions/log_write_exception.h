@@ -0,0 +1,58 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a write-ahead log cannot be written
+ *        out or synced to disk, so that what was appended to it is not durable.
+ */
+class LogWriteException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a log write exception for the given log file.
+   *
+   * @param name   Name of the log file.
+   * @param error  errno of the failed write or sync.
+   */
+  LogWriteException(const std::string& name, const int error);
+
+  /**
+   * Destroys the exception.  Does nothing special; just included to make the
+   * compiler happy.
+   */
+  virtual ~LogWriteException() throw() {}
+
+  /**
+   * Returns the name of the log file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+  /**
+   * Returns the errno of the failed write or sync.
+   */
+  virtual int error() const { return error_; }
+
+ protected:
+  /**
+   * Name of the log file which caused this exception.
+   */
+  const std::string filename_;
+
+  /**
+   * errno of the failed write or sync.
+   */
+  const int error_;
+};
+
+}
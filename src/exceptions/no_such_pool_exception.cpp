@@ -0,0 +1,22 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "no_such_pool_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+NoSuchPoolException::NoSuchPoolException(const std::string& name)
+    : BadgerDbException(""), poolname_(name) {
+  std::stringstream ss;
+  ss << "No buffer pool named: " << poolname_;
+  message_.assign(ss.str());
+}
+
+}
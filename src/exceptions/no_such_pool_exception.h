@@ -0,0 +1,43 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a buffer pool is asked for by a
+ *        name no pool was created with.
+ */
+class NoSuchPoolException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a no such pool exception for the given pool.
+   *
+   * @param name  Name of the pool.
+   */
+  explicit NoSuchPoolException(const std::string& name);
+
+  virtual ~NoSuchPoolException() throw() {}
+
+  /**
+   * Returns the name of the pool that caused this exception.
+   */
+  virtual const std::string& poolname() const { return poolname_; }
+
+ protected:
+  /**
+   * Name of pool that caused this exception.
+   */
+  const std::string poolname_;
+};
+
+}
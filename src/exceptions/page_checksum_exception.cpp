@@ -0,0 +1,29 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "page_checksum_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+PageChecksumException::PageChecksumException(
+    const PageId page_number, const std::string& file,
+    const std::uint32_t expected, const std::uint32_t actual)
+    : BadgerDbException(""),
+      page_number_(page_number),
+      filename_(file) {
+  std::stringstream ss;
+  ss << "Page failed its checksum."
+     << " Page " << page_number_
+     << " of file '" << filename_ << "' has checksum " << std::hex << actual
+     << ", expected " << expected;
+  message_.assign(ss.str());
+}
+
+}
@@ -0,0 +1,43 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a file that is only mapped for
+ *        reading is asked to change.
+ */
+class ReadOnlyException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a read-only exception for the given file.
+   *
+   * @param name  Name of the read-only file.
+   */
+  explicit ReadOnlyException(const std::string& name);
+
+  virtual ~ReadOnlyException() throw() {}
+
+  /**
+   * Returns the name of the file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+ protected:
+  /**
+   * Name of file that caused this exception.
+   */
+  const std::string filename_;
+};
+
+}
@@ -0,0 +1,444 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "exceptions/file_not_found_exception.h"
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * Fewest buffer frames an ExternalSorter works with: a merge needs at least two inputs and an output
+ */
+const std::uint32_t SORT_MIN_BUDGET = 3;
+
+/**
+ * @brief Tournament tree for a k-way merge.
+ *
+ * Each internal node remembers the loser of the match played there and the overall winner is kept apart, so
+ * replacing the winner's element replays only the matches on the path from its leaf to the root, one
+ * comparison per level. Exhausted inputs lose every match; equal elements are won by the lower input.
+ */
+template <class T>
+class LoserTree {
+   public:
+    /**
+     * Builds the tree over the first element of each input.
+     *
+     * @param heads  Per input: its first element, or NULL if it is empty
+     */
+    explicit LoserTree(const std::vector<const T*>& heads) : heads(heads), losers(heads.size() + 1) {
+        const std::size_t k = heads.size();
+        if (k == 0) return;
+        // leaves sit at k .. 2k-1 and node n plays the winners of nodes 2n and 2n+1
+        std::vector<std::size_t> winners(2 * k);
+        for (std::size_t i = 0; i < k; i++) winners[k + i] = i;
+        for (std::size_t n = k - 1; n >= 1; n--) {
+            const std::size_t a = winners[2 * n];
+            const std::size_t b = winners[2 * n + 1];
+            winners[n] = beats(a, b) ? a : b;
+            losers[n] = beats(a, b) ? b : a;
+        }
+        losers[0] = winners[1];
+    }
+
+    /**
+     * Returns true once every input is exhausted.
+     */
+    bool empty() const { return heads.empty() || heads[losers[0]] == NULL; }
+
+    /**
+     * Returns the input holding the smallest element.
+     */
+    std::size_t winner() const { return losers[0]; }
+
+    /**
+     * Returns the smallest element.
+     */
+    const T& top() const { return *heads[losers[0]]; }
+
+    /**
+     * Replaces the element of the winning input with its next one and finds the new winner.
+     *
+     * @param next  Next element of the input, or NULL if it is exhausted
+     */
+    void replace(const T* next) {
+        std::size_t winning = losers[0];
+        heads[winning] = next;
+        for (std::size_t n = (heads.size() + winning) / 2; n >= 1; n /= 2) {
+            if (beats(losers[n], winning)) std::swap(losers[n], winning);
+        }
+        losers[0] = winning;
+    }
+
+   private:
+    std::vector<const T*> heads;
+
+    /**
+     * losers[0] is the winner, losers[n] the loser of node n
+     */
+    std::vector<std::size_t> losers;
+
+    bool beats(const std::size_t a, const std::size_t b) const {
+        if (heads[b] == NULL) return heads[a] != NULL || a < b;
+        if (heads[a] == NULL) return false;
+        if (*heads[a] < *heads[b]) return true;
+        if (*heads[b] < *heads[a]) return false;
+        return a < b;
+    }
+};
+
+/**
+ * @brief Sorts more elements than fit in memory with a bounded number of buffer frames.
+ *
+ * The frames are reserved from a BufMgr, so the memory of the sort is part of the buffer pool's. Elements are
+ * added by several writers at once, each filling its own share of the frames. A full share is sorted a page
+ * at a time, merged into one sorted run and written to the writer's temporary BlobFile. Once every element is
+ * added, runs are merged as many at once as the frames allow until a single merge of all the remaining runs
+ * can hand out the elements in order. T must be copyable as plain bytes, ordered by operator< and smaller than
+ * a page.
+ */
+template <class T>
+class ExternalSorter {
+   public:
+    /**
+     * Constructor of ExternalSorter class, reserves the frames.
+     *
+     * @param bufMgr      Buffer manager the frames are reserved from
+     * @param tempPrefix  Prefix of the names of the temporary files
+     * @param budget      Number of frames, raised to SORT_MIN_BUDGET if below it
+     * @param writers     Number of writers wanted; fewer are used if the budget cannot give each two frames
+     * @throws BufferExceededException If the buffer pool cannot spare the frames
+     */
+    ExternalSorter(BufMgr* bufMgr, const std::string& tempPrefix, const std::uint32_t budget,
+                   const unsigned writers)
+        : bufMgr(bufMgr), tempPrefix(tempPrefix), total(0), mergeFile(NULL), tree(NULL) {
+        const std::uint32_t frameCount = std::max(budget, SORT_MIN_BUDGET);
+        bufMgr->reserveFrames(frameCount, frames);
+        // each writer needs a frame to sort in and one to write its runs through
+        const unsigned count = std::max(1u, std::min(writers, (unsigned)(frameCount / 2)));
+        const std::uint32_t share = frameCount / count;
+        writerState.resize(count);
+        try {
+            for (unsigned w = 0; w < count; w++) {
+                Writer& writer = writerState[w];
+                writer.frames.assign(frames.begin() + w * share, frames.begin() + (w + 1) * share);
+                writer.file = createTemp(tempPrefix + ".run" + std::to_string(w));
+            }
+        } catch (...) {
+            cleanUp();
+            throw;
+        }
+    }
+
+    /**
+     * Destructor of ExternalSorter class, removes the temporary files and returns the frames.
+     */
+    ~ExternalSorter() { cleanUp(); }
+
+    /**
+     * Returns the number of writers, which may be fewer than requested.
+     */
+    unsigned writers() const { return writerState.size(); }
+
+    /**
+     * Adds an element. Different writers may add at the same time; each writer must be used by one thread at a
+     * time.
+     *
+     * @param writer  Writer adding the element, below writers()
+     * @param value   Element
+     */
+    void add(const unsigned writer, const T& value) {
+        Writer& state = writerState[writer];
+        const std::size_t capacity = (state.frames.size() - 1) * PER_PAGE;
+        if (state.filled == capacity) spill(state);
+        elements(state.frames[state.filled / PER_PAGE])[state.filled % PER_PAGE] = value;
+        state.filled++;
+        state.added++;
+    }
+
+    /**
+     * Ends the adding: writes out what the writers still hold and merges the runs until all of them can be
+     * merged at once. Must be called once, after every add and before next.
+     */
+    void finish() {
+        for (size_t w = 0; w < writerState.size(); w++) {
+            spill(writerState[w]);
+            total += writerState[w].added;
+            runs.insert(runs.end(), writerState[w].runs.begin(), writerState[w].runs.end());
+        }
+
+        // intermediate merges write through one frame, so they take one input fewer than the last merge
+        const std::size_t fanIn = frames.size() - 1;
+        while (runs.size() > frames.size()) {
+            if (mergeFile == NULL) mergeFile = createTemp(tempPrefix + ".merge");
+            std::vector<Run> merged;
+            for (size_t first = 0; first < runs.size(); first += fanIn) {
+                const size_t last = std::min(first + fanIn, runs.size());
+                if (last - first == 1) {  // a run left over on its own is merged in the next pass
+                    merged.push_back(runs[first]);
+                    continue;
+                }
+                std::vector<Reader> inputs;
+                for (size_t i = first; i < last; i++) inputs.push_back(Reader(runs[i], frames[i - first]));
+                RunBuilder out(mergeFile, frames[last - first]);
+                merge(inputs, out);
+                merged.push_back(out.finish());
+            }
+            runs.swap(merged);
+        }
+
+        std::vector<const T*> heads;
+        for (size_t i = 0; i < runs.size(); i++) {
+            readers.push_back(Reader(runs[i], frames[i]));
+            heads.push_back(readers.back().head());
+        }
+        tree = new LoserTree<T>(heads);
+    }
+
+    /**
+     * Returns the number of elements added.
+     */
+    std::size_t size() const { return total; }
+
+    /**
+     * Returns the number of runs written before merging, for diagnostics.
+     */
+    std::size_t runsWritten() const {
+        std::size_t count = 0;
+        for (size_t w = 0; w < writerState.size(); w++) count += writerState[w].runs.size();
+        return count;
+    }
+
+    /**
+     * Takes the next element in order.
+     *
+     * @param value  Set to the element
+     * @return  False once every element has been taken
+     */
+    bool next(T& value) {
+        if (tree->empty()) return false;
+        const std::size_t i = tree->winner();
+        value = tree->top();
+        readers[i].advance();
+        tree->replace(readers[i].head());
+        return true;
+    }
+
+   private:
+    /**
+     * Number of elements stored in a page
+     */
+    static const std::size_t PER_PAGE = Page::SIZE / sizeof(T);
+
+    /**
+     * @brief A sorted run: count elements on consecutive pages of a file, PER_PAGE to a page.
+     */
+    struct Run {
+        BlobFile* file;
+        PageId firstPage;
+        std::size_t count;
+    };
+
+    /**
+     * @brief State of one writer: its frames, the last of which is its output frame, and its runs.
+     */
+    struct Writer {
+        std::vector<Page*> frames;
+        std::size_t filled;
+        std::size_t added;
+        BlobFile* file;
+        std::vector<Run> runs;
+
+        Writer() : filled(0), added(0), file(NULL) {}
+    };
+
+    /**
+     * @brief Reads a run back one page at a time into a frame.
+     */
+    class Reader {
+       public:
+        Reader(const Run& run, Page* frame) : run(run), frame(frame), page(0), pos(0), left(run.count) {
+            if (left > 0) run.file->readPageInto(run.firstPage, *frame);
+        }
+
+        /**
+         * Returns the current element, or NULL once the run is exhausted.
+         */
+        const T* head() const { return left > 0 ? &elements(frame)[pos] : NULL; }
+
+        void advance() {
+            left--;
+            if (++pos == PER_PAGE && left > 0) {
+                pos = 0;
+                run.file->readPageInto(run.firstPage + ++page, *frame);
+            }
+        }
+
+       private:
+        Run run;
+        Page* frame;
+        PageId page;
+        std::size_t pos;
+        std::size_t left;
+    };
+
+    /**
+     * @brief Writes a run through a frame, appending each page to the file once it is full.
+     */
+    class RunBuilder {
+       public:
+        RunBuilder(BlobFile* file, Page* frame) : frame(frame), inPage(0) {
+            run.file = file;
+            run.firstPage = Page::INVALID_NUMBER;
+            run.count = 0;
+        }
+
+        void add(const T& value) {
+            elements(frame)[inPage++] = value;
+            run.count++;
+            if (inPage == PER_PAGE) flush();
+        }
+
+        Run finish() {
+            if (inPage > 0) flush();
+            return run;
+        }
+
+       private:
+        Run run;
+        Page* frame;
+        std::size_t inPage;
+
+        void flush() {
+            PageId pageNo;
+            run.file->appendPage(pageNo, *frame);
+            if (run.firstPage == Page::INVALID_NUMBER) run.firstPage = pageNo;
+            inPage = 0;
+        }
+    };
+
+    BufMgr* bufMgr;
+    std::string tempPrefix;
+    std::size_t total;
+
+    /**
+     * Every reserved frame; the writers' shares while adding, the merge buffers afterwards
+     */
+    std::vector<Page*> frames;
+
+    std::vector<Writer> writerState;
+
+    /**
+     * Runs left to merge once adding is finished
+     */
+    std::vector<Run> runs;
+
+    /**
+     * File of the runs written by intermediate merges, NULL until needed
+     */
+    BlobFile* mergeFile;
+
+    /**
+     * Inputs and tree of the final merge
+     */
+    std::vector<Reader> readers;
+    LoserTree<T>* tree;
+
+    static T* elements(Page* frame) { return reinterpret_cast<T*>(frame); }
+
+    static BlobFile* createTemp(const std::string& name) {
+        // left over from a sort that did not finish
+        try {
+            File::remove(name);
+        } catch (const FileNotFoundException&) {
+        }
+        return new BlobFile(name, true);
+    }
+
+    static void removeTemp(BlobFile* file) {
+        if (file == NULL) return;
+        const std::string name = file->filename();
+        delete file;
+        try {
+            File::remove(name);
+        } catch (const FileNotFoundException&) {
+        }
+    }
+
+    /**
+     * Sorts the elements a writer holds, page by page, merges the pages into a run and writes it out.
+     */
+    void spill(Writer& writer) {
+        if (writer.filled == 0) return;
+        std::vector<const T*> heads;
+        std::vector<const T*> ends;
+        for (size_t first = 0; first < writer.filled; first += PER_PAGE) {
+            T* begin = elements(writer.frames[first / PER_PAGE]);
+            T* end = begin + std::min(PER_PAGE, writer.filled - first);
+            std::sort(begin, end);
+            heads.push_back(begin);
+            ends.push_back(end);
+        }
+
+        LoserTree<T> pages(heads);
+        RunBuilder out(writer.file, writer.frames.back());
+        while (!pages.empty()) {
+            const std::size_t i = pages.winner();
+            out.add(pages.top());
+            pages.replace(++heads[i] == ends[i] ? NULL : heads[i]);
+        }
+        writer.runs.push_back(out.finish());
+        writer.filled = 0;
+    }
+
+    /**
+     * Merges runs into one.
+     */
+    static void merge(std::vector<Reader>& inputs, RunBuilder& out) {
+        std::vector<const T*> heads;
+        for (size_t i = 0; i < inputs.size(); i++) heads.push_back(inputs[i].head());
+        LoserTree<T> merging(heads);
+        while (!merging.empty()) {
+            const std::size_t i = merging.winner();
+            out.add(merging.top());
+            inputs[i].advance();
+            merging.replace(inputs[i].head());
+        }
+    }
+
+    void cleanUp() {
+        delete tree;
+        tree = NULL;
+        readers.clear();
+        for (size_t w = 0; w < writerState.size(); w++) {
+            removeTemp(writerState[w].file);
+            writerState[w].file = NULL;
+        }
+        removeTemp(mergeFile);
+        mergeFile = NULL;
+        bufMgr->releaseFrames(frames);
+    }
+
+    ExternalSorter(const ExternalSorter&);
+    ExternalSorter& operator=(const ExternalSorter&);
+};
+
+template <class T>
+const std::size_t ExternalSorter<T>::PER_PAGE;
+
+}  // namespace badgerdb
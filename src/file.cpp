@@ -7,24 +7,67 @@
 
 #include "file.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
-#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <memory>
 #include <string>
 
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/file_format_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
+#include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_page_exception.h"
 #include "file_iterator.h"
 #include "page.h"
+#include "trace.h"
 
 namespace badgerdb {
 
-File::StreamMap File::open_streams_;
-File::CountMap File::open_counts_;
+void FreeSpaceMap::set(const PageId page_number, const std::size_t free_bytes) {
+    const int bucket = (int)std::min<std::size_t>(free_bytes / FREE_SPACE_BUCKET_BYTES, FREE_SPACE_BUCKETS - 1);
+    std::pair<std::unordered_map<PageId, int>::iterator, bool> entry =
+        bucket_of_.insert(std::make_pair(page_number, bucket));
+    if (!entry.second) {
+        if (entry.first->second == bucket) return;
+        buckets_[entry.first->second].erase(page_number);
+        entry.first->second = bucket;
+    }
+    buckets_[bucket].insert(page_number);
+}
+
+void FreeSpaceMap::remove(const PageId page_number) {
+    std::unordered_map<PageId, int>::iterator entry = bucket_of_.find(page_number);
+    if (entry == bucket_of_.end()) return;
+    buckets_[entry->second].erase(page_number);
+    bucket_of_.erase(entry);
+}
+
+PageId FreeSpaceMap::find(const std::size_t free_bytes) const {
+    // every page from the first bucket starting at or above free_bytes has room
+    for (std::size_t bucket = (free_bytes + FREE_SPACE_BUCKET_BYTES - 1) / FREE_SPACE_BUCKET_BYTES;
+         bucket < (std::size_t)FREE_SPACE_BUCKETS; bucket++) {
+        if (!buckets_[bucket].empty()) return *buckets_[bucket].begin();
+    }
+    return Page::INVALID_NUMBER;
+}
+
+File::FileIdMap File::file_ids_;
+std::vector<std::shared_ptr<File::OpenFileState> > File::open_states_;
+bool File::direct_io_ = false;
+bool File::checksums_ = false;
+bool File::compression_ = false;
 
 void File::remove(const std::string& filename) {
     if (!exists(filename)) {
@@ -34,23 +77,40 @@ void File::remove(const std::string& filename) {
         throw FileOpenException(filename);
     }
     std::remove(filename.c_str());
+    const std::string sidecars[2] = {PageChecksums::filenameOf(filename), CompressedPages::filenameOf(filename)};
+    for (int i = 0; i < 2; i++) {
+        if (exists(sidecars[i])) std::remove(sidecars[i].c_str());
+    }
+}
+
+void File::rename(const std::string& from, const std::string& to) {
+    if (!exists(from)) {
+        throw FileNotFoundException(from);
+    }
+    if (exists(to)) {
+        throw FileExistsException(to);
+    }
+    if (isOpen(from)) {
+        throw FileOpenException(from);
+    }
+    std::rename(from.c_str(), to.c_str());
+    const std::string sidecars[2][2] = {{PageChecksums::filenameOf(from), PageChecksums::filenameOf(to)},
+                                        {CompressedPages::filenameOf(from), CompressedPages::filenameOf(to)}};
+    for (int i = 0; i < 2; i++) {
+        if (exists(sidecars[i][0])) std::rename(sidecars[i][0].c_str(), sidecars[i][1].c_str());
+    }
 }
 
 bool File::isOpen(const std::string& filename) {
-    if (!exists(filename)) {
+    FileIdMap::const_iterator id = file_ids_.find(filename);
+    if (id == file_ids_.end() || !open_states_[id->second]) {
         return false;
     }
-    return open_counts_.find(filename) != open_counts_.end();
+    return exists(filename);
 }
 
 bool File::exists(const std::string& filename) {
-    std::fstream file(filename);
-    if (file) {
-        file.close();
-        return true;
-    }
-
-    return false;
+    return ::access(filename.c_str(), F_OK) == 0;
 }
 
 File::~File() {
@@ -58,6 +118,7 @@ File::~File() {
 }
 
 PageId File::getFirstPageNo() {
+    std::lock_guard<std::recursive_mutex> guard(state_->lock);
     const FileHeader& header = readHeader();
     return header.first_used_page;
 }
@@ -68,18 +129,23 @@ File::File(const std::string& name, const bool create_new) : filename_(name) {
     if (create_new) {
         // File starts with 1 page (the header).
         FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                             0 /* num_free_pages */, 0 /* first_free_page */};
+                             0 /* num_free_pages */, 0 /* first_free_page */,
+                             0 /* last_used_page */, 0 /* page_format */};
         writeHeader(header);
     }
 }
 
 void File::openIfNeeded(const bool create_new) {
-    if (open_counts_.find(filename_) != open_counts_.end()) {  // exists an entry already
-        ++open_counts_[filename_];
-        stream_ = open_streams_[filename_];
+    const std::pair<FileIdMap::iterator, bool> interned =
+        file_ids_.insert(std::make_pair(filename_, (std::uint32_t)open_states_.size()));
+    if (interned.second) open_states_.push_back(std::shared_ptr<OpenFileState>());
+    id_ = interned.first->second;
+
+    if (open_states_[id_]) {  // exists an entry already
+        state_ = open_states_[id_];
+        ++state_->open_count;
     } else {
-        std::ios_base::openmode mode =
-            std::fstream::in | std::fstream::out | std::fstream::binary;
+        int flags = O_RDWR;
         const bool already_exists = exists(filename_);
         if (create_new) {
             // Error if we try to overwrite an existing file.
@@ -87,43 +153,248 @@ void File::openIfNeeded(const bool create_new) {
                 throw FileExistsException(filename_);
             }
             // New files have to be truncated on open.
-            mode = mode | std::fstream::trunc;
+            flags |= O_CREAT | O_TRUNC;
         } else {
             // Error if we try to open a file that doesn't exist.
             if (!already_exists) {
                 throw FileNotFoundException(filename_);
             }
         }
-        stream_.reset(new std::fstream(filename_, mode));
-        open_streams_[filename_] = stream_;
-        open_counts_[filename_] = 1;
+        // a new file sheds whatever a file of its name left next to it
+        const std::string checksumFile = PageChecksums::filenameOf(filename_);
+        const std::string pageMap = CompressedPages::filenameOf(filename_);
+        if (create_new && !checksums_ && exists(checksumFile)) std::remove(checksumFile.c_str());
+        if (create_new && !compression_ && exists(pageMap)) std::remove(pageMap.c_str());
+        const bool compress = create_new ? compression_ : exists(pageMap);
+
+        int fd = -1;
+        bool direct = false;
+#ifdef O_DIRECT
+        // compressed pages are read and written through buffers of any alignment
+        if (direct_io_ && !compress) {
+            // file systems without direct I/O refuse the flag; those files are opened normally
+            fd = ::open(filename_.c_str(), flags | O_DIRECT, 0644);
+            direct = fd >= 0;
+        }
+#endif
+        if (fd < 0) {
+            fd = ::open(filename_.c_str(), flags, 0644);
+        }
+        if (fd < 0) {
+            throw FileNotFoundException(filename_);
+        }
+        state_.reset(new OpenFileState(fd, direct));
+        // a new file's checksums start over; an existing one keeps checking against those it has
+        if (checksums_ || exists(checksumFile)) {
+            state_->checksums.reset(new PageChecksums(filename_, create_new));
+        }
+        if (compress) state_->compressed.reset(new CompressedPages(fd, filename_, create_new));
+        open_states_[id_] = state_;
     }
 }
 
 void File::close() {
-    if (open_counts_[filename_] > 0)
-        --open_counts_[filename_];
+    if (!state_) return;
+    assert(state_->open_count > 0);
+
+    // the last File object on the file writes back its header
+    if (--state_->open_count == 0) {
+        flushHeader();
+        open_states_[id_].reset();
+    }
+    state_.reset();
+}
+
+File::OpenFileState::~OpenFileState() {
+    ::close(fd);
+}
+
+void File::setDirectIO(const bool enabled) {
+    direct_io_ = enabled;
+}
+
+void File::setChecksums(const bool enabled) {
+    checksums_ = enabled;
+}
 
-    stream_.reset();
-    assert(open_counts_[filename_] >= 0);
+void File::setCompression(const bool enabled) {
+    compression_ = enabled;
+}
+
+/**
+ * Page-aligned scratch buffer for direct I/O, freed when it goes out of scope.
+ */
+struct AlignedBuffer {
+    char* data;
+
+    explicit AlignedBuffer(const size_t length) : data(NULL) {
+        void* ptr = NULL;
+        if (posix_memalign(&ptr, DIRECT_IO_ALIGNMENT, length) == 0) data = static_cast<char*>(ptr);
+    }
+    ~AlignedBuffer() { free(data); }
+};
 
-    if (open_counts_[filename_] == 0) {
-        open_streams_.erase(filename_);
-        open_counts_.erase(filename_);
+/**
+ * Reads up to length bytes at offset, retrying after signals and short reads.
+ *
+ * @return  Number of bytes read; fewer than length only at the end of the file or on an error
+ */
+static size_t preadFully(const int fd, char* data, const size_t length, const off_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = ::pread(fd, data + done, length - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
     }
+    return done;
+}
+
+static void pwriteFully(const int fd, const char* data, const size_t length, const off_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = ::pwrite(fd, data + done, length - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+}
+
+void File::readAt(const off_t offset, void* data, const size_t length) const {
+    char* out = static_cast<char*>(data);
+    if (state_->compressed && offset >= (off_t)Page::SIZE) {
+        // compressed pages are read whole and the bytes asked for copied out of them
+        for (size_t done = 0; done < length;) {
+            const PageId page_number = (PageId)((offset + done) / Page::SIZE);
+            const size_t within = (offset + done) % Page::SIZE;
+            const size_t n = std::min(length - done, Page::SIZE - within);
+            if (n == Page::SIZE) {
+                state_->compressed->read(page_number, out + done);
+            } else {
+                char page[Page::SIZE];
+                state_->compressed->read(page_number, page);
+                memcpy(out + done, page + within, n);
+            }
+            done += n;
+        }
+        return;
+    }
+    if (!state_->direct_io) {
+        size_t done = preadFully(state_->fd, out, length, offset);
+        memset(out + done, 0, length - done);
+        return;
+    }
+    // direct reads cover whole aligned blocks through an aligned buffer
+    const off_t begin = offset & ~(off_t)(DIRECT_IO_ALIGNMENT - 1);
+    const off_t end = (offset + length + DIRECT_IO_ALIGNMENT - 1) & ~(off_t)(DIRECT_IO_ALIGNMENT - 1);
+    AlignedBuffer buffer(end - begin);
+    size_t done = preadFully(state_->fd, buffer.data, end - begin, begin);
+    memset(buffer.data + done, 0, (end - begin) - done);
+    memcpy(out, buffer.data + (offset - begin), length);
+}
+
+void File::writeAt(const off_t offset, const void* data, const size_t length) const {
+    const char* in = static_cast<const char*>(data);
+    if (state_->compressed && offset >= (off_t)Page::SIZE) {
+        for (size_t done = 0; done < length;) {
+            const PageId page_number = (PageId)((offset + done) / Page::SIZE);
+            const size_t within = (offset + done) % Page::SIZE;
+            const size_t n = std::min(length - done, Page::SIZE - within);
+            if (n == Page::SIZE) {
+                state_->compressed->write(page_number, in + done);
+            } else {
+                state_->compressed->update(page_number, within, in + done, n);
+            }
+            done += n;
+        }
+        return;
+    }
+    if (!state_->direct_io) {
+        pwriteFully(state_->fd, in, length, offset);
+        return;
+    }
+    // a write that does not cover whole blocks reads the blocks it touches first
+    const off_t begin = offset & ~(off_t)(DIRECT_IO_ALIGNMENT - 1);
+    const off_t end = (offset + length + DIRECT_IO_ALIGNMENT - 1) & ~(off_t)(DIRECT_IO_ALIGNMENT - 1);
+    AlignedBuffer buffer(end - begin);
+    if (begin != offset || end != (off_t)(offset + length)) {
+        size_t done = preadFully(state_->fd, buffer.data, end - begin, begin);
+        memset(buffer.data + done, 0, (end - begin) - done);
+    }
+    memcpy(buffer.data + (offset - begin), in, length);
+    pwriteFully(state_->fd, buffer.data, end - begin, begin);
+}
+
+void File::writeAt(const off_t offset, const void* head, const size_t headLength, const void* tail,
+                   const size_t tailLength) const {
+    const size_t length = headLength + tailLength;
+    if (state_->direct_io || state_->compressed) {
+        AlignedBuffer buffer(length);
+        memcpy(buffer.data, head, headLength);
+        memcpy(buffer.data + headLength, tail, tailLength);
+        writeAt(offset, buffer.data, length);
+        return;
+    }
+    struct iovec parts[2];
+    parts[0].iov_base = const_cast<void*>(head);
+    parts[0].iov_len = headLength;
+    parts[1].iov_base = const_cast<void*>(tail);
+    parts[1].iov_len = tailLength;
+    ssize_t n;
+    do {
+        n = ::pwritev(state_->fd, parts, 2, offset);
+    } while (n < 0 && errno == EINTR);
+
+    // finish a short write part by part
+    size_t done = n < 0 ? 0 : n;
+    if (done < headLength) {
+        pwriteFully(state_->fd, static_cast<const char*>(head) + done, headLength - done, offset + done);
+        done = headLength;
+    }
+    if (done < length)
+        pwriteFully(state_->fd, static_cast<const char*>(tail) + (done - headLength), length - done, offset + done);
 }
 
 FileHeader File::readHeader() const {
-    FileHeader header;
-    stream_->seekg(0 /* pos */, std::ios::beg);
-    stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
-    return header;
+    std::lock_guard<std::recursive_mutex> guard(state_->lock);
+    OpenFileState& state = *state_;
+    if (!state.header_loaded) {
+        readAt(0 /* pos */, &state.header, sizeof(FileHeader));
+        state.header_loaded = true;
+    }
+    return state.header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-    stream_->seekp(0 /* pos */, std::ios::beg);
-    stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-    stream_->flush();
+    std::lock_guard<std::recursive_mutex> guard(state_->lock);
+    OpenFileState& state = *state_;
+    state.header = header;
+    state.header_loaded = true;
+    state.header_dirty = true;
+    if (state.header_checkpoint > 0 && ++state.header_writes >= state.header_checkpoint) {
+        flushHeader();
+    }
+}
+
+void File::flushHeader() const {
+    std::lock_guard<std::recursive_mutex> guard(state_->lock);
+    OpenFileState& state = *state_;
+    if (!state.header_dirty) return;
+    writeAt(0 /* pos */, &state.header, sizeof(FileHeader));
+    state.header_dirty = false;
+    state.header_writes = 0;
+}
+
+void File::sync() const {
+    flushHeader();
+    ::fdatasync(state_->fd);
+    if (state_->checksums) state_->checksums->sync();
+    if (state_->compressed) state_->compressed->sync();
+}
+
+void File::setHeaderCheckpoint(const int writes) {
+    std::lock_guard<std::recursive_mutex> guard(state_->lock);
+    state_->header_checkpoint = writes;
 }
 
 PageFile PageFile::create(const std::string& filename) {
@@ -136,6 +407,14 @@ PageFile PageFile::open(const std::string& filename) {
 
 PageFile::PageFile(const std::string& name, const bool create_new)
     : File(name, create_new) {
+    FileHeader header = readHeader();
+    if (create_new) {
+        header.page_format = Page::FORMAT;
+        writeHeader(header);
+    } else if (header.page_format != Page::FORMAT) {
+        // a file of another layout would be read with its records in the wrong places
+        throw FileFormatException(filename_, Page::FORMAT, header.page_format);
+    }
 }
 
 PageFile::~PageFile() {
@@ -155,95 +434,104 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
 }
 
 Page PageFile::allocatePage(PageId& new_page_number) {
-    FileHeader header = readHeader();
     Page new_page;
-    Page existing_page;
+    allocatePageInto(new_page_number, new_page);
+    return new_page;
+}
+
+void PageFile::allocatePageInto(PageId& new_page_number, Page& new_page) {
+    std::lock_guard<std::recursive_mutex> guard(state_->lock);
+    FileHeader header = readHeader();
     if (header.num_free_pages > 0) {
-        new_page = readPage(header.first_free_page, true /* allow_free */);
+        readPageInto(header.first_free_page, new_page, true /* allow_free */);
         new_page.set_page_number(header.first_free_page);
         new_page_number = new_page.page_number();
         header.first_free_page = new_page.next_page_number();
         --header.num_free_pages;
 
-        if (header.first_used_page == Page::INVALID_NUMBER ||
-            header.first_used_page > new_page.page_number()) {
-            // Either have no pages used or the head of the used list is a page later
-            // than the one we just allocated, so add the new page to the head.
-            if (header.first_used_page > new_page.page_number()) {
-                new_page.set_next_page_number(header.first_used_page);
-            }
-            header.first_used_page = new_page.page_number();
+        // The used list is kept in page number order, so link the reused page in
+        // between the used pages just before and just after it.
+        std::set<PageId>& used = usedPages(header);
+        std::set<PageId>::iterator next = used.lower_bound(new_page_number);
+        new_page.set_next_page_number(next == used.end() ? Page::INVALID_NUMBER : *next);
+        if (next == used.begin()) {
+            header.first_used_page = new_page_number;
         } else {
-            // New page is reused from somewhere after the beginning, so we need to
-            // find where in the used list to insert it.
-            PageId next_page_number = Page::INVALID_NUMBER;
-            for (FileIterator iter = begin(); iter != end(); ++iter) {
-                next_page_number = (*iter).next_page_number();
-                if (next_page_number > new_page.page_number() ||
-                    next_page_number == Page::INVALID_NUMBER) {
-                    existing_page = *iter;
-                    break;
-                }
-            }
-            existing_page.set_next_page_number(new_page.page_number());
-            new_page.set_next_page_number(next_page_number);
+            const PageId previous_page_number = *std::prev(next);
+            PageHeader previous_header = readPageHeader(previous_page_number);
+            previous_header.next_page_number = new_page_number;
+            writePageHeader(previous_page_number, previous_header);
+        }
+        if (next == used.end()) {
+            header.last_used_page = new_page_number;
         }
+        used.insert(next, new_page_number);
 
         assert((header.num_free_pages == 0) ==
                (header.first_free_page == Page::INVALID_NUMBER));
     } else {
+        new_page.initialize();
         new_page.set_page_number(header.num_pages);
         new_page_number = new_page.page_number();
 
         if (header.first_used_page == Page::INVALID_NUMBER) {
-            header.first_used_page = new_page.page_number();
+            header.first_used_page = new_page_number;
         } else {
-            // If we have pages allocated, we need to add the new page to the tail
-            // of the linked list.
-            for (FileIterator iter = begin(); iter != end(); ++iter) {
-                if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-                    existing_page = *iter;
-                    break;
-                }
-            }
-            assert(existing_page.isUsed());
-            existing_page.set_next_page_number(new_page.page_number());
+            // A new page has the highest number yet, so it goes after the tail.
+            PageHeader tail_header = readPageHeader(header.last_used_page);
+            assert(tail_header.next_page_number == Page::INVALID_NUMBER);
+            tail_header.next_page_number = new_page_number;
+            writePageHeader(header.last_used_page, tail_header);
+        }
+        header.last_used_page = new_page_number;
+        if (state_->used_pages_loaded) {
+            state_->used_pages.insert(state_->used_pages.end(), new_page_number);
         }
         ++header.num_pages;
     }
     writePage(new_page_number, new_page.header_, new_page);
-    if (existing_page.page_number() != Page::INVALID_NUMBER) {
-        // If we updated an existing page by inserting the new page into the
-        // used list, we need to write it out.
-        writePage(existing_page.page_number(), existing_page.header_, existing_page);
-    }
     writeHeader(header);
-
-    return new_page;
 }
 
 Page PageFile::readPage(const PageId page_number) const {
-    FileHeader header = readHeader();
+    Page page;
+    readPageInto(page_number, page);
+    return page;
+}
+
+void PageFile::readPageInto(const PageId page_number, Page& page) const {
+    const FileHeader header = readHeader();
 
     if (page_number >= header.num_pages) {
         throw InvalidPageException(page_number, filename_);
     }
-    return readPage(page_number, false /* allow_free */);
+    readPageInto(page_number, page, false /* allow_free */);
 }
 
-Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
-    Page page;
-    stream_->seekg(pagePosition(page_number), std::ios::beg);
-    stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-    stream_->read(&page.data_[0], Page::DATA_SIZE);
+/**
+ * Checksum of a PageFile page. The used and free lists relink pages by rewriting their headers in place, so the
+ * link to the next page is left out.
+ */
+static std::uint32_t linkedPageChecksum(const PageHeader& header, const char* data) {
+    PageHeader unlinked = header;
+    unlinked.next_page_number = 0;
+    return crc32c(data, Page::DATA_SIZE, crc32c(&unlinked, sizeof(PageHeader)));
+}
+
+void PageFile::readPageInto(const PageId page_number, Page& page, const bool allow_free) const {
+    BADGERDB_SPAN("File::readPage", page_number);
+    readAt(pagePosition(page_number), &page, Page::SIZE);
+    if (state_->checksums) {
+        state_->checksums->verify(page_number, linkedPageChecksum(page.header_, page.data_), filename_);
+    }
     if (!allow_free && !page.isUsed()) {
         throw InvalidPageException(page_number, filename_);
     }
-
-    return page;
 }
 
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
+    BADGERDB_SPAN("File::writePage", new_page_number);
+    std::lock_guard<std::recursive_mutex> guard(state_->lock);
     PageHeader header = readPageHeader(new_page_number);
     if (header.current_page_number == Page::INVALID_NUMBER) {
         // Page has been deleted since it was read.
@@ -259,38 +547,41 @@ void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
 }
 
 void PageFile::deletePage(const PageId page_number) {
+    std::lock_guard<std::recursive_mutex> guard(state_->lock);
     FileHeader header = readHeader();
 
-    Page existing_page = readPage(page_number);
-    Page previous_page;
+    Page existing_page;
+    readPageInto(page_number, existing_page);
+    std::set<PageId>& used = usedPages(header);
+    std::set<PageId>::iterator position = used.find(page_number);
+    assert(position != used.end());
     // If this page is the head of the used list, update the header to point to
-    // the next page in line.
-    if (page_number == header.first_used_page) {
+    // the next page in line; otherwise its predecessor skips over it.
+    PageId previous_page_number = Page::INVALID_NUMBER;
+    if (position == used.begin()) {
         header.first_used_page = existing_page.next_page_number();
     } else {
-        // Walk the used list so we can update the page that points to this one.
-        for (FileIterator iter = begin(); iter != end(); ++iter) {
-            previous_page = *iter;
-            if (previous_page.next_page_number() == existing_page.page_number()) {
-                previous_page.set_next_page_number(existing_page.next_page_number());
-                break;
-            }
-        }
+        previous_page_number = *std::prev(position);
+        PageHeader previous_header = readPageHeader(previous_page_number);
+        previous_header.next_page_number = existing_page.next_page_number();
+        writePageHeader(previous_page_number, previous_header);
     }
+    if (page_number == header.last_used_page) {
+        header.last_used_page = previous_page_number;
+    }
+    used.erase(position);
+
     // Clear the page and add it to the head of the free list.
     existing_page.initialize();
     existing_page.set_next_page_number(header.first_free_page);
     header.first_free_page = page_number;
     ++header.num_free_pages;
-    if (previous_page.isUsed()) {
-        writePage(previous_page.page_number(), previous_page.header_, previous_page);
-    }
     writePage(page_number, existing_page.header_, existing_page);
     writeHeader(header);
 }
 
 FileIterator PageFile::begin() {
-    const FileHeader& header = readHeader();
+    const FileHeader header = readHeader();
     return FileIterator(this, header.first_used_page);
 }
 
@@ -298,21 +589,83 @@ FileIterator PageFile::end() {
     return FileIterator(this, Page::INVALID_NUMBER);
 }
 
+std::vector<PageId> PageFile::usedPagesAfter(const PageId page_number, const std::size_t count) {
+    std::lock_guard<std::recursive_mutex> guard(state_->lock);
+    // the used list is kept in page number order, so it continues at the next larger number in the set
+    std::set<PageId>& used = usedPages(readHeader());
+    std::vector<PageId> pages;
+    for (std::set<PageId>::iterator iter = used.upper_bound(page_number); iter != used.end() && pages.size() < count;
+         ++iter)
+        pages.push_back(*iter);
+    return pages;
+}
+
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                          const Page& new_page) {
-    stream_->seekp(pagePosition(page_number), std::ios::beg);
-    stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-    stream_->write(&new_page.data_[0], Page::DATA_SIZE);
-    stream_->flush();
+    // the header replaces the page's own, so the two are written side by side rather than copied together
+    writeAt(pagePosition(page_number), &header, sizeof(PageHeader), new_page.data_, Page::DATA_SIZE);
+    if (state_->checksums) state_->checksums->set(page_number, linkedPageChecksum(header, new_page.data_));
+    if (state_->free_space_loaded) {
+        if (header.current_page_number == Page::INVALID_NUMBER)
+            state_->free_space.remove(page_number);
+        else
+            state_->free_space.set(page_number, new_page.getFreeSpace());
+    }
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
     PageHeader header;
-    stream_->seekg(pagePosition(page_number), std::ios::beg);
-    stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+    readAt(pagePosition(page_number), &header, sizeof(PageHeader));
     return header;
 }
 
+void PageFile::writePageHeader(const PageId page_number, const PageHeader& header) {
+    writeAt(pagePosition(page_number), &header, sizeof(PageHeader));
+}
+
+std::set<PageId>& PageFile::usedPages(const FileHeader& header) {
+    if (!state_->used_pages_loaded) {
+        for (PageId page_number = header.first_used_page;
+             page_number != Page::INVALID_NUMBER;
+             page_number = readPageHeader(page_number).next_page_number) {
+            state_->used_pages.insert(state_->used_pages.end(), page_number);
+        }
+        state_->used_pages_loaded = true;
+    }
+    return state_->used_pages;
+}
+
+FreeSpaceMap& PageFile::freeSpace() {
+    if (!state_->free_space_loaded) {
+        Page page;
+        const std::set<PageId>& used = usedPages(readHeader());
+        for (std::set<PageId>::const_iterator iter = used.begin(); iter != used.end(); ++iter) {
+            readPageInto(*iter, page, true /* allow_free */);
+            state_->free_space.set(*iter, page.getFreeSpace());
+        }
+        state_->free_space_loaded = true;
+    }
+    return state_->free_space;
+}
+
+RecordId PageFile::insertRecord(const std::string& record_data) {
+    std::lock_guard<std::recursive_mutex> guard(state_->lock);
+    if (record_data.length() + sizeof(PageSlot) > Page::DATA_SIZE) {
+        throw InsufficientSpaceException(Page::INVALID_NUMBER, record_data.length(), Page::DATA_SIZE);
+    }
+    // asking for room for a new slot as well passes over pages that could reuse one, but never picks a page
+    // without room
+    Page page;
+    PageId page_number = freeSpace().find(record_data.length() + sizeof(PageSlot));
+    if (page_number != Page::INVALID_NUMBER) readPageInto(page_number, page);
+    if (page_number == Page::INVALID_NUMBER || !page.hasSpaceForRecord(record_data)) {
+        allocatePageInto(page_number, page);
+    }
+    const RecordId record_id = page.insertRecord(record_data);
+    writePage(page_number, page);
+    return record_id;
+}
+
 BlobFile BlobFile::create(const std::string& filename) {
     return BlobFile(filename, true /* create_new */);
 }
@@ -342,8 +695,26 @@ BlobFile& BlobFile::operator=(const BlobFile& rhs) {
 }
 
 Page BlobFile::allocatePage(PageId& new_page_number) {
-    FileHeader header = readHeader();
     Page new_page;
+    allocatePageInto(new_page_number, new_page);
+    return new_page;
+}
+
+void BlobFile::allocatePageInto(PageId& new_page_number, Page& new_page) {
+    std::lock_guard<std::recursive_mutex> guard(state_->lock);
+    FileHeader header = readHeader();
+    new_page.initialize();
+
+    // reuse the head of the free list; its first PageId links to the next free page
+    if (header.num_free_pages > 0) {
+        new_page_number = header.first_free_page;
+        readAt(pagePosition(new_page_number), &header.first_free_page, sizeof(PageId));
+        --header.num_free_pages;
+
+        writePage(new_page_number, new_page);
+        writeHeader(header);
+        return;
+    }
 
     new_page_number = header.num_pages;
 
@@ -355,26 +726,79 @@ Page BlobFile::allocatePage(PageId& new_page_number) {
 
     writePage(new_page_number, new_page);
     writeHeader(header);
+}
 
-    return new_page;
+void BlobFile::appendPage(PageId& new_page_number, const Page& page) {
+    std::lock_guard<std::recursive_mutex> guard(state_->lock);
+    FileHeader header = readHeader();
+    new_page_number = header.num_pages;
+    if (header.first_used_page == Page::INVALID_NUMBER) {
+        header.first_used_page = header.num_pages;
+    }
+    ++header.num_pages;
+
+    writePage(new_page_number, page);
+    writeHeader(header);
+}
+
+void BlobFile::appendPageInto(PageId& new_page_number, Page& page) {
+    page.initialize();
+    appendPage(new_page_number, page);
+}
+
+void BlobFile::restoreExtent(const PageId page_count) {
+    std::lock_guard<std::recursive_mutex> guard(state_->lock);
+    FileHeader header = readHeader();
+    if (header.num_pages < page_count) header.num_pages = page_count;
+    header.num_free_pages = 0;
+    header.first_free_page = Page::INVALID_NUMBER;
+    writeHeader(header);
 }
 
 Page BlobFile::readPage(const PageId page_number) const {
     Page page;
-    stream_->seekg(pagePosition(page_number), std::ios::beg);
-    stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+    readPageInto(page_number, page);
     return page;
 }
 
+void BlobFile::readPageInto(const PageId page_number, Page& page) const {
+    readPageInto(page_number, page, true /* verify */);
+}
+
+void BlobFile::readPageInto(const PageId page_number, Page& page, const bool verify) const {
+    BADGERDB_SPAN("File::readPage", page_number);
+    readAt(pagePosition(page_number), &page, Page::SIZE);
+    if (verify && state_->checksums) state_->checksums->verify(page_number, crc32c(&page, Page::SIZE), filename_);
+}
+
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-    stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-    stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-    stream_->flush();
+    BADGERDB_SPAN("File::writePage", new_page_number);
+    writeAt(pagePosition(new_page_number), &new_page, Page::SIZE);
+    if (state_->checksums) state_->checksums->set(new_page_number, crc32c(&new_page, Page::SIZE));
+}
+
+bool BlobFile::pageLocation(const PageId page_number, const void* buffer, int& fd, off_t& offset) const {
+    // pages moved straight between the file and a frame would skip their checksums or their compression
+    if (state_->checksums || state_->compressed) return false;
+    // unaligned buffers cannot be used with O_DIRECT and go through writePage's bounce buffer instead
+    if (state_->direct_io && reinterpret_cast<uintptr_t>(buffer) % DIRECT_IO_ALIGNMENT != 0) return false;
+    fd = state_->fd;
+    offset = pagePosition(page_number);
+    return true;
 }
 
-// delePage should not be called for a blob_file, not supported
 void BlobFile::deletePage(const PageId page_number) {
-    throw InvalidPageException(page_number, filename_);
+    std::lock_guard<std::recursive_mutex> guard(state_->lock);
+    FileHeader header = readHeader();
+    if (page_number == 0 || page_number >= header.num_pages) {
+        throw InvalidPageException(page_number, filename_);
+    }
+
+    writeAt(pagePosition(page_number), &header.first_free_page, sizeof(PageId));
+    if (state_->checksums) state_->checksums->forget(page_number);
+    header.first_free_page = page_number;
+    ++header.num_free_pages;
+    writeHeader(header);
 }
 
 }  // namespace badgerdb
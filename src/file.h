@@ -7,17 +7,30 @@
 
 #pragma once
 
-#include <fstream>
-#include <map>
+#include <sys/types.h>
+
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
+#include "checksum.h"
+#include "compressed_pages.h"
 #include "page.h"
 
 namespace badgerdb {
 
 class FileIterator;
 
+/**
+ * @brief Alignment of the offsets, lengths and buffers of direct I/O.
+ */
+const size_t DIRECT_IO_ALIGNMENT = 4096;
+
 /**
  * @brief Header metadata for files on disk which contain pages.
  */
@@ -42,6 +55,16 @@ struct FileHeader {
      */
     PageId first_free_page;
 
+    /**
+     * Page number of the last used page in the file, the tail of the used list.
+     */
+    PageId last_used_page;
+
+    /**
+     * Layout of the pages of a PageFile, Page::FORMAT once the file is created; 0 in a BlobFile.
+     */
+    std::uint32_t page_format;
+
     /**
      * Returns true if this file header is equal to the other.
      *
@@ -52,7 +75,9 @@ struct FileHeader {
         return num_pages == rhs.num_pages &&
                num_free_pages == rhs.num_free_pages &&
                first_used_page == rhs.first_used_page &&
-               first_free_page == rhs.first_free_page;
+               first_free_page == rhs.first_free_page &&
+               last_used_page == rhs.last_used_page &&
+               page_format == rhs.page_format;
     }
 };
 
@@ -60,17 +85,55 @@ struct FileHeader {
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
+ * The File class wraps a POSIX file descriptor of an underlying file on disk.  Files contain
  * fixed-sized pages, and they never deallocate space (though they do reuse
  * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * underlying file, they will share the descriptor in memory.
  * If a file that has already been opened (possibly by another query), then the File class
- * detects this (by looking in the open_streams_ map) and just returns a file object with
- * the already created stream for the file without actually opening the UNIX file again.
+ * detects this (by looking its name up in the registry of open files) and just returns a file
+ * object with the already opened descriptor for the file without actually opening the UNIX
+ * file again.
  *
- * @warning This class is not threadsafe.
+ * Pages are read and written with positional pread and pwrite, so there is no shared file
+ * position and page reads from several threads run concurrently. Allocation, deletion and
+ * the cached header are guarded by a per-file lock. Opening and closing files is not
+ * threadsafe.
  */
 
+/**
+ * @brief Number of buckets of a FreeSpaceMap, each FREE_SPACE_BUCKET_BYTES of free space wide.
+ */
+const int FREE_SPACE_BUCKETS = 32;
+const std::size_t FREE_SPACE_BUCKET_BYTES = Page::SIZE / FREE_SPACE_BUCKETS;
+
+/**
+ * @brief Used pages of a PageFile by the free space they had when last written, in buckets of
+ * FREE_SPACE_BUCKET_BYTES, so that a page with room for a record is found by looking at a fixed number of
+ * buckets rather than at pages.
+ */
+class FreeSpaceMap {
+   public:
+    /**
+     * Records the free space of a page, replacing what was recorded for it.
+     */
+    void set(const PageId page_number, const std::size_t free_bytes);
+
+    /**
+     * Drops a page, which has been deleted.
+     */
+    void remove(const PageId page_number);
+
+    /**
+     * Returns a page with at least the given free space, from the emptiest bucket that is sure to hold enough,
+     * or Page::INVALID_NUMBER if there is none.
+     */
+    PageId find(const std::size_t free_bytes) const;
+
+   private:
+    std::unordered_set<PageId> buckets_[FREE_SPACE_BUCKETS];
+    std::unordered_map<PageId, int> bucket_of_;
+};
+
 class File {
    public:
     /**
@@ -94,6 +157,18 @@ class File {
      */
     static void remove(const std::string& filename);
 
+    /**
+     * Renames an existing file, moving its checksum and compressed page map
+     * files with it.
+     *
+     * @param from  Name of the file.
+     * @param to    New name of the file.
+     * @throws  FileNotFoundException   If the file doesn't exist.
+     * @throws  FileExistsException     If a file named to exists.
+     * @throws  FileOpenException       If the file is currently open.
+     */
+    static void rename(const std::string& from, const std::string& to);
+
     /**
      * Returns true if the file exists and is open.
      *
@@ -102,7 +177,7 @@ class File {
     static bool isOpen(const std::string& filename);
 
     /**
-     * Returns true if the file exists and is open.
+     * Returns true if the file exists.
      *
      * @param filename  Name of the file.
      */
@@ -121,6 +196,25 @@ class File {
      */
     virtual Page allocatePage(PageId& new_page_number) = 0;
 
+    /**
+     * Allocates a new page in the file and builds it directly in the caller's
+     * buffer, such as a buffer pool frame.
+     *
+     * @param new_page_number   Set to the number of the new page.
+     * @param page              Receives the new page.
+     */
+    virtual void allocatePageInto(PageId& new_page_number, Page& page) = 0;
+
+    /**
+     * Allocates a new page as allocatePageInto does, but at the end of the file
+     * where the file can tell, so that pages appended one after another get
+     * consecutive numbers. Files that cannot tell just allocate the page.
+     *
+     * @param new_page_number   Set to the number of the new page.
+     * @param page              Receives the new page.
+     */
+    virtual void appendPageInto(PageId& new_page_number, Page& page) { allocatePageInto(new_page_number, page); }
+
     /**
      * Reads an existing page from the file.
      *
@@ -131,6 +225,18 @@ class File {
      */
     virtual Page readPage(const PageId page_number) const = 0;
 
+    /**
+     * Reads an existing page from the file directly into the caller's buffer,
+     * such as a buffer pool frame, instead of returning a copy.
+     *
+     * @param page_number   Number of page to read.
+     * @param page          Receives the page; its contents are undefined if an
+     *                      exception is thrown.
+     * @throws  InvalidPageException  If the page doesn't exist in the file or is
+     *                                not currently used.
+     */
+    virtual void readPageInto(const PageId page_number, Page& page) const = 0;
+
     /**
      * Writes a page into the file at the given page number.
      * No bounds checking is performed.
@@ -147,6 +253,21 @@ class File {
      */
     virtual void deletePage(const PageId page_number) = 0;
 
+    /**
+     * Tells an asynchronous I/O engine where a page lives if it may be read and
+     * written as a plain page image there, bypassing readPage and writePage.
+     * Files whose page I/O does more than that return false, the default.
+     *
+     * @param page_number   Number of page.
+     * @param buffer        Memory the page would be transferred from or to.
+     * @param fd            Set to the descriptor of the file.
+     * @param offset        Set to the position of the page in the file.
+     * @return  True if the page may be transferred directly.
+     */
+    virtual bool pageLocation(const PageId page_number, const void* buffer, int& fd, off_t& offset) const {
+        return false;
+    }
+
     /**
      * Returns the name of the file this object represents.
      *
@@ -161,22 +282,118 @@ class File {
      */
     PageId getFirstPageNo();
 
+    /**
+     * Writes the cached file header to disk if it has changed.
+     */
+    void flushHeader() const;
+
+    /**
+     * Writes the cached header out and waits until every write to the file has
+     * reached the disk. Page writes are not synced one by one; this is the point
+     * at which they become durable.
+     */
+    void sync() const;
+
+    /**
+     * Sets how many header updates may stay in memory before the header is
+     * written back to disk. 0, the default, writes it only when the file is
+     * flushed or closed.
+     *
+     * @param writes  Number of header updates between write-backs.
+     */
+    void setHeaderCheckpoint(const int writes);
+
+    /**
+     * Sets whether files opened from now on bypass the operating system's page
+     * cache with O_DIRECT. Direct I/O goes through buffers aligned to
+     * DIRECT_IO_ALIGNMENT; a file system that does not support it opens the file
+     * normally instead.
+     *
+     * @param enabled  True to open files for direct I/O.
+     */
+    static void setDirectIO(const bool enabled);
+
+    /**
+     * Sets whether files opened from now on keep a CRC32C checksum of every
+     * page they write, in a PageChecksums file next to them, and check pages
+     * read against it. A file whose checksum file exists keeps checksums
+     * whatever the setting; removing the file removes its checksums too.
+     *
+     * @param enabled  True to checksum the pages of files opened from now on.
+     */
+    static void setChecksums(const bool enabled);
+
+    /**
+     * @return  True if this file checksums its pages.
+     */
+    bool checksummed() const { return state_->checksums != NULL; }
+
+    /**
+     * Sets whether files created from now on store their pages LZ4-compressed,
+     * in extents of varying size found through a CompressedPages page map next
+     * to them. A file is opened compressed if it has a page map, whatever the
+     * setting. Compressed files are not opened for direct I/O and cannot be
+     * mapped; removing one removes its page map too.
+     *
+     * @param enabled  True to compress the pages of files created from now on.
+     */
+    static void setCompression(const bool enabled);
+
+    /**
+     * @return  True if this file stores its pages compressed.
+     */
+    bool compressed() const { return state_->compressed != NULL; }
+
    protected:
     /**
      * Returns the position of the page with the given number in the file (as an
-     * offset from the beginning of the file).
+     * offset from the beginning of the file). The header takes the first page
+     * slot, so every page starts on a page boundary.
      *
      * @param page_number   Number of page.
      * @return  Position of page in file.
      */
-    static std::streampos pagePosition(const PageId page_number) {
-        return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+    static off_t pagePosition(const PageId page_number) {
+        return (off_t)page_number * Page::SIZE;
     }
 
+    /**
+     * Reads length bytes at offset with pread. Bytes past the end of the file
+     * read as zeros.
+     *
+     * @param offset  Position in the file.
+     * @param data    Buffer of at least length bytes.
+     * @param length  Number of bytes to read.
+     */
+    void readAt(const off_t offset, void* data, const size_t length) const;
+
+    /**
+     * Writes length bytes at offset with pwrite.
+     *
+     * @param offset  Position in the file.
+     * @param data    Bytes to write.
+     * @param length  Number of bytes to write.
+     */
+    void writeAt(const off_t offset, const void* data, const size_t length) const;
+
+    /**
+     * Writes headLength bytes from head followed by tailLength bytes from tail
+     * at offset with one pwritev, so that the two parts need not be copied
+     * together first.
+     *
+     * @param offset      Position in the file.
+     * @param head        First part of the bytes to write.
+     * @param headLength  Length of the first part.
+     * @param tail        Second part of the bytes to write.
+     * @param tailLength  Length of the second part.
+     */
+    void writeAt(const off_t offset, const void* head, const size_t headLength, const void* tail,
+                 const size_t tailLength) const;
+
     /**
      * Opens the underlying file named in filename_.
      * This method only opens the file if no other File objects exist that access
-     * the same filesystem file; otherwise, it reuses the existing stream.
+     * the same filesystem file; otherwise, it reuses the existing descriptor.
      *
      * @param create_new  Whether to create a new file.
      * @throws  FileExistsException     If the underlying file exists and
@@ -187,38 +404,114 @@ class File {
     void openIfNeeded(const bool create_new);
 
     /**
-     * Closes the underlying file stream in <stream_>.
+     * Closes the underlying file descriptor in <state_>.
      * This method only closes the file if no other File objects exist that access
      * the same file.
      */
     void close();
 
     /**
-     * Reads the header for this file from disk.
+     * Returns the header for this file, read from disk the first time it is
+     * needed and kept in memory after that.
      *
      * @return  The file header.
      */
     FileHeader readHeader() const;
 
     /**
-     * Writes the given header to the disk as the header for this file.
+     * Replaces the cached header for this file. It is written to disk by
+     * flushHeader, when the file is closed, or after every header checkpoint
+     * interval of updates.
      *
      * @param header  File header to write.
      */
     void writeHeader(const FileHeader& header);
 
-    typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
-    typedef std::map<std::string, int> CountMap;
+    /**
+     * @brief In-memory state of an open file, shared by every File object on it.
+     */
+    struct OpenFileState {
+        /**
+         * Descriptor of the file, closed with the state.
+         */
+        int fd;
+
+        /**
+         * True if the file was opened with O_DIRECT.
+         */
+        bool direct_io;
+
+        /**
+         * Guards the header, the used pages and page writes that depend on them. Recursive, since public
+         * operations call each other.
+         */
+        std::recursive_mutex lock;
+
+        /**
+         * Cached copy of the file header, valid once header_loaded is set.
+         */
+        FileHeader header;
+        bool header_loaded;
+
+        /**
+         * True if header has changed since it was last written to disk.
+         */
+        bool header_dirty;
+
+        /**
+         * Header updates since it was last written, and the number after which it is written back; 0 leaves
+         * the header in memory until the file is flushed or closed.
+         */
+        int header_writes;
+        int header_checkpoint;
+
+        /**
+         * Page numbers of the used pages in order, read from the used list on first need.
+         */
+        std::set<PageId> used_pages;
+        bool used_pages_loaded;
+
+        /**
+         * Free space of the used pages, found by reading every one of them on first need and kept up to date
+         * by page writes after that.
+         */
+        FreeSpaceMap free_space;
+        bool free_space_loaded;
+
+        /**
+         * Checksums of the file's pages, or null if it keeps none.
+         */
+        std::unique_ptr<PageChecksums> checksums;
+
+        /**
+         * Page map and extents of the file's pages, or null if they are stored as they are. Every read and
+         * write past the file header goes through it.
+         */
+        std::unique_ptr<CompressedPages> compressed;
+
+        /**
+         * Number of File objects on the file.
+         */
+        int open_count;
+
+        OpenFileState(const int fdIn, const bool directIn)
+            : fd(fdIn), direct_io(directIn), header_loaded(false), header_dirty(false), header_writes(0),
+              header_checkpoint(0), used_pages_loaded(false), free_space_loaded(false), open_count(1) {}
+
+        ~OpenFileState();
+    };
+
+    typedef std::unordered_map<std::string, std::uint32_t> FileIdMap;
 
     /**
-     * Streams for opened files.
+     * Id of every file name opened so far, interned the first time it is opened and kept after it is closed.
      */
-    static StreamMap open_streams_;
+    static FileIdMap file_ids_;
 
     /**
-     * Counts for opened files.
+     * In-memory state of each file by id, null while the file is not open.
      */
-    static CountMap open_counts_;
+    static std::vector<std::shared_ptr<OpenFileState> > open_states_;
 
     /**
      * Name of the file this object represents.
@@ -226,9 +519,29 @@ class File {
     std::string filename_;
 
     /**
-     * Stream for underlying filesystem object.
+     * Interned id of filename_.
+     */
+    std::uint32_t id_;
+
+    /**
+     * In-memory state of the underlying file, shared by every File object on it.
+     */
+    std::shared_ptr<OpenFileState> state_;
+
+    /**
+     * Whether files opened from now on use O_DIRECT.
+     */
+    static bool direct_io_;
+
+    /**
+     * Whether files opened from now on checksum their pages.
+     */
+    static bool checksums_;
+
+    /**
+     * Whether files created from now on compress their pages.
      */
-    std::shared_ptr<std::fstream> stream_;
+    static bool compression_;
 
     friend class FileIterator;
 };
@@ -245,13 +558,14 @@ class PageFile : public File {
 
     /**
      * Opens the file named fileName and returns the corresponding File object.
-     * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+     * It first checks if the file is already open. If so, then the new File object created uses the same file descriptor to read to or write fom
      * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-     * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-     * open_streams_ map.
+     * opened again. Otherwise the UNIX file is actually opened. The fileName and the state associated with this File object are inserted into the
+     * open_states_ map.
      *
      * @param filename  Name of the file.
      * @throws  FileNotFoundException   If the requested file doesn't exist.
+     * @throws  FileFormatException     If the file holds its pages in another layout.
      */
     static PageFile open(const std::string& filename);
 
@@ -264,6 +578,8 @@ class PageFile : public File {
      *                                  create_new is true.
      * @throws  FileNotFoundException   If the underlying file doesn't exist and
      *                                  create_new is false.
+     * @throws  FileFormatException     If the underlying file exists and holds
+     *                                  its pages in another layout.
      */
     PageFile(const std::string& name, const bool create_new);
 
@@ -290,12 +606,18 @@ class PageFile : public File {
     ~PageFile();
 
     /**
-     * Allocates a new page in the file.
+     * Allocates a new page in the file. A new page is appended after the tail of the used list; a free page
+     * being reused is linked in between its neighbours in page number order, found in the used page set.
      *
      * @return The new page.
      */
     Page allocatePage(PageId& new_page_number) override;
 
+    /**
+     * Allocates a new page as allocatePage does, building it in page.
+     */
+    void allocatePageInto(PageId& new_page_number, Page& page) override;
+
     /**
      * Reads an existing page from the file.
      *
@@ -306,6 +628,14 @@ class PageFile : public File {
      */
     Page readPage(const PageId page_number) const override;
 
+    /**
+     * Reads an existing page from the file into page.
+     *
+     * @throws  InvalidPageException  If the page doesn't exist in the file or is
+     *                                not currently used.
+     */
+    void readPageInto(const PageId page_number, Page& page) const override;
+
     /**
      * Writes a page into the file at the given page number.
      * No bounds checking is performed.
@@ -316,7 +646,7 @@ class PageFile : public File {
     void writePage(const PageId page_number, const Page& new_page) override;
 
     /**
-     * Deletes a page from the file.
+     * Deletes a page from the file. Its predecessor in the used list is found in the used page set.
      *
      * @param page_number   Number of page to delete.
      */
@@ -337,21 +667,44 @@ class PageFile : public File {
      */
     FileIterator end();
 
+    /**
+     * Returns the numbers of up to count used pages that follow the given page
+     * in the used list, in list order, so that a scan can read them ahead.
+     *
+     * @param page_number   Number of a used page.
+     * @param count         Largest number of page numbers to return.
+     * @return  Numbers of the following used pages.
+     */
+    std::vector<PageId> usedPagesAfter(const PageId page_number, const std::size_t count);
+
+    /**
+     * Inserts a record into a used page with room for it, found through the
+     * file's free space map, or into a new page if none has room. The page
+     * is read and written back directly, so none of the file's pages may be
+     * changed in a buffer pool meanwhile.
+     *
+     * @param record_data  Bytes that compose the record.
+     * @return  ID of the new record.
+     * @throws  InsufficientSpaceException  If the record does not fit in an
+     *                                      empty page.
+     */
+    RecordId insertRecord(const std::string& record_data);
+
    private:
     /**
      * Reads a page from the file.  If <allow_free> is not set, an exception
      * will be thrown if the page read from disk is not currently in use.
      *
-     * No bounds checking is performed; the underlying file stream will throw
-     * an exception if the page is past the end of the file.
+     * No bounds checking is performed; a page past the end of the file reads
+     * as zeros, which is a free page.
      *
      * @param page_number   Number of page to read.
+     * @param page          Receives the page.
      * @param allow_free    Whether to allow reading a free (unused) page.
-     * @return  The page.
      * @throws  InvalidPageException  If the page is free (unused) and
      *                                allow_free is false.
      */
-    Page readPage(const PageId page_number, const bool allow_free) const;
+    void readPageInto(const PageId page_number, Page& page, const bool allow_free) const;
 
     /**
      * Writes a page into the file at the given page number with the given header.
@@ -374,9 +727,42 @@ class PageFile : public File {
      */
     PageHeader readPageHeader(const PageId page_number) const;
 
+    /**
+     * Writes only the header of the given page to disk.  No bounds checking is
+     * performed.
+     *
+     * @param page_number   Number of page whose header is to be written.
+     * @param header        Header of page to write.
+     */
+    void writePageHeader(const PageId page_number, const PageHeader& header);
+
+    /**
+     * Returns the page numbers of the used pages in order, walking the used list
+     * the first time they are needed after the file is opened.
+     *
+     * @param header  Current file header.
+     * @return  The used page numbers.
+     */
+    std::set<PageId>& usedPages(const FileHeader& header);
+
+    /**
+     * Returns the free space map of the file, reading every used page the
+     * first time it is needed after the file is opened.
+     *
+     * @return  The free space map.
+     */
+    FreeSpaceMap& freeSpace();
+
     friend class FileIterator;
 };
 
+/**
+ * @brief Class which represents a file of raw pages, such as an index file.
+ *
+ * Pages carry no header of their own. Deleted pages are kept on a free list that runs through the first PageId
+ * of each free page and starts at first_free_page in the file header; allocatePage reuses them before the file
+ * grows.
+ */
 class BlobFile : public File {
    public:
     /**
@@ -389,10 +775,10 @@ class BlobFile : public File {
 
     /**
      * Opens the file named fileName and returns the corresponding File object.
-     * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+     * It first checks if the file is already open. If so, then the new File object created uses the same file descriptor to read to or write fom
      * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-     * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-     * open_streams_ map.
+     * opened again. Otherwise the UNIX file is actually opened. The fileName and the state associated with this File object are inserted into the
+     * open_states_ map.
      *
      * @param filename  Name of the file.
      * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -436,12 +822,41 @@ class BlobFile : public File {
     ~BlobFile();
 
     /**
-     * Allocates a new page in the file.
+     * Allocates a page in the file, reusing the most recently deleted page if there is one.
      *
      * @return The new page.
      */
     Page allocatePage(PageId& new_page_number) override;
 
+    /**
+     * Allocates a page as allocatePage does, building it in page.
+     */
+    void allocatePageInto(PageId& new_page_number, Page& page) override;
+
+    /**
+     * Adds a page holding the given contents at the end of the file, writing it
+     * once. Deleted pages are not reused, so pages appended one after another
+     * get consecutive numbers.
+     *
+     * @param new_page_number   Set to the number of the new page.
+     * @param page              Contents of the new page.
+     */
+    void appendPage(PageId& new_page_number, const Page& page);
+
+    /**
+     * Appends an empty page as appendPage does, building it in page.
+     */
+    void appendPageInto(PageId& new_page_number, Page& page) override;
+
+    /**
+     * Brings the header in line with pages written back by replaying a log, which records neither the pages
+     * allocated nor the pages freed: the file grows to hold at least page_count pages, and its free list is
+     * dropped, leaking the free pages rather than handing out one that is in use again.
+     *
+     * @param page_count  Number of pages the file holds at least.
+     */
+    void restoreExtent(const PageId page_count);
+
     /**
      * Reads an existing page from the file.
      *
@@ -452,6 +867,18 @@ class BlobFile : public File {
      */
     Page readPage(const PageId page_number) const override;
 
+    /**
+     * Reads an existing page from the file into page.
+     */
+    void readPageInto(const PageId page_number, Page& page) const override;
+
+    /**
+     * Reads an existing page from the file into page, checking it against the
+     * file's checksums only if verify is true. Replaying a log reads pages a
+     * crash may have torn this way, since it writes them back whole.
+     */
+    void readPageInto(const PageId page_number, Page& page, const bool verify) const;
+
     /**
      * Writes a page into the file at the given page number.
      * No bounds checking is performed.
@@ -462,9 +889,17 @@ class BlobFile : public File {
     void writePage(const PageId page_number, const Page& new_page) override;
 
     /**
-     * Deletes a page from the file.
+     * Pages of a blob file are plain page images, so the page can be transferred
+     * directly, provided the buffer is aligned if the file is open for direct I/O
+     * and the file keeps no checksums and is not compressed.
+     */
+    bool pageLocation(const PageId page_number, const void* buffer, int& fd, off_t& offset) const override;
+
+    /**
+     * Deletes a page from the file by pushing it onto the free list.
      *
      * @param page_number   Number of page to delete.
+     * @throws  InvalidPageException  If the page doesn't exist in the file.
      */
     void deletePage(const PageId page_number) override;
 };
@@ -7,22 +7,158 @@
 
 #include "filescan.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/invalid_record_exception.h"
 
 namespace badgerdb {
 
+/**
+ * Default number of pages a scan reads ahead
+ */
+const std::uint32_t FILESCAN_READ_AHEAD = 8;
+
+ScanPredicate::ScanPredicate() : attrByteOffset(0), attrType(INTEGER), op(GTE), intValue(0), doubleValue(0) {
+    memset(stringValue, 0, STRINGSIZE);
+}
+
+ScanPredicate::ScanPredicate(const int attrByteOffset, const Datatype attrType, const Operator op, const void *value)
+    : attrByteOffset(attrByteOffset), attrType(attrType), op(op), intValue(0), doubleValue(0) {
+    memset(stringValue, 0, STRINGSIZE);
+    switch (attrType) {
+        case INTEGER:
+            memcpy(&intValue, value, sizeof(intValue));
+            break;
+        case DOUBLE:
+            memcpy(&doubleValue, value, sizeof(doubleValue));
+            break;
+        case STRING:
+            strncpy(stringValue, static_cast<const char *>(value), STRINGSIZE);
+            break;
+    }
+}
+
+/**
+ * Applies a comparison to the result of comparing an attribute with the constant, negative if it is less.
+ */
+static inline bool compareResult(const int order, const Operator op) {
+    switch (op) {
+        case LT:
+            return order < 0;
+        case LTE:
+            return order <= 0;
+        case GTE:
+            return order >= 0;
+        case GT:
+            return order > 0;
+    }
+    return false;
+}
+
+template <class T>
+static inline bool compareValue(const T value, const T bound, const Operator op) {
+    switch (op) {
+        case LT:
+            return value < bound;
+        case LTE:
+            return value <= bound;
+        case GTE:
+            return value >= bound;
+        case GT:
+            return value > bound;
+    }
+    return false;
+}
+
+/**
+ * Sets match[i] to whether values[i] op bound holds, four values per SSE2 compare.
+ */
+static void matchInts(const std::int32_t *values, const size_t count, const std::int32_t bound, const Operator op,
+                      char *match) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i bounds = _mm_set1_epi32(bound);
+    const __m128i ones = _mm_set1_epi32(-1);
+    for (; i + 4 <= count; i += 4) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+        __m128i m;
+        switch (op) {
+            case LT:
+                m = _mm_cmplt_epi32(v, bounds);
+                break;
+            case LTE:
+                m = _mm_xor_si128(_mm_cmpgt_epi32(v, bounds), ones);
+                break;
+            case GTE:
+                m = _mm_xor_si128(_mm_cmplt_epi32(v, bounds), ones);
+                break;
+            default:
+                m = _mm_cmpgt_epi32(v, bounds);
+                break;
+        }
+        const int bits = _mm_movemask_ps(_mm_castsi128_ps(m));
+        for (int k = 0; k < 4; k++) match[i + k] = (bits >> k) & 1;
+    }
+#endif
+    for (; i < count; i++) match[i] = compareValue(values[i], bound, op);
+}
+
+/**
+ * Sets match[i] to whether values[i] op bound holds, two values per SSE2 compare. NaN matches nothing.
+ */
+static void matchDoubles(const double *values, const size_t count, const double bound, const Operator op,
+                         char *match) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128d bounds = _mm_set1_pd(bound);
+    for (; i + 2 <= count; i += 2) {
+        const __m128d v = _mm_loadu_pd(values + i);
+        __m128d m;
+        switch (op) {
+            case LT:
+                m = _mm_cmplt_pd(v, bounds);
+                break;
+            case LTE:
+                m = _mm_cmple_pd(v, bounds);
+                break;
+            case GTE:
+                m = _mm_cmpge_pd(v, bounds);
+                break;
+            default:
+                m = _mm_cmpgt_pd(v, bounds);
+                break;
+        }
+        const int bits = _mm_movemask_pd(m);
+        match[i] = bits & 1;
+        match[i + 1] = (bits >> 1) & 1;
+    }
+#endif
+    for (; i < count; i++) match[i] = compareValue(values[i], bound, op);
+}
+
 FileScan::FileScan(const std::string &name, BufMgr *bufferMgr) {
     file = new PageFile(name, false);  // dont create new file
     bufMgr = bufferMgr;
     curDirtyFlag = false;
     curPage = NULL;
+    readAhead = FILESCAN_READ_AHEAD;
+    prefetchMark = Page::INVALID_NUMBER;
     filePageIter = file->begin();
 }
 
 FileScan::~FileScan() {
     // generally must unpin last page of the scan
     if (curPage != NULL) {
-        bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+        bufMgr->unPinPage(file, filePageIter.current_page_number(), curDirtyFlag);
         curPage = NULL;
         curDirtyFlag = false;
         filePageIter = file->begin();
@@ -32,8 +168,6 @@ FileScan::~FileScan() {
 }
 
 void FileScan::scanNext(RecordId &outRid) {
-    std::string rec;
-
     if (filePageIter == file->end()) {
         throw EndOfFileException();
     }
@@ -46,64 +180,318 @@ void FileScan::scanNext(RecordId &outRid) {
             throw EndOfFileException();
         }
 
-        // read the first page of the file
-        bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+        // read the first page of the file, starting the reads of the pages after it
+        prefetchMark = filePageIter.current_page_number();
+        prefetchAfter(prefetchMark);
+        bufMgr->readPage(file, filePageIter.current_page_number(), curPage, ACCESS_SCAN);
         curDirtyFlag = false;
 
         // get the first record off the page
         pageRecordIter = curPage->begin();
 
-        if (pageRecordIter != curPage->end()) {
-            // get pointer to record
-            rec = *pageRecordIter;
-
+        if (pageRecordIter != curPage->end() && filter.satisfies(pageRecordIter.view())) {
             outRid = pageRecordIter.getCurrentRecord();
             return;
         }
     }
 
-    // Loop, looking for a record that satisfied the predicate.
-    // First try and get the next record off the current page
-    pageRecordIter++;
-
-    while (pageRecordIter == curPage->end()) {
-        // unpin the current page
-        bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-        curPage = NULL;
-        curDirtyFlag = false;
+    // Loop, looking for a record that satisfies the predicate.
+    do {
+        // First try and get the next record off the current page
+        pageRecordIter++;
 
-        filePageIter++;
-        if (filePageIter == file->end()) {
+        while (pageRecordIter == curPage->end()) {
+            // unpin the current page
+            bufMgr->unPinPage(file, filePageIter.current_page_number(), curDirtyFlag);
             curPage = NULL;
-            throw EndOfFileException();
-        }
+            curDirtyFlag = false;
 
-        // read the next page of the file
-        bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+            filePageIter++;
+            if (filePageIter == file->end()) {
+                curPage = NULL;
+                throw EndOfFileException();
+            }
 
-        // get the first record off the page
-        pageRecordIter = curPage->begin();
-    }
+            // read the next page of the file
+            prefetchAfter(filePageIter.current_page_number());
+            bufMgr->readPage(file, filePageIter.current_page_number(), curPage, ACCESS_SCAN);
 
-    // curRec points at a valid record
-    // see if the record satisfies the scan's predicate
-    // get a pointer to the record
-    rec = *pageRecordIter;
+            // get the first record off the page
+            pageRecordIter = curPage->begin();
+        }
+    } while (!filter.satisfies(pageRecordIter.view()));
 
+    // curRec points at a valid record
     // return rid of the record
     outRid = pageRecordIter.getCurrentRecord();
     return;
 }
 
+size_t FileScan::scanNextBatch(std::vector<ScanRecord> &out) {
+    out.clear();
+    while (out.empty()) {
+        if (filePageIter == file->end()) return 0;
+
+        if (curPage == NULL) {
+            // first call: start at the first page, starting the reads of the pages after it
+            filePageIter = file->begin();
+            if (filePageIter == file->end()) return 0;
+            prefetchMark = filePageIter.current_page_number();
+        } else {
+            bufMgr->unPinPage(file, filePageIter.current_page_number(), curDirtyFlag);
+            curPage = NULL;
+            curDirtyFlag = false;
+
+            filePageIter++;
+            if (filePageIter == file->end()) return 0;
+        }
+
+        prefetchAfter(filePageIter.current_page_number());
+        bufMgr->readPage(file, filePageIter.current_page_number(), curPage, ACCESS_SCAN);
+        pageRecordIter = curPage->begin();
+        filter.collect(curPage, out);
+    }
+    return out.size();
+}
+
+void FileScan::setPredicate(const ScanPredicate &scanPredicate) {
+    filter.setPredicate(scanPredicate);
+}
+
+void FileScan::clearPredicate() {
+    filter.clearPredicate();
+}
+
+PageFilter::PageFilter() : hasPredicate(false) {}
+
+void PageFilter::setPredicate(const ScanPredicate &scanPredicate) {
+    predicate = scanPredicate;
+    hasPredicate = true;
+}
+
+void PageFilter::clearPredicate() {
+    hasPredicate = false;
+}
+
+bool PageFilter::satisfies(const RecordView &record) const {
+    if (!hasPredicate) return true;
+    switch (predicate.attrType) {
+        case INTEGER: {
+            if (predicate.attrByteOffset + sizeof(std::int32_t) > record.length) return false;
+            std::int32_t value;
+            memcpy(&value, record.data + predicate.attrByteOffset, sizeof(value));
+            return compareValue(value, predicate.intValue, predicate.op);
+        }
+        case DOUBLE: {
+            if (predicate.attrByteOffset + sizeof(double) > record.length) return false;
+            double value;
+            memcpy(&value, record.data + predicate.attrByteOffset, sizeof(value));
+            return compareValue(value, predicate.doubleValue, predicate.op);
+        }
+        case STRING: {
+            if (predicate.attrByteOffset + (size_t)STRINGSIZE > record.length) return false;
+            // the attribute is cut like a string key: at its first NUL or after STRINGSIZE bytes
+            char value[STRINGSIZE];
+            memset(value, 0, STRINGSIZE);
+            strncpy(value, record.data + predicate.attrByteOffset, STRINGSIZE);
+            return compareResult(memcmp(value, predicate.stringValue, STRINGSIZE), predicate.op);
+        }
+    }
+    return false;
+}
+
+void PageFilter::collect(Page *page, std::vector<ScanRecord> &out) {
+    pageRecords.clear();
+    for (PageIterator iter = page->begin(); iter != page->end(); ++iter) {
+        ScanRecord entry;
+        entry.rid = iter.getCurrentRecord();
+        entry.record = iter.view();
+        pageRecords.push_back(entry);
+    }
+    if (!hasPredicate) {
+        out.insert(out.end(), pageRecords.begin(), pageRecords.end());
+        return;
+    }
+
+    // gather the attribute of every record into one array and compare them all at once; records too short to
+    // hold the attribute are compared with a stand-in value and dropped afterwards
+    const size_t count = pageRecords.size();
+    const size_t offset = predicate.attrByteOffset;
+    matches.assign(count, 0);
+    if (predicate.attrType == INTEGER) {
+        intValues.assign(count, 0);
+        for (size_t i = 0; i < count; i++)
+            if (offset + sizeof(std::int32_t) <= pageRecords[i].record.length)
+                memcpy(&intValues[i], pageRecords[i].record.data + offset, sizeof(std::int32_t));
+        matchInts(intValues.data(), count, predicate.intValue, predicate.op, matches.data());
+    } else if (predicate.attrType == DOUBLE) {
+        doubleValues.assign(count, 0);
+        for (size_t i = 0; i < count; i++)
+            if (offset + sizeof(double) <= pageRecords[i].record.length)
+                memcpy(&doubleValues[i], pageRecords[i].record.data + offset, sizeof(double));
+        matchDoubles(doubleValues.data(), count, predicate.doubleValue, predicate.op, matches.data());
+    } else {
+        for (size_t i = 0; i < count; i++) matches[i] = satisfies(pageRecords[i].record);
+    }
+
+    const size_t width = predicate.attrType == INTEGER ? sizeof(std::int32_t) : sizeof(double);
+    for (size_t i = 0; i < count; i++) {
+        if (matches[i] && (predicate.attrType == STRING || offset + width <= pageRecords[i].record.length))
+            out.push_back(pageRecords[i]);
+    }
+}
+
 // returns pointer to the current record.  page is left pinned
 // and the scan logic is required to unpin the page
 std::string FileScan::getRecord() {
     return *pageRecordIter;
 }
 
+RecordView FileScan::viewRecord() const {
+    return pageRecordIter.view();
+}
+
+const char *FileScan::attribute(const std::size_t byteOffset, const std::size_t length) const {
+    const RecordView record = pageRecordIter.view();
+    if (byteOffset + length > record.length)
+        throw InvalidRecordException(pageRecordIter.getCurrentRecord(), curPage->page_number());
+    return record.data + byteOffset;
+}
+
 // mark current page of scan dirty
 void FileScan::markDirty() {
     curDirtyFlag = true;
 }
 
+void FileScan::setReadAhead(const std::uint32_t pages) {
+    readAhead = pages;
+}
+
+void FileScan::prefetchAfter(const PageId pageNo) {
+    if (readAhead == 0 || pageNo != prefetchMark) return;
+
+    // the pages are fetched in batches, and the next batch starts while about half of this one is unread
+    std::vector<PageId> pages = file->usedPagesAfter(pageNo, readAhead);
+    for (size_t i = 0; i < pages.size(); i++)
+        bufMgr->prefetch(file, pages[i], ACCESS_SCAN);
+    prefetchMark = pages.empty() ? Page::INVALID_NUMBER : pages[(pages.size() - 1) / 2];
+}
+
+ParallelScan::ParallelScan(const std::string &name, BufMgr *bufferMgr, const unsigned threads,
+                           const std::uint32_t morsel) {
+    file = new PageFile(name, false);  // dont create new file
+    bufMgr = bufferMgr;
+    numThreads = threads > 0 ? threads : 1;
+    morselPages = morsel > 0 ? morsel : 1;
+}
+
+ParallelScan::~ParallelScan() {
+    bufMgr->flushFile(file);
+    delete file;
+}
+
+void ParallelScan::setPredicate(const ScanPredicate &scanPredicate) {
+    filter.setPredicate(scanPredicate);
+}
+
+void ParallelScan::clearPredicate() {
+    filter.clearPredicate();
+}
+
+void ParallelScan::run(const Consumer &consume) {
+    RunState state;
+    // the used pages are listed once up front, so the morsels are fixed before any worker starts
+    state.pages = file->usedPagesAfter(Page::INVALID_NUMBER, state.pages.max_size());
+    state.nextMorsel = 0;
+    state.failed = false;
+
+    std::vector<std::thread> workers;
+    for (unsigned worker = 1; worker < numThreads; worker++)
+        workers.push_back(std::thread(&ParallelScan::work, this, worker, std::ref(state), std::cref(consume)));
+    work(0, state, consume);  // the calling thread is worker 0
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+
+    if (state.error) std::rethrow_exception(state.error);
+}
+
+void ParallelScan::work(const unsigned worker, RunState &state, const Consumer &consume) {
+    PageFilter pageFilter(filter);
+    std::vector<ScanRecord> records;
+    const size_t numMorsels = (state.pages.size() + morselPages - 1) / morselPages;
+    try {
+        while (!state.failed) {
+            const size_t morsel = state.nextMorsel++;
+            if (morsel >= numMorsels) break;
+            const size_t first = morsel * morselPages;
+            const size_t last = std::min(first + morselPages, state.pages.size());
+            for (size_t i = first; i < last && !state.failed; i++) {
+                // the next page of the morsel is read while this one is filtered
+                if (i + 1 < last) bufMgr->prefetch(file, state.pages[i + 1], ACCESS_SCAN);
+
+                Page *page;
+                bufMgr->readPage(file, state.pages[i], page, ACCESS_SCAN);
+                records.clear();
+                try {
+                    pageFilter.collect(page, records);
+                    if (!records.empty()) consume(worker, records);
+                } catch (...) {
+                    bufMgr->unPinPage(file, state.pages[i], false);
+                    throw;
+                }
+                bufMgr->unPinPage(file, state.pages[i], false);
+            }
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> guard(state.errorLock);
+        if (!state.error) state.error = std::current_exception();
+        state.failed = true;
+    }
+}
+
+/**
+ * Orders record ids by page number, then slot number.
+ */
+static bool fileOrder(const RecordId &a, const RecordId &b) {
+    return a.page_number != b.page_number ? a.page_number < b.page_number : a.slot_number < b.slot_number;
+}
+
+RecordFetch::RecordFetch(const std::string &name, BufMgr *bufferMgr, const std::uint32_t pages) {
+    file = new PageFile(name, false);  // dont create new file
+    bufMgr = bufferMgr;
+    readAhead = pages;
+}
+
+RecordFetch::~RecordFetch() {
+    bufMgr->flushFile(file);
+    delete file;
+}
+
+void RecordFetch::run(std::vector<RecordId> &rids, const Consumer &consume) {
+    std::sort(rids.begin(), rids.end(), fileOrder);
+    rids.erase(std::unique(rids.begin(), rids.end()), rids.end());
+
+    std::vector<PageId> pages;
+    for (size_t i = 0; i < rids.size(); i++)
+        if (pages.empty() || pages.back() != rids[i].page_number) pages.push_back(rids[i].page_number);
+
+    // the pages are read once each, with the reads of the next readAhead of them already started
+    size_t prefetched = 1;
+    size_t next = 0;
+    for (size_t p = 0; p < pages.size(); p++) {
+        for (; prefetched < pages.size() && prefetched <= p + readAhead; prefetched++)
+            bufMgr->prefetch(file, pages[prefetched], ACCESS_SCAN);
+
+        Page *page;
+        bufMgr->readPage(file, pages[p], page, ACCESS_SCAN);
+        try {
+            for (; next < rids.size() && rids[next].page_number == pages[p]; next++)
+                consume(rids[next], page->viewRecord(rids[next]));
+        } catch (...) {
+            bufMgr->unPinPage(file, pages[p], false);
+            throw;
+        }
+        bufMgr->unPinPage(file, pages[p], false);
+    }
+}
+
 }  // namespace badgerdb
@@ -7,7 +7,13 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "buffer.h"
 #include "file_iterator.h"
@@ -17,6 +23,107 @@
 
 namespace badgerdb {
 
+/**
+ * @brief Comparison of one fixed-offset attribute of each record with a constant, pushed down into a FileScan.
+ *
+ * The attribute is described the way a BTreeIndex describes its key, so a predicate selects the same records as
+ * an index scan bounded on one side: INTEGER and DOUBLE attributes compare numerically and STRING attributes on
+ * their first STRINGSIZE bytes. Records too short to hold the attribute never match.
+ */
+struct ScanPredicate {
+    /**
+     * Offset of the attribute in the record
+     */
+    int attrByteOffset;
+
+    /**
+     * Type of the attribute
+     */
+    Datatype attrType;
+
+    /**
+     * Comparison that selects a record: attribute op value
+     */
+    Operator op;
+
+    /**
+     * The constant, in the member of attrType
+     */
+    std::int32_t intValue;
+    double doubleValue;
+    char stringValue[STRINGSIZE];
+
+    /**
+     * Builds a predicate that only FileScan's default state uses; set a real one with FileScan::setPredicate.
+     */
+    ScanPredicate();
+
+    /**
+     * Builds a predicate.
+     *
+     * @param attrByteOffset  Offset of the attribute in the record
+     * @param attrType        Type of the attribute
+     * @param op              Comparison
+     * @param value           Pointer to the integer, double or character string to compare with
+     */
+    ScanPredicate(const int attrByteOffset, const Datatype attrType, const Operator op, const void *value);
+};
+
+/**
+ * @brief A record returned by FileScan::scanNextBatch: its id and a view of it in its pinned page.
+ */
+struct ScanRecord {
+    RecordId rid;
+    RecordView record;
+};
+
+/**
+ * @brief Selects the records of a page that satisfy an optional ScanPredicate.
+ *
+ * The attribute of every record of a page is gathered into one array and, for INTEGER and DOUBLE attributes,
+ * compared with SSE2 where the target has it. A filter keeps its scratch arrays between pages, so each thread
+ * scanning needs a filter of its own.
+ */
+class PageFilter {
+   public:
+    PageFilter();
+
+    /**
+     * Restricts the filter to records satisfying a predicate.
+     */
+    void setPredicate(const ScanPredicate &predicate);
+
+    /**
+     * Removes the predicate, so every record passes.
+     */
+    void clearPredicate();
+
+    /**
+     * Returns true if a record passes the filter.
+     */
+    bool satisfies(const RecordView &record) const;
+
+    /**
+     * Appends the records of a page that pass the filter to out, in slot order.
+     */
+    void collect(Page *page, std::vector<ScanRecord> &out);
+
+   private:
+    /**
+     * Predicate records must satisfy, if hasPredicate is set
+     */
+    ScanPredicate predicate;
+    bool hasPredicate;
+
+    /**
+     * Scratch arrays: the records of the page, their attribute values and the match flags
+     */
+    std::vector<ScanRecord> pageRecords;
+    std::vector<std::int32_t> intValues;
+    std::vector<double> doubleValues;
+    std::vector<char> matches;
+};
+
 /**
  * @brief This class is used to sequentially scan records in a relation.
  */
@@ -29,12 +136,33 @@ class FileScan {
     //return RecordId of next record that satisfies the scan
     void scanNext(RecordId &outRid);
 
-    //read current record, returning pointer and length
+    //replaces out with the records of the next page that has any satisfying the predicate, and returns their
+    //number, 0 once the scan is complete. The page stays pinned, and the views valid, until the next call. The
+    //predicate is evaluated over whole pages with SIMD compares. Do not mix with scanNext on one scan.
+    size_t scanNextBatch(std::vector<ScanRecord> &out);
+
+    //restricts the scan to records satisfying a predicate; applies to scanNext and scanNextBatch
+    void setPredicate(const ScanPredicate &predicate);
+
+    //removes the predicate, so every record satisfies the scan
+    void clearPredicate();
+
+    //read current record, returning a copy of it
     std::string getRecord();
 
+    //view current record in place; valid until the scan moves to the next page
+    RecordView viewRecord() const;
+
+    //pointer to a length-byte attribute of the current record, in place; throws InvalidRecordException if the
+    //record is too short to hold it
+    const char *attribute(const std::size_t byteOffset, const std::size_t length) const;
+
     //marks current page of scan dirty
     void markDirty();
 
+    //sets how many pages are prefetched ahead of the scan, 0 to read one page at a time
+    void setReadAhead(const std::uint32_t pages);
+
    private:
     /**
    * File which is being scanned.
@@ -58,6 +186,166 @@ class FileScan {
    * True if page has been updated
    */
     bool curDirtyFlag;
+
+    /**
+   * Number of pages prefetched ahead of the scan
+   */
+    std::uint32_t readAhead;
+
+    /**
+   * Page at which the next batch of pages is prefetched, about halfway through the previous batch
+   */
+    PageId prefetchMark;
+
+    /**
+   * Records the scan returns
+   */
+    PageFilter filter;
+
+    /**
+   * Prefetches the pages following pageNo if the scan has reached prefetchMark.
+   */
+    void prefetchAfter(const PageId pageNo);
+};
+
+/**
+ * Default number of consecutive pages a ParallelScan worker claims at a time
+ */
+const std::uint32_t PARALLELSCAN_MORSEL_PAGES = 16;
+
+/**
+ * @brief Scans the records of a relation with several threads.
+ *
+ * The used pages of the file are cut into morsels of consecutive pages. Each worker thread repeatedly claims the
+ * next morsel not yet taken and scans its pages through a PageFilter of its own, so fast workers take more
+ * morsels and no thread waits for a slow one. The workers share the buffer manager and one open file. Records
+ * of a page are handed to the consumer together, in slot order; the order of the pages and the worker that
+ * scans each are not defined.
+ */
+class ParallelScan {
+   public:
+    /**
+     * Called by a worker with the records of one page that pass the filter, never with none. The views stay
+     * valid until the call returns, while the page is pinned. Calls from different workers run at the same time.
+     */
+    typedef std::function<void(unsigned worker, const std::vector<ScanRecord> &records)> Consumer;
+
+    /**
+     * Constructor of ParallelScan class, opens the relation.
+     *
+     * @param name         Name of the relation
+     * @param bufMgr       Buffer manager the pages are read through
+     * @param threads      Number of worker threads, at least one
+     * @param morselPages  Number of consecutive pages a worker claims at a time, at least one
+     */
+    ParallelScan(const std::string &name, BufMgr *bufMgr, const unsigned threads,
+                 const std::uint32_t morselPages = PARALLELSCAN_MORSEL_PAGES);
+
+    ~ParallelScan();
+
+    //restricts the scan to records satisfying a predicate
+    void setPredicate(const ScanPredicate &predicate);
+
+    //removes the predicate, so every record satisfies the scan
+    void clearPredicate();
+
+    //scans the whole relation, returning once every worker is done. If a worker or the consumer throws, the
+    //other workers stop after their current page and the first exception is rethrown here
+    void run(const Consumer &consume);
+
+    //number of worker threads
+    unsigned threads() const { return numThreads; }
+
+   private:
+    /**
+   * File which is being scanned.
+   */
+    PageFile *file;
+
+    /**
+   * Buffer Manager instance used to read pages into the buffer pool.
+   */
+    BufMgr *bufMgr;
+
+    unsigned numThreads;
+    std::uint32_t morselPages;
+
+    /**
+   * Filter each worker starts from a copy of
+   */
+    PageFilter filter;
+
+    /**
+   * State shared by the workers of one run
+   */
+    struct RunState {
+        std::vector<PageId> pages;
+        std::atomic<std::size_t> nextMorsel;
+        std::atomic<bool> failed;
+        std::mutex errorLock;
+        std::exception_ptr error;
+    };
+
+    /**
+   * Body of a worker thread: claims and scans morsels until none is left or a worker has failed.
+   */
+    void work(const unsigned worker, RunState &state, const Consumer &consume);
+
+    ParallelScan(const ParallelScan &);
+    ParallelScan &operator=(const ParallelScan &);
+};
+
+/**
+ * Default number of distinct pages a RecordFetch keeps prefetched ahead of the page it reads
+ */
+const std::uint32_t RECORDFETCH_READ_AHEAD = 8;
+
+/**
+ * @brief Reads the records of a set of record ids in file order, as a bitmap heap scan does.
+ *
+ * An index range scan returns record ids in key order, so reading their records one by one jumps between the
+ * pages of the relation. A fetch sorts the ids by page and slot number first: each page holding one of them is
+ * then read once, in page order, while the next pages are prefetched, and its records are handed over in slot
+ * order.
+ */
+class RecordFetch {
+   public:
+    /**
+     * Called with each fetched record. The view stays valid until the call returns, while its page is pinned.
+     */
+    typedef std::function<void(const RecordId &rid, const RecordView &record)> Consumer;
+
+    /**
+     * Constructor of RecordFetch class, opens the relation.
+     *
+     * @param name       Name of the relation
+     * @param bufMgr     Buffer manager the pages are read through
+     * @param readAhead  Number of distinct pages prefetched ahead of the one read, 0 to read one page at a time
+     */
+    RecordFetch(const std::string &name, BufMgr *bufMgr, const std::uint32_t readAhead = RECORDFETCH_READ_AHEAD);
+
+    ~RecordFetch();
+
+    //sorts rids by page and slot number, dropping repeated ids, and hands the record of each to consume in that
+    //order. Throws InvalidRecordException for an id whose record does not exist, once the records before it
+    //have been consumed
+    void run(std::vector<RecordId> &rids, const Consumer &consume);
+
+   private:
+    /**
+   * File the records are read from.
+   */
+    PageFile *file;
+
+    /**
+   * Buffer Manager instance used to read pages into the buffer pool.
+   */
+    BufMgr *bufMgr;
+
+    std::uint32_t readAhead;
+
+    RecordFetch(const RecordFetch &);
+    RecordFetch &operator=(const RecordFetch &);
 };
 
 }  // namespace badgerdb
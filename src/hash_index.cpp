@@ -0,0 +1,607 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "hash_index.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+#include "bloom_filter.h"
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "filescan.h"
+
+namespace badgerdb {
+
+/**
+ * Reads a key of the attribute type out of a probe or a record, which need not be aligned.
+ *
+ * @param ptr   Attribute value
+ * @param key   Returns the key
+ */
+static inline void readKey(const void *ptr, int &key) {
+    memcpy(&key, ptr, sizeof(int));
+}
+
+static inline void readKey(const void *ptr, double &key) {
+    memcpy(&key, ptr, sizeof(double));
+}
+
+static inline void readKey(const void *ptr, StringKey &key) {
+    key = StringKey((const char *)ptr);
+}
+
+/**
+ * Hashes a key. Keys equal as keys hash alike, so -0.0 is hashed as 0.0.
+ */
+static inline std::uint64_t hashKey(const int &key) {
+    return BloomFilter::hash(&key, sizeof(key));
+}
+
+static inline std::uint64_t hashKey(const double &key) {
+    const double value = key == 0.0 ? 0.0 : key;
+    return BloomFilter::hash(&value, sizeof(value));
+}
+
+static inline std::uint64_t hashKey(const StringKey &key) {
+    return BloomFilter::hash(key.chars, STRINGSIZE);
+}
+
+HashIndex::HashIndex(const std::string &relationName, std::string &outIndexName, BufMgr *bufMgrIn,
+                     const int attrByteOffset, const Datatype attrType) {
+    bufMgr = bufMgrIn;
+    attributeType = attrType;
+    this->attrByteOffset = attrByteOffset;
+    globalDepth = 0;
+    entryCount = 0;
+    if (relationName.size() >= sizeof(HashIndexMetaInfo().relationName))
+        throw BadIndexInfoException("Relation name is too long.");
+
+    std::ostringstream indexStr;
+    indexStr << relationName << '.' << attrByteOffset << ".hash";
+    outIndexName = indexStr.str();
+
+    try {
+        file = new BlobFile(outIndexName, false);
+        headerPageNum = file->getFirstPageNo();
+        Page *metaPage;
+        bufMgr->readPage(file, headerPageNum, metaPage);
+        HashIndexMetaInfo *meta = (HashIndexMetaInfo *)metaPage;
+        try {
+            if (relationName != meta->relationName) throw BadIndexInfoException("Index doesn't exist.");
+            if (attributeType != meta->attrType) throw BadIndexInfoException("Index doesn't exist.");
+            if (attrByteOffset != meta->attrByteOffset) throw BadIndexInfoException("Index doesn't exist.");
+            if (meta->format != HASH_FORMAT_VERSION)
+                throw BadIndexInfoException("Index was written in another hash format.");
+        } catch (const BadIndexInfoException &e) {
+            // the file is left closed, so that it can be opened as it is or removed
+            bufMgr->unPinPage(file, headerPageNum, false);
+            bufMgr->flushFile(file);
+            delete file;
+            throw;
+        }
+        globalDepth = meta->globalDepth;
+        entryCount = meta->entryCount;
+        const PageId directoryPageNo = meta->directoryPageNo;
+        bufMgr->unPinPage(file, headerPageNum, false);
+
+        loadDirectory(directoryPageNo);
+        if (directory.size() != (size_t)1 << globalDepth) {
+            bufMgr->flushFile(file);
+            delete file;
+            throw BadIndexInfoException("Index directory is incomplete.");
+        }
+    } catch (const FileNotFoundException &) {  // the index does not exist yet, so it is built from the relation
+        file = new BlobFile(outIndexName, true);
+        Page *metaPage;
+        bufMgr->allocPage(file, headerPageNum, metaPage);
+        HashIndexMetaInfo *meta = (HashIndexMetaInfo *)metaPage;
+        strcpy(meta->relationName, relationName.c_str());
+        meta->attrByteOffset = attrByteOffset;
+        meta->attrType = attrType;
+        meta->format = HASH_FORMAT_VERSION;
+        meta->globalDepth = 0;
+        meta->entryCount = 0;
+        meta->directoryPageNo = Page::INVALID_NUMBER;
+        bufMgr->unPinPage(file, headerPageNum, true);
+
+        switch (attributeType) {
+            case INTEGER:
+                directory.assign(1, newBucket<int>(0));
+                loadRelation<int>(relationName);
+                break;
+            case DOUBLE:
+                directory.assign(1, newBucket<double>(0));
+                loadRelation<double>(relationName);
+                break;
+            case STRING:
+                directory.assign(1, newBucket<StringKey>(0));
+                loadRelation<StringKey>(relationName);
+                break;
+        }
+        saveDirectory();
+    }
+}
+
+HashIndex::~HashIndex() {
+    try {
+        saveDirectory();
+    } catch (...) {
+        std::cout << "The hash directory could not be saved.";
+    }
+    bufMgr->flushFile(file);
+    delete file;
+}
+
+Page *HashIndex::fetchPage(const PageId pid, const bool exclusive) {
+    Page *page;
+    bufMgr->readPage(file, pid, page);
+    if (exclusive) bufMgr->latchPage(page, true);
+    return page;
+}
+
+void HashIndex::releasePage(const PageId pid, Page *page, const bool exclusive, const bool dirty) {
+    if (exclusive) bufMgr->unlatchPage(page, true);
+    bufMgr->unPinPage(file, pid, dirty);
+}
+
+void HashIndex::loadDirectory(const PageId firstPageNo) {
+    const size_t slots = (size_t)1 << globalDepth;
+    directory.clear();
+    directory.reserve(slots);
+    PageId pid = firstPageNo;
+    while (pid != Page::INVALID_NUMBER && directory.size() < slots) {
+        Page *page = fetchPage(pid, false);
+        const HashDirectoryPage *dir = (const HashDirectoryPage *)page;
+        directory.insert(directory.end(), dir->buckets, dir->buckets + dir->count);
+        const PageId next = dir->nextPageNo;
+        releasePage(pid, page, false, false);
+        pid = next;
+    }
+}
+
+void HashIndex::saveDirectory() {
+    Page *metaPage = fetchPage(headerPageNum, true);
+    HashIndexMetaInfo *meta = (HashIndexMetaInfo *)metaPage;
+    // the directory only grows, so the pages it was saved in last time are all filled again
+    PageId pid = meta->directoryPageNo;
+    PageId prevId = Page::INVALID_NUMBER;
+    Page *prev = NULL;
+    size_t saved = 0;
+    do {
+        Page *page;
+        if (pid == Page::INVALID_NUMBER) {
+            bufMgr->allocPage(file, pid, page);
+            bufMgr->latchPage(page, true);
+            ((HashDirectoryPage *)page)->nextPageNo = Page::INVALID_NUMBER;
+            if (prev != NULL)
+                ((HashDirectoryPage *)prev)->nextPageNo = pid;
+            else
+                meta->directoryPageNo = pid;
+        } else {
+            page = fetchPage(pid, true);
+        }
+        HashDirectoryPage *dir = (HashDirectoryPage *)page;
+        dir->count = (int)std::min((size_t)HASH_DIRECTORY_ENTRIES, directory.size() - saved);
+        memcpy(dir->buckets, &directory[saved], dir->count * sizeof(PageId));
+        saved += dir->count;
+        if (prev != NULL) releasePage(prevId, prev, true, true);
+        prev = page;
+        prevId = pid;
+        pid = dir->nextPageNo;
+    } while (saved < directory.size());
+    releasePage(prevId, prev, true, true);
+    meta->globalDepth = globalDepth;
+    meta->entryCount = entryCount;
+    releasePage(headerPageNum, metaPage, true, true);
+}
+
+template <class K>
+PageId HashIndex::newBucket(const int localDepth) {
+    PageId pid;
+    Page *page;
+    bufMgr->allocPage(file, pid, page);
+    bufMgr->latchPage(page, true);
+    HashBucket<K> *bucket = (HashBucket<K> *)page;
+    bucket->localDepth = localDepth;
+    bucket->count = 0;
+    bucket->overflowPageNo = Page::INVALID_NUMBER;
+    releasePage(pid, page, true, true);
+    return pid;
+}
+
+template <class K>
+void HashIndex::loadRelation(const std::string &relationName) {
+    FileScan FS(relationName, bufMgr);
+    RecordId rid;
+    K key;
+    while (true) {
+        try {
+            FS.scanNext(rid);
+            // the key is read from the pinned page itself; a key type is as large as its attribute
+            readKey(FS.attribute(attrByteOffset, sizeof(K)), key);
+            insertKey(key, rid);
+        } catch (const EndOfFileException &e) {
+            break;
+        }
+    }
+}
+
+/**
+ * Inserts the entry <key,rid>.
+ * The bucket page the key hashes to takes the entry if it has room. A full bucket is split, and the insert tried
+ * again, until the bucket of the key has room or cannot split because its keys all hash alike, as many entries
+ * of one key do; the entry then goes into the first page of the bucket's overflow chain with room, or into a
+ * new page at the end of the chain.
+ * @param key			Key to insert, pointer to integer/double/char string
+ * @param rid			Record ID of a record whose entry is getting inserted into the index.
+ */
+void HashIndex::insertEntry(const void *key, const RecordId rid) {
+    RWLatchGuard guard(latch, true);
+    switch (attributeType) {
+        case INTEGER: {
+            int keyInt;
+            readKey(key, keyInt);
+            insertKey(keyInt, rid);
+            break;
+        }
+        case DOUBLE: {
+            double keyDouble;
+            readKey(key, keyDouble);
+            insertKey(keyDouble, rid);
+            break;
+        }
+        case STRING: {
+            StringKey keyString;
+            readKey(key, keyString);
+            insertKey(keyString, rid);
+            break;
+        }
+    }
+}
+
+template <class K>
+void HashIndex::insertKey(const K &key, const RecordId rid) {
+    const std::uint64_t hash = hashKey(key);
+    PageId pid;
+    while (true) {
+        pid = bucketOf(hash);
+        Page *page = fetchPage(pid, true);
+        HashBucket<K> *bucket = (HashBucket<K> *)page;
+        if (bucket->count < HashCapacity<K>::ENTRIES) {
+            bucket->keys[bucket->count] = key;
+            bucket->rids[bucket->count] = rid;
+            bucket->count++;
+            releasePage(pid, page, true, true);
+            entryCount++;
+            return;
+        }
+        releasePage(pid, page, true, false);
+        if (!splitBucket<K>(pid)) break;
+    }
+
+    Page *page = fetchPage(pid, true);
+    while (true) {
+        HashBucket<K> *bucket = (HashBucket<K> *)page;
+        if (bucket->count < HashCapacity<K>::ENTRIES) {
+            bucket->keys[bucket->count] = key;
+            bucket->rids[bucket->count] = rid;
+            bucket->count++;
+            releasePage(pid, page, true, true);
+            entryCount++;
+            return;
+        }
+        PageId next = bucket->overflowPageNo;
+        if (next == Page::INVALID_NUMBER) {
+            next = newBucket<K>(0);
+            bucket->overflowPageNo = next;
+            releasePage(pid, page, true, true);
+        } else {
+            releasePage(pid, page, true, false);
+        }
+        pid = next;
+        page = fetchPage(pid, true);
+    }
+}
+
+template <class K>
+bool HashIndex::splitBucket(const PageId bucketId) {
+    Page *page = fetchPage(bucketId, true);
+    HashBucket<K> *bucket = (HashBucket<K> *)page;
+    const int localDepth = bucket->localDepth;
+    if (localDepth >= HASH_MAX_DEPTH) {
+        releasePage(bucketId, page, true, false);
+        return false;
+    }
+
+    // the whole chain is split, as its overflow pages are only there because the bucket could not split before
+    std::vector<K> keys(bucket->keys, bucket->keys + bucket->count);
+    std::vector<RecordId> rids(bucket->rids, bucket->rids + bucket->count);
+    std::vector<PageId> overflow;
+    for (PageId pid = bucket->overflowPageNo; pid != Page::INVALID_NUMBER;) {
+        Page *overflowPage = fetchPage(pid, false);
+        const HashBucket<K> *chained = (const HashBucket<K> *)overflowPage;
+        keys.insert(keys.end(), chained->keys, chained->keys + chained->count);
+        rids.insert(rids.end(), chained->rids, chained->rids + chained->count);
+        overflow.push_back(pid);
+        const PageId next = chained->overflowPageNo;
+        releasePage(pid, overflowPage, false, false);
+        pid = next;
+    }
+
+    // the keys share the low localDepth bits of their hash; splitting helps only if they differ in a later one
+    const std::uint64_t splitBits =
+        (((std::uint64_t)1 << HASH_MAX_DEPTH) - 1) & ~(((std::uint64_t)1 << localDepth) - 1);
+    std::vector<std::uint64_t> hashes(keys.size());
+    bool differ = false;
+    for (size_t i = 0; i < keys.size(); i++) {
+        hashes[i] = hashKey(keys[i]);
+        differ = differ || ((hashes[i] ^ hashes[0]) & splitBits) != 0;
+    }
+    if (!differ) {
+        releasePage(bucketId, page, true, false);
+        return false;
+    }
+
+    if (localDepth == globalDepth) {
+        // the new half of the directory names the same buckets as the old one
+        const size_t slots = directory.size();
+        directory.resize(slots * 2);
+        std::copy(directory.begin(), directory.begin() + slots, directory.begin() + slots);
+        globalDepth++;
+    }
+    const PageId siblingId = newBucket<K>(localDepth + 1);
+    const std::uint64_t bit = (std::uint64_t)1 << localDepth;
+    for (size_t slot = 0; slot < directory.size(); slot++) {
+        if (directory[slot] == bucketId && (slot & bit) != 0) directory[slot] = siblingId;
+    }
+    for (size_t i = 0; i < overflow.size(); i++) bufMgr->disposePage(file, overflow[i]);
+
+    std::vector<K> stayKeys, moveKeys;
+    std::vector<RecordId> stayRids, moveRids;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if ((hashes[i] & bit) != 0) {
+            moveKeys.push_back(keys[i]);
+            moveRids.push_back(rids[i]);
+        } else {
+            stayKeys.push_back(keys[i]);
+            stayRids.push_back(rids[i]);
+        }
+    }
+    bucket->localDepth = localDepth + 1;
+    fillChain(bucketId, page, stayKeys, stayRids);
+    fillChain(siblingId, fetchPage(siblingId, true), moveKeys, moveRids);
+    return true;
+}
+
+template <class K>
+void HashIndex::fillChain(const PageId bucketId, Page *bucketPage, const std::vector<K> &keys,
+                          const std::vector<RecordId> &rids) {
+    PageId pid = bucketId;
+    Page *page = bucketPage;
+    size_t filled = 0;
+    while (true) {
+        HashBucket<K> *bucket = (HashBucket<K> *)page;
+        bucket->count = (int)std::min((size_t)HashCapacity<K>::ENTRIES, keys.size() - filled);
+        std::copy(keys.begin() + filled, keys.begin() + filled + bucket->count, bucket->keys);
+        std::copy(rids.begin() + filled, rids.begin() + filled + bucket->count, bucket->rids);
+        filled += bucket->count;
+        if (filled == keys.size()) {
+            bucket->overflowPageNo = Page::INVALID_NUMBER;
+            releasePage(pid, page, true, true);
+            return;
+        }
+        const PageId next = newBucket<K>(0);
+        bucket->overflowPageNo = next;
+        releasePage(pid, page, true, true);
+        pid = next;
+        page = fetchPage(pid, true);
+    }
+}
+
+/**
+ * Deletes the entry <key,rid>.
+ * The chain of the key's bucket is walked until the entry is found, and the last entry of its page takes its slot.
+ * Pages left empty stay in the chain, and buckets are never merged.
+ * @param key			Key of the entry, pointer to integer/double/char string
+ * @param rid			Record ID of the entry
+ * @return			True if the entry was found and removed
+ */
+bool HashIndex::deleteEntry(const void *key, const RecordId rid) {
+    RWLatchGuard guard(latch, true);
+    switch (attributeType) {
+        case INTEGER: {
+            int keyInt;
+            readKey(key, keyInt);
+            return removeKey(keyInt, rid);
+        }
+        case DOUBLE: {
+            double keyDouble;
+            readKey(key, keyDouble);
+            return removeKey(keyDouble, rid);
+        }
+        case STRING: {
+            StringKey keyString;
+            readKey(key, keyString);
+            return removeKey(keyString, rid);
+        }
+    }
+    return false;
+}
+
+template <class K>
+bool HashIndex::removeKey(const K &key, const RecordId rid) {
+    for (PageId pid = bucketOf(hashKey(key)); pid != Page::INVALID_NUMBER;) {
+        Page *page = fetchPage(pid, true);
+        HashBucket<K> *bucket = (HashBucket<K> *)page;
+        for (int i = 0; i < bucket->count; i++) {
+            if (bucket->keys[i] == key && bucket->rids[i] == rid) {
+                bucket->count--;
+                bucket->keys[i] = bucket->keys[bucket->count];
+                bucket->rids[i] = bucket->rids[bucket->count];
+                releasePage(pid, page, true, true);
+                entryCount--;
+                return true;
+            }
+        }
+        const PageId next = bucket->overflowPageNo;
+        releasePage(pid, page, true, false);
+        pid = next;
+    }
+    return false;
+}
+
+template <class K, class Found>
+void HashIndex::probeBucket(const PageId bucketId, const std::vector<K> &probes, const std::vector<size_t> &which,
+                            const Found &found) {
+    for (PageId pid = bucketId; pid != Page::INVALID_NUMBER;) {
+        Page *page = fetchPage(pid, false);
+        const HashBucket<K> *bucket = (const HashBucket<K> *)page;
+        try {
+            for (int i = 0; i < bucket->count; i++) {
+                for (size_t w = 0; w < which.size(); w++) {
+                    if (bucket->keys[i] == probes[which[w]] && !found(which[w], bucket->rids[i])) {
+                        releasePage(pid, page, false, false);
+                        return;
+                    }
+                }
+            }
+        } catch (...) {
+            releasePage(pid, page, false, false);
+            throw;
+        }
+        const PageId next = bucket->overflowPageNo;
+        releasePage(pid, page, false, false);
+        pid = next;
+    }
+}
+
+template <class K, class Found>
+void HashIndex::probeKey(const void *key, const Found &found) {
+    std::vector<K> probes(1);
+    readKey(key, probes[0]);
+    const std::vector<size_t> which(1, 0);
+    probeBucket(bucketOf(hashKey(probes[0])), probes, which,
+                [&found](size_t, const RecordId &rid) { return found(rid); });
+}
+
+/**
+ * Returns the record ID of every entry equal to key.
+ * One bucket page is read, and its overflow pages if the key has more entries than a page holds.
+ * @param key			Key to look up, pointer to integer/double/char string
+ */
+std::vector<RecordId> HashIndex::lookup(const void *key) {
+    RWLatchGuard guard(latch, false);
+    std::vector<RecordId> rids;
+    const auto collect = [&rids](const RecordId &rid) {
+        rids.push_back(rid);
+        return true;
+    };
+    switch (attributeType) {
+        case INTEGER:
+            probeKey<int>(key, collect);
+            break;
+        case DOUBLE:
+            probeKey<double>(key, collect);
+            break;
+        case STRING:
+            probeKey<StringKey>(key, collect);
+            break;
+    }
+    return rids;
+}
+
+bool HashIndex::contains(const void *key) {
+    RWLatchGuard guard(latch, false);
+    bool present = false;
+    const auto stop = [&present](const RecordId &) {
+        present = true;
+        return false;
+    };
+    switch (attributeType) {
+        case INTEGER:
+            probeKey<int>(key, stop);
+            break;
+        case DOUBLE:
+            probeKey<double>(key, stop);
+            break;
+        case STRING:
+            probeKey<StringKey>(key, stop);
+            break;
+    }
+    return present;
+}
+
+/**
+ * Finds every entry equal to any of several probe keys.
+ * The probes are sorted by the bucket page they hash to, and the chain of each bucket is walked once comparing
+ * every entry with all of the bucket's probes. The bucket pages of the groups HASH_PREFETCH_DEPTH ahead are
+ * prefetched, so that their reads overlap with the comparisons of the groups before them.
+ * @param keys			Probe keys, laid out back to back
+ * @param count			Number of probe keys
+ * @param callback		Receives each match with the position of its probe in keys
+ */
+void HashIndex::lookupBatch(const void *keys, const size_t count, const LookupCallback &callback) {
+    RWLatchGuard guard(latch, false);
+    switch (attributeType) {
+        case INTEGER:
+            lookupKeys<int>(keys, count, callback);
+            break;
+        case DOUBLE:
+            lookupKeys<double>(keys, count, callback);
+            break;
+        case STRING:
+            lookupKeys<StringKey>(keys, count, callback);
+            break;
+    }
+}
+
+template <class K>
+void HashIndex::lookupKeys(const void *keys, const size_t count, const LookupCallback &callback) {
+    std::vector<K> probes(count);
+    std::vector<std::pair<PageId, size_t> > order(count);
+    for (size_t i = 0; i < count; i++) {
+        readKey((const char *)keys + i * sizeof(K), probes[i]);
+        order[i] = std::make_pair(bucketOf(hashKey(probes[i])), i);
+    }
+    std::sort(order.begin(), order.end());
+
+    // start of the run of probes of each bucket, with the end of the last one after them
+    std::vector<size_t> groups;
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0 || order[i].first != order[i - 1].first) groups.push_back(i);
+    }
+    const size_t bucketCount = groups.size();
+    groups.push_back(count);
+
+    for (size_t g = 0; g < bucketCount && g < (size_t)HASH_PREFETCH_DEPTH; g++)
+        bufMgr->prefetch(file, order[groups[g]].first);
+    std::vector<size_t> which;
+    const auto report = [&callback](size_t probe, const RecordId &rid) {
+        callback(probe, rid);
+        return true;
+    };
+    for (size_t g = 0; g < bucketCount; g++) {
+        if (g + HASH_PREFETCH_DEPTH < bucketCount)
+            bufMgr->prefetch(file, order[groups[g + HASH_PREFETCH_DEPTH]].first);
+        which.clear();
+        for (size_t i = groups[g]; i < groups[g + 1]; i++) which.push_back(order[i].second);
+        probeBucket(order[groups[g]].first, probes, which, report);
+    }
+}
+
+void HashIndex::flush() {
+    RWLatchGuard guard(latch, true);
+    saveDirectory();
+    bufMgr->flushFile(file);
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,387 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "btree.h"
+#include "buffer.h"
+#include "latch.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Version of the layout of a HashIndex file, recorded in its meta page. A file written with another layout
+ * is not opened.
+ */
+const int HASH_FORMAT_VERSION = 1;
+
+/**
+ * @brief Most bits of a key's hash a HashIndex directory is indexed by. A bucket that would need more to split
+ * grows a chain of overflow pages instead.
+ */
+const int HASH_MAX_DEPTH = 20;
+
+/**
+ * @brief Probes of a HashIndex::lookupBatch whose bucket pages are prefetched ahead of the probe being answered.
+ */
+const int HASH_PREFETCH_DEPTH = 8;
+
+/**
+ * @brief The meta page of a HashIndex, the first page of its file.
+ */
+struct HashIndexMetaInfo {
+    /**
+     * Name of base relation.
+     */
+    char relationName[20];
+
+    /**
+     * Offset of attribute, over which index is built, inside the record stored in pages.
+     */
+    int attrByteOffset;
+
+    /**
+     * Type of the attribute over which index is built.
+     */
+    Datatype attrType;
+
+    /**
+     * HASH_FORMAT_VERSION of the layout the file was written in.
+     */
+    int format;
+
+    /**
+     * Bits of a key's hash the directory is indexed by.
+     */
+    int globalDepth;
+
+    /**
+     * Entries in the index, as of the last time the directory was saved.
+     */
+    std::uint64_t entryCount;
+
+    /**
+     * First page of the chain of pages the directory is saved in.
+     */
+    PageId directoryPageNo;
+};
+
+/**
+ * @brief Number of bucket page numbers a page of a HashIndex directory holds.
+ */
+const int HASH_DIRECTORY_ENTRIES = (Page::SIZE - sizeof(PageId) - sizeof(int)) / sizeof(PageId);
+
+/**
+ * @brief A page of the directory of a HashIndex: the page numbers of the buckets of a run of directory slots.
+ */
+struct HashDirectoryPage {
+    /**
+     * Next page of the directory, or Page::INVALID_NUMBER for the last one.
+     */
+    PageId nextPageNo;
+
+    /**
+     * Slots of the directory held in this page.
+     */
+    int count;
+
+    /**
+     * Page number of the bucket of each slot.
+     */
+    PageId buckets[HASH_DIRECTORY_ENTRIES];
+};
+
+/**
+ * @brief Number of entries a bucket page of a HashIndex holds, for keys of type K.
+ */
+template <class K>
+struct HashCapacity {
+    static const int ENTRIES = (Page::SIZE - 2 * sizeof(int) - sizeof(PageId) - sizeof(double)) /
+                               (sizeof(K) + sizeof(RecordId));
+};
+
+/**
+ * @brief A bucket page of a HashIndex, or an overflow page chained to one, for keys of type K. Entries are kept
+ * unordered in the first count slots.
+ */
+template <class K>
+struct HashBucket {
+    /**
+     * Bits of the hash every key of the bucket shares; unused in overflow pages.
+     */
+    int localDepth;
+
+    /**
+     * Entries in the page.
+     */
+    int count;
+
+    /**
+     * Next page of the bucket's chain, or Page::INVALID_NUMBER.
+     */
+    PageId overflowPageNo;
+
+    /**
+     * Keys of the entries.
+     */
+    K keys[HashCapacity<K>::ENTRIES];
+
+    /**
+     * Record ids of the entries, each with the key of the same slot.
+     */
+    RecordId rids[HashCapacity<K>::ENTRIES];
+};
+
+static_assert(sizeof(HashBucket<int>) <= Page::SIZE && sizeof(HashBucket<double>) <= Page::SIZE &&
+                  sizeof(HashBucket<StringKey>) <= Page::SIZE && sizeof(HashDirectoryPage) <= Page::SIZE,
+              "Hash index pages must fit in a page.");
+
+/**
+ * @brief Extendible hash index on a single attribute of a relation, for attributes only ever probed by equality.
+ *
+ * The directory, 2^globalDepth slots each naming a bucket page, is kept in memory, so a probe reads the one
+ * bucket page its key hashes to, and the overflow pages chained to it only if one key has more entries than a page
+ * holds. A full bucket splits in two on the next bit of the hash, doubling the directory when the bucket already
+ * uses every bit it indexes by. Deletes leave buckets as they are. The directory and the count of entries are
+ * saved in the file when the index is flushed or destroyed; a process that stops without either loses the splits
+ * made since, so the index has to be rebuilt then.
+ *
+ * Keys are those of BTreeIndex: an INTEGER, a DOUBLE or the first STRINGSIZE characters of a STRING. Lookups may
+ * run from several threads at once; inserts and deletes exclude every other call.
+ */
+class HashIndex {
+   public:
+    /**
+     * HashIndex Constructor. Opens the index of the relation's attribute if its file exists, and otherwise
+     * creates it, inserting an entry for every tuple of the relation.
+     *
+     * @param relationName        Name of the relation
+     * @param outIndexName        Returns the name of the index file
+     * @param bufMgrIn            Buffer Manager Instance
+     * @param attrByteOffset      Offset of attribute, over which index is to be built, in the record
+     * @param attrType            Datatype of attribute over which index is built
+     * @throws  BadIndexInfoException  If the index file exists but was built for another relation, attribute or
+     *          layout
+     */
+    HashIndex(const std::string& relationName, std::string& outIndexName, BufMgr* bufMgrIn,
+              const int attrByteOffset, const Datatype attrType);
+
+    /**
+     * HashIndex Destructor. Saves the directory, flushes the index file and closes it.
+     */
+    ~HashIndex();
+
+    /**
+     * Inserts the entry <key,rid>, splitting its bucket if it is full.
+     *
+     * @param key   Key to insert, pointer to integer/double/char string
+     * @param rid   Record ID of a record whose entry is getting inserted into the index.
+     */
+    void insertEntry(const void* key, const RecordId rid);
+
+    /**
+     * Deletes the entry <key,rid>.
+     *
+     * @param key   Key of the entry, pointer to integer/double/char string
+     * @param rid   Record ID of the entry
+     * @return      True if the entry was found and removed
+     */
+    bool deleteEntry(const void* key, const RecordId rid);
+
+    /**
+     * Returns the record ID of every entry equal to key, in no particular order.
+     *
+     * @param key   Key to look up, pointer to integer/double/char string
+     */
+    std::vector<RecordId> lookup(const void* key);
+
+    /**
+     * Returns true if any entry equals key.
+     *
+     * @param key   Key to look up, pointer to integer/double/char string
+     */
+    bool contains(const void* key);
+
+    /**
+     * Finds every entry equal to any of several probe keys. The probes are grouped by the bucket they hash to, so
+     * that each bucket is read once however many probes it answers, and the buckets of the next
+     * HASH_PREFETCH_DEPTH groups are prefetched while the current one is read. The callback runs with the index
+     * latched, so it must not use the index.
+     *
+     * @param keys      Probe keys, laid out back to back: count integers, doubles or STRINGSIZE-byte strings
+     * @param count     Number of probe keys
+     * @param callback  Receives each match with the position of its probe in keys
+     */
+    void lookupBatch(const void* keys, const size_t count, const LookupCallback& callback);
+
+    /**
+     * Saves the directory and the count of entries, and flushes the index file.
+     */
+    void flush();
+
+    /**
+     * Returns the number of entries in the index.
+     */
+    std::uint64_t entries() const { return entryCount; }
+
+    /**
+     * Returns the number of bits of the hash the directory is indexed by.
+     */
+    int depth() const { return globalDepth; }
+
+   private:
+    /**
+     * Index file
+     */
+    File* file;
+
+    /**
+     * Buffer manager the index file is read through
+     */
+    BufMgr* bufMgr;
+
+    /**
+     * Page number of the meta page
+     */
+    PageId headerPageNum;
+
+    /**
+     * Datatype of the attribute
+     */
+    Datatype attributeType;
+
+    /**
+     * Offset of the attribute in the records
+     */
+    int attrByteOffset;
+
+    /**
+     * Bits of the hash the directory is indexed by
+     */
+    int globalDepth;
+
+    /**
+     * Bucket page of each of the 2^globalDepth slots; a bucket of local depth d fills every slot whose low d bits
+     * are its own
+     */
+    std::vector<PageId> directory;
+
+    /**
+     * Entries in the index
+     */
+    std::uint64_t entryCount;
+
+    /**
+     * Held shared by lookups and exclusively by inserts and deletes, which may split buckets and grow the
+     * directory
+     */
+    RWLatch latch;
+
+    /**
+     * Returns the bucket page a hash is filed under.
+     */
+    PageId bucketOf(const std::uint64_t hash) const {
+        return directory[hash & (((std::uint64_t)1 << globalDepth) - 1)];
+    }
+
+    /**
+     * Pins a page of the index file and, for a change, latches it exclusively, so that the background writer
+     * does not write it back halfway. Lookups need no latch, as the index latch keeps changes away from them.
+     */
+    Page* fetchPage(const PageId pid, const bool exclusive);
+
+    /**
+     * Releases a page taken with fetchPage.
+     */
+    void releasePage(const PageId pid, Page* page, const bool exclusive, const bool dirty);
+
+    /**
+     * Reads the directory out of its chain of pages.
+     */
+    void loadDirectory(const PageId firstPageNo);
+
+    /**
+     * Writes the directory and the count of entries to the file, reusing the directory's pages.
+     */
+    void saveDirectory();
+
+    /**
+     * Allocates an empty bucket page of the given local depth and returns its page number.
+     */
+    template <class K>
+    PageId newBucket(const int localDepth);
+
+    /**
+     * Inserts the entry <key,rid> into the bucket of its key of type K, as described for insertEntry.
+     */
+    template <class K>
+    void insertKey(const K& key, const RecordId rid);
+
+    /**
+     * Splits a full bucket on the next bit of the hash, doubling the directory first if the bucket already uses
+     * every bit of it.
+     *
+     * @return  False if the bucket cannot split, as its keys all share HASH_MAX_DEPTH bits of their hash
+     */
+    template <class K>
+    bool splitBucket(const PageId bucketId);
+
+    /**
+     * Deletes the entry <key,rid> from the bucket its key hashes to.
+     */
+    template <class K>
+    bool removeKey(const K& key, const RecordId rid);
+
+    /**
+     * Writes entries into the chain of a bucket whose overflow pages have been dropped, filling the bucket page
+     * and then as many overflow pages as it takes. The bucket page is released.
+     */
+    template <class K>
+    void fillChain(const PageId bucketId, Page* bucketPage, const std::vector<K>& keys,
+                   const std::vector<RecordId>& rids);
+
+    /**
+     * Calls found with the position of the probe and the record id of every entry equal to one of several probes
+     * in the chain of a bucket, until found returns false.
+     *
+     * @param bucketId  Bucket every probe hashes to
+     * @param probes    Probe keys
+     * @param which     Positions in probes of the probes to answer
+     * @param found     Called with the position of the probe and the record id of the entry
+     */
+    template <class K, class Found>
+    void probeBucket(const PageId bucketId, const std::vector<K>& probes, const std::vector<size_t>& which,
+                     const Found& found);
+
+    /**
+     * Calls found with the record id of every entry equal to key, until found returns false.
+     */
+    template <class K, class Found>
+    void probeKey(const void* key, const Found& found);
+
+    /**
+     * Answers a batch of probes of keys of type K, as described for lookupBatch.
+     */
+    template <class K>
+    void lookupKeys(const void* keys, const size_t count, const LookupCallback& callback);
+
+    /**
+     * Inserts an entry for every tuple of the relation.
+     */
+    template <class K>
+    void loadRelation(const std::string& relationName);
+
+    HashIndex(const HashIndex&);
+    HashIndex& operator=(const HashIndex&);
+};
+
+}  // namespace badgerdb
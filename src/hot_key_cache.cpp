@@ -0,0 +1,609 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "hot_key_cache.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cassert>
+
+#include "bloom_filter.h"
+
+namespace badgerdb {
+
+/**
+ * Sizes of inner node, by the most children they hold.
+ */
+enum ArtNodeType { ART_NODE4, ART_NODE16, ART_NODE48, ART_NODE256 };
+
+/**
+ * Rows of the frequency sketch, each counting every key under a hash of its own.
+ */
+static const int SKETCH_ROWS = 4;
+
+/**
+ * Fewest counters per row of the frequency sketch.
+ */
+static const std::size_t SKETCH_MIN_WIDTH = 1024;
+
+struct ArtNode {
+    /**
+     * ArtNodeType of the node
+     */
+    std::uint8_t type;
+
+    /**
+     * Bytes every key below the node shares after those of the nodes above, before the byte the node branches on
+     */
+    std::uint8_t prefixLength;
+    unsigned char prefix[HOT_KEY_MAX_BYTES];
+
+    /**
+     * Children of the node
+     */
+    std::uint16_t count;
+};
+
+/**
+ * @brief Node of up to 4 children, each under the byte in the same slot; the slots are in no order.
+ */
+struct ArtNode4 : ArtNode {
+    unsigned char keys[4];
+    ArtNode* children[4];
+};
+
+/**
+ * @brief Node of up to 16 children, laid out as in ArtNode4.
+ */
+struct ArtNode16 : ArtNode {
+    unsigned char keys[16];
+    ArtNode* children[16];
+};
+
+/**
+ * @brief Node of up to 48 children, with the slot of each byte's child, plus one, indexed by the byte.
+ */
+struct ArtNode48 : ArtNode {
+    unsigned char index[256];
+    ArtNode* children[48];
+};
+
+/**
+ * @brief Node of up to 256 children, indexed by their byte.
+ */
+struct ArtNode256 : ArtNode {
+    ArtNode* children[256];
+};
+
+struct HotLeaf {
+    /**
+     * Record ids of every entry of the key
+     */
+    std::vector<RecordId> rids;
+
+    /**
+     * Times the key was offered before it was admitted plus those it was found since, halved as the sketch is
+     */
+    std::atomic<std::uint32_t> hits;
+
+    /**
+     * Position of the leaf in HotKeyCache::leaves
+     */
+    std::size_t slot;
+
+    unsigned char key[HOT_KEY_MAX_BYTES];
+};
+
+/**
+ * Leaves are told from nodes in the tree by the lowest bit of their pointer, which alignment leaves clear.
+ */
+static inline bool isLeaf(const ArtNode* child) {
+    return ((std::uintptr_t)child & 1) != 0;
+}
+
+static inline HotLeaf* asLeaf(ArtNode* child) {
+    return (HotLeaf*)((std::uintptr_t)child & ~(std::uintptr_t)1);
+}
+
+static inline ArtNode* tagLeaf(HotLeaf* leaf) {
+    return (ArtNode*)((std::uintptr_t)leaf | 1);
+}
+
+/**
+ * Returns the slot holding a node's child under a byte, or NULL if it has none.
+ */
+static ArtNode** findChild(ArtNode* node, const unsigned char byte) {
+    switch (node->type) {
+        case ART_NODE4: {
+            ArtNode4* n = static_cast<ArtNode4*>(node);
+            for (int i = 0; i < n->count; i++) {
+                if (n->keys[i] == byte) return &n->children[i];
+            }
+            return NULL;
+        }
+        case ART_NODE16: {
+            ArtNode16* n = static_cast<ArtNode16*>(node);
+            for (int i = 0; i < n->count; i++) {
+                if (n->keys[i] == byte) return &n->children[i];
+            }
+            return NULL;
+        }
+        case ART_NODE48: {
+            ArtNode48* n = static_cast<ArtNode48*>(node);
+            return n->index[byte] == 0 ? NULL : &n->children[n->index[byte] - 1];
+        }
+        default: {
+            ArtNode256* n = static_cast<ArtNode256*>(node);
+            return n->children[byte] == NULL ? NULL : &n->children[byte];
+        }
+    }
+}
+
+/**
+ * Copies the prefix and count of a node into the node replacing it.
+ */
+static void copyHeader(ArtNode* to, const ArtNode* from) {
+    to->prefixLength = from->prefixLength;
+    memcpy(to->prefix, from->prefix, from->prefixLength);
+    to->count = from->count;
+}
+
+/**
+ * Returns the bytes a node of a type takes.
+ */
+static std::size_t nodeBytes(const int type) {
+    switch (type) {
+        case ART_NODE4:
+            return sizeof(ArtNode4);
+        case ART_NODE16:
+            return sizeof(ArtNode16);
+        case ART_NODE48:
+            return sizeof(ArtNode48);
+        default:
+            return sizeof(ArtNode256);
+    }
+}
+
+HotKeyCache::HotKeyCache(const std::size_t keyLength, const std::size_t budget)
+    : keyLength(keyLength), budgetBytes(budget), root(NULL), used(0), changes(0), sketchAdds(0), random(1) {
+    assert(keyLength > 0 && keyLength <= HOT_KEY_MAX_BYTES);
+    // about one counter for each key the budget holds
+    sketchWidth = SKETCH_MIN_WIDTH;
+    while (sketchWidth < budget / 64) sketchWidth <<= 1;
+    sketch.assign(SKETCH_ROWS * sketchWidth, 0);
+    agingPeriod = 10 * sketchWidth;
+}
+
+HotKeyCache::~HotKeyCache() {
+    destroy(root);
+    for (size_t i = 0; i < leaves.size(); i++) delete leaves[i];
+}
+
+bool HotKeyCache::find(const unsigned char* key, std::vector<RecordId>& out) {
+    RWLatchGuard guard(latch, false);
+    HotLeaf* leaf = findLeaf(key);
+    if (leaf == NULL) return false;
+    out.insert(out.end(), leaf->rids.begin(), leaf->rids.end());
+    leaf->hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool HotKeyCache::offer(const unsigned char* key, const std::vector<RecordId>& rids, const std::uint64_t stamp) {
+    RWLatchGuard guard(latch, true);
+    const std::uint32_t frequency = countKey(key);
+    // an entry changed since the tree was read may be missing from rids; so may one another offer cached
+    if (frequency < HOT_ADMIT_FREQUENCY || changes.load(std::memory_order_relaxed) != stamp || findLeaf(key) != NULL)
+        return false;
+    // the leaf may split a leaf or a node's prefix, adding a node
+    const std::size_t need = sizeof(HotLeaf) + rids.size() * sizeof(RecordId) + sizeof(ArtNode4);
+    if (need > budgetBytes) return false;
+    while (used + need > budgetBytes) {
+        HotLeaf* victim = sampleVictim();
+        if (victim == NULL || victim->hits.load(std::memory_order_relaxed) >= frequency) return false;
+        evict(victim);
+    }
+
+    HotLeaf* leaf = new HotLeaf();
+    leaf->rids = rids;
+    leaf->hits.store(frequency, std::memory_order_relaxed);
+    memcpy(leaf->key, key, keyLength);
+    leaf->slot = leaves.size();
+    leaves.push_back(leaf);
+    used += leafBytes(leaf);
+    insertLeaf(root, leaf, 0);
+    // a node that had to grow for the leaf may take the cache over its budget
+    bool admitted = true;
+    while (used > budgetBytes) {
+        HotLeaf* victim = sampleVictim();
+        admitted = admitted && victim != leaf;
+        evict(victim);
+    }
+    return admitted;
+}
+
+void HotKeyCache::added(const unsigned char* key, const RecordId rid) {
+    RWLatchGuard guard(latch, true);
+    changes.fetch_add(1, std::memory_order_release);
+    HotLeaf* leaf = findLeaf(key);
+    // a lookup that read the tree after the insert may have cached the entry already
+    if (leaf == NULL || std::find(leaf->rids.begin(), leaf->rids.end(), rid) != leaf->rids.end()) return;
+    used -= leafBytes(leaf);
+    leaf->rids.push_back(rid);
+    used += leafBytes(leaf);
+}
+
+void HotKeyCache::removed(const unsigned char* key, const RecordId rid) {
+    RWLatchGuard guard(latch, true);
+    changes.fetch_add(1, std::memory_order_release);
+    HotLeaf* leaf = findLeaf(key);
+    if (leaf == NULL) return;
+    std::vector<RecordId>::iterator iter = std::find(leaf->rids.begin(), leaf->rids.end(), rid);
+    if (iter != leaf->rids.end()) leaf->rids.erase(iter);
+}
+
+void HotKeyCache::clear() {
+    RWLatchGuard guard(latch, true);
+    changes.fetch_add(1, std::memory_order_release);
+    destroy(root);
+    root = NULL;
+    for (size_t i = 0; i < leaves.size(); i++) delete leaves[i];
+    leaves.clear();
+    used = 0;
+    std::fill(sketch.begin(), sketch.end(), 0);
+    sketchAdds = 0;
+}
+
+std::size_t HotKeyCache::keys() const {
+    RWLatchGuard guard(latch, false);
+    return leaves.size();
+}
+
+std::size_t HotKeyCache::bytes() const {
+    RWLatchGuard guard(latch, false);
+    return used;
+}
+
+HotLeaf* HotKeyCache::findLeaf(const unsigned char* key) const {
+    ArtNode* node = root;
+    std::size_t depth = 0;
+    while (node != NULL) {
+        if (isLeaf(node)) {
+            HotLeaf* leaf = asLeaf(node);
+            return memcmp(leaf->key, key, keyLength) == 0 ? leaf : NULL;
+        }
+        if (memcmp(node->prefix, key + depth, node->prefixLength) != 0) return NULL;
+        depth += node->prefixLength;
+        ArtNode** child = findChild(node, key[depth]);
+        if (child == NULL) return NULL;
+        node = *child;
+        depth++;
+    }
+    return NULL;
+}
+
+void HotKeyCache::insertLeaf(ArtNode*& ref, HotLeaf* leaf, const std::size_t depth) {
+    if (ref == NULL) {
+        ref = tagLeaf(leaf);
+        return;
+    }
+    if (isLeaf(ref)) {
+        // keys of one length that are not equal differ in some byte past those they share here
+        const HotLeaf* other = asLeaf(ref);
+        std::size_t shared = 0;
+        while (other->key[depth + shared] == leaf->key[depth + shared]) shared++;
+        ArtNode* node = newNode(ART_NODE4);
+        node->prefixLength = (std::uint8_t)shared;
+        memcpy(node->prefix, leaf->key + depth, shared);
+        addChild(node, other->key[depth + shared], ref);
+        addChild(node, leaf->key[depth + shared], tagLeaf(leaf));
+        ref = node;
+        return;
+    }
+
+    ArtNode* node = ref;
+    std::size_t shared = 0;
+    while (shared < node->prefixLength && node->prefix[shared] == leaf->key[depth + shared]) shared++;
+    if (shared < node->prefixLength) {
+        // the prefix is split where the key leaves it: a new node branches there on the byte after
+        ArtNode* parent = newNode(ART_NODE4);
+        parent->prefixLength = (std::uint8_t)shared;
+        memcpy(parent->prefix, node->prefix, shared);
+        const unsigned char branch = node->prefix[shared];
+        node->prefixLength -= shared + 1;
+        memmove(node->prefix, node->prefix + shared + 1, node->prefixLength);
+        addChild(parent, branch, node);
+        addChild(parent, leaf->key[depth + shared], tagLeaf(leaf));
+        ref = parent;
+        return;
+    }
+    const std::size_t next = depth + node->prefixLength;
+    ArtNode** child = findChild(node, leaf->key[next]);
+    if (child != NULL)
+        insertLeaf(*child, leaf, next + 1);
+    else
+        addChild(ref, leaf->key[next], tagLeaf(leaf));
+}
+
+bool HotKeyCache::eraseLeaf(ArtNode*& ref, const unsigned char* key, const std::size_t depth) {
+    if (ref == NULL) return false;
+    if (isLeaf(ref)) {
+        // only the root is a leaf without a node above it
+        if (memcmp(asLeaf(ref)->key, key, keyLength) != 0) return false;
+        ref = NULL;
+        return true;
+    }
+    ArtNode* node = ref;
+    if (memcmp(node->prefix, key + depth, node->prefixLength) != 0) return false;
+    const std::size_t next = depth + node->prefixLength;
+    ArtNode** child = findChild(node, key[next]);
+    if (child == NULL) return false;
+    if (!isLeaf(*child)) return eraseLeaf(*child, key, next + 1);
+    if (memcmp(asLeaf(*child)->key, key, keyLength) != 0) return false;
+    removeChild(ref, key[next]);
+    return true;
+}
+
+void HotKeyCache::addChild(ArtNode*& ref, const unsigned char byte, ArtNode* child) {
+    ArtNode* node = ref;
+    switch (node->type) {
+        case ART_NODE4: {
+            ArtNode4* n = static_cast<ArtNode4*>(node);
+            if (n->count < 4) {
+                n->keys[n->count] = byte;
+                n->children[n->count] = child;
+                n->count++;
+                return;
+            }
+            ArtNode16* bigger = static_cast<ArtNode16*>(newNode(ART_NODE16));
+            copyHeader(bigger, n);
+            memcpy(bigger->keys, n->keys, sizeof(n->keys));
+            memcpy(bigger->children, n->children, sizeof(n->children));
+            freeNode(n);
+            ref = bigger;
+            break;
+        }
+        case ART_NODE16: {
+            ArtNode16* n = static_cast<ArtNode16*>(node);
+            if (n->count < 16) {
+                n->keys[n->count] = byte;
+                n->children[n->count] = child;
+                n->count++;
+                return;
+            }
+            ArtNode48* bigger = static_cast<ArtNode48*>(newNode(ART_NODE48));
+            copyHeader(bigger, n);
+            for (int i = 0; i < 16; i++) {
+                bigger->index[n->keys[i]] = (unsigned char)(i + 1);
+                bigger->children[i] = n->children[i];
+            }
+            freeNode(n);
+            ref = bigger;
+            break;
+        }
+        case ART_NODE48: {
+            ArtNode48* n = static_cast<ArtNode48*>(node);
+            if (n->count < 48) {
+                int slot = 0;
+                while (n->children[slot] != NULL) slot++;
+                n->children[slot] = child;
+                n->index[byte] = (unsigned char)(slot + 1);
+                n->count++;
+                return;
+            }
+            ArtNode256* bigger = static_cast<ArtNode256*>(newNode(ART_NODE256));
+            copyHeader(bigger, n);
+            for (int b = 0; b < 256; b++) {
+                if (n->index[b] != 0) bigger->children[b] = n->children[n->index[b] - 1];
+            }
+            freeNode(n);
+            ref = bigger;
+            break;
+        }
+        default: {
+            ArtNode256* n = static_cast<ArtNode256*>(node);
+            n->children[byte] = child;
+            n->count++;
+            return;
+        }
+    }
+    addChild(ref, byte, child);
+}
+
+void HotKeyCache::removeChild(ArtNode*& ref, const unsigned char byte) {
+    ArtNode* node = ref;
+    switch (node->type) {
+        case ART_NODE4: {
+            ArtNode4* n = static_cast<ArtNode4*>(node);
+            int i = 0;
+            while (n->keys[i] != byte) i++;
+            n->count--;
+            n->keys[i] = n->keys[n->count];
+            n->children[i] = n->children[n->count];
+            if (n->count > 1) return;
+            // a node of one child is folded into it, its prefix and branch byte going in front of the child's
+            ArtNode* only = n->children[0];
+            if (!isLeaf(only)) {
+                const std::size_t length = n->prefixLength + 1 + only->prefixLength;
+                memmove(only->prefix + n->prefixLength + 1, only->prefix, only->prefixLength);
+                memcpy(only->prefix, n->prefix, n->prefixLength);
+                only->prefix[n->prefixLength] = n->keys[0];
+                only->prefixLength = (std::uint8_t)length;
+            }
+            freeNode(n);
+            ref = only;
+            return;
+        }
+        case ART_NODE16: {
+            ArtNode16* n = static_cast<ArtNode16*>(node);
+            int i = 0;
+            while (n->keys[i] != byte) i++;
+            n->count--;
+            n->keys[i] = n->keys[n->count];
+            n->children[i] = n->children[n->count];
+            if (n->count > 3) return;
+            ArtNode4* smaller = static_cast<ArtNode4*>(newNode(ART_NODE4));
+            copyHeader(smaller, n);
+            memcpy(smaller->keys, n->keys, n->count);
+            memcpy(smaller->children, n->children, n->count * sizeof(ArtNode*));
+            freeNode(n);
+            ref = smaller;
+            return;
+        }
+        case ART_NODE48: {
+            ArtNode48* n = static_cast<ArtNode48*>(node);
+            n->children[n->index[byte] - 1] = NULL;
+            n->index[byte] = 0;
+            n->count--;
+            if (n->count > 12) return;
+            ArtNode16* smaller = static_cast<ArtNode16*>(newNode(ART_NODE16));
+            copyHeader(smaller, n);
+            int slot = 0;
+            for (int b = 0; b < 256; b++) {
+                if (n->index[b] == 0) continue;
+                smaller->keys[slot] = (unsigned char)b;
+                smaller->children[slot] = n->children[n->index[b] - 1];
+                slot++;
+            }
+            freeNode(n);
+            ref = smaller;
+            return;
+        }
+        default: {
+            ArtNode256* n = static_cast<ArtNode256*>(node);
+            n->children[byte] = NULL;
+            n->count--;
+            if (n->count > 37) return;
+            ArtNode48* smaller = static_cast<ArtNode48*>(newNode(ART_NODE48));
+            copyHeader(smaller, n);
+            int slot = 0;
+            for (int b = 0; b < 256; b++) {
+                if (n->children[b] == NULL) continue;
+                smaller->index[b] = (unsigned char)(slot + 1);
+                smaller->children[slot] = n->children[b];
+                slot++;
+            }
+            freeNode(n);
+            ref = smaller;
+            return;
+        }
+    }
+}
+
+ArtNode* HotKeyCache::newNode(const int type) {
+    ArtNode* node;
+    switch (type) {
+        case ART_NODE4:
+            node = new ArtNode4();
+            break;
+        case ART_NODE16:
+            node = new ArtNode16();
+            break;
+        case ART_NODE48:
+            node = new ArtNode48();
+            break;
+        default:
+            node = new ArtNode256();
+            break;
+    }
+    node->type = (std::uint8_t)type;
+    used += nodeBytes(type);
+    return node;
+}
+
+void HotKeyCache::freeNode(ArtNode* node) {
+    used -= nodeBytes(node->type);
+    switch (node->type) {
+        case ART_NODE4:
+            delete static_cast<ArtNode4*>(node);
+            break;
+        case ART_NODE16:
+            delete static_cast<ArtNode16*>(node);
+            break;
+        case ART_NODE48:
+            delete static_cast<ArtNode48*>(node);
+            break;
+        default:
+            delete static_cast<ArtNode256*>(node);
+            break;
+    }
+}
+
+void HotKeyCache::destroy(ArtNode* node) {
+    if (node == NULL || isLeaf(node)) return;
+    switch (node->type) {
+        case ART_NODE4: {
+            ArtNode4* n = static_cast<ArtNode4*>(node);
+            for (int i = 0; i < n->count; i++) destroy(n->children[i]);
+            break;
+        }
+        case ART_NODE16: {
+            ArtNode16* n = static_cast<ArtNode16*>(node);
+            for (int i = 0; i < n->count; i++) destroy(n->children[i]);
+            break;
+        }
+        case ART_NODE48: {
+            ArtNode48* n = static_cast<ArtNode48*>(node);
+            for (int i = 0; i < 48; i++) destroy(n->children[i]);
+            break;
+        }
+        default: {
+            ArtNode256* n = static_cast<ArtNode256*>(node);
+            for (int i = 0; i < 256; i++) destroy(n->children[i]);
+            break;
+        }
+    }
+    freeNode(node);
+}
+
+void HotKeyCache::evict(HotLeaf* leaf) {
+    eraseLeaf(root, leaf->key, 0);
+    leaves[leaf->slot] = leaves.back();
+    leaves[leaf->slot]->slot = leaf->slot;
+    leaves.pop_back();
+    used -= leafBytes(leaf);
+    delete leaf;
+}
+
+HotLeaf* HotKeyCache::sampleVictim() {
+    HotLeaf* victim = NULL;
+    for (int i = 0; i < HOT_EVICTION_SAMPLE && !leaves.empty(); i++) {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        HotLeaf* leaf = leaves[random % leaves.size()];
+        if (victim == NULL || leaf->hits.load(std::memory_order_relaxed) < victim->hits.load(std::memory_order_relaxed))
+            victim = leaf;
+    }
+    return victim;
+}
+
+std::uint32_t HotKeyCache::countKey(const unsigned char* key) {
+    if (++sketchAdds >= agingPeriod) {
+        // old counts halve, so that what was hot a while ago does not keep its place for ever
+        for (size_t i = 0; i < sketch.size(); i++) sketch[i] >>= 1;
+        for (size_t i = 0; i < leaves.size(); i++)
+            leaves[i]->hits.store(leaves[i]->hits.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+        sketchAdds = 0;
+    }
+    const std::uint64_t hash = BloomFilter::hash(key, keyLength);
+    const std::uint32_t h1 = (std::uint32_t)hash;
+    const std::uint32_t h2 = (std::uint32_t)(hash >> 32) | 1;
+    std::uint32_t least = 255;
+    for (int row = 0; row < SKETCH_ROWS; row++) {
+        std::uint8_t& counter = sketch[row * sketchWidth + ((h1 + row * h2) & (sketchWidth - 1))];
+        if (counter < 255) counter++;
+        least = std::min<std::uint32_t>(least, counter);
+    }
+    return least;
+}
+
+std::size_t HotKeyCache::leafBytes(const HotLeaf* leaf) {
+    return sizeof(HotLeaf) + leaf->rids.capacity() * sizeof(RecordId);
+}
+
+}  // namespace badgerdb
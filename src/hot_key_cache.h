@@ -0,0 +1,265 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "latch.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Longest key a HotKeyCache holds, in bytes.
+ */
+const std::size_t HOT_KEY_MAX_BYTES = 16;
+
+/**
+ * @brief Times a key has to miss, as counted by the frequency sketch, before a HotKeyCache admits it, so that keys
+ * looked up once never displace anything.
+ */
+const std::uint32_t HOT_ADMIT_FREQUENCY = 2;
+
+/**
+ * @brief Cached keys a full HotKeyCache samples to pick the one to evict for a key more frequent than it.
+ */
+const int HOT_EVICTION_SAMPLE = 8;
+
+/**
+ * @brief Inner node of the adaptive radix tree of a HotKeyCache; the four node sizes are defined with it in
+ * hot_key_cache.cpp.
+ */
+struct ArtNode;
+
+/**
+ * @brief A cached key with its record ids, a leaf of the adaptive radix tree of a HotKeyCache.
+ */
+struct HotLeaf;
+
+/**
+ * @brief In-memory cache of the record ids of the keys looked up most often, which a BTreeIndex answers lookups
+ * from before descending the tree.
+ *
+ * Keys are byte strings of one length. They are held in an adaptive radix tree: each inner node branches on one
+ * byte of the key and is sized to its children, with room for 4, 16, 48 or 256 of them, growing and shrinking as
+ * children come and go; a run of bytes that every key below a node shares is kept in the node rather than in a
+ * chain of nodes. A lookup so reads one small node per byte at which cached keys differ, in place of the pages of
+ * a descent.
+ *
+ * Keys get in by frequency. A lookup that misses offers what it then found in the tree, and a count-min sketch
+ * counts every key offered; a key is admitted once it was offered HOT_ADMIT_FREQUENCY times, and only evicts a
+ * sampled cached key that was used less often than it was. Cached keys keep counting their hits, and all counts
+ * halve every so often, so that keys that have gone cold make way. The keys, record ids and nodes are held within
+ * a budget of bytes, which only record ids added to cached keys can take the cache over until the next admission;
+ * the sketch, sized by the budget, comes on top.
+ *
+ * Its owner keeps the cache consistent by calling added and removed for every entry it inserts or deletes once
+ * the change is made. A lookup that misses reads version before the tree, and offer turns away what it found if
+ * an entry changed in between, so an entry changed while the lookup ran is never lost. The record ids of a key
+ * come back as they were cached, with those added later after them, rather than in index order, and an entry
+ * inserted twice is held once.
+ *
+ * find may run from several threads at once; every other method excludes it and each other.
+ */
+class HotKeyCache {
+   public:
+    /**
+     * Constructor of HotKeyCache class, creates an empty cache.
+     *
+     * @param keyLength   Bytes of every key, at most HOT_KEY_MAX_BYTES
+     * @param budget      Most bytes the keys, their record ids and the nodes holding them may take
+     */
+    HotKeyCache(const std::size_t keyLength, const std::size_t budget);
+
+    ~HotKeyCache();
+
+    /**
+     * Finds a cached key.
+     *
+     * @param key   Key, keyLength bytes
+     * @param out   Receives the record ids of the key, possibly none, if it is cached
+     * @return      True if the key is cached
+     */
+    bool find(const unsigned char* key, std::vector<RecordId>& out);
+
+    /**
+     * Returns the number of entries added or removed so far, for a lookup that misses to pass to offer.
+     */
+    std::uint64_t version() const { return changes.load(std::memory_order_acquire); }
+
+    /**
+     * Offers a key that missed, with every record id the tree holds for it, possibly none. It is counted, and
+     * admitted if it is frequent enough and fits, evicting keys used less often than it to make room.
+     *
+     * @param key     Key, keyLength bytes
+     * @param rids    Record ids of the key
+     * @param stamp   version as read before the tree was looked at
+     * @return        True if the key was admitted
+     */
+    bool offer(const unsigned char* key, const std::vector<RecordId>& rids, const std::uint64_t stamp);
+
+    /**
+     * Records that an entry was inserted, adding its record id to the key if it is cached.
+     */
+    void added(const unsigned char* key, const RecordId rid);
+
+    /**
+     * Records that an entry was deleted, taking its record id from the key if it is cached.
+     */
+    void removed(const unsigned char* key, const RecordId rid);
+
+    /**
+     * Evicts every key and forgets their counts.
+     */
+    void clear();
+
+    /**
+     * Returns the number of keys cached.
+     */
+    std::size_t keys() const;
+
+    /**
+     * Returns the bytes the cached keys, their record ids and the nodes holding them take.
+     */
+    std::size_t bytes() const;
+
+    /**
+     * Returns the most bytes the cache holds.
+     */
+    std::size_t budget() const { return budgetBytes; }
+
+   private:
+    /**
+     * Bytes of every key
+     */
+    const std::size_t keyLength;
+
+    /**
+     * Most bytes the leaves and nodes may take
+     */
+    const std::size_t budgetBytes;
+
+    /**
+     * Held shared by find and exclusively by everything else
+     */
+    mutable RWLatch latch;
+
+    /**
+     * Root of the tree: NULL, a tagged leaf or an inner node
+     */
+    ArtNode* root;
+
+    /**
+     * Every leaf, each knowing its position, so that eviction can sample them
+     */
+    std::vector<HotLeaf*> leaves;
+
+    /**
+     * Bytes the leaves and nodes take
+     */
+    std::size_t used;
+
+    /**
+     * Entries added or removed since the cache was created
+     */
+    std::atomic<std::uint64_t> changes;
+
+    /**
+     * Count-min sketch of the keys offered: SKETCH_ROWS rows of sketchWidth saturating counters
+     */
+    std::vector<std::uint8_t> sketch;
+
+    /**
+     * Counters per row of the sketch, a power of two
+     */
+    std::size_t sketchWidth;
+
+    /**
+     * Keys counted since the counts were last halved, and how many are counted between halvings
+     */
+    std::size_t sketchAdds;
+    std::size_t agingPeriod;
+
+    /**
+     * State of the generator picking the keys eviction samples
+     */
+    std::uint64_t random;
+
+    /**
+     * Returns the leaf of a key, or NULL if it is not cached.
+     */
+    HotLeaf* findLeaf(const unsigned char* key) const;
+
+    /**
+     * Puts a leaf into the subtree ref points to, whose keys share their first depth bytes with it.
+     */
+    void insertLeaf(ArtNode*& ref, HotLeaf* leaf, const std::size_t depth);
+
+    /**
+     * Takes the leaf of a key out of the subtree ref points to, whose keys share their first depth bytes with
+     * it, shrinking the nodes it leaves with fewer children. The leaf itself is not freed.
+     *
+     * @return  True if the key was found
+     */
+    bool eraseLeaf(ArtNode*& ref, const unsigned char* key, const std::size_t depth);
+
+    /**
+     * Adds a child to the node ref points to, replacing the node with a larger one if it is full.
+     */
+    void addChild(ArtNode*& ref, const unsigned char byte, ArtNode* child);
+
+    /**
+     * Removes a child from the node ref points to, replacing the node with a smaller one if few children are
+     * left, or with its only child if one is.
+     */
+    void removeChild(ArtNode*& ref, const unsigned char byte);
+
+    /**
+     * Allocates an empty node with room for 4, 16, 48 or 256 children, charging it to used.
+     */
+    ArtNode* newNode(const int type);
+
+    /**
+     * Frees a node, without its children.
+     */
+    void freeNode(ArtNode* node);
+
+    /**
+     * Frees a subtree, leaves aside.
+     */
+    void destroy(ArtNode* node);
+
+    /**
+     * Evicts a cached key.
+     */
+    void evict(HotLeaf* leaf);
+
+    /**
+     * Picks the least used of HOT_EVICTION_SAMPLE cached keys, or NULL if none is cached.
+     */
+    HotLeaf* sampleVictim();
+
+    /**
+     * Counts a key in the sketch and returns its estimated count, halving every count first if the period is
+     * over.
+     */
+    std::uint32_t countKey(const unsigned char* key);
+
+    /**
+     * Returns the bytes a leaf takes.
+     */
+    static std::size_t leafBytes(const HotLeaf* leaf);
+
+    HotKeyCache(const HotKeyCache&);
+    HotKeyCache& operator=(const HotKeyCache&);
+};
+
+}  // namespace badgerdb
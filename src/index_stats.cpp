@@ -0,0 +1,90 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "index_stats.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <new>
+
+namespace badgerdb {
+
+/**
+ * Field of IndexStats each IndexCounter is added to.
+ */
+static std::uint64_t IndexStats::*const STATS_FIELDS[INDEX_COUNTERS] = {
+    &IndexStats::inserts,      &IndexStats::deletes,     &IndexStats::leafSplits,   &IndexStats::nodeSplits,
+    &IndexStats::merges,       &IndexStats::lookups,     &IndexStats::lookupLeaves, &IndexStats::probes,
+    &IndexStats::filtered,     &IndexStats::descents,    &IndexStats::descentNodes, &IndexStats::retries,
+    &IndexStats::scans,        &IndexStats::scanLeaves,  &IndexStats::scanRids,     &IndexStats::hotHits};
+
+void IndexStats::clear() {
+    for (int i = 0; i < INDEX_COUNTERS; i++) this->*STATS_FIELDS[i] = 0;
+}
+
+IndexCounters::IndexCounters() {
+    void* storage = NULL;
+    if (posix_memalign(&storage, CACHE_LINE_SIZE, INDEX_COUNTER_SHARDS * sizeof(Shard)) != 0) throw std::bad_alloc();
+    shards = static_cast<Shard*>(storage);
+    for (int s = 0; s < INDEX_COUNTER_SHARDS; s++) new (&shards[s]) Shard();
+    clear();
+}
+
+IndexCounters::~IndexCounters() {
+    for (int s = 0; s < INDEX_COUNTER_SHARDS; s++) shards[s].~Shard();
+    free(shards);
+}
+
+void IndexCounters::addTo(IndexStats& out) const {
+    for (int s = 0; s < INDEX_COUNTER_SHARDS; s++) {
+        for (int i = 0; i < INDEX_COUNTERS; i++) out.*STATS_FIELDS[i] += shards[s].values[i].load(std::memory_order_relaxed);
+    }
+}
+
+void IndexCounters::clear() {
+    for (int s = 0; s < INDEX_COUNTER_SHARDS; s++) {
+        for (int i = 0; i < INDEX_COUNTERS; i++) shards[s].values[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+int IndexCounters::shard() {
+    static std::atomic<int> nextShard(0);
+    static thread_local int mine = nextShard.fetch_add(1, std::memory_order_relaxed) % INDEX_COUNTER_SHARDS;
+    return mine;
+}
+
+LevelShape::LevelShape() : nodes(0), entries(0), slots(0) {
+    std::fill(fill, fill + FILL_BUCKETS, 0);
+}
+
+void LevelShape::add(const int nodeEntries, const int nodeSlots) {
+    nodes++;
+    entries += nodeEntries;
+    slots += nodeSlots;
+    const int bucket = nodeSlots == 0 ? 0 : (int)((std::int64_t)nodeEntries * FILL_BUCKETS / nodeSlots);
+    fill[std::min(bucket, FILL_BUCKETS - 1)]++;
+}
+
+void IndexShape::print(std::ostream& out) const {
+    const std::ios::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    for (std::size_t i = 0; i < levels.size(); i++) {
+        const LevelShape& level = levels[i];
+        out << "level " << i << (i + 1 == levels.size() ? " (leaves)" : "") << ": nodes " << level.nodes
+            << " entries " << level.entries << " fill " << level.fillFactor() << " deciles";
+        for (int b = 0; b < FILL_BUCKETS; b++) out << ' ' << level.fill[b];
+        out << '\n';
+    }
+    out << "retired nodes " << retiredNodes << std::endl;
+    out.flags(flags);
+    out.precision(precision);
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,309 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "arena.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Operations a BTreeIndex counts, one IndexCounters slot each.
+ */
+enum IndexCounter {
+    INDEX_INSERTS,
+    INDEX_DELETES,
+    INDEX_LEAF_SPLITS,
+    INDEX_NODE_SPLITS,
+    INDEX_MERGES,
+    INDEX_LOOKUPS,
+    INDEX_LOOKUP_LEAVES,
+    INDEX_PROBES,
+    INDEX_FILTERED,
+    INDEX_DESCENTS,
+    INDEX_DESCENT_NODES,
+    INDEX_RETRIES,
+    INDEX_SCANS,
+    INDEX_SCAN_LEAVES,
+    INDEX_SCAN_RIDS,
+    INDEX_HOT_HITS,
+    INDEX_COUNTERS
+};
+
+/**
+ * @brief Number of shards of an IndexCounters. Each thread adds to one of them, so threads rarely share a line.
+ */
+const int INDEX_COUNTER_SHARDS = 16;
+
+/**
+ * @brief Counters of a BTreeIndex, as returned by BTreeIndex::stats.
+ */
+struct IndexStats {
+    /**
+     * Entries inserted into the tree, by insertEntry or insertBatch or out of the write buffer; bulk loads are not
+     * counted
+     */
+    std::uint64_t inserts;
+
+    /**
+     * Entries deleted
+     */
+    std::uint64_t deletes;
+
+    /**
+     * Leaves split
+     */
+    std::uint64_t leafSplits;
+
+    /**
+     * Non-leaf nodes split
+     */
+    std::uint64_t nodeSplits;
+
+    /**
+     * Nodes merged into a sibling, or roots collapsed, by deletes
+     */
+    std::uint64_t merges;
+
+    /**
+     * Keys looked up by lookup and contains, including those the key filter turned away or the hot key cache answered
+     */
+    std::uint64_t lookups;
+
+    /**
+     * Leaves those lookups read, one for each that reached the tree plus one for each further leaf its duplicates
+     * continued in
+     */
+    std::uint64_t lookupLeaves;
+
+    /**
+     * Probe keys looked up by lookupBatch
+     */
+    std::uint64_t probes;
+
+    /**
+     * Lookups, probes and scans the key filter answered without reading a page
+     */
+    std::uint64_t filtered;
+
+    /**
+     * Descents from the root to a leaf, by any operation
+     */
+    std::uint64_t descents;
+
+    /**
+     * Nodes read by those descents, leaves included
+     */
+    std::uint64_t descentNodes;
+
+    /**
+     * Optimistic lookups and scan openings that found a node changed under them and had to start again
+     */
+    std::uint64_t retries;
+
+    /**
+     * Scans opened, by startScan or openScan
+     */
+    std::uint64_t scans;
+
+    /**
+     * Leaves scans copied entries out of, a leaf read again after a retry counting again
+     */
+    std::uint64_t scanLeaves;
+
+    /**
+     * Record ids scans returned
+     */
+    std::uint64_t scanRids;
+
+    /**
+     * Lookups the hot key cache answered without reading a page
+     */
+    std::uint64_t hotHits;
+
+    IndexStats() { clear(); }
+
+    void clear();
+
+    /**
+     * @return  Nodes read per descent, which is the height of the tree while it does not change; 0 without descents
+     */
+    double nodesPerDescent() const { return descents == 0 ? 0 : (double)descentNodes / descents; }
+
+    /**
+     * @return  Leaves read per lookup, those the key filter answered reading none; 0 without lookups
+     */
+    double leavesPerLookup() const { return lookups == 0 ? 0 : (double)lookupLeaves / lookups; }
+};
+
+/**
+ * @brief Counters of a BTreeIndex, updated with relaxed atomics from any thread.
+ *
+ * Each thread adds to a shard of its own choosing, in cache lines of their own, so that lookups running on every
+ * core do not all write the same line; stats adds the shards up.
+ */
+class IndexCounters {
+   public:
+    IndexCounters();
+
+    ~IndexCounters();
+
+    /**
+     * Adds n to a counter.
+     */
+    void add(const IndexCounter counter, const std::uint64_t n = 1) {
+        shards[shard()].values[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /**
+     * Adds the counters to a snapshot. Operations counted meanwhile may or may not be in it.
+     */
+    void addTo(IndexStats& out) const;
+
+    void clear();
+
+   private:
+    /**
+     * @brief One thread's share of every counter.
+     */
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        std::atomic<std::uint64_t> values[INDEX_COUNTERS];
+    };
+
+    /**
+     * INDEX_COUNTER_SHARDS shards, allocated apart on a cache line boundary: the counters are members of objects
+     * allocated with plain new, which would not honour the alignment of shards held inline
+     */
+    Shard* shards;
+
+    /**
+     * Returns the shard of the calling thread, handed out round robin the first time it counts anything.
+     */
+    static int shard();
+
+    IndexCounters(const IndexCounters&);
+    IndexCounters& operator=(const IndexCounters&);
+};
+
+/**
+ * @brief Number of fill factor buckets of a LevelShape, each a tenth of a node.
+ */
+const int FILL_BUCKETS = 10;
+
+/**
+ * @brief Occupancy of the nodes of one level of a BTreeIndex, as found by BTreeIndex::analyze.
+ */
+struct LevelShape {
+    /**
+     * Nodes on the level
+     */
+    std::uint64_t nodes;
+
+    /**
+     * Entries of the leaves, or keys of the non-leaf nodes, on the level
+     */
+    std::uint64_t entries;
+
+    /**
+     * Slots of the nodes on the level, counted as spaceAvail does; prefix and frame-of-reference compressed nodes
+     * have as many as their fences allow
+     */
+    std::uint64_t slots;
+
+    /**
+     * Nodes by fill fraction: bucket i counts the nodes holding at least i tenths and less than i + 1 tenths of
+     * their slots, the last bucket the full ones too
+     */
+    std::uint64_t fill[FILL_BUCKETS];
+
+    LevelShape();
+
+    /**
+     * @return  Fraction of the level's slots in use, 0 for an empty level
+     */
+    double fillFactor() const { return slots == 0 ? 0 : (double)entries / slots; }
+
+    /**
+     * Counts one node.
+     */
+    void add(const int nodeEntries, const int nodeSlots);
+};
+
+/**
+ * @brief Structure of a BTreeIndex, as found by BTreeIndex::analyze.
+ */
+struct IndexShape {
+    /**
+     * Levels of the tree, the root's first and the leaves' last; one level while the root is a leaf
+     */
+    std::vector<LevelShape> levels;
+
+    /**
+     * Nodes merged away that wait for readers to leave before their pages are freed
+     */
+    std::uint64_t retiredNodes;
+
+    IndexShape() : retiredNodes(0) {}
+
+    /**
+     * @return  Number of levels, leaves included
+     */
+    int height() const { return (int)levels.size(); }
+
+    /**
+     * @return  The leaf level
+     */
+    const LevelShape& leaves() const { return levels.back(); }
+
+    /**
+     * Writes one line per level with its node count, fill factor and fill histogram.
+     */
+    void print(std::ostream& out) const;
+};
+
+/**
+ * @brief What the meta page of a BTreeIndex keeps about its size and fill, read with it when the index is opened,
+ * as BTreeIndex::summary returns it.
+ */
+struct IndexSummary {
+    /**
+     * Levels of the tree, leaves included
+     */
+    int height;
+
+    /**
+     * Entries in the tree
+     */
+    std::uint64_t entries;
+
+    /**
+     * False if entries is only an estimate: the index was not closed cleanly since it was last counted, or it
+     * was written before the meta page kept a count
+     */
+    bool entriesExact;
+
+    /**
+     * Leaves, their entries and their slots as last measured, when the index was bulk loaded or analyzed
+     */
+    std::uint64_t leafNodes;
+    std::uint64_t leafEntries;
+    std::uint64_t leafSlots;
+
+    IndexSummary() : height(0), entries(0), entriesExact(false), leafNodes(0), leafEntries(0), leafSlots(0) {}
+
+    /**
+     * @return  Fraction of the leaf slots in use when last measured, 0 if never measured
+     */
+    double leafFill() const { return leafSlots == 0 ? 0 : (double)leafEntries / leafSlots; }
+};
+
+}  // namespace badgerdb
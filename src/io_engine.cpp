@@ -0,0 +1,361 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "io_engine.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace badgerdb {
+
+#ifdef __linux__
+
+/**
+ * @brief A minimal io_uring instance driven through the raw system calls, so that no library is needed.
+ *
+ * Submissions are serialized by a lock and at most depth requests are in flight, which keeps the
+ * completion queue from overflowing. One reaper thread consumes completions.
+ */
+struct IOEngine::Ring {
+    int fd;
+    unsigned depth;
+    unsigned inFlight;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    struct io_uring_sqe* sqes;
+
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    size_t sqesSize;
+
+    /**
+     * Guards the submission queue and inFlight
+     */
+    std::mutex lock;
+
+    /**
+     * Signalled when a request completes and frees a slot
+     */
+    std::condition_variable space;
+
+    std::thread reaper;
+
+    /**
+     * Set if the no-op telling the reaper to exit could not be submitted, for it to see instead
+     */
+    std::atomic<bool> closed;
+
+    Ring() : fd(-1), inFlight(0), sqes(NULL), sqRing(MAP_FAILED), cqRing(MAP_FAILED), closed(false) {}
+
+    /**
+     * Sets up the rings, returning false if the kernel does not offer io_uring.
+     */
+    bool open(const unsigned entries) {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0) return false;
+        depth = params.sq_entries;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+        sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) return false;
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            cqRing = sqRing;
+        } else {
+            cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) return false;
+        }
+        sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        void* sqesMap = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqesMap == MAP_FAILED) return false;
+        sqes = static_cast<struct io_uring_sqe*>(sqesMap);
+
+        char* sq = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    ~Ring() {
+        if (sqes != NULL) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (fd >= 0) ::close(fd);
+    }
+
+    /**
+     * Queues one operation and submits it to the kernel, waiting while depth requests are in flight.
+     *
+     * @return  False if the kernel refused it, in which case it is not in flight
+     */
+    bool push(const unsigned char opcode, const int file, const off_t offset, void* addr, const unsigned length,
+              const std::uint64_t userData) {
+        std::unique_lock<std::mutex> guard(lock);
+        while (inFlight >= depth) space.wait(guard);
+        if (!enter(opcode, file, offset, addr, length, userData)) return false;
+        inFlight++;
+        return true;
+    }
+
+    /**
+     * Queues the rest of a request that completed short and submits it to the kernel. The request keeps the
+     * slot it holds, so this never waits, as the reaper calling it must not.
+     *
+     * @return  False if the kernel refused it, in which case the request still holds its slot
+     */
+    bool resubmit(const unsigned char opcode, const int file, const off_t offset, void* addr, const unsigned length,
+                  const std::uint64_t userData) {
+        std::lock_guard<std::mutex> guard(lock);
+        return enter(opcode, file, offset, addr, length, userData);
+    }
+
+    /**
+     * Fills the next submission queue entry and submits it, taking the entry back if the kernel refuses it.
+     * Called with lock held.
+     */
+    bool enter(const unsigned char opcode, const int file, const off_t offset, void* addr, const unsigned length,
+               const std::uint64_t userData) {
+        const unsigned tail = *sqTail;
+        const unsigned index = tail & *sqMask;
+        struct io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = file;
+        sqe->off = offset;
+        sqe->addr = (std::uint64_t)(uintptr_t)addr;
+        sqe->len = length;
+        sqe->user_data = userData;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+        while (syscall(__NR_io_uring_enter, fd, 1, 0, 0, NULL, 0) < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                // a failed enter consumed no entry
+                __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+};
+
+#else
+
+struct IOEngine::Ring {
+    std::thread reaper;
+};
+
+#endif
+
+IOEngine::IOEngine(const std::uint32_t queueDepth, const std::uint32_t workerCount)
+    : ring(NULL), stopping(false), pending(0) {
+#ifdef __linux__
+    ring = new Ring();
+    if (ring->open(std::max(queueDepth, (std::uint32_t)1))) {
+        ring->reaper = std::thread(&IOEngine::reapLoop, this);
+    } else {
+        delete ring;
+        ring = NULL;
+    }
+#endif
+    for (std::uint32_t i = 0; i < std::max(workerCount, (std::uint32_t)1); i++)
+        workers.push_back(std::thread(&IOEngine::workerLoop, this));
+}
+
+IOEngine::~IOEngine() {
+    drain();
+
+#ifdef __linux__
+    if (ring != NULL) {
+        // a no-op with no request attached tells the reaper to exit
+        if (!ring->push(IORING_OP_NOP, -1, 0, NULL, 0, 0)) ring->closed = true;
+        ring->reaper.join();
+        delete ring;
+    }
+#endif
+
+    {
+        std::lock_guard<std::mutex> guard(queueLock);
+        stopping = true;
+    }
+    queueReady.notify_all();
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
+void IOEngine::submitRead(File* file, const PageId pageNo, Page* page, const Callback& done) {
+    Request* request = new Request();
+    request->file = file;
+    request->pageNo = pageNo;
+    request->page = page;
+    request->write = false;
+    request->done = done;
+    request->fd = -1;
+    request->offset = 0;
+    request->transferred = 0;
+    submit(request);
+}
+
+void IOEngine::submitWrite(File* file, const PageId pageNo, const Page* page, const Callback& done) {
+    Request* request = new Request();
+    request->file = file;
+    request->pageNo = pageNo;
+    request->page = const_cast<Page*>(page);
+    request->write = true;
+    request->done = done;
+    request->fd = -1;
+    request->offset = 0;
+    request->transferred = 0;
+    submit(request);
+}
+
+void IOEngine::drain() {
+    std::unique_lock<std::mutex> guard(pendingLock);
+    while (pending > 0) idle.wait(guard);
+}
+
+void IOEngine::submit(Request* request) {
+    {
+        std::lock_guard<std::mutex> guard(pendingLock);
+        pending++;
+    }
+
+#ifdef __linux__
+    if (ring != NULL && request->file->pageLocation(request->pageNo, request->page, request->fd, request->offset)) {
+        // a request the kernel refuses goes through File instead
+        if (ring->push(request->write ? IORING_OP_WRITE : IORING_OP_READ, request->fd, request->offset,
+                       request->page, Page::SIZE, (std::uint64_t)(uintptr_t)request))
+            return;
+    }
+#endif
+
+    {
+        std::lock_guard<std::mutex> guard(queueLock);
+        queue.push_back(request);
+    }
+    queueReady.notify_one();
+}
+
+void IOEngine::complete(Request* request, const bool ok) {
+    request->done(ok);
+    delete request;
+
+    std::lock_guard<std::mutex> guard(pendingLock);
+    if (--pending == 0) idle.notify_all();
+}
+
+void IOEngine::workerLoop() {
+    while (true) {
+        Request* request;
+        {
+            std::unique_lock<std::mutex> guard(queueLock);
+            while (queue.empty() && !stopping) queueReady.wait(guard);
+            if (queue.empty()) return;
+            request = queue.front();
+            queue.pop_front();
+        }
+
+        bool ok = true;
+        try {
+            if (request->write)
+                request->file->writePage(request->pageNo, *request->page);
+            else
+                request->file->readPageInto(request->pageNo, *request->page);
+        } catch (...) {
+            ok = false;
+        }
+        complete(request, ok);
+    }
+}
+
+void IOEngine::reapLoop() {
+#ifdef __linux__
+    while (!ring->closed) {
+        if (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+            std::this_thread::yield();
+
+        unsigned head = *ring->cqHead;
+        const unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        bool stop = false;
+        while (head != tail) {
+            struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+            Request* request = reinterpret_cast<Request*>((uintptr_t)cqe->user_data);
+            const int result = cqe->res;
+            head++;
+            __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+
+            const bool partial = request != NULL && result > 0 && request->transferred + result < Page::SIZE;
+            if (partial) {
+                // a short transfer is retried for the rest of the page, which stays in flight meanwhile
+                request->transferred += result;
+                char* rest = reinterpret_cast<char*>(request->page) + request->transferred;
+                if (ring->resubmit(request->write ? IORING_OP_WRITE : IORING_OP_READ, request->fd,
+                                   request->offset + request->transferred, rest, Page::SIZE - request->transferred,
+                                   (std::uint64_t)(uintptr_t)request))
+                    continue;
+            }
+            {
+                std::lock_guard<std::mutex> guard(ring->lock);
+                ring->inFlight--;
+            }
+            ring->space.notify_one();
+
+            if (request == NULL) {
+                stop = true;
+            } else if (!partial && (result > 0 || (!request->write && result == 0))) {
+                // bytes past the end of the file read as zeros, as they do through File
+                const unsigned transferred = request->transferred + result;
+                char* page = reinterpret_cast<char*>(request->page);
+                if (!request->write) memset(page + transferred, 0, Page::SIZE - transferred);
+                complete(request, true);
+            } else {
+                // failed transfers, the rest of short ones the kernel refused, and kernels without these opcodes,
+                // go through File instead
+                {
+                    std::lock_guard<std::mutex> guard(queueLock);
+                    queue.push_back(request);
+                }
+                queueReady.notify_one();
+            }
+        }
+        if (stop) return;
+    }
+#endif
+}
+
+}  // namespace badgerdb
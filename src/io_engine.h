@@ -0,0 +1,171 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "file.h"
+#include "page.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Asynchronous page I/O engine.
+ *
+ * Page reads and writes are submitted with a callback and complete later on one of the engine's threads.
+ * On Linux, pages a file exposes through File::pageLocation are transferred by io_uring, so many of them
+ * can be in flight at once. Everything else, and every request when io_uring is not available, is run by
+ * a pool of worker threads calling File::readPage and File::writePage.
+ *
+ * Callbacks run on engine threads and must not wait for other I/O of the same engine. The page buffer of
+ * a request must stay valid until its callback has run.
+ */
+class IOEngine {
+   public:
+    /**
+     * Called when a request completes, with true if the page was transferred and false if it failed
+     */
+    typedef std::function<void(bool)> Callback;
+
+    /**
+     * Constructor of IOEngine class
+     *
+     * @param queueDepth  Maximum number of io_uring requests in flight; further submissions wait
+     * @param workers     Number of worker threads for requests that do not go through io_uring
+     */
+    explicit IOEngine(const std::uint32_t queueDepth = 64, const std::uint32_t workers = 2);
+
+    /**
+     * Destructor of IOEngine class, waits for all submitted requests to complete
+     */
+    ~IOEngine();
+
+    /**
+     * Starts reading a page of a file into page.
+     *
+     * @param file    File to read from
+     * @param pageNo  Page number in the file
+     * @param page    Buffer the page is read into
+     * @param done    Called once the read has completed
+     */
+    void submitRead(File* file, const PageId pageNo, Page* page, const Callback& done);
+
+    /**
+     * Starts writing page to a page of a file.
+     *
+     * @param file    File to write to
+     * @param pageNo  Page number in the file
+     * @param page    Page to write
+     * @param done    Called once the write has completed
+     */
+    void submitWrite(File* file, const PageId pageNo, const Page* page, const Callback& done);
+
+    /**
+     * Waits until every request submitted so far has completed and its callback has returned.
+     */
+    void drain();
+
+    /**
+     * Returns true if requests for raw page files go through io_uring.
+     */
+    bool usesUring() const { return ring != NULL; }
+
+   private:
+    /**
+     * @brief A submitted read or write.
+     */
+    struct Request {
+        File* file;
+        PageId pageNo;
+        Page* page;
+        bool write;
+        Callback done;
+
+        /**
+         * Where the page lies in the file, and the bytes of it io_uring has transferred so far
+         */
+        int fd;
+        off_t offset;
+        unsigned transferred;
+    };
+
+    /**
+     * io_uring instance, defined in io_engine.cpp; NULL if io_uring is not used
+     */
+    struct Ring;
+    Ring* ring;
+
+    /**
+     * Requests waiting for a worker thread
+     */
+    std::deque<Request*> queue;
+
+    /**
+     * Guards queue and stopping
+     */
+    std::mutex queueLock;
+
+    /**
+     * Signalled when a request is queued or the engine stops
+     */
+    std::condition_variable queueReady;
+
+    /**
+     * True once the destructor has asked the worker threads to exit
+     */
+    bool stopping;
+
+    /**
+     * Worker threads
+     */
+    std::vector<std::thread> workers;
+
+    /**
+     * Number of submitted requests whose callback has not returned yet
+     */
+    std::uint64_t pending;
+
+    /**
+     * Guards pending
+     */
+    std::mutex pendingLock;
+
+    /**
+     * Signalled when pending drops to zero
+     */
+    std::condition_variable idle;
+
+    /**
+     * Routes a request to io_uring or the worker threads.
+     */
+    void submit(Request* request);
+
+    /**
+     * Runs the callback of a completed request and accounts for it.
+     */
+    void complete(Request* request, const bool ok);
+
+    /**
+     * Body of the worker threads.
+     */
+    void workerLoop();
+
+    /**
+     * Body of the thread that reaps io_uring completions.
+     */
+    void reapLoop();
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,266 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "key_search.h"
+
+#include <string.h>
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BADGERDB_KEY_SEARCH_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BADGERDB_KEY_SEARCH_NEON
+#endif
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * @brief Set of count and unpack kernels for one instruction set.
+ */
+struct KeySearchKernel {
+    const char* name;
+    int (*less)(const int* keys, int n, int key);
+    int (*lessEqual)(const int* keys, int n, int key);
+    void (*unpack)(const void* deltas, int width, int n, int base, int* out);
+};
+
+int countLessScalar(const int* keys, int n, int key) {
+    int count = 0;
+    for (int i = 0; i < n; i++) count += keys[i] < key;
+    return count;
+}
+
+int countLessEqualScalar(const int* keys, int n, int key) {
+    int count = 0;
+    for (int i = 0; i < n; i++) count += keys[i] <= key;
+    return count;
+}
+
+void unpackScalar(const void* deltas, int width, int n, int base, int* out) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(deltas);
+    const std::uint32_t from = (std::uint32_t)base;
+    for (int i = 0; i < n; i++) {
+        std::uint32_t delta;
+        if (width == 1) {
+            delta = bytes[i];
+        } else if (width == 2) {
+            std::uint16_t narrow;
+            memcpy(&narrow, bytes + i * 2, 2);
+            delta = narrow;
+        } else {
+            memcpy(&delta, bytes + i * 4, 4);
+        }
+        out[i] = (int)(from + delta);
+    }
+}
+
+#ifdef BADGERDB_KEY_SEARCH_X86
+
+__attribute__((target("avx2"))) int countLessAvx2(const int* keys, int n, int key) {
+    const __m256i probe = _mm256_set1_epi32(key);
+    int count = 0;
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+        __m256i lt = _mm256_cmpgt_epi32(probe, chunk);
+        count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(lt)));
+    }
+    return count + countLessScalar(keys + i, n - i, key);
+}
+
+__attribute__((target("avx2"))) int countLessEqualAvx2(const int* keys, int n, int key) {
+    const __m256i probe = _mm256_set1_epi32(key);
+    int greater = 0;
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+        __m256i gt = _mm256_cmpgt_epi32(chunk, probe);
+        greater += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(gt)));
+    }
+    return (i - greater) + countLessEqualScalar(keys + i, n - i, key);
+}
+
+// SSE2 is part of the x86-64 baseline; two 4-wide compares cover each 8-key chunk.
+int countLessSse2(const int* keys, int n, int key) {
+    const __m128i probe = _mm_set1_epi32(key);
+    int count = 0;
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i + 4));
+        __m128i lt = _mm_packs_epi32(_mm_cmpgt_epi32(probe, lo), _mm_cmpgt_epi32(probe, hi));
+        count += __builtin_popcount(_mm_movemask_epi8(lt)) / 2;
+    }
+    return count + countLessScalar(keys + i, n - i, key);
+}
+
+int countLessEqualSse2(const int* keys, int n, int key) {
+    const __m128i probe = _mm_set1_epi32(key);
+    int greater = 0;
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i + 4));
+        __m128i gt = _mm_packs_epi32(_mm_cmpgt_epi32(lo, probe), _mm_cmpgt_epi32(hi, probe));
+        greater += __builtin_popcount(_mm_movemask_epi8(gt)) / 2;
+    }
+    return (i - greater) + countLessEqualScalar(keys + i, n - i, key);
+}
+
+__attribute__((target("avx2"))) void unpackAvx2(const void* deltas, int width, int n, int base, int* out) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(deltas);
+    const __m256i from = _mm256_set1_epi32(base);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i wide;
+        if (width == 1)
+            wide = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(bytes + i)));
+        else if (width == 2)
+            wide = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i * 2)));
+        else
+            wide = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes + i * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_add_epi32(wide, from));
+    }
+    unpackScalar(bytes + i * width, width, n - i, base, out + i);
+}
+
+// each 8-key chunk is widened with zero-extending unpacks into two 4-wide halves
+void unpackSse2(const void* deltas, int width, int n, int base, int* out) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(deltas);
+    const __m128i from = _mm_set1_epi32(base);
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo, hi;
+        if (width == 4) {
+            lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i * 4));
+            hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i * 4 + 16));
+        } else {
+            const __m128i narrow =
+                width == 1 ? _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(bytes + i)), zero)
+                           : _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i * 2));
+            lo = _mm_unpacklo_epi16(narrow, zero);
+            hi = _mm_unpackhi_epi16(narrow, zero);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi32(lo, from));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 4), _mm_add_epi32(hi, from));
+    }
+    unpackScalar(bytes + i * width, width, n - i, base, out + i);
+}
+
+#endif  // BADGERDB_KEY_SEARCH_X86
+
+#ifdef BADGERDB_KEY_SEARCH_NEON
+
+int countLessNeon(const int* keys, int n, int key) {
+    const int32x4_t probe = vdupq_n_s32(key);
+    uint32x4_t acc = vdupq_n_u32(0);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        // Each true lane is all ones; shifting right by 31 turns it into 1.
+        acc = vaddq_u32(acc, vshrq_n_u32(vcltq_s32(vld1q_s32(keys + i), probe), 31));
+        acc = vaddq_u32(acc, vshrq_n_u32(vcltq_s32(vld1q_s32(keys + i + 4), probe), 31));
+    }
+    int count = vgetq_lane_u32(acc, 0) + vgetq_lane_u32(acc, 1) + vgetq_lane_u32(acc, 2) + vgetq_lane_u32(acc, 3);
+    return count + countLessScalar(keys + i, n - i, key);
+}
+
+int countLessEqualNeon(const int* keys, int n, int key) {
+    const int32x4_t probe = vdupq_n_s32(key);
+    uint32x4_t acc = vdupq_n_u32(0);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc = vaddq_u32(acc, vshrq_n_u32(vcleq_s32(vld1q_s32(keys + i), probe), 31));
+        acc = vaddq_u32(acc, vshrq_n_u32(vcleq_s32(vld1q_s32(keys + i + 4), probe), 31));
+    }
+    int count = vgetq_lane_u32(acc, 0) + vgetq_lane_u32(acc, 1) + vgetq_lane_u32(acc, 2) + vgetq_lane_u32(acc, 3);
+    return count + countLessEqualScalar(keys + i, n - i, key);
+}
+
+void unpackNeon(const void* deltas, int width, int n, int base, int* out) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(deltas);
+    const uint32x4_t from = vdupq_n_u32((std::uint32_t)base);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint32x4_t lo, hi;
+        if (width == 1) {
+            const uint16x8_t narrow = vmovl_u8(vld1_u8(bytes + i));
+            lo = vmovl_u16(vget_low_u16(narrow));
+            hi = vmovl_u16(vget_high_u16(narrow));
+        } else if (width == 2) {
+            const uint16x8_t narrow = vreinterpretq_u16_u8(vld1q_u8(bytes + i * 2));
+            lo = vmovl_u16(vget_low_u16(narrow));
+            hi = vmovl_u16(vget_high_u16(narrow));
+        } else {
+            lo = vreinterpretq_u32_u8(vld1q_u8(bytes + i * 4));
+            hi = vreinterpretq_u32_u8(vld1q_u8(bytes + i * 4 + 16));
+        }
+        vst1q_s32(out + i, vreinterpretq_s32_u32(vaddq_u32(lo, from)));
+        vst1q_s32(out + i + 4, vreinterpretq_s32_u32(vaddq_u32(hi, from)));
+    }
+    unpackScalar(bytes + i * width, width, n - i, base, out + i);
+}
+
+#endif  // BADGERDB_KEY_SEARCH_NEON
+
+/**
+ * Picks the widest kernel the running CPU supports.
+ */
+KeySearchKernel selectKernel() {
+#if defined(BADGERDB_KEY_SEARCH_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        KeySearchKernel kernel = {"avx2", countLessAvx2, countLessEqualAvx2, unpackAvx2};
+        return kernel;
+    }
+    KeySearchKernel kernel = {"sse2", countLessSse2, countLessEqualSse2, unpackSse2};
+    return kernel;
+#elif defined(BADGERDB_KEY_SEARCH_NEON)
+    KeySearchKernel kernel = {"neon", countLessNeon, countLessEqualNeon, unpackNeon};
+    return kernel;
+#else
+    KeySearchKernel kernel = {"scalar", countLessScalar, countLessEqualScalar, unpackScalar};
+    return kernel;
+#endif
+}
+
+/**
+ * Returns the kernel for this CPU, selecting it on first use.
+ */
+const KeySearchKernel& kernel() {
+    static const KeySearchKernel selected = selectKernel();
+    return selected;
+}
+
+}  // namespace
+
+int countKeysLess(const int* keys, int n, int key) {
+    return kernel().less(keys, n, key);
+}
+
+int countKeysLessEqual(const int* keys, int n, int key) {
+    return kernel().lessEqual(keys, n, key);
+}
+
+void unpackKeys(const void* deltas, int width, int n, int base, int* out) {
+    if (width == 0) {
+        for (int i = 0; i < n; i++) out[i] = base;
+        return;
+    }
+    kernel().unpack(deltas, width, n, base, out);
+}
+
+const char* keySearchKernelName() {
+    return kernel().name;
+}
+
+}  // namespace badgerdb
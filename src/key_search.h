@@ -0,0 +1,58 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+namespace badgerdb {
+
+/**
+ * @brief Number of keys below which node searches stop halving and count the rest with the vector kernel.
+ */
+const int KEY_SEARCH_WINDOW = 32;
+
+/**
+ * Counts the keys in keys[0, n) that are less than key. The kernel is chosen once, on first use, from the
+ * best instruction set the CPU supports (AVX2 or SSE2 on x86, NEON on ARM) and falls back to scalar code.
+ * Keys are compared eight at a time where the instruction set allows it.
+ *
+ * @param keys  Keys to compare, need not be sorted
+ * @param n     Number of keys
+ * @param key   Probe key
+ * @return      Number of keys less than key
+ */
+int countKeysLess(const int* keys, int n, int key);
+
+/**
+ * Counts the keys in keys[0, n) that are less than or equal to key, using the same dispatched kernel as
+ * countKeysLess.
+ *
+ * @param keys  Keys to compare, need not be sorted
+ * @param n     Number of keys
+ * @param key   Probe key
+ * @return      Number of keys less than or equal to key
+ */
+int countKeysLessEqual(const int* keys, int n, int key);
+
+/**
+ * Rebuilds keys stored as unsigned distances from a base: out[i] = base + deltas[i], wrapping around as unsigned
+ * arithmetic does, using the same dispatched kernel as countKeysLess. Keys are widened eight at a time where the
+ * instruction set allows it.
+ *
+ * @param deltas    Distances, each width bytes in the byte order of the CPU; need not be aligned
+ * @param width     Bytes of each distance: 1, 2 or 4, or 0 for keys that all equal base
+ * @param n         Number of keys
+ * @param base      Base the distances are from
+ * @param out       Receives the n keys
+ */
+void unpackKeys(const void* deltas, int width, int n, int base, int* out);
+
+/**
+ * Returns the name of the kernel selected for this CPU ("avx2", "sse2", "neon" or "scalar").
+ */
+const char* keySearchKernelName();
+
+}  // namespace badgerdb
@@ -0,0 +1,100 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+namespace badgerdb {
+
+/**
+ * @brief Reader-writer latch guarding the contents of one buffer frame.
+ *
+ * Latches are held for the few instructions it takes to read or modify a page, so waiters spin and yield
+ * instead of sleeping. The state is the number of shared holders, or -1 while held exclusively.
+ */
+class RWLatch {
+   private:
+    /**
+     * Number of shared holders, or -1 if held exclusively
+     */
+    std::atomic<int> state;
+
+   public:
+    /**
+     * Constructor of RWLatch class, creates an unheld latch
+     */
+    RWLatch() : state(0) {}
+
+    /**
+     * Acquires the latch in shared mode, waiting while it is held exclusively.
+     */
+    void lockShared() {
+        while (true) {
+            int current = state.load(std::memory_order_relaxed);
+            if (current >= 0 && state.compare_exchange_weak(current, current + 1, std::memory_order_acquire))
+                return;
+            std::this_thread::yield();
+        }
+    }
+
+    /**
+     * Releases a shared hold on the latch.
+     */
+    void unlockShared() {
+        state.fetch_sub(1, std::memory_order_release);
+    }
+
+    /**
+     * Acquires the latch in exclusive mode, waiting until no one else holds it.
+     */
+    void lockExclusive() {
+        while (true) {
+            int current = 0;
+            if (state.compare_exchange_weak(current, -1, std::memory_order_acquire))
+                return;
+            std::this_thread::yield();
+        }
+    }
+
+    /**
+     * Releases an exclusive hold on the latch.
+     */
+    void unlockExclusive() {
+        state.store(0, std::memory_order_release);
+    }
+};
+
+/**
+ * @brief Holds an RWLatch for the scope it lives in, so that an exception leaving the scope releases it.
+ */
+class RWLatchGuard {
+   public:
+    RWLatchGuard(RWLatch& latch, const bool exclusive) : latch(latch), exclusive(exclusive) {
+        if (exclusive)
+            latch.lockExclusive();
+        else
+            latch.lockShared();
+    }
+
+    ~RWLatchGuard() {
+        if (exclusive)
+            latch.unlockExclusive();
+        else
+            latch.unlockShared();
+    }
+
+   private:
+    RWLatch& latch;
+    const bool exclusive;
+
+    RWLatchGuard(const RWLatchGuard&);
+    RWLatchGuard& operator=(const RWLatchGuard&);
+};
+
+}  // namespace badgerdb
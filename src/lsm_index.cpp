@@ -0,0 +1,661 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "lsm_index.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include "bloom_filter.h"
+#include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_scanrange_exception.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/scan_not_initialized_exception.h"
+#include "filescan.h"
+
+namespace badgerdb {
+
+// runs allocate their trees with plain new, which honours no more than the fundamental alignment
+static_assert(alignof(BTreeIndex) <= alignof(std::max_align_t), "BTreeIndex is over-aligned for new");
+
+struct LsmRun {
+    /**
+     * Number of the run, which names its files
+     */
+    std::uint64_t id;
+
+    /**
+     * Tier of the run: 0 for a memtable written out, one more than its inputs for a merge
+     */
+    unsigned tier;
+
+    /**
+     * Relation name the run's tree is opened under, and the name of its file
+     */
+    std::string relationName;
+    std::string indexName;
+
+    /**
+     * The run's entries
+     */
+    std::unique_ptr<BTreeIndex> tree;
+
+    /**
+     * Filter over the run's keys
+     */
+    BloomFilter filter;
+
+    /**
+     * Set once the run was merged away; its files go with the last reference to it
+     */
+    bool obsolete;
+
+    LsmRun() : id(0), tier(0), obsolete(false) {}
+
+    ~LsmRun() {
+        tree.reset();
+        if (!obsolete) return;
+        try {
+            File::remove(indexName);
+        } catch (const FileNotFoundException &e) {
+        }
+        std::remove((indexName + ".bloom").c_str());
+    }
+};
+
+/**
+ * Name of the relation a run's tree is opened under; the tree's file is named after it.
+ */
+static std::string runRelationName(const std::string &relationName, const std::uint64_t id) {
+    std::ostringstream name;
+    name << relationName << ".r" << id;
+    return name.str();
+}
+
+/**
+ * Fills low and high with the smallest and largest keys of a type, in the stored form, so that a scan between
+ * them inclusive reads every entry.
+ */
+static void keyBounds(const Datatype type, char *low, char *high) {
+    switch (type) {
+        case INTEGER: {
+            const int lowest = std::numeric_limits<int>::min();
+            const int highest = std::numeric_limits<int>::max();
+            memcpy(low, &lowest, sizeof(int));
+            memcpy(high, &highest, sizeof(int));
+            break;
+        }
+        case DOUBLE: {
+            const double lowest = -std::numeric_limits<double>::infinity();
+            const double highest = std::numeric_limits<double>::infinity();
+            memcpy(low, &lowest, sizeof(double));
+            memcpy(high, &highest, sizeof(double));
+            break;
+        }
+        case STRING:
+            memset(low, 0, STRINGSIZE);
+            memset(high, 0xff, STRINGSIZE);
+            break;
+    }
+}
+
+LsmIndex::LsmIndex(const std::string &relationName, std::string &outIndexName, BufMgr *bufMgrIn,
+                   const int attrByteOffset, const Datatype attrType, const std::size_t memtableEntries,
+                   const unsigned fanout)
+    : relationName(relationName), bufMgr(bufMgrIn), attrByteOffset(attrByteOffset), attributeType(attrType),
+      fanout(fanout < 2 ? 2 : fanout), nextRunId(0), compactorStop(false), scanExecuting(false), scanMemNext(0) {
+    std::ostringstream name;
+    name << relationName << '.' << attrByteOffset << ".lsm";
+    manifestName = name.str();
+    outIndexName = manifestName;
+    switch (attributeType) {
+        case INTEGER:
+            keySize = sizeof(int);
+            memtable.reset(new WriteBuffer<int>(memtableEntries));
+            break;
+        case DOUBLE:
+            keySize = sizeof(double);
+            memtable.reset(new WriteBuffer<double>(memtableEntries));
+            break;
+        case STRING:
+            keySize = STRINGSIZE;
+            memtable.reset(new WriteBuffer<StringKey>(memtableEntries));
+            break;
+    }
+
+    std::ifstream manifest(manifestName.c_str());
+    if (manifest) {
+        manifest >> nextRunId;
+        std::uint64_t id;
+        unsigned tier;
+        while (manifest >> id >> tier) runs.push_back(openRun(id, tier));
+    } else {
+        // a new index starts with one run holding every tuple of the relation
+        std::vector<char> keys;
+        std::vector<RecordId> rids;
+        FileScan scan(relationName, bufMgr);
+        char key[STRINGSIZE];
+        try {
+            RecordId rid;
+            while (true) {
+                scan.scanNext(rid);
+                encodeKey(scan.attribute(attrByteOffset, keySize), key);
+                keys.insert(keys.end(), key, key + keySize);
+                rids.push_back(rid);
+            }
+        } catch (const EndOfFileException &e) {
+        }
+        if (!rids.empty()) runs.push_back(createRun(keys, rids, 0));
+        std::lock_guard<std::mutex> guard(runsLock);
+        writeManifest();
+    }
+    compactor = std::thread(&LsmIndex::compactorLoop, this);
+}
+
+LsmIndex::~LsmIndex() {
+    {
+        std::lock_guard<std::mutex> guard(runsLock);
+        compactorStop = true;
+    }
+    compactorWake.notify_all();
+    compactor.join();
+    if (scanExecuting) endScan();
+    try {
+        flush();
+    } catch (...) {
+        std::cout << "The memtable could not be written out.";
+    }
+}
+
+void LsmIndex::encodeKey(const void *key, char *out) const {
+    switch (attributeType) {
+        case INTEGER:
+            memcpy(out, key, sizeof(int));
+            break;
+        case DOUBLE: {
+            double value;
+            memcpy(&value, key, sizeof(double));
+            // -0.0 equals 0.0, so both hash alike
+            if (value == 0) value = 0;
+            memcpy(out, &value, sizeof(double));
+            break;
+        }
+        case STRING: {
+            const StringKey value(static_cast<const char *>(key));
+            memcpy(out, value.chars, STRINGSIZE);
+            break;
+        }
+    }
+}
+
+int LsmIndex::compareKeys(const char *a, const char *b) const {
+    switch (attributeType) {
+        case INTEGER: {
+            int x, y;
+            memcpy(&x, a, sizeof(int));
+            memcpy(&y, b, sizeof(int));
+            return x < y ? -1 : (y < x ? 1 : 0);
+        }
+        case DOUBLE: {
+            double x, y;
+            memcpy(&x, a, sizeof(double));
+            memcpy(&y, b, sizeof(double));
+            return x < y ? -1 : (y < x ? 1 : 0);
+        }
+        case STRING:
+            return memcmp(a, b, STRINGSIZE);
+    }
+    return 0;
+}
+
+void LsmIndex::insertEntry(const void *key, const RecordId rid) {
+    char stored[STRINGSIZE];
+    encodeKey(key, stored);
+    switch (attributeType) {
+        case INTEGER: {
+            int value;
+            memcpy(&value, stored, sizeof(int));
+            if (buffered<int>()->add(value, rid)) flushMemtable<int>();
+            break;
+        }
+        case DOUBLE: {
+            double value;
+            memcpy(&value, stored, sizeof(double));
+            if (buffered<double>()->add(value, rid)) flushMemtable<double>();
+            break;
+        }
+        case STRING: {
+            StringKey value;
+            memcpy(value.chars, stored, STRINGSIZE);
+            if (buffered<StringKey>()->add(value, rid)) flushMemtable<StringKey>();
+            break;
+        }
+    }
+}
+
+bool LsmIndex::deleteEntry(const void *key, const RecordId rid) {
+    char stored[STRINGSIZE];
+    encodeKey(key, stored);
+    bool removed = false;
+    switch (attributeType) {
+        case INTEGER: {
+            int value;
+            memcpy(&value, stored, sizeof(int));
+            removed = buffered<int>()->remove(value, rid);
+            break;
+        }
+        case DOUBLE: {
+            double value;
+            memcpy(&value, stored, sizeof(double));
+            removed = buffered<double>()->remove(value, rid);
+            break;
+        }
+        case STRING: {
+            StringKey value;
+            memcpy(value.chars, stored, STRINGSIZE);
+            removed = buffered<StringKey>()->remove(value, rid);
+            break;
+        }
+    }
+    if (removed) return true;
+
+    // a memtable written out meanwhile is registered by now, since remove waited for it
+    std::lock_guard<std::mutex> merging(compactionLock);
+    std::vector<std::shared_ptr<LsmRun> > snapshot;
+    {
+        std::lock_guard<std::mutex> guard(runsLock);
+        snapshot = runs;
+    }
+    const std::uint64_t keyHash = BloomFilter::hash(stored, keySize);
+    for (size_t i = snapshot.size(); i-- > 0;) {
+        if (snapshot[i]->filter.mayContain(keyHash) && snapshot[i]->tree->deleteEntry(stored, rid)) return true;
+    }
+    return false;
+}
+
+std::vector<RecordId> LsmIndex::lookup(const void *key) {
+    char stored[STRINGSIZE];
+    encodeKey(key, stored);
+    std::vector<RecordId> matches;
+    std::vector<std::shared_ptr<LsmRun> > snapshot;
+    {
+        std::lock_guard<std::mutex> guard(runsLock);
+        switch (attributeType) {
+            case INTEGER: {
+                int value;
+                memcpy(&value, stored, sizeof(int));
+                buffered<int>()->find(value, &matches);
+                break;
+            }
+            case DOUBLE: {
+                double value;
+                memcpy(&value, stored, sizeof(double));
+                buffered<double>()->find(value, &matches);
+                break;
+            }
+            case STRING: {
+                StringKey value;
+                memcpy(value.chars, stored, STRINGSIZE);
+                buffered<StringKey>()->find(value, &matches);
+                break;
+            }
+        }
+        snapshot = runs;
+    }
+    const std::uint64_t keyHash = BloomFilter::hash(stored, keySize);
+    for (size_t i = snapshot.size(); i-- > 0;) {
+        if (!snapshot[i]->filter.mayContain(keyHash)) continue;
+        const std::vector<RecordId> found = snapshot[i]->tree->lookup(stored);
+        matches.insert(matches.end(), found.begin(), found.end());
+    }
+    return matches;
+}
+
+bool LsmIndex::contains(const void *key) {
+    char stored[STRINGSIZE];
+    encodeKey(key, stored);
+    bool found = false;
+    std::vector<std::shared_ptr<LsmRun> > snapshot;
+    {
+        std::lock_guard<std::mutex> guard(runsLock);
+        switch (attributeType) {
+            case INTEGER: {
+                int value;
+                memcpy(&value, stored, sizeof(int));
+                found = buffered<int>()->find(value, NULL);
+                break;
+            }
+            case DOUBLE: {
+                double value;
+                memcpy(&value, stored, sizeof(double));
+                found = buffered<double>()->find(value, NULL);
+                break;
+            }
+            case STRING: {
+                StringKey value;
+                memcpy(value.chars, stored, STRINGSIZE);
+                found = buffered<StringKey>()->find(value, NULL);
+                break;
+            }
+        }
+        snapshot = runs;
+    }
+    const std::uint64_t keyHash = BloomFilter::hash(stored, keySize);
+    for (size_t i = snapshot.size(); i-- > 0 && !found;) {
+        found = snapshot[i]->filter.mayContain(keyHash) && snapshot[i]->tree->contains(stored);
+    }
+    return found;
+}
+
+void LsmIndex::startScan(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp) {
+    if ((lowOp != GT && lowOp != GTE) || (highOp != LT && highOp != LTE)) throw BadOpcodesException();
+    char low[STRINGSIZE];
+    char high[STRINGSIZE];
+    encodeKey(lowVal, low);
+    encodeKey(highVal, high);
+    if (compareKeys(low, high) > 0) throw BadScanrangeException();
+    if (scanExecuting) endScan();
+
+    scanMemKeys.clear();
+    scanMemRids.clear();
+    scanMemNext = 0;
+    {
+        std::lock_guard<std::mutex> guard(runsLock);
+        switch (attributeType) {
+            case INTEGER:
+                memtableRange<int>(low, lowOp == GTE, high, highOp == LTE, scanMemKeys, scanMemRids);
+                break;
+            case DOUBLE:
+                memtableRange<double>(low, lowOp == GTE, high, highOp == LTE, scanMemKeys, scanMemRids);
+                break;
+            case STRING:
+                memtableRange<StringKey>(low, lowOp == GTE, high, highOp == LTE, scanMemKeys, scanMemRids);
+                break;
+        }
+        scanRuns = runs;
+    }
+    scanCursors.clear();
+    for (size_t i = 0; i < scanRuns.size(); i++) {
+        try {
+            scanCursors.push_back(scanRuns[i]->tree->openScan(low, lowOp, high, highOp, true));
+        } catch (const NoSuchKeyFoundException &e) {
+            scanCursors.push_back(IndexScanCursor());
+        }
+    }
+
+    const size_t sources = scanCursors.size() + 1;
+    scanHeadKeys.assign(sources * keySize, 0);
+    scanHeadRids.assign(sources, RecordId());
+    scanHeadValid.assign(sources, false);
+    bool any = false;
+    for (size_t i = 0; i < sources; i++) {
+        advanceSource(i);
+        any = any || scanHeadValid[i];
+    }
+    scanExecuting = true;
+    if (!any) {
+        endScan();
+        throw NoSuchKeyFoundException();
+    }
+}
+
+void LsmIndex::advanceSource(const std::size_t i) {
+    if (i < scanCursors.size()) {
+        scanHeadValid[i] = false;
+        if (!scanCursors[i].isOpen()) return;
+        try {
+            scanCursors[i].nextKeyed(&scanHeadKeys[i * keySize], scanHeadRids[i]);
+            scanHeadValid[i] = true;
+        } catch (const IndexScanCompletedException &e) {
+            scanCursors[i].close();
+        }
+        return;
+    }
+    scanHeadValid[i] = scanMemNext < scanMemRids.size();
+    if (!scanHeadValid[i]) return;
+    memcpy(&scanHeadKeys[i * keySize], &scanMemKeys[scanMemNext * keySize], keySize);
+    scanHeadRids[i] = scanMemRids[scanMemNext];
+    scanMemNext++;
+}
+
+void LsmIndex::scanNext(RecordId &outRid) {
+    if (!scanExecuting) throw ScanNotInitializedException();
+    // there are only a few sources, so the smallest head is found by looking at each
+    size_t best = scanHeadValid.size();
+    for (size_t i = 0; i < scanHeadValid.size(); i++) {
+        if (!scanHeadValid[i]) continue;
+        if (best == scanHeadValid.size() || compareKeys(&scanHeadKeys[i * keySize], &scanHeadKeys[best * keySize]) < 0)
+            best = i;
+    }
+    if (best == scanHeadValid.size()) throw IndexScanCompletedException();
+    outRid = scanHeadRids[best];
+    advanceSource(best);
+}
+
+void LsmIndex::endScan() {
+    if (!scanExecuting) throw ScanNotInitializedException();
+    scanExecuting = false;
+    scanCursors.clear();
+    scanRuns.clear();
+    scanMemKeys.clear();
+    scanMemRids.clear();
+}
+
+void LsmIndex::flush() {
+    switch (attributeType) {
+        case INTEGER:
+            flushMemtable<int>();
+            break;
+        case DOUBLE:
+            flushMemtable<double>();
+            break;
+        case STRING:
+            flushMemtable<StringKey>();
+            break;
+    }
+}
+
+void LsmIndex::compact() {
+    while (compactOnce()) {
+    }
+}
+
+std::size_t LsmIndex::runCount() {
+    std::lock_guard<std::mutex> guard(runsLock);
+    return runs.size();
+}
+
+template <class K>
+void LsmIndex::flushMemtable() {
+    std::vector<std::pair<K, RecordId> > taken;
+    if (!buffered<K>()->take(taken)) return;
+    std::vector<char> keys(taken.size() * keySize);
+    std::vector<RecordId> rids(taken.size());
+    for (size_t i = 0; i < taken.size(); i++) {
+        memcpy(&keys[i * keySize], &taken[i].first, keySize);
+        rids[i] = taken[i].second;
+    }
+    std::shared_ptr<LsmRun> run;
+    try {
+        run = createRun(keys, rids, 0);
+    } catch (...) {
+        buffered<K>()->done();
+        throw;
+    }
+    {
+        std::lock_guard<std::mutex> guard(runsLock);
+        runs.push_back(run);
+        writeManifest();
+        buffered<K>()->done();
+    }
+    compactorWake.notify_all();
+}
+
+template <class K>
+void LsmIndex::memtableRange(const char *low, const bool lowInclusive, const char *high, const bool highInclusive,
+                             std::vector<char> &keys, std::vector<RecordId> &rids) {
+    K lowKey, highKey;
+    memcpy(&lowKey, low, keySize);
+    memcpy(&highKey, high, keySize);
+    std::vector<std::pair<K, RecordId> > entries;
+    buffered<K>()->range(lowKey, lowInclusive, highKey, highInclusive, entries);
+    keys.resize(entries.size() * keySize);
+    rids.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        memcpy(&keys[i * keySize], &entries[i].first, keySize);
+        rids[i] = entries[i].second;
+    }
+}
+
+std::shared_ptr<LsmRun> LsmIndex::createRun(const std::vector<char> &keys, const std::vector<RecordId> &rids,
+                                            const unsigned tier) {
+    std::shared_ptr<LsmRun> run(new LsmRun());
+    {
+        std::lock_guard<std::mutex> guard(runsLock);
+        run->id = nextRunId++;
+    }
+    run->tier = tier;
+    run->relationName = runRelationName(relationName, run->id);
+    {
+        std::ostringstream name;
+        name << run->relationName << '.' << attrByteOffset;
+        run->indexName = name.str();
+    }
+    // a run left behind by a crash before the manifest listed it would be opened instead of built
+    try {
+        File::remove(run->indexName);
+    } catch (const FileNotFoundException &e) {
+    }
+
+    IndexEntries entries;
+    entries.keys = keys.data();
+    entries.rids = rids.data();
+    entries.count = rids.size();
+    std::string indexName;
+    run->tree.reset(new BTreeIndex(run->relationName, indexName, bufMgr, attrByteOffset, attributeType,
+                                   BULKLOAD_FILL_FACTOR, 1, 0, &entries));
+    run->filter = BloomFilter(rids.size());
+    for (size_t i = 0; i < rids.size(); i++) run->filter.add(BloomFilter::hash(&keys[i * keySize], keySize));
+    run->filter.save(run->indexName + ".bloom");
+    return run;
+}
+
+std::shared_ptr<LsmRun> LsmIndex::openRun(const std::uint64_t id, const unsigned tier) {
+    std::shared_ptr<LsmRun> run(new LsmRun());
+    run->id = id;
+    run->tier = tier;
+    run->relationName = runRelationName(relationName, id);
+    run->tree.reset(new BTreeIndex(run->relationName, run->indexName, bufMgr, attrByteOffset, attributeType));
+    // without its filter the run is searched for every key
+    run->filter.load(run->indexName + ".bloom");
+    return run;
+}
+
+void LsmIndex::writeManifest() {
+    // the new manifest replaces the old one whole, so a crash leaves one or the other
+    const std::string temporary = manifestName + ".tmp";
+    {
+        std::ofstream out(temporary.c_str(), std::ios::trunc);
+        out << nextRunId << '\n';
+        for (size_t i = 0; i < runs.size(); i++) out << runs[i]->id << ' ' << runs[i]->tier << '\n';
+    }
+    std::rename(temporary.c_str(), manifestName.c_str());
+}
+
+bool LsmIndex::compactOnce() {
+    std::lock_guard<std::mutex> merging(compactionLock);
+    std::vector<std::shared_ptr<LsmRun> > inputs;
+    unsigned tier = 0;
+    {
+        std::lock_guard<std::mutex> guard(runsLock);
+        // the lowest tier first: its runs are the smallest and the most numerous
+        for (bool found = false; !found; tier++) {
+            std::vector<std::shared_ptr<LsmRun> > candidates;
+            bool higher = false;
+            for (size_t i = 0; i < runs.size(); i++) {
+                if (runs[i]->tier == tier) candidates.push_back(runs[i]);
+                higher = higher || runs[i]->tier > tier;
+            }
+            if (candidates.size() >= fanout) {
+                inputs.assign(candidates.begin(), candidates.begin() + fanout);
+                found = true;
+            } else if (!higher) {
+                return false;
+            }
+        }
+        tier--;
+    }
+
+    // the merged run is built from every entry of its inputs; runs are read with cursors over their whole range
+    std::vector<char> keys;
+    std::vector<RecordId> rids;
+    char low[STRINGSIZE];
+    char high[STRINGSIZE];
+    char key[STRINGSIZE];
+    keyBounds(attributeType, low, high);
+    for (size_t i = 0; i < inputs.size(); i++) {
+        try {
+            IndexScanCursor cursor = inputs[i]->tree->openScan(low, GTE, high, LTE, true);
+            RecordId rid;
+            while (true) {
+                cursor.nextKeyed(key, rid);
+                keys.insert(keys.end(), key, key + keySize);
+                rids.push_back(rid);
+            }
+        } catch (const NoSuchKeyFoundException &e) {
+        } catch (const IndexScanCompletedException &e) {
+        }
+    }
+    std::shared_ptr<LsmRun> merged;
+    if (!rids.empty()) merged = createRun(keys, rids, tier + 1);
+
+    std::lock_guard<std::mutex> guard(runsLock);
+    std::vector<std::shared_ptr<LsmRun> > kept;
+    bool placed = false;
+    for (size_t i = 0; i < runs.size(); i++) {
+        if (std::find(inputs.begin(), inputs.end(), runs[i]) == inputs.end()) {
+            kept.push_back(runs[i]);
+            continue;
+        }
+        // the merged run takes the place of its oldest input
+        if (!placed && merged) kept.push_back(merged);
+        placed = true;
+        runs[i]->obsolete = true;
+    }
+    runs.swap(kept);
+    writeManifest();
+    return true;
+}
+
+void LsmIndex::compactorLoop() {
+    std::unique_lock<std::mutex> guard(runsLock);
+    while (!compactorStop) {
+        compactorWake.wait(guard);
+        if (compactorStop) break;
+        guard.unlock();
+        try {
+            while (compactOnce()) {
+                std::lock_guard<std::mutex> stopping(runsLock);
+                if (compactorStop) break;
+            }
+        } catch (...) {
+            // the runs stay as they are and the merge is tried again after the next run is written out
+        }
+        guard.lock();
+    }
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,338 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "btree.h"
+#include "buffer.h"
+#include "types.h"
+#include "write_buffer.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Entries an LsmIndex gathers in its memtable before writing them out as a run.
+ */
+const std::size_t LSM_MEMTABLE_ENTRIES = 4096;
+
+/**
+ * @brief Runs of one tier an LsmIndex merges into one run of the next tier.
+ */
+const unsigned LSM_TIER_FANOUT = 4;
+
+/**
+ * @brief A sorted run of an LsmIndex: a bulk-loaded BTreeIndex file with a Bloom filter over its keys.
+ */
+struct LsmRun;
+
+/**
+ * @brief Log-structured index on a single attribute of a relation, for tables that take far more inserts than
+ * lookups.
+ *
+ * Inserts go to an in-memory memtable. Once it holds its capacity, the thread that filled it writes the memtable
+ * out as a new sorted run, a BTreeIndex bulk-loaded from it, which is never inserted into. Runs are tiered: a
+ * background thread merges every LSM_TIER_FANOUT runs of a tier into one run of the next, so each entry is
+ * rewritten once per tier rather than each insert reading and writing a leaf. Lookups consult the memtable and
+ * then the runs, newest first, skipping the runs whose Bloom filter rules the key out; scans merge the memtable
+ * and the cursors of every run in key order.
+ *
+ * The runs and the manifest listing them live next to the relation, so the index is reopened with its runs.
+ * Entries still in the memtable when the process stops without destroying the index are lost. Deletes remove an
+ * entry from the memtable or, in place, from the run holding it, so runs shrink but never hold tombstones.
+ *
+ * The surface follows BTreeIndex, so a table can use either engine. insertEntry, deleteEntry, lookup and
+ * contains may run from several threads at once; startScan, scanNext and endScan drive one scan at a time.
+ */
+class LsmIndex {
+   public:
+    /**
+     * LsmIndex Constructor. Opens the index of the relation's attribute if its manifest exists, and otherwise
+     * creates it, loading every tuple of the relation into its first run.
+     *
+     * @param relationName        Name of the relation
+     * @param outIndexName        Returns the name of the index's manifest
+     * @param bufMgrIn            Buffer Manager Instance
+     * @param attrByteOffset      Offset of attribute, over which index is to be built, in the record
+     * @param attrType            Datatype of attribute over which index is built
+     * @param memtableEntries     Entries gathered in memory per run written
+     * @param fanout              Runs of a tier merged into one of the next tier, at least 2
+     * @throws  BadIndexInfoException  If a run of the index does not match the attribute
+     */
+    LsmIndex(const std::string& relationName, std::string& outIndexName, BufMgr* bufMgrIn,
+             const int attrByteOffset, const Datatype attrType,
+             const std::size_t memtableEntries = LSM_MEMTABLE_ENTRIES, const unsigned fanout = LSM_TIER_FANOUT);
+
+    /**
+     * LsmIndex Destructor. Ends the scan, stops the background merges, writes the memtable out as a run and
+     * closes the runs. Does not throw.
+     */
+    ~LsmIndex();
+
+    /**
+     * Inserts the entry <key,rid> into the memtable, writing the memtable out as a run if that fills it.
+     *
+     * @param key   Key to insert, pointer to integer/double/char string
+     * @param rid   Record ID of a record whose entry is getting inserted into the index.
+     */
+    void insertEntry(const void* key, const RecordId rid);
+
+    /**
+     * Deletes the entry <key,rid> from the memtable or from the run holding it.
+     *
+     * @param key   Key of the entry, pointer to integer/double/char string
+     * @param rid   Record ID of the entry
+     * @return      True if the entry was found and removed
+     */
+    bool deleteEntry(const void* key, const RecordId rid);
+
+    /**
+     * Returns the record ID of every entry equal to key: those in the memtable, then those of the runs from the
+     * newest on.
+     *
+     * @param key   Key to look up, pointer to integer/double/char string
+     */
+    std::vector<RecordId> lookup(const void* key);
+
+    /**
+     * Returns true if any entry equals key.
+     *
+     * @param key   Key to look up, pointer to integer/double/char string
+     */
+    bool contains(const void* key);
+
+    /**
+     * Begins a scan of the entries in a range, as BTreeIndex::startScan does, over the memtable and runs as they
+     * are now; entries inserted later are not seen. Ends the scan running, if any.
+     *
+     * @param lowVal    Low value of range, pointer to integer / double / char string
+     * @param lowOp     Low operator (GT/GTE)
+     * @param highVal   High value of range, pointer to integer / double / char string
+     * @param highOp    High operator (LT/LTE)
+     * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+     * @throws  BadScanrangeException If lowVal > highval
+     * @throws  NoSuchKeyFoundException If no entry satisfies the scan criteria.
+     */
+    void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+    /**
+     * Fetches the record id of the next entry of the scan, in key order.
+     *
+     * @param outRid    RecordId of next record found that satisfies the scan criteria returned in this
+     * @throws ScanNotInitializedException If no scan has been initialized.
+     * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+     */
+    void scanNext(RecordId& outRid);
+
+    /**
+     * Terminates the current scan.
+     *
+     * @throws ScanNotInitializedException If no scan has been initialized.
+     */
+    void endScan();
+
+    /**
+     * Writes the memtable out as a run, whatever it holds.
+     */
+    void flush();
+
+    /**
+     * Merges runs, on the calling thread, until no tier holds LSM_TIER_FANOUT runs.
+     */
+    void compact();
+
+    /**
+     * Returns the number of runs.
+     */
+    std::size_t runCount();
+
+   private:
+    /**
+     * Name of the relation, which names the manifest and the runs
+     */
+    std::string relationName;
+
+    /**
+     * Name of the manifest, which lists the runs
+     */
+    std::string manifestName;
+
+    /**
+     * Buffer manager the runs are read through
+     */
+    BufMgr* bufMgr;
+
+    /**
+     * Offset of the attribute in the records
+     */
+    int attrByteOffset;
+
+    /**
+     * Datatype of the attribute
+     */
+    Datatype attributeType;
+
+    /**
+     * Bytes of a key: an integer, a double or STRINGSIZE characters
+     */
+    std::size_t keySize;
+
+    /**
+     * Runs of a tier merged into one of the next tier
+     */
+    unsigned fanout;
+
+    /**
+     * Memtable, a WriteBuffer for keys of the attribute's type
+     */
+    std::unique_ptr<WriteBufferBase> memtable;
+
+    /**
+     * Guards runs, nextRunId, the manifest and compactorStop. Writing a run out registers it and drops its
+     * entries from the memtable under this lock, so a reader that takes the memtable's entries and the runs
+     * under it sees every entry exactly once.
+     */
+    std::mutex runsLock;
+
+    /**
+     * Runs, oldest first
+     */
+    std::vector<std::shared_ptr<LsmRun> > runs;
+
+    /**
+     * Number of the next run created
+     */
+    std::uint64_t nextRunId;
+
+    /**
+     * Held by a merge from picking its runs until they are replaced, and by deletes from runs, so that no
+     * delete lands in a run being merged away
+     */
+    std::mutex compactionLock;
+
+    /**
+     * Background thread merging runs
+     */
+    std::thread compactor;
+
+    /**
+     * Wakes the background thread when a run is written out or it is asked to stop
+     */
+    std::condition_variable compactorWake;
+
+    /**
+     * True once the background thread has been asked to stop
+     */
+    bool compactorStop;
+
+    /**
+     * True while a scan is running
+     */
+    bool scanExecuting;
+
+    /**
+     * Runs the scan reads, kept alive until it ends
+     */
+    std::vector<std::shared_ptr<LsmRun> > scanRuns;
+
+    /**
+     * Cursor of the scan on each run of scanRuns
+     */
+    std::vector<IndexScanCursor> scanCursors;
+
+    /**
+     * Entries of the memtable inside the scan's range, copied when the scan started, in key order
+     */
+    std::vector<char> scanMemKeys;
+    std::vector<RecordId> scanMemRids;
+    std::size_t scanMemNext;
+
+    /**
+     * Next entry of each source of the scan: every cursor, then the memtable copy
+     */
+    std::vector<char> scanHeadKeys;
+    std::vector<RecordId> scanHeadRids;
+    std::vector<bool> scanHeadValid;
+
+    /**
+     * Returns the memtable, for keys of type K.
+     */
+    template <class K>
+    WriteBuffer<K>* buffered() const {
+        return static_cast<WriteBuffer<K>*>(memtable.get());
+    }
+
+    /**
+     * Copies a key as given by a caller into the fixed-size form stored and hashed: STRING keys are padded
+     * with NULs, and a zero DOUBLE is made positive.
+     */
+    void encodeKey(const void* key, char* out) const;
+
+    /**
+     * Compares two keys in the stored form: negative, zero or positive.
+     */
+    int compareKeys(const char* a, const char* b) const;
+
+    /**
+     * Writes the memtable of keys of type K out as a run.
+     */
+    template <class K>
+    void flushMemtable();
+
+    /**
+     * Copies the memtable's entries inside a range, in key order, in the stored form.
+     */
+    template <class K>
+    void memtableRange(const char* low, const bool lowInclusive, const char* high, const bool highInclusive,
+                       std::vector<char>& keys, std::vector<RecordId>& rids);
+
+    /**
+     * Creates a run from entries in the stored form, in any order, with its file and filter. Does not register
+     * it.
+     */
+    std::shared_ptr<LsmRun> createRun(const std::vector<char>& keys, const std::vector<RecordId>& rids,
+                                      const unsigned tier);
+
+    /**
+     * Opens a run listed in the manifest.
+     */
+    std::shared_ptr<LsmRun> openRun(const std::uint64_t id, const unsigned tier);
+
+    /**
+     * Rewrites the manifest from runs. runsLock must be held.
+     */
+    void writeManifest();
+
+    /**
+     * Merges the oldest fanout runs of the lowest tier holding as many.
+     *
+     * @return  False if no tier holds fanout runs
+     */
+    bool compactOnce();
+
+    /**
+     * Body of the background thread.
+     */
+    void compactorLoop();
+
+    /**
+     * Moves scan source i on to its next entry.
+     */
+    void advanceSource(const std::size_t i);
+
+    LsmIndex(const LsmIndex&);
+    LsmIndex& operator=(const LsmIndex&);
+};
+
+}  // namespace badgerdb
@@ -5,21 +5,45 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <thread>
 #include <vector>
 
 #include "btree.h"
+#include "buffer_pools.h"
+#include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
+#include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_format_exception.h"
 #include "exceptions/file_not_found_exception.h"
+#include "exceptions/file_open_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/insufficient_space_exception.h"
+#include "exceptions/log_write_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/no_such_pool_exception.h"
+#include "exceptions/page_checksum_exception.h"
+#include "exceptions/pool_exists_exception.h"
+#include "exceptions/read_only_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "file_iterator.h"
 #include "filescan.h"
+#include "hash_index.h"
+#include "lsm_index.h"
 #include "page.h"
 #include "page_iterator.h"
+#include "trace.h"
 
 #define checkPassFail(a, b)                                               \
     {                                                                     \
@@ -66,12 +90,69 @@ BufMgr *bufMgr = new BufMgr(100);
 void createRelationForward();
 void createRelationBackward();
 void createRelationRandom();
+int asyncPageScan();
+int readsAfterScan();
+int backgroundWrites();
+int fileMetrics();
+int spanTrace();
+int alignedFrames();
+int pageChecksums();
+int compressedFiles();
+int fileRegistry();
+int heapFreeSpace();
+int bufferPools();
+int swizzledPins();
+int epochReclamation();
+int filteredScan(const ScanPredicate &predicate, bool batch);
+void predicateScans();
+int parallelCount(const ScanPredicate *predicate, unsigned threads);
 void intTests();
+void intInsertTests();
+void checkIntScans(BTreeIndex *index);
+void intDeleteTests(BTreeIndex *index);
+void intBatchInsertTests();
+void intAppendTests();
+int walRecovery(const bool checksums);
+void walCheckpointTests();
+void writeBufferTests();
+void concurrentIndexTests();
+void lsmTests();
+void hashIndexTests();
+void hotKeyTests();
+void keyFilterTests();
+void compressedLeafTests();
+void postingListTests();
+void coveringIndexTests();
+void recordFetchTests();
+int lsmScan(LsmIndex &index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+void relationEntries(std::vector<int> &keys, std::vector<RecordId> &rids);
+void copyFile(const std::string &from, const std::string &to);
+int indexFilePages(const std::string &indexName);
+int batchInsertIntRange(BTreeIndex *index, int lowVal, int highVal, size_t batchSize);
+int changeIntRange(BTreeIndex *index, int lowVal, int highVal, bool remove);
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int intInterleavedScans(BTreeIndex *index);
+int intBatchScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int reversedScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int optionedScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp,
+                 const ScanOptions &options);
+int intLookupBatch(BTreeIndex *index);
+int intLookups(BTreeIndex *index);
+int optimisticLookups(BTreeIndex *index);
+int persistedSummary();
+int readOnlyInserts(BTreeIndex *index);
+int indexShape(BTreeIndex *index);
+int reorganizedLeaves(BTreeIndex *index);
+void doubleTests();
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp);
+void stringTests();
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int countScan(BTreeIndex *index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp);
 void indexTests();
 void test1();
 void test2();
 void test3();
+void test4();
 void errorTests();
 void deleteRelation();
 
@@ -126,6 +207,7 @@ int main(int argc, char **argv) {
     test1();
     test2();
     test3();
+    test4();
     errorTests();
 
     delete bufMgr;
@@ -140,6 +222,20 @@ void test1() {
     std::cout << "------- TEST 1 -------" << std::endl;
     std::cout << "createRelationForward" << std::endl;
     createRelationForward();
+    checkPassFail(asyncPageScan(), relationSize)
+    checkPassFail(readsAfterScan(), 0)
+    checkPassFail(backgroundWrites(), 10)
+    checkPassFail(fileMetrics(), 1)
+    checkPassFail(spanTrace(), 1)
+    checkPassFail(alignedFrames(), 2)
+    checkPassFail(pageChecksums(), 5)
+    checkPassFail(compressedFiles(), relationSize)
+    checkPassFail(fileRegistry(), 4)
+    checkPassFail(heapFreeSpace(), 6)
+    checkPassFail(bufferPools(), 4)
+    checkPassFail(swizzledPins(), 1)
+    checkPassFail(epochReclamation(), 1)
+    predicateScans();
     indexTests();
     deleteRelation();
 }
@@ -166,6 +262,83 @@ void test3() {
     deleteRelation();
 }
 
+void test4() {
+    // Create an index over an empty relation, then fill the relation in random order and insert every
+    // tuple through insertEntry, so the tree is grown by splits instead of the bulk load
+    std::cout << "----------------------" << std::endl;
+    std::cout << "------- TEST 4 -------" << std::endl;
+    std::cout << "createRelationRandom with incremental inserts" << std::endl;
+    intInsertTests();
+    try {
+        File::remove(intIndexName);
+    } catch (const FileNotFoundException &e) {
+    }
+    intBatchInsertTests();
+    try {
+        File::remove(intIndexName);
+    } catch (const FileNotFoundException &e) {
+    }
+    intAppendTests();
+    try {
+        File::remove(intIndexName);
+    } catch (const FileNotFoundException &e) {
+    }
+    checkPassFail(walRecovery(false), 1500)
+    try {
+        File::remove(intIndexName);
+    } catch (const FileNotFoundException &e) {
+    }
+    checkPassFail(walRecovery(true), 1500)
+    try {
+        File::remove(intIndexName);
+    } catch (const FileNotFoundException &e) {
+    }
+    walCheckpointTests();
+    try {
+        File::remove(intIndexName);
+    } catch (const FileNotFoundException &e) {
+    }
+    writeBufferTests();
+    try {
+        File::remove(intIndexName);
+    } catch (const FileNotFoundException &e) {
+    }
+    concurrentIndexTests();
+    try {
+        File::remove(intIndexName);
+    } catch (const FileNotFoundException &e) {
+    }
+    lsmTests();
+    hashIndexTests();
+    keyFilterTests();
+    try {
+        File::remove(intIndexName);
+    } catch (const FileNotFoundException &e) {
+    }
+    hotKeyTests();
+    try {
+        File::remove(intIndexName);
+    } catch (const FileNotFoundException &e) {
+    }
+    compressedLeafTests();
+    try {
+        File::remove(intIndexName);
+    } catch (const FileNotFoundException &e) {
+    }
+    postingListTests();
+    try {
+        File::remove(intIndexName);
+    } catch (const FileNotFoundException &e) {
+    }
+    coveringIndexTests();
+    try {
+        File::remove(intIndexName);
+    } catch (const FileNotFoundException &e) {
+    }
+    recordFetchTests();
+    deleteRelation();
+}
+
 // -----------------------------------------------------------------------------
 // createRelationForward
 // -----------------------------------------------------------------------------
@@ -206,6 +379,629 @@ void createRelationForward() {
     file1->writePage(new_page_number, new_page);
 }
 
+// -----------------------------------------------------------------------------
+// asyncPageScan
+// -----------------------------------------------------------------------------
+
+int asyncPageScan() {
+    // Start reads of every relation page at once, count the records through readPage, and write every page
+    // back asynchronously
+    std::vector<PageId> pages;
+    for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter)
+        pages.push_back((*iter).page_number());
+    for (size_t i = 0; i < pages.size(); i++)
+        bufMgr->readPageAsync(file1, pages[i]);
+
+    int count = 0;
+    for (size_t i = 0; i < pages.size(); i++) {
+        Page *page;
+        bufMgr->readPage(file1, pages[i], page);
+        for (PageIterator iter = page->begin(); iter != page->end(); ++iter)
+            count++;
+        bufMgr->unPinPage(file1, pages[i], true);
+        bufMgr->writePageAsync(file1, pages[i]);
+    }
+    bufMgr->waitForIO();
+    return count;
+}
+
+// -----------------------------------------------------------------------------
+// readsAfterScan
+// -----------------------------------------------------------------------------
+
+int readsAfterScan() {
+    // A full scan through a pool much smaller than the relation cycles through the scan ring, so a page read
+    // normally before it is still in the pool afterwards
+    BufMgr pool(20);
+    PageId hotPage = file1->getFirstPageNo();
+    Page *page;
+    pool.readPage(file1, hotPage, page);
+    pool.unPinPage(file1, hotPage, false);
+    {
+        FileScan scan(relationName, &pool);
+        RecordId scanRid;
+        try {
+            while (1) scan.scanNext(scanRid);
+        } catch (const EndOfFileException &e) {
+        }
+    }
+
+    pool.clearBufStats();
+    pool.readPage(file1, hotPage, page);
+    pool.unPinPage(file1, hotPage, false);
+    int reads = pool.getBufStats().diskreads;
+    pool.flushFile(file1);
+    return reads;
+}
+
+// -----------------------------------------------------------------------------
+// backgroundWrites
+// -----------------------------------------------------------------------------
+
+int backgroundWrites() {
+    // The background writer cleans the dirty pages of an idle pool, so flushing the file afterwards writes
+    // nothing more
+    BufMgr pool(20);
+    std::vector<PageId> pages;
+    for (FileIterator iter = file1->begin(); iter != file1->end() && pages.size() < 10; ++iter)
+        pages.push_back((*iter).page_number());
+    for (size_t i = 0; i < pages.size(); i++) {
+        Page *page;
+        pool.readPage(file1, pages[i], page);
+        pool.unPinPage(file1, pages[i], true);
+    }
+
+    pool.clearBufStats();
+    pool.startBackgroundWriter(1);
+    for (int wait = 0; wait < 5000 && pool.getBufStats().diskwrites < pages.size(); wait++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    pool.stopBackgroundWriter();
+    pool.flushFile(file1);
+    return pool.getBufStats().diskwrites;
+}
+
+// -----------------------------------------------------------------------------
+// fileMetrics
+// -----------------------------------------------------------------------------
+
+int fileMetrics() {
+    // Two passes over twice as many pages as frames miss and evict on every read past the first four; the page
+    // read last is still resident. The counts outlive flushFile under the file's name.
+    BufMgr pool(4);
+    std::vector<PageId> pages;
+    for (FileIterator iter = file1->begin(); iter != file1->end() && pages.size() < 8; ++iter)
+        pages.push_back((*iter).page_number());
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < pages.size(); i++) {
+            Page *page;
+            pool.readPage(file1, pages[i], page);
+            pool.unPinPage(file1, pages[i], pass == 0 && i == 0);
+        }
+    }
+    Page *page;
+    pool.readPage(file1, pages.back(), page);
+    pool.unPinPage(file1, pages.back(), false);
+    pool.flushFile(file1);
+
+    BufMetricsSnapshot snapshot;
+    pool.metrics(snapshot);
+    if (snapshot.files.size() != 1 || snapshot.files[0].filename != relationName) return 0;
+    const FileMetricsSnapshot &metrics = snapshot.files[0];
+    std::cout << "hits " << metrics.hits << " misses " << metrics.misses << " evictions " << metrics.evictions
+              << " dirty writebacks " << metrics.dirtyWritebacks << std::endl;
+    const bool counted = metrics.hits == 1 && metrics.misses == 16 && metrics.evictions == 12 &&
+                         metrics.dirtyWritebacks == 1 && metrics.readNanos.count == 16 &&
+                         snapshot.sweepLength.count == 12 && snapshot.total.misses == 16;
+    std::ostringstream json;
+    snapshot.writeJson(json);
+    pool.clearMetrics();
+    pool.metrics(snapshot);
+    return counted && json.str().find("\"" + relationName + "\": {\"hits\": 1,") != std::string::npos &&
+           snapshot.files.empty();
+}
+
+// -----------------------------------------------------------------------------
+// spanTrace
+// -----------------------------------------------------------------------------
+
+int spanTrace() {
+    // A miss records a span for the pin and one for the file read below it, if span tracing is compiled in
+    clearSpans();
+    BufMgr pool(4);
+    const PageId pageNo = file1->getFirstPageNo();
+    Page *page;
+    pool.readPage(file1, pageNo, page);
+    pool.unPinPage(file1, pageNo, false);
+    std::ostringstream trace;
+    const std::size_t spans = dumpSpans(trace);
+    const std::string json = trace.str();
+    const bool wellFormed = json.compare(0, 20, "{\"displayTimeUnit\": ") == 0 && json.find("\n]}") != std::string::npos;
+    if (!BADGERDB_TRACE_SPANS) return wellFormed && spans == 0;
+    return wellFormed && spans >= 3 && json.find("\"name\": \"BufMgr::readPage\"") != std::string::npos &&
+           json.find("\"name\": \"File::readPage\"") != std::string::npos;
+}
+
+// -----------------------------------------------------------------------------
+// swizzledPins
+// -----------------------------------------------------------------------------
+
+int swizzledPins() {
+    // A page is pinned through the frame it was read into while the frame holds it, and no longer once the
+    // file is flushed out of the pool
+    BufMgr pool(20);
+    PageId pageNo = file1->getFirstPageNo();
+    Page *frame;
+    pool.readPage(file1, pageNo, frame);
+    pool.unPinFrame(file1, pageNo, frame, false);
+
+    int pins = 0;
+    if (pool.pinFrame(file1, pageNo, frame)) {
+        pins++;
+        pool.unPinFrame(file1, pageNo, frame, false);
+    }
+    pool.flushFile(file1);
+    if (pool.pinFrame(file1, pageNo, frame)) {
+        pins++;
+        pool.unPinFrame(file1, pageNo, frame, false);
+    }
+    return pins;
+}
+
+// -----------------------------------------------------------------------------
+// epochReclamation
+// -----------------------------------------------------------------------------
+
+int epochReclamation() {
+    // A retired page waits for the reader that entered before it was retired, but not for one that entered
+    // after; the result counts the pages collected while the first reader was inside, then after it left
+    EpochManager epochs;
+    EpochTicket before = epochs.enter();
+    epochs.retire(7);
+    EpochTicket after = epochs.enter();
+
+    std::vector<PageId> reclaimed;
+    epochs.collect(reclaimed);
+    const int early = reclaimed.size();
+    epochs.exit(before);
+    epochs.collect(reclaimed);
+    epochs.exit(after);
+    return early * 10 + (int)reclaimed.size();
+}
+
+// -----------------------------------------------------------------------------
+// alignedFrames
+// -----------------------------------------------------------------------------
+
+int alignedFrames() {
+    // Frames start on direct I/O boundaries whatever pages back them, including when huge pages are asked for
+    // but none are reserved
+    ArenaOptions memory;
+    memory.hugePages = HUGE_PAGES_2MB;
+    BufMgr plain(20);
+    BufMgr huge(20, 2, POLICY_CLOCK, memory);
+    BufMgr *pools[2] = {&plain, &huge};
+    int aligned = 0;
+    for (int p = 0; p < 2; p++) {
+        Page *page;
+        PageId pageNo = file1->getFirstPageNo();
+        pools[p]->readPage(file1, pageNo, page);
+        if (reinterpret_cast<uintptr_t>(page) % DIRECT_IO_ALIGNMENT == 0) aligned++;
+        pools[p]->unPinPage(file1, pageNo, false);
+        pools[p]->flushFile(file1);
+    }
+    return aligned;
+}
+
+// -----------------------------------------------------------------------------
+// pageChecksums
+// -----------------------------------------------------------------------------
+
+int pageChecksums() {
+    // A byte flipped on disk after its page was written back is caught when the pool reads the page again and
+    // when the file is mapped, but not by a mapping of a trusted replica; the other pages still read
+    const std::string name = "checksums.blob";
+    try {
+        File::remove(name);
+    } catch (const FileNotFoundException &) {
+    }
+    File::setChecksums(true);
+    int checked = 0;
+    {
+        BlobFile blob = BlobFile::create(name);
+        BufMgr pool(4);
+        PageId pages[3];
+        for (int i = 0; i < 3; i++) {
+            Page *page;
+            pool.allocPage(&blob, pages[i], page);
+            for (std::size_t b = 0; b < Page::SIZE; b += 64) reinterpret_cast<char *>(page)[b] = (char)(i + b);
+            pool.unPinPage(&blob, pages[i], true);
+        }
+        pool.flushFile(&blob);
+        {
+            std::fstream raw(name, std::ios::in | std::ios::out | std::ios::binary);
+            raw.seekp((std::streamoff)pages[2] * Page::SIZE + 100);
+            raw.put('x');
+        }
+
+        Page *page;
+        try {
+            pool.readPage(&blob, pages[2], page);
+            pool.unPinPage(&blob, pages[2], false);
+        } catch (const PageChecksumException &e) {
+            if (e.page_number() == pages[2]) checked++;
+        }
+        try {
+            MappedFile mapped(name);
+        } catch (const PageChecksumException &e) {
+            checked++;
+        }
+        MappedFile trusted(name, false /* verifyChecksums */);
+        if (trusted.numPages() == pages[2] + 1) checked++;
+        pool.readPage(&blob, pages[0], page);
+        if (reinterpret_cast<char *>(page)[64] == 64) checked++;
+        pool.unPinPage(&blob, pages[0], false);
+        pool.flushFile(&blob);
+    }
+    File::remove(name);
+
+    // a page written after the last flush still matches its checksum in the files a crash would leave
+    const std::string heapName = "checksums.rel";
+    try {
+        File::remove(heapName);
+    } catch (const FileNotFoundException &) {
+    }
+    RecordId since;
+    {
+        PageFile heap = PageFile::create(heapName);
+        PageId pageNo;
+        Page page = heap.allocatePage(pageNo);
+        page.insertRecord("flushed");
+        heap.writePage(pageNo, page);
+        bufMgr->flushFile(&heap);
+        since = page.insertRecord("written since");
+        heap.writePage(pageNo, page);
+        copyFile(heapName, heapName + ".bak");
+        copyFile(PageChecksums::filenameOf(heapName), PageChecksums::filenameOf(heapName) + ".bak");
+    }
+    copyFile(heapName + ".bak", heapName);
+    copyFile(PageChecksums::filenameOf(heapName) + ".bak", PageChecksums::filenameOf(heapName));
+    std::remove((heapName + ".bak").c_str());
+    std::remove((PageChecksums::filenameOf(heapName) + ".bak").c_str());
+    {
+        PageFile heap = PageFile::open(heapName);
+        try {
+            if (heap.readPage(since.page_number).getRecord(since) == "written since") checked++;
+        } catch (const PageChecksumException &e) {
+        }
+    }
+    File::setChecksums(false);
+    File::remove(heapName);
+    return checked;
+}
+
+// -----------------------------------------------------------------------------
+// compressedFiles
+// -----------------------------------------------------------------------------
+
+int compressedFiles() {
+    // A compressed copy of the relation, with a page deleted from the middle of its used list and added back,
+    // scans to every record through the buffer pool once reopened, and takes well under half the disk space
+    const std::string name = "compressed.rel";
+    try {
+        File::remove(name);
+    } catch (const FileNotFoundException &) {
+    }
+    File::setCompression(true);
+    {
+        PageFile copy = PageFile::create(name);
+        for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter) {
+            Page page = *iter;
+            PageId pageNo;
+            Page compressed = copy.allocatePage(pageNo);
+            for (PageIterator record = page.begin(); record != page.end(); ++record)
+                compressed.insertRecord(*record);
+            copy.writePage(pageNo, compressed);
+        }
+        const PageId deleted = 3;
+        Page moved = copy.readPage(deleted);
+        copy.deletePage(deleted);
+        PageId pageNo;
+        Page page = copy.allocatePage(pageNo);
+        for (PageIterator record = moved.begin(); record != moved.end(); ++record) page.insertRecord(*record);
+        copy.writePage(pageNo, page);
+    }
+    File::setCompression(false);
+
+    int records = 0;
+    {
+        FileScan scan(name, bufMgr);
+        try {
+            RecordId rid;
+            while (1) {
+                scan.scanNext(rid);
+                records++;
+            }
+        } catch (const EndOfFileException &e) {
+        }
+    }
+    const bool smaller = indexFilePages(name) * 2 < indexFilePages(relationName);
+    std::cout << "compressed pages " << indexFilePages(name) << " of " << indexFilePages(relationName) << std::endl;
+    File::remove(name);
+    return smaller ? records : 0;
+}
+
+// -----------------------------------------------------------------------------
+// fileRegistry
+// -----------------------------------------------------------------------------
+
+int fileRegistry() {
+    // Objects on one file share its header whichever opened it, and the file stays open until the last of them
+    // is gone
+    const std::string name = "registry.blob";
+    try {
+        File::remove(name);
+    } catch (const FileNotFoundException &) {
+    }
+    int checks = 0;
+    {
+        BlobFile created = BlobFile::create(name);
+        {
+            BlobFile opened = BlobFile::open(name);
+            PageId pageNo;
+            opened.allocatePage(pageNo);
+            if (created.getFirstPageNo() == pageNo) checks++;
+        }
+        if (File::isOpen(name)) checks++;
+    }
+    if (!File::isOpen(name) && File::exists(name)) checks++;
+    File::remove(name);
+    if (!File::exists(name) && !File::isOpen(name)) checks++;
+    return checks;
+}
+
+// -----------------------------------------------------------------------------
+// heapFreeSpace
+// -----------------------------------------------------------------------------
+
+/**
+ * Deletes the first count records of a page of a file and writes it back.
+ */
+void deleteRecords(PageFile &file, const PageId pageNo, const int count) {
+    Page page = file.readPage(pageNo);
+    std::vector<RecordId> rids;
+    for (PageIterator iter = page.begin(); iter != page.end() && (int)rids.size() < count; ++iter)
+        rids.push_back(iter.getCurrentRecord());
+    for (size_t i = 0; i < rids.size(); i++) page.deleteRecord(rids[i]);
+    file.writePage(pageNo, page);
+}
+
+int heapFreeSpace() {
+    // A page whose deletes left its free space in holes still takes a record larger than any hole, and updates
+    // that shrink or grow a record keep the others intact, with the page's free space counted along. Inserts into
+    // a file go to a page a delete made room on, known from the free space map kept since the file was opened or
+    // rebuilt when it is reopened. A file of an older page layout is not opened.
+    int checks = 0;
+    {
+        Page page;
+        const std::string record(100, 'a');
+        std::vector<RecordId> rids;
+        while (page.hasSpaceForRecord(record)) rids.push_back(page.insertRecord(record));
+        for (size_t i = 0; i + 1 < rids.size(); i += 2) page.deleteRecord(rids[i]);
+        const std::string large(250, 'b');
+        const RecordId largeRid = page.insertRecord(large);
+        bool intact = page.getRecord(largeRid) == large;
+        for (size_t i = 1; i < rids.size(); i += 2) intact = intact && page.getRecord(rids[i]) == record;
+        if (intact) checks++;
+
+        page.updateRecord(rids[1], std::string(50, 'c'));
+        page.updateRecord(rids[3], std::string(180, 'd'));
+        intact = page.getRecord(rids[1]) == std::string(50, 'c') && page.getRecord(rids[3]) == std::string(180, 'd') &&
+                 page.getRecord(rids[5]) == record && page.getRecord(largeRid) == large;
+        if (intact) checks++;
+
+        // the bytes counted as held by records all come back once every record is gone
+        std::vector<RecordId> left;
+        for (PageIterator iter = page.begin(); iter != page.end(); ++iter) left.push_back(iter.getCurrentRecord());
+        for (size_t i = 0; i < left.size(); i++) page.deleteRecord(left[i]);
+        if (page.getFreeSpace() == Page::DATA_SIZE) checks++;
+    }
+
+    const std::string name = "freespace.rel";
+    try {
+        File::remove(name);
+    } catch (const FileNotFoundException &) {
+    }
+    const std::string record(200, 'r');
+    PageId pages = 0;
+    {
+        PageFile heap = PageFile::create(name);
+        for (int i = 0; i < 300; i++) heap.insertRecord(record);
+        for (FileIterator iter = heap.begin(); iter != heap.end(); ++iter) pages++;
+        const PageId first = heap.getFirstPageNo();
+        deleteRecords(heap, first, 5);
+        if (heap.insertRecord(record).page_number == first) checks++;
+    }
+    {
+        PageFile heap = PageFile::open(name);
+        PageId last = 0;
+        for (FileIterator iter = heap.begin(); iter != heap.end(); ++iter) last = (*iter).page_number();
+        deleteRecords(heap, last - 1, 3);
+        PageId after = 0;
+        const bool reused = heap.insertRecord(record).page_number == last - 1;
+        for (FileIterator iter = heap.begin(); iter != heap.end(); ++iter) after++;
+        if (reused && after == pages) checks++;
+    }
+    {
+        // a file written before pages counted their record bytes is refused instead of read with records misplaced
+        const std::uint32_t before = 0;
+        std::fstream raw(name, std::ios::in | std::ios::out | std::ios::binary);
+        raw.seekp(offsetof(FileHeader, page_format));
+        raw.write(reinterpret_cast<const char *>(&before), sizeof(before));
+    }
+    try {
+        PageFile heap = PageFile::open(name);
+    } catch (const FileFormatException &e) {
+        if (e.format() == 0) checks++;
+    }
+    File::remove(name);
+    return checks;
+}
+
+// -----------------------------------------------------------------------------
+// bufferPools
+// -----------------------------------------------------------------------------
+
+/**
+ * Pins count pages of a file in a pool, returning false if the pool runs out of frames first. Whatever was
+ * pinned is unpinned again.
+ */
+bool pinPages(BufMgr *pool, PageFile &file, const PageId first, const int count) {
+    std::vector<PageId> pinned;
+    bool fitted = true;
+    try {
+        for (int i = 0; i < count; i++) {
+            Page *page;
+            pool->readPage(&file, first + i, page);
+            pinned.push_back(first + i);
+        }
+    } catch (const BufferExceededException &) {
+        fitted = false;
+    }
+    for (size_t i = 0; i < pinned.size(); i++) pool->unPinPage(&file, pinned[i], false);
+    return fitted;
+}
+
+int bufferPools() {
+    // Files go to the pool they are assigned to and the rest to the first pool; a pool is as large as it was
+    // last resized to, and cannot shrink below the frames pinned in it.
+    const std::string name = "pools.rel";
+    try {
+        File::remove(name);
+    } catch (const FileNotFoundException &) {
+    }
+    int checks = 0;
+    {
+        BufPoolRegistry pools;
+        BufMgr *hot = pools.createPool("hot", 8, 0, 1, POLICY_2Q);
+        BufMgr *scratch = pools.createPool("scratch", 4, 16);
+        pools.assign(name, "scratch");
+        PageFile file = PageFile::create(name);
+        if (pools.poolFor(&file) == scratch && pools.poolFor("other.rel") == hot && pools.pool("hot") == hot)
+            checks++;
+
+        PageId first = 0;
+        for (int i = 0; i < 12; i++) {
+            PageId pageNo;
+            file.allocatePage(pageNo);
+            if (i == 0) first = pageNo;
+        }
+        const bool small = !pinPages(scratch, file, first, 5);
+        pools.resize("scratch", 16);
+        if (small && pinPages(scratch, file, first, 12) && pools.size("scratch") == 16) checks++;
+
+        Page *page;
+        scratch->readPage(&file, first, page);
+        scratch->readPage(&file, first + 1, page);
+        bool refused = false;
+        try {
+            pools.resize("scratch", 1);
+        } catch (const BufferExceededException &) {
+            refused = pools.size("scratch") == 16;
+        }
+        scratch->unPinPage(&file, first, false);
+        scratch->unPinPage(&file, first + 1, false);
+        pools.resize("scratch", 1);
+        if (refused && pools.size("scratch") == 1 && pinPages(scratch, file, first, 1) &&
+            !pinPages(scratch, file, first, 2))
+            checks++;
+
+        bool errors = false;
+        try {
+            pools.createPool("hot", 4);
+        } catch (const PoolExistsException &) {
+            try {
+                pools.assign(name, "cold");
+            } catch (const NoSuchPoolException &) {
+                errors = pools.poolFor(name) == scratch;
+            }
+        }
+        if (errors) checks++;
+        scratch->flushFile(&file);
+    }
+    File::remove(name);
+    return checks;
+}
+
+// -----------------------------------------------------------------------------
+// predicateScans
+// -----------------------------------------------------------------------------
+
+void predicateScans() {
+    // Predicates on each attribute type, through scanNext and through batches of a page each
+    int intBound = 1000;
+    double doubleBound = relationSize - 10;
+    const char *stringBound = "00100";
+    ScanPredicate below(offsetof(RECORD, i), INTEGER, LT, &intBound);
+    checkPassFail(filteredScan(below, false), 1000)
+    checkPassFail(filteredScan(below, true), 1000)
+    ScanPredicate top(offsetof(RECORD, d), DOUBLE, GTE, &doubleBound);
+    checkPassFail(filteredScan(top, true), 10)
+    ScanPredicate prefix(offsetof(RECORD, s), STRING, LT, stringBound);
+    checkPassFail(filteredScan(prefix, true), 100)
+
+    // The same relation split into morsels across worker threads
+    checkPassFail(parallelCount(NULL, 4), relationSize)
+    checkPassFail(parallelCount(&below, 3), 1000)
+}
+
+/**
+ * Counts the records of the relation with a ParallelScan, checking every record is handed over exactly once.
+ *
+ * @return  Number of records, or -1 if any record was handed over twice
+ */
+int parallelCount(const ScanPredicate *predicate, unsigned threads) {
+    // small morsels, so that the workers take turns many times over the relation
+    ParallelScan scan(relationName, bufMgr, threads, 2);
+    if (predicate != NULL) scan.setPredicate(*predicate);
+    std::vector<std::vector<int> > values(threads);
+    scan.run([&values](unsigned worker, const std::vector<ScanRecord> &records) {
+        for (size_t i = 0; i < records.size(); i++) {
+            int value;
+            memcpy(&value, records[i].record.data + offsetof(RECORD, i), sizeof(value));
+            values[worker].push_back(value);
+        }
+    });
+    std::set<int> seen;
+    int count = 0;
+    for (size_t w = 0; w < values.size(); w++) {
+        for (size_t i = 0; i < values[w].size(); i++) {
+            if (!seen.insert(values[w][i]).second) return -1;
+            count++;
+        }
+    }
+    return count;
+}
+
+int filteredScan(const ScanPredicate &predicate, bool batch) {
+    FileScan scan(relationName, bufMgr);
+    scan.setPredicate(predicate);
+    int count = 0;
+    if (batch) {
+        std::vector<ScanRecord> records;
+        while (scan.scanNextBatch(records) > 0) count += records.size();
+        return count;
+    }
+    try {
+        RecordId scanRid;
+        while (1) {
+            scan.scanNext(scanRid);
+            count++;
+        }
+    } catch (const EndOfFileException &e) {
+    }
+    return count;
+}
+
 // -----------------------------------------------------------------------------
 // createRelationBackward
 // -----------------------------------------------------------------------------
@@ -310,6 +1106,16 @@ void indexTests() {
         File::remove(intIndexName);
     } catch (const FileNotFoundException &e) {
     }
+    doubleTests();
+    try {
+        File::remove(doubleIndexName);
+    } catch (const FileNotFoundException &e) {
+    }
+    stringTests();
+    try {
+        File::remove(stringIndexName);
+    } catch (const FileNotFoundException &e) {
+    }
 }
 
 // -----------------------------------------------------------------------------
@@ -318,28 +1124,1215 @@ void indexTests() {
 
 void intTests() {
     std::cout << "Create a B+ Tree index on the integer field" << std::endl;
-    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    {
+        BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+        checkIntScans(&index);
+        checkPassFail(optimisticLookups(&index), 0)
+    }
+    checkPassFail(persistedSummary(), 3)
 
-    // run some tests
-    // checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
-    //     checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
-    //         checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
-    //             checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
-    //                 checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
-    //                     checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
-    //                         checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+    std::cout << "Reopen the index and map it read-only" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    index.mapReadOnly();
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(intBatchScan(&index, 0, GTE, relationSize, LT), relationSize)
+    checkPassFail(intLookups(&index), relationSize)
+    checkPassFail(readOnlyInserts(&index), 1)
 }
 
-int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp) {
-    RecordId scanRid;
-    Page *curPage;
-
-    std::cout << "Scan for ";
-    if (lowOp == GT) {
-        std::cout << "(";
-    } else {
-        std::cout << "[";
-    }
+/**
+ * Reopens the integer index three times: as it was built, after entries were inserted and deleted, and from a
+ * copy of its file taken while it was open.
+ *
+ * @return  Number of times the summary read from the meta page was as expected: exact for an index closed
+ *          cleanly, an estimate until analyzed for the copy
+ */
+int persistedSummary() {
+    const std::string backup = intIndexName + ".open";
+    int checks = 0;
+    {
+        BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+        const IndexSummary opened = index.summary();
+        const IndexShape shape = index.analyze();
+        if (opened.entriesExact && opened.entries == (std::uint64_t)relationSize && opened.height == shape.height() &&
+            opened.leafNodes == shape.leaves().nodes && opened.leafFill() == shape.leaves().fillFactor())
+            checks++;
+        copyFile(intIndexName, backup);
+        RecordId rid;
+        rid.page_number = 1;
+        rid.slot_number = 1;
+        for (int key = relationSize; key < relationSize + 10; key++) index.insertEntry(&key, rid);
+        for (int key = relationSize; key < relationSize + 3; key++) index.deleteEntry(&key, rid);
+    }
+    {
+        BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+        const IndexSummary reopened = index.summary();
+        if (reopened.entriesExact && reopened.entries == (std::uint64_t)relationSize + 7) checks++;
+    }
+    copyFile(backup, intIndexName);
+    File::remove(backup);
+    {
+        BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+        const IndexSummary copied = index.summary();
+        const IndexShape shape = index.analyze();
+        const IndexSummary counted = index.summary();
+        if (!copied.entriesExact && copied.entries == (std::uint64_t)relationSize && counted.entriesExact &&
+            counted.entries == (std::uint64_t)relationSize && counted.height == shape.height())
+            checks++;
+    }
+    return checks;
+}
+
+/**
+ * Tries to insert an entry into a mapped index.
+ *
+ * @return  Number of inserts rejected
+ */
+int readOnlyInserts(BTreeIndex *index) {
+    int key = 0;
+    RecordId rid;
+    rid.page_number = 1;
+    rid.slot_number = 1;
+    try {
+        index->insertEntry(&key, rid);
+    } catch (const ReadOnlyException &e) {
+        return 1;
+    }
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+// doubleTests
+// -----------------------------------------------------------------------------
+
+void doubleTests() {
+    std::cout << "Create a B+ Tree index on the double field, scanning the relation with 4 threads" << std::endl;
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE, BULKLOAD_FILL_FACTOR, 4);
+
+    checkPassFail(doubleScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(doubleScan(&index, 20, GTE, 35, LTE), 16)
+    checkPassFail(doubleScan(&index, -3, GT, 3, LT), 3)
+    checkPassFail(doubleScan(&index, 996, GT, 1001, LT), 4)
+    checkPassFail(doubleScan(&index, 0, GT, 1, LT), 0)
+    checkPassFail(doubleScan(&index, 300, GT, 400, LT), 99)
+    checkPassFail(doubleScan(&index, 3000, GTE, 4000, LT), 1000)
+}
+
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp) {
+    std::cout << "Scan for " << (lowOp == GT ? "(" : "[") << lowVal << "," << highVal
+              << (highOp == LT ? ")" : "]") << std::endl;
+
+    return countScan(index, &lowVal, lowOp, &highVal, highOp);
+}
+
+// -----------------------------------------------------------------------------
+// stringTests
+// -----------------------------------------------------------------------------
+
+void stringTests() {
+    // 4 frames split between 2 writers force many small runs and several merge passes
+    std::cout << "Create a B+ Tree index on the string field, sorting it externally in 4 frames" << std::endl;
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s), STRING, BULKLOAD_FILL_FACTOR, 2, 4);
+    checkPassFail(File::exists(stringIndexName + ".sort.run0") || File::exists(stringIndexName + ".sort.merge"), 0)
+
+    checkPassFail(stringScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(stringScan(&index, 20, GTE, 35, LTE), 16)
+    checkPassFail(stringScan(&index, -3, GT, 3, LT), 3)
+    checkPassFail(stringScan(&index, 996, GT, 1001, LT), 4)
+    checkPassFail(stringScan(&index, 0, GT, 1, LT), 0)
+    checkPassFail(stringScan(&index, 300, GT, 400, LT), 99)
+    checkPassFail(stringScan(&index, 3000, GTE, 4000, LT), 1000)
+}
+
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp) {
+    // bounds are spelled like the string attribute of the tuples with i equal to them
+    char lowValStr[100];
+    char highValStr[100];
+    sprintf(lowValStr, "%05d string record", lowVal);
+    sprintf(highValStr, "%05d string record", highVal);
+
+    std::cout << "Scan for " << (lowOp == GT ? "(" : "[") << lowValStr << "," << highValStr
+              << (highOp == LT ? ")" : "]") << std::endl;
+
+    return countScan(index, lowValStr, lowOp, highValStr, highOp);
+}
+
+int countScan(BTreeIndex *index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp) {
+    try {
+        index->startScan(lowVal, lowOp, highVal, highOp);
+    } catch (const NoSuchKeyFoundException &e) {
+        std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+        return 0;
+    }
+
+    RecordId scanRid;
+    int numResults = 0;
+    while (1) {
+        try {
+            index->scanNext(scanRid);
+        } catch (const IndexScanCompletedException &e) {
+            break;
+        }
+        numResults++;
+    }
+    index->endScan();
+    std::cout << "Number of results: " << numResults << std::endl << std::endl;
+
+    return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// intInsertTests
+// -----------------------------------------------------------------------------
+
+void intInsertTests() {
+    try {
+        File::remove(relationName);
+    } catch (const FileNotFoundException &e) {
+    }
+    {
+        PageFile emptyFile = PageFile::create(relationName);
+    }
+
+    std::cout << "Create an empty B+ Tree index on the integer field" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+    createRelationRandom();
+    {
+        FileScan fscan(relationName, bufMgr);
+        try {
+            RecordId scanRid;
+            while (1) {
+                fscan.scanNext(scanRid);
+                int key;
+                memcpy(&key, fscan.attribute(offsetof(RECORD, i), sizeof(int)), sizeof(int));
+                index.insertEntry(&key, scanRid);
+            }
+        } catch (const EndOfFileException &e) {
+        }
+    }
+
+    checkIntScans(&index);
+    checkPassFail(indexShape(&index), 1)
+    checkPassFail(reorganizedLeaves(&index), 1)
+    intDeleteTests(&index);
+}
+
+/**
+ * Checks the counters and the shape of an index built by inserting relationSize entries one at a time: every leaf
+ * but the first came from a leaf split, and every non-leaf node from a split or a new root.
+ *
+ * @return  1 if the counters and the shape agree
+ */
+int indexShape(BTreeIndex *index) {
+    IndexStats stats = index->stats();
+    const IndexShape shape = index->analyze();
+    std::uint64_t nonLeafNodes = 0;
+    bool linked = true;
+    for (int i = 0; i + 1 < shape.height(); i++) {
+        nonLeafNodes += shape.levels[i].nodes;
+        // each node has one child more than it has keys
+        linked = linked && shape.levels[i + 1].nodes == shape.levels[i].nodes + shape.levels[i].entries;
+    }
+    const LevelShape &leaves = shape.leaves();
+    std::uint64_t filled = 0;
+    for (int b = 0; b < FILL_BUCKETS; b++) filled += leaves.fill[b];
+    const bool counted = stats.inserts == (std::uint64_t)relationSize && stats.deletes == 0 && stats.scans > 0 &&
+                         stats.scanRids > 0 && stats.descentNodes > stats.descents;
+    const bool shaped = linked && leaves.entries == (std::uint64_t)relationSize && filled == leaves.nodes &&
+                        leaves.nodes == stats.leafSplits + 1 &&
+                        nonLeafNodes == stats.nodeSplits + shape.height() - 1;
+
+    // a lookup reads one leaf for a key without duplicates
+    index->clearStats();
+    int key = relationSize / 2;
+    const bool found = index->contains(&key);
+    stats = index->stats();
+    const bool looked = found && stats.lookups == 1 && stats.lookupLeaves == 1 && stats.inserts == 0;
+    return counted && shaped && looked ? 1 : 0;
+}
+
+/**
+ * Empties the lower half of the leaves of an index built by random inserts, with merges off, and reorganizes the
+ * leaves one parent at a time while a scan is open, then all at once again. The entries are put back after.
+ *
+ * @return  1 if the leaves got fewer and fuller, the scan and a scan after it returned every entry in the same
+ *          order, and the second pass found nothing left to move
+ */
+int reorganizedLeaves(BTreeIndex *index) {
+    index->setMergeThreshold(0);
+    const int removed = changeIntRange(index, 0, relationSize / 2, true);
+    int low = 0;
+    int high = relationSize;
+    RecordId batch[64];
+    size_t count;
+    std::vector<RecordId> before;
+    index->startScan(&low, GTE, &high, LT);
+    while ((count = index->scanNextBatch(batch, 64)) > 0) before.insert(before.end(), batch, batch + count);
+    index->endScan();
+    const IndexShape shapeBefore = index->analyze();
+
+    // the scan runs through leaves retired under it
+    std::vector<RecordId> during;
+    ReorgResult step;
+    std::size_t written = 0;
+    index->startScan(&low, GTE, &high, LT);
+    do {
+        step = index->reorganize(1, BULKLOAD_FILL_FACTOR);
+        written += step.leavesWritten;
+        if ((count = index->scanNextBatch(batch, 64)) > 0) during.insert(during.end(), batch, batch + count);
+    } while (!step.complete);
+    while ((count = index->scanNextBatch(batch, 64)) > 0) during.insert(during.end(), batch, batch + count);
+    index->endScan();
+
+    std::vector<RecordId> after;
+    index->startScan(&low, GTE, &high, LT);
+    while ((count = index->scanNextBatch(batch, 64)) > 0) after.insert(after.end(), batch, batch + count);
+    index->endScan();
+    const IndexShape shapeAfter = index->analyze();
+    const ReorgResult again = index->reorganize(0, BULKLOAD_FILL_FACTOR);
+    std::cout << "Reorganized " << written << " leaves, leaf fill " << shapeBefore.leaves().fillFactor() << " to "
+              << shapeAfter.leaves().fillFactor() << std::endl;
+
+    const bool restored = changeIntRange(index, 0, relationSize / 2, false) == removed;
+    index->setMergeThreshold(MERGE_THRESHOLD);
+
+    const bool kept = removed == relationSize / 2 && before.size() == (size_t)(relationSize - removed) &&
+                      during == before && after == before && restored;
+    const bool packed = shapeAfter.leaves().nodes < shapeBefore.leaves().nodes &&
+                        shapeAfter.leaves().fillFactor() > shapeBefore.leaves().fillFactor() &&
+                        shapeAfter.leaves().entries == shapeBefore.leaves().entries;
+    const bool settled = again.complete && again.leavesRead == shapeAfter.leaves().nodes && again.leavesWritten == 0;
+    return kept && packed && settled ? 1 : 0;
+}
+
+void intDeleteTests(BTreeIndex *index) {
+    // deleting the lower half empties a run of leaves, which merge away up to the root
+    checkPassFail(changeIntRange(index, 0, relationSize / 2, true), relationSize / 2)
+    checkPassFail(changeIntRange(index, 0, relationSize / 2, true), 0)
+    checkPassFail(intScan(index, 0, GTE, relationSize, LT), relationSize / 2)
+    checkPassFail(intScan(index, 25, GT, 40, LT), 0)
+    checkPassFail(intScan(index, 3000, GTE, 4000, LT), 1000)
+
+    // inserting them again reuses the pages merged away
+    checkPassFail(changeIntRange(index, 0, relationSize / 2, false), relationSize / 2)
+    checkIntScans(index);
+}
+
+void intBatchInsertTests() {
+    std::cout << "Bulk load an index, delete its lower half and put it back through insertBatch" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkPassFail(changeIntRange(&index, 0, relationSize / 2, true), relationSize / 2)
+    checkPassFail(batchInsertIntRange(&index, 0, relationSize / 2, 700), relationSize / 2)
+    checkIntScans(&index);
+}
+
+void intAppendTests() {
+    std::cout << "Create an empty B+ Tree index and insert every entry in key order" << std::endl;
+    std::vector<std::pair<int, RecordId> > entries;
+    {
+        FileScan fscan(relationName, bufMgr);
+        try {
+            RecordId scanRid;
+            while (1) {
+                fscan.scanNext(scanRid);
+                int key;
+                memcpy(&key, fscan.attribute(offsetof(RECORD, i), sizeof(int)), sizeof(int));
+                entries.push_back(std::make_pair(key, scanRid));
+            }
+        } catch (const EndOfFileException &e) {
+        }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const std::pair<int, RecordId> &a, const std::pair<int, RecordId> &b) { return a.first < b.first; });
+    {
+        // an index over an empty relation starts out empty
+        const std::string emptyName = "relEmpty";
+        {
+            PageFile emptyFile = PageFile::create(emptyName);
+        }
+        BTreeIndex index(emptyName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+        File::remove(emptyName);
+        for (size_t i = 0; i < entries.size(); i++) {
+            index.insertEntry(&entries[i].first, entries[i].second);
+        }
+        checkIntScans(&index);
+    }
+    // appends split off a leaf holding only the new entry, so every leaf but the last is full: the header page,
+    // the meta page, the root and the leaves
+    checkPassFail(indexFilePages(intIndexName), 3 + (relationSize + INTARRAYLEAFSIZE - 1) / INTARRAYLEAFSIZE)
+}
+
+/**
+ * Changes an index with its write-ahead log on, then puts back the index file as it was when the log was turned
+ * on, as a crash that lost every page written since would, and appends a torn group to the log. Reopening the
+ * index redoes the whole groups: the result counts the entries it holds then. With checksums on, the checksums
+ * of the pages written since are kept, so that the pages put back fail them as torn pages would.
+ */
+int walRecovery(const bool checksums) {
+    std::cout << "Recover inserts and deletes from the write-ahead log" << std::endl;
+    std::vector<int> keys;
+    std::vector<RecordId> rids;
+    relationEntries(keys, rids);
+    const std::string emptyName = "relEmpty";
+    std::string logName;
+    File::setChecksums(checksums);
+    {
+        {
+            PageFile emptyFile = PageFile::create(emptyName);
+        }
+        BTreeIndex index(emptyName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+        File::remove(emptyName);
+        logName = intIndexName + ".wal";
+        index.setWriteAheadLog(true);
+        copyFile(intIndexName, intIndexName + ".bak");
+
+        // splits grow the tree to a new root, and the deletes merge most of the leaves away again
+        for (int i = 0; i < 2000; i++) {
+            index.insertEntry(&keys[i], rids[i]);
+        }
+        for (int i = 0; i < 2000; i++) {
+            if (i % 4 != 0) index.deleteEntry(&keys[i], rids[i]);
+        }
+        index.insertBatch(&keys[2000], &rids[2000], 1000);
+        copyFile(logName, logName + ".bak");
+    }
+    copyFile(intIndexName + ".bak", intIndexName);
+    copyFile(logName + ".bak", logName);
+    std::remove((intIndexName + ".bak").c_str());
+    std::remove((logName + ".bak").c_str());
+    {
+        std::ofstream torn(logName.c_str(), std::ios::binary | std::ios::app);
+        torn << "a group torn before its commit record was whole";
+    }
+
+    BTreeIndex index(emptyName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    File::setChecksums(false);
+    return intScan(&index, 0, GTE, relationSize, LT);
+}
+
+/**
+ * Checkpoints an index with its write-ahead log on until the background writer has trickled out every page
+ * changed so far, makes a few more inserts and puts back the index file and the log as a crash would leave
+ * them. Replay starts at the checkpoint, so it redoes only the inserts made after it.
+ */
+void walCheckpointTests() {
+    std::cout << "Checkpoint the write-ahead log while the background writer trickles pages out" << std::endl;
+    std::vector<int> keys;
+    std::vector<RecordId> rids;
+    relationEntries(keys, rids);
+    const std::string emptyName = "relEmpty";
+    const std::string logName = intIndexName + ".wal";
+    {
+        {
+            PageFile emptyFile = PageFile::create(emptyName);
+        }
+        BTreeIndex index(emptyName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+        File::remove(emptyName);
+        index.setWriteAheadLog(true);
+        for (int i = 0; i < 1000; i++) {
+            index.insertEntry(&keys[i], rids[i]);
+        }
+
+        // the top of the tree stays pinned all along, and is trickled out all the same
+        bufMgr->startBackgroundWriter(1);
+        std::size_t holding = index.checkpoint();
+        for (int wait = 0; wait < 5000 && holding > 0; wait++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            holding = index.checkpoint();
+        }
+        bufMgr->stopBackgroundWriter();
+        checkPassFail((int)holding, 0)
+
+        for (int i = 1000; i < 1100; i++) {
+            index.insertEntry(&keys[i], rids[i]);
+        }
+        copyFile(intIndexName, intIndexName + ".bak");
+        copyFile(logName, logName + ".bak");
+    }
+    copyFile(intIndexName + ".bak", intIndexName);
+    copyFile(logName + ".bak", logName);
+    std::remove((intIndexName + ".bak").c_str());
+    std::remove((logName + ".bak").c_str());
+
+    {
+        BlobFile indexFile = BlobFile::open(intIndexName);
+        checkPassFail((int)LogManager::replay(logName, indexFile), 100)
+    }
+    BTreeIndex index(emptyName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkPassFail(intScan(&index, 0, GTE, relationSize, LT), 1100)
+
+    // a log that cannot be written is reported rather than taken for durable
+    bool unwritable = false;
+    try {
+        LogManager full("/dev/full");
+    } catch (const LogWriteException &e) {
+        unwritable = e.error() == ENOSPC;
+    }
+    checkPassFail(unwritable, true)
+}
+
+/**
+ * Inserts and deletes entries of one index from several writer threads while reader threads scan it. Each writer
+ * takes every writers-th entry of the relation and deletes every third entry it inserted once it has inserted
+ * two more, so the entries left are known up front. Every scan has to see its keys in order, and once the writers
+ * are done a scan has to find exactly the keys left.
+ */
+void concurrentIndexTests() {
+    std::cout << "Insert, delete and scan an index from several threads at once" << std::endl;
+    std::vector<int> keys;
+    std::vector<RecordId> rids;
+    relationEntries(keys, rids);
+    const std::string emptyName = "relEmpty";
+    {
+        PageFile emptyFile = PageFile::create(emptyName);
+    }
+    BTreeIndex index(emptyName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    File::remove(emptyName);
+
+    const size_t writers = 4;
+    const int readers = 2;
+    std::set<int> expected;
+    for (size_t w = 0; w < writers; w++) {
+        for (size_t i = w, n = 0; i < keys.size(); i += writers, n++) {
+            expected.insert(keys[i]);
+            if (n % 3 == 2) expected.erase(keys[i - 2 * writers]);
+        }
+    }
+
+    std::atomic<bool> writing(true);
+    std::atomic<int> disordered(0);
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < writers; w++) {
+        threads.push_back(std::thread([&index, &keys, &rids, w, writers]() {
+            for (size_t i = w, n = 0; i < keys.size(); i += writers, n++) {
+                index.insertEntry(&keys[i], rids[i]);
+                if (n % 3 == 2) index.deleteEntry(&keys[i - 2 * writers], rids[i - 2 * writers]);
+            }
+        }));
+    }
+    for (int r = 0; r < readers; r++) {
+        threads.push_back(std::thread([&index, &writing, &disordered]() {
+            do {
+                if (optionedScan(&index, 0, GTE, relationSize, LT, ScanOptions()) < 0) disordered++;
+            } while (writing);
+        }));
+    }
+    for (size_t w = 0; w < writers; w++) threads[w].join();
+    writing = false;
+    for (size_t t = writers; t < threads.size(); t++) threads[t].join();
+    checkPassFail(disordered.load(), 0)
+
+    std::vector<int> found;
+    try {
+        const int low = 0;
+        const int high = relationSize;
+        IndexScanCursor cursor = index.openScan(&low, GTE, &high, LT, true);
+        while (true) {
+            int key;
+            RecordId rid;
+            cursor.nextKeyed(&key, rid);
+            found.push_back(key);
+        }
+    } catch (const NoSuchKeyFoundException &e) {
+    } catch (const IndexScanCompletedException &e) {
+    }
+    const bool left = found == std::vector<int>(expected.begin(), expected.end());
+    checkPassFail(left, true)
+}
+
+/**
+ * Inserts entries through a write buffer. Entries still in the buffer are found by lookups and removed by
+ * deletes before any of them reaches the tree; deletes also find the entries flushed already, and a scan sees
+ * every entry left.
+ */
+void writeBufferTests() {
+    std::cout << "Insert through a write buffer" << std::endl;
+    std::vector<int> keys;
+    std::vector<RecordId> rids;
+    relationEntries(keys, rids);
+    const std::string emptyName = "relEmpty";
+    {
+        PageFile emptyFile = PageFile::create(emptyName);
+    }
+    BTreeIndex index(emptyName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    File::remove(emptyName);
+    index.setWriteBuffer(256);
+
+    for (int i = 0; i < 10; i++) {
+        index.insertEntry(&keys[i], rids[i]);
+    }
+    index.insertEntry(&keys[0], rids[1]);
+    int found = (int)index.lookup(&keys[0]).size();
+    found += index.contains(&keys[5]);
+    found += index.deleteEntry(&keys[5], rids[5]);
+    found += index.contains(&keys[5]);
+    checkPassFail(found, 4)
+
+    for (int i = 10; i < 3000; i++) {
+        index.insertEntry(&keys[i], rids[i]);
+    }
+    int deleted = 0;
+    for (int i = 0; i < 3000; i++) {
+        if (i % 2 == 0 && i != 0) deleted += index.deleteEntry(&keys[i], rids[i]);
+    }
+    checkPassFail(deleted, 1499)
+    // the scan flushes the buffer; keys[0] is in twice, as keys[5] is in no more
+    checkPassFail(intScan(&index, 0, GTE, relationSize, LT), 3000 - 1 - 1499 + 1)
+}
+
+/**
+ * Inserts entries into an LSM index with a small memtable, so that they are written out as runs and merged.
+ * Lookups and deletes find entries in the memtable and in the runs alike, a scan merges them in key order,
+ * and the index reopened from its manifest holds every entry left.
+ */
+void lsmTests() {
+    std::cout << "Insert into an LSM index" << std::endl;
+    std::vector<int> keys;
+    std::vector<RecordId> rids;
+    relationEntries(keys, rids);
+    const std::string emptyName = "relLsm";
+    {
+        PageFile emptyFile = PageFile::create(emptyName);
+    }
+    std::string lsmIndexName;
+    {
+        LsmIndex index(emptyName, lsmIndexName, bufMgr, offsetof(tuple, i), INTEGER, 256, 4);
+        for (int i = 0; i < 3000; i++) {
+            index.insertEntry(&keys[i], rids[i]);
+        }
+        index.insertEntry(&keys[0], rids[1]);
+        int found = (int)index.lookup(&keys[0]).size();
+        found += index.contains(&keys[2999]);
+        found += index.contains(&keys[3000]);
+        checkPassFail(found, 3)
+
+        int deleted = 0;
+        for (int i = 0; i < 3000; i++) {
+            if (i % 2 == 0 && i != 0) deleted += index.deleteEntry(&keys[i], rids[i]);
+        }
+        checkPassFail(deleted, 1499)
+        index.compact();
+        // 11 runs written out leave 2 merged runs and 3 of the first tier
+        checkPassFail(index.runCount(), 5)
+        checkPassFail(lsmScan(index, 0, GTE, relationSize, LT), 3000 - 1499 + 1)
+    }
+    {
+        LsmIndex index(emptyName, lsmIndexName, bufMgr, offsetof(tuple, i), INTEGER, 256, 4);
+        checkPassFail(lsmScan(index, 0, GTE, relationSize, LT), 3000 - 1499 + 1)
+        checkPassFail((int)index.lookup(&keys[0]).size() + index.contains(&keys[2]), 2)
+
+        // an empty range at the largest buffered key ends the memtable scan before its end
+        const int largest = relationSize + 5;
+        index.insertEntry(&largest, rids[0]);
+        checkPassFail(lsmScan(index, largest, GT, largest, LT), 0)
+        checkPassFail(lsmScan(index, largest, GTE, largest, LTE), 1)
+    }
+
+    // the manifest names runs by number; numbers past the last run name no file
+    for (int id = 0; id < 64; id++) {
+        std::ostringstream run;
+        run << emptyName << ".r" << id << '.' << offsetof(tuple, i);
+        try {
+            File::remove(run.str());
+        } catch (const FileNotFoundException &e) {
+        }
+        std::remove((run.str() + ".bloom").c_str());
+    }
+    std::remove(lsmIndexName.c_str());
+    File::remove(emptyName);
+}
+
+/**
+ * Builds a hash index over the relation and looks every key up, alone and in one batch. A key with more entries
+ * than a bucket page holds is still found in full through its overflow pages, deletes take entries out, and the
+ * directory and count of entries are there again once the index is reopened.
+ */
+void hashIndexTests() {
+    std::cout << "Look up through a hash index" << std::endl;
+    std::vector<int> keys;
+    std::vector<RecordId> rids;
+    relationEntries(keys, rids);
+    const int absent = relationSize;
+    const int duplicates = 3000;
+    std::string hashIndexName;
+    int kept = 0;
+    {
+        HashIndex index(relationName, hashIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+        int found = 0;
+        for (size_t i = 0; i < keys.size(); i++) {
+            const std::vector<RecordId> match = index.lookup(&keys[i]);
+            found += match.size() == 1 && match[0] == rids[i];
+        }
+        checkPassFail(found, relationSize)
+        checkPassFail((int)index.contains(&absent), 0)
+
+        // every key twice and one past the relation, each twin answered with its own probe position
+        std::vector<int> probes(keys);
+        probes.insert(probes.end(), keys.begin(), keys.end());
+        probes.push_back(absent);
+        int matched = 0;
+        index.lookupBatch(&probes[0], probes.size(), [&](size_t probe, const RecordId &rid) {
+            matched += probe < 2 * keys.size() && rid == rids[probe % keys.size()];
+        });
+        checkPassFail(matched, 2 * relationSize)
+
+        // entries of one key past a page's worth cannot be split apart, so they chain overflow pages
+        RecordId extra;
+        extra.slot_number = 1;
+        for (int i = 0; i < duplicates; i++) {
+            extra.page_number = 100000 + i;
+            index.insertEntry(&keys[0], extra);
+        }
+        checkPassFail((int)index.lookup(&keys[0]).size(), duplicates + 1)
+        checkPassFail((int)index.entries(), relationSize + duplicates)
+
+        int deleted = 0;
+        for (int i = 0; i < duplicates; i++) {
+            extra.page_number = 100000 + i;
+            deleted += index.deleteEntry(&keys[0], extra);
+        }
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (keys[i] % 2 == 0) deleted += index.deleteEntry(&keys[i], rids[i]);
+        }
+        deleted += index.deleteEntry(&absent, rids[0]);
+        checkPassFail(deleted, duplicates + relationSize / 2)
+        kept = (int)index.entries();
+    }
+    {
+        HashIndex index(relationName, hashIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+        int found = 0;
+        for (size_t i = 0; i < keys.size(); i++) found += (int)index.lookup(&keys[i]).size();
+        checkPassFail(found, kept)
+        checkPassFail((int)index.entries(), relationSize - relationSize / 2)
+    }
+    File::remove(hashIndexName);
+}
+
+/**
+ * Looks up keys through a hot key cache. A key is cached on its second lookup and answered from the cache after,
+ * inserts and deletes of its entries show in the cached answer, the cache stays within its budget while every key
+ * still finds its entry, and keys looked up once each do not displace the keys looked up over and over.
+ */
+void hotKeyTests() {
+    std::cout << "Look up through a hot key cache" << std::endl;
+    std::vector<int> keys;
+    std::vector<RecordId> rids;
+    relationEntries(keys, rids);
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    index.setHotKeyCache(64 * 1024);
+    for (int i = 0; i < 3; i++) index.lookup(&keys[0]);
+    checkPassFail((int)index.stats().hotHits, 1)
+    checkPassFail((int)index.hotKeyCache()->keys(), 1)
+
+    RecordId extra;
+    extra.page_number = 100000;
+    extra.slot_number = 1;
+    index.insertEntry(&keys[0], extra);
+    std::vector<RecordId> found = index.lookup(&keys[0]);
+    int consistent = found.size() == 2 && found[0] == rids[0] && found[1] == extra;
+    index.deleteEntry(&keys[0], rids[0]);
+    found = index.lookup(&keys[0]);
+    consistent += found.size() == 1 && found[0] == extra;
+    index.deleteEntry(&keys[0], extra);
+    consistent += !index.contains(&keys[0]);
+    index.insertBatch(&keys[0], &rids[0], 1);
+    found = index.lookup(&keys[0]);
+    consistent += found.size() == 1 && found[0] == rids[0];
+    checkPassFail(consistent, 4)
+    checkPassFail((int)index.stats().hotHits, 5)
+
+    // far more keys are looked up twice than the budget holds
+    const std::size_t budget = 2048;
+    index.setHotKeyCache(budget);
+    int exact = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        for (int pass = 0; pass < 2; pass++) {
+            found = index.lookup(&keys[i]);
+            exact += found.size() == 1 && found[0] == rids[i];
+        }
+    }
+    checkPassFail(exact, 2 * relationSize)
+    const HotKeyCache *cache = index.hotKeyCache();
+    checkPassFail((int)(cache->bytes() <= budget && cache->keys() > 0 && cache->keys() < keys.size()), 1)
+
+    // a few hot keys between keys looked up once each
+    const int hot = 8;
+    index.setHotKeyCache(4096);
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < hot; i++) index.lookup(&keys[i]);
+        for (int i = 0; i < 15; i++) index.lookup(&keys[hot + round * 15 + i]);
+    }
+    index.clearStats();
+    for (int i = 0; i < hot; i++) index.lookup(&keys[i]);
+    checkPassFail((int)index.stats().hotHits, hot)
+    // a key looked up once only gets in if the sketch mistakes it for one it counted before
+    checkPassFail((int)(index.hotKeyCache()->keys() < 2 * hot), 1)
+}
+
+/**
+ * Looks up keys through an index with a key filter. Keys past the relation are turned away, whether probed
+ * alone, in a batch or by a scan for one key, while every key of the relation and every key inserted later is
+ * still found.
+ */
+void keyFilterTests() {
+    std::cout << "Look up through a key filter" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, BULKLOAD_FILL_FACTOR, 1, 0,
+                     NULL, BLOOM_BITS_PER_KEY);
+    int found = 0;
+    for (int key = 0; key < 2 * relationSize; key++) found += index.contains(&key);
+    checkPassFail(found, relationSize)
+
+    std::vector<int> keys;
+    std::vector<RecordId> rids;
+    relationEntries(keys, rids);
+    const int added = 3 * relationSize;
+    index.insertEntry(&added, rids[0]);
+    std::vector<int> probes;
+    for (int key = relationSize - 10; key <= added; key++) probes.push_back(key);
+    int matches = 0;
+    index.lookupBatch(probes.data(), probes.size(), [&matches](size_t, const RecordId &) { matches++; });
+    checkPassFail(matches, 10 + 1)
+
+    const int absent = 2 * relationSize;
+    checkPassFail(intScan(&index, absent, GTE, absent, LTE), 0)
+    checkPassFail(intScan(&index, added, GTE, added, LTE), 1)
+}
+
+/**
+ * Loads dense keys, whose leaves store each key in 2 bytes, and then keys far apart, whose leaves need all 4.
+ * The dense leaves hold more entries than uncompressed leaves would, and searches and scans find every key on
+ * either kind of leaf.
+ */
+void compressedLeafTests() {
+    std::cout << "Load frame-of-reference compressed leaves" << std::endl;
+    std::vector<int> relationKeys;
+    std::vector<RecordId> relationRids;
+    relationEntries(relationKeys, relationRids);
+    const int dense = 40000;
+    const int sparse = 1000;
+    std::vector<int> keys;
+    std::vector<RecordId> rids;
+    for (int i = 0; i < dense + sparse; i++) {
+        keys.push_back(i < dense ? i : dense + (i - dense) * 70000);
+        rids.push_back(relationRids[i % relationRids.size()]);
+    }
+    IndexEntries entries;
+    entries.keys = keys.data();
+    entries.rids = rids.data();
+    entries.count = keys.size();
+    const std::string emptyName = "relWide";
+    BTreeIndex index(emptyName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, BULKLOAD_FILL_FACTOR, 1, 0,
+                     &entries);
+    const bool smaller = indexFilePages(intIndexName) < 3 + (dense + sparse) / INTARRAYLEAFSIZE;
+    checkPassFail(smaller, true)
+
+    int found = 0;
+    for (int i = 0; i < dense + sparse; i += 97) found += index.contains(&keys[i]);
+    const int between = dense + 35000;
+    found += index.contains(&between);
+    checkPassFail(found, (dense + sparse + 96) / 97)
+    checkPassFail(intScan(&index, 100, GT, 5000, LTE), 4900)
+    checkPassFail(intScan(&index, dense - 10, GTE, dense + 10 * 70000, LT), 10 + 10)
+}
+
+/**
+ * Loads one key many times over among a few others, so that the leaves between its separators hold nothing but
+ * its record ids, then inserts and deletes more of its duplicates. The index is smaller than one storing a key
+ * per entry, and lookups and equality scans find every duplicate left.
+ */
+void postingListTests() {
+    std::cout << "Load and change posting lists of a duplicated key" << std::endl;
+    std::vector<int> relationKeys;
+    std::vector<RecordId> relationRids;
+    relationEntries(relationKeys, relationRids);
+    const int heavyKey = 7;
+    const int heavy = 30000;
+    const int others = 1000;
+    std::vector<int> keys;
+    std::vector<RecordId> rids;
+    for (int i = 0; i < heavy + others; i++) {
+        keys.push_back(i < heavy ? heavyKey : i - heavy);
+        rids.push_back(relationRids[i % relationRids.size()]);
+    }
+    IndexEntries entries;
+    entries.keys = keys.data();
+    entries.rids = rids.data();
+    entries.count = keys.size();
+    BTreeIndex index("relDup", intIndexName, bufMgr, offsetof(tuple, i), INTEGER, BULKLOAD_FILL_FACTOR, 1, 0,
+                     &entries);
+    // a key delta of even one byte per entry would take more leaves than this
+    const int leafBytes = (heavy + others) * (int)(sizeof(RecordId) + 1);
+    const bool smaller = indexFilePages(intIndexName) < 2 + leafBytes / INTLEAFAREA;
+    checkPassFail(smaller, true)
+    checkPassFail((int)index.lookup(&heavyKey).size(), heavy + 1)
+
+    RecordId added;
+    added.page_number = 1;
+    for (int i = 0; i < 3000; i++) {
+        added.slot_number = i;
+        index.insertEntry(&heavyKey, added);
+    }
+    int deleted = 0;
+    for (int i = 0; i < 3000; i += 3) {
+        added.slot_number = i;
+        deleted += index.deleteEntry(&heavyKey, added);
+    }
+    checkPassFail(deleted, 1000)
+    checkPassFail((int)index.lookup(&heavyKey).size(), heavy + 1 + 2000)
+    const int next = heavyKey + 1;
+    checkPassFail((int)index.lookup(&next).size(), 1)
+    checkPassFail(reversedScan(&index, heavyKey - 1, GTE, next, LTE), 1 + heavy + 1 + 2000 + 1)
+    // a distinct scan returns the three keys either way, however many leaves the duplicates fill
+    checkPassFail(optionedScan(&index, heavyKey - 1, GTE, next, LTE, ScanOptions(SCAN_ASCENDING, 0, true)), 3)
+    checkPassFail(optionedScan(&index, heavyKey - 1, GTE, next, LTE, ScanOptions(SCAN_DESCENDING, 0, true)), 3)
+    checkPassFail(optionedScan(&index, 0, GTE, others, LT, ScanOptions(SCAN_DESCENDING, 0, true)), others)
+    checkPassFail(optionedScan(&index, heavyKey, GTE, others, LT, ScanOptions(SCAN_ASCENDING, 2, true)), 2)
+}
+
+/**
+ * Lays out the included attributes coveringIndexTests asks for, the d and the first five characters of the s of
+ * the tuple createRelationRandom makes for key.
+ */
+void coveredAttributes(const int key, char *out) {
+    const double d = key;
+    char s[8];
+    sprintf(s, "%05d", key);
+    memcpy(out, &d, sizeof(d));
+    memcpy(out + sizeof(d), s, 5);
+}
+
+/**
+ * Scans the keys of a covering index from low up to high, exclusive, and counts the entries found and those whose
+ * included attributes are not those of their key.
+ */
+void coveredScan(BTreeIndex &index, const int low, const int high, int &found, int &wrong) {
+    found = 0;
+    wrong = 0;
+    try {
+        IndexScanCursor cursor = index.openScan(&low, GTE, &high, LT, true);
+        while (true) {
+            int key;
+            RecordId outRid;
+            char included[sizeof(double) + 5];
+            char expected[sizeof(double) + 5];
+            cursor.nextIncluded(&key, outRid, included);
+            coveredAttributes(key, expected);
+            found++;
+            wrong += memcmp(included, expected, sizeof(included)) != 0;
+        }
+    } catch (const NoSuchKeyFoundException &e) {
+    } catch (const IndexScanCompletedException &e) {
+    }
+}
+
+/**
+ * Builds a covering index over the relation that includes two of its attributes, grows and shrinks it through
+ * splits and merges, and checks that index scans return the attributes of every entry without reading a record.
+ */
+void coveringIndexTests() {
+    std::cout << "Scan the included attributes of a covering index" << std::endl;
+    std::vector<IncludedColumn> columns(2);
+    columns[0].byteOffset = offsetof(tuple, d);
+    columns[0].length = sizeof(double);
+    columns[1].byteOffset = offsetof(tuple, s);
+    columns[1].length = 5;
+    {
+        BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, BULKLOAD_FILL_FACTOR, 1,
+                         0, NULL, 0, columns);
+        int found, wrong;
+        coveredScan(index, 0, relationSize, found, wrong);
+        checkPassFail(found, relationSize)
+        checkPassFail(wrong, 0)
+
+        // inserts of their own and in batches split the leaves, and deletes merge them again
+        RecordId added;
+        added.page_number = 1;
+        char included[sizeof(double) + 5];
+        for (int i = 0; i < 3000; i++) {
+            const int key = relationSize + (i * 7919) % 3000;
+            added.slot_number = i;
+            coveredAttributes(key, included);
+            index.insertEntry(&key, added, included);
+        }
+        std::vector<int> keys(1000);
+        std::vector<RecordId> rids(1000, added);
+        std::vector<char> batch(1000 * sizeof(included));
+        for (int i = 0; i < 1000; i++) {
+            keys[i] = 2 * (999 - i) + 1;
+            rids[i].slot_number = 3000 + i;
+            coveredAttributes(keys[i], &batch[i * sizeof(included)]);
+        }
+        index.insertBatch(keys.data(), rids.data(), keys.size(), batch.data());
+        int deleted = 0;
+        for (int i = 0; i < 3000; i += 2) {
+            const int key = relationSize + (i * 7919) % 3000;
+            added.slot_number = i;
+            deleted += index.deleteEntry(&key, added);
+        }
+        checkPassFail(deleted, 1500)
+        coveredScan(index, 0, relationSize + 3000, found, wrong);
+        checkPassFail(found, relationSize + 1000 + 1500)
+        checkPassFail(wrong, 0)
+    }
+
+    // the included columns are part of the index, and only INTEGER indexes have them
+    bool rejected = false;
+    try {
+        BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    } catch (const BadIndexInfoException &e) {
+        rejected = true;
+    }
+    checkPassFail(rejected, true)
+    rejected = false;
+    try {
+        BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE, BULKLOAD_FILL_FACTOR, 1,
+                         0, NULL, 0, columns);
+    } catch (const BadIndexInfoException &e) {
+        rejected = true;
+    }
+    checkPassFail(rejected, true)
+}
+
+/**
+ * Reads the records of the index entries inside a range through a RecordFetch.
+ *
+ * @param ordered  Returns the number of records whose key is above that of the record fetched before
+ * @return         Number of records with the key of their entry inside the range
+ */
+int fetchedRange(BTreeIndex &index, const std::string &relation, int low, int high, int &ordered) {
+    std::vector<RecordId> rids;
+    RecordId batch[64];
+    size_t count;
+    index.startScan(&low, GTE, &high, LT);
+    while ((count = index.scanNextBatch(batch, 64)) > 0) rids.insert(rids.end(), batch, batch + count);
+    index.endScan();
+
+    int found = 0;
+    int previous = low - 1;
+    ordered = 0;
+    RecordFetch fetch(relation, bufMgr);
+    fetch.run(rids, [&](const RecordId &rid, const RecordView &record) {
+        int key;
+        memcpy(&key, record.data + offsetof(tuple, i), sizeof(int));
+        found += key >= low && key < high;
+        ordered += key > previous;
+        previous = key;
+    });
+    return found;
+}
+
+void recordFetchTests() {
+    std::cout << "Fetch the records of a range in page order, and cluster a relation" << std::endl;
+    const std::string clusteredName = relationName + ".clustered";
+    int ordered;
+    {
+        // the relation was filled in random order, so the records come back out of key order
+        BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+        checkPassFail(fetchedRange(index, relationName, 1000, 2000, ordered), 1000)
+        checkPassFail((ordered < 1000), true)
+    }
+    File::remove(intIndexName);
+
+    bool rejected = false;
+    try {
+        BTreeIndex::cluster(relationName, bufMgr, offsetof(tuple, i), INTEGER);
+    } catch (const FileOpenException &e) {
+        rejected = true;
+    }
+    checkPassFail(rejected, true)
+
+    // once clustered, page order is key order
+    copyFile(relationName, clusteredName);
+    checkPassFail((int)BTreeIndex::cluster(clusteredName, bufMgr, offsetof(tuple, i), INTEGER), relationSize)
+    std::string clusteredIndexName;
+    {
+        BTreeIndex index(clusteredName, clusteredIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+        checkPassFail(fetchedRange(index, clusteredName, 0, relationSize, ordered), relationSize)
+        checkPassFail(ordered, relationSize)
+    }
+    File::remove(clusteredIndexName);
+    File::remove(clusteredName);
+
+    // the checksums and page map written with the clustered copy move with it to the relation's name
+    copyFile(relationName, clusteredName);
+    File::setChecksums(true);
+    File::setCompression(true);
+    checkPassFail((int)BTreeIndex::cluster(clusteredName, bufMgr, offsetof(tuple, i), INTEGER), relationSize)
+    File::setCompression(false);
+    File::setChecksums(false);
+    const std::string sidecars[2] = {PageChecksums::filenameOf(clusteredName + ".cluster"),
+                                     CompressedPages::filenameOf(clusteredName + ".cluster")};
+    checkPassFail(File::exists(sidecars[0]) || File::exists(sidecars[1]), false)
+    int scanned = 0;
+    {
+        PageFile clustered(clusteredName, false);
+        checkPassFail(clustered.checksummed() && clustered.compressed(), true)
+    }
+    {
+        FileScan scan(clusteredName, bufMgr);
+        try {
+            RecordId rid;
+            while (1) {
+                scan.scanNext(rid);
+                scanned++;
+            }
+        } catch (const EndOfFileException &e) {
+        }
+    }
+    checkPassFail(scanned, relationSize)
+    File::remove(clusteredName);
+}
+
+/**
+ * Counts the entries of an LSM index inside a range.
+ */
+int lsmScan(LsmIndex &index, int lowVal, Operator lowOp, int highVal, Operator highOp) {
+    int found = 0;
+    try {
+        index.startScan(&lowVal, lowOp, &highVal, highOp);
+    } catch (const NoSuchKeyFoundException &e) {
+        return 0;
+    }
+    try {
+        RecordId outRid;
+        while (1) {
+            index.scanNext(outRid);
+            found++;
+        }
+    } catch (const IndexScanCompletedException &e) {
+    }
+    index.endScan();
+    return found;
+}
+
+/**
+ * Collects the key and record id of every record of the relation, in file order.
+ */
+void relationEntries(std::vector<int> &keys, std::vector<RecordId> &rids) {
+    FileScan fscan(relationName, bufMgr);
+    try {
+        RecordId scanRid;
+        while (1) {
+            fscan.scanNext(scanRid);
+            int key;
+            memcpy(&key, fscan.attribute(offsetof(RECORD, i), sizeof(int)), sizeof(int));
+            keys.push_back(key);
+            rids.push_back(scanRid);
+        }
+    } catch (const EndOfFileException &e) {
+    }
+}
+
+/**
+ * Copies a file byte for byte.
+ */
+void copyFile(const std::string &from, const std::string &to) {
+    std::ifstream in(from.c_str(), std::ios::binary);
+    std::ofstream out(to.c_str(), std::ios::binary | std::ios::trunc);
+    out << in.rdbuf();
+}
+
+/**
+ * Returns the number of pages in an index file.
+ */
+int indexFilePages(const std::string &indexName) {
+    std::ifstream indexFile(indexName.c_str(), std::ios::binary | std::ios::ate);
+    return (int)(indexFile.tellg() / Page::SIZE);
+}
+
+/**
+ * Inserts the index entry of every record whose key is in [lowVal, highVal), batchSize entries at a time.
+ *
+ * @return  Number of entries inserted
+ */
+int batchInsertIntRange(BTreeIndex *index, int lowVal, int highVal, size_t batchSize) {
+    std::vector<int> keys;
+    std::vector<RecordId> rids;
+    int inserted = 0;
+    FileScan fscan(relationName, bufMgr);
+    try {
+        RecordId scanRid;
+        while (1) {
+            fscan.scanNext(scanRid);
+            int key;
+            memcpy(&key, fscan.attribute(offsetof(RECORD, i), sizeof(int)), sizeof(int));
+            if (key < lowVal || key >= highVal) continue;
+            keys.push_back(key);
+            rids.push_back(scanRid);
+            if (keys.size() == batchSize) {
+                index->insertBatch(keys.data(), rids.data(), keys.size());
+                inserted += keys.size();
+                keys.clear();
+                rids.clear();
+            }
+        }
+    } catch (const EndOfFileException &e) {
+    }
+    index->insertBatch(keys.data(), rids.data(), keys.size());
+    return inserted + keys.size();
+}
+
+/**
+ * Deletes or inserts the index entry of every record whose key is in [lowVal, highVal).
+ *
+ * @return  Number of entries deleted or inserted
+ */
+int changeIntRange(BTreeIndex *index, int lowVal, int highVal, bool remove) {
+    int changed = 0;
+    FileScan fscan(relationName, bufMgr);
+    try {
+        RecordId scanRid;
+        while (1) {
+            fscan.scanNext(scanRid);
+            int key;
+            memcpy(&key, fscan.attribute(offsetof(RECORD, i), sizeof(int)), sizeof(int));
+            if (key < lowVal || key >= highVal) continue;
+            if (!remove) {
+                index->insertEntry(&key, scanRid);
+                changed++;
+            } else if (index->deleteEntry(&key, scanRid)) {
+                changed++;
+            }
+        }
+    } catch (const EndOfFileException &e) {
+    }
+    return changed;
+}
+
+void checkIntScans(BTreeIndex *index) {
+    // run some tests
+    checkPassFail(intScan(index, 25, GT, 40, LT), 14)
+    checkPassFail(intScan(index, 20, GTE, 35, LTE), 16)
+    checkPassFail(intScan(index, -3, GT, 3, LT), 3)
+    checkPassFail(intScan(index, 996, GT, 1001, LT), 4)
+    checkPassFail(intScan(index, 0, GT, 1, LT), 0)
+    checkPassFail(intScan(index, 300, GT, 400, LT), 99)
+    checkPassFail(intScan(index, 3000, GTE, 4000, LT), 1000)
+    checkPassFail(intInterleavedScans(index), 14 + 1000)
+    checkPassFail(intBatchScan(index, 300, GT, 400, LT), 99)
+    checkPassFail(intBatchScan(index, 0, GTE, relationSize, LT), relationSize)
+    checkPassFail(reversedScan(index, 25, GT, 40, LT), 14)
+    checkPassFail(reversedScan(index, 0, GTE, relationSize, LT), relationSize)
+    checkPassFail(optionedScan(index, 300, GT, 400, LT, ScanOptions(SCAN_ASCENDING, 10)), 10)
+    checkPassFail(optionedScan(index, 300, GT, 400, LT, ScanOptions(SCAN_DESCENDING, 10)), 10)
+    checkPassFail(optionedScan(index, 25, GT, 40, LT, ScanOptions(SCAN_ASCENDING, 100)), 14)
+    checkPassFail(optionedScan(index, 0, GTE, relationSize, LT, ScanOptions(SCAN_ASCENDING, 0, true)), relationSize)
+    // the 1666 keys of the relation probed once each, and one of them twice more
+    checkPassFail(intLookupBatch(index), 1666 + 2)
+    checkPassFail(intLookups(index), relationSize)
+}
+
+int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp) {
+    RecordId scanRid;
+    Page *curPage;
+
+    std::cout << "Scan for ";
+    if (lowOp == GT) {
+        std::cout << "(";
+    } else {
+        std::cout << "[";
+    }
     std::cout << lowVal << "," << highVal;
     if (highOp == LT) {
         std::cout << ")";
@@ -364,7 +2357,7 @@ int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator
         try {
             index->scanNext(scanRid);
             bufMgr->readPage(file1, scanRid.page_number, curPage);
-            RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data()));
+            RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->viewRecord(scanRid).data));
             bufMgr->unPinPage(file1, scanRid.page_number, false);
 
             if (numResults < 5) {
@@ -389,6 +2382,200 @@ int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator
     return numResults;
 }
 
+/**
+ * Probes the index with lookupBatch for every third key from just past the end of the relation down to below its
+ * start, then twice for key 42, checking each match against its record.
+ *
+ * @return  Number of matches, or -1 if a match does not hold its probe key
+ */
+int intLookupBatch(BTreeIndex *index) {
+    std::vector<int> probes;
+    for (int key = relationSize + 9; key >= -10; key -= 3) {
+        probes.push_back(key);
+    }
+    probes.push_back(42);
+    probes.push_back(42);
+    std::cout << "Batch lookup of " << probes.size() << " keys" << std::endl;
+
+    int numResults = 0;
+    bool mismatch = false;
+    // records are read after the batch, since the callback runs with index pages latched
+    std::vector<std::pair<size_t, RecordId> > matches;
+    index->lookupBatch(probes.data(), probes.size(),
+                       [&matches](size_t probe, const RecordId &rid) { matches.push_back(std::make_pair(probe, rid)); });
+    for (size_t i = 0; i < matches.size(); i++) {
+        Page *curPage;
+        bufMgr->readPage(file1, matches[i].second.page_number, curPage);
+        RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->viewRecord(matches[i].second).data));
+        bufMgr->unPinPage(file1, matches[i].second.page_number, false);
+        if (myRec.i != probes[matches[i].first]) mismatch = true;
+        numResults++;
+    }
+    std::cout << "Number of results: " << numResults << std::endl;
+    return mismatch ? -1 : numResults;
+}
+
+/**
+ * Looks up every key of the relation, and a key on each side of it, with lookup and contains.
+ *
+ * @return  Number of matches, or -1 if a match does not hold its key or contains disagrees with lookup
+ */
+int intLookups(BTreeIndex *index) {
+    std::cout << "Point lookups of keys -1 to " << relationSize << std::endl;
+    int numResults = 0;
+    for (int key = -1; key <= relationSize; key++) {
+        const std::vector<RecordId> matches = index->lookup(&key);
+        if (index->contains(&key) != !matches.empty()) return -1;
+        for (size_t i = 0; i < matches.size(); i++) {
+            Page *curPage;
+            bufMgr->readPage(file1, matches[i].page_number, curPage);
+            RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->viewRecord(matches[i]).data));
+            bufMgr->unPinPage(file1, matches[i].page_number, false);
+            if (myRec.i != key) return -1;
+        }
+        numResults += matches.size();
+    }
+    std::cout << "Number of results: " << numResults << std::endl;
+    return numResults;
+}
+
+/**
+ * Looks keys up again once their lookups have found the frames of the nodes on the way, which are then read
+ * without going through the buffer manager.
+ *
+ * @return  Number of buffer pool accesses made by the repeated lookups, or -1 if one of them got a wrong answer
+ */
+int optimisticLookups(BTreeIndex *index) {
+    const int keys[3] = {0, relationSize / 2, relationSize - 1};
+    for (int i = 0; i < 3; i++) index->contains(&keys[i]);
+
+    bufMgr->clearBufStats();
+    for (int round = 0; round < 100; round++) {
+        for (int i = 0; i < 3; i++) {
+            if (!index->contains(&keys[i]) || index->lookup(&keys[i]).size() != 1) return -1;
+        }
+    }
+    return bufMgr->getBufStats().accesses;
+}
+
+int intBatchScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp) {
+    // a batch smaller than a leaf, so batches span leaf boundaries
+    RecordId batch[64];
+    Page *curPage;
+
+    std::cout << "Batch scan for " << (lowOp == GT ? "(" : "[") << lowVal << "," << highVal
+              << (highOp == LT ? ")" : "]") << std::endl;
+
+    try {
+        index->startScan(&lowVal, lowOp, &highVal, highOp);
+    } catch (const NoSuchKeyFoundException &e) {
+        std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+        return 0;
+    }
+
+    int numResults = 0;
+    size_t count;
+    while ((count = index->scanNextBatch(batch, 64)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            bufMgr->readPage(file1, batch[i].page_number, curPage);
+            RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->viewRecord(batch[i]).data));
+            bufMgr->unPinPage(file1, batch[i].page_number, false);
+            if (myRec.i < lowVal || myRec.i > highVal) {
+                std::cout << "Key " << myRec.i << " outside the scan range" << std::endl;
+                return -1;
+            }
+        }
+        numResults += count;
+    }
+    index->endScan();
+    std::cout << "Number of results: " << numResults << std::endl;
+
+    return numResults;
+}
+
+/**
+ * Scans a range in descending order and compares the entries with those of an ascending scan.
+ *
+ * @return  Number of entries, or -1 if they are not those of the ascending scan in reverse
+ */
+int reversedScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp) {
+    std::vector<RecordId> ascending, descending;
+    RecordId batch[64];
+    size_t count;
+    try {
+        IndexScanCursor forward = index->openScan(&lowVal, lowOp, &highVal, highOp);
+        while ((count = forward.nextBatch(batch, 64)) > 0) ascending.insert(ascending.end(), batch, batch + count);
+        IndexScanCursor backward = index->openScan(&lowVal, lowOp, &highVal, highOp, false, SCAN_DESCENDING);
+        while ((count = backward.nextBatch(batch, 64)) > 0) descending.insert(descending.end(), batch, batch + count);
+    } catch (const NoSuchKeyFoundException &e) {
+        return 0;
+    }
+    std::reverse(ascending.begin(), ascending.end());
+    return ascending == descending ? (int)descending.size() : -1;
+}
+
+/**
+ * Scans a range with the given options and checks the keys come in scan order, each key once for a distinct scan.
+ *
+ * @return  Number of entries, or -1 if a key is out of order
+ */
+int optionedScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp,
+                 const ScanOptions &options) {
+    int numResults = 0;
+    try {
+        IndexScanCursor cursor = index->openScan(&lowVal, lowOp, &highVal, highOp, true, options);
+        int key, lastKey = 0;
+        RecordId rid;
+        try {
+            while (true) {
+                cursor.nextKeyed(&key, rid);
+                const bool descending = options.order == SCAN_DESCENDING;
+                if (numResults > 0 && (descending ? key > lastKey : key < lastKey)) return -1;
+                if (numResults > 0 && options.distinct && key == lastKey) return -1;
+                lastKey = key;
+                numResults++;
+            }
+        } catch (const IndexScanCompletedException &e) {
+        }
+    } catch (const NoSuchKeyFoundException &e) {
+    }
+    return numResults;
+}
+
+int intInterleavedScans(BTreeIndex *index) {
+    // Two cursors over different ranges, advanced in turn, must not disturb each other
+    int low1 = 25, high1 = 40, low2 = 3000, high2 = 4000;
+    IndexScanCursor first = index->openScan(&low1, GT, &high1, LT);
+    IndexScanCursor second = index->openScan(&low2, GTE, &high2, LT);
+
+    std::cout << "Interleaved scans for (25,40) and [3000,4000)" << std::endl;
+
+    RecordId scanRid;
+    int numResults = 0;
+    bool firstDone = false, secondDone = false;
+    while (!firstDone || !secondDone) {
+        if (!firstDone) {
+            try {
+                first.next(scanRid);
+                numResults++;
+            } catch (const IndexScanCompletedException &e) {
+                firstDone = true;
+            }
+        }
+        if (!secondDone) {
+            try {
+                second.next(scanRid);
+                numResults++;
+            } catch (const IndexScanCompletedException &e) {
+                secondDone = true;
+            }
+        }
+    }
+    std::cout << "Number of results: " << numResults << std::endl;
+
+    return numResults;
+}
+
 // -----------------------------------------------------------------------------
 // errorTests
 // -----------------------------------------------------------------------------
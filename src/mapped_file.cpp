@@ -0,0 +1,77 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checksum.h"
+#include "compressed_pages.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/file_open_exception.h"
+#include "exceptions/invalid_page_exception.h"
+
+namespace badgerdb {
+
+MappedFile::MappedFile(const std::string& name, const bool verifyChecksums) : filename_(name), base_(NULL), size_(0), numPages_(0) {
+    const int fd = ::open(name.c_str(), O_RDONLY);
+    if (fd < 0) throw FileNotFoundException(filename_);
+    // the pages of a compressed file are not where a mapping would look for them
+    if (::access(CompressedPages::filenameOf(name).c_str(), F_OK) == 0) {
+        ::close(fd);
+        throw FileOpenException(filename_);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw FileOpenException(filename_);
+    }
+    size_ = (std::size_t)info.st_size;
+    numPages_ = (PageId)(size_ / Page::SIZE);
+    if (size_ > 0) {
+        void* memory = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED) {
+            ::close(fd);
+            throw FileOpenException(filename_);
+        }
+        base_ = static_cast<const char*>(memory);
+    }
+    // the mapping keeps the file alive on its own
+    ::close(fd);
+    if (verifyChecksums) {
+        try {
+            this->verifyChecksums();
+        } catch (...) {
+            if (base_ != NULL) munmap(const_cast<char*>(base_), size_);
+            throw;
+        }
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (base_ != NULL) munmap(const_cast<char*>(base_), size_);
+}
+
+void MappedFile::verifyChecksums() const {
+    const std::string checksumFile = PageChecksums::filenameOf(filename_);
+    if (::access(checksumFile.c_str(), F_OK) != 0) return;
+    const PageChecksums checksums(filename_, false /* truncate */, false /* writable */);
+    // page 0 is the file header, which is not checksummed
+    for (PageId pageNo = 1; pageNo < numPages_; pageNo++) {
+        checksums.verify(pageNo, crc32c(page(pageNo), Page::SIZE), filename_);
+    }
+}
+
+void MappedFile::throwInvalidPage(const PageId pageNo) const {
+    throw InvalidPageException(pageNo, filename_);
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,83 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief A page file mapped read-only into memory.
+ *
+ * Pages are read straight from the mapping, so they are neither copied into buffer frames nor looked up and
+ * pinned in a buffer manager, and every process mapping the same file shares the operating system's cached
+ * copy. The file is mapped as it is when the object is constructed; pages written to it afterwards may or may
+ * not become visible, and pages added to it do not.
+ */
+class MappedFile {
+   public:
+    /**
+     * Constructor of MappedFile class, maps the file.
+     *
+     * @param name             Name of the file
+     * @param verifyChecksums  True to check every page against the file's PageChecksums, if it has any, as a
+     *                         BlobFile records them; false for a replica whose pages are trusted
+     * @throws  FileNotFoundException  If the file does not exist
+     * @throws  FileOpenException      If the file cannot be mapped, or is compressed
+     * @throws  PageChecksumException  If a page does not match its checksum
+     */
+    explicit MappedFile(const std::string& name, const bool verifyChecksums = true);
+
+    /**
+     * Destructor of MappedFile class, unmaps the file
+     */
+    ~MappedFile();
+
+    /**
+     * Returns a page of the file. The page may not be modified and stays valid until the file is unmapped.
+     *
+     * @param pageNo  Number of the page
+     * @throws  InvalidPageException  If the page lies past the end of the mapping
+     */
+    const Page* page(const PageId pageNo) const {
+        if (pageNo >= numPages_) throwInvalidPage(pageNo);
+        return reinterpret_cast<const Page*>(base_ + (std::size_t)pageNo * Page::SIZE);
+    }
+
+    /**
+     * Returns the number of pages mapped, counting the file header as page 0.
+     */
+    PageId numPages() const { return numPages_; }
+
+    /**
+     * Returns the name of the file.
+     */
+    const std::string& filename() const { return filename_; }
+
+   private:
+    std::string filename_;
+    const char* base_;
+    std::size_t size_;
+    PageId numPages_;
+
+    void throwInvalidPage(const PageId pageNo) const;
+
+    /**
+     * Checks every page of the mapping against the checksum file next to it.
+     */
+    void verifyChecksums() const;
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+}  // namespace badgerdb
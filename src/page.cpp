@@ -7,6 +7,7 @@
 
 #include "page.h"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 
@@ -28,6 +29,8 @@ void Page::initialize() {
     header_.free_space_upper_bound = DATA_SIZE;
     header_.num_slots = 0;
     header_.num_free_slots = 0;
+    header_.record_bytes = 0;
+    header_.padding = 0;
     header_.current_page_number = INVALID_NUMBER;
     header_.next_page_number = INVALID_NUMBER;
     //data_.assign(DATA_SIZE, char());
@@ -45,17 +48,28 @@ RecordId Page::insertRecord(const std::string& record_data) {
 }
 
 std::string Page::getRecord(const RecordId& record_id) const {
+    return viewRecord(record_id).str();
+}
+
+RecordView Page::viewRecord(const RecordId& record_id) const {
     validateRecordId(record_id);
     const PageSlot& slot = getSlot(record_id.slot_number);
-    std::string retStr = std::string(data_, DATA_SIZE).substr(slot.item_offset, slot.item_length);
-
-    return retStr;
+    RecordView view = {data_ + slot.item_offset, slot.item_length};
+    return view;
 }
 
 void Page::updateRecord(const RecordId& record_id,
                         const std::string& record_data) {
     validateRecordId(record_id);
-    const PageSlot* slot = getSlot(record_id.slot_number);
+    PageSlot* slot = getSlot(record_id.slot_number);
+    if (record_data.length() <= slot->item_length) {
+        // the bytes the record shrank by become a hole after it
+        memcpy(data_ + slot->item_offset, record_data.data(), record_data.length());
+        memset(data_ + slot->item_offset + record_data.length(), '\0', slot->item_length - record_data.length());
+        header_.record_bytes -= slot->item_length - record_data.length();
+        slot->item_length = record_data.length();
+        return;
+    }
     const std::size_t free_space_after_delete =
         getFreeSpace() + slot->item_length;
     if (record_data.length() > free_space_after_delete) {
@@ -78,36 +92,15 @@ void Page::deleteRecord(const RecordId& record_id,
     validateRecordId(record_id);
     PageSlot* slot = getSlot(record_id.slot_number);
 
-    for (int i = 0; i < slot->item_length; i++)
-        data_[i + slot->item_offset] = '\0';
+    memset(data_ + slot->item_offset, '\0', slot->item_length);
 
-    //data_.replace(slot->item_offset, slot->item_length, slot->item_length, '\0');
-
-    // Compact the data by removing the hole left by this record (if necessary).
-    std::uint16_t move_offset = slot->item_offset;
-    std::size_t move_bytes = 0;
-    for (SlotId i = 1; i <= header_.num_slots; ++i) {
-        PageSlot* other_slot = getSlot(i);
-        if (other_slot->used && other_slot->item_offset < slot->item_offset) {
-            if (other_slot->item_offset < move_offset) {
-                move_offset = other_slot->item_offset;
-            }
-            move_bytes += other_slot->item_length;
-            // Update the slot for the other data to reflect the soon-to-be-new
-            // location.
-            other_slot->item_offset += slot->item_length;
-        }
+    // The record's bytes stay a hole until an insert needs them, unless it is
+    // the record nearest the slot array, whose bytes join the free space.
+    if (slot->item_offset == header_.free_space_upper_bound) {
+        header_.free_space_upper_bound += slot->item_length;
     }
-    // If we have data to move, shift it to the right.
-    if (move_bytes > 0) {
-        const std::string& data_to_move = std::string(data_, DATA_SIZE).substr(move_offset, move_bytes);
 
-        for (std::uint16_t i = 0; i < move_bytes; i++)
-            data_[i + move_offset + slot->item_length] = data_to_move[i];
-
-        //data_.replace(move_offset + slot->item_length, move_bytes, data_to_move);
-    }
-    header_.free_space_upper_bound += slot->item_length;
+    header_.record_bytes -= slot->item_length;
 
     // Mark slot as unused.
     slot->used = false;
@@ -141,7 +134,33 @@ bool Page::hasSpaceForRecord(const std::string& record_data) const {
     if (header_.num_free_slots == 0) {
         record_size += sizeof(PageSlot);
     }
-    return record_size <= getFreeSpace();
+    // holes only need counting if the contiguous space is too small
+    return record_size <= getContiguousFreeSpace() || record_size <= getFreeSpace();
+}
+
+void Page::compact() {
+    SlotId order[DATA_SIZE / sizeof(PageSlot)];
+    SlotId used = 0;
+    for (SlotId i = 1; i <= header_.num_slots; ++i) {
+        if (getSlot(i)->used) order[used++] = i;
+    }
+    // Taking the records furthest from the slot array first, each moves
+    // towards the end of the page only over bytes already moved out of the
+    // way.
+    std::sort(order, order + used,
+              [this](const SlotId a, const SlotId b) { return getSlot(a)->item_offset > getSlot(b)->item_offset; });
+    std::uint16_t upper_bound = DATA_SIZE;
+    for (SlotId i = 0; i < used; ++i) {
+        PageSlot* slot = getSlot(order[i]);
+        upper_bound -= slot->item_length;
+        if (slot->item_offset != upper_bound) {
+            memmove(data_ + upper_bound, data_ + slot->item_offset, slot->item_length);
+            slot->item_offset = upper_bound;
+        }
+    }
+    // free space is kept zeroed
+    memset(data_ + header_.free_space_upper_bound, '\0', upper_bound - header_.free_space_upper_bound);
+    header_.free_space_upper_bound = upper_bound;
 }
 
 PageSlot* Page::getSlot(const SlotId slot_number) {
@@ -166,7 +185,9 @@ SlotId Page::getAvailableSlot() {
             }
         }
     } else {
-        // Have to allocate a new slot.
+        // Have to allocate a new slot, after making room for it if holes
+        // hold the free space.
+        if (getContiguousFreeSpace() < sizeof(PageSlot)) compact();
         slot_number = header_.num_slots + 1;
         ++header_.num_slots;
         ++header_.num_free_slots;
@@ -187,16 +208,15 @@ void Page::insertRecordInSlot(const SlotId slot_number,
         throw SlotInUseException(page_number(), slot_number);
     }
     const int record_length = record_data.length();
+    if (record_length > getContiguousFreeSpace()) compact();
     slot->used = true;
     slot->item_length = record_length;
     slot->item_offset = header_.free_space_upper_bound - record_length;
     header_.free_space_upper_bound = slot->item_offset;
+    header_.record_bytes += record_length;
     --header_.num_free_slots;
 
-    for (int i = 0; i < slot->item_length; i++)
-        data_[i + slot->item_offset] = record_data[i];
-
-    //data_.replace(slot->item_offset, slot->item_length, record_data);
+    memcpy(data_ + slot->item_offset, record_data.data(), slot->item_length);
 }
 
 void Page::validateRecordId(const RecordId& record_id) const {
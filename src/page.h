@@ -49,6 +49,17 @@ struct PageHeader {
    */
     SlotId num_free_slots;
 
+    /**
+   * Bytes held by the records in use, kept up to date as records come and go
+   * so that the free space is known without walking the slot array.
+   */
+    std::uint16_t record_bytes;
+
+    /**
+   * Unused; kept zero, so that no byte of the header is left uninitialized.
+   */
+    std::uint16_t padding;
+
     /**
    * Number of the page within the file.
    */
@@ -94,6 +105,29 @@ struct PageSlot {
     std::uint16_t item_length;
 };
 
+/**
+ * @brief Read-only view of the bytes of a record in a page.
+ *
+ * The view points into the page, so it is only valid while the page stays in
+ * memory (pinned, for a page in the buffer pool) and the record is not changed.
+ */
+struct RecordView {
+    /**
+   * First byte of the record.
+   */
+    const char* data;
+
+    /**
+   * Length of the record in bytes.
+   */
+    std::size_t length;
+
+    /**
+   * Returns a copy of the record.
+   */
+    std::string str() const { return std::string(data, length); }
+};
+
 class PageIterator;
 
 /**
@@ -129,6 +163,13 @@ class Page {
    */
     static const SlotId INVALID_SLOT = 0;
 
+    /**
+   * Layout of the page header and slot array, recorded in the header of each
+   * PageFile and checked when the file is opened.  Files written before the
+   * page header counted the bytes of its records record 0.
+   */
+    static const std::uint32_t FORMAT = 1;
+
     /**
    * Constructs a new, uninitialized page.
    */
@@ -152,10 +193,21 @@ class Page {
    */
     std::string getRecord(const RecordId& record_id) const;
 
+    /**
+   * Returns a view of the record with the given ID in place, without copying
+   * it.
+   *
+   * @see RecordView
+   * @param record_id  ID of the record to view.
+   * @return  View of the record.
+   */
+    RecordView viewRecord(const RecordId& record_id) const;
+
     /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
-   * new one, with the exception that the record ID will not change.
+   * new one, with the exception that the record ID will not change.  A record
+   * that does not grow is rewritten where it is.
    *
    * @param record_id   ID of record to update.
    * @param record_data Updated bytes that compose the record.
@@ -163,9 +215,10 @@ class Page {
     void updateRecord(const RecordId& record_id, const std::string& record_data);
 
     /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array.
+   * Deletes the record with the given ID.  Its bytes are left as a hole that
+   * the page is compacted over once an insert needs the space, so deletes
+   * move no other record.  Slot array is compacted if the slot deleted is at
+   * the end of the slot array.
    *
    * @param record_id   ID of the record to delete.
    */
@@ -180,12 +233,15 @@ class Page {
     bool hasSpaceForRecord(const std::string& record_data) const;
 
     /**
-   * Returns this page's free space in bytes.
+   * Returns this page's free space in bytes, counting the holes deleted and
+   * shrunk records left between the others as well as the space between the
+   * slot array and the records.
    *
    * @return  Free space in bytes.
    */
-    std::uint16_t getFreeSpace() const { return header_.free_space_upper_bound -
-                                                header_.free_space_lower_bound; }
+    std::uint16_t getFreeSpace() const {
+        return DATA_SIZE - header_.free_space_lower_bound - header_.record_bytes;
+    }
 
     /**
    * Returns this page's number in its file.
@@ -305,6 +361,22 @@ class Page {
     void insertRecordInSlot(const SlotId slot_number,
                             const std::string& record_data);
 
+    /**
+   * Returns the free space between the slot array and the records, which
+   * records and slots are added in.
+   *
+   * @return  Contiguous free space in bytes.
+   */
+    std::uint16_t getContiguousFreeSpace() const {
+        return header_.free_space_upper_bound - header_.free_space_lower_bound;
+    }
+
+    /**
+   * Slides every record towards the end of the page, keeping their order, so
+   * that all free space is contiguous.  Slots keep their records.
+   */
+    void compact();
+
     /**
    * Throws an exception if the given record ID is not valid for this page
    * (i.e., it has the right page number and the slot it references is in use).
@@ -0,0 +1,197 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "replacement.h"
+
+#include <algorithm>
+
+namespace badgerdb {
+
+ReplacementPolicy* ReplacementPolicy::create(const ReplacementPolicyKind kind, const FrameId firstFrame,
+                                             const std::uint32_t numFrames) {
+    switch (kind) {
+        case POLICY_2Q:
+            return new TwoQPolicy(firstFrame, numFrames);
+        case POLICY_CLOCK:
+        default:
+            return new ClockPolicy(firstFrame, numFrames);
+    }
+}
+
+//----------------------------------------
+// ClockPolicy
+//----------------------------------------
+
+ClockPolicy::ClockPolicy(const FrameId first, const std::uint32_t count)
+    : firstFrame(first), numFrames(count), hand(count - 1), inUse(count, 0), refbits(count, 0) {
+}
+
+void ClockPolicy::admit(const FrameId frame, const File* file, const PageId pageNo, const bool referenced) {
+    inUse[frame - firstFrame] = 1;
+    refbits[frame - firstFrame] = referenced;
+}
+
+void ClockPolicy::touch(const FrameId frame) {
+    refbits[frame - firstFrame] = 1;
+}
+
+void ClockPolicy::remove(const FrameId frame) {
+    inUse[frame - firstFrame] = 0;
+    refbits[frame - firstFrame] = 0;
+}
+
+bool ClockPolicy::victim(const EvictableTest& evictable, FrameId& frame) {
+    // two sweeps: the first may only clear reference bits
+    for (std::uint32_t scanned = 0; scanned < 2 * numFrames; scanned++) {
+        hand = hand + 1 == numFrames ? 0 : hand + 1;
+        if (!inUse[hand]) continue;
+
+        if (refbits[hand]) {
+            refbits[hand] = 0;
+        } else if (evictable(firstFrame + hand)) {
+            inUse[hand] = 0;
+            frame = firstFrame + hand;
+            sweepLength = scanned + 1;
+            return true;
+        }
+    }
+    sweepLength = 2 * numFrames;
+    return false;
+}
+
+void ClockPolicy::upcomingVictims(const EvictableTest& test, const std::uint32_t max,
+                                  std::vector<FrameId>& frames) const {
+    // the hand takes the unreferenced frames on its first sweep and the others on the second
+    const size_t limit = frames.size() + max;
+    for (int referencedPass = 0; referencedPass < 2; referencedPass++) {
+        std::uint32_t position = hand;
+        for (std::uint32_t scanned = 0; scanned < numFrames && frames.size() < limit; scanned++) {
+            position = position + 1 == numFrames ? 0 : position + 1;
+            if (inUse[position] && refbits[position] == referencedPass && test(firstFrame + position))
+                frames.push_back(firstFrame + position);
+        }
+    }
+}
+
+bool ClockPolicy::referenced(const FrameId frame) const {
+    return refbits[frame - firstFrame];
+}
+
+//----------------------------------------
+// TwoQPolicy
+//----------------------------------------
+
+TwoQPolicy::TwoQPolicy(const FrameId first, const std::uint32_t count)
+    : firstFrame(first),
+      maxA1in(std::max(count / 4, (std::uint32_t)1)),
+      maxA1out(std::max(count / 2, (std::uint32_t)1)),
+      queueOf(count, QUEUE_NONE),
+      position(count),
+      keyOf(count),
+      unreferenced(count, 0) {
+}
+
+void TwoQPolicy::admit(const FrameId frame, const File* file, const PageId pageNo, const bool referenced) {
+    const std::uint32_t index = frame - firstFrame;
+    keyOf[index] = PageKey(file, pageNo);
+    unreferenced[index] = !referenced;
+
+    std::map<PageKey, std::list<PageKey>::iterator>::iterator ghost = a1outIndex.find(keyOf[index]);
+    if (ghost != a1outIndex.end()) {
+        // read again soon after leaving A1in, so it is worth keeping
+        a1out.erase(ghost->second);
+        a1outIndex.erase(ghost);
+        am.push_front(frame);
+        position[index] = am.begin();
+        queueOf[index] = QUEUE_AM;
+    } else if (referenced) {
+        a1in.push_front(frame);
+        position[index] = a1in.begin();
+        queueOf[index] = QUEUE_A1IN;
+    } else {
+        // a prefetched page is the next to go unless it is read
+        a1in.push_back(frame);
+        position[index] = std::prev(a1in.end());
+        queueOf[index] = QUEUE_A1IN;
+    }
+}
+
+void TwoQPolicy::touch(const FrameId frame) {
+    const std::uint32_t index = frame - firstFrame;
+    if (queueOf[index] == QUEUE_AM) {
+        am.splice(am.begin(), am, position[index]);
+    } else if (queueOf[index] == QUEUE_A1IN && unreferenced[index]) {
+        // the first read of a prefetched page counts as its admission
+        a1in.splice(a1in.begin(), a1in, position[index]);
+        unreferenced[index] = 0;
+    }
+}
+
+void TwoQPolicy::remove(const FrameId frame) {
+    const std::uint32_t index = frame - firstFrame;
+    if (queueOf[index] == QUEUE_AM)
+        am.erase(position[index]);
+    else if (queueOf[index] == QUEUE_A1IN)
+        a1in.erase(position[index]);
+    queueOf[index] = QUEUE_NONE;
+}
+
+bool TwoQPolicy::victim(const EvictableTest& evictable, FrameId& frame) {
+    sweepLength = 0;
+    if (a1in.size() > maxA1in || am.empty())
+        return evictFrom(a1in, evictable, frame) || evictFrom(am, evictable, frame);
+    return evictFrom(am, evictable, frame) || evictFrom(a1in, evictable, frame);
+}
+
+void TwoQPolicy::upcomingVictims(const EvictableTest& test, const std::uint32_t max,
+                                 std::vector<FrameId>& frames) const {
+    const size_t limit = frames.size() + max;
+    const bool a1inFirst = a1in.size() > maxA1in || am.empty();
+    listOldest(a1inFirst ? a1in : am, test, limit, frames);
+    listOldest(a1inFirst ? am : a1in, test, limit, frames);
+}
+
+void TwoQPolicy::listOldest(const std::list<FrameId>& queue, const EvictableTest& test, const std::uint32_t limit,
+                            std::vector<FrameId>& frames) {
+    for (std::list<FrameId>::const_reverse_iterator iter = queue.rbegin(); iter != queue.rend(); ++iter) {
+        if (frames.size() >= limit) return;
+        if (test(*iter)) frames.push_back(*iter);
+    }
+}
+
+bool TwoQPolicy::referenced(const FrameId frame) const {
+    const std::uint32_t index = frame - firstFrame;
+    return queueOf[index] == QUEUE_AM || (queueOf[index] == QUEUE_A1IN && !unreferenced[index]);
+}
+
+bool TwoQPolicy::evictFrom(std::list<FrameId>& queue, const EvictableTest& evictable, FrameId& frame) {
+    for (std::list<FrameId>::iterator iter = queue.end(); iter != queue.begin();) {
+        --iter;
+        sweepLength++;
+        if (!evictable(*iter)) continue;
+
+        frame = *iter;
+        const std::uint32_t index = frame - firstFrame;
+        if (queueOf[index] == QUEUE_A1IN) remember(keyOf[index]);
+        queue.erase(iter);
+        queueOf[index] = QUEUE_NONE;
+        return true;
+    }
+    return false;
+}
+
+void TwoQPolicy::remember(const PageKey& key) {
+    if (a1outIndex.count(key)) return;
+    a1out.push_front(key);
+    a1outIndex[key] = a1out.begin();
+    if (a1out.size() > maxA1out) {
+        a1outIndex.erase(a1out.back());
+        a1out.pop_back();
+    }
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,258 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "file.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief How a page is being accessed, passed to the buffer manager with each read.
+ */
+enum AccessHint {
+    /**
+     * The page may be used again soon
+     */
+    ACCESS_NORMAL,
+
+    /**
+     * The page is read once by a sequential scan; such pages cycle through a small ring of frames instead of
+     * displacing the rest of the pool
+     */
+    ACCESS_SCAN
+};
+
+/**
+ * @brief Replacement policies BufMgr can be built with.
+ */
+enum ReplacementPolicyKind {
+    /**
+     * CLOCK with one reference bit per frame
+     */
+    POLICY_CLOCK,
+
+    /**
+     * 2Q: pages referenced once wait in a FIFO queue and only pages referenced again enter the LRU main queue
+     */
+    POLICY_2Q
+};
+
+/**
+ * @brief Decides which frame of a buffer partition to evict.
+ *
+ * A policy tracks the frames that hold pages, from admit until they are chosen as victim or removed. Empty
+ * frames are handed out by the buffer manager itself and never reach the policy. All calls are made with the
+ * partition lock held.
+ */
+class ReplacementPolicy {
+   public:
+    /**
+     * Returns true if a frame may be evicted, that is, it is not pinned
+     */
+    typedef std::function<bool(FrameId)> EvictableTest;
+
+    virtual ~ReplacementPolicy() {}
+
+    /**
+     * Creates a policy for the frames [firstFrame, firstFrame + numFrames).
+     *
+     * @param kind        Policy to create
+     * @param firstFrame  First frame of the partition
+     * @param numFrames   Number of frames in the partition
+     */
+    static ReplacementPolicy* create(const ReplacementPolicyKind kind, const FrameId firstFrame,
+                                     const std::uint32_t numFrames);
+
+    /**
+     * A page has been loaded into a frame.
+     *
+     * @param frame       Frame holding the page
+     * @param file        File of the page
+     * @param pageNo      Number of the page
+     * @param referenced  False for prefetched pages, which should go first if they are never used
+     */
+    virtual void admit(const FrameId frame, const File* file, const PageId pageNo, const bool referenced) = 0;
+
+    /**
+     * The page in a frame has been read again.
+     */
+    virtual void touch(const FrameId frame) = 0;
+
+    /**
+     * The page in a frame has been dropped without being chosen as victim.
+     */
+    virtual void remove(const FrameId frame) = 0;
+
+    /**
+     * Chooses a frame to evict among those that pass the test and stops tracking it.
+     *
+     * @param evictable  Test for frames that may be evicted
+     * @param frame      Set to the chosen frame
+     * @return  False if no tracked frame may be evicted
+     */
+    virtual bool victim(const EvictableTest& evictable, FrameId& frame) = 0;
+
+    /**
+     * Lists the frames that pass the test in the order the policy would evict them if nothing changed, so
+     * that they can be cleaned before they are needed. Nothing is changed.
+     *
+     * @param test    Test for frames to list
+     * @param max     Largest number of frames to list
+     * @param frames  The frames are appended here
+     */
+    virtual void upcomingVictims(const EvictableTest& test, const std::uint32_t max,
+                                 std::vector<FrameId>& frames) const = 0;
+
+    /**
+     * Returns true if the policy currently considers the frame recently used, for diagnostics.
+     */
+    virtual bool referenced(const FrameId frame) const = 0;
+
+    /**
+     * Returns the number of frames the last call to victim stepped over, the one it chose included, for the
+     * buffer pool's metrics.
+     */
+    std::uint32_t lastSweepLength() const { return sweepLength; }
+
+   protected:
+    ReplacementPolicy() : sweepLength(0) {}
+
+    /**
+     * Frames the last call to victim stepped over
+     */
+    std::uint32_t sweepLength;
+};
+
+/**
+ * @brief CLOCK: the hand sweeps the frames, clearing reference bits, and evicts the first unpinned frame whose
+ * bit is already clear.
+ */
+class ClockPolicy : public ReplacementPolicy {
+   public:
+    ClockPolicy(const FrameId firstFrame, const std::uint32_t numFrames);
+
+    void admit(const FrameId frame, const File* file, const PageId pageNo, const bool referenced) override;
+    void touch(const FrameId frame) override;
+    void remove(const FrameId frame) override;
+    bool victim(const EvictableTest& evictable, FrameId& frame) override;
+    void upcomingVictims(const EvictableTest& test, const std::uint32_t max,
+                         std::vector<FrameId>& frames) const override;
+    bool referenced(const FrameId frame) const override;
+
+   private:
+    FrameId firstFrame;
+    std::uint32_t numFrames;
+
+    /**
+     * Current position of the hand, relative to firstFrame
+     */
+    std::uint32_t hand;
+
+    /**
+     * Per frame: true if it holds a page the policy tracks
+     */
+    std::vector<char> inUse;
+
+    /**
+     * Per frame: the reference bit
+     */
+    std::vector<char> refbits;
+};
+
+/**
+ * @brief Simplified 2Q (Johnson and Shasha). A page read for the first time enters the FIFO queue A1in. If it is
+ * evicted from there its key is remembered in the ghost queue A1out, and a page found in A1out when it is read
+ * again goes straight to the LRU queue Am. A1in is kept to a quarter of the frames, so a burst of pages read
+ * once cannot push the pages of Am out.
+ */
+class TwoQPolicy : public ReplacementPolicy {
+   public:
+    TwoQPolicy(const FrameId firstFrame, const std::uint32_t numFrames);
+
+    void admit(const FrameId frame, const File* file, const PageId pageNo, const bool referenced) override;
+    void touch(const FrameId frame) override;
+    void remove(const FrameId frame) override;
+    bool victim(const EvictableTest& evictable, FrameId& frame) override;
+    void upcomingVictims(const EvictableTest& test, const std::uint32_t max,
+                         std::vector<FrameId>& frames) const override;
+    bool referenced(const FrameId frame) const override;
+
+   private:
+    typedef std::pair<const File*, PageId> PageKey;
+
+    /**
+     * Queue a frame is in
+     */
+    enum Queue { QUEUE_NONE, QUEUE_A1IN, QUEUE_AM };
+
+    FrameId firstFrame;
+
+    /**
+     * Target size of A1in
+     */
+    std::uint32_t maxA1in;
+
+    /**
+     * Largest number of keys remembered in A1out
+     */
+    std::uint32_t maxA1out;
+
+    /**
+     * Frames read once, newest at the front
+     */
+    std::list<FrameId> a1in;
+
+    /**
+     * Frames read more than once, most recently used at the front
+     */
+    std::list<FrameId> am;
+
+    /**
+     * Keys of pages recently evicted from A1in, newest at the front, and their positions
+     */
+    std::list<PageKey> a1out;
+    std::map<PageKey, std::list<PageKey>::iterator> a1outIndex;
+
+    /**
+     * Per frame: queue, position in it, and the key of its page
+     */
+    std::vector<Queue> queueOf;
+    std::vector<std::list<FrameId>::iterator> position;
+    std::vector<PageKey> keyOf;
+
+    /**
+     * Per frame: true if it was prefetched and has not been read since
+     */
+    std::vector<char> unreferenced;
+
+    /**
+     * Evicts the oldest evictable frame of a queue.
+     */
+    bool evictFrom(std::list<FrameId>& queue, const EvictableTest& evictable, FrameId& frame);
+
+    /**
+     * Remembers the key of a page evicted from A1in.
+     */
+    void remember(const PageKey& key);
+
+    /**
+     * Appends the frames of a queue that pass the test, oldest first, until frames holds limit entries.
+     */
+    static void listOldest(const std::list<FrameId>& queue, const EvictableTest& test, const std::uint32_t limit,
+                           std::vector<FrameId>& frames);
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,33 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "slab.h"
+
+namespace badgerdb {
+
+Slab::Slab() : next_(NULL), end_(NULL) {
+    for (std::size_t i = 0; i < MAX_BLOCK / GRAIN; i++) free_[i] = NULL;
+}
+
+Slab::~Slab() {
+    for (std::size_t i = 0; i < slabs_.size(); i++) ::operator delete(slabs_[i]);
+}
+
+void* Slab::carve(const std::size_t bytes) {
+    const std::size_t size = (sizeClass(bytes) + 1) * GRAIN;
+    // the end of a slab too short for the block is left unused
+    if (next_ == NULL || (std::size_t)(end_ - next_) < size) {
+        next_ = static_cast<char*>(::operator new(SLAB_BYTES));
+        end_ = next_ + SLAB_BYTES;
+        slabs_.push_back(next_);
+    }
+    void* block = next_;
+    next_ += size;
+    return block;
+}
+
+}  // namespace badgerdb
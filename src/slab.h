@@ -0,0 +1,144 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace badgerdb {
+
+/**
+ * @brief Small blocks of memory carved out of large slabs and recycled through a free list per size.
+ *
+ * Blocks are sized in GRAIN-byte steps up to MAX_BLOCK bytes; larger requests go to operator new. A block
+ * released goes to the free list of its size and is handed out again before the current slab is carved
+ * further, so containers that insert and erase all the time stop allocating once they have grown. Slabs are
+ * freed with the Slab. Not threadsafe: BufMgr keeps one per partition, used under the partition lock.
+ */
+class Slab {
+   public:
+    /**
+     * Step block sizes are rounded up to, which is also the alignment of every block
+     */
+    static const std::size_t GRAIN = 16;
+
+    /**
+     * Largest block carved out of a slab
+     */
+    static const std::size_t MAX_BLOCK = 256;
+
+    /**
+     * Bytes of each slab
+     */
+    static const std::size_t SLAB_BYTES = 64 * 1024;
+
+    Slab();
+
+    ~Slab();
+
+    /**
+     * Returns a block of at least bytes bytes.
+     */
+    void* allocate(const std::size_t bytes) {
+        if (bytes > MAX_BLOCK) return ::operator new(bytes);
+        Block*& head = free_[sizeClass(bytes)];
+        if (head == NULL) return carve(bytes);
+        Block* block = head;
+        head = block->next;
+        return block;
+    }
+
+    /**
+     * Takes back a block allocate returned for the same number of bytes.
+     */
+    void release(void* memory, const std::size_t bytes) {
+        if (bytes > MAX_BLOCK) {
+            ::operator delete(memory);
+            return;
+        }
+        Block* block = static_cast<Block*>(memory);
+        Block*& head = free_[sizeClass(bytes)];
+        block->next = head;
+        head = block;
+    }
+
+    /**
+     * Returns the bytes of the slabs carved so far.
+     */
+    std::size_t reservedBytes() const { return slabs_.size() * SLAB_BYTES; }
+
+   private:
+    struct Block {
+        Block* next;
+    };
+
+    /**
+     * Free blocks of each size class
+     */
+    Block* free_[MAX_BLOCK / GRAIN];
+
+    std::vector<char*> slabs_;
+
+    /**
+     * Part of the newest slab not carved yet, shared by every size class
+     */
+    char* next_;
+    char* end_;
+
+    static std::size_t sizeClass(const std::size_t bytes) { return bytes == 0 ? 0 : (bytes - 1) / GRAIN; }
+
+    /**
+     * Carves a new block out of the newest slab, starting a slab if that one has no room left.
+     */
+    void* carve(const std::size_t bytes);
+
+    Slab(const Slab&);
+    Slab& operator=(const Slab&);
+};
+
+/**
+ * @brief Allocator for standard containers that takes single elements, such as the nodes of a hash table, from a
+ * Slab, and arrays, such as its buckets, from operator new. Without a Slab it allocates everything with operator
+ * new.
+ */
+template <class T>
+struct SlabAllocator {
+    typedef T value_type;
+
+    Slab* slab;
+
+    explicit SlabAllocator(Slab* slab = NULL) : slab(slab) {}
+
+    template <class U>
+    SlabAllocator(const SlabAllocator<U>& other) : slab(other.slab) {}
+
+    T* allocate(const std::size_t n) {
+        if (slab != NULL && n == 1) return static_cast<T*>(slab->allocate(sizeof(T)));
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* memory, const std::size_t n) {
+        if (slab != NULL && n == 1)
+            slab->release(memory, sizeof(T));
+        else
+            ::operator delete(memory);
+    }
+
+    template <class U>
+    bool operator==(const SlabAllocator<U>& other) const {
+        return slab == other.slab;
+    }
+
+    template <class U>
+    bool operator!=(const SlabAllocator<U>& other) const {
+        return slab != other.slab;
+    }
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,117 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "trace.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace badgerdb {
+
+/**
+ * @brief One span as a ring holds it.
+ */
+struct SpanEvent {
+    const char* name;
+    std::uint64_t begin;
+    std::uint64_t end;
+    std::uint64_t arg;
+};
+
+/**
+ * @brief Spans of one thread, written only by that thread. head counts every span ever recorded; the last
+ * SPAN_RING_EVENTS of them are in events, span i at i modulo the size.
+ */
+struct SpanRing {
+    std::atomic<std::uint64_t> head;
+    std::unique_ptr<SpanEvent[]> events;
+    int thread;
+
+    explicit SpanRing(const int thread) : head(0), events(new SpanEvent[SPAN_RING_EVENTS]), thread(thread) {}
+};
+
+/**
+ * @brief Every ring registered, kept after its thread exits so that its spans can still be dumped, and the
+ * clock reading the trace's timestamps count from.
+ */
+struct SpanRegistry {
+    std::mutex lock;
+    std::vector<std::shared_ptr<SpanRing> > rings;
+    std::uint64_t startTicks;
+    std::chrono::steady_clock::time_point startTime;
+
+    SpanRegistry() : startTicks(spanClock()), startTime(std::chrono::steady_clock::now()) {}
+};
+
+static SpanRegistry& registry() {
+    static SpanRegistry spans;
+    return spans;
+}
+
+static SpanRing& threadRing() {
+    static thread_local std::shared_ptr<SpanRing> ring;
+    if (!ring) {
+        SpanRegistry& spans = registry();
+        std::lock_guard<std::mutex> guard(spans.lock);
+        ring.reset(new SpanRing((int)spans.rings.size() + 1));
+        spans.rings.push_back(ring);
+    }
+    return *ring;
+}
+
+void recordSpan(const char* name, const std::uint64_t begin, const std::uint64_t end, const std::uint64_t arg) {
+    SpanRing& ring = threadRing();
+    const std::uint64_t at = ring.head.load(std::memory_order_relaxed);
+    SpanEvent& event = ring.events[at % SPAN_RING_EVENTS];
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+    event.arg = arg;
+    // a dump that sees the new head sees the span too
+    ring.head.store(at + 1, std::memory_order_release);
+}
+
+std::size_t dumpSpans(std::ostream& out) {
+    SpanRegistry& spans = registry();
+    std::lock_guard<std::mutex> guard(spans.lock);
+    // ticks run at a rate only known by timing them against a clock that counts time
+    const std::uint64_t ticks = spanClock() - spans.startTicks;
+    const double nanos =
+        std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - spans.startTime).count();
+    const double microsPerTick = ticks == 0 ? 0 : nanos / ticks / 1000;
+
+    std::size_t written = 0;
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    for (std::size_t r = 0; r < spans.rings.size(); r++) {
+        const SpanRing& ring = *spans.rings[r];
+        const std::uint64_t head = ring.head.load(std::memory_order_acquire);
+        const std::uint64_t first = head > SPAN_RING_EVENTS ? head - SPAN_RING_EVENTS : 0;
+        for (std::uint64_t i = first; i < head; i++) {
+            const SpanEvent& event = ring.events[i % SPAN_RING_EVENTS];
+            // a span begun before the registry's clock reading or torn by a concurrent write has nowhere to go
+            if (event.begin < spans.startTicks || event.end < event.begin) continue;
+            out << (written == 0 ? "\n" : ",\n") << "{\"name\": \"" << event.name
+                << "\", \"cat\": \"badgerdb\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << ring.thread
+                << ", \"ts\": " << (event.begin - spans.startTicks) * microsPerTick
+                << ", \"dur\": " << (event.end - event.begin) * microsPerTick << ", \"args\": {\"arg\": " << event.arg
+                << "}}";
+            written++;
+        }
+    }
+    out << "\n]}" << std::endl;
+    return written;
+}
+
+void clearSpans() {
+    SpanRegistry& spans = registry();
+    std::lock_guard<std::mutex> guard(spans.lock);
+    for (std::size_t r = 0; r < spans.rings.size(); r++) spans.rings[r]->head.store(0, std::memory_order_relaxed);
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,146 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @brief Compile-time tracing switch.
+ *
+ * Tracing output is selected with BADGERDB_TRACE_LEVEL, which the Makefile sets from its TRACE variable
+ * (e.g. "make TRACE=2"). At the default level of 0 every trace statement is dead code: its message is
+ * never evaluated and the compiler removes it, so traced hot paths cost nothing.
+ *
+ * Levels:
+ *   BADGERDB_TRACE_LEVEL_INFO  (1)  structural events such as node splits and new roots
+ *   BADGERDB_TRACE_LEVEL_DEBUG (2)  per-call detail on inserts, searches and scans
+ */
+#ifndef BADGERDB_TRACE_LEVEL
+#define BADGERDB_TRACE_LEVEL 0
+#endif
+
+#define BADGERDB_TRACE_LEVEL_INFO 1
+#define BADGERDB_TRACE_LEVEL_DEBUG 2
+
+/**
+ * True if trace statements of the given level are compiled in.
+ */
+#define BADGERDB_TRACE_ON(level) (BADGERDB_TRACE_LEVEL >= (level))
+
+/**
+ * Writes msg, a sequence of values joined with <<, to std::cerr if the given level is compiled in.
+ */
+#define BADGERDB_TRACE(level, msg)                    \
+    do {                                              \
+        if (BADGERDB_TRACE_ON(level)) {               \
+            std::cerr << msg << std::endl;            \
+        }                                             \
+    } while (0)
+
+#define BADGERDB_TRACE_INFO(msg) BADGERDB_TRACE(BADGERDB_TRACE_LEVEL_INFO, msg)
+#define BADGERDB_TRACE_DEBUG(msg) BADGERDB_TRACE(BADGERDB_TRACE_LEVEL_DEBUG, msg)
+
+/**
+ * @brief Compile-time switch for span tracing.
+ *
+ * With BADGERDB_TRACE_SPANS set to 1, which the Makefile does for "make SPANS=1", every BADGERDB_SPAN statement
+ * records the time its scope was entered and left into a ring buffer of the calling thread, and dumpSpans writes
+ * what the rings hold as a Chrome trace, which chrome://tracing and the Perfetto UI open. A thread only ever
+ * writes its own ring, without locks or shared counters, so tracing disturbs the timing of what it traces far
+ * less than writing out trace messages does. At the default of 0 a span statement is no statement at all and its
+ * argument is never evaluated.
+ */
+#ifndef BADGERDB_TRACE_SPANS
+#define BADGERDB_TRACE_SPANS 0
+#endif
+
+namespace badgerdb {
+
+/**
+ * @brief Number of spans each thread's ring keeps; once it is full the oldest spans are overwritten.
+ */
+const std::size_t SPAN_RING_EVENTS = 1 << 15;
+
+/**
+ * Returns a timestamp in clock ticks: the time stamp counter where there is one, nanoseconds elsewhere.
+ * dumpSpans converts ticks to time by timing the clock against std::chrono::steady_clock.
+ */
+inline std::uint64_t spanClock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+/**
+ * Records a span into the calling thread's ring, registering the ring the first time the thread records one.
+ *
+ * @param name   Name of the span; must outlive every dump, so in practice a string literal
+ * @param begin  spanClock when the span began
+ * @param end    spanClock when it ended
+ * @param arg    Value shown with the span, such as a page number
+ */
+void recordSpan(const char* name, const std::uint64_t begin, const std::uint64_t end, const std::uint64_t arg);
+
+/**
+ * Writes every span the rings of all threads, live or exited, hold as one Chrome trace JSON object, with one
+ * complete event per span, timed in microseconds since the first ring was registered. Spans written into a ring
+ * while it is dumped may come out garbled, so dump once the traced work is done. Without span tracing compiled
+ * in the trace holds no event.
+ *
+ * @param out  Stream to write to
+ * @return     Number of spans written
+ */
+std::size_t dumpSpans(std::ostream& out);
+
+/**
+ * Empties the ring of every thread. Must not be called while any thread records spans.
+ */
+void clearSpans();
+
+#if BADGERDB_TRACE_SPANS
+/**
+ * @brief Records its own lifetime as a span, from construction to destruction.
+ */
+class TraceSpan {
+   public:
+    TraceSpan(const char* name, const std::uint64_t arg) : name(name), arg(arg), begin(spanClock()) {}
+
+    ~TraceSpan() { recordSpan(name, begin, spanClock(), arg); }
+
+   private:
+    const char* name;
+    const std::uint64_t arg;
+    const std::uint64_t begin;
+
+    TraceSpan(const TraceSpan&);
+    TraceSpan& operator=(const TraceSpan&);
+};
+
+#define BADGERDB_SPAN_JOIN2(a, b) a##b
+#define BADGERDB_SPAN_JOIN(a, b) BADGERDB_SPAN_JOIN2(a, b)
+
+/**
+ * Records the rest of the enclosing scope as a span named name, a string literal, showing arg.
+ */
+#define BADGERDB_SPAN(name, arg) ::badgerdb::TraceSpan BADGERDB_SPAN_JOIN(badgerdbSpan, __LINE__)((name), (arg))
+#else
+#define BADGERDB_SPAN(name, arg) \
+    do {                         \
+    } while (0)
+#endif
+
+}  // namespace badgerdb
@@ -64,4 +64,29 @@ struct RecordId {
     }
 };
 
+/**
+ * @brief Datatype enumeration type.
+ */
+enum Datatype {
+    INTEGER = 0,
+    DOUBLE = 1,
+    STRING = 2
+};
+
+/**
+ * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() and to
+ * FileScan predicates.
+ */
+enum Operator {
+    LT,  /* Less Than */
+    LTE, /* Less Than or Equal to */
+    GTE, /* Greater Than or Equal to */
+    GT   /* Greater Than */
+};
+
+/**
+ * @brief Size of String key; STRING attributes compare on their first STRINGSIZE bytes.
+ */
+const int STRINGSIZE = 10;
+
 }  // namespace badgerdb
@@ -0,0 +1,284 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "wal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+
+#include "exceptions/file_open_exception.h"
+#include "exceptions/log_write_exception.h"
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+ * Marks the start of every group in the log.
+ */
+static const std::uint32_t LOG_GROUP_MAGIC = 0x57414c31;
+
+/**
+ * Marks a log file's header.
+ */
+static const std::uint32_t LOG_FILE_MAGIC = 0x57414c48;
+
+/**
+ * Header at the start of a log file: the group at base starts right after the header, and replay starts at redo.
+ */
+struct LogFileHeader {
+    std::uint32_t magic;
+    std::uint32_t padding;
+    Lsn base;
+    Lsn redo;
+};
+
+/**
+ * Commit record heading a group: the group counts only if all length bytes after it match the checksum.
+ */
+struct LogGroupHeader {
+    std::uint32_t magic;
+    std::uint32_t count;
+    std::uint32_t length;
+    std::uint32_t checksum;
+};
+
+/**
+ * Header of a record: length bytes following it go at offset in the page.
+ */
+struct LogRecordHeader {
+    PageId pageNo;
+    std::uint16_t offset;
+    std::uint16_t length;
+};
+
+/**
+ * FNV-1a hash of a group's records.
+ */
+static std::uint32_t checksum(const char* data, const std::size_t length) {
+    std::uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void LogGroup::addRecord(const PageId pageNo, const std::size_t offset, const void* data, const std::size_t length) {
+    LogRecordHeader header;
+    header.pageNo = pageNo;
+    header.offset = (std::uint16_t)offset;
+    header.length = (std::uint16_t)length;
+    const char* headerBytes = reinterpret_cast<const char*>(&header);
+    bytes.insert(bytes.end(), headerBytes, headerBytes + sizeof(header));
+    bytes.insert(bytes.end(), static_cast<const char*>(data), static_cast<const char*>(data) + length);
+    count++;
+}
+
+void LogGroup::addChanges(const PageId pageNo, const Page& before, const Page& after) {
+    // pages are compared a word at a time, and nearby changed runs go into one record
+    const std::uint64_t* old = reinterpret_cast<const std::uint64_t*>(&before);
+    const std::uint64_t* now = reinterpret_cast<const std::uint64_t*>(&after);
+    const std::size_t words = Page::SIZE / sizeof(std::uint64_t);
+    std::size_t i = 0;
+    while (i < words) {
+        if (old[i] == now[i]) {
+            i++;
+            continue;
+        }
+        std::size_t last = i;
+        for (std::size_t j = i + 1; j < words && j <= last + LOG_MERGE_WORDS; j++) {
+            if (old[j] != now[j]) last = j;
+        }
+        addRecord(pageNo, i * sizeof(std::uint64_t), now + i, (last + 1 - i) * sizeof(std::uint64_t));
+        i = last + 1;
+    }
+}
+
+void LogGroup::addPage(const PageId pageNo, const Page& page) {
+    addRecord(pageNo, 0, &page, Page::SIZE);
+}
+
+LogManager::LogManager(const std::string& name)
+    : name(name), appended(0), durable(0), base(0), flushing(false) {
+    fd = ::open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw FileOpenException(name);
+    try {
+        writeHeader(0);
+    } catch (const LogWriteException& e) {
+        ::close(fd);
+        throw;
+    }
+}
+
+LogManager::~LogManager() {
+    ::close(fd);
+}
+
+Lsn LogManager::append(const LogGroup& group) {
+    const std::vector<char>& records = group.records();
+    LogGroupHeader header;
+    header.magic = LOG_GROUP_MAGIC;
+    header.count = group.size();
+    header.length = records.size();
+    header.checksum = checksum(records.data(), records.size());
+
+    std::lock_guard<std::mutex> guard(lock);
+    const char* headerBytes = reinterpret_cast<const char*>(&header);
+    buffer.insert(buffer.end(), headerBytes, headerBytes + sizeof(header));
+    buffer.insert(buffer.end(), records.begin(), records.end());
+    appended += sizeof(header) + records.size();
+    return appended;
+}
+
+void LogManager::flush(const Lsn lsn) {
+    std::unique_lock<std::mutex> guard(lock);
+    const Lsn target = std::min(lsn, appended);
+    while (durable < target) {
+        if (flushing) {
+            flushed.wait(guard);
+            continue;
+        }
+        // this thread writes every group appended so far, its own and those of the threads waiting behind it
+        flushing = true;
+        std::vector<char> batch;
+        batch.swap(buffer);
+        const Lsn end = appended;
+        const off_t offset = (off_t)(LOG_HEADER_SIZE + end - batch.size() - base);
+        guard.unlock();
+
+        std::size_t done = 0;
+        int error = 0;
+        while (done < batch.size() && error == 0) {
+            ssize_t n = ::pwrite(fd, batch.data() + done, batch.size() - done, offset + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) error = n < 0 ? errno : EIO;
+            else done += n;
+        }
+        if (error == 0 && ::fdatasync(fd) != 0) error = errno;
+
+        guard.lock();
+        flushing = false;
+        flushed.notify_all();
+        if (error != 0) {
+            // the groups go back in front of those appended since, for the next flush to write out again
+            batch.insert(batch.end(), buffer.begin(), buffer.end());
+            buffer.swap(batch);
+            throw LogWriteException(name, error);
+        }
+        durable = end;
+    }
+}
+
+Lsn LogManager::end() {
+    std::lock_guard<std::mutex> guard(lock);
+    return appended;
+}
+
+void LogManager::checkpoint(const Lsn redo) {
+    std::lock_guard<std::mutex> guard(lock);
+    writeHeader(redo);
+#ifdef FALLOC_FL_PUNCH_HOLE
+    // whole blocks before the redo LSN are never read again
+    const off_t unused = (off_t)((redo - base) & ~(Lsn)(LOG_HEADER_SIZE - 1));
+    if (unused > 0) ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, LOG_HEADER_SIZE, unused);
+#endif
+}
+
+void LogManager::writeHeader(const Lsn redo) {
+    LogFileHeader header;
+    header.magic = LOG_FILE_MAGIC;
+    header.padding = 0;
+    header.base = base;
+    header.redo = redo;
+    ssize_t n;
+    do {
+        n = ::pwrite(fd, &header, sizeof(header), 0);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) throw LogWriteException(name, errno);
+    if (n != (ssize_t)sizeof(header)) throw LogWriteException(name, EIO);
+    if (::fdatasync(fd) != 0) throw LogWriteException(name, errno);
+}
+
+void LogManager::truncate() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (flushing) flushed.wait(guard);
+    buffer.clear();
+    durable = appended;
+    base = appended;
+    if (::ftruncate(fd, 0) == 0) writeHeader(base);
+}
+
+std::size_t LogManager::replay(const std::string& name, BlobFile& file) {
+    const int fd = ::open(name.c_str(), O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat info;
+    std::vector<char> log;
+    if (fstat(fd, &info) == 0) log.resize(info.st_size);
+    std::size_t size = 0;
+    while (size < log.size()) {
+        ssize_t n = ::pread(fd, log.data() + size, log.size() - size, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        size += n;
+    }
+    ::close(fd);
+
+    // replay starts at the redo LSN of the last checkpoint; a log without a whole header holds no group
+    LogFileHeader master;
+    if (size < sizeof(master)) size = 0;
+    if (size > 0) memcpy(&master, log.data(), sizeof(master));
+    if (size > 0 && (master.magic != LOG_FILE_MAGIC || master.redo < master.base)) size = 0;
+
+    // pages are read once, changed by every group in log order and written back at the end
+    std::map<PageId, Page> pages;
+    std::size_t groups = 0;
+    std::size_t pos = size > 0 ? LOG_HEADER_SIZE + (std::size_t)(master.redo - master.base) : 0;
+    while (pos + sizeof(LogGroupHeader) <= size) {
+        LogGroupHeader header;
+        memcpy(&header, log.data() + pos, sizeof(header));
+        const char* records = log.data() + pos + sizeof(header);
+        if (header.magic != LOG_GROUP_MAGIC || header.length > size - pos - sizeof(header) ||
+            checksum(records, header.length) != header.checksum)
+            break;
+
+        std::size_t offset = 0;
+        for (std::uint32_t i = 0; i < header.count && offset + sizeof(LogRecordHeader) <= header.length; i++) {
+            LogRecordHeader record;
+            memcpy(&record, records + offset, sizeof(record));
+            offset += sizeof(record);
+            if (record.offset + record.length > Page::SIZE || offset + record.length > header.length) break;
+            std::map<PageId, Page>::iterator page = pages.find(record.pageNo);
+            if (page == pages.end()) {
+                // a page torn by the crash fails its checksum, and is written back whole with a new one below
+                page = pages.insert(std::make_pair(record.pageNo, Page())).first;
+                file.readPageInto(record.pageNo, page->second, false /* verify */);
+            }
+            memcpy(reinterpret_cast<char*>(&page->second) + record.offset, records + offset, record.length);
+            offset += record.length;
+        }
+        pos += sizeof(header) + header.length;
+        groups++;
+    }
+
+    if (!pages.empty()) {
+        for (std::map<PageId, Page>::iterator page = pages.begin(); page != pages.end(); ++page) {
+            file.writePage(page->first, page->second);
+        }
+        file.restoreExtent(pages.rbegin()->first + 1);
+        file.sync();
+    }
+    ::unlink(name.c_str());
+    return groups;
+}
+
+}  // namespace badgerdb
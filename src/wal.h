@@ -0,0 +1,225 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+class BlobFile;
+
+/**
+ * @brief Log sequence number: the position just past a group in the log, counted from the log's creation.
+ */
+typedef std::uint64_t Lsn;
+
+/**
+ * @brief Unchanged words between two changed runs of a page up to which LogGroup::addChanges logs the runs as
+ * one, since every record carries a header of its own.
+ */
+const int LOG_MERGE_WORDS = 2;
+
+/**
+ * @brief Bytes at the start of a log file holding its header, the master record of the last checkpoint. Groups
+ * follow it.
+ */
+const std::size_t LOG_HEADER_SIZE = 4096;
+
+/**
+ * @brief The changes one operation made to the pages of a file, logged and replayed as a whole.
+ *
+ * Each record redoes a change by writing a range of bytes at an offset within a page, so replaying a record
+ * twice, or over a page that already holds the change, leaves the page the same.
+ */
+class LogGroup {
+   public:
+    /**
+     * Constructor of LogGroup class, creates an empty group.
+     */
+    LogGroup() : count(0) {}
+
+    /**
+     * Adds records for the bytes of a page that differ between two images of it.
+     *
+     * @param pageNo  Page number
+     * @param before  The page before the operation
+     * @param after   The page after it
+     */
+    void addChanges(const PageId pageNo, const Page& before, const Page& after);
+
+    /**
+     * Adds a record holding the whole of a page, for a page the operation created.
+     *
+     * @param pageNo  Page number
+     * @param page    The page
+     */
+    void addPage(const PageId pageNo, const Page& page);
+
+    /**
+     * Returns true if the group holds no record.
+     */
+    bool empty() const { return count == 0; }
+
+    /**
+     * Records of the group, laid out back to back.
+     */
+    const std::vector<char>& records() const { return bytes; }
+
+    /**
+     * Number of records in the group.
+     */
+    std::uint32_t size() const { return count; }
+
+   private:
+    std::vector<char> bytes;
+    std::uint32_t count;
+
+    void addRecord(const PageId pageNo, const std::size_t offset, const void* data, const std::size_t length);
+};
+
+/**
+ * @brief Redo log of the page changes made to one file.
+ *
+ * Operations append a group each, as one commit record checksummed over its changes; a group whose commit
+ * record is torn or missing was not committed and is never replayed. Appending only copies the group into
+ * memory. flush makes every group up to an LSN durable: the first thread to ask writes and syncs everything
+ * appended so far, and threads asking in the meantime wait and find their groups written by it, so commits
+ * arriving together share one sync. The buffer manager flushes a page's log up to the page's LSN before it
+ * writes the page back, so pages need no sync of their own.
+ *
+ * A checkpoint records in the log's header the redo LSN, the oldest LSN replay has to start from for every change
+ * not yet on disk; replay skips whatever comes before it, and the space it took is handed back to the file system
+ * where it supports punching holes into files.
+ */
+class LogManager {
+   public:
+    /**
+     * Constructor of LogManager class, creates the log or empties an existing one.
+     *
+     * @param name  Name of the log file
+     * @throws  FileOpenException  If the log cannot be opened
+     * @throws  LogWriteException  If its header cannot be written
+     */
+    explicit LogManager(const std::string& name);
+
+    /**
+     * Destructor of LogManager class, closes the log. Groups not flushed yet are lost.
+     */
+    ~LogManager();
+
+    /**
+     * Appends a group to the log.
+     *
+     * @param group   Group to append
+     * @return        LSN to flush up to for the group to be durable
+     */
+    Lsn append(const LogGroup& group);
+
+    /**
+     * Returns once every group up to an LSN is on disk.
+     *
+     * @param lsn   LSN returned by append
+     * @throws  LogWriteException  If the log cannot be written or synced; the groups stay buffered, for a later
+     *                             flush to write out again
+     */
+    void flush(const Lsn lsn);
+
+    /**
+     * Returns the LSN past the last group appended. A group appended afterwards starts at or after it.
+     */
+    Lsn end();
+
+    /**
+     * Records a checkpoint: replay starts from redo from now on. Every change made by groups before redo has
+     * to be on disk already.
+     *
+     * @param redo  LSN at the start of a group, or end()
+     * @throws  LogWriteException  If the header cannot be written or synced
+     */
+    void checkpoint(const Lsn redo);
+
+    /**
+     * Empties the log. Every page the groups appended so far changed has to be on disk already, and no group
+     * may be appended or flushed meanwhile.
+     *
+     * @throws  LogWriteException  If the header cannot be written or synced
+     */
+    void truncate();
+
+    /**
+     * Replays the committed groups of a log, from the redo LSN of its last checkpoint on, onto the file its
+     * changes were made to, syncs the file and removes the log. The log stops at the first group that is not
+     * whole. The file's header records neither the pages
+     * the groups allocated nor the pages they freed, so it is grown to cover every page replayed and its free
+     * list is dropped: free pages are leaked rather than risk reusing a page still in use.
+     *
+     * @param name  Name of the log file
+     * @param file  File the log's changes were made to
+     * @return      Number of groups replayed; 0 if there is no log
+     */
+    static std::size_t replay(const std::string& name, BlobFile& file);
+
+   private:
+    /**
+     * Name of the log file
+     */
+    std::string name;
+
+    /**
+     * Descriptor of the log file
+     */
+    int fd;
+
+    /**
+     * Guards everything below
+     */
+    std::mutex lock;
+
+    /**
+     * Signalled when a flush ends
+     */
+    std::condition_variable flushed;
+
+    /**
+     * Groups appended but not yet handed to a flush
+     */
+    std::vector<char> buffer;
+
+    /**
+     * LSN past the last group appended, and past the last one on disk
+     */
+    Lsn appended;
+    Lsn durable;
+
+    /**
+     * LSN at the start of the log file, which moves on when the log is emptied
+     */
+    Lsn base;
+
+    /**
+     * True while a thread writes and syncs the log
+     */
+    bool flushing;
+
+    /**
+     * Writes and syncs the header with the given redo LSN. Called with lock held.
+     */
+    void writeHeader(const Lsn redo);
+
+    LogManager(const LogManager&);
+    LogManager& operator=(const LogManager&);
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,202 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Base of WriteBuffer, so that an index holds its buffer whatever its key type.
+ */
+class WriteBufferBase {
+   public:
+    virtual ~WriteBufferBase() {}
+};
+
+/**
+ * @brief In-memory sorted delta of index entries inserted but not yet in the tree.
+ *
+ * Inserts only add their entry here; once capacity entries have gathered, the thread that filled the buffer
+ * takes them all and inserts them into the tree in key order as one batch, so entries bound for the same leaf
+ * share one read and write of it. Entries taken stay visible to find and remove until the batch is in the tree,
+ * so a reader looking here before the tree never misses an entry moving between the two. One batch is flushed
+ * at a time; inserts keep gathering the next one meanwhile.
+ */
+template <class K>
+class WriteBuffer : public WriteBufferBase {
+   public:
+    /**
+     * Constructor of WriteBuffer class, creates an empty buffer.
+     *
+     * @param capacity  Entries gathered before a flush is due
+     */
+    explicit WriteBuffer(const std::size_t capacity) : capacity(capacity), flushing(false) {}
+
+    /**
+     * Adds an entry.
+     *
+     * @return  True if the buffer holds capacity entries now, and the caller should flush it
+     */
+    bool add(const K& key, const RecordId rid) {
+        std::lock_guard<std::mutex> guard(lock);
+        pending.insert(std::make_pair(key, rid));
+        return pending.size() >= capacity;
+    }
+
+    /**
+     * Finds the entries equal to key, whether gathered or being flushed.
+     *
+     * @param key   Key to look up
+     * @param out   Receives the record ID of each match; NULL to stop at the first one
+     * @return      True if any entry matched
+     */
+    bool find(const K& key, std::vector<RecordId>* out) {
+        std::lock_guard<std::mutex> guard(lock);
+        return collect(pending, key, out) | collect(taken, key, out);
+    }
+
+    /**
+     * Copies the entries with keys inside a range, whether gathered or being flushed, in key order.
+     *
+     * @param low           Low bound
+     * @param lowInclusive  True if low itself is inside
+     * @param high          High bound
+     * @param highInclusive True if high itself is inside
+     * @param out           Receives the entries
+     */
+    void range(const K& low, const bool lowInclusive, const K& high, const bool highInclusive,
+               std::vector<std::pair<K, RecordId> >& out) {
+        std::lock_guard<std::mutex> guard(lock);
+        const std::size_t first = out.size();
+        collectRange(pending, low, lowInclusive, high, highInclusive, out);
+        const std::size_t middle = out.size();
+        collectRange(taken, low, lowInclusive, high, highInclusive, out);
+        std::inplace_merge(out.begin() + first, out.begin() + middle, out.end(),
+                           [](const std::pair<K, RecordId>& a, const std::pair<K, RecordId>& b) {
+                               return a.first < b.first;
+                           });
+    }
+
+    /**
+     * Removes a gathered entry. An entry being flushed is left to the flush, which is waited for, so that the
+     * caller finds the entry in the tree.
+     *
+     * @return  True if the entry was gathered here and is gone now; false if the tree has to be searched
+     */
+    bool remove(const K& key, const RecordId rid) {
+        std::unique_lock<std::mutex> guard(lock);
+        if (erase(pending, key, rid)) return true;
+        while (flushing && holds(taken, key, rid)) flushed.wait(guard);
+        return false;
+    }
+
+    /**
+     * Takes every gathered entry for a flush, in key order, once an earlier flush has ended. The entries stay
+     * visible until done is called.
+     *
+     * @param entries   Receives the entries
+     * @return          False if there was nothing to take
+     */
+    bool take(std::vector<std::pair<K, RecordId> >& entries) {
+        std::unique_lock<std::mutex> guard(lock);
+        while (flushing) flushed.wait(guard);
+        if (pending.empty()) return false;
+        taken.swap(pending);
+        flushing = true;
+        entries.assign(taken.begin(), taken.end());
+        return true;
+    }
+
+    /**
+     * Ends the flush of the entries taken, which are in the tree now.
+     */
+    void done() {
+        std::lock_guard<std::mutex> guard(lock);
+        taken.clear();
+        flushing = false;
+        flushed.notify_all();
+    }
+
+   private:
+    typedef std::multimap<K, RecordId> Entries;
+
+    /**
+     * Entries gathered before a flush is due
+     */
+    const std::size_t capacity;
+
+    /**
+     * Guards everything below
+     */
+    std::mutex lock;
+
+    /**
+     * Signalled when a flush ends
+     */
+    std::condition_variable flushed;
+
+    /**
+     * Entries gathered for the next flush, and those of the flush under way
+     */
+    Entries pending;
+    Entries taken;
+
+    /**
+     * True while a flush is under way
+     */
+    bool flushing;
+
+    static bool collect(const Entries& entries, const K& key, std::vector<RecordId>* out) {
+        std::pair<typename Entries::const_iterator, typename Entries::const_iterator> range = entries.equal_range(key);
+        if (out == NULL) return range.first != range.second;
+        for (typename Entries::const_iterator iter = range.first; iter != range.second; ++iter)
+            out->push_back(iter->second);
+        return range.first != range.second;
+    }
+
+    static void collectRange(const Entries& entries, const K& low, const bool lowInclusive, const K& high,
+                             const bool highInclusive, std::vector<std::pair<K, RecordId> >& out) {
+        typename Entries::const_iterator iter = lowInclusive ? entries.lower_bound(low) : entries.upper_bound(low);
+        const typename Entries::const_iterator end = highInclusive ? entries.upper_bound(high) : entries.lower_bound(high);
+        // an empty range can leave iter at or past end, even at entries.end() with end before it
+        if (iter == entries.end() || high < iter->first || (!highInclusive && !(iter->first < high))) return;
+        for (; iter != end; ++iter) out.push_back(*iter);
+    }
+
+    static bool holds(const Entries& entries, const K& key, const RecordId rid) {
+        std::pair<typename Entries::const_iterator, typename Entries::const_iterator> range = entries.equal_range(key);
+        for (typename Entries::const_iterator iter = range.first; iter != range.second; ++iter) {
+            if (iter->second == rid) return true;
+        }
+        return false;
+    }
+
+    static bool erase(Entries& entries, const K& key, const RecordId rid) {
+        std::pair<typename Entries::iterator, typename Entries::iterator> range = entries.equal_range(key);
+        for (typename Entries::iterator iter = range.first; iter != range.second; ++iter) {
+            if (!(iter->second == rid)) continue;
+            entries.erase(iter);
+            return true;
+        }
+        return false;
+    }
+
+    WriteBuffer(const WriteBuffer&);
+    WriteBuffer& operator=(const WriteBuffer&);
+};
+
+}  // namespace badgerdb